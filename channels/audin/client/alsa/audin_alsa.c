@@ -193,6 +193,7 @@ static void* audin_alsa_thread_func(void* arg)
 	buffer = (BYTE*) malloc(rbytes_per_frame * alsa->frames_per_packet);
 	ZeroMemory(buffer, rbytes_per_frame * alsa->frames_per_packet);
 	freerdp_dsp_context_reset_adpcm(alsa->dsp_context);
+	freerdp_dsp_context_reset_resampler(alsa->dsp_context);
 
 	do
 	{
@@ -36,6 +36,7 @@
 #include <freerdp/svc.h>
 #include <freerdp/addin.h>
 #include <freerdp/utils/file.h>
+#include <freerdp/utils/buffer.h>
 #include <freerdp/utils/event.h>
 #include <freerdp/utils/debug.h>
 
@@ -391,6 +392,7 @@ struct _SYNC_DATA
 	UINT32 DataLength;
 	void* UserData;
 	int Index;
+	int OpenHandle;
 };
 typedef struct _SYNC_DATA SYNC_DATA;
 
@@ -835,6 +837,7 @@ static UINT32 FREERDP_CC MyVirtualChannelWrite(UINT32 openHandle, void* pData, U
 	item->DataLength = dataLength;
 	item->UserData = pUserData;
 	item->Index = index;
+	item->OpenHandle = openHandle;
 
 	InterlockedPushEntrySList(channels->pSyncDataList, &(item->ItemEntry));
 
@@ -1225,37 +1228,78 @@ FREERDP_API int freerdp_channels_send_event(rdpChannels* channels, RDP_EVENT* ev
 	return 0;
 }
 
+/**
+ * Called when the channel send queue is done with the data of a write:
+ * hand it back to the plugin. The channel may be gone by then.
+ */
+static void freerdp_channels_write_complete(SHARED_BUFFER* buffer)
+{
+	int index;
+	rdpChannels* channels;
+	struct channel_data* lchannel_data;
+	SYNC_DATA* item = (SYNC_DATA*) buffer->context;
+
+	channels = freerdp_channels_find_by_open_handle(item->OpenHandle, &index);
+
+	if (channels != NULL)
+	{
+		lchannel_data = channels->channels_data + index;
+
+		if (lchannel_data->open_event_proc != 0)
+		{
+			lchannel_data->open_event_proc(lchannel_data->open_handle,
+				CHANNEL_EVENT_WRITE_COMPLETE, item->UserData, sizeof(void*), sizeof(void*), 0);
+		}
+	}
+
+	_aligned_free(item);
+}
+
 /**
  * called only from main thread
+ *
+ * The data is sent in place: the send queue references it until it is
+ * sent, and the write completes with the last reference.
  */
 static void freerdp_channels_process_sync(rdpChannels* channels, freerdp* instance)
 {
 	SYNC_DATA* item;
+	SHARED_BUFFER* buffer;
+	PSLIST_ENTRY entry;
+	PSLIST_ENTRY items;
 	rdpChannel* lrdp_channel;
 	struct channel_data* lchannel_data;
 
-	while (QueryDepthSList(channels->pSyncDataList) > 0)
+	/* the list is LIFO, reverse it so that each channel is written in order */
+	items = NULL;
+
+	while ((entry = InterlockedPopEntrySList(channels->pSyncDataList)) != NULL)
 	{
-		item = (SYNC_DATA*) InterlockedPopEntrySList(channels->pSyncDataList);
+		entry->Next = items;
+		items = entry;
+	}
 
-		if (!item)
-			break;
+	while (items)
+	{
+		item = (SYNC_DATA*) items;
+		items = items->Next;
 
 		lchannel_data = channels->channels_data + item->Index;
 
 		lrdp_channel = freerdp_channels_find_channel_by_name(channels, instance->settings,
 			lchannel_data->name, &item->Index);
 
-		if (lrdp_channel != NULL)
-			instance->SendChannelData(instance, lrdp_channel->ChannelId, item->Data, item->DataLength);
+		buffer = shared_buffer_attach((BYTE*) item->Data, item->DataLength, freerdp_channels_write_complete, item);
 
-		if (lchannel_data->open_event_proc != 0)
+		if (lrdp_channel != NULL)
 		{
-			lchannel_data->open_event_proc(lchannel_data->open_handle,
-				CHANNEL_EVENT_WRITE_COMPLETE, item->UserData, sizeof(void*), sizeof(void*), 0);
+			if (instance->SendChannelBuffer)
+				instance->SendChannelBuffer(instance, lrdp_channel->ChannelId, buffer, buffer->data, buffer->size);
+			else
+				instance->SendChannelData(instance, lrdp_channel->ChannelId, buffer->data, buffer->size);
 		}
 
-		_aligned_free(item);
+		shared_buffer_unref(buffer);
 	}
 }
 
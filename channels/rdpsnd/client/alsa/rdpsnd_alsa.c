@@ -231,6 +231,7 @@ static void rdpsnd_alsa_open(rdpsndDevicePlugin* device, rdpsndFormat* format, i
 	else
 	{
 		freerdp_dsp_context_reset_adpcm(alsa->dsp_context);
+		freerdp_dsp_context_reset_resampler(alsa->dsp_context);
 		rdpsnd_alsa_set_format(device, format, latency);
 		rdpsnd_alsa_open_mixer(alsa);
 	}
@@ -417,6 +418,20 @@ static void rdpsnd_alsa_start(rdpsndDevicePlugin* device)
 	snd_pcm_start(alsa->out_handle);
 }
 
+static UINT32 rdpsnd_alsa_get_latency(rdpsndDevicePlugin* device)
+{
+	snd_pcm_sframes_t frames;
+	rdpsndAlsaPlugin* alsa = (rdpsndAlsaPlugin*) device;
+
+	if (alsa->out_handle == 0)
+		return 0;
+
+	if ((snd_pcm_delay(alsa->out_handle, &frames) < 0) || (frames <= 0))
+		return 0;
+
+	return (UINT32) ((frames * 1000) / alsa->actual_rate);
+}
+
 COMMAND_LINE_ARGUMENT_A rdpsnd_alsa_args[] =
 {
 	{ "dev", COMMAND_LINE_VALUE_REQUIRED, "<device>", NULL, NULL, -1, NULL, "device" },
@@ -473,6 +488,7 @@ int freerdp_rdpsnd_client_subsystem_entry(PFREERDP_RDPSND_DEVICE_ENTRY_POINTS pE
 	alsa->device.Start = rdpsnd_alsa_start;
 	alsa->device.Close = rdpsnd_alsa_close;
 	alsa->device.Free = rdpsnd_alsa_free;
+	alsa->device.GetLatency = rdpsnd_alsa_get_latency;
 
 	args = pEntryPoints->args;
 	rdpsnd_alsa_parse_addin_args((rdpsndDevicePlugin*) alsa, args);
@@ -523,6 +523,25 @@ static void rdpsnd_pulse_start(rdpsndDevicePlugin* device)
 	pa_stream_trigger(pulse->stream, NULL, NULL);
 }
 
+static UINT32 rdpsnd_pulse_get_latency(rdpsndDevicePlugin* device)
+{
+	int negative;
+	pa_usec_t usec;
+	rdpsndPulsePlugin* pulse = (rdpsndPulsePlugin*) device;
+
+	if (!pulse->stream)
+		return 0;
+
+	pa_threaded_mainloop_lock(pulse->mainloop);
+
+	if ((pa_stream_get_latency(pulse->stream, &usec, &negative) < 0) || negative)
+		usec = 0;
+
+	pa_threaded_mainloop_unlock(pulse->mainloop);
+
+	return (UINT32) (usec / 1000);
+}
+
 COMMAND_LINE_ARGUMENT_A rdpsnd_pulse_args[] =
 {
 	{ "dev", COMMAND_LINE_VALUE_REQUIRED, "<device>", NULL, NULL, -1, NULL, "device" },
@@ -580,6 +599,7 @@ int freerdp_rdpsnd_client_subsystem_entry(PFREERDP_RDPSND_DEVICE_ENTRY_POINTS pE
 	pulse->device.Start = rdpsnd_pulse_start;
 	pulse->device.Close = rdpsnd_pulse_close;
 	pulse->device.Free = rdpsnd_pulse_free;
+	pulse->device.GetLatency = rdpsnd_pulse_get_latency;
 
 	args = pEntryPoints->args;
 	rdpsnd_pulse_parse_addin_args((rdpsndDevicePlugin*) pulse, args);
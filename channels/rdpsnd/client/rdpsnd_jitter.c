@@ -0,0 +1,212 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Audio Output Virtual Channel Jitter Buffer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/crt.h>
+
+#include "rdpsnd_jitter.h"
+
+/**
+ * Playing time of a wave in milliseconds, 0 if the format is unknown.
+ */
+
+UINT32 rdpsnd_jitter_wave_duration(rdpsndFormat* format, int size)
+{
+	UINT32 blocks;
+	UINT32 samples;
+	UINT32 channels;
+
+	channels = format->nChannels;
+
+	if ((size <= 0) || (format->nSamplesPerSec == 0) || (format->nBlockAlign == 0) || (channels == 0))
+		return 0;
+
+	blocks = (size + format->nBlockAlign - 1) / format->nBlockAlign;
+
+	switch (format->wFormatTag)
+	{
+		case 0x01: /* PCM */
+			samples = size / format->nBlockAlign;
+			break;
+
+		case 0x02: /* MS ADPCM */
+			if (format->nBlockAlign < 7 * channels)
+				return 0;
+			samples = blocks * (((format->nBlockAlign - 7 * channels) * 2) / channels + 2);
+			break;
+
+		case 0x11: /* IMA ADPCM */
+			if (format->nBlockAlign < 4 * channels)
+				return 0;
+			samples = blocks * (((format->nBlockAlign - 4 * channels) * 2) / channels + 1);
+			break;
+
+		default:
+			return 0;
+	}
+
+	return (UINT32) (((UINT64) samples * 1000) / format->nSamplesPerSec);
+}
+
+void rdpsnd_jitter_init(rdpsndJitterBuffer* jitter, UINT32 min_ms, UINT32 max_ms)
+{
+	ZeroMemory(jitter, sizeof(rdpsndJitterBuffer));
+
+	jitter->min_ms = min_ms;
+	jitter->max_ms = MAX(min_ms, max_ms);
+	jitter->target_ms = min_ms;
+}
+
+/**
+ * Start of a new stream: the device is closed or has been drained, so the
+ * next wave is buffered again. The jitter estimate is kept, it describes
+ * the network rather than the stream.
+ */
+
+void rdpsnd_jitter_reset(rdpsndJitterBuffer* jitter, UINT32 now)
+{
+	jitter->has_arrival = FALSE;
+	jitter->prefilling = FALSE;
+	jitter->held_ms = 0;
+	jitter->play_end = now;
+}
+
+void rdpsnd_jitter_arrival(rdpsndJitterBuffer* jitter, UINT16 wTimeStamp, UINT32 arrival)
+{
+	INT32 d;
+	UINT32 gap;
+
+	if (jitter->has_arrival)
+	{
+		gap = arrival - jitter->last_arrival;
+
+		if (gap < RDPSND_JITTER_MAX_GAP_MS)
+		{
+			d = (INT32) gap - (INT32) ((UINT16) (wTimeStamp - jitter->last_timestamp));
+
+			if (d < 0)
+				d = -d;
+
+			/* J += (|D| - J) / 16, kept scaled by 16 */
+			jitter->jitter_x16 = jitter->jitter_x16 + d - (jitter->jitter_x16 >> 4);
+
+			jitter->target_ms = jitter->min_ms + (jitter->jitter_x16 >> 2);
+
+			if (jitter->target_ms > jitter->max_ms)
+				jitter->target_ms = jitter->max_ms;
+		}
+	}
+
+	jitter->has_arrival = TRUE;
+	jitter->last_timestamp = wTimeStamp;
+	jitter->last_arrival = arrival;
+}
+
+/**
+ * Decide what to do with an arriving wave, given the amount of audio the
+ * device still has queued.
+ * @return RDPSND_JITTER_HOLD to keep the wave back, RDPSND_JITTER_START to
+ * play the held waves and this one then start the device, or
+ * RDPSND_JITTER_PLAY to play it right away
+ */
+
+int rdpsnd_jitter_hold(rdpsndJitterBuffer* jitter, UINT32 now, UINT32 duration, UINT32 queued_ms)
+{
+	if (!jitter->prefilling)
+	{
+		if (queued_ms >= RDPSND_JITTER_UNDERRUN_MS)
+			return RDPSND_JITTER_PLAY;
+
+		jitter->prefilling = TRUE;
+		jitter->prefill_start = now;
+		jitter->held_ms = 0;
+	}
+
+	jitter->held_ms += duration;
+
+	if ((jitter->held_ms >= jitter->target_ms) || (now - jitter->prefill_start >= jitter->target_ms))
+	{
+		jitter->prefilling = FALSE;
+		return RDPSND_JITTER_START;
+	}
+
+	return RDPSND_JITTER_HOLD;
+}
+
+/**
+ * Whether the oldest held wave has waited long enough, in which case the
+ * held waves are to be played without waiting for more.
+ */
+
+BOOL rdpsnd_jitter_expired(rdpsndJitterBuffer* jitter, UINT32 now)
+{
+	if (!jitter->prefilling)
+		return FALSE;
+
+	if (now - jitter->prefill_start < jitter->target_ms)
+		return FALSE;
+
+	jitter->prefilling = FALSE;
+
+	return TRUE;
+}
+
+/* the stream ended, the held waves are played as they are */
+void rdpsnd_jitter_flush(rdpsndJitterBuffer* jitter)
+{
+	jitter->prefilling = FALSE;
+	jitter->held_ms = 0;
+}
+
+BOOL rdpsnd_jitter_deadline(rdpsndJitterBuffer* jitter, UINT32* deadline)
+{
+	if (!jitter->prefilling)
+		return FALSE;
+
+	*deadline = jitter->prefill_start + jitter->target_ms;
+
+	return TRUE;
+}
+
+UINT32 rdpsnd_jitter_estimate_queued(rdpsndJitterBuffer* jitter, UINT32 now)
+{
+	if ((INT32) (jitter->play_end - now) <= 0)
+		return 0;
+
+	return jitter->play_end - now;
+}
+
+void rdpsnd_jitter_played(rdpsndJitterBuffer* jitter, UINT32 now, UINT32 duration)
+{
+	if ((INT32) (jitter->play_end - now) < 0)
+		jitter->play_end = now;
+
+	jitter->play_end += duration;
+}
+
+/**
+ * The WaveConfirm timestamp: the server timestamp of the wave advanced by
+ * the time the client took from its arrival to the end of its playback.
+ */
+
+UINT16 rdpsnd_jitter_confirm_timestamp(UINT16 wTimeStamp, UINT32 arrival, UINT32 played)
+{
+	return (UINT16) (wTimeStamp + (played - arrival));
+}
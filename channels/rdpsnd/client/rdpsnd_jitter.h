@@ -0,0 +1,87 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Audio Output Virtual Channel Jitter Buffer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __RDPSND_JITTER_H
+#define __RDPSND_JITTER_H
+
+#include <freerdp/types.h>
+#include <freerdp/channels/rdpsnd.h>
+
+/* default bounds of the playout delay when no latency is configured */
+#define RDPSND_JITTER_MIN_MS		40
+#define RDPSND_JITTER_MAX_MS		400
+
+/* queued audio below which the device is considered to have run dry */
+#define RDPSND_JITTER_UNDERRUN_MS	5
+
+/* wave gaps longer than this are pauses in the stream, not jitter */
+#define RDPSND_JITTER_MAX_GAP_MS	1000
+
+/* what to do with an arriving wave */
+#define RDPSND_JITTER_PLAY		0
+#define RDPSND_JITTER_HOLD		1
+#define RDPSND_JITTER_START		2
+
+typedef struct rdpsnd_jitter_buffer rdpsndJitterBuffer;
+
+/**
+ * Playout delay control for the waves of one stream.
+ *
+ * The interarrival jitter of the waves is estimated against the server
+ * timestamps as in RFC 3550, and the target delay follows it within
+ * [min_ms, max_ms]. Whenever the device has run dry, waves are held back
+ * until target_ms of audio is buffered or the oldest one has waited
+ * target_ms, then all are released to the device at once.
+ *
+ * For devices that cannot report how much audio they have queued, the
+ * queue is estimated from the durations of the waves played so far.
+ */
+struct rdpsnd_jitter_buffer
+{
+	UINT32 min_ms;
+	UINT32 max_ms;
+	UINT32 target_ms;
+
+	BOOL has_arrival;
+	UINT16 last_timestamp;
+	UINT32 last_arrival;
+	UINT32 jitter_x16;
+
+	BOOL prefilling;
+	UINT32 prefill_start;
+	UINT32 held_ms;
+
+	UINT32 play_end;
+};
+
+UINT32 rdpsnd_jitter_wave_duration(rdpsndFormat* format, int size);
+
+void rdpsnd_jitter_init(rdpsndJitterBuffer* jitter, UINT32 min_ms, UINT32 max_ms);
+void rdpsnd_jitter_reset(rdpsndJitterBuffer* jitter, UINT32 now);
+
+void rdpsnd_jitter_arrival(rdpsndJitterBuffer* jitter, UINT16 wTimeStamp, UINT32 arrival);
+int rdpsnd_jitter_hold(rdpsndJitterBuffer* jitter, UINT32 now, UINT32 duration, UINT32 queued_ms);
+BOOL rdpsnd_jitter_expired(rdpsndJitterBuffer* jitter, UINT32 now);
+void rdpsnd_jitter_flush(rdpsndJitterBuffer* jitter);
+BOOL rdpsnd_jitter_deadline(rdpsndJitterBuffer* jitter, UINT32* deadline);
+
+UINT32 rdpsnd_jitter_estimate_queued(rdpsndJitterBuffer* jitter, UINT32 now);
+void rdpsnd_jitter_played(rdpsndJitterBuffer* jitter, UINT32 now, UINT32 duration);
+
+UINT16 rdpsnd_jitter_confirm_timestamp(UINT16 wTimeStamp, UINT32 arrival, UINT32 played);
+
+#endif /* __RDPSND_JITTER_H */
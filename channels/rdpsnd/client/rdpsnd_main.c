@@ -41,12 +41,15 @@
 #include <freerdp/utils/svc_plugin.h>
 
 #include "rdpsnd_main.h"
+#include "rdpsnd_jitter.h"
 
 struct rdpsnd_plugin
 {
 	rdpSvcPlugin plugin;
 
 	LIST* data_out_list;
+	LIST* wave_list; /* waves held back by the jitter buffer */
+	rdpsndJitterBuffer jitter;
 
 	BYTE cBlockNo;
 	rdpsndFormat* supported_formats;
@@ -80,6 +83,15 @@ struct data_out_item
 	UINT32 out_timestamp;
 };
 
+struct wave_item
+{
+	STREAM* data;
+	UINT16 wTimeStamp;
+	BYTE cBlockNo;
+	UINT32 arrival;
+	UINT32 duration;
+};
+
 /* get time in milliseconds */
 static UINT32 get_mstime(void)
 {
@@ -104,6 +116,118 @@ static UINT32 get_mstime(void)
 #endif
 }
 
+/* milliseconds of audio the device has yet to play */
+static UINT32 rdpsnd_get_queued(rdpsndPlugin* rdpsnd, UINT32 now)
+{
+	if (rdpsnd->device && rdpsnd->device->GetLatency)
+		return rdpsnd->device->GetLatency(rdpsnd->device);
+
+	return rdpsnd_jitter_estimate_queued(&rdpsnd->jitter, now);
+}
+
+/**
+ * Arm the interval timer for the earliest of the pending deadlines: the
+ * next wave confirm, the release of the held waves and the device close.
+ * With none pending the channel thread sleeps until the next message.
+ */
+static void rdpsnd_schedule(rdpsndPlugin* rdpsnd)
+{
+	UINT32 now;
+	UINT32 deadline;
+	UINT32 jitter_deadline;
+	BOOL pending = FALSE;
+	struct data_out_item* item;
+
+	item = (struct data_out_item*) list_peek(rdpsnd->data_out_list);
+
+	if (item)
+	{
+		deadline = item->out_timestamp;
+		pending = TRUE;
+	}
+
+	if (rdpsnd_jitter_deadline(&rdpsnd->jitter, &jitter_deadline))
+	{
+		if (!pending || ((INT32) (jitter_deadline - deadline) < 0))
+			deadline = jitter_deadline;
+		pending = TRUE;
+	}
+
+	if (rdpsnd->is_open && rdpsnd->close_timestamp > 0)
+	{
+		if (!pending || ((INT32) (rdpsnd->close_timestamp - deadline) < 0))
+			deadline = rdpsnd->close_timestamp;
+		pending = TRUE;
+	}
+
+	if (!pending)
+	{
+		rdpsnd->plugin.interval_ms = 0;
+		return;
+	}
+
+	now = get_mstime();
+
+	if ((INT32) (deadline - now) < 1)
+		rdpsnd->plugin.interval_ms = 1;
+	else
+		rdpsnd->plugin.interval_ms = deadline - now;
+}
+
+/**
+ * Hand a wave to the device and queue its confirm for when the device will
+ * have played it, according to the audio it reports queued.
+ */
+static void rdpsnd_play_wave(rdpsndPlugin* rdpsnd, struct wave_item* wave)
+{
+	UINT32 now;
+	UINT32 played;
+	struct data_out_item* item;
+
+	if (rdpsnd->device)
+	{
+		IFCALL(rdpsnd->device->Play, rdpsnd->device, stream_get_head(wave->data), stream_get_size(wave->data));
+	}
+
+	now = get_mstime();
+	rdpsnd_jitter_played(&rdpsnd->jitter, now, wave->duration);
+	played = now + rdpsnd_get_queued(rdpsnd, now);
+
+	DEBUG_SVC("data_size %d duration_ms %u delay_ms %u",
+		stream_get_size(wave->data), wave->duration, played - wave->arrival);
+
+	item = (struct data_out_item*) malloc(sizeof(struct data_out_item));
+	ZeroMemory(item, sizeof(struct data_out_item));
+
+	item->data_out = stream_new(8);
+	stream_write_BYTE(item->data_out, SNDC_WAVECONFIRM);
+	stream_write_BYTE(item->data_out, 0);
+	stream_write_UINT16(item->data_out, 4);
+	stream_write_UINT16(item->data_out, rdpsnd_jitter_confirm_timestamp(wave->wTimeStamp, wave->arrival, played));
+	stream_write_BYTE(item->data_out, wave->cBlockNo); /* cConfirmedBlockNo */
+	stream_write_BYTE(item->data_out, 0); /* bPad */
+	item->out_timestamp = played;
+
+	list_enqueue(rdpsnd->data_out_list, item);
+
+	stream_free(wave->data);
+	free(wave);
+}
+
+/* play the waves held by the jitter buffer and start the device */
+static void rdpsnd_release_waves(rdpsndPlugin* rdpsnd)
+{
+	struct wave_item* wave;
+
+	while ((wave = (struct wave_item*) list_dequeue(rdpsnd->wave_list)) != NULL)
+		rdpsnd_play_wave(rdpsnd, wave);
+
+	if (rdpsnd->device)
+	{
+		IFCALL(rdpsnd->device->Start, rdpsnd->device);
+	}
+}
+
 /* process the linked list of data that has queued to be sent */
 static void rdpsnd_process_interval(rdpSvcPlugin* plugin)
 {
@@ -111,13 +235,16 @@ static void rdpsnd_process_interval(rdpSvcPlugin* plugin)
 	struct data_out_item* item;
 	UINT32 cur_time;
 
+	if (rdpsnd_jitter_expired(&rdpsnd->jitter, get_mstime()))
+		rdpsnd_release_waves(rdpsnd);
+
 	while (list_size(rdpsnd->data_out_list) > 0)
 	{
 		item = (struct data_out_item*) list_peek(rdpsnd->data_out_list);
 
 		cur_time = get_mstime();
 
-		if (!item || cur_time <= item->out_timestamp)
+		if (!item || ((INT32) (cur_time - item->out_timestamp) < 0))
 			break;
 
 		item = (struct data_out_item*) list_dequeue(rdpsnd->data_out_list);
@@ -131,7 +258,7 @@ static void rdpsnd_process_interval(rdpSvcPlugin* plugin)
 	{
 		cur_time = get_mstime();
 
-		if (cur_time > rdpsnd->close_timestamp)
+		if ((INT32) (cur_time - rdpsnd->close_timestamp) >= 0)
 		{
 			if (rdpsnd->device)
 				IFCALL(rdpsnd->device->Close, rdpsnd->device);
@@ -142,10 +269,7 @@ static void rdpsnd_process_interval(rdpSvcPlugin* plugin)
 		}
 	}
 
-	if (list_size(rdpsnd->data_out_list) == 0 && !rdpsnd->is_open)
-	{
-		rdpsnd->plugin.interval_ms = 0;
-	}
+	rdpsnd_schedule(rdpsnd);
 }
 
 static void rdpsnd_free_supported_formats(rdpsndPlugin* rdpsnd)
@@ -324,6 +448,7 @@ static void rdpsnd_process_message_wave_info(rdpsndPlugin* rdpsnd, STREAM* data_
 	{
 		rdpsnd->current_format = wFormatNo;
 		rdpsnd->is_open = TRUE;
+		rdpsnd_jitter_reset(&rdpsnd->jitter, rdpsnd->wave_timestamp);
 
 		if (rdpsnd->device)
 		{
@@ -343,13 +468,14 @@ static void rdpsnd_process_message_wave_info(rdpsndPlugin* rdpsnd, STREAM* data_
 	}
 }
 
-/* header is not removed from data in this function */
+/**
+ * header is not removed from data in this function,
+ * data_in is consumed by the wave or freed here
+ */
 static void rdpsnd_process_message_wave(rdpsndPlugin* rdpsnd, STREAM* data_in)
 {
-	UINT16 wTimeStamp;
-	UINT32 delay_ms;
-	UINT32 process_ms;
-	struct data_out_item* item;
+	UINT32 now;
+	struct wave_item* wave;
 
 	rdpsnd->expectingWave = 0;
 
@@ -358,48 +484,57 @@ static void rdpsnd_process_message_wave(rdpsndPlugin* rdpsnd, STREAM* data_in)
 	if (stream_get_size(data_in) != rdpsnd->waveDataSize)
 	{
 		DEBUG_WARN("size error");
+		stream_free(data_in);
 		return;
 	}
 
-	if (rdpsnd->device)
+	wave = (struct wave_item*) malloc(sizeof(struct wave_item));
+	ZeroMemory(wave, sizeof(struct wave_item));
+
+	wave->data = data_in;
+	wave->wTimeStamp = rdpsnd->wTimeStamp;
+	wave->cBlockNo = rdpsnd->cBlockNo;
+	wave->arrival = rdpsnd->wave_timestamp;
+
+	if (rdpsnd->current_format < rdpsnd->n_supported_formats)
 	{
-		IFCALL(rdpsnd->device->Play, rdpsnd->device, stream_get_head(data_in), stream_get_size(data_in));
+		wave->duration = rdpsnd_jitter_wave_duration(&rdpsnd->supported_formats[rdpsnd->current_format],
+				stream_get_size(data_in));
 	}
 
-	process_ms = get_mstime() - rdpsnd->wave_timestamp;
-	delay_ms = 250;
-	wTimeStamp = rdpsnd->wTimeStamp + delay_ms;
+	rdpsnd_jitter_arrival(&rdpsnd->jitter, wave->wTimeStamp, wave->arrival);
 
-	DEBUG_SVC("data_size %d delay_ms %u process_ms %u",
-		stream_get_size(data_in), delay_ms, process_ms);
+	now = get_mstime();
 
-	item = (struct data_out_item*) malloc(sizeof(struct data_out_item));
-	ZeroMemory(item, sizeof(struct data_out_item));
+	switch (rdpsnd_jitter_hold(&rdpsnd->jitter, now, wave->duration, rdpsnd_get_queued(rdpsnd, now)))
+	{
+		case RDPSND_JITTER_HOLD:
+			list_enqueue(rdpsnd->wave_list, wave);
+			break;
 
-	item->data_out = stream_new(8);
-	stream_write_BYTE(item->data_out, SNDC_WAVECONFIRM);
-	stream_write_BYTE(item->data_out, 0);
-	stream_write_UINT16(item->data_out, 4);
-	stream_write_UINT16(item->data_out, wTimeStamp);
-	stream_write_BYTE(item->data_out, rdpsnd->cBlockNo); /* cConfirmedBlockNo */
-	stream_write_BYTE(item->data_out, 0); /* bPad */
-	item->out_timestamp = rdpsnd->wave_timestamp + delay_ms;
+		case RDPSND_JITTER_START:
+			list_enqueue(rdpsnd->wave_list, wave);
+			rdpsnd_release_waves(rdpsnd);
+			break;
 
-	list_enqueue(rdpsnd->data_out_list, item);
-	rdpsnd->plugin.interval_ms = 10;
+		default:
+			rdpsnd_play_wave(rdpsnd, wave);
+			break;
+	}
+
+	rdpsnd_schedule(rdpsnd);
 }
 
 static void rdpsnd_process_message_close(rdpsndPlugin* rdpsnd)
 {
 	DEBUG_SVC("server closes.");
 
-	if (rdpsnd->device)
-	{
-		IFCALL(rdpsnd->device->Start, rdpsnd->device);
-	}
+	/* a stream shorter than the jitter buffer ends here, play what is held */
+	rdpsnd_jitter_flush(&rdpsnd->jitter);
+	rdpsnd_release_waves(rdpsnd);
 
 	rdpsnd->close_timestamp = get_mstime() + 2000;
-	rdpsnd->plugin.interval_ms = 10;
+	rdpsnd_schedule(rdpsnd);
 }
 
 static void rdpsnd_process_message_setvolume(rdpsndPlugin* rdpsnd, STREAM* data_in)
@@ -424,7 +559,6 @@ static void rdpsnd_process_receive(rdpSvcPlugin* plugin, STREAM* data_in)
 	if (rdpsnd->expectingWave)
 	{
 		rdpsnd_process_message_wave(rdpsnd, data_in);
-		stream_free(data_in);
 		return;
 	}
 
@@ -588,6 +722,7 @@ static void rdpsnd_process_connect(rdpSvcPlugin* plugin)
 	plugin->interval_callback = rdpsnd_process_interval;
 
 	rdpsnd->data_out_list = list_new();
+	rdpsnd->wave_list = list_new();
 	rdpsnd->latency = -1;
 
 	args = (ADDIN_ARGV*) plugin->channel_entry_points.pExtendedData;
@@ -595,6 +730,12 @@ static void rdpsnd_process_connect(rdpSvcPlugin* plugin)
 	if (args)
 		rdpsnd_process_addin_args(rdpsnd, args);
 
+	/* a configured latency is a fixed playout delay */
+	if (rdpsnd->latency > 0)
+		rdpsnd_jitter_init(&rdpsnd->jitter, rdpsnd->latency, rdpsnd->latency);
+	else
+		rdpsnd_jitter_init(&rdpsnd->jitter, RDPSND_JITTER_MIN_MS, RDPSND_JITTER_MAX_MS);
+
 	if (rdpsnd->subsystem)
 	{
 		if (strcmp(rdpsnd->subsystem, "fake") == 0)
@@ -637,12 +778,20 @@ static void rdpsnd_process_event(rdpSvcPlugin* plugin, RDP_EVENT* event)
 
 static void rdpsnd_process_terminate(rdpSvcPlugin* plugin)
 {
+	struct wave_item* wave;
 	struct data_out_item* item;
 	rdpsndPlugin* rdpsnd = (rdpsndPlugin*) plugin;
 
 	if (rdpsnd->device)
 		IFCALL(rdpsnd->device->Free, rdpsnd->device);
 
+	while ((wave = list_dequeue(rdpsnd->wave_list)) != NULL)
+	{
+		stream_free(wave->data);
+		free(wave);
+	}
+	list_free(rdpsnd->wave_list);
+
 	while ((item = list_dequeue(rdpsnd->data_out_list)) != NULL)
 	{
 		stream_free(item->data_out);
@@ -34,6 +34,7 @@ typedef void (*pcPlay) (rdpsndDevicePlugin* device, BYTE* data, int size);
 typedef void (*pcStart) (rdpsndDevicePlugin* device);
 typedef void (*pcClose) (rdpsndDevicePlugin* device);
 typedef void (*pcFree) (rdpsndDevicePlugin* device);
+typedef UINT32 (*pcGetLatency) (rdpsndDevicePlugin* device);
 
 struct rdpsnd_device_plugin
 {
@@ -45,6 +46,9 @@ struct rdpsnd_device_plugin
 	pcStart Start;
 	pcClose Close;
 	pcFree Free;
+
+	/* optional: milliseconds of audio written but not played yet */
+	pcGetLatency GetLatency;
 };
 
 #define RDPSND_DEVICE_EXPORT_FUNC_NAME "freerdp_rdpsnd_client_subsystem_entry"
@@ -0,0 +1,260 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <winpr/crt.h>
+
+#include "rdpsnd_jitter.h"
+
+/**
+ * Runs wave streams through the jitter buffer against a synthetic device
+ * on a simulated millisecond clock. The device plays its queue in real
+ * time once started and stops when it runs dry, as ALSA does after an
+ * underrun. The server sends a 20 ms wave every 20 ms; the jittered
+ * streams delay each arrival by a pseudo random amount.
+ *
+ * The buffer depth has to stay at its floor for a steady stream and grow
+ * with the jitter, cutting the underruns a fixed floor sized buffer has.
+ * Every confirm has to report the time its wave finishes playing on the
+ * device, which is well under the old fixed 250 ms for a steady stream.
+ */
+
+#define TEST_WAVES		500
+#define TEST_WAVE_MS		20
+
+typedef struct
+{
+	UINT32 target_ms;
+	int underruns;
+	int bad_confirms;
+	UINT32 max_delay;
+	UINT32 total_delay;
+	int confirms;
+} testResult;
+
+typedef struct
+{
+	BOOL started;
+	UINT32 queued_ms;
+	UINT32 last_finish;
+	int held;
+	UINT32 held_arrival[TEST_WAVES];
+	UINT16 held_timestamp[TEST_WAVES];
+} testDevice;
+
+/* a fixed generator, so every platform runs the same streams */
+static UINT32 test_random(UINT32* seed)
+{
+	*seed = (*seed * 1103515245) + 12345;
+	return (*seed >> 16) & 0x7FFF;
+}
+
+static void test_device_play(testDevice* device, testResult* result, UINT32 now, UINT16 wTimeStamp, UINT32 arrival)
+{
+	UINT32 played;
+	UINT16 confirm;
+
+	device->queued_ms += TEST_WAVE_MS;
+	played = now + device->queued_ms;
+
+	/* the reported end of playback, as rdpsnd computes it from the queue */
+	confirm = rdpsnd_jitter_confirm_timestamp(wTimeStamp, arrival, played);
+
+	if (((UINT16) (confirm - wTimeStamp) != (UINT16) (played - arrival)) ||
+		(played - arrival < TEST_WAVE_MS) || ((INT32) (played - device->last_finish) < TEST_WAVE_MS))
+	{
+		result->bad_confirms++;
+	}
+
+	device->last_finish = played;
+
+	result->confirms++;
+	result->total_delay += played - arrival;
+	result->max_delay = MAX(result->max_delay, played - arrival);
+}
+
+static void test_device_release(testDevice* device, testResult* result, UINT32 now)
+{
+	int i;
+
+	for (i = 0; i < device->held; i++)
+		test_device_play(device, result, now, device->held_timestamp[i], device->held_arrival[i]);
+
+	device->held = 0;
+	device->started = TRUE;
+}
+
+static void test_run_stream(UINT32 min_ms, UINT32 max_ms, int max_jitter, testResult* result)
+{
+	int i;
+	int next;
+	int status;
+	UINT32 now;
+	UINT32 seed = 1;
+	UINT32 arrivals[TEST_WAVES];
+	testDevice device;
+	rdpsndJitterBuffer jitter;
+
+	ZeroMemory(result, sizeof(testResult));
+	ZeroMemory(&device, sizeof(testDevice));
+
+	for (i = 0; i < TEST_WAVES; i++)
+	{
+		arrivals[i] = 1000 + i * TEST_WAVE_MS + (max_jitter ? (test_random(&seed) % (max_jitter + 1)) : 0);
+
+		/* the channel keeps the waves in order */
+		if ((i > 0) && (arrivals[i] < arrivals[i - 1]))
+			arrivals[i] = arrivals[i - 1];
+	}
+
+	rdpsnd_jitter_init(&jitter, min_ms, max_ms);
+	rdpsnd_jitter_reset(&jitter, arrivals[0]);
+
+	next = 0;
+
+	for (now = arrivals[0]; (next < TEST_WAVES) || device.held; now++)
+	{
+		if (device.started && (device.queued_ms > 0))
+		{
+			device.queued_ms--;
+
+			if (device.queued_ms == 0)
+			{
+				device.started = FALSE;
+
+				if (next < TEST_WAVES)
+					result->underruns++;
+			}
+		}
+
+		while ((next < TEST_WAVES) && (arrivals[next] == now))
+		{
+			/* server timestamps wrap at 16 bits */
+			UINT16 wTimeStamp = (UINT16) (65000 + next * TEST_WAVE_MS);
+
+			rdpsnd_jitter_arrival(&jitter, wTimeStamp, now);
+			status = rdpsnd_jitter_hold(&jitter, now, TEST_WAVE_MS, device.queued_ms);
+
+			if (status == RDPSND_JITTER_PLAY)
+			{
+				test_device_play(&device, result, now, wTimeStamp, now);
+			}
+			else
+			{
+				device.held_arrival[device.held] = now;
+				device.held_timestamp[device.held] = wTimeStamp;
+				device.held++;
+
+				if (status == RDPSND_JITTER_START)
+					test_device_release(&device, result, now);
+			}
+
+			next++;
+		}
+
+		if (rdpsnd_jitter_expired(&jitter, now))
+			test_device_release(&device, result, now);
+
+		if ((next == TEST_WAVES) && device.held)
+		{
+			rdpsnd_jitter_flush(&jitter);
+			test_device_release(&device, result, now);
+		}
+	}
+
+	result->target_ms = jitter.target_ms;
+}
+
+static void test_print_result(const char* name, testResult* result)
+{
+	printf("%-24s target %3u ms, %2d underruns, delay mean %3u ms max %3u ms\n", name,
+		result->target_ms, result->underruns,
+		result->confirms ? (result->total_delay / result->confirms) : 0, result->max_delay);
+}
+
+int TestRdpsndJitter(int argc, char* argv[])
+{
+	int status = 0;
+	UINT32 duration;
+	rdpsndFormat format;
+	testResult steady;
+	testResult adaptive;
+	testResult fixed;
+
+	/* 22.05 kHz 16-bit stereo PCM */
+	ZeroMemory(&format, sizeof(rdpsndFormat));
+	format.wFormatTag = 0x01;
+	format.nChannels = 2;
+	format.nSamplesPerSec = 22050;
+	format.nBlockAlign = 4;
+	format.wBitsPerSample = 16;
+
+	duration = rdpsnd_jitter_wave_duration(&format, 22050 * 4 / 50);
+
+	if (duration != 20)
+	{
+		printf("PCM wave duration: %u ms, expected 20\n", duration);
+		status = -1;
+	}
+
+	/* IMA ADPCM, 2041 frames per 2048 byte stereo block */
+	format.wFormatTag = 0x11;
+	format.nBlockAlign = 2048;
+	format.wBitsPerSample = 4;
+
+	duration = rdpsnd_jitter_wave_duration(&format, 2048 * 2);
+
+	if (duration != (2041 * 2 * 1000) / 22050)
+	{
+		printf("IMA ADPCM wave duration: %u ms, expected %u\n", duration, (2041 * 2 * 1000) / 22050);
+		status = -1;
+	}
+
+	if (rdpsnd_jitter_confirm_timestamp(65530, 1000, 1020) != 14)
+	{
+		printf("confirm timestamp does not wrap at 16 bits\n");
+		status = -1;
+	}
+
+	test_run_stream(RDPSND_JITTER_MIN_MS, RDPSND_JITTER_MAX_MS, 0, &steady);
+	test_run_stream(RDPSND_JITTER_MIN_MS, RDPSND_JITTER_MAX_MS, 120, &adaptive);
+	test_run_stream(RDPSND_JITTER_MIN_MS, RDPSND_JITTER_MIN_MS, 120, &fixed);
+
+	test_print_result("steady", &steady);
+	test_print_result("jittered, adaptive", &adaptive);
+	test_print_result("jittered, fixed", &fixed);
+
+	if ((steady.target_ms != RDPSND_JITTER_MIN_MS) || (steady.underruns != 0) ||
+		(steady.max_delay > RDPSND_JITTER_MIN_MS + 2 * TEST_WAVE_MS))
+	{
+		printf("steady stream: buffer is not at its floor\n");
+		status = -1;
+	}
+
+	if ((adaptive.target_ms <= RDPSND_JITTER_MIN_MS) || (adaptive.target_ms > RDPSND_JITTER_MAX_MS))
+	{
+		printf("jittered stream: buffer depth did not follow the jitter\n");
+		status = -1;
+	}
+
+	if (adaptive.underruns >= fixed.underruns)
+	{
+		printf("jittered stream: adaptive buffer did not reduce underruns\n");
+		status = -1;
+	}
+
+	if (steady.bad_confirms || adaptive.bad_confirms || fixed.bad_confirms)
+	{
+		printf("confirms do not match playback: %d %d %d\n",
+			steady.bad_confirms, adaptive.bad_confirms, fixed.bad_confirms);
+		status = -1;
+	}
+
+	if ((steady.confirms != TEST_WAVES) || (adaptive.confirms != TEST_WAVES) || (fixed.confirms != TEST_WAVES))
+	{
+		printf("not every wave was confirmed\n");
+		status = -1;
+	}
+
+	return status;
+}
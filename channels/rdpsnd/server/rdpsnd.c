@@ -28,6 +28,7 @@
 #include <winpr/crt.h>
 
 #include <freerdp/utils/dsp.h>
+#include <freerdp/utils/list.h>
 #include <freerdp/utils/stream.h>
 #include <freerdp/utils/thread.h>
 #include <freerdp/channels/wtsvc.h>
@@ -49,8 +50,24 @@ typedef struct _rdpsnd_server
 
 	UINT32 src_bytes_per_sample;
 	UINT32 src_bytes_per_frame;
+
+	freerdp_thread* encode_thread;
+	LIST* encode_queue;
+	LIST* free_packets;
+	HANDLE encode_idle;
+	STREAM* wave_pdu;
+	BOOL encode_failed;
 } rdpsnd_server;
 
+/* packets queued to the encode thread before SendSamples waits for it */
+#define RDPSND_SERVER_MAX_QUEUED	4
+
+typedef struct
+{
+	BYTE* buffer;
+	int frames;
+} rdpsnd_wave_packet;
+
 #define RDPSND_PDU_INIT(_s, _msgType) \
 { \
 	stream_write_BYTE(_s, _msgType); \
@@ -230,6 +247,11 @@ static void* rdpsnd_server_thread_func(void* arg)
 	return 0;
 }
 
+static void* rdpsnd_server_encode_thread_func(void* arg);
+static void rdpsnd_server_drain(rdpsnd_server* rdpsnd);
+static void rdpsnd_server_set_encode_failed(rdpsnd_server* rdpsnd, BOOL failed);
+static void rdpsnd_server_free_packets(rdpsnd_server* rdpsnd);
+
 static BOOL rdpsnd_server_initialize(rdpsnd_server_context* context)
 {
 	rdpsnd_server* rdpsnd = (rdpsnd_server*) context;
@@ -242,6 +264,16 @@ static BOOL rdpsnd_server_initialize(rdpsnd_server_context* context)
 		rdpsnd->rdpsnd_channel_thread = freerdp_thread_new();
 		freerdp_thread_start(rdpsnd->rdpsnd_channel_thread, rdpsnd_server_thread_func, rdpsnd);
 
+		if (context->use_encode_thread)
+		{
+			rdpsnd->wave_pdu = stream_new(4096);
+			rdpsnd->encode_queue = list_new();
+			rdpsnd->free_packets = list_new();
+			rdpsnd->encode_idle = CreateEvent(NULL, TRUE, TRUE, NULL);
+			rdpsnd->encode_thread = freerdp_thread_new();
+			freerdp_thread_start(rdpsnd->encode_thread, rdpsnd_server_encode_thread_func, rdpsnd);
+		}
+
 		return TRUE;
 	}
 	else
@@ -263,6 +295,10 @@ static void rdpsnd_server_select_format(rdpsnd_server_context* context, int clie
 		return;
 	}
 
+	/* the encode thread is done with the previous format once it is idle */
+	rdpsnd_server_drain(rdpsnd);
+	rdpsnd_server_set_encode_failed(rdpsnd, FALSE);
+
 	rdpsnd->src_bytes_per_sample = context->src_format.wBitsPerSample / 8;
 	rdpsnd->src_bytes_per_frame = rdpsnd->src_bytes_per_sample * context->src_format.nChannels;
 
@@ -296,12 +332,20 @@ static void rdpsnd_server_select_format(rdpsnd_server_context* context, int clie
 	{
 		rdpsnd->out_buffer = (BYTE*) realloc(rdpsnd->out_buffer, out_buffer_size);
 		rdpsnd->out_buffer_size = out_buffer_size;
+
+		/* the spare buffers are too small for the new format */
+		if (rdpsnd->free_packets)
+			rdpsnd_server_free_packets(rdpsnd);
 	}
 
 	freerdp_dsp_context_reset_adpcm(rdpsnd->dsp_context);
 }
 
-static BOOL rdpsnd_server_send_audio_pdu(rdpsnd_server* rdpsnd)
+/**
+ * Resample and encode a packet of source frames, then send it in a WaveInfo
+ * and a Wave PDU. Called from the encode thread when there is one.
+ */
+static BOOL rdpsnd_server_send_audio_pdu(rdpsnd_server* rdpsnd, STREAM* s, BYTE* buffer, int pending_frames)
 {
 	int size;
 	BOOL r;
@@ -310,7 +354,6 @@ static BOOL rdpsnd_server_send_audio_pdu(rdpsnd_server* rdpsnd)
 	int fill_size;
 	rdpsndFormat* format;
 	int tbytes_per_frame;
-	STREAM* s = rdpsnd->rdpsnd_pdu;
 
 	format = &rdpsnd->context.client_formats[rdpsnd->context.selected_client_format];
 	tbytes_per_frame = format->nChannels * rdpsnd->src_bytes_per_sample;
@@ -318,13 +361,13 @@ static BOOL rdpsnd_server_send_audio_pdu(rdpsnd_server* rdpsnd)
 	if ((format->nSamplesPerSec == rdpsnd->context.src_format.nSamplesPerSec) &&
 			(format->nChannels == rdpsnd->context.src_format.nChannels))
 	{
-		src = rdpsnd->out_buffer;
-		frames = rdpsnd->out_pending_frames;
+		src = buffer;
+		frames = pending_frames;
 	}
 	else
 	{
-		rdpsnd->dsp_context->resample(rdpsnd->dsp_context, rdpsnd->out_buffer, rdpsnd->src_bytes_per_sample,
-			rdpsnd->context.src_format.nChannels, rdpsnd->context.src_format.nSamplesPerSec, rdpsnd->out_pending_frames,
+		rdpsnd->dsp_context->resample(rdpsnd->dsp_context, buffer, rdpsnd->src_bytes_per_sample,
+			rdpsnd->context.src_format.nChannels, rdpsnd->context.src_format.nSamplesPerSec, pending_frames,
 			format->nChannels, format->nSamplesPerSec);
 		frames = rdpsnd->dsp_context->resampled_frames;
 		src = rdpsnd->dsp_context->resampled_buffer;
@@ -350,7 +393,7 @@ static BOOL rdpsnd_server_send_audio_pdu(rdpsnd_server* rdpsnd)
 
 	/* Fill to nBlockAlign for the last audio packet */
 	if ((format->wFormatTag == 0x11 || format->wFormatTag == 0x02) &&
-		rdpsnd->out_pending_frames < rdpsnd->out_frames && (size % format->nBlockAlign) != 0)
+		pending_frames < rdpsnd->out_frames && (size % format->nBlockAlign) != 0)
 		fill_size = format->nBlockAlign - (size % format->nBlockAlign);
 	else
 		fill_size = 0;
@@ -381,9 +424,146 @@ static BOOL rdpsnd_server_send_audio_pdu(rdpsnd_server* rdpsnd)
 	r = WTSVirtualChannelWrite(rdpsnd->rdpsnd_channel, stream_get_head(s), stream_get_length(s), NULL);
 	stream_set_pos(s, 0);
 
+	return r;
+}
+
+static void* rdpsnd_server_encode_thread_func(void* arg)
+{
+	rdpsnd_wave_packet* packet;
+	rdpsnd_server* rdpsnd = (rdpsnd_server*) arg;
+	freerdp_thread* thread = rdpsnd->encode_thread;
+
+	while (1)
+	{
+		freerdp_thread_wait(thread);
+
+		if (freerdp_thread_is_stopped(thread))
+			break;
+
+		freerdp_thread_lock(thread);
+		packet = (rdpsnd_wave_packet*) list_dequeue(rdpsnd->encode_queue);
+
+		if (packet == NULL)
+		{
+			freerdp_thread_reset(thread);
+			SetEvent(rdpsnd->encode_idle);
+		}
+
+		freerdp_thread_unlock(thread);
+
+		if (packet == NULL)
+			continue;
+
+		if (!rdpsnd_server_send_audio_pdu(rdpsnd, rdpsnd->wave_pdu, packet->buffer, packet->frames))
+			rdpsnd_server_set_encode_failed(rdpsnd, TRUE);
+
+		freerdp_thread_lock(thread);
+		list_enqueue(rdpsnd->free_packets, packet);
+		freerdp_thread_unlock(thread);
+	}
+
+	freerdp_thread_quit(thread);
+
+	return NULL;
+}
+
+/* wait until the encode thread has sent every queued packet */
+static void rdpsnd_server_drain(rdpsnd_server* rdpsnd)
+{
+	if (rdpsnd->encode_thread)
+		WaitForSingleObject(rdpsnd->encode_idle, INFINITE);
+}
+
+/* encode_failed is set by the encode thread and read by the session thread */
+static void rdpsnd_server_set_encode_failed(rdpsnd_server* rdpsnd, BOOL failed)
+{
+	if (rdpsnd->encode_thread == NULL)
+		return;
+
+	freerdp_thread_lock(rdpsnd->encode_thread);
+	rdpsnd->encode_failed = failed;
+	freerdp_thread_unlock(rdpsnd->encode_thread);
+}
+
+static BOOL rdpsnd_server_get_encode_failed(rdpsnd_server* rdpsnd)
+{
+	BOOL failed;
+
+	if (rdpsnd->encode_thread == NULL)
+		return FALSE;
+
+	freerdp_thread_lock(rdpsnd->encode_thread);
+	failed = rdpsnd->encode_failed;
+	freerdp_thread_unlock(rdpsnd->encode_thread);
+
+	return failed;
+}
+
+static void rdpsnd_server_free_packets(rdpsnd_server* rdpsnd)
+{
+	rdpsnd_wave_packet* packet;
+
+	while ((packet = (rdpsnd_wave_packet*) list_dequeue(rdpsnd->free_packets)) != NULL)
+	{
+		free(packet->buffer);
+		free(packet);
+	}
+}
+
+/**
+ * Hand the pending frames over to be sent. With an encode thread, the
+ * filled buffer goes to its queue and a spare one of a sent packet takes
+ * its place, so no frames are copied.
+ */
+static BOOL rdpsnd_server_queue_audio(rdpsnd_server* rdpsnd)
+{
+	BYTE* buffer;
+	int frames;
+	int queued;
+	rdpsnd_wave_packet* packet;
+	freerdp_thread* thread = rdpsnd->encode_thread;
+
+	if (thread == NULL)
+	{
+		frames = rdpsnd->out_pending_frames;
+		rdpsnd->out_pending_frames = 0;
+
+		return rdpsnd_server_send_audio_pdu(rdpsnd, rdpsnd->rdpsnd_pdu, rdpsnd->out_buffer, frames);
+	}
+
+	if (rdpsnd_server_get_encode_failed(rdpsnd))
+		return FALSE;
+
+	freerdp_thread_lock(thread);
+	queued = list_size(rdpsnd->encode_queue);
+	freerdp_thread_unlock(thread);
+
+	if (queued >= RDPSND_SERVER_MAX_QUEUED)
+		rdpsnd_server_drain(rdpsnd);
+
+	freerdp_thread_lock(thread);
+	packet = (rdpsnd_wave_packet*) list_dequeue(rdpsnd->free_packets);
+	freerdp_thread_unlock(thread);
+
+	if (packet == NULL)
+	{
+		packet = (rdpsnd_wave_packet*) malloc(sizeof(rdpsnd_wave_packet));
+		packet->buffer = (BYTE*) malloc(rdpsnd->out_buffer_size);
+	}
+
+	buffer = packet->buffer;
+	packet->buffer = rdpsnd->out_buffer;
+	packet->frames = rdpsnd->out_pending_frames;
+	rdpsnd->out_buffer = buffer;
 	rdpsnd->out_pending_frames = 0;
 
-	return r;
+	freerdp_thread_lock(thread);
+	ResetEvent(rdpsnd->encode_idle);
+	list_enqueue(rdpsnd->encode_queue, packet);
+	freerdp_thread_signal(thread);
+	freerdp_thread_unlock(thread);
+
+	return TRUE;
 }
 
 static BOOL rdpsnd_server_send_samples(rdpsnd_server_context* context, const void* buf, int nframes)
@@ -407,7 +587,7 @@ static BOOL rdpsnd_server_send_samples(rdpsnd_server_context* context, const voi
 
 		if (rdpsnd->out_pending_frames >= rdpsnd->out_frames)
 		{
-			if (!rdpsnd_server_send_audio_pdu(rdpsnd))
+			if (!rdpsnd_server_queue_audio(rdpsnd))
 				return FALSE;
 		}
 	}
@@ -420,6 +600,9 @@ static BOOL rdpsnd_server_set_volume(rdpsnd_server_context* context, int left, i
 	rdpsnd_server* rdpsnd = (rdpsnd_server*) context;
 	STREAM* s = rdpsnd->rdpsnd_pdu;
 
+	/* the encode thread writes a WaveInfo and its Wave separately, nothing may come between them */
+	rdpsnd_server_drain(rdpsnd);
+
 	RDPSND_PDU_INIT(s, SNDC_SETVOLUME);
 
 	stream_write_UINT16(s, left);
@@ -438,10 +621,15 @@ static BOOL rdpsnd_server_close(rdpsnd_server_context* context)
 
 	if (rdpsnd->out_pending_frames > 0)
 	{
-		if (!rdpsnd_server_send_audio_pdu(rdpsnd))
+		if (!rdpsnd_server_queue_audio(rdpsnd))
 			return FALSE;
 	}
 
+	rdpsnd_server_drain(rdpsnd);
+
+	if (rdpsnd_server_get_encode_failed(rdpsnd))
+		return FALSE;
+
 	rdpsnd->context.selected_client_format = -1;
 
 	RDPSND_PDU_INIT(s, SNDC_CLOSE);
@@ -472,6 +660,19 @@ void rdpsnd_server_context_free(rdpsnd_server_context* context)
 {
 	rdpsnd_server* rdpsnd = (rdpsnd_server*) context;
 
+	if (rdpsnd->encode_thread)
+	{
+		rdpsnd_server_drain(rdpsnd);
+		freerdp_thread_stop(rdpsnd->encode_thread);
+		freerdp_thread_free(rdpsnd->encode_thread);
+
+		rdpsnd_server_free_packets(rdpsnd);
+		list_free(rdpsnd->free_packets);
+		list_free(rdpsnd->encode_queue);
+		CloseHandle(rdpsnd->encode_idle);
+		stream_free(rdpsnd->wave_pdu);
+	}
+
 	if (rdpsnd->rdpsnd_channel_thread)
 	{
 		freerdp_thread_stop(rdpsnd->rdpsnd_channel_thread);
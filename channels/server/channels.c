@@ -27,6 +27,7 @@
 #include <string.h>
 
 #include <freerdp/constants.h>
+#include <freerdp/utils/buffer.h>
 #include <freerdp/server/channels.h>
 
 #include <winpr/crt.h>
@@ -61,16 +62,37 @@ void freerdp_channels_dummy()
 #define CLOSE_REQUEST_PDU			0x04
 #define CAPABILITY_REQUEST_PDU			0x05
 
+/**
+ * A queued message: length bytes at buffer, which lies within shared.
+ * Outgoing messages are sent as PDUs of at most pdu_size bytes each.
+ */
 typedef struct wts_data_item
 {
 	UINT16 channel_id;
+	SHARED_BUFFER* shared;
 	BYTE* buffer;
 	UINT32 length;
+	UINT32 pdu_size;
 } wts_data_item;
 
+static wts_data_item* wts_data_item_new(SHARED_BUFFER* shared, BYTE* buffer, UINT32 length)
+{
+	wts_data_item* item;
+
+	item = (wts_data_item*) malloc(sizeof(wts_data_item));
+	ZeroMemory(item, sizeof(wts_data_item));
+
+	item->shared = shared_buffer_ref(shared);
+	item->buffer = buffer;
+	item->length = length;
+	item->pdu_size = length;
+
+	return item;
+}
+
 static void wts_data_item_free(wts_data_item* item)
 {
-	free(item->buffer);
+	shared_buffer_unref(item->shared);
 	free(item);
 }
 
@@ -95,16 +117,11 @@ static rdpPeerChannel* wts_get_dvc_channel_by_id(WTSVirtualChannelManager* vcm,
 	return channel;
 }
 
-static void wts_queue_receive_data(rdpPeerChannel* channel, const BYTE* buffer, UINT32 length)
+static void wts_queue_receive_data(rdpPeerChannel* channel, SHARED_BUFFER* shared, BYTE* buffer, UINT32 length)
 {
 	wts_data_item* item;
 
-	item = (wts_data_item*) malloc(sizeof(wts_data_item));
-	ZeroMemory(item, sizeof(wts_data_item));
-
-	item->length = length;
-	item->buffer = malloc(length);
-	memcpy(item->buffer, buffer, length);
+	item = wts_data_item_new(shared, buffer, length);
 
 	WaitForSingleObject(channel->mutex, INFINITE);
 	list_enqueue(channel->receive_queue, item);
@@ -209,6 +226,9 @@ static void wts_read_drdynvc_data_first(rdpPeerChannel* channel, STREAM* s, int
 
 static void wts_read_drdynvc_data(rdpPeerChannel* channel, STREAM* s, UINT32 length)
 {
+	BYTE* data;
+	SHARED_BUFFER* shared;
+
 	if (channel->dvc_total_length > 0)
 	{
 		if (stream_get_length(channel->receive_data) + length > channel->dvc_total_length)
@@ -222,13 +242,20 @@ static void wts_read_drdynvc_data(rdpPeerChannel* channel, STREAM* s, UINT32 len
 
 		if (stream_get_length(channel->receive_data) >= (int) channel->dvc_total_length)
 		{
-			wts_queue_receive_data(channel, stream_get_head(channel->receive_data), channel->dvc_total_length);
+			/* hand the reassembled message over, the next one gets a new buffer */
+			shared = shared_buffer_detach_stream(channel->receive_data);
+			wts_queue_receive_data(channel, shared, shared->data, channel->dvc_total_length);
+			shared_buffer_unref(shared);
 			channel->dvc_total_length = 0;
 		}
 	}
 	else
 	{
-		wts_queue_receive_data(channel, stream_get_tail(s), length);
+		/* the data is a slice of the drdynvc PDU, which is handed over with it */
+		data = stream_get_tail(s);
+		shared = shared_buffer_detach_stream(s);
+		wts_queue_receive_data(channel, shared, data, length);
+		shared_buffer_unref(shared);
 	}
 }
 
@@ -359,9 +386,13 @@ static void wts_write_drdynvc_create_request(STREAM *s, UINT32 ChannelId, const
 
 static void WTSProcessChannelData(rdpPeerChannel* channel, int channelId, BYTE* data, int size, int flags, int total_size)
 {
+	int length;
+	SHARED_BUFFER* shared;
+
 	if (flags & CHANNEL_FLAG_FIRST)
 	{
 		stream_set_pos(channel->receive_data, 0);
+		stream_check_size(channel->receive_data, total_size);
 	}
 
 	stream_check_size(channel->receive_data, size);
@@ -379,7 +410,11 @@ static void WTSProcessChannelData(rdpPeerChannel* channel, int channelId, BYTE*
 		}
 		else
 		{
-			wts_queue_receive_data(channel, stream_get_head(channel->receive_data), stream_get_length(channel->receive_data));
+			/* hand the reassembled message over, the next one gets a new buffer */
+			length = stream_get_length(channel->receive_data);
+			shared = shared_buffer_detach_stream(channel->receive_data);
+			wts_queue_receive_data(channel, shared, shared->data, length);
+			shared_buffer_unref(shared);
 		}
 		stream_set_pos(channel->receive_data, 0);
 	}
@@ -491,6 +526,35 @@ void WTSVirtualChannelManagerGetFileDescriptor(WTSVirtualChannelManager* vcm,
 	}
 }
 
+/**
+ * Send a queued message. The PDUs are slices of the message buffer, which
+ * the channel send queue keeps a reference to until they are sent.
+ */
+
+static BOOL wts_send_item(freerdp_peer* client, wts_data_item* item)
+{
+	UINT32 size;
+	UINT32 offset;
+
+	for (offset = 0; offset < item->length; offset += size)
+	{
+		size = MIN(item->pdu_size, item->length - offset);
+
+		if (client->SendChannelBuffer)
+		{
+			if (!client->SendChannelBuffer(client, item->channel_id, item->shared, &item->buffer[offset], size))
+				return FALSE;
+		}
+		else
+		{
+			if (!client->SendChannelData(client, item->channel_id, &item->buffer[offset], size))
+				return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
 BOOL WTSVirtualChannelManagerCheckFileDescriptor(WTSVirtualChannelManager* vcm)
 {
 	BOOL result = TRUE;
@@ -519,7 +583,7 @@ BOOL WTSVirtualChannelManagerCheckFileDescriptor(WTSVirtualChannelManager* vcm)
 
 	while ((item = (wts_data_item*) list_dequeue(vcm->send_queue)) != NULL)
 	{
-		if (vcm->client->SendChannelData(vcm->client, item->channel_id, item->buffer, item->length) == FALSE)
+		if (wts_send_item(vcm->client, item) == FALSE)
 		{
 			result = FALSE;
 		}
@@ -739,23 +803,27 @@ BOOL WTSVirtualChannelWrite(
 {
 	rdpPeerChannel* channel = (rdpPeerChannel*) hChannelHandle;
 	wts_data_item* item;
+	SHARED_BUFFER* shared;
 	STREAM* s;
+	BYTE* pdu;
+	BYTE* data;
 	int cbLen;
 	int cbChId;
 	int first;
+	UINT32 left;
 	UINT32 written;
+	UINT32 chunk_size;
 
 	if (channel == NULL)
 		return FALSE;
 
 	if (channel->channel_type == RDP_PEER_CHANNEL_TYPE_SVC)
 	{
-		item = (wts_data_item*) malloc(sizeof(wts_data_item));
-		ZeroMemory(item, sizeof(wts_data_item));
+		shared = shared_buffer_new(Length);
+		memcpy(shared->data, Buffer, Length);
 
-		item->buffer = malloc(Length);
-		item->length = Length;
-		memcpy(item->buffer, Buffer, Length);
+		item = wts_data_item_new(shared, shared->data, Length);
+		shared_buffer_unref(shared);
 
 		wts_queue_send_item(channel, item);
 	}
@@ -764,48 +832,58 @@ BOOL WTSVirtualChannelWrite(
 		DEBUG_DVC("drdynvc not ready");
 		return FALSE;
 	}
-	else
+	else if (Length > 0)
 	{
+		/**
+		 * Lay all the PDUs out back to back in a single buffer. Each PDU
+		 * but the last fills a whole chunk, so they are sent as slices of
+		 * chunk_size bytes. A PDU header takes at most 9 bytes.
+		 */
+		chunk_size = channel->client->settings->VirtualChannelChunkSize;
+		shared = shared_buffer_new(Length + ((Length / (chunk_size - 9)) + 1) * 9);
+
 		s = stream_new(0);
+		stream_attach(s, shared->data, shared->size);
+
+		data = Buffer;
+		left = Length;
 		first = TRUE;
 
-		while (Length > 0)
+		while (left > 0)
 		{
-			item = (wts_data_item*) malloc(sizeof(wts_data_item));
-			ZeroMemory(item, sizeof(wts_data_item));
-
-			item->buffer = malloc(channel->client->settings->VirtualChannelChunkSize);
-			stream_attach(s, item->buffer, channel->client->settings->VirtualChannelChunkSize);
-
+			pdu = stream_get_tail(s);
 			stream_seek_BYTE(s);
 			cbChId = wts_write_variable_uint(s, channel->channel_id);
 
-			if (first && (Length > (UINT32) stream_get_left(s)))
+			if (first && (left > chunk_size - (stream_get_tail(s) - pdu)))
 			{
 				cbLen = wts_write_variable_uint(s, Length);
-				item->buffer[0] = (DATA_FIRST_PDU << 4) | (cbLen << 2) | cbChId;
+				*pdu = (DATA_FIRST_PDU << 4) | (cbLen << 2) | cbChId;
 			}
 			else
 			{
-				item->buffer[0] = (DATA_PDU << 4) | cbChId;
+				*pdu = (DATA_PDU << 4) | cbChId;
 			}
 
 			first = FALSE;
-			written = stream_get_left(s);
-
-			if (written > Length)
-				written = Length;
+			written = chunk_size - (stream_get_tail(s) - pdu);
 
-			stream_write(s, Buffer, written);
-			item->length = stream_get_length(s);
-			stream_detach(s);
-			Length -= written;
-			Buffer += written;
+			if (written > left)
+				written = left;
 
-			wts_queue_send_item(channel->vcm->drdynvc_channel, item);
+			stream_write(s, data, written);
+			left -= written;
+			data += written;
 		}
 
+		item = wts_data_item_new(shared, shared->data, stream_get_length(s));
+		item->pdu_size = chunk_size;
+		shared_buffer_unref(shared);
+
+		stream_detach(s);
 		stream_free(s);
+
+		wts_queue_send_item(channel->vcm->drdynvc_channel, item);
 	}
 
 	if (pBytesWritten != NULL)
@@ -54,6 +54,9 @@ typedef struct _TSMFFFmpegDecoder
 	BYTE* decoded_data;
 	UINT32 decoded_size;
 	UINT32 decoded_size_max;
+
+	/* A video frame decoded into frame, to be copied out by GetDecodedData or GetDecodedFrame */
+	BOOL frame_decoded;
 } TSMFFFmpegDecoder;
 
 static BOOL tsmf_ffmpeg_init_context(ITSMFDecoder* decoder)
@@ -270,7 +273,6 @@ static BOOL tsmf_ffmpeg_decode_video(ITSMFDecoder* decoder, const BYTE* data, UI
 	TSMFFFmpegDecoder* mdecoder = (TSMFFFmpegDecoder*) decoder;
 	int decoded;
 	int len;
-	AVFrame* frame;
 	BOOL ret = TRUE;
 
 #if LIBAVCODEC_VERSION_MAJOR < 52 || (LIBAVCODEC_VERSION_MAJOR == 52 && LIBAVCODEC_VERSION_MINOR <= 20)
@@ -308,23 +310,34 @@ static BOOL tsmf_ffmpeg_decode_video(ITSMFDecoder* decoder, const BYTE* data, UI
 
 		mdecoder->decoded_size = avpicture_get_size(mdecoder->codec_context->pix_fmt,
 			mdecoder->codec_context->width, mdecoder->codec_context->height);
-		mdecoder->decoded_data = malloc(mdecoder->decoded_size);
-		ZeroMemory(mdecoder->decoded_data, mdecoder->decoded_size);
-		frame = avcodec_alloc_frame();
-		avpicture_fill((AVPicture*) frame, mdecoder->decoded_data,
-			mdecoder->codec_context->pix_fmt,
-			mdecoder->codec_context->width, mdecoder->codec_context->height);
-
-		av_picture_copy((AVPicture*) frame, (AVPicture*) mdecoder->frame,
-			mdecoder->codec_context->pix_fmt,
-			mdecoder->codec_context->width, mdecoder->codec_context->height);
-
-		av_free(frame);
+		mdecoder->frame_decoded = TRUE;
 	}
 
 	return ret;
 }
 
+/**
+ * Copy the decoded picture out of the codec's buffers, which it reuses on
+ * the next decode, into a packed frame of decoded_size bytes.
+ */
+static void tsmf_ffmpeg_copy_video_frame(TSMFFFmpegDecoder* mdecoder, BYTE* dst)
+{
+	AVFrame* frame;
+
+	frame = avcodec_alloc_frame();
+	avpicture_fill((AVPicture*) frame, dst,
+		mdecoder->codec_context->pix_fmt,
+		mdecoder->codec_context->width, mdecoder->codec_context->height);
+
+	av_picture_copy((AVPicture*) frame, (AVPicture*) mdecoder->frame,
+		mdecoder->codec_context->pix_fmt,
+		mdecoder->codec_context->width, mdecoder->codec_context->height);
+
+	av_free(frame);
+
+	mdecoder->frame_decoded = FALSE;
+}
+
 static BOOL tsmf_ffmpeg_decode_audio(ITSMFDecoder* decoder, const BYTE* data, UINT32 data_size, UINT32 extensions)
 {
 	TSMFFFmpegDecoder* mdecoder = (TSMFFFmpegDecoder*) decoder;
@@ -437,6 +450,7 @@ static BOOL tsmf_ffmpeg_decode(ITSMFDecoder* decoder, const BYTE* data, UINT32 d
 		mdecoder->decoded_data = NULL;
 	}
 	mdecoder->decoded_size = 0;
+	mdecoder->frame_decoded = FALSE;
 
 	switch (mdecoder->media_type)
 	{
@@ -455,6 +469,12 @@ static BYTE* tsmf_ffmpeg_get_decoded_data(ITSMFDecoder* decoder, UINT32* size)
 	BYTE* buf;
 	TSMFFFmpegDecoder* mdecoder = (TSMFFFmpegDecoder*) decoder;
 
+	if (mdecoder->frame_decoded)
+	{
+		mdecoder->decoded_data = malloc(mdecoder->decoded_size);
+		tsmf_ffmpeg_copy_video_frame(mdecoder, mdecoder->decoded_data);
+	}
+
 	*size = mdecoder->decoded_size;
 	buf = mdecoder->decoded_data;
 	mdecoder->decoded_data = NULL;
@@ -463,6 +483,24 @@ static BYTE* tsmf_ffmpeg_get_decoded_data(ITSMFDecoder* decoder, UINT32* size)
 	return buf;
 }
 
+static SHARED_BUFFER* tsmf_ffmpeg_get_decoded_frame(ITSMFDecoder* decoder, SHARED_BUFFER_POOL* pool)
+{
+	SHARED_BUFFER* buffer;
+	TSMFFFmpegDecoder* mdecoder = (TSMFFFmpegDecoder*) decoder;
+
+	if (!mdecoder->frame_decoded)
+		return NULL;
+
+	buffer = shared_buffer_pool_get(pool, mdecoder->decoded_size);
+
+	if (buffer)
+		tsmf_ffmpeg_copy_video_frame(mdecoder, buffer->data);
+
+	mdecoder->decoded_size = 0;
+
+	return buffer;
+}
+
 static UINT32 tsmf_ffmpeg_get_decoded_format(ITSMFDecoder* decoder)
 {
 	TSMFFFmpegDecoder* mdecoder = (TSMFFFmpegDecoder*) decoder;
@@ -543,6 +581,7 @@ ITSMFDecoder* freerdp_tsmf_client_decoder_subsystem_entry(void)
 	decoder->iface.GetDecodedData = tsmf_ffmpeg_get_decoded_data;
 	decoder->iface.GetDecodedFormat = tsmf_ffmpeg_get_decoded_format;
 	decoder->iface.GetDecodedDimension = tsmf_ffmpeg_get_decoded_dimension;
+	decoder->iface.GetDecodedFrame = tsmf_ffmpeg_get_decoded_frame;
 	decoder->iface.Free = tsmf_ffmpeg_free;
 
 	return (ITSMFDecoder*) decoder;
@@ -0,0 +1,386 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+
+#include "tsmf_clock.h"
+
+/**
+ * Plays a 30 fps video stream through a fake decoder on a simulated clock,
+ * once with the scheduler of the playback thread and once with the one it
+ * replaced, which polled the sample queue every 5 ms and paced frames by
+ * their durations. The server sends the frames in bursts of eight, ahead of
+ * time, and decoding takes a pseudo random 2 to 12 ms.
+ *
+ * The clock scheduled thread has to wake up at most twice per frame, once
+ * for the arrival and once when the frame is due, not at all while the
+ * stream is idle, and present every frame within a millisecond of its
+ * start time.
+ */
+
+#define TEST_FRAMES		600
+#define TEST_BURST		8
+#define TEST_FRAME_TIME		333333LL
+#define TEST_MS			10000LL
+#define TEST_POLL_TIME		(5 * TEST_MS)
+#define TEST_IDLE_TIME		(10000 * TEST_MS)
+
+typedef struct
+{
+	UINT64 arrival[TEST_FRAMES];
+	UINT64 decode[TEST_FRAMES];
+	UINT64 presented[TEST_FRAMES];
+	int wakeups;
+	int idle_wakeups;
+	double jitter_ms;
+	double max_error_ms;
+} testStream;
+
+/* a fixed generator, so every platform runs the same stream */
+static UINT32 test_random(UINT32* seed)
+{
+	*seed = (*seed * 1103515245) + 12345;
+	return (*seed >> 16) & 0x7FFF;
+}
+
+static void test_stream_init(testStream* stream)
+{
+	int i;
+	INT64 burst;
+	UINT32 seed = 1;
+
+	ZeroMemory(stream, sizeof(testStream));
+
+	for (i = 0; i < TEST_FRAMES; i++)
+	{
+		/* each burst arrives half a burst before its first frame is due */
+		burst = ((i / TEST_BURST) * TEST_BURST - TEST_BURST / 2) * TEST_FRAME_TIME;
+
+		stream->arrival[i] = 10000000LL + ((burst > 0) ? burst : 0) + (test_random(&seed) % 20) * TEST_MS;
+		stream->decode[i] = (2 + (test_random(&seed) % 11)) * TEST_MS;
+
+		if ((i > 0) && (stream->arrival[i] < stream->arrival[i - 1]))
+			stream->arrival[i] = stream->arrival[i - 1];
+	}
+}
+
+/**
+ * Presentation errors against the start times, with the constant offset
+ * of the first frame taken out.
+ */
+static void test_stream_measure(testStream* stream)
+{
+	int i;
+	double error;
+	double mean = 0;
+	double variance = 0;
+
+	for (i = 0; i < TEST_FRAMES; i++)
+		mean += (double) (INT64) (stream->presented[i] - i * TEST_FRAME_TIME);
+
+	mean /= TEST_FRAMES;
+
+	for (i = 0; i < TEST_FRAMES; i++)
+	{
+		error = ((double) (INT64) (stream->presented[i] - i * TEST_FRAME_TIME) - mean) / TEST_MS;
+		variance += error * error;
+
+		if (fabs(error) > stream->max_error_ms)
+			stream->max_error_ms = fabs(error);
+	}
+
+	stream->jitter_ms = sqrt(variance / TEST_FRAMES);
+}
+
+/**
+ * The playback thread: it sleeps on its event until a sample arrives, and
+ * once a frame is decoded, until the frame is due or the next sample
+ * arrives, whatever comes first.
+ */
+static void test_run_clock(testStream* stream)
+{
+	int next = 0;
+	int held = -1;
+	int decoded = 0;
+	BOOL running;
+	UINT64 now;
+	UINT64 delay;
+	UINT64 deadline;
+	UINT64 end;
+	TSMF_CLOCK clock;
+
+	tsmf_clock_init(&clock);
+
+	now = stream->arrival[0];
+	end = stream->arrival[TEST_FRAMES - 1] + TEST_IDLE_TIME;
+
+	while (now < end)
+	{
+		while ((next < TEST_FRAMES) && (stream->arrival[next] <= now))
+			next++;
+
+		deadline = 0;
+
+		for (;;)
+		{
+			if (held >= 0)
+			{
+				running = tsmf_clock_due(&clock, held * TEST_FRAME_TIME, now, &delay);
+
+				if (running && (delay == 0))
+				{
+					stream->presented[held] = now;
+					held = -1;
+					continue;
+				}
+
+				deadline = now + tsmf_clock_timeout(delay) * TEST_MS;
+				break;
+			}
+
+			if (decoded < next)
+			{
+				now += stream->decode[decoded];
+				held = decoded++;
+				continue;
+			}
+
+			break;
+		}
+
+		/* sleep on the event, with the timeout if a frame is held */
+		if ((next < TEST_FRAMES) && (!deadline || (stream->arrival[next] < deadline)))
+			now = stream->arrival[next];
+		else if (deadline)
+			now = deadline;
+		else
+			break;
+
+		stream->wakeups++;
+
+		if (decoded == TEST_FRAMES && held < 0)
+			stream->idle_wakeups++;
+	}
+}
+
+/**
+ * The replaced playback thread, polling the queue and sleeping until
+ * next_start_time before each frame.
+ */
+static void test_run_polling(testStream* stream)
+{
+	int next = 0;
+	int decoded = 0;
+	UINT64 t;
+	UINT64 now;
+	UINT64 end;
+	UINT64 next_start_time = 0;
+
+	now = stream->arrival[0];
+	end = stream->arrival[TEST_FRAMES - 1] + TEST_IDLE_TIME;
+
+	while (now < end)
+	{
+		while ((next < TEST_FRAMES) && (stream->arrival[next] <= now))
+			next++;
+
+		if (decoded < next)
+		{
+			now += stream->decode[decoded];
+			t = now;
+
+			if (next_start_time > t)
+			{
+				now = next_start_time;
+				stream->wakeups++;
+			}
+
+			next_start_time = t + TEST_FRAME_TIME - 50000;
+			stream->presented[decoded++] = now;
+		}
+		else
+		{
+			now += TEST_POLL_TIME;
+			stream->wakeups++;
+
+			if (decoded == TEST_FRAMES)
+				stream->idle_wakeups++;
+		}
+	}
+}
+
+static int test_clock_basics(void)
+{
+	int status = 0;
+	INT64 media;
+	UINT64 delay;
+	TSMF_CLOCK clock;
+
+	tsmf_clock_init(&clock);
+
+	if (tsmf_clock_media_time(&clock, 1000, &media))
+	{
+		printf("clock runs before the first sample\n");
+		status = -1;
+	}
+
+	/* the first sample starts the clock */
+	if (!tsmf_clock_due(&clock, 5000000, 20000000, &delay) || (delay != 0))
+	{
+		printf("first sample is not due at once\n");
+		status = -1;
+	}
+
+	if (!tsmf_clock_due(&clock, 5000000 + TEST_FRAME_TIME, 20000000, &delay) || (delay != TEST_FRAME_TIME))
+	{
+		printf("next frame delay %d, expected %d\n", (int) delay, (int) TEST_FRAME_TIME);
+		status = -1;
+	}
+
+	if (tsmf_clock_timeout(TEST_FRAME_TIME) != 34 || tsmf_clock_timeout(TEST_MS) != 1 || tsmf_clock_timeout(0) != 0)
+	{
+		printf("timeouts are not rounded up to whole milliseconds\n");
+		status = -1;
+	}
+
+	/* a paused clock stands still, and nothing is due until it is resumed */
+	tsmf_clock_pause(&clock, 20000000 + 10 * TEST_MS);
+
+	if (tsmf_clock_due(&clock, 5000000, 30000000, &delay))
+	{
+		printf("sample due while paused\n");
+		status = -1;
+	}
+
+	tsmf_clock_resume(&clock, 90000000);
+	tsmf_clock_media_time(&clock, 90000000 + 5 * TEST_MS, &media);
+
+	if (media != 5000000 + 15 * TEST_MS)
+	{
+		printf("clock did not stand still while paused\n");
+		status = -1;
+	}
+
+	/* audio drift within the tolerance is left alone, beyond it moves the clock */
+	if (tsmf_clock_sync(&clock, media + TSMF_CLOCK_TOLERANCE / 2, 90000000 + 5 * TEST_MS))
+	{
+		printf("clock moved within the tolerance\n");
+		status = -1;
+	}
+
+	if (!tsmf_clock_sync(&clock, media + 2 * TSMF_CLOCK_TOLERANCE, 90000000 + 5 * TEST_MS))
+	{
+		printf("clock did not follow the audio\n");
+		status = -1;
+	}
+
+	/* a seek restarts the clock on the next frame */
+	if (!tsmf_clock_due(&clock, media + 10 * TSMF_CLOCK_MAX_SKEW, 90000000 + 5 * TEST_MS, &delay) || (delay != 0))
+	{
+		printf("discontinuity is held back\n");
+		status = -1;
+	}
+
+	tsmf_clock_reset(&clock);
+
+	if (tsmf_clock_media_time(&clock, 90000000, &media))
+	{
+		printf("clock runs after a reset\n");
+		status = -1;
+	}
+
+	return status;
+}
+
+/**
+ * An audio device whose clock runs 0.5% fast drives the presentation
+ * clock, which has to follow it within the tolerance, in a few steps.
+ */
+static int test_clock_audio_drift(void)
+{
+	int i;
+	int steps = 0;
+	INT64 media;
+	INT64 error;
+	INT64 max_error = 0;
+	UINT64 now;
+	UINT64 played;
+	TSMF_CLOCK clock;
+
+	tsmf_clock_init(&clock);
+
+	for (i = 0; i < 1000; i++)
+	{
+		/* a 20 ms sample written every 20 ms, played 100 ms later */
+		now = 10000000 + i * 20 * TEST_MS;
+		played = now + 100 * TEST_MS;
+
+		if (tsmf_clock_sync(&clock, ((played - 10000000) * 1005) / 1000, played))
+			steps++;
+
+		tsmf_clock_media_time(&clock, now, &media);
+		error = media - (INT64) (((now - 10000000) * 1005) / 1000);
+		error = (error < 0) ? -error : error;
+
+		if (error > max_error)
+			max_error = error;
+	}
+
+	printf("audio drift: %d clock steps, max error %.1f ms\n", steps, (double) max_error / TEST_MS);
+
+	/* 20 s drifting by 0.5% are 100 ms */
+	if ((max_error > TSMF_CLOCK_TOLERANCE + TEST_MS) || (steps > 1 + (100 * TEST_MS) / TSMF_CLOCK_TOLERANCE))
+	{
+		printf("clock does not follow the audio device\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+int TestTsmfClock(int argc, char* argv[])
+{
+	int status = 0;
+	testStream* clocked;
+	testStream* polling;
+
+	status |= test_clock_basics();
+	status |= test_clock_audio_drift();
+
+	clocked = (testStream*) malloc(sizeof(testStream));
+	polling = (testStream*) malloc(sizeof(testStream));
+
+	test_stream_init(clocked);
+	test_stream_init(polling);
+
+	test_run_clock(clocked);
+	test_run_polling(polling);
+
+	test_stream_measure(clocked);
+	test_stream_measure(polling);
+
+	printf("clock:   %5d wakeups, %5d idle, jitter %.2f ms, max %.2f ms\n",
+		clocked->wakeups, clocked->idle_wakeups, clocked->jitter_ms, clocked->max_error_ms);
+	printf("polling: %5d wakeups, %5d idle, jitter %.2f ms, max %.2f ms\n",
+		polling->wakeups, polling->idle_wakeups, polling->jitter_ms, polling->max_error_ms);
+
+	if ((clocked->wakeups > 2 * TEST_FRAMES) || (clocked->idle_wakeups != 0))
+	{
+		printf("clock scheduled thread wakes up too often\n");
+		status = -1;
+	}
+
+	if ((clocked->max_error_ms > 1.0) || (clocked->jitter_ms >= polling->jitter_ms))
+	{
+		printf("clock scheduled frames are not presented on time\n");
+		status = -1;
+	}
+
+	free(clocked);
+	free(polling);
+
+	return status;
+}
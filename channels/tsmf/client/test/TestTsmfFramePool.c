@@ -0,0 +1,273 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <winpr/crt.h>
+
+#include <freerdp/utils/event.h>
+#include <freerdp/utils/buffer.h>
+#include <freerdp/utils/stopwatch.h>
+#include <freerdp/client/tsmf.h>
+
+#include "tsmf_decoder.h"
+
+/**
+ * Runs 1080p I420 frames from a stub decoder to a client that frees each
+ * video frame event a few frames after it got it, as the TSMF stream
+ * thread does: once through GetDecodedData, which allocates, clears and
+ * fills a buffer per frame, and once through GetDecodedFrame and a frame
+ * pool.
+ *
+ * Once the pool holds the frames in flight, every frame has to come from
+ * it, and be written once. The pool has to follow a change of the frame
+ * size, and frames still held by the client have to survive the pool.
+ */
+
+#define TEST_WIDTH		1920
+#define TEST_HEIGHT		1080
+#define TEST_FRAMES		120
+#define TEST_CLIENT_DEPTH	3
+#define TEST_POOL_SIZE		8
+
+typedef struct
+{
+	ITSMFDecoder iface;
+
+	UINT32 width;
+	UINT32 height;
+	BYTE* picture;
+	BYTE value;
+
+	int allocations;
+	UINT64 bytes_written;
+} testDecoder;
+
+typedef struct
+{
+	RDP_VIDEO_FRAME_EVENT* events[TEST_CLIENT_DEPTH + 1];
+	int count;
+} testClient;
+
+static UINT32 test_frame_size(testDecoder* decoder)
+{
+	return decoder->width * decoder->height * 3 / 2;
+}
+
+static void test_decoder_set_size(testDecoder* decoder, UINT32 width, UINT32 height)
+{
+	decoder->width = width;
+	decoder->height = height;
+
+	free(decoder->picture);
+	decoder->picture = (BYTE*) malloc(test_frame_size(decoder));
+}
+
+static BOOL test_decoder_decode(ITSMFDecoder* decoder, const BYTE* data, UINT32 data_size, UINT32 extensions)
+{
+	testDecoder* tdecoder = (testDecoder*) decoder;
+
+	/* the codec's own picture buffer, which the next decode overwrites */
+	tdecoder->value = data[0];
+	memset(tdecoder->picture, tdecoder->value, test_frame_size(tdecoder));
+
+	return TRUE;
+}
+
+static BYTE* test_decoder_get_decoded_data(ITSMFDecoder* decoder, UINT32* size)
+{
+	BYTE* data;
+	testDecoder* tdecoder = (testDecoder*) decoder;
+
+	/* what the ffmpeg decoder did for every frame */
+	*size = test_frame_size(tdecoder);
+	data = (BYTE*) malloc(*size);
+	ZeroMemory(data, *size);
+	memcpy(data, tdecoder->picture, *size);
+
+	tdecoder->allocations++;
+	tdecoder->bytes_written += 2 * (*size);
+
+	return data;
+}
+
+static SHARED_BUFFER* test_decoder_get_decoded_frame(ITSMFDecoder* decoder, SHARED_BUFFER_POOL* pool)
+{
+	SHARED_BUFFER* frame;
+	testDecoder* tdecoder = (testDecoder*) decoder;
+
+	frame = shared_buffer_pool_get(pool, test_frame_size(tdecoder));
+	memcpy(frame->data, tdecoder->picture, frame->size);
+
+	tdecoder->bytes_written += frame->size;
+
+	return frame;
+}
+
+static void test_decoder_init(testDecoder* decoder)
+{
+	ZeroMemory(decoder, sizeof(testDecoder));
+
+	decoder->iface.Decode = test_decoder_decode;
+	decoder->iface.GetDecodedData = test_decoder_get_decoded_data;
+	decoder->iface.GetDecodedFrame = test_decoder_get_decoded_frame;
+
+	test_decoder_set_size(decoder, TEST_WIDTH, TEST_HEIGHT);
+}
+
+static void test_client_flush(testClient* client, int keep)
+{
+	int i;
+
+	while (client->count > keep)
+	{
+		freerdp_event_free((RDP_EVENT*) client->events[0]);
+
+		for (i = 1; i < client->count; i++)
+			client->events[i - 1] = client->events[i];
+
+		client->count--;
+	}
+}
+
+/**
+ * Decodes frames and passes them on in video frame events, returning the
+ * number of frames whose data did not match what was decoded.
+ */
+static int test_play(testDecoder* decoder, SHARED_BUFFER_POOL* pool, testClient* client, int frames)
+{
+	int i;
+	int errors = 0;
+	BYTE data[1];
+	SHARED_BUFFER* frame;
+	RDP_VIDEO_FRAME_EVENT* vevent;
+
+	for (i = 0; i < frames; i++)
+	{
+		data[0] = (BYTE) (i + 1);
+		decoder->iface.Decode((ITSMFDecoder*) decoder, data, 1, 0);
+
+		vevent = (RDP_VIDEO_FRAME_EVENT*) freerdp_event_new(RDP_EVENT_CLASS_TSMF,
+			RDP_EVENT_TYPE_TSMF_VIDEO_FRAME, NULL, NULL);
+
+		if (pool)
+		{
+			frame = decoder->iface.GetDecodedFrame((ITSMFDecoder*) decoder, pool);
+			vevent->frame_data = frame->data;
+			vevent->frame_size = frame->size;
+			vevent->frame_buffer = frame;
+		}
+		else
+		{
+			vevent->frame_data = decoder->iface.GetDecodedData((ITSMFDecoder*) decoder, &vevent->frame_size);
+		}
+
+		client->events[client->count++] = vevent;
+
+		/* the client presents its oldest frame */
+		if (client->events[0]->frame_data[client->events[0]->frame_size - 1] !=
+			(BYTE) (i + 2 - client->count))
+		{
+			errors++;
+		}
+
+		test_client_flush(client, TEST_CLIENT_DEPTH);
+	}
+
+	return errors;
+}
+
+int TestTsmfFramePool(int argc, char* argv[])
+{
+	int status = 0;
+	int errors;
+	UINT32 misses;
+	double legacy_time;
+	double pooled_time;
+	double megabytes;
+	STOPWATCH* stopwatch;
+	SHARED_BUFFER* held;
+	SHARED_BUFFER_POOL* pool;
+	testDecoder decoder;
+	testClient client;
+
+	ZeroMemory(&client, sizeof(testClient));
+	test_decoder_init(&decoder);
+
+	stopwatch = stopwatch_create();
+
+	/* every frame allocated by the decoder */
+	stopwatch_start(stopwatch);
+	errors = test_play(&decoder, NULL, &client, TEST_FRAMES);
+	test_client_flush(&client, 0);
+	stopwatch_stop(stopwatch);
+	legacy_time = stopwatch_get_elapsed_time_in_seconds(stopwatch);
+
+	megabytes = (double) decoder.bytes_written / (1024 * 1024);
+	printf("GetDecodedData:  %3d allocations, %7.1f MB written, %.1f ms per frame\n",
+		decoder.allocations, megabytes, legacy_time * 1000 / TEST_FRAMES);
+
+	/* frames from the pool */
+	decoder.allocations = 0;
+	decoder.bytes_written = 0;
+	pool = shared_buffer_pool_new(TEST_POOL_SIZE);
+
+	stopwatch_reset(stopwatch);
+	stopwatch_start(stopwatch);
+	errors += test_play(&decoder, pool, &client, TEST_FRAMES);
+	test_client_flush(&client, 0);
+	stopwatch_stop(stopwatch);
+	pooled_time = stopwatch_get_elapsed_time_in_seconds(stopwatch);
+
+	megabytes = (double) decoder.bytes_written / (1024 * 1024);
+	printf("GetDecodedFrame: %3u allocations, %7.1f MB written, %.1f ms per frame, %u hits\n",
+		pool->misses, megabytes, pooled_time * 1000 / TEST_FRAMES, pool->hits);
+
+	if (errors)
+	{
+		printf("%d frames did not reach the client intact\n", errors);
+		status = -1;
+	}
+
+	if ((pool->misses > TEST_CLIENT_DEPTH + 1) || (pool->hits + pool->misses != TEST_FRAMES))
+	{
+		printf("frames in flight are not reused\n");
+		status = -1;
+	}
+
+	if (decoder.bytes_written != (UINT64) TEST_FRAMES * test_frame_size(&decoder))
+	{
+		printf("pooled frames are written more than once\n");
+		status = -1;
+	}
+
+	/* a new frame size replaces the kept frames */
+	misses = pool->misses;
+	test_decoder_set_size(&decoder, TEST_WIDTH / 2, TEST_HEIGHT / 2);
+	errors = test_play(&decoder, pool, &client, TEST_FRAMES);
+
+	if (errors || (pool->misses - misses > TEST_CLIENT_DEPTH + 1) || (pool->size != (int) test_frame_size(&decoder)))
+	{
+		printf("pool does not follow the frame size\n");
+		status = -1;
+	}
+
+	/* a frame the client keeps after its event is freed, and frames outliving the pool */
+	held = shared_buffer_ref(client.events[client.count - 1]->frame_buffer);
+	test_client_flush(&client, TEST_CLIENT_DEPTH - 1);
+	shared_buffer_pool_free(pool);
+	test_client_flush(&client, 0);
+
+	if (held->data[held->size - 1] != (BYTE) TEST_FRAMES)
+	{
+		printf("held frame was overwritten\n");
+		status = -1;
+	}
+
+	shared_buffer_unref(held);
+
+	stopwatch_free(stopwatch);
+	free(decoder.picture);
+
+	return status;
+}
@@ -0,0 +1,186 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Video Redirection Virtual Channel - Presentation Clock
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <time.h>
+
+#include <winpr/crt.h>
+#include <winpr/windows.h>
+#include <winpr/synch.h>
+
+#include "tsmf_clock.h"
+
+/**
+ * Monotonic system time, unaffected by changes of the wall clock.
+ */
+
+UINT64 tsmf_clock_system_time(void)
+{
+#ifdef _WIN32
+	return GetTickCount64() * 10000LL;
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ((UINT64) ts.tv_sec) * 10000000LL + ((UINT64) ts.tv_nsec) / 100;
+#endif
+}
+
+void tsmf_clock_init(TSMF_CLOCK* clock)
+{
+	ZeroMemory(clock, sizeof(TSMF_CLOCK));
+}
+
+/**
+ * Forgets the mapping after a flush, the next sample presented starts the
+ * clock again. A paused clock stays paused.
+ */
+
+void tsmf_clock_reset(TSMF_CLOCK* clock)
+{
+	clock->anchored = FALSE;
+	clock->media_base = 0;
+	clock->system_base = 0;
+}
+
+BOOL tsmf_clock_media_time(TSMF_CLOCK* clock, UINT64 now, INT64* media_time)
+{
+	if (!clock->anchored)
+	{
+		*media_time = 0;
+		return FALSE;
+	}
+
+	if (clock->paused)
+		*media_time = clock->media_base;
+	else
+		*media_time = clock->media_base + ((INT64) now - clock->system_base);
+
+	return TRUE;
+}
+
+void tsmf_clock_anchor(TSMF_CLOCK* clock, UINT64 media_time, UINT64 system_time)
+{
+	clock->anchored = TRUE;
+	clock->media_base = (INT64) media_time;
+	clock->system_base = (INT64) system_time;
+}
+
+/**
+ * Moves the clock to a sample known to be presented at system_time, if it
+ * has drifted away from it by more than the tolerance. Returns TRUE if the
+ * clock was moved.
+ */
+
+BOOL tsmf_clock_sync(TSMF_CLOCK* clock, UINT64 media_time, UINT64 system_time)
+{
+	INT64 error;
+
+	if (clock->paused)
+		return FALSE;
+
+	if (clock->anchored)
+	{
+		error = clock->media_base + ((INT64) system_time - clock->system_base) - (INT64) media_time;
+
+		if ((error <= TSMF_CLOCK_TOLERANCE) && (error >= -TSMF_CLOCK_TOLERANCE))
+			return FALSE;
+	}
+
+	tsmf_clock_anchor(clock, media_time, system_time);
+
+	return TRUE;
+}
+
+void tsmf_clock_pause(TSMF_CLOCK* clock, UINT64 now)
+{
+	if (clock->paused)
+		return;
+
+	tsmf_clock_media_time(clock, now, &clock->media_base);
+	clock->system_base = (INT64) now;
+	clock->paused = TRUE;
+}
+
+void tsmf_clock_resume(TSMF_CLOCK* clock, UINT64 now)
+{
+	if (!clock->paused)
+		return;
+
+	clock->system_base = (INT64) now;
+	clock->paused = FALSE;
+}
+
+/**
+ * How long a sample starting at media_time has to be held back from now.
+ * Returns FALSE while the clock is paused, the sample is then due only
+ * after the presentation has been restarted.
+ *
+ * A clock not started yet starts on the sample, so is a sample too far
+ * off to be part of the same stream, as after a seek.
+ */
+
+BOOL tsmf_clock_due(TSMF_CLOCK* clock, UINT64 media_time, UINT64 now, UINT64* delay)
+{
+	INT64 diff;
+	INT64 current;
+
+	*delay = 0;
+
+	if (clock->paused)
+		return FALSE;
+
+	if (!tsmf_clock_media_time(clock, now, &current))
+	{
+		tsmf_clock_anchor(clock, media_time, now);
+		return TRUE;
+	}
+
+	diff = (INT64) media_time - current;
+
+	if ((diff > TSMF_CLOCK_MAX_SKEW) || (diff < -TSMF_CLOCK_MAX_SKEW))
+	{
+		tsmf_clock_anchor(clock, media_time, now);
+		return TRUE;
+	}
+
+	if (diff > 0)
+		*delay = (UINT64) diff;
+
+	return TRUE;
+}
+
+/**
+ * Wait timeout in milliseconds for a delay, rounded up so that the wait
+ * never ends before the sample is due.
+ */
+
+DWORD tsmf_clock_timeout(UINT64 delay)
+{
+	UINT64 timeout;
+
+	timeout = (delay + 9999) / 10000;
+
+	if (timeout >= INFINITE)
+		timeout = INFINITE - 1;
+
+	return (DWORD) timeout;
+}
@@ -0,0 +1,67 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Video Redirection Virtual Channel - Presentation Clock
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __TSMF_CLOCK_H
+#define __TSMF_CLOCK_H
+
+#include <freerdp/types.h>
+
+/* all times are in 100 ns units, as the sample times of the protocol */
+
+/* audio drift below this is left alone, to keep the clock from stepping on every sample */
+#define TSMF_CLOCK_TOLERANCE		200000LL
+
+/* samples this far off the clock are a discontinuity in the stream, the clock restarts on them */
+#define TSMF_CLOCK_MAX_SKEW		10000000LL
+
+typedef struct _TSMF_CLOCK TSMF_CLOCK;
+
+/**
+ * The media clock of one presentation, mapping sample times to the
+ * monotonic system time.
+ *
+ * The clock starts on the first sample presented, and from then on runs
+ * with the system time. An audio device that can report its latency
+ * drives the clock: each played sample moves it to the time the device
+ * will have played it, whenever the two drift apart by more than
+ * TSMF_CLOCK_TOLERANCE. Video frames are held back until the clock
+ * reaches their start time.
+ */
+struct _TSMF_CLOCK
+{
+	BOOL anchored;
+	BOOL paused;
+	INT64 media_base;
+	INT64 system_base;
+};
+
+UINT64 tsmf_clock_system_time(void);
+
+void tsmf_clock_init(TSMF_CLOCK* clock);
+void tsmf_clock_reset(TSMF_CLOCK* clock);
+
+BOOL tsmf_clock_media_time(TSMF_CLOCK* clock, UINT64 now, INT64* media_time);
+void tsmf_clock_anchor(TSMF_CLOCK* clock, UINT64 media_time, UINT64 system_time);
+BOOL tsmf_clock_sync(TSMF_CLOCK* clock, UINT64 media_time, UINT64 system_time);
+
+void tsmf_clock_pause(TSMF_CLOCK* clock, UINT64 now);
+void tsmf_clock_resume(TSMF_CLOCK* clock, UINT64 now);
+
+BOOL tsmf_clock_due(TSMF_CLOCK* clock, UINT64 media_time, UINT64 now, UINT64* delay);
+DWORD tsmf_clock_timeout(UINT64 delay);
+
+#endif /* __TSMF_CLOCK_H */
@@ -21,6 +21,8 @@
 #ifndef __TSMF_DECODER_H
 #define __TSMF_DECODER_H
 
+#include <freerdp/utils/buffer.h>
+
 #include "tsmf_types.h"
 
 typedef enum _ITSMFControlMsg
@@ -60,6 +62,8 @@ struct _ITSMFDecoder
 	void (*ChangeVolume) (ITSMFDecoder * decoder, UINT32 newVolume, UINT32 muted);
 	/* Check buffer level */
 	UINT32 (*BufferLevel) (ITSMFDecoder * decoder);
+	/* Optional, get the decoded video frame written into a buffer from the pool, instead of GetDecodedData */
+	SHARED_BUFFER* (*GetDecodedFrame) (ITSMFDecoder* decoder, SHARED_BUFFER_POOL* pool);
 };
 
 #define TSMF_DECODER_EXPORT_FUNC_NAME "TSMFDecoderEntry"
@@ -31,17 +31,12 @@
 #include <unistd.h>
 #endif
 
-#ifndef _WIN32
-#include <sys/time.h>
-#endif
-
 #include <winpr/crt.h>
 
 #include <freerdp/utils/stream.h>
 #include <freerdp/utils/list.h>
 #include <freerdp/utils/thread.h>
 #include <freerdp/utils/event.h>
-#include <freerdp/utils/sleep.h>
 #include <freerdp/client/tsmf.h>
 
 #include <winpr/synch.h>
@@ -52,10 +47,14 @@
 #include "tsmf_audio.h"
 #include "tsmf_main.h"
 #include "tsmf_codec.h"
+#include "tsmf_clock.h"
 #include "tsmf_media.h"
 
 #define AUDIO_TOLERANCE 10000000LL
 
+/* Decoded frames kept for reuse per video stream, covering those still queued to the client */
+#define VIDEO_FRAME_POOL_SIZE 8
+
 struct _TSMF_PRESENTATION
 {
 	BYTE presentation_id[GUID_SIZE];
@@ -80,8 +79,8 @@ struct _TSMF_PRESENTATION
 
 	IWTSVirtualChannelCallback* channel_callback;
 
-	UINT64 audio_start_time;
-	UINT64 audio_end_time;
+	/* The clock is shared by the stream threads and protected by the mutex as well. */
+	TSMF_CLOCK clock;
 
 	/* The stream list could be accessed by different threads and need to be protected. */
 	HANDLE mutex;
@@ -109,11 +108,14 @@ struct _TSMF_STREAM
 
 	/* The end_time of last played sample */
 	UINT64 last_end_time;
-	/* Next sample should not start before this system time. */
-	UINT64 next_start_time;
+	/* Held back for another stream to catch up, to be woken when it does. */
+	BOOL sync_waiting;
 
 	freerdp_thread* thread;
 
+	/* Buffers for the decoded frames of a video stream, reused once the client is done with them. */
+	SHARED_BUFFER_POOL* frame_pool;
+
 	LIST* sample_list;
 
 	/* The sample ack response queue will be accessed only by the stream thread. */
@@ -131,6 +133,7 @@ struct _TSMF_SAMPLE
 	BYTE* data;
 	UINT32 decoded_size;
 	UINT32 pixfmt;
+	SHARED_BUFFER* frame;
 
 	TSMF_STREAM* stream;
 	IWTSVirtualChannelCallback* channel_callback;
@@ -142,12 +145,29 @@ static UINT64 last_played_audio_time = 0;
 static HANDLE tsmf_mutex = NULL;
 static int TERMINATING = 0;
 
-static UINT64 get_current_time(void)
+/**
+ * Wakes the threads of a presentation's streams, all of them or only those
+ * held back for another stream to catch up.
+ */
+static void tsmf_presentation_wake_streams(TSMF_PRESENTATION* presentation, TSMF_STREAM* except, BOOL waiting_only)
 {
-	struct timeval tp;
+	LIST_ITEM* item;
+	TSMF_STREAM* stream;
+
+	WaitForSingleObject(presentation->mutex, INFINITE);
+
+	for (item = presentation->stream_list->head; item; item = item->next)
+	{
+		stream = (TSMF_STREAM*) item->data;
+
+		if (stream == except)
+			continue;
+
+		if (!waiting_only || stream->sync_waiting)
+			freerdp_thread_signal(stream->thread);
+	}
 
-	gettimeofday(&tp, 0);
-	return ((UINT64)tp.tv_sec) * 10000000LL + ((UINT64)tp.tv_usec) * 10LL;
+	ReleaseMutex(presentation->mutex);
 }
 
 static TSMF_SAMPLE* tsmf_stream_pop_sample(TSMF_STREAM* stream, int sync)
@@ -167,36 +187,32 @@ static TSMF_SAMPLE* tsmf_stream_pop_sample(TSMF_STREAM* stream, int sync)
 		{
 			if (stream->decoder->GetDecodedData)
 			{
-				if (stream->major_type == TSMF_MAJOR_TYPE_AUDIO)
+				WaitForSingleObject(presentation->mutex, INFINITE);
+
+				/* Nothing is played while paused, the restart wakes the stream again */
+				if (presentation->clock.paused)
+					pending = TRUE;
+
+				/* Check if some other stream has earlier sample that needs to be played first */
+				if (!pending && stream->major_type == TSMF_MAJOR_TYPE_AUDIO &&
+					stream->last_end_time > AUDIO_TOLERANCE)
 				{
-					/* Check if some other stream has earlier sample that needs to be played first */
-					if (stream->last_end_time > AUDIO_TOLERANCE)
+					for (item = presentation->stream_list->head; item; item = item->next)
 					{
-						WaitForSingleObject(presentation->mutex, INFINITE);
+						s = (TSMF_STREAM*) item->data;
 
-						for (item = presentation->stream_list->head; item; item = item->next)
+						if (s != stream && !s->eos && s->last_end_time &&
+							s->last_end_time < stream->last_end_time - AUDIO_TOLERANCE)
 						{
-							s = (TSMF_STREAM*) item->data;
-
-							if (s != stream && !s->eos && s->last_end_time &&
-								s->last_end_time < stream->last_end_time - AUDIO_TOLERANCE)
-							{
-									pending = TRUE;
-									break;
-							}
+								pending = TRUE;
+								break;
 						}
-
-						ReleaseMutex(presentation->mutex);
-					}
-				}
-				else
-				{
-					if (stream->last_end_time > presentation->audio_end_time)
-					{
-						pending = TRUE;
 					}
 				}
 
+				stream->sync_waiting = pending;
+
+				ReleaseMutex(presentation->mutex);
 			}
 		}
 	}
@@ -216,7 +232,9 @@ static TSMF_SAMPLE* tsmf_stream_pop_sample(TSMF_STREAM* stream, int sync)
 
 static void tsmf_sample_free(TSMF_SAMPLE* sample)
 {
-	if (sample->data)
+	if (sample->frame)
+		shared_buffer_unref(sample->frame);
+	else if (sample->data)
 		free(sample->data);
 	free(sample);
 }
@@ -238,7 +256,7 @@ static void tsmf_stream_process_ack(TSMF_STREAM* stream)
 	TSMF_SAMPLE* sample;
 	UINT64 ack_time;
 
-	ack_time = get_current_time();
+	ack_time = tsmf_clock_system_time();
 	while (list_size(stream->sample_ack_list) > 0 && !freerdp_thread_is_stopped(stream->thread))
 	{
 		sample = (TSMF_SAMPLE*) list_peek(stream->sample_ack_list);
@@ -251,6 +269,28 @@ static void tsmf_stream_process_ack(TSMF_STREAM* stream)
 	}
 }
 
+/**
+ * Time in milliseconds until the next sample ack is due, INFINITE if none
+ * is queued.
+ */
+static DWORD tsmf_stream_ack_timeout(TSMF_STREAM* stream)
+{
+	UINT64 now;
+	TSMF_SAMPLE* sample;
+
+	sample = (TSMF_SAMPLE*) list_peek(stream->sample_ack_list);
+
+	if (!sample)
+		return INFINITE;
+
+	now = tsmf_clock_system_time();
+
+	if (sample->ack_time <= now)
+		return 0;
+
+	return tsmf_clock_timeout(sample->ack_time - now);
+}
+
 TSMF_PRESENTATION* tsmf_presentation_new(const BYTE* guid, IWTSVirtualChannelCallback* pChannelCallback)
 {
 	TSMF_PRESENTATION* presentation;
@@ -278,6 +318,7 @@ TSMF_PRESENTATION* tsmf_presentation_new(const BYTE* guid, IWTSVirtualChannelCal
 	memcpy(presentation->presentation_id, guid, GUID_SIZE);
 	presentation->channel_callback = pChannelCallback;
 
+	tsmf_clock_init(&presentation->clock);
 	presentation->mutex = CreateMutex(NULL, FALSE, NULL);
 	presentation->stream_list = list_new();
 
@@ -323,9 +364,34 @@ static void tsmf_presentation_restore_last_video_frame(TSMF_PRESENTATION* presen
 	}
 }
 
+/**
+ * Holds a decoded frame back until the presentation clock reaches its start
+ * time. New samples wake the thread as well, so the delay is computed again
+ * after every wakeup, which also catches the clock being paused or moved.
+ */
+static void tsmf_stream_wait_due(TSMF_STREAM* stream, TSMF_SAMPLE* sample)
+{
+	BOOL running;
+	UINT64 delay;
+	TSMF_PRESENTATION* presentation = stream->presentation;
+
+	while (!freerdp_thread_is_stopped(stream->thread))
+	{
+		freerdp_thread_reset(stream->thread);
+
+		WaitForSingleObject(presentation->mutex, INFINITE);
+		running = tsmf_clock_due(&presentation->clock, sample->start_time, tsmf_clock_system_time(), &delay);
+		ReleaseMutex(presentation->mutex);
+
+		if (running && (delay == 0))
+			break;
+
+		freerdp_thread_wait_timeout(stream->thread, running ? tsmf_clock_timeout(delay) : INFINITE);
+	}
+}
+
 static void tsmf_sample_playback_video(TSMF_SAMPLE* sample)
 {
-	UINT64 t;
 	RDP_VIDEO_FRAME_EVENT* vevent;
 	TSMF_STREAM* stream = sample->stream;
 	TSMF_PRESENTATION* presentation = stream->presentation;
@@ -335,15 +401,7 @@ static void tsmf_sample_playback_video(TSMF_SAMPLE* sample)
 
 	if (sample->data)
 	{
-		t = get_current_time();
-
-		if (stream->next_start_time > t &&
-			(sample->end_time >= presentation->audio_start_time ||
-			sample->end_time < stream->last_end_time))
-		{
-			freerdp_usleep((stream->next_start_time - t) / 10);
-		}
-		stream->next_start_time = t + sample->duration - 50000;
+		tsmf_stream_wait_due(stream, sample);
 
 		if (presentation->last_x != presentation->output_x ||
 			presentation->last_y != presentation->output_y ||
@@ -382,6 +440,7 @@ static void tsmf_sample_playback_video(TSMF_SAMPLE* sample)
 		vevent = (RDP_VIDEO_FRAME_EVENT*) freerdp_event_new(RDP_EVENT_CLASS_TSMF, RDP_EVENT_TYPE_TSMF_VIDEO_FRAME,
 			NULL, NULL);
 		vevent->frame_data = sample->data;
+		vevent->frame_buffer = sample->frame;
 		vevent->frame_size = sample->decoded_size;
 		vevent->frame_pixfmt = sample->pixfmt;
 		vevent->frame_width = sample->stream->width;
@@ -404,6 +463,7 @@ static void tsmf_sample_playback_video(TSMF_SAMPLE* sample)
 
 		/* The frame data ownership is passed to the event object, and is freed after the event is processed. */
 		sample->data = NULL;
+		sample->frame = NULL;
 		sample->decoded_size = 0;
 
 		if (!tsmf_push_event(sample->channel_callback, (RDP_EVENT*) vevent))
@@ -436,8 +496,10 @@ static void tsmf_sample_playback_video(TSMF_SAMPLE* sample)
 
 static void tsmf_sample_playback_audio(TSMF_SAMPLE* sample)
 {
+	UINT64 now;
 	UINT64 latency = 0;
 	TSMF_STREAM* stream = sample->stream;
+	TSMF_PRESENTATION* presentation = stream->presentation;
 
 	DEBUG_DVC("MessageId %d EndTime %d consumed.",
 		sample->sample_id, (int)sample->end_time);
@@ -457,10 +519,18 @@ static void tsmf_sample_playback_audio(TSMF_SAMPLE* sample)
 		latency = 0;
 	}
 
-	sample->ack_time = latency + get_current_time();
+	now = tsmf_clock_system_time();
+
+	/* The device has played the sample once its latency has passed, which drives the clock */
+	if (stream->audio && stream->audio->GetLatency)
+	{
+		WaitForSingleObject(presentation->mutex, INFINITE);
+		tsmf_clock_sync(&presentation->clock, sample->end_time, now + latency);
+		ReleaseMutex(presentation->mutex);
+	}
+
+	sample->ack_time = latency + now;
 	stream->last_end_time = sample->end_time + latency;
-	stream->presentation->audio_start_time = sample->start_time + latency;
-	stream->presentation->audio_end_time = sample->end_time + latency;
 }
 
 static void tsmf_sample_playback(TSMF_SAMPLE* sample)
@@ -519,7 +589,21 @@ static void tsmf_sample_playback(TSMF_SAMPLE* sample)
 
 	if (stream->decoder->GetDecodedData)
 	{
-		sample->data = stream->decoder->GetDecodedData(stream->decoder, &sample->decoded_size);
+		if (stream->frame_pool && stream->decoder->GetDecodedFrame)
+		{
+			sample->frame = stream->decoder->GetDecodedFrame(stream->decoder, stream->frame_pool);
+
+			if (sample->frame)
+			{
+				sample->data = sample->frame->data;
+				sample->decoded_size = sample->frame->size;
+			}
+		}
+		else
+		{
+			sample->data = stream->decoder->GetDecodedData(stream->decoder, &sample->decoded_size);
+		}
+
 		switch (sample->stream->major_type)
 		{
 			case TSMF_MAJOR_TYPE_VIDEO:
@@ -536,7 +620,7 @@ static void tsmf_sample_playback(TSMF_SAMPLE* sample)
 	else
 	{
 		TSMF_STREAM * stream = sample->stream;
-		UINT64 ack_anticipation_time = get_current_time();
+		UINT64 ack_anticipation_time = tsmf_clock_system_time();
 		UINT64 currentRunningTime = sample->start_time;
 		UINT32 bufferLevel = 0;
 		if (stream->decoder->GetRunningTime)
@@ -672,12 +756,21 @@ static void* tsmf_stream_playback_func(void* arg)
 	}
 	while (!freerdp_thread_is_stopped(stream->thread))
 	{
+		/* Reset before looking at the queues, so that no wakeup gets lost */
+		freerdp_thread_reset(stream->thread);
+
 		tsmf_stream_process_ack(stream);
 		sample = tsmf_stream_pop_sample(stream, 1);
+
 		if (sample)
+		{
 			tsmf_sample_playback(sample);
-		else
-			freerdp_usleep(5000);
+			tsmf_presentation_wake_streams(presentation, stream, TRUE);
+			continue;
+		}
+
+		/* Sleep until a sample arrives or an ack is due, idle and paused streams sleep for good */
+		freerdp_thread_wait_timeout(stream->thread, tsmf_stream_ack_timeout(stream));
 	}
 	if (stream->eos || presentation->eos)
 	{
@@ -784,6 +877,10 @@ void tsmf_presentation_paused(TSMF_PRESENTATION* presentation)
 	LIST_ITEM* item;
 	TSMF_STREAM* stream;
 
+	WaitForSingleObject(presentation->mutex, INFINITE);
+	tsmf_clock_pause(&presentation->clock, tsmf_clock_system_time());
+	ReleaseMutex(presentation->mutex);
+
 	for (item = presentation->stream_list->head; item; item = item->next)
 	{
 		stream = (TSMF_STREAM*) item->data;
@@ -796,11 +893,17 @@ void tsmf_presentation_restarted(TSMF_PRESENTATION* presentation)
 	LIST_ITEM* item;
 	TSMF_STREAM* stream;
 
+	WaitForSingleObject(presentation->mutex, INFINITE);
+	tsmf_clock_resume(&presentation->clock, tsmf_clock_system_time());
+	ReleaseMutex(presentation->mutex);
+
 	for (item = presentation->stream_list->head; item; item = item->next)
 	{
 		stream = (TSMF_STREAM*) item->data;
 		tsmf_stream_restart(stream);
 	}
+
+	tsmf_presentation_wake_streams(presentation, NULL, FALSE);
 }
 
 void tsmf_presentation_start(TSMF_PRESENTATION* presentation)
@@ -878,12 +981,6 @@ static void tsmf_stream_flush(TSMF_STREAM* stream)
 
 	stream->eos = 0;
 	stream->last_end_time = 0;
-	stream->next_start_time = 0;
-	if (stream->major_type == TSMF_MAJOR_TYPE_AUDIO)
-	{
-		stream->presentation->audio_start_time = 0;
-		stream->presentation->audio_end_time = 0;
-	}
 }
 
 void tsmf_presentation_flush(TSMF_PRESENTATION* presentation)
@@ -898,8 +995,12 @@ void tsmf_presentation_flush(TSMF_PRESENTATION* presentation)
 	}
 
 	presentation->eos = 0;
-	presentation->audio_start_time = 0;
-	presentation->audio_end_time = 0;
+
+	WaitForSingleObject(presentation->mutex, INFINITE);
+	tsmf_clock_reset(&presentation->clock);
+	ReleaseMutex(presentation->mutex);
+
+	tsmf_presentation_wake_streams(presentation, NULL, FALSE);
 }
 
 void tsmf_presentation_free(TSMF_PRESENTATION* presentation)
@@ -999,12 +1100,18 @@ void tsmf_stream_set_format(TSMF_STREAM* stream, const char* name, STREAM* s)
 	stream->width = mediatype.Width;
 	stream->height = mediatype.Height;
 	stream->decoder = tsmf_load_decoder(name, &mediatype);
+
+	if (stream->decoder && stream->decoder->GetDecodedFrame && stream->major_type == TSMF_MAJOR_TYPE_VIDEO)
+		stream->frame_pool = shared_buffer_pool_new(VIDEO_FRAME_POOL_SIZE);
 }
 
 void tsmf_stream_end(TSMF_STREAM* stream)
 {
 	stream->eos = 1;
 	stream->presentation->eos = 1;
+
+	/* An ended stream no longer holds the others back */
+	tsmf_presentation_wake_streams(stream->presentation, stream, TRUE);
 }
 
 void tsmf_stream_free(TSMF_STREAM* stream)
@@ -1018,6 +1125,8 @@ void tsmf_stream_free(TSMF_STREAM* stream)
 	list_remove(presentation->stream_list, stream);
 	ReleaseMutex(presentation->mutex);
 
+	tsmf_presentation_wake_streams(presentation, NULL, TRUE);
+
 	list_free(stream->sample_list);
 	list_free(stream->sample_ack_list);
 
@@ -1027,6 +1136,9 @@ void tsmf_stream_free(TSMF_STREAM* stream)
 		stream->decoder = 0;
 	}
 
+	/* Frames still queued to the client keep the pool until they are freed */
+	shared_buffer_pool_free(stream->frame_pool);
+
 	freerdp_thread_free(stream->thread);
 
 	free(stream);
@@ -1061,12 +1173,14 @@ void tsmf_stream_push_sample(TSMF_STREAM* stream, IWTSVirtualChannelCallback* pC
 	sample->channel_callback = pChannelCallback;
 	sample->data_size = data_size;
 	sample->data = malloc(data_size + TSMF_BUFFER_PADDING_SIZE);
-	ZeroMemory(sample->data, data_size + TSMF_BUFFER_PADDING_SIZE);
 	memcpy(sample->data, data, data_size);
+	ZeroMemory(sample->data + data_size, TSMF_BUFFER_PADDING_SIZE);
 
 	freerdp_thread_lock(stream->thread);
 	list_enqueue(stream->sample_list, sample);
 	freerdp_thread_unlock(stream->thread);
+
+	freerdp_thread_signal(stream->thread);
 }
 
 #ifndef _WIN32
@@ -24,6 +24,7 @@
 #include <freerdp/freerdp.h>
 #include <freerdp/constants.h>
 #include <freerdp/utils/event.h>
+#include <freerdp/utils/trace.h>
 #include <freerdp/client/file.h>
 #include <freerdp/client/cmdline.h>
 #include <freerdp/client/channels.h>
@@ -404,6 +405,10 @@ int dfreerdp_run(freerdp* instance)
 	df_free(dfi);
 	gdi_free(instance);
 	freerdp_disconnect(instance);
+
+	if (g_trace_enabled)
+		trace_print();
+
 	freerdp_free(instance);
 
 	return 0;
@@ -0,0 +1,332 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * FreeRDP Session Dump Replay
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Plays a session dump, as written with /session-dump, through the client
+ * pipeline (fast-path and slow-path updates, bulk decompression, orders,
+ * caches, codecs and the gdi) as fast as it can, without a server or a
+ * window, then reports the frames per second, the processor time spent in
+ * every stage, their latency histograms and a checksum of the final frame
+ * buffer.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/constants.h>
+#include <freerdp/gdi/gdi.h>
+#include <freerdp/cache/cache.h>
+#include <freerdp/utils/trace.h>
+#include <freerdp/utils/stopwatch.h>
+
+#include <winpr/crt.h>
+#include <winpr/windows.h>
+
+enum replay_stage
+{
+	REPLAY_STAGE_PROTOCOL,
+	REPLAY_STAGE_BITMAP,
+	REPLAY_STAGE_SURFACE,
+	REPLAY_STAGE_CACHE,
+	REPLAY_STAGE_DRAWING,
+	REPLAY_STAGE_COUNT
+};
+
+static const char* const replay_stage_names[REPLAY_STAGE_COUNT] =
+{
+	"protocol",
+	"bitmap updates",
+	"surface bits",
+	"cache orders",
+	"drawing orders"
+};
+
+struct replay_context
+{
+	rdpContext _p;
+
+	UINT32 frames;
+	STOPWATCH* stages[REPLAY_STAGE_COUNT];
+
+	pBitmapUpdate BitmapUpdate;
+	pSurfaceBits SurfaceBits;
+	pEndPaint EndPaint;
+
+	pCacheBitmap CacheBitmap;
+	pCacheBitmapV2 CacheBitmapV2;
+	pCacheBitmapV3 CacheBitmapV3;
+	pCacheGlyph CacheGlyph;
+	pCacheGlyphV2 CacheGlyphV2;
+	pCacheBrush CacheBrush;
+
+	pDstBlt DstBlt;
+	pPatBlt PatBlt;
+	pScrBlt ScrBlt;
+	pOpaqueRect OpaqueRect;
+	pMultiOpaqueRect MultiOpaqueRect;
+	pLineTo LineTo;
+	pPolyline Polyline;
+	pMemBlt MemBlt;
+	pMem3Blt Mem3Blt;
+	pGlyphIndex GlyphIndex;
+	pFastIndex FastIndex;
+	pFastGlyph FastGlyph;
+};
+typedef struct replay_context replayContext;
+
+/* times the gdi callback of the given name as part of a stage */
+#define REPLAY_CALLBACK(_name, _type, _stage) \
+	static void replay_##_name(rdpContext* context, _type* arg) \
+	{ \
+		replayContext* rc = (replayContext*) context; \
+		stopwatch_start(rc->stages[_stage]); \
+		rc->_name(context, arg); \
+		stopwatch_stop(rc->stages[_stage]); \
+	}
+
+REPLAY_CALLBACK(BitmapUpdate, BITMAP_UPDATE, REPLAY_STAGE_BITMAP)
+REPLAY_CALLBACK(SurfaceBits, SURFACE_BITS_COMMAND, REPLAY_STAGE_SURFACE)
+
+REPLAY_CALLBACK(CacheBitmap, CACHE_BITMAP_ORDER, REPLAY_STAGE_CACHE)
+REPLAY_CALLBACK(CacheBitmapV2, CACHE_BITMAP_V2_ORDER, REPLAY_STAGE_CACHE)
+REPLAY_CALLBACK(CacheBitmapV3, CACHE_BITMAP_V3_ORDER, REPLAY_STAGE_CACHE)
+REPLAY_CALLBACK(CacheGlyph, CACHE_GLYPH_ORDER, REPLAY_STAGE_CACHE)
+REPLAY_CALLBACK(CacheGlyphV2, CACHE_GLYPH_V2_ORDER, REPLAY_STAGE_CACHE)
+REPLAY_CALLBACK(CacheBrush, CACHE_BRUSH_ORDER, REPLAY_STAGE_CACHE)
+
+REPLAY_CALLBACK(DstBlt, DSTBLT_ORDER, REPLAY_STAGE_DRAWING)
+REPLAY_CALLBACK(PatBlt, PATBLT_ORDER, REPLAY_STAGE_DRAWING)
+REPLAY_CALLBACK(ScrBlt, SCRBLT_ORDER, REPLAY_STAGE_DRAWING)
+REPLAY_CALLBACK(OpaqueRect, OPAQUE_RECT_ORDER, REPLAY_STAGE_DRAWING)
+REPLAY_CALLBACK(MultiOpaqueRect, MULTI_OPAQUE_RECT_ORDER, REPLAY_STAGE_DRAWING)
+REPLAY_CALLBACK(LineTo, LINE_TO_ORDER, REPLAY_STAGE_DRAWING)
+REPLAY_CALLBACK(Polyline, POLYLINE_ORDER, REPLAY_STAGE_DRAWING)
+REPLAY_CALLBACK(MemBlt, MEMBLT_ORDER, REPLAY_STAGE_DRAWING)
+REPLAY_CALLBACK(Mem3Blt, MEM3BLT_ORDER, REPLAY_STAGE_DRAWING)
+REPLAY_CALLBACK(GlyphIndex, GLYPH_INDEX_ORDER, REPLAY_STAGE_DRAWING)
+REPLAY_CALLBACK(FastIndex, FAST_INDEX_ORDER, REPLAY_STAGE_DRAWING)
+REPLAY_CALLBACK(FastGlyph, FAST_GLYPH_ORDER, REPLAY_STAGE_DRAWING)
+
+/* hooks the gdi callback of the given name when the gdi has one */
+#define REPLAY_HOOK(_table, _name) \
+	if (_table->_name) \
+	{ \
+		rc->_name = _table->_name; \
+		_table->_name = replay_##_name; \
+	}
+
+static void replay_end_paint(rdpContext* context)
+{
+	replayContext* rc = (replayContext*) context;
+
+	rc->frames++;
+	IFCALL(rc->EndPaint, context);
+}
+
+static void replay_desktop_resize(rdpContext* context)
+{
+	rdpSettings* settings = context->instance->settings;
+
+	gdi_resize(context->gdi, settings->DesktopWidth, settings->DesktopHeight);
+}
+
+/* FNV-1a, to compare the frame buffers of two replays */
+static UINT32 replay_checksum(BYTE* data, int length)
+{
+	int i;
+	UINT32 hash = 2166136261U;
+
+	for (i = 0; i < length; i++)
+	{
+		hash ^= data[i];
+		hash *= 16777619U;
+	}
+
+	return hash;
+}
+
+static BOOL replay_pre_connect(freerdp* instance)
+{
+	rdpSettings* settings = instance->settings;
+
+	settings->OrderSupport[NEG_DSTBLT_INDEX] = TRUE;
+	settings->OrderSupport[NEG_PATBLT_INDEX] = TRUE;
+	settings->OrderSupport[NEG_SCRBLT_INDEX] = TRUE;
+	settings->OrderSupport[NEG_OPAQUE_RECT_INDEX] = TRUE;
+	settings->OrderSupport[NEG_DRAWNINEGRID_INDEX] = TRUE;
+	settings->OrderSupport[NEG_MULTIDSTBLT_INDEX] = TRUE;
+	settings->OrderSupport[NEG_MULTIPATBLT_INDEX] = TRUE;
+	settings->OrderSupport[NEG_MULTISCRBLT_INDEX] = TRUE;
+	settings->OrderSupport[NEG_MULTIOPAQUERECT_INDEX] = TRUE;
+	settings->OrderSupport[NEG_MULTI_DRAWNINEGRID_INDEX] = TRUE;
+	settings->OrderSupport[NEG_LINETO_INDEX] = TRUE;
+	settings->OrderSupport[NEG_POLYLINE_INDEX] = TRUE;
+	settings->OrderSupport[NEG_MEMBLT_INDEX] = TRUE;
+	settings->OrderSupport[NEG_MEM3BLT_INDEX] = TRUE;
+	settings->OrderSupport[NEG_SAVEBITMAP_INDEX] = TRUE;
+	settings->OrderSupport[NEG_GLYPH_INDEX_INDEX] = TRUE;
+	settings->OrderSupport[NEG_FAST_INDEX_INDEX] = TRUE;
+	settings->OrderSupport[NEG_FAST_GLYPH_INDEX] = TRUE;
+	settings->OrderSupport[NEG_POLYGON_SC_INDEX] = TRUE;
+	settings->OrderSupport[NEG_POLYGON_CB_INDEX] = TRUE;
+	settings->OrderSupport[NEG_ELLIPSE_SC_INDEX] = TRUE;
+	settings->OrderSupport[NEG_ELLIPSE_CB_INDEX] = TRUE;
+
+	return TRUE;
+}
+
+static BOOL replay_post_connect(freerdp* instance)
+{
+	rdpUpdate* update = instance->update;
+	rdpPrimaryUpdate* primary = update->primary;
+	rdpSecondaryUpdate* secondary = update->secondary;
+	replayContext* rc = (replayContext*) instance->context;
+
+	gdi_init(instance, CLRCONV_ALPHA | CLRBUF_32BPP, NULL);
+
+	update->DesktopResize = replay_desktop_resize;
+
+	rc->EndPaint = update->EndPaint;
+	update->EndPaint = replay_end_paint;
+
+	REPLAY_HOOK(update, BitmapUpdate);
+	REPLAY_HOOK(update, SurfaceBits);
+
+	REPLAY_HOOK(secondary, CacheBitmap);
+	REPLAY_HOOK(secondary, CacheBitmapV2);
+	REPLAY_HOOK(secondary, CacheBitmapV3);
+	REPLAY_HOOK(secondary, CacheGlyph);
+	REPLAY_HOOK(secondary, CacheGlyphV2);
+	REPLAY_HOOK(secondary, CacheBrush);
+
+	REPLAY_HOOK(primary, DstBlt);
+	REPLAY_HOOK(primary, PatBlt);
+	REPLAY_HOOK(primary, ScrBlt);
+	REPLAY_HOOK(primary, OpaqueRect);
+	REPLAY_HOOK(primary, MultiOpaqueRect);
+	REPLAY_HOOK(primary, LineTo);
+	REPLAY_HOOK(primary, Polyline);
+	REPLAY_HOOK(primary, MemBlt);
+	REPLAY_HOOK(primary, Mem3Blt);
+	REPLAY_HOOK(primary, GlyphIndex);
+	REPLAY_HOOK(primary, FastIndex);
+	REPLAY_HOOK(primary, FastGlyph);
+
+	return TRUE;
+}
+
+static void replay_print_stats(replayContext* rc, STOPWATCH* total, UINT32 records, UINT64 elapsed)
+{
+	int i;
+	double seconds;
+	double others = 0;
+	rdpGdi* gdi = rc->_p.gdi;
+
+	for (i = REPLAY_STAGE_PROTOCOL + 1; i < REPLAY_STAGE_COUNT; i++)
+		others += stopwatch_get_elapsed_time_in_seconds(rc->stages[i]);
+
+	seconds = stopwatch_get_elapsed_time_in_seconds(total);
+
+	/* elapsed is in nanoseconds, as short dumps replay in well under a millisecond */
+	printf("%d records, %d frames in %.3f ms: %.1f frames per second\n",
+		records, rc->frames, elapsed / 1000000.0, elapsed ? (rc->frames * 1000000000.0) / elapsed : 0);
+
+	/* reading the dump and parsing the PDUs is whatever the callbacks did not take */
+	printf("%-16s %10.2f ms\n", replay_stage_names[REPLAY_STAGE_PROTOCOL],
+		(seconds - others > 0) ? (seconds - others) * 1000 : 0);
+
+	for (i = REPLAY_STAGE_PROTOCOL + 1; i < REPLAY_STAGE_COUNT; i++)
+	{
+		printf("%-16s %10.2f ms %10d calls\n", replay_stage_names[i],
+			stopwatch_get_elapsed_time_in_seconds(rc->stages[i]) * 1000, rc->stages[i]->count);
+	}
+
+	printf("frame buffer %dx%d checksum 0x%08X\n", gdi->width, gdi->height,
+		replay_checksum(gdi->primary_buffer, gdi->width * gdi->height * gdi->bytesPerPixel));
+}
+
+int main(int argc, char* argv[])
+{
+	int i;
+	int status;
+	UINT64 start;
+	UINT32 records = 0;
+	STOPWATCH* total;
+	freerdp* instance;
+	replayContext* rc;
+
+	if (argc != 2)
+	{
+		printf("usage: %s <session dump>\n", argv[0]);
+		return 1;
+	}
+
+	instance = freerdp_new();
+	instance->PreConnect = replay_pre_connect;
+	instance->PostConnect = replay_post_connect;
+	instance->ReceiveChannelData = NULL;
+
+	instance->context_size = sizeof(replayContext);
+	freerdp_context_new(instance);
+
+	rc = (replayContext*) instance->context;
+
+	for (i = 0; i < REPLAY_STAGE_COUNT; i++)
+		rc->stages[i] = stopwatch_create();
+
+	total = stopwatch_create();
+
+	if (!freerdp_replay_open(instance, argv[1]))
+	{
+		printf("failed to open %s\n", argv[1]);
+		return 1;
+	}
+
+	trace_set_enabled(TRUE);
+
+	start = trace_get_time();
+	stopwatch_start(total);
+
+	while ((status = freerdp_replay_check(instance)) > 0)
+		records++;
+
+	stopwatch_stop(total);
+	trace_set_enabled(FALSE);
+
+	if (status < 0)
+		printf("replay stopped on an invalid record after %d records\n", records);
+
+	replay_print_stats(rc, total, records, trace_get_time() - start);
+	trace_print();
+
+	for (i = 0; i < REPLAY_STAGE_COUNT; i++)
+		stopwatch_free(rc->stages[i]);
+
+	stopwatch_free(total);
+
+	cache_free(instance->context->cache);
+	gdi_free(instance);
+	freerdp_context_free(instance);
+	freerdp_free(instance);
+
+	return (status < 0) ? 1 : 0;
+}
@@ -146,7 +146,7 @@ void wf_Bitmap_Paint(rdpContext* context, rdpBitmap* bitmap)
 void wf_Bitmap_Decompress(rdpContext* context, rdpBitmap* bitmap,
 		BYTE* data, int width, int height, int bpp, int length, BOOL compressed, int codec_id)
 {
-	UINT16 size;
+	UINT32 size;
 
 	size = width * height * (bpp / 8);
 
@@ -43,6 +43,7 @@
 #include <freerdp/constants.h>
 #include <freerdp/utils/event.h>
 #include <freerdp/utils/svc_plugin.h>
+#include <freerdp/utils/trace.h>
 
 #include <freerdp/client/file.h>
 #include <freerdp/client/cmdline.h>
@@ -331,6 +332,7 @@ BOOL wf_post_connect(freerdp* instance)
 		wfi->hdc->hwnd->count = 32;
 		wfi->hdc->hwnd->cinvalid = (HGDI_RGN) malloc(sizeof(GDI_RGN) * wfi->hdc->hwnd->count);
 		wfi->hdc->hwnd->ninvalid = 0;
+		wfi->hdc->hwnd->invalidRgn = gdi_RegionNew();
 
 		wfi->image = wf_image_new(wfi, 64, 64, 32, NULL);
 		wfi->image->_bitmap.data = NULL;
@@ -638,6 +640,9 @@ int wfreerdp_run(freerdp* instance)
 	freerdp_channels_close(channels, instance);
 	freerdp_channels_free(channels);
 	freerdp_disconnect(instance);
+
+	if (g_trace_enabled)
+		trace_print();
 	
 	return 0;
 }
@@ -0,0 +1,213 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include <winpr/crt.h>
+
+#include "xf_shm.h"
+
+/**
+ * Full screen update throughput of the software GDI paint path, the way
+ * xf_sw_end_paint() pushes the primary buffer: into the backing pixmap,
+ * then copied to the window. Each frame redraws the whole buffer and is
+ * pushed once with XPutImage over the socket, then once with XShmPutImage
+ * from a shared segment.
+ *
+ * Needs an X server on the local host, e.g.:
+ * xvfb-run -s "-screen 0 1920x1080x24" TestX11Client TestXfShm
+ * Without a display the benchmark is skipped.
+ *
+ * Usage: TestXfShm [frames] [width] [height]
+ */
+
+#define TEST_FRAMES	200
+#define TEST_WIDTH	1920
+#define TEST_HEIGHT	1080
+
+static double test_now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	return tv.tv_sec + (tv.tv_usec / 1000000.0);
+}
+
+static void test_draw_frame(XImage* image, int frame)
+{
+	int x;
+	int y;
+	UINT32 pixel;
+	UINT32* row;
+
+	for (y = 0; y < image->height; y++)
+	{
+		row = (UINT32*) &image->data[y * image->bytes_per_line];
+		pixel = ((y + frame) & 0xFF) << 8;
+
+		for (x = 0; x < image->width; x++)
+			row[x] = pixel | ((x + frame) & 0xFF);
+	}
+}
+
+static BOOL test_check_frame(Display* display, Pixmap pixmap, XImage* image)
+{
+	int x;
+	BOOL match = TRUE;
+	XImage* result;
+
+	result = XGetImage(display, pixmap, 0, image->height / 2, image->width, 1, AllPlanes, ZPixmap);
+
+	if (result == NULL)
+		return FALSE;
+
+	for (x = 0; x < image->width; x++)
+	{
+		if ((XGetPixel(result, x, 0) & 0xFFFFFF) != (XGetPixel(image, x, image->height / 2) & 0xFFFFFF))
+		{
+			match = FALSE;
+			break;
+		}
+	}
+
+	XDestroyImage(result);
+
+	return match;
+}
+
+static void test_report(const char* name, int frames, int width, int height, double elapsed)
+{
+	printf("%-12s %d frames %dx%d in %.3f s: %7.1f frames/s %8.1f MB/s\n", name, frames, width, height,
+		elapsed, frames / elapsed, (frames * (double) width * height * 4) / (elapsed * 1024 * 1024));
+}
+
+int TestXfShm(int argc, char* argv[])
+{
+	int i;
+	int depth;
+	int frames = TEST_FRAMES;
+	int width = TEST_WIDTH;
+	int height = TEST_HEIGHT;
+	int status = 0;
+	double start;
+	double put_time;
+	double shm_time;
+	GC gc;
+	Window window;
+	Pixmap pixmap;
+	Visual* visual;
+	XImage* image;
+	Display* display;
+	xfShmImage* shm;
+
+	if (argc > 1)
+		frames = atoi(argv[1]);
+
+	if (argc > 3)
+	{
+		width = atoi(argv[2]);
+		height = atoi(argv[3]);
+	}
+
+	if ((frames < 1) || (width < 1) || (height < 1))
+	{
+		frames = TEST_FRAMES;
+		width = TEST_WIDTH;
+		height = TEST_HEIGHT;
+	}
+
+	display = XOpenDisplay(NULL);
+
+	if (display == NULL)
+	{
+		printf("no X display, skipping\n");
+		return 0;
+	}
+
+	visual = DefaultVisual(display, DefaultScreen(display));
+	depth = DefaultDepth(display, DefaultScreen(display));
+
+	/* frames are drawn as 32 bpp pixels */
+	if (depth != 24)
+	{
+		printf("depth %d, skipping\n", depth);
+		XCloseDisplay(display);
+		return 0;
+	}
+
+	window = XCreateSimpleWindow(display, DefaultRootWindow(display), 0, 0, width, height, 0, 0, 0);
+	XMapWindow(display, window);
+
+	pixmap = XCreatePixmap(display, window, width, height, depth);
+	gc = XCreateGC(display, pixmap, 0, NULL);
+
+	/* XPutImage from a client buffer, the path without MIT-SHM */
+	image = XCreateImage(display, visual, depth, ZPixmap, 0, (char*) malloc(width * height * 4), width, height, 32, 0);
+	XSync(display, False);
+
+	start = test_now();
+
+	for (i = 0; i < frames; i++)
+	{
+		test_draw_frame(image, i);
+		XPutImage(display, pixmap, gc, image, 0, 0, 0, 0, width, height);
+		XCopyArea(display, pixmap, window, gc, 0, 0, width, height, 0, 0);
+		XFlush(display);
+	}
+
+	XSync(display, False);
+	put_time = test_now() - start;
+	test_report("XPutImage", frames, width, height, put_time);
+
+	if (!test_check_frame(display, pixmap, image))
+	{
+		printf("XPutImage: pixmap does not match the last frame\n");
+		status = -1;
+	}
+
+	XDestroyImage(image);
+
+	/* XShmPutImage from a shared segment, waiting for the server before drawing again */
+	shm = xf_shm_query(display) ? xf_shm_image_new(display, visual, depth, width, height) : NULL;
+
+	if (shm == NULL)
+	{
+		printf("MIT-SHM is not available\n");
+	}
+	else
+	{
+		start = test_now();
+
+		for (i = 0; i < frames; i++)
+		{
+			xf_shm_image_wait(display, shm);
+			test_draw_frame(shm->image, i);
+			xf_shm_put_image(display, pixmap, gc, shm, 0, 0, 0, 0, width, height);
+			XCopyArea(display, pixmap, window, gc, 0, 0, width, height, 0, 0);
+			XFlush(display);
+		}
+
+		xf_shm_image_wait(display, shm);
+		shm_time = test_now() - start;
+		test_report("XShmPutImage", frames, width, height, shm_time);
+
+		printf("speedup: %.2fx\n", put_time / shm_time);
+
+		if (!test_check_frame(display, pixmap, shm->image))
+		{
+			printf("XShmPutImage: pixmap does not match the last frame\n");
+			status = -1;
+		}
+
+		xf_shm_image_free(display, shm);
+	}
+
+	XFreeGC(display, gc);
+	XFreePixmap(display, pixmap);
+	XDestroyWindow(display, window);
+	XCloseDisplay(display);
+
+	return status;
+}
@@ -24,6 +24,8 @@
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
 
+#include <winpr/crt.h>
+
 #include <freerdp/gdi/gdi.h>
 #include <freerdp/codec/rfx.h>
 #include <freerdp/codec/nsc.h>
@@ -947,7 +949,9 @@ static void xf_gdi_surface_update_frame(xfInfo* xfi, UINT16 tx, UINT16 ty, UINT1
 void xf_gdi_surface_bits(rdpContext* context, SURFACE_BITS_COMMAND* surface_bits_command)
 {
 	int i, tx, ty;
+	int left, top, right, bottom;
 	XImage* image;
+	RFX_SURFACE surface;
 	RFX_MESSAGE* message;
 	xfInfo* xfi = ((xfContext*) context)->xfi;
 	RFX_CONTEXT* rfx_context = (RFX_CONTEXT*) xfi->rfx_context;
@@ -955,8 +959,54 @@ void xf_gdi_surface_bits(rdpContext* context, SURFACE_BITS_COMMAND* surface_bits
 
 	if (surface_bits_command->codecID == CODEC_ID_REMOTEFX)
 	{
-		message = rfx_process_message(rfx_context,
-				surface_bits_command->bitmapData, surface_bits_command->bitmapDataLength);
+		/**
+		 * Tiles are decoded straight into a desktop sized client buffer,
+		 * which is then put once for the bounding box of the region with
+		 * the region as clip mask. With MIT-SHM that buffer is a shared
+		 * segment, and the put does not copy the pixels through the socket.
+		 */
+		if (xfi->use_xshm && (xfi->rfx_shm == NULL))
+		{
+			xfi->rfx_shm = xf_shm_image_new(xfi->display, xfi->visual, xfi->depth, xfi->width, xfi->height);
+
+			if (xfi->rfx_shm && (xfi->rfx_shm->image->bits_per_pixel != 32))
+			{
+				xf_shm_image_free(xfi->display, xfi->rfx_shm);
+				xfi->rfx_shm = NULL;
+			}
+
+			if (xfi->rfx_shm == NULL)
+				xfi->use_xshm = FALSE;
+		}
+
+		ZeroMemory(&surface, sizeof(RFX_SURFACE));
+
+		if (xfi->rfx_shm)
+		{
+			/* the previous put may still be reading the segment */
+			xf_shm_image_wait(xfi->display, xfi->rfx_shm);
+
+			surface.data = (BYTE*) xfi->rfx_shm->image->data;
+			surface.stride = xfi->rfx_shm->image->bytes_per_line;
+		}
+		else
+		{
+			if (xfi->bmp_codec_rfx == NULL)
+				xfi->bmp_codec_rfx = (BYTE*) malloc(xfi->width * xfi->height * 4);
+
+			surface.data = xfi->bmp_codec_rfx;
+			surface.stride = xfi->width * 4;
+		}
+
+		surface.width = xfi->width;
+		surface.height = xfi->height;
+		/* both buffers hold 32 bpp pixels, in the byte order of the visual */
+		surface.pixel_format = (xfi->clrconv->invert) ? RDP_PIXEL_FORMAT_R8G8B8A8 : RDP_PIXEL_FORMAT_B8G8R8A8;
+		surface.left = surface_bits_command->destLeft;
+		surface.top = surface_bits_command->destTop;
+
+		message = rfx_process_message_surface(rfx_context,
+				surface_bits_command->bitmapData, surface_bits_command->bitmapDataLength, &surface);
 
 		XSetFunction(xfi->display, xfi->gc, GXcopy);
 		XSetFillStyle(xfi->display, xfi->gc, FillSolid);
@@ -965,16 +1015,39 @@ void xf_gdi_surface_bits(rdpContext* context, SURFACE_BITS_COMMAND* surface_bits
 				surface_bits_command->destLeft, surface_bits_command->destTop,
 				(XRectangle*) message->rects, message->num_rects, YXBanded);
 
-		/* Draw the tiles to primary surface, each is 64x64. */
-		for (i = 0; i < message->num_tiles; i++)
+		left = top = 0;
+		right = bottom = 0;
+
+		for (i = 0; i < message->num_rects; i++)
 		{
-			image = XCreateImage(xfi->display, xfi->visual, 24, ZPixmap, 0,
-				(char*) message->tiles[i]->data, 64, 64, 32, 0);
+			tx = message->rects[i].x + surface_bits_command->destLeft;
+			ty = message->rects[i].y + surface_bits_command->destTop;
 
-			tx = message->tiles[i]->x + surface_bits_command->destLeft;
-			ty = message->tiles[i]->y + surface_bits_command->destTop;
+			if ((i == 0) || (tx < left))
+				left = tx;
+			if ((i == 0) || (ty < top))
+				top = ty;
+			if ((i == 0) || (tx + message->rects[i].width > right))
+				right = tx + message->rects[i].width;
+			if ((i == 0) || (ty + message->rects[i].height > bottom))
+				bottom = ty + message->rects[i].height;
+		}
+
+		right = MIN(right, xfi->width);
+		bottom = MIN(bottom, xfi->height);
+
+		if ((left < right) && (top < bottom) && xfi->rfx_shm)
+		{
+			xf_shm_put_image(xfi->display, xfi->primary, xfi->gc, xfi->rfx_shm,
+				left, top, left, top, right - left, bottom - top);
+		}
+		else if ((left < right) && (top < bottom))
+		{
+			image = XCreateImage(xfi->display, xfi->visual, 24, ZPixmap, 0,
+				(char*) xfi->bmp_codec_rfx, xfi->width, xfi->height, 32, 0);
 
-			XPutImage(xfi->display, xfi->primary, xfi->gc, image, 0, 0, tx, ty, 64, 64);
+			XPutImage(xfi->display, xfi->primary, xfi->gc, image,
+				left, top, left, top, right - left, bottom - top);
 			XFree(image);
 		}
 
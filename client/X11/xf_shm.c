@@ -0,0 +1,182 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * X11 Shared Memory Images
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef WITH_XSHM
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#endif
+
+#include <winpr/crt.h>
+
+#include "xf_shm.h"
+
+#ifdef WITH_XSHM
+
+static BOOL xf_shm_attach_failed = FALSE;
+
+static int xf_shm_error_handler(Display* display, XErrorEvent* event)
+{
+	xf_shm_attach_failed = TRUE;
+	return 0;
+}
+
+BOOL xf_shm_query(Display* display)
+{
+	return XShmQueryExtension(display) ? TRUE : FALSE;
+}
+
+/**
+ * MIT-SHM is only usable when the X server shares our host, which the
+ * extension being present does not imply: a forwarded display may
+ * advertise it and then fail the attach, so the attach is checked with a
+ * round trip and NULL returned for the caller to fall back to XPutImage.
+ */
+
+xfShmImage* xf_shm_image_new(Display* display, Visual* visual, int depth, int width, int height)
+{
+	xfShmImage* shm;
+	int (*handler)(Display*, XErrorEvent*);
+
+	shm = (xfShmImage*) malloc(sizeof(xfShmImage));
+	ZeroMemory(shm, sizeof(xfShmImage));
+
+	shm->shminfo.shmid = -1;
+	shm->image = XShmCreateImage(display, visual, depth, ZPixmap, NULL, &shm->shminfo, width, height);
+
+	if (shm->image == NULL)
+	{
+		free(shm);
+		return NULL;
+	}
+
+	shm->shminfo.shmid = shmget(IPC_PRIVATE, shm->image->bytes_per_line * shm->image->height, IPC_CREAT | 0600);
+
+	if (shm->shminfo.shmid == -1)
+	{
+		XDestroyImage(shm->image);
+		free(shm);
+		return NULL;
+	}
+
+	shm->shminfo.shmaddr = shm->image->data = (char*) shmat(shm->shminfo.shmid, 0, 0);
+	shm->shminfo.readOnly = False;
+
+	if (shm->shminfo.shmaddr == (char*) -1)
+	{
+		shmctl(shm->shminfo.shmid, IPC_RMID, NULL);
+		shm->image->data = NULL;
+		XDestroyImage(shm->image);
+		free(shm);
+		return NULL;
+	}
+
+	xf_shm_attach_failed = FALSE;
+	handler = XSetErrorHandler(xf_shm_error_handler);
+
+	XShmAttach(display, &shm->shminfo);
+	XSync(display, False);
+
+	XSetErrorHandler(handler);
+
+	/* the segment goes away with its last detach, even if we crash */
+	shmctl(shm->shminfo.shmid, IPC_RMID, NULL);
+
+	if (xf_shm_attach_failed)
+	{
+		printf("xf_shm_image_new: XShmAttach failed, falling back to XPutImage\n");
+		shmdt(shm->shminfo.shmaddr);
+		shm->image->data = NULL;
+		XDestroyImage(shm->image);
+		free(shm);
+		return NULL;
+	}
+
+	return shm;
+}
+
+void xf_shm_image_free(Display* display, xfShmImage* shm)
+{
+	if (shm == NULL)
+		return;
+
+	XShmDetach(display, &shm->shminfo);
+	XSync(display, False);
+
+	shmdt(shm->shminfo.shmaddr);
+	shm->image->data = NULL;
+	XDestroyImage(shm->image);
+
+	free(shm);
+}
+
+void xf_shm_put_image(Display* display, Drawable drawable, GC gc, xfShmImage* shm,
+		int src_x, int src_y, int dst_x, int dst_y, int width, int height)
+{
+	XShmPutImage(display, drawable, gc, shm->image, src_x, src_y, dst_x, dst_y, width, height, False);
+	shm->pending = TRUE;
+}
+
+/**
+ * Wait for the X server to be done with the pending puts. A round trip is
+ * enough since it processes requests in order.
+ */
+
+void xf_shm_image_wait(Display* display, xfShmImage* shm)
+{
+	if (shm && shm->pending)
+	{
+		XSync(display, False);
+		shm->pending = FALSE;
+	}
+}
+
+#else
+
+BOOL xf_shm_query(Display* display)
+{
+	return FALSE;
+}
+
+xfShmImage* xf_shm_image_new(Display* display, Visual* visual, int depth, int width, int height)
+{
+	return NULL;
+}
+
+void xf_shm_image_free(Display* display, xfShmImage* shm)
+{
+
+}
+
+void xf_shm_put_image(Display* display, Drawable drawable, GC gc, xfShmImage* shm,
+		int src_x, int src_y, int dst_x, int dst_y, int width, int height)
+{
+
+}
+
+void xf_shm_image_wait(Display* display, xfShmImage* shm)
+{
+
+}
+
+#endif
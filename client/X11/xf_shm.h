@@ -0,0 +1,56 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * X11 Shared Memory Images
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __XF_SHM_H
+#define __XF_SHM_H
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+
+#ifdef WITH_XSHM
+#include <X11/extensions/XShm.h>
+#endif
+
+#include <freerdp/types.h>
+
+typedef struct xf_shm_image xfShmImage;
+
+/**
+ * An image in a MIT-SHM segment: the client renders into image->data and
+ * the X server reads the pixels from the segment instead of the socket.
+ * The server reads when it processes the request, so the image must not
+ * be drawn into again before xf_shm_image_wait() while a put is pending.
+ */
+struct xf_shm_image
+{
+	XImage* image;
+	BOOL pending;
+#ifdef WITH_XSHM
+	XShmSegmentInfo shminfo;
+#endif
+};
+
+BOOL xf_shm_query(Display* display);
+
+xfShmImage* xf_shm_image_new(Display* display, Visual* visual, int depth, int width, int height);
+void xf_shm_image_free(Display* display, xfShmImage* shm);
+
+void xf_shm_put_image(Display* display, Drawable drawable, GC gc, xfShmImage* shm,
+		int src_x, int src_y, int dst_x, int dst_y, int width, int height);
+void xf_shm_image_wait(Display* display, xfShmImage* shm);
+
+#endif /* __XF_SHM_H */
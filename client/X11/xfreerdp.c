@@ -54,6 +54,7 @@
 #include <freerdp/utils/event.h>
 #include <freerdp/utils/signal.h>
 #include <freerdp/utils/passphrase.h>
+#include <freerdp/utils/trace.h>
 #include <freerdp/client/cliprdr.h>
 #include <freerdp/client/channels.h>
 
@@ -98,9 +99,26 @@ void xf_context_free(freerdp* instance, rdpContext* context)
 
 }
 
+/**
+ * Put a rectangle of the software GDI primary buffer into the primary
+ * pixmap, through MIT-SHM when the buffer is a shared segment.
+ */
+void xf_sw_put_image(xfInfo* xfi, GC gc, int x, int y, int width, int height)
+{
+	if (xfi->primary_shm)
+		xf_shm_put_image(xfi->display, xfi->primary, gc, xfi->primary_shm, x, y, x, y, width, height);
+	else
+		XPutImage(xfi->display, xfi->primary, gc, xfi->image, x, y, x, y, width, height);
+}
+
 void xf_sw_begin_paint(rdpContext* context)
 {
 	rdpGdi* gdi = context->gdi;
+	xfInfo* xfi = ((xfContext*) context)->xfi;
+
+	/* the X server may still be reading the shared primary buffer */
+	xf_shm_image_wait(xfi->display, xfi->primary_shm);
+
 	gdi->primary->hdc->hwnd->invalid->null = 1;
 	gdi->primary->hdc->hwnd->ninvalid = 0;
 }
@@ -127,7 +145,7 @@ void xf_sw_end_paint(rdpContext* context)
 			w = gdi->primary->hdc->hwnd->invalid->w;
 			h = gdi->primary->hdc->hwnd->invalid->h;
 
-			XPutImage(xfi->display, xfi->primary, xfi->gc, xfi->image, x, y, x, y, w, h);
+			xf_sw_put_image(xfi, xfi->gc, x, y, w, h);
 			XCopyArea(xfi->display, xfi->primary, xfi->window->handle, xfi->gc, x, y, w, h, x, y);
 		}
 		else
@@ -139,8 +157,8 @@ void xf_sw_end_paint(rdpContext* context)
 			if (gdi->primary->hdc->hwnd->ninvalid < 1)
 				return;
 
-			ninvalid = gdi->primary->hdc->hwnd->ninvalid;
-			cinvalid = gdi->primary->hdc->hwnd->cinvalid;
+			/* the complex region never overlaps, unlike the raw rectangle list */
+			cinvalid = gdi_RegionGetRects(gdi->primary->hdc->hwnd->invalidRgn, &ninvalid);
 
 			for (i = 0; i < ninvalid; i++)
 			{
@@ -149,7 +167,7 @@ void xf_sw_end_paint(rdpContext* context)
 				w = cinvalid[i].w;
 				h = cinvalid[i].h;
 
-				XPutImage(xfi->display, xfi->primary, xfi->gc, xfi->image, x, y, x, y, w, h);
+				xf_sw_put_image(xfi, xfi->gc, x, y, w, h);
 				XCopyArea(xfi->display, xfi->primary, xfi->window->handle, xfi->gc, x, y, w, h, x, y);
 			}
 
@@ -170,6 +188,35 @@ void xf_sw_end_paint(rdpContext* context)
 	}
 }
 
+/**
+ * A shared segment for the software GDI to render into, if MIT-SHM is
+ * usable and the image layout is the one the GDI draws: packed rows of
+ * 16 or 32 bpp pixels.
+ */
+static xfShmImage* xf_sw_primary_shm_new(xfInfo* xfi, int width, int height)
+{
+	int bpp;
+	xfShmImage* shm;
+
+	if (!xfi->use_xshm)
+		return NULL;
+
+	shm = xf_shm_image_new(xfi->display, xfi->visual, xfi->depth, width, height);
+
+	if (shm == NULL)
+		return NULL;
+
+	bpp = (xfi->bpp > 16) ? 32 : 16;
+
+	if ((shm->image->bits_per_pixel != bpp) || (shm->image->bytes_per_line != width * (bpp / 8)))
+	{
+		xf_shm_image_free(xfi->display, shm);
+		return NULL;
+	}
+
+	return shm;
+}
+
 void xf_sw_desktop_resize(rdpContext* context)
 {
 	xfInfo* xfi;
@@ -181,12 +228,37 @@ void xf_sw_desktop_resize(rdpContext* context)
 	if (xfi->fullscreen != TRUE)
 	{
 		rdpGdi* gdi = context->gdi;
+
+		if ((gdi->width == xfi->width) && (gdi->height == xfi->height))
+			return;
+
+		/* gdi_resize() frees the primary buffer, unless it is a shared segment */
+		gdi->primary_buffer = NULL;
+
+		if (xfi->primary_shm)
+		{
+			gdi->primary->bitmap->data = NULL;
+			xf_shm_image_wait(xfi->display, xfi->primary_shm);
+			xf_shm_image_free(xfi->display, xfi->primary_shm);
+
+			xfi->primary_shm = xf_sw_primary_shm_new(xfi, xfi->width, xfi->height);
+
+			if (xfi->primary_shm)
+				gdi->primary_buffer = (BYTE*) xfi->primary_shm->image->data;
+		}
+
 		gdi_resize(gdi, xfi->width, xfi->height);
+		xfi->primary_buffer = gdi->primary_buffer;
 
 		if (xfi->image)
 		{
 			xfi->image->data = NULL;
 			XDestroyImage(xfi->image);
+			xfi->image = NULL;
+		}
+
+		if (xfi->primary_shm == NULL)
+		{
 			xfi->image = XCreateImage(xfi->display, xfi->visual, xfi->depth, ZPixmap, 0,
 					(char*) gdi->primary_buffer, gdi->width, gdi->height, xfi->scanline_pad, 0);
 		}
@@ -237,6 +309,13 @@ void xf_hw_desktop_resize(rdpContext* context)
 		xfi->width = settings->DesktopWidth;
 		xfi->height = settings->DesktopHeight;
 
+		/* reallocated at the new size by the next RemoteFX update */
+		free(xfi->bmp_codec_rfx);
+		xfi->bmp_codec_rfx = NULL;
+
+		xf_shm_image_free(xfi->display, xfi->rfx_shm);
+		xfi->rfx_shm = NULL;
+
 		if (xfi->window)
 			xf_ResizeDesktopWindow(xfi, xfi->window, settings->DesktopWidth, settings->DesktopHeight);
 
@@ -716,7 +795,12 @@ BOOL xf_post_connect(freerdp* instance)
 		else
 			flags |= CLRBUF_16BPP;
 
-		gdi_init(instance, flags, NULL);
+		/* render straight into a shared segment when MIT-SHM is usable */
+		xfi->use_xshm = xf_shm_query(xfi->display);
+		xfi->primary_shm = xf_sw_primary_shm_new(xfi,
+				instance->settings->DesktopWidth, instance->settings->DesktopHeight);
+
+		gdi_init(instance, flags, xfi->primary_shm ? (BYTE*) xfi->primary_shm->image->data : NULL);
 		gdi = instance->context->gdi;
 		xfi->primary_buffer = gdi->primary_buffer;
 
@@ -724,6 +808,7 @@ BOOL xf_post_connect(freerdp* instance)
 	}
 	else
 	{
+		xfi->use_xshm = xf_shm_query(xfi->display);
 		xfi->srcBpp = instance->settings->ColorDepth;
 		xf_gdi_register_update_callbacks(instance->update);
 
@@ -772,8 +857,11 @@ BOOL xf_post_connect(freerdp* instance)
 	XFillRectangle(xfi->display, xfi->primary, xfi->gc, 0, 0, xfi->width, xfi->height);
 	XFlush(xfi->display);
 
-	xfi->image = XCreateImage(xfi->display, xfi->visual, xfi->depth, ZPixmap, 0,
-			(char*) xfi->primary_buffer, xfi->width, xfi->height, xfi->scanline_pad, 0);
+	if (xfi->primary_shm == NULL)
+	{
+		xfi->image = XCreateImage(xfi->display, xfi->visual, xfi->depth, ZPixmap, 0,
+				(char*) xfi->primary_buffer, xfi->width, xfi->height, xfi->scanline_pad, 0);
+	}
 
 	xfi->bmp_codec_none = (BYTE*) malloc(64 * 64 * 4);
 
@@ -970,6 +1058,12 @@ void xf_window_free(xfInfo* xfi)
 		xfi->image = NULL;
 	}
 
+	xf_shm_image_free(xfi->display, xfi->primary_shm);
+	xfi->primary_shm = NULL;
+
+	xf_shm_image_free(xfi->display, xfi->rfx_shm);
+	xfi->rfx_shm = NULL;
+
 	if (context != NULL)
 	{
 			cache_free(context->cache);
@@ -1005,6 +1099,7 @@ void xf_free(xfInfo* xfi)
 	xf_window_free(xfi);
 
 	free(xfi->bmp_codec_none);
+	free(xfi->bmp_codec_rfx);
 
 	XCloseDisplay(xfi->display);
 
@@ -1168,6 +1263,14 @@ int xfreerdp_run(freerdp* instance)
 	freerdp_channels_close(channels, instance);
 	freerdp_channels_free(channels);
 	freerdp_disconnect(instance);
+
+	if (g_trace_enabled)
+		trace_print();
+
+	/* the shared primary buffer is released with its segment, not by the GDI */
+	if (xfi->primary_shm && instance->context->gdi)
+		instance->context->gdi->primary->bitmap->data = NULL;
+
 	gdi_free(instance);
 	xf_free(xfi);
 
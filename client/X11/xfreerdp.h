@@ -34,6 +34,7 @@
 
 typedef struct xf_info xfInfo;
 
+#include "xf_shm.h"
 #include "xf_window.h"
 #include "xf_monitor.h"
 
@@ -119,6 +120,10 @@ struct xf_info
 	BOOL sw_gdi;
 	BYTE* primary_buffer;
 
+	BOOL use_xshm;
+	xfShmImage* primary_shm;
+	xfShmImage* rfx_shm;
+
 	BOOL frame_begin;
 	UINT16 frame_x1;
 	UINT16 frame_y1;
@@ -138,6 +143,7 @@ struct xf_info
 	VIRTUAL_SCREEN vscreen;
 	BYTE* bmp_codec_none;
 	BYTE* bmp_codec_nsc;
+	BYTE* bmp_codec_rfx;
 	void* rfx_context;
 	void* nsc_context;
 	void* xv_context;
@@ -169,6 +175,7 @@ struct xf_info
 };
 
 void xf_create_window(xfInfo* xfi);
+void xf_sw_put_image(xfInfo* xfi, GC gc, int x, int y, int width, int height);
 void xf_toggle_fullscreen(xfInfo* xfi);
 BOOL xf_post_connect(freerdp* instance);
 
@@ -26,6 +26,7 @@
 
 #include <freerdp/addin.h>
 #include <freerdp/settings.h>
+#include <freerdp/utils/trace.h>
 #include <freerdp/client/channels.h>
 #include <freerdp/locale/keyboard.h>
 
@@ -100,10 +101,13 @@ COMMAND_LINE_ARGUMENT_A args[] =
 	{ "mouse-motion", COMMAND_LINE_VALUE_BOOL, NULL, BoolValueTrue, NULL, -1, NULL, "mouse-motion" },
 	{ "parent-window", COMMAND_LINE_VALUE_REQUIRED, "<window id>", NULL, NULL, -1, NULL, "Parent window id" },
 	{ "bitmap-cache", COMMAND_LINE_VALUE_BOOL, NULL, BoolValueTrue, NULL, -1, NULL, "bitmap cache" },
+	{ "bitmap-cache-file", COMMAND_LINE_VALUE_REQUIRED, "<file>", NULL, NULL, -1, NULL, "persistent bitmap cache file" },
 	{ "offscreen-cache", COMMAND_LINE_VALUE_BOOL, NULL, BoolValueTrue, NULL, -1, NULL, "offscreen bitmap cache" },
 	{ "glyph-cache", COMMAND_LINE_VALUE_BOOL, NULL, BoolValueTrue, NULL, -1, NULL, "glyph cache" },
 	{ "codec-cache", COMMAND_LINE_VALUE_REQUIRED, "<rfx|nsc|jpeg>", NULL, NULL, -1, NULL, "bitmap codec cache" },
 	{ "fast-path", COMMAND_LINE_VALUE_BOOL, NULL, BoolValueTrue, NULL, -1, NULL, "fast-path input/output" },
+	{ "session-dump", COMMAND_LINE_VALUE_REQUIRED, "<file>", NULL, NULL, -1, NULL, "dump the session for replay" },
+	{ "trace", COMMAND_LINE_VALUE_BOOL, NULL, BoolValueFalse, NULL, -1, NULL, "stage latency tracing" },
 	{ "version", COMMAND_LINE_VALUE_FLAG | COMMAND_LINE_PRINT_VERSION, NULL, NULL, NULL, -1, NULL, "print version" },
 	{ "help", COMMAND_LINE_VALUE_FLAG | COMMAND_LINE_PRINT_HELP, NULL, NULL, NULL, -1, "?", "print help" },
 	{ NULL, 0, NULL, NULL, NULL, -1, NULL, NULL }
@@ -1116,6 +1120,16 @@ int freerdp_client_parse_command_line_arguments(int argc, char** argv, rdpSettin
 		{
 			settings->BitmapCacheEnabled = arg->Value ? TRUE : FALSE;
 		}
+		CommandLineSwitchCase(arg, "bitmap-cache-file")
+		{
+			UINT32 i;
+
+			settings->BitmapCachePersistEnabled = TRUE;
+			settings->BitmapCachePersistFile = _strdup(arg->Value);
+
+			for (i = 0; i < settings->BitmapCacheV2NumCells; i++)
+				settings->BitmapCacheV2CellInfo[i].persistent = TRUE;
+		}
 		CommandLineSwitchCase(arg, "offscreen-cache")
 		{
 			settings->OffscreenSupportLevel = arg->Value ? TRUE : FALSE;
@@ -1149,6 +1163,15 @@ int freerdp_client_parse_command_line_arguments(int argc, char** argv, rdpSettin
 			settings->FastPathInput = arg->Value ? TRUE : FALSE;
 			settings->FastPathOutput = arg->Value ? TRUE : FALSE;
 		}
+		CommandLineSwitchCase(arg, "session-dump")
+		{
+			settings->DumpSession = TRUE;
+			settings->DumpSessionFile = _strdup(arg->Value);
+		}
+		CommandLineSwitchCase(arg, "trace")
+		{
+			trace_set_enabled(arg->Value ? TRUE : FALSE);
+		}
 		CommandLineSwitchDefault(arg)
 		{
 
@@ -35,7 +35,9 @@
 #include <freerdp/gdi/drawing.h>
 #include <freerdp/gdi/clipping.h>
 #include <freerdp/gdi/32bpp.h>
+#include <freerdp/utils/stopwatch.h>
 
+#include "rop.h"
 #include "test_gdi.h"
 
 int init_gdi_suite(void)
@@ -74,6 +76,10 @@ int add_gdi_suite(void)
 	add_test_function(gdi_BitBlt_8bpp);
 	add_test_function(gdi_ClipCoords);
 	add_test_function(gdi_InvalidateRegion);
+	add_test_function(gdi_RegionCombine);
+	add_test_function(gdi_InvalidateComplexRegion);
+	add_test_function(gdi_RopKernels);
+	add_test_function(gdi_RopBenchmark);
 
 	return 0;
 }
@@ -2871,6 +2877,7 @@ void test_gdi_InvalidateRegion(void)
 	
 	hdc->hwnd->count = 16;
 	hdc->hwnd->cinvalid = (HGDI_RGN) malloc(sizeof(GDI_RGN) * hdc->hwnd->count);
+	hdc->hwnd->invalidRgn = NULL;
 
 	rgn1 = gdi_CreateRectRgn(0, 0, 0, 0);
 	rgn2 = gdi_CreateRectRgn(0, 0, 0, 0);
@@ -2989,3 +2996,437 @@ void test_gdi_InvalidateRegion(void)
 	gdi_InvalidateRegion(hdc, rgn1->x, rgn1->y, rgn1->w, rgn1->h);
 	CU_ASSERT(gdi_EqualRgn(invalid, rgn2) == 1);
 }
+
+static int test_region_equal(HGDI_REGION region, int* rects, int count)
+{
+	int i;
+	int nrects;
+	GDI_RGN* rgn;
+
+	rgn = gdi_RegionGetRects(region, &nrects);
+
+	if (nrects != count)
+		return 0;
+
+	for (i = 0; i < count; i++)
+	{
+		if ((rgn[i].x != rects[4 * i]) || (rgn[i].y != rects[4 * i + 1]) ||
+			(rgn[i].w != rects[4 * i + 2]) || (rgn[i].h != rects[4 * i + 3]))
+			return 0;
+	}
+
+	return 1;
+}
+
+void test_gdi_RegionCombine(void)
+{
+	HGDI_REGION rgn1;
+	HGDI_REGION rgn2;
+	HGDI_REGION rgn3;
+
+	int union_overlap[] =
+	{
+		0, 0, 100, 50,
+		0, 50, 150, 50,
+		50, 100, 100, 50
+	};
+
+	int union_disjoint[] =
+	{
+		0, 0, 10, 10,
+		1000, 700, 24, 68
+	};
+
+	int union_same_band[] =
+	{
+		0, 0, 10, 10,
+		20, 0, 10, 10
+	};
+
+	int intersect[] =
+	{
+		50, 50, 50, 50
+	};
+
+	int subtract[] =
+	{
+		0, 0, 100, 50,
+		0, 50, 50, 50
+	};
+
+	int hole[] =
+	{
+		0, 0, 30, 10,
+		0, 10, 10, 10,
+		20, 10, 10, 10,
+		0, 20, 30, 10
+	};
+
+	int coalesced[] =
+	{
+		0, 0, 30, 30
+	};
+
+	int extents[] =
+	{
+		0, 0, 70, 70
+	};
+
+	rgn1 = gdi_RegionNew();
+	rgn2 = gdi_RegionNew();
+	rgn3 = gdi_RegionNew();
+
+	CU_ASSERT(gdi_RegionIsEmpty(rgn1) == 1);
+
+	/* overlapping rectangles split into three bands */
+	gdi_RegionCombineRect(rgn1, 0, 0, 100, 100, GDI_RGN_OR);
+	gdi_RegionCombineRect(rgn1, 50, 50, 100, 100, GDI_RGN_OR);
+	CU_ASSERT(test_region_equal(rgn1, union_overlap, 3) == 1);
+	CU_ASSERT(rgn1->extents.x == 0 && rgn1->extents.y == 0);
+	CU_ASSERT(rgn1->extents.w == 150 && rgn1->extents.h == 150);
+
+	/* union is idempotent */
+	gdi_RegionCombineRect(rgn1, 50, 50, 100, 100, GDI_RGN_OR);
+	CU_ASSERT(test_region_equal(rgn1, union_overlap, 3) == 1);
+
+	/* intersection of two regions */
+	gdi_RegionClear(rgn1);
+	gdi_RegionCombineRect(rgn1, 0, 0, 100, 100, GDI_RGN_OR);
+	gdi_RegionCombineRect(rgn2, 50, 50, 100, 100, GDI_RGN_OR);
+	gdi_RegionCombine(rgn3, rgn1, rgn2, GDI_RGN_AND);
+	CU_ASSERT(test_region_equal(rgn3, intersect, 1) == 1);
+
+	/* difference of two regions */
+	gdi_RegionCombine(rgn3, rgn1, rgn2, GDI_RGN_DIFF);
+	CU_ASSERT(test_region_equal(rgn3, subtract, 2) == 1);
+
+	/* disjoint intersection is empty */
+	gdi_RegionClear(rgn2);
+	gdi_RegionCombineRect(rgn2, 200, 200, 10, 10, GDI_RGN_OR);
+	gdi_RegionCombine(rgn3, rgn1, rgn2, GDI_RGN_AND);
+	CU_ASSERT(gdi_RegionIsEmpty(rgn3) == 1);
+	CU_ASSERT(rgn3->extents.null == 1);
+
+	/* changes at opposite corners stay separate */
+	gdi_RegionClear(rgn1);
+	gdi_RegionCombineRect(rgn1, 1000, 700, 24, 68, GDI_RGN_OR);
+	gdi_RegionCombineRect(rgn1, 0, 0, 10, 10, GDI_RGN_OR);
+	CU_ASSERT(test_region_equal(rgn1, union_disjoint, 2) == 1);
+
+	/* rectangles of the same band are sorted left to right */
+	gdi_RegionClear(rgn1);
+	gdi_RegionCombineRect(rgn1, 20, 0, 10, 10, GDI_RGN_OR);
+	gdi_RegionCombineRect(rgn1, 0, 0, 10, 10, GDI_RGN_OR);
+	CU_ASSERT(test_region_equal(rgn1, union_same_band, 2) == 1);
+
+	/* punching a hole, then filling it again coalesces back to one rectangle */
+	gdi_RegionClear(rgn1);
+	gdi_RegionCombineRect(rgn1, 0, 0, 30, 30, GDI_RGN_OR);
+	gdi_RegionCombineRect(rgn1, 10, 10, 10, 10, GDI_RGN_DIFF);
+	CU_ASSERT(test_region_equal(rgn1, hole, 4) == 1);
+	gdi_RegionCombineRect(rgn1, 10, 10, 10, 10, GDI_RGN_OR);
+	CU_ASSERT(test_region_equal(rgn1, coalesced, 1) == 1);
+
+	/* simplification closes the gaps within bands, letting them coalesce */
+	gdi_RegionCombineRect(rgn1, 10, 10, 10, 10, GDI_RGN_DIFF);
+	CU_ASSERT(gdi_RegionSimplify(rgn1, 4) == 4);
+	CU_ASSERT(gdi_RegionSimplify(rgn1, 3) == 1);
+	CU_ASSERT(test_region_equal(rgn1, coalesced, 1) == 1);
+
+	gdi_RegionCombineRect(rgn1, 10, 10, 10, 10, GDI_RGN_DIFF);
+	gdi_RegionCombineRect(rgn1, 0, 10, 10, 10, GDI_RGN_DIFF);
+	gdi_RegionCombineRect(rgn1, 0, 10, 10, 10, GDI_RGN_OR);
+	CU_ASSERT(test_region_equal(rgn1, hole, 4) == 1);
+	gdi_RegionCombineRect(rgn1, 0, 40, 1, 1, GDI_RGN_AND);
+	CU_ASSERT(gdi_RegionIsEmpty(rgn1) == 1);
+
+	/* a diagonal cannot be coalesced and falls back to the extents */
+	gdi_RegionCombineRect(rgn1, 0, 0, 10, 10, GDI_RGN_OR);
+	gdi_RegionCombineRect(rgn1, 20, 20, 10, 10, GDI_RGN_OR);
+	gdi_RegionCombineRect(rgn1, 40, 40, 10, 10, GDI_RGN_OR);
+	gdi_RegionCombineRect(rgn1, 60, 60, 10, 10, GDI_RGN_OR);
+	CU_ASSERT(gdi_RegionSimplify(rgn1, 3) == 1);
+	CU_ASSERT(test_region_equal(rgn1, extents, 1) == 1);
+
+	gdi_RegionFree(rgn1);
+	gdi_RegionFree(rgn2);
+	gdi_RegionFree(rgn3);
+}
+
+void test_gdi_InvalidateComplexRegion(void)
+{
+	HGDI_DC hdc;
+	HGDI_BITMAP bmp;
+	GDI_RGN* rects;
+	int nrects;
+
+	hdc = gdi_GetDC();
+	hdc->bytesPerPixel = 4;
+	hdc->bitsPerPixel = 32;
+	bmp = gdi_CreateBitmap(1024, 768, 4, NULL);
+	gdi_SelectObject(hdc, (HGDIOBJECT) bmp);
+	gdi_SetNullClipRgn(hdc);
+
+	hdc->hwnd = (HGDI_WND) malloc(sizeof(GDI_WND));
+	hdc->hwnd->invalid = gdi_CreateRectRgn(0, 0, 0, 0);
+	hdc->hwnd->invalid->null = 1;
+	hdc->hwnd->count = 16;
+	hdc->hwnd->cinvalid = (HGDI_RGN) malloc(sizeof(GDI_RGN) * hdc->hwnd->count);
+	hdc->hwnd->ninvalid = 0;
+	hdc->hwnd->invalidRgn = gdi_RegionNew();
+
+	/* two small changes at opposite corners */
+	gdi_InvalidateRegion(hdc, 0, 0, 16, 16);
+	gdi_InvalidateRegion(hdc, 1008, 752, 16, 16);
+
+	CU_ASSERT(hdc->hwnd->invalid->w == 1024 && hdc->hwnd->invalid->h == 768);
+
+	rects = gdi_RegionGetRects(hdc->hwnd->invalidRgn, &nrects);
+	CU_ASSERT(nrects == 2);
+	CU_ASSERT(rects[0].x == 0 && rects[0].y == 0 && rects[0].w == 16 && rects[0].h == 16);
+	CU_ASSERT(rects[1].x == 1008 && rects[1].y == 752 && rects[1].w == 16 && rects[1].h == 16);
+
+	/* negative coordinates are clipped like the bounding box */
+	gdi_InvalidateRegion(hdc, -8, -8, 16, 16);
+	rects = gdi_RegionGetRects(hdc->hwnd->invalidRgn, &nrects);
+	CU_ASSERT(nrects == 2);
+	CU_ASSERT(rects[0].x == 0 && rects[0].y == 0 && rects[0].w == 16 && rects[0].h == 16);
+
+	/* resetting the bounding box restarts the complex region */
+	hdc->hwnd->invalid->null = 1;
+	hdc->hwnd->ninvalid = 0;
+	gdi_InvalidateRegion(hdc, 100, 100, 10, 10);
+	rects = gdi_RegionGetRects(hdc->hwnd->invalidRgn, &nrects);
+	CU_ASSERT(nrects == 1);
+	CU_ASSERT(rects[0].x == 100 && rects[0].y == 100 && rects[0].w == 10 && rects[0].h == 10);
+
+	gdi_DeleteDC(hdc);
+}
+
+#define ROP_TEST_LENGTH		160
+
+static void test_rop_fill_random(BYTE* data, int length)
+{
+	int i;
+
+	for (i = 0; i < length; i++)
+		data[i] = (BYTE) rand();
+}
+
+/* masks as produced by glyph expansion, with a few partial values thrown in */
+static void test_rop_fill_mask(BYTE* data, int length)
+{
+	int i;
+
+	for (i = 0; i < length; i++)
+		data[i] = (rand() % 5 == 0) ? (BYTE) rand() : ((rand() & 1) ? 0xFF : 0x00);
+}
+
+void test_gdi_RopKernels(void)
+{
+	int i, offset;
+	int count, period;
+	BYTE src[ROP_TEST_LENGTH * 4 + 16];
+	BYTE dst1[ROP_TEST_LENGTH * 4 + 32];
+	BYTE dst2[ROP_TEST_LENGTH * 4 + 32];
+	BYTE pattern[40];
+	UINT32 color32;
+	UINT16 color16;
+	const GDI_ROP_KERNELS* generic = gdi_rop_kernels_generic();
+	const GDI_ROP_KERNELS* kernels = gdi_rop_kernels_get();
+
+	srand(1);
+
+	/* every kernel against the generic one, for all lengths and misalignments */
+	for (offset = 0; offset < 4; offset++)
+	{
+		for (count = 0; count < ROP_TEST_LENGTH; count++)
+		{
+			test_rop_fill_random(src, sizeof(src));
+			test_rop_fill_random(dst1, sizeof(dst1));
+			color32 = (UINT32) rand() * 0x10001;
+			color16 = (UINT16) rand();
+
+			memcpy(dst2, dst1, sizeof(dst1));
+			generic->srccopy(&dst1[offset], &src[3 - offset], count * 4);
+			kernels->srccopy(&dst2[offset], &src[3 - offset], count * 4);
+			CU_ASSERT(memcmp(dst1, dst2, sizeof(dst1)) == 0);
+
+			memcpy(dst2, dst1, sizeof(dst1));
+			generic->srcinvert(&dst1[offset], &src[3 - offset], count * 4);
+			kernels->srcinvert(&dst2[offset], &src[3 - offset], count * 4);
+			CU_ASSERT(memcmp(dst1, dst2, sizeof(dst1)) == 0);
+
+			memcpy(dst2, dst1, sizeof(dst1));
+			generic->srcand(&dst1[offset], &src[3 - offset], count * 4);
+			kernels->srcand(&dst2[offset], &src[3 - offset], count * 4);
+			CU_ASSERT(memcmp(dst1, dst2, sizeof(dst1)) == 0);
+
+			memcpy(dst2, dst1, sizeof(dst1));
+			generic->fill_16(&dst1[offset], count, color16);
+			kernels->fill_16(&dst2[offset], count, color16);
+			CU_ASSERT(memcmp(dst1, dst2, sizeof(dst1)) == 0);
+
+			memcpy(dst2, dst1, sizeof(dst1));
+			generic->fill_32(&dst1[offset], count, color32);
+			kernels->fill_32(&dst2[offset], count, color32);
+			CU_ASSERT(memcmp(dst1, dst2, sizeof(dst1)) == 0);
+
+			test_rop_fill_mask(src, sizeof(src));
+
+			memcpy(dst2, dst1, sizeof(dst1));
+			generic->dspdxax_16(&dst1[offset], &src[offset], count, color16);
+			kernels->dspdxax_16(&dst2[offset], &src[offset], count, color16);
+			CU_ASSERT(memcmp(dst1, dst2, sizeof(dst1)) == 0);
+
+			memcpy(dst2, dst1, sizeof(dst1));
+			generic->dspdxax_32(&dst1[offset], &src[offset], count, color32);
+			kernels->dspdxax_32(&dst2[offset], &src[offset], count, color32);
+			CU_ASSERT(memcmp(dst1, dst2, sizeof(dst1)) == 0);
+		}
+	}
+
+	/* pattern rows of every brush width and depth, including 24bpp */
+	for (period = 1; period <= 40; period++)
+	{
+		for (count = 0; count < ROP_TEST_LENGTH; count += 7)
+		{
+			test_rop_fill_random(pattern, sizeof(pattern));
+			test_rop_fill_random(dst1, sizeof(dst1));
+			memcpy(dst2, dst1, sizeof(dst1));
+
+			generic->fill_pattern(&dst1[1], count * 3, pattern, period);
+			kernels->fill_pattern(&dst2[1], count * 3, pattern, period);
+			CU_ASSERT(memcmp(dst1, dst2, sizeof(dst1)) == 0);
+
+			for (i = 0; i < count * 3; i++)
+			{
+				if (dst1[1 + i] != pattern[i % period])
+					break;
+			}
+
+			CU_ASSERT(i == count * 3);
+		}
+	}
+
+	/* glyph masking against the formula used by the blitters */
+	for (i = 0; i < 64; i++)
+		src[i] = (BYTE) (i * 4);
+
+	test_rop_fill_random(dst1, sizeof(dst1));
+	memcpy(dst2, dst1, sizeof(dst1));
+	kernels->dspdxax_32(dst2, src, 64, 0x00336699);
+
+	for (i = 0; i < 64; i++)
+	{
+		UINT32 s32 = src[i] * 0x01010101;
+		UINT32 d32 = ((UINT32*) dst1)[i];
+		CU_ASSERT(((UINT32*) dst2)[i] == ((s32 & 0x00336699) | (~s32 & d32)));
+	}
+}
+
+#define ROP_BENCH_PIXELS		(1024 * 768)
+#define ROP_BENCH_ROUNDS		16
+
+enum
+{
+	ROP_BENCH_SRCCOPY,
+	ROP_BENCH_SRCINVERT,
+	ROP_BENCH_SRCAND,
+	ROP_BENCH_PATCOPY_SOLID,
+	ROP_BENCH_PATCOPY_8X8,
+	ROP_BENCH_DSPDXAX,
+	ROP_BENCH_COUNT
+};
+
+static const char* const rop_bench_names[ROP_BENCH_COUNT] =
+{
+	"SRCCOPY",
+	"SRCINVERT",
+	"SRCAND",
+	"PATCOPY",
+	"PATCOPY 8x8",
+	"DSPDxax"
+};
+
+static double test_rop_speed(const GDI_ROP_KERNELS* kernels, int rop, BYTE* dst, BYTE* src, BYTE* pattern)
+{
+	int i;
+	double elapsed;
+	STOPWATCH* stopwatch;
+
+	stopwatch = stopwatch_create();
+	stopwatch_start(stopwatch);
+
+	for (i = 0; i < ROP_BENCH_ROUNDS; i++)
+	{
+		switch (rop)
+		{
+			case ROP_BENCH_SRCCOPY:
+				kernels->srccopy(dst, src, ROP_BENCH_PIXELS * 4);
+				break;
+
+			case ROP_BENCH_SRCINVERT:
+				kernels->srcinvert(dst, src, ROP_BENCH_PIXELS * 4);
+				break;
+
+			case ROP_BENCH_SRCAND:
+				kernels->srcand(dst, src, ROP_BENCH_PIXELS * 4);
+				break;
+
+			case ROP_BENCH_PATCOPY_SOLID:
+				kernels->fill_32(dst, ROP_BENCH_PIXELS, 0xFF336699);
+				break;
+
+			case ROP_BENCH_PATCOPY_8X8:
+				kernels->fill_pattern(dst, ROP_BENCH_PIXELS * 4, pattern, 32);
+				break;
+
+			case ROP_BENCH_DSPDXAX:
+				kernels->dspdxax_32(dst, src, ROP_BENCH_PIXELS, 0xFF336699);
+				break;
+		}
+	}
+
+	stopwatch_stop(stopwatch);
+	elapsed = stopwatch_get_elapsed_time_in_seconds(stopwatch);
+	stopwatch_free(stopwatch);
+
+	if (elapsed <= 0.0)
+		return 0.0;
+
+	return ((double) ROP_BENCH_PIXELS * ROP_BENCH_ROUNDS) / (elapsed * 1000000.0);
+}
+
+/**
+ * Prints the 32bpp throughput of every hot raster operation in megapixels
+ * per second, for the generic kernels and for the ones selected at runtime.
+ */
+void test_gdi_RopBenchmark(void)
+{
+	int rop;
+	BYTE* src;
+	BYTE* dst;
+	BYTE pattern[32];
+	const GDI_ROP_KERNELS* generic = gdi_rop_kernels_generic();
+	const GDI_ROP_KERNELS* kernels = gdi_rop_kernels_get();
+
+	src = (BYTE*) malloc(ROP_BENCH_PIXELS * 4);
+	dst = (BYTE*) malloc(ROP_BENCH_PIXELS * 4);
+
+	test_rop_fill_mask(src, ROP_BENCH_PIXELS * 4);
+	test_rop_fill_random(dst, ROP_BENCH_PIXELS * 4);
+	test_rop_fill_random(pattern, sizeof(pattern));
+
+	printf("\n%-12s %12s %12s (MPixel/s)\n", "rop", generic->name, kernels->name);
+
+	for (rop = 0; rop < ROP_BENCH_COUNT; rop++)
+	{
+		printf("%-12s %12.1f %12.1f\n", rop_bench_names[rop],
+			test_rop_speed(generic, rop, dst, src, pattern),
+			test_rop_speed(kernels, rop, dst, src, pattern));
+	}
+
+	free(src);
+	free(dst);
+}
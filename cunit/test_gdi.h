@@ -45,3 +45,7 @@ void test_gdi_BitBlt_16bpp(void);
 void test_gdi_BitBlt_8bpp(void);
 void test_gdi_ClipCoords(void);
 void test_gdi_InvalidateRegion(void);
+void test_gdi_RegionCombine(void);
+void test_gdi_InvalidateComplexRegion(void);
+void test_gdi_RopKernels(void);
+void test_gdi_RopBenchmark(void);
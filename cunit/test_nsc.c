@@ -31,6 +31,7 @@
 #include <freerdp/utils/hexdump.h>
 #include <freerdp/codec/nsc.h>
 
+#include "nsc_types.h"
 #include "test_nsc.h"
 
 static const BYTE nsc_data[] =
@@ -325,6 +326,8 @@ int add_nsc_suite(void)
 
 	add_test_function(nsc_decode);
 	add_test_function(nsc_encode);
+	add_test_function(nsc_rle_decode);
+	add_test_function(nsc_decode_simd);
 
 	return 0;
 }
@@ -375,3 +378,204 @@ void test_nsc_encode(void)
 
 	nsc_context_free(context);
 }
+
+/* byte-by-byte reference of the plane RLE decoder */
+static void nsc_rle_decode_reference(BYTE* in, BYTE* out, UINT32 origsz)
+{
+	UINT32 len;
+	UINT32 left;
+	BYTE value;
+
+	left = origsz;
+	while (left > 4)
+	{
+		value = *in++;
+
+		if (left == 5)
+		{
+			*out++ = value;
+			left--;
+		}
+		else if (value == *in)
+		{
+			in++;
+			if (*in < 0xFF)
+			{
+				len = (UINT32) *in++;
+				len += 2;
+			}
+			else
+			{
+				in++;
+				len = *((UINT32*) in);
+				in += 4;
+			}
+			memset(out, value, len);
+			out += len;
+			left -= len;
+		}
+		else
+		{
+			*out++ = value;
+			left--;
+		}
+	}
+
+	memcpy(out, in, 4);
+}
+
+/* pseudo-random BGRA image with runs of random length, so planes get RLE encoded */
+static BYTE* nsc_test_image_new(int width, int height)
+{
+	int i;
+	int run;
+	UINT32 seed;
+	UINT32 pixel;
+	UINT32* data;
+
+	data = (UINT32*) malloc(width * height * 4);
+
+	seed = 0x12345678;
+	pixel = 0;
+	run = 0;
+
+	for (i = 0; i < width * height; i++)
+	{
+		if (run == 0)
+		{
+			seed = seed * 1103515245 + 12345;
+			pixel = (seed >> 8) | 0xFF000000;
+			run = (seed & 0x80) ? 1 : (seed & 0x3F) + 1;
+		}
+
+		data[i] = pixel;
+		run--;
+	}
+
+	return (BYTE*) data;
+}
+
+static void nsc_test_compose(STREAM* s, BYTE* image, int width, int height,
+	BYTE colorloss, BYTE subsampling)
+{
+	NSC_CONTEXT* context;
+
+	context = nsc_context_new();
+	nsc_context_set_pixel_format(context, RDP_PIXEL_FORMAT_B8G8R8A8);
+	context->nsc_stream.ColorLossLevel = colorloss;
+	context->nsc_stream.ChromaSubSamplingLevel = subsampling;
+
+	stream_set_pos(s, 0);
+	nsc_compose_message(context, s, image, width, height, width * 4);
+
+	nsc_context_free(context);
+}
+
+void test_nsc_rle_decode(void)
+{
+	int i;
+	BYTE* rle;
+	BYTE* image;
+	BYTE* plane;
+	UINT32 planesize;
+	STREAM* s;
+	NSC_CONTEXT* context;
+
+	image = nsc_test_image_new(61, 37);
+	s = stream_new(65536);
+	nsc_test_compose(s, image, 61, 37, 3, 1);
+
+	context = nsc_context_new();
+	nsc_process_message(context, 32, 61, 37, stream_get_head(s), stream_get_length(s));
+
+	rle = context->nsc_stream.Planes;
+	plane = (BYTE*) malloc(context->priv->plane_buf_length + 4);
+
+	for (i = 0; i < 4; i++)
+	{
+		planesize = context->nsc_stream.PlaneByteCount[i];
+
+		if (planesize > 0 && planesize < context->OrgByteCount[i])
+		{
+			nsc_rle_decode_reference(rle, plane, context->OrgByteCount[i]);
+			CU_ASSERT(memcmp(plane, context->priv->plane_buf[i], context->OrgByteCount[i]) == 0);
+		}
+
+		rle += planesize;
+	}
+
+	free(plane);
+	nsc_context_free(context);
+	stream_free(s);
+	free(image);
+}
+
+static void nsc_test_compare_decoders(BYTE* data, UINT32 length, int width, int height)
+{
+	NSC_CONTEXT* scalar;
+	NSC_CONTEXT* simd;
+
+	scalar = nsc_context_new();
+	simd = nsc_context_new();
+	nsc_context_set_cpu_opt(simd, CPU_SSE2);
+
+	nsc_process_message(scalar, 32, width, height, data, length);
+	nsc_process_message(simd, 32, width, height, data, length);
+
+	CU_ASSERT(memcmp(scalar->bmpdata, simd->bmpdata, width * height * 4) == 0);
+
+	nsc_context_free(scalar);
+	nsc_context_free(simd);
+}
+
+void test_nsc_decode_simd(void)
+{
+	int i;
+	int size;
+	BYTE* image;
+	BYTE colorloss;
+	BYTE subsampling;
+	STREAM* s;
+	const int sizes[][2] = { { 64, 64 }, { 61, 37 }, { 7, 3 }, { 1, 1 } };
+
+	nsc_test_compare_decoders((BYTE*) nsc_data, sizeof(nsc_data), 15, 10);
+	nsc_test_compare_decoders((BYTE*) nsc_stress_data, sizeof(nsc_stress_data), 54, 44);
+
+	s = stream_new(65536);
+
+	for (size = 0; size < sizeof(sizes) / sizeof(sizes[0]); size++)
+	{
+		image = nsc_test_image_new(sizes[size][0], sizes[size][1]);
+
+		for (subsampling = 0; subsampling <= 1; subsampling++)
+		{
+			for (colorloss = 1; colorloss <= 7; colorloss++)
+			{
+				nsc_test_compose(s, image, sizes[size][0], sizes[size][1], colorloss, subsampling);
+				nsc_test_compare_decoders(stream_get_head(s), stream_get_length(s),
+					sizes[size][0], sizes[size][1]);
+			}
+		}
+
+		free(image);
+	}
+
+	/* the chroma planes carry arbitrary bytes, make sure saturation matches too */
+	for (i = 0; i < 256; i++)
+	{
+		BYTE planes[20 + 4 * 64];
+
+		memset(planes, 0, 20);
+		planes[0] = planes[4] = planes[8] = planes[12] = 64;
+		planes[16] = 1 + (i % 7);
+		planes[17] = 0;
+		memset(planes + 20, i, 64);
+		memset(planes + 20 + 64, (i * 7) & 0xFF, 64);
+		memset(planes + 20 + 128, 255 - i, 64);
+		memset(planes + 20 + 192, i ^ 0x5A, 64);
+
+		nsc_test_compare_decoders(planes, sizeof(planes), 8, 8);
+	}
+
+	stream_free(s);
+}
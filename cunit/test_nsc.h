@@ -25,3 +25,5 @@ int add_nsc_suite(void);
 
 void test_nsc_decode(void);
 void test_nsc_encode(void);
+void test_nsc_rle_decode(void);
+void test_nsc_decode_simd(void);
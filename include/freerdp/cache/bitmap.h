@@ -25,6 +25,8 @@
 #include <freerdp/update.h>
 #include <freerdp/freerdp.h>
 #include <freerdp/utils/stream.h>
+#include <freerdp/utils/persistent.h>
+#include <freerdp/utils/worker.h>
 
 typedef struct _BITMAP_V2_CELL BITMAP_V2_CELL;
 typedef struct rdp_bitmap_cache rdpBitmapCache;
@@ -35,6 +37,7 @@ struct _BITMAP_V2_CELL
 {
 	UINT32 number;
 	rdpBitmap** entries;
+	PERSISTENT_CACHE_ENTRY** persistent;
 };
 
 struct rdp_bitmap_cache
@@ -53,10 +56,14 @@ struct rdp_bitmap_cache
 
 	/* internal */
 
-	rdpBitmap* bitmap;
+	UINT32 maxBitmaps;
+	rdpBitmap** bitmaps;
+	WORKER_POOL* workers;
+
 	rdpUpdate* update;
 	rdpContext* context;
 	rdpSettings* settings;
+	rdpPersistentCache* persistent;
 };
 
 FREERDP_API rdpBitmap* bitmap_cache_get(rdpBitmapCache* bitmap_cache, UINT32 id, UINT32 index);
@@ -20,6 +20,8 @@
 #ifndef __TSMF_PLUGIN
 #define __TSMF_PLUGIN
 
+#include <freerdp/utils/buffer.h>
+
 /**
  * Event Types
  */
@@ -43,6 +45,9 @@ struct _RDP_VIDEO_FRAME_EVENT
 	INT16 height;
 	UINT16 num_visible_rects;
 	RDP_RECT* visible_rects;
+
+	/* When set, frame_data belongs to this buffer. Keep a reference to use the frame after the event is freed. */
+	SHARED_BUFFER* frame_buffer;
 };
 typedef struct _RDP_VIDEO_FRAME_EVENT RDP_VIDEO_FRAME_EVENT;
 
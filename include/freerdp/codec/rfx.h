@@ -73,6 +73,29 @@ struct _RFX_MESSAGE
 };
 typedef struct _RFX_MESSAGE RFX_MESSAGE;
 
+/**
+ * Destination for rfx_process_message_surface(). Tiles are decoded straight
+ * into this buffer, clipped to the message region, to the surface bounds
+ * and to the optional clip rects. left and top give the position of the
+ * message origin on the surface and may be negative.
+ */
+struct _RFX_SURFACE
+{
+	BYTE* data;
+	int stride;
+	int width;
+	int height;
+	RDP_PIXEL_FORMAT pixel_format; /* one of the 24 or 32 bpp RGB formats */
+
+	int left;
+	int top;
+
+	/* surface coordinates, ignored when num_clip_rects is 0 */
+	int num_clip_rects;
+	RFX_RECT* clip_rects;
+};
+typedef struct _RFX_SURFACE RFX_SURFACE;
+
 typedef struct _RFX_CONTEXT_PRIV RFX_CONTEXT_PRIV;
 
 struct _RFX_CONTEXT
@@ -120,6 +143,7 @@ FREERDP_API void rfx_context_set_pixel_format(RFX_CONTEXT* context, RDP_PIXEL_FO
 FREERDP_API void rfx_context_reset(RFX_CONTEXT* context);
 
 FREERDP_API RFX_MESSAGE* rfx_process_message(RFX_CONTEXT* context, BYTE* data, UINT32 length);
+FREERDP_API RFX_MESSAGE* rfx_process_message_surface(RFX_CONTEXT* context, BYTE* data, UINT32 length, RFX_SURFACE* surface);
 FREERDP_API UINT16 rfx_message_get_tile_count(RFX_MESSAGE* message);
 FREERDP_API RFX_TILE* rfx_message_get_tile(RFX_MESSAGE* message, int index);
 FREERDP_API UINT16 rfx_message_get_rect_count(RFX_MESSAGE* message);
@@ -45,6 +45,8 @@ struct rdp_tls
 
 FREERDP_API BOOL tls_connect(rdpTls* tls);
 FREERDP_API BOOL tls_accept(rdpTls* tls, const char* cert_file, const char* privatekey_file);
+FREERDP_API BOOL tls_accept_begin(rdpTls* tls, const char* cert_file, const char* privatekey_file);
+FREERDP_API int tls_accept_continue(rdpTls* tls);
 FREERDP_API BOOL tls_disconnect(rdpTls* tls);
 
 FREERDP_API int tls_read(rdpTls* tls, BYTE* data, int length);
@@ -36,6 +36,7 @@ typedef struct rdp_freerdp_peer freerdp_peer;
 #include <freerdp/settings.h>
 #include <freerdp/extension.h>
 #include <freerdp/utils/stream.h>
+#include <freerdp/utils/buffer.h>
 
 #include <freerdp/input.h>
 #include <freerdp/update.h>
@@ -55,8 +56,62 @@ typedef BOOL (*pVerifyCertificate)(freerdp* instance, char* subject, char* issue
 typedef BOOL (*pVerifyChangedCertificate)(freerdp* instance, char* subject, char* issuer, char* new_fingerprint, char* old_fingerprint);
 
 typedef int (*pSendChannelData)(freerdp* instance, int channelId, BYTE* data, int size);
+typedef int (*pSendChannelBuffer)(freerdp* instance, int channelId, SHARED_BUFFER* buffer, BYTE* data, int size);
 typedef int (*pReceiveChannelData)(freerdp* instance, int channelId, BYTE* data, int size, int flags, int total_size);
 
+/**
+ * Send side state of a static virtual channel: the data queued behind the
+ * channel scheduler and what has gone out so far. BytesPerSecond covers
+ * the last complete one second window.
+ */
+struct rdp_channel_stats
+{
+	UINT32 QueuedMessages;
+	UINT32 QueuedBytes;
+	UINT64 MessagesSent;
+	UINT64 BytesSent;
+	UINT32 BytesPerSecond;
+};
+typedef struct rdp_channel_stats RDP_CHANNEL_STATS;
+
+/**
+ * Counters of a connection since it was created, in both directions.
+ * Bytes are counted above TLS and include the security handshake, and
+ * PDUs are fast-path or TPKT packets. An update fragmented over several
+ * fast-path PDUs counts once. A frame is a surface frame end marker, or a
+ * surface bits command or bitmap update outside of a frame marker pair, as
+ * servers send the markers only to clients acknowledging frames.
+ *
+ * The bytes sent through the bulk compressor are counted before and after
+ * it, including those it had to send flat, so their ratio is the one it
+ * achieves. The bytes received are counted for the packets that arrived
+ * compressed only.
+ * UpdateEncodeTime is the time spent serializing, compressing and
+ * encrypting fast-path updates, in microseconds, but not the codecs run
+ * before or the socket writes after.
+ */
+struct rdp_session_stats
+{
+	UINT64 BytesSent;
+	UINT64 BytesReceived;
+	UINT64 PdusSent;
+	UINT64 PdusReceived;
+	UINT64 FastPathPdusSent;
+	UINT64 FastPathPdusReceived;
+	UINT64 UpdatesSent;
+	UINT64 UpdatesReceived;
+	UINT64 FramesSent;
+	UINT64 FramesReceived;
+	UINT64 UncompressedBytesSent;
+	UINT64 CompressedBytesSent;
+	UINT64 CompressedBytesReceived;
+	UINT64 DecompressedBytesReceived;
+	UINT64 UpdateEncodeTime;
+};
+typedef struct rdp_session_stats RDP_SESSION_STATS;
+
+typedef void (*pSessionStats)(freerdp* instance, RDP_SESSION_STATS* stats);
+
 /**
  * Defines the context for a given instance of RDP connection.
  * It is embedded in the rdp_freerdp structure, and allocated by a call to freerdp_context_new().
@@ -178,7 +233,15 @@ struct rdp_freerdp
 											   Callback for receiving data from a channel.
 											   This is called by freerdp_channel_process() (if not NULL).
 											   Clients will typically use a function that calls freerdp_channels_data() to perform the needed tasks. */
-	UINT32 paddingE[80 - 66]; /* 66 */
+	pSendChannelBuffer SendChannelBuffer; /* (offset 66)
+											 Callback for sending data that lies within a shared buffer to a channel.
+											 The buffer is referenced until the data is sent instead of being copied.
+											 By default, it is set by freerdp_new() to freerdp_send_channel_buffer(), which eventually calls
+											 freerdp_channel_send_buffer() */
+	pSessionStats SessionStats; /* (offset 67)
+								   Callback for the counters of the session, called about once a second from
+								   freerdp_check_fds() while the connection is up (if not NULL). */
+	UINT32 paddingE[80 - 68]; /* 68 */
 };
 
 FREERDP_API void freerdp_context_new(freerdp* instance);
@@ -191,8 +254,14 @@ FREERDP_API BOOL freerdp_disconnect(freerdp* instance);
 FREERDP_API BOOL freerdp_get_fds(freerdp* instance, void** rfds, int* rcount, void** wfds, int* wcount);
 FREERDP_API BOOL freerdp_check_fds(freerdp* instance);
 
+FREERDP_API BOOL freerdp_replay_open(freerdp* instance, char* filename);
+FREERDP_API int freerdp_replay_check(freerdp* instance);
+
 FREERDP_API UINT32 freerdp_error_info(freerdp* instance);
 
+FREERDP_API BOOL freerdp_get_channel_stats(freerdp* instance, int channelId, RDP_CHANNEL_STATS* stats);
+FREERDP_API BOOL freerdp_get_session_stats(freerdp* instance, RDP_SESSION_STATS* stats);
+
 FREERDP_API void freerdp_get_version(int* major, int* minor, int* revision);
 
 FREERDP_API freerdp* freerdp_new();
@@ -148,6 +148,26 @@ struct _GDI_RGN
 typedef struct _GDI_RGN GDI_RGN;
 typedef GDI_RGN* HGDI_RGN;
 
+/* Region combine modes */
+#define GDI_RGN_AND			0x01
+#define GDI_RGN_OR			0x02
+#define GDI_RGN_DIFF			0x03
+
+/**
+ * Complex region made of non-overlapping rectangles sorted in y-x bands:
+ * rectangles of the same band share their top and height, bands are
+ * sorted top to bottom and rectangles within a band left to right.
+ */
+struct _GDI_REGION
+{
+	int numRects;
+	int maxRects;
+	GDI_RGN extents;
+	GDI_RGN* rects;
+};
+typedef struct _GDI_REGION GDI_REGION;
+typedef GDI_REGION* HGDI_REGION;
+
 struct _GDI_BITMAP
 {
 	BYTE objectType;
@@ -213,6 +233,7 @@ struct _GDI_WND
 	int ninvalid;
 	HGDI_RGN invalid;
 	HGDI_RGN cinvalid;
+	HGDI_REGION invalidRgn;
 };
 typedef struct _GDI_WND GDI_WND;
 typedef GDI_WND* HGDI_WND;
@@ -40,6 +40,14 @@ FREERDP_API int gdi_SetRectRgn(HGDI_RGN hRgn, int nLeftRect, int nTopRect, int n
 FREERDP_API int gdi_EqualRgn(HGDI_RGN hSrcRgn1, HGDI_RGN hSrcRgn2);
 FREERDP_API int gdi_CopyRect(HGDI_RECT dst, HGDI_RECT src);
 FREERDP_API int gdi_PtInRect(HGDI_RECT rc, int x, int y);
+FREERDP_API HGDI_REGION gdi_RegionNew(void);
+FREERDP_API void gdi_RegionFree(HGDI_REGION region);
+FREERDP_API void gdi_RegionClear(HGDI_REGION region);
+FREERDP_API int gdi_RegionIsEmpty(HGDI_REGION region);
+FREERDP_API GDI_RGN* gdi_RegionGetRects(HGDI_REGION region, int* count);
+FREERDP_API int gdi_RegionCombine(HGDI_REGION dst, HGDI_REGION src1, HGDI_REGION src2, int mode);
+FREERDP_API int gdi_RegionCombineRect(HGDI_REGION region, int x, int y, int w, int h, int mode);
+FREERDP_API int gdi_RegionSimplify(HGDI_REGION region, int maxRects);
 FREERDP_API int gdi_InvalidateRegion(HGDI_DC hdc, int x, int y, int w, int h);
 
 #endif /* __GDI_REGION_H */
@@ -31,8 +31,26 @@ typedef struct rdp_freerdp_listener freerdp_listener;
 extern "C" {
 #endif
 
+/**
+ * Open binds the listening sockets of a single server process.
+ *
+ * OpenReusePort binds with SO_REUSEPORT, so that several worker processes
+ * can each open the same address and port and the kernel spreads incoming
+ * connections across them. Every process sees only its own share of the
+ * connections. It fails where the platform has no SO_REUSEPORT.
+ *
+ * OpenHandoff listens on a Unix domain socket for peer sockets passed by
+ * HandoffPeer in another process, for example from a single acceptor to a
+ * pool of workers. Received peers are reported through PeerAccepted like
+ * any other. HandoffPeer sends the socket of client to the listener at path,
+ * then closes it and frees client on success. Not available on Windows.
+ */
+
 typedef BOOL (*psListenerOpen)(freerdp_listener* instance, const char* bind_address, UINT16 port);
+typedef BOOL (*psListenerOpenReusePort)(freerdp_listener* instance, const char* bind_address, UINT16 port);
 typedef BOOL (*psListenerOpenLocal)(freerdp_listener* instance, const char* path);
+typedef BOOL (*psListenerOpenHandoff)(freerdp_listener* instance, const char* path);
+typedef BOOL (*psListenerHandoffPeer)(freerdp_listener* instance, const char* path, freerdp_peer* client);
 typedef BOOL (*psListenerGetFileDescriptor)(freerdp_listener* instance, void** rfds, int* rcount);
 typedef BOOL (*psListenerCheckFileDescriptor)(freerdp_listener* instance);
 typedef void (*psListenerClose)(freerdp_listener* instance);
@@ -54,6 +72,10 @@ struct rdp_freerdp_listener
 	psListenerClose Close;
 
 	psPeerAccepted PeerAccepted;
+
+	psListenerOpenReusePort OpenReusePort;
+	psListenerOpenHandoff OpenHandoff;
+	psListenerHandoffPeer HandoffPeer;
 };
 
 FREERDP_API freerdp_listener* freerdp_listener_new(void);
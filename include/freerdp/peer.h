@@ -25,6 +25,7 @@
 #include <freerdp/settings.h>
 #include <freerdp/input.h>
 #include <freerdp/update.h>
+#include <freerdp/utils/persistent.h>
 
 #include <winpr/sspi.h>
 
@@ -42,8 +43,11 @@ typedef BOOL (*psPeerActivate)(freerdp_peer* client);
 typedef BOOL (*psPeerLogon)(freerdp_peer* client, SEC_WINNT_AUTH_IDENTITY* identity, BOOL automatic);
 
 typedef int (*psPeerSendChannelData)(freerdp_peer* client, int channelId, BYTE* data, int size);
+typedef int (*psPeerSendChannelBuffer)(freerdp_peer* client, int channelId, SHARED_BUFFER* buffer, BYTE* data, int size);
 typedef int (*psPeerReceiveChannelData)(freerdp_peer* client, int channelId, BYTE* data, int size, int flags, int total_size);
 
+typedef void (*psPeerSessionStats)(freerdp_peer* client, RDP_SESSION_STATS* stats);
+
 struct rdp_freerdp_peer
 {
 	rdpContext* context;
@@ -70,8 +74,11 @@ struct rdp_freerdp_peer
 	psPeerLogon Logon;
 
 	psPeerSendChannelData SendChannelData;
+	psPeerSendChannelBuffer SendChannelBuffer;
 	psPeerReceiveChannelData ReceiveChannelData;
 
+	psPeerSessionStats SessionStats;
+
 	int pId;
 	UINT32 ack_frame_id;
 	BOOL local;
@@ -87,5 +94,9 @@ FREERDP_API void freerdp_peer_context_free(freerdp_peer* client);
 FREERDP_API freerdp_peer* freerdp_peer_new(int sockfd);
 FREERDP_API void freerdp_peer_free(freerdp_peer* client);
 
+FREERDP_API BOOL freerdp_peer_get_channel_stats(freerdp_peer* client, int channelId, RDP_CHANNEL_STATS* stats);
+FREERDP_API BOOL freerdp_peer_get_session_stats(freerdp_peer* client, RDP_SESSION_STATS* stats);
+FREERDP_API rdpPersistentCache* freerdp_peer_get_persistent_keys(freerdp_peer* client);
+
 #endif /* __FREERDP_PEER_H */
 
@@ -0,0 +1,90 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * RDP Server Runtime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __FREERDP_RUNTIME_H
+#define __FREERDP_RUNTIME_H
+
+typedef struct rdp_freerdp_runtime freerdp_runtime;
+typedef struct rdp_freerdp_runtime_stats RUNTIME_WORKER_STATS;
+
+#include <freerdp/api.h>
+#include <freerdp/types.h>
+#include <freerdp/peer.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * The runtime multiplexes many peers over a fixed pool of worker threads.
+ * A peer handed to AddPeer is bound to one worker for its whole lifetime,
+ * so all of its callbacks run on the same thread and never concurrently.
+ * Callbacks must not block: a blocked callback stalls every other session
+ * served by the same worker.
+ */
+
+typedef BOOL (*psRuntimeStart)(freerdp_runtime* instance);
+typedef void (*psRuntimeStop)(freerdp_runtime* instance);
+typedef BOOL (*psRuntimeAddPeer)(freerdp_runtime* instance, freerdp_peer* client);
+typedef BOOL (*psRuntimeGetWorkerStats)(freerdp_runtime* instance, int index, RUNTIME_WORKER_STATS* stats);
+
+typedef BOOL (*psRuntimePeerGetFileDescriptor)(freerdp_runtime* instance, freerdp_peer* client, void** rfds, int* rcount);
+typedef BOOL (*psRuntimePeerCheckFileDescriptor)(freerdp_runtime* instance, freerdp_peer* client);
+typedef void (*psRuntimePeerClosed)(freerdp_runtime* instance, freerdp_peer* client);
+
+struct rdp_freerdp_runtime_stats
+{
+	int sessions;
+	UINT64 dispatches;
+	UINT64 cpu_time_us;
+};
+
+struct rdp_freerdp_runtime
+{
+	void* runtime;
+	void* param1;
+	void* param2;
+	void* param3;
+	void* param4;
+
+	int num_workers;
+
+	psRuntimeStart Start;
+	psRuntimeStop Stop;
+	psRuntimeAddPeer AddPeer;
+	psRuntimeGetWorkerStats GetWorkerStats;
+
+	/* defaults to client->GetFileDescriptor, override to add channel fds */
+	psRuntimePeerGetFileDescriptor PeerGetFileDescriptor;
+	/* defaults to client->CheckFileDescriptor, FALSE closes the session */
+	psRuntimePeerCheckFileDescriptor PeerCheckFileDescriptor;
+	/* defaults to disconnecting and freeing the peer and its context */
+	psRuntimePeerClosed PeerClosed;
+};
+
+/**
+ * Creates a runtime with num_workers threads, or one per online CPU if
+ * num_workers is 0. Returns NULL where the platform has no epoll.
+ */
+FREERDP_API freerdp_runtime* freerdp_runtime_new(int num_workers);
+FREERDP_API void freerdp_runtime_free(freerdp_runtime* instance);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -89,6 +89,13 @@ struct _rdpsnd_server_context
 	 * synchronization.
 	 */
 	psRdpsndServerActivated Activated;
+
+	/**
+	 * Resample, encode and send the audio from a worker thread of the
+	 * context, SendSamples then only queues it. Set by server before
+	 * Initialize.
+	 */
+	BOOL use_encode_thread;
 };
 
 FREERDP_API rdpsnd_server_context* rdpsnd_server_context_new(WTSVirtualChannelManager* vcm);
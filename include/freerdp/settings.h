@@ -701,7 +701,9 @@ struct rdp_settings
 	ALIGN64 BOOL PlayRemoteFx; /* 1857 */
 	ALIGN64 char* DumpRemoteFxFile; /* 1858 */
 	ALIGN64 char* PlayRemoteFxFile; /* 1859 */
-	UINT64 padding1920[1920 - 1860]; /* 1860 */
+	ALIGN64 BOOL DumpSession; /* 1860 */
+	ALIGN64 char* DumpSessionFile; /* 1861 */
+	UINT64 padding1920[1920 - 1862]; /* 1862 */
 	UINT64 padding1984[1984 - 1920]; /* 1920 */
 
 	/**
@@ -781,7 +783,8 @@ struct rdp_settings
 	ALIGN64 BOOL BitmapCachePersistEnabled; /* 2500 */
 	ALIGN64 UINT32 BitmapCacheV2NumCells; /* 2501 */
 	ALIGN64 BITMAP_CACHE_V2_CELL_INFO* BitmapCacheV2CellInfo; /* 2502 */
-	UINT64 padding2560[2560 - 2503]; /* 2503 */
+	ALIGN64 char* BitmapCachePersistFile; /* 2503 */
+	UINT64 padding2560[2560 - 2504]; /* 2504 */
 
 	/* Pointer Capabilities */
 	ALIGN64 BOOL ColorPointerFlag; /* 2560 */
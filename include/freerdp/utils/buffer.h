@@ -0,0 +1,86 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Reference Counted Buffers
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __UTILS_BUFFER_H
+#define __UTILS_BUFFER_H
+
+#include <freerdp/api.h>
+#include <freerdp/types.h>
+#include <freerdp/utils/stream.h>
+
+typedef struct _SHARED_BUFFER SHARED_BUFFER;
+
+typedef void (*pSharedBufferFree)(SHARED_BUFFER* buffer);
+
+/**
+ * A buffer shared by reference instead of being copied. Whoever keeps a
+ * slice of data past the call that handed it over takes a reference, and
+ * the buffer is released with its last reference.
+ *
+ * Free, when set, is called on the last reference instead of freeing data,
+ * which lets a buffer lent by someone else be handed back to its owner.
+ */
+struct _SHARED_BUFFER
+{
+	LONG refcount;
+	BYTE* data;
+	int size;
+
+	void* context;
+	pSharedBufferFree Free;
+};
+
+FREERDP_API SHARED_BUFFER* shared_buffer_new(int size);
+FREERDP_API SHARED_BUFFER* shared_buffer_attach(BYTE* data, int size, pSharedBufferFree Free, void* context);
+FREERDP_API SHARED_BUFFER* shared_buffer_detach_stream(STREAM* s);
+
+FREERDP_API SHARED_BUFFER* shared_buffer_ref(SHARED_BUFFER* buffer);
+FREERDP_API void shared_buffer_unref(SHARED_BUFFER* buffer);
+
+typedef struct _SHARED_BUFFER_POOL SHARED_BUFFER_POOL;
+
+/**
+ * A pool of equally sized buffers for data produced at a steady rate, such
+ * as decoded video frames. A buffer taken from the pool goes back to it
+ * with its last reference, and is handed out again instead of allocating a
+ * new one. Only buffers of the current size are kept, up to max_free of
+ * them; asking for another size drops the kept ones.
+ *
+ * Every buffer taken out holds a reference on the pool, so buffers still
+ * in use may outlive shared_buffer_pool_free().
+ */
+struct _SHARED_BUFFER_POOL
+{
+	LONG refcount;
+	HANDLE mutex;
+	BOOL closed;
+
+	int size;
+	int max_free;
+	int free_count;
+	BYTE** free_list;
+
+	UINT32 hits;
+	UINT32 misses;
+};
+
+FREERDP_API SHARED_BUFFER_POOL* shared_buffer_pool_new(int max_free);
+FREERDP_API void shared_buffer_pool_free(SHARED_BUFFER_POOL* pool);
+
+FREERDP_API SHARED_BUFFER* shared_buffer_pool_get(SHARED_BUFFER_POOL* pool, int size);
+
+#endif /* __UTILS_BUFFER_H */
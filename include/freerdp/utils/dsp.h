@@ -39,6 +39,16 @@ union _ADPCM
 };
 typedef union _ADPCM ADPCM;
 
+/**
+ * Resampling modes for 16-bit samples, other sample sizes are resampled
+ * by picking the nearest sample. The polyphase mode low-pass filters the
+ * signal below both Nyquist frequencies and is the default.
+ */
+#define FREERDP_DSP_RESAMPLE_LINEAR		0
+#define FREERDP_DSP_RESAMPLE_POLYPHASE		1
+
+typedef struct _FREERDP_DSP_RESAMPLER FREERDP_DSP_RESAMPLER;
+
 typedef struct _FREERDP_DSP_CONTEXT FREERDP_DSP_CONTEXT;
 struct _FREERDP_DSP_CONTEXT
 {
@@ -67,10 +77,15 @@ struct _FREERDP_DSP_CONTEXT
 		const BYTE* src, int size, int channels, int block_size);
 	void (*encode_ms_adpcm)(FREERDP_DSP_CONTEXT* context,
 		const BYTE* src, int size, int channels, int block_size);
+
+	int resample_mode;
+	FREERDP_DSP_RESAMPLER* resampler;
 };
 
 FREERDP_API FREERDP_DSP_CONTEXT* freerdp_dsp_context_new(void);
 FREERDP_API void freerdp_dsp_context_free(FREERDP_DSP_CONTEXT* context);
+FREERDP_API void freerdp_dsp_context_set_resample_mode(FREERDP_DSP_CONTEXT* context, int mode);
+FREERDP_API void freerdp_dsp_context_reset_resampler(FREERDP_DSP_CONTEXT* context);
 #define freerdp_dsp_context_reset_adpcm(_c) memset(&_c->adpcm, 0, sizeof(ADPCM))
 
 #endif /* __DSP_UTILS_H */
@@ -0,0 +1,106 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Persistent Bitmap Cache Store
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __UTILS_PERSISTENT_H
+#define __UTILS_PERSISTENT_H
+
+#include <stdio.h>
+
+#include <freerdp/api.h>
+#include <freerdp/types.h>
+
+#define PERSISTENT_CACHE_MAX_CELLS	5
+#define PERSISTENT_CACHE_NO_INDEX	0xFFFFFFFF
+
+/* entry flags */
+#define PERSISTENT_CACHE_COMPRESSED	0x01
+
+typedef struct _PERSISTENT_CACHE_ENTRY PERSISTENT_CACHE_ENTRY;
+typedef struct rdp_persistent_cache rdpPersistentCache;
+
+/**
+ * A bitmap kept across sessions, under the 64-bit key the server gave it
+ * (key1 in the low, key2 in the high 32 bits). The data is the bitmap as
+ * it came in the cache order, compressed or not, and stays in the file
+ * until it is asked for.
+ *
+ * index is the place given to the bitmap in its cell for this session by
+ * persistent_cache_get_keys(), or the one the client announced it at on
+ * the server side.
+ */
+struct _PERSISTENT_CACHE_ENTRY
+{
+	UINT64 key;
+	UINT32 id;
+	UINT32 index;
+	UINT32 stamp;
+
+	UINT16 width;
+	UINT16 height;
+	UINT16 bpp;
+	UINT16 flags;
+
+	UINT32 length;
+	long offset;
+	BYTE* data;
+
+	PERSISTENT_CACHE_ENTRY* next;
+};
+
+/**
+ * Bitmaps by key, for the persistent bitmap cache: a client loads them
+ * from its cache file, announces their keys in the persistent key list
+ * PDUs and saves them back at the end of the session, the most recently
+ * used first. A server keeps the keys the client announced, without
+ * data, and needs not send the bitmaps again.
+ */
+struct rdp_persistent_cache
+{
+	FILE* fp;
+	UINT32 stamp;
+
+	int count;
+	int size;
+	PERSISTENT_CACHE_ENTRY** entries;
+
+	int buckets;
+	PERSISTENT_CACHE_ENTRY** table;
+
+	UINT32 cells[PERSISTENT_CACHE_MAX_CELLS];
+	UINT32 max_entries[PERSISTENT_CACHE_MAX_CELLS];
+};
+
+FREERDP_API rdpPersistentCache* persistent_cache_new(void);
+FREERDP_API void persistent_cache_free(rdpPersistentCache* cache);
+
+FREERDP_API BOOL persistent_cache_load(rdpPersistentCache* cache, const char* filename);
+FREERDP_API BOOL persistent_cache_save(rdpPersistentCache* cache, const char* filename);
+FREERDP_API void persistent_cache_clear(rdpPersistentCache* cache);
+
+FREERDP_API void persistent_cache_set_max_entries(rdpPersistentCache* cache, UINT32 id, UINT32 max_entries);
+FREERDP_API UINT32 persistent_cache_get_count(rdpPersistentCache* cache, UINT32 id);
+
+FREERDP_API PERSISTENT_CACHE_ENTRY* persistent_cache_find(rdpPersistentCache* cache, UINT64 key);
+FREERDP_API PERSISTENT_CACHE_ENTRY* persistent_cache_put(rdpPersistentCache* cache, UINT64 key, UINT32 id,
+		UINT16 width, UINT16 height, UINT16 bpp, UINT16 flags, BYTE* data, UINT32 length);
+FREERDP_API PERSISTENT_CACHE_ENTRY* persistent_cache_put_key(rdpPersistentCache* cache, UINT64 key, UINT32 id, UINT32 index);
+FREERDP_API void persistent_cache_touch(rdpPersistentCache* cache, PERSISTENT_CACHE_ENTRY* entry);
+
+FREERDP_API BYTE* persistent_cache_get_data(rdpPersistentCache* cache, PERSISTENT_CACHE_ENTRY* entry);
+FREERDP_API int persistent_cache_get_keys(rdpPersistentCache* cache, UINT32 id, PERSISTENT_CACHE_ENTRY** entries, int max);
+
+#endif /* __UTILS_PERSISTENT_H */
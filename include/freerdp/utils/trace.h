@@ -0,0 +1,108 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Trace Points and Latency Histograms
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __UTILS_TRACE_H
+#define __UTILS_TRACE_H
+
+#include <freerdp/api.h>
+#include <freerdp/types.h>
+
+/**
+ * Trace points time the main stages of a session in every build, and
+ * cost a load and a branch while tracing is off. Once turned on with
+ * trace_set_enabled(), each thread records into a buffer of its own,
+ * without locks: a latency histogram per trace point, and the last
+ * TRACE_BUFFER_EVENTS events so that spikes can be told apart from a
+ * slow average.
+ *
+ * Histograms have 8 buckets per power of two of nanoseconds, so any value
+ * read back from one is within 12.5% of the latencies it stands for.
+ *
+ * The stages nest: an order is decoded along with the drawing it causes,
+ * including the gdi blits, and a bitmap update is read along with its
+ * decompression.
+ */
+
+enum TRACE_POINT
+{
+	TRACE_TRANSPORT_READ,
+	TRACE_DECOMPRESS,
+	TRACE_ORDER_DECODE,
+	TRACE_CODEC_DECODE,
+	TRACE_GDI_BLIT,
+	TRACE_ENCODE,
+	TRACE_COMPRESS,
+	TRACE_SEND,
+	TRACE_POINT_COUNT
+};
+
+#define TRACE_HISTOGRAM_SUB_BUCKETS	8
+#define TRACE_HISTOGRAM_BUCKETS		(2 * TRACE_HISTOGRAM_SUB_BUCKETS + 60 * TRACE_HISTOGRAM_SUB_BUCKETS)
+
+#define TRACE_BUFFER_EVENTS		256
+#define TRACE_MAX_THREADS		64
+
+struct _TRACE_HISTOGRAM
+{
+	UINT64 count;
+	UINT64 total;
+	UINT64 min;
+	UINT64 max;
+	UINT32 buckets[TRACE_HISTOGRAM_BUCKETS];
+};
+typedef struct _TRACE_HISTOGRAM TRACE_HISTOGRAM;
+
+struct _TRACE_EVENT
+{
+	UINT32 point;
+	UINT32 thread;
+	UINT64 start;
+	UINT64 duration;
+};
+typedef struct _TRACE_EVENT TRACE_EVENT;
+
+FREERDP_API extern volatile BOOL g_trace_enabled;
+
+FREERDP_API void trace_set_enabled(BOOL enabled);
+FREERDP_API void trace_reset(void);
+
+FREERDP_API UINT64 trace_get_time(void);
+FREERDP_API void trace_record(int point, UINT64 start);
+
+FREERDP_API void trace_histogram_reset(TRACE_HISTOGRAM* histogram);
+FREERDP_API void trace_histogram_record(TRACE_HISTOGRAM* histogram, UINT64 value);
+FREERDP_API void trace_histogram_add(TRACE_HISTOGRAM* histogram, TRACE_HISTOGRAM* other);
+FREERDP_API UINT64 trace_histogram_get_percentile(TRACE_HISTOGRAM* histogram, double percentile);
+
+FREERDP_API const char* trace_get_point_name(int point);
+FREERDP_API void trace_get_histogram(int point, TRACE_HISTOGRAM* histogram);
+FREERDP_API int trace_get_events(TRACE_EVENT* events, int count, UINT64 threshold);
+FREERDP_API int trace_get_dropped_threads(void);
+
+FREERDP_API void trace_print(void);
+
+/**
+ * TRACE_BEGIN(start) and TRACE_END(point, start) surround the code to time,
+ * with start a UINT64 of the caller; start stays 0 while tracing is off.
+ */
+#define TRACE_BEGIN(_start) \
+	_start = (g_trace_enabled ? trace_get_time() : 0)
+
+#define TRACE_END(_point, _start) \
+	do { if (_start) trace_record(_point, _start); } while (0)
+
+#endif /* __UTILS_TRACE_H */
@@ -0,0 +1,58 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Worker Thread Pool
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __UTILS_WORKER_H
+#define __UTILS_WORKER_H
+
+#include <freerdp/api.h>
+#include <freerdp/types.h>
+
+#include <winpr/synch.h>
+
+typedef struct _WORKER_POOL WORKER_POOL;
+
+typedef void (*pWorkerPoolCallback)(void* context, int index);
+
+/**
+ * Threads running the independent items of a batch, such as the
+ * rectangles of a bitmap update, alongside the thread that hands the batch
+ * over. Items are taken one at a time in index order, by whichever thread
+ * is free, and worker_pool_run() returns once every item is done.
+ *
+ * A pool runs one batch at a time, and without threads, or for a single
+ * item, the calling thread runs the batch by itself.
+ */
+struct _WORKER_POOL
+{
+	int threads;
+	BOOL stopping;
+
+	HANDLE start;
+	HANDLE done;
+
+	int count;
+	LONG next;
+	void* context;
+	pWorkerPoolCallback callback;
+};
+
+FREERDP_API WORKER_POOL* worker_pool_new(int threads);
+FREERDP_API void worker_pool_free(WORKER_POOL* pool);
+
+FREERDP_API void worker_pool_run(WORKER_POOL* pool, int count, pWorkerPoolCallback callback, void* context);
+
+#endif /* __UTILS_WORKER_H */
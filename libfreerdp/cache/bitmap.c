@@ -31,6 +31,47 @@
 
 #include <freerdp/cache/bitmap.h>
 
+/**
+ * A bitmap of the persistent cache file announced in the key list, drawn
+ * from the data kept in the file the first time the server uses it.
+ */
+
+static rdpBitmap* bitmap_cache_load_persistent(rdpBitmapCache* bitmap_cache, PERSISTENT_CACHE_ENTRY* entry)
+{
+	BYTE* data;
+	rdpBitmap* bitmap;
+	rdpContext* context = bitmap_cache->context;
+
+	data = persistent_cache_get_data(bitmap_cache->persistent, entry);
+
+	if (data == NULL)
+		return NULL;
+
+	bitmap = Bitmap_Alloc(context);
+
+	Bitmap_SetDimensions(context, bitmap, entry->width, entry->height);
+
+	bitmap->Decompress(context, bitmap,
+			data, entry->width, entry->height, entry->bpp, entry->length,
+			(entry->flags & PERSISTENT_CACHE_COMPRESSED) ? TRUE : FALSE, CODEC_ID_NONE);
+
+	bitmap->New(context, bitmap);
+
+	persistent_cache_touch(bitmap_cache->persistent, entry);
+
+	return bitmap;
+}
+
+/* a bitmap sent by the server replaces the persistent one at its index, which needs not be loaded */
+static void bitmap_cache_forget_persistent(rdpBitmapCache* bitmap_cache, UINT32 id, UINT32 index)
+{
+	if ((id >= bitmap_cache->maxCells) || (bitmap_cache->cells[id].persistent == NULL))
+		return;
+
+	if (index <= bitmap_cache->cells[id].number)
+		bitmap_cache->cells[id].persistent[index] = NULL;
+}
+
 void update_gdi_memblt(rdpContext* context, MEMBLT_ORDER* memblt)
 {
 	rdpBitmap* bitmap;
@@ -87,6 +128,7 @@ void update_gdi_cache_bitmap(rdpContext* context, CACHE_BITMAP_ORDER* cache_bitm
 
 	bitmap->New(context, bitmap);
 
+	bitmap_cache_forget_persistent(cache->bitmap, cache_bitmap->cacheId, cache_bitmap->cacheIndex);
 	prevBitmap = bitmap_cache_get(cache->bitmap, cache_bitmap->cacheId, cache_bitmap->cacheIndex);
 
 	if (prevBitmap != NULL)
@@ -118,12 +160,24 @@ void update_gdi_cache_bitmap_v2(rdpContext* context, CACHE_BITMAP_V2_ORDER* cach
 
 	bitmap->New(context, bitmap);
 
+	bitmap_cache_forget_persistent(cache->bitmap, cache_bitmap_v2->cacheId, cache_bitmap_v2->cacheIndex);
 	prevBitmap = bitmap_cache_get(cache->bitmap, cache_bitmap_v2->cacheId, cache_bitmap_v2->cacheIndex);
 
 	if (prevBitmap != NULL)
 		Bitmap_Free(context, prevBitmap);
 
 	bitmap_cache_put(cache->bitmap, cache_bitmap_v2->cacheId, cache_bitmap_v2->cacheIndex, bitmap);
+
+	/* keep bitmaps of persistent cells the server gave a key for across sessions */
+	if ((cache->bitmap->persistent != NULL) && (cache_bitmap_v2->flags & CBR2_PERSISTENT_KEY_PRESENT) &&
+		(cache_bitmap_v2->cacheId < cache->bitmap->maxCells) && cache->bitmap->cells[cache_bitmap_v2->cacheId].persistent)
+	{
+		persistent_cache_put(cache->bitmap->persistent,
+				((UINT64) cache_bitmap_v2->key2 << 32) | cache_bitmap_v2->key1, cache_bitmap_v2->cacheId,
+				cache_bitmap_v2->bitmapWidth, cache_bitmap_v2->bitmapHeight, cache_bitmap_v2->bitmapBpp,
+				cache_bitmap_v2->compressed ? PERSISTENT_CACHE_COMPRESSED : 0,
+				cache_bitmap_v2->bitmapDataStream, cache_bitmap_v2->bitmapLength);
+	}
 }
 
 void update_gdi_cache_bitmap_v3(rdpContext* context, CACHE_BITMAP_V3_ORDER* cache_bitmap_v3)
@@ -150,6 +204,7 @@ void update_gdi_cache_bitmap_v3(rdpContext* context, CACHE_BITMAP_V3_ORDER* cach
 
 	bitmap->New(context, bitmap);
 
+	bitmap_cache_forget_persistent(cache->bitmap, cache_bitmap_v3->cacheId, cache_bitmap_v3->cacheIndex);
 	prevBitmap = bitmap_cache_get(cache->bitmap, cache_bitmap_v3->cacheId, cache_bitmap_v3->cacheIndex);
 
 	if (prevBitmap != NULL)
@@ -158,50 +213,95 @@ void update_gdi_cache_bitmap_v3(rdpContext* context, CACHE_BITMAP_V3_ORDER* cach
 	bitmap_cache_put(cache->bitmap, cache_bitmap_v3->cacheId, cache_bitmap_v3->cacheIndex, bitmap);
 }
 
+/* below this many pixels an update is decoded faster than the workers wake up */
+#define BITMAP_UPDATE_PARALLEL_PIXELS	16384
+
+typedef struct
+{
+	rdpContext* context;
+	rdpBitmap** bitmaps;
+	BITMAP_DATA* rectangles;
+} BITMAP_UPDATE_BATCH;
+
+static void update_gdi_bitmap_decompress(void* arg, int index)
+{
+	BITMAP_UPDATE_BATCH* batch = (BITMAP_UPDATE_BATCH*) arg;
+	rdpBitmap* bitmap = batch->bitmaps[index];
+	BITMAP_DATA* bitmap_data = &batch->rectangles[index];
+
+	bitmap->bpp = bitmap_data->bitsPerPixel;
+	bitmap->length = bitmap_data->bitmapLength;
+	bitmap->compressed = bitmap_data->compressed;
+
+	Bitmap_SetRectangle(batch->context, bitmap,
+			bitmap_data->destLeft, bitmap_data->destTop,
+			bitmap_data->destRight, bitmap_data->destBottom);
+
+	Bitmap_SetDimensions(batch->context, bitmap, bitmap_data->width, bitmap_data->height);
+
+	bitmap->Decompress(batch->context, bitmap,
+			bitmap_data->bitmapDataStream, bitmap_data->width, bitmap_data->height,
+			bitmap_data->bitsPerPixel, bitmap_data->bitmapLength,
+			bitmap_data->compressed, CODEC_ID_NONE);
+}
+
+/**
+ * The rectangles of a bitmap update are decompressed into bitmaps of their
+ * own, kept from one update to the next with their data buffers, and on
+ * several threads when the update is large enough. Only decompression runs
+ * there: creating the bitmaps on the surface and painting them is left to
+ * the calling thread, in the order of the update.
+ */
+
 void update_gdi_bitmap_update(rdpContext* context, BITMAP_UPDATE* bitmap_update)
 {
-	int i;
+	UINT32 i;
+	UINT32 pixels = 0;
 	rdpBitmap* bitmap;
-	BITMAP_DATA* bitmap_data;
-	BOOL reused = TRUE;
-	rdpCache* cache = context->cache;
+	BITMAP_UPDATE_BATCH batch;
+	rdpBitmapCache* bitmap_cache = context->cache->bitmap;
 
-	if (cache->bitmap->bitmap == NULL)
+	if (bitmap_update->number > bitmap_cache->maxBitmaps)
 	{
-		cache->bitmap->bitmap = Bitmap_Alloc(context);
-		cache->bitmap->bitmap->ephemeral = TRUE;
-		reused = FALSE;
-	}
+		bitmap_cache->bitmaps = (rdpBitmap**) realloc(bitmap_cache->bitmaps,
+				sizeof(rdpBitmap*) * bitmap_update->number);
 
-	bitmap = cache->bitmap->bitmap;
+		for (i = bitmap_cache->maxBitmaps; i < bitmap_update->number; i++)
+		{
+			bitmap_cache->bitmaps[i] = Bitmap_Alloc(context);
+			bitmap_cache->bitmaps[i]->ephemeral = TRUE;
+		}
 
-	for (i = 0; i < (int) bitmap_update->number; i++)
-	{
-		bitmap_data = &bitmap_update->rectangles[i];
+		bitmap_cache->maxBitmaps = bitmap_update->number;
+	}
 
-		bitmap->bpp = bitmap_data->bitsPerPixel;
-		bitmap->length = bitmap_data->bitmapLength;
-		bitmap->compressed = bitmap_data->compressed;
+	for (i = 0; i < bitmap_update->number; i++)
+		pixels += bitmap_update->rectangles[i].width * bitmap_update->rectangles[i].height;
 
-		Bitmap_SetRectangle(context, bitmap,
-				bitmap_data->destLeft, bitmap_data->destTop,
-				bitmap_data->destRight, bitmap_data->destBottom);
+	batch.context = context;
+	batch.bitmaps = bitmap_cache->bitmaps;
+	batch.rectangles = bitmap_update->rectangles;
 
-		Bitmap_SetDimensions(context, bitmap, bitmap_data->width, bitmap_data->height);
+	if ((bitmap_update->number > 1) && (pixels >= BITMAP_UPDATE_PARALLEL_PIXELS))
+	{
+		if (bitmap_cache->workers == NULL)
+			bitmap_cache->workers = worker_pool_new(-1);
 
-		bitmap->Decompress(context, bitmap,
-				bitmap_data->bitmapDataStream, bitmap_data->width, bitmap_data->height,
-				bitmap_data->bitsPerPixel, bitmap_data->bitmapLength,
-				bitmap_data->compressed, CODEC_ID_NONE);
+		worker_pool_run(bitmap_cache->workers, bitmap_update->number, update_gdi_bitmap_decompress, &batch);
+	}
+	else
+	{
+		for (i = 0; i < bitmap_update->number; i++)
+			update_gdi_bitmap_decompress(&batch, i);
+	}
 
-		if (reused)
-			bitmap->Free(context, bitmap);
-		else
-			reused = TRUE;
+	for (i = 0; i < bitmap_update->number; i++)
+	{
+		bitmap = bitmap_cache->bitmaps[i];
 
 		bitmap->New(context, bitmap);
-
 		bitmap->Paint(context, bitmap);
+		bitmap->Free(context, bitmap);
 	}
 }
 
@@ -227,6 +327,14 @@ rdpBitmap* bitmap_cache_get(rdpBitmapCache* bitmap_cache, UINT32 id, UINT32 inde
 
 	bitmap = bitmap_cache->cells[id].entries[index];
 
+	if ((bitmap == NULL) && (bitmap_cache->cells[id].persistent != NULL) &&
+		(bitmap_cache->cells[id].persistent[index] != NULL))
+	{
+		bitmap = bitmap_cache_load_persistent(bitmap_cache, bitmap_cache->cells[id].persistent[index]);
+		bitmap_cache->cells[id].persistent[index] = NULL;
+		bitmap_cache->cells[id].entries[index] = bitmap;
+	}
+
 	return bitmap;
 }
 
@@ -268,6 +376,35 @@ void bitmap_cache_register_callbacks(rdpUpdate* update)
 	update->BitmapUpdate = update_gdi_bitmap_update;
 }
 
+/**
+ * Puts the bitmaps of the persistent cache file at the indices the key
+ * list announced them at, the same ones as the key list was built from
+ * the same file.
+ */
+
+static void bitmap_cache_load_persistent_file(rdpBitmapCache* bitmap_cache)
+{
+	UINT32 i;
+	rdpSettings* settings = bitmap_cache->settings;
+
+	bitmap_cache->persistent = persistent_cache_new();
+	persistent_cache_load(bitmap_cache->persistent, settings->BitmapCachePersistFile);
+
+	for (i = 0; (i < bitmap_cache->maxCells) && (i < PERSISTENT_CACHE_MAX_CELLS); i++)
+	{
+		if (!settings->BitmapCacheV2CellInfo[i].persistent)
+			continue;
+
+		bitmap_cache->cells[i].persistent = (PERSISTENT_CACHE_ENTRY**)
+				malloc(sizeof(PERSISTENT_CACHE_ENTRY*) * (bitmap_cache->cells[i].number + 1));
+		ZeroMemory(bitmap_cache->cells[i].persistent, sizeof(PERSISTENT_CACHE_ENTRY*) * (bitmap_cache->cells[i].number + 1));
+
+		persistent_cache_set_max_entries(bitmap_cache->persistent, i, bitmap_cache->cells[i].number);
+		persistent_cache_get_keys(bitmap_cache->persistent, i,
+				bitmap_cache->cells[i].persistent, bitmap_cache->cells[i].number);
+	}
+}
+
 rdpBitmapCache* bitmap_cache_new(rdpSettings* settings)
 {
 	int i;
@@ -294,6 +431,9 @@ rdpBitmapCache* bitmap_cache_new(rdpSettings* settings)
 			bitmap_cache->cells[i].entries = (rdpBitmap**) malloc(sizeof(rdpBitmap*) * (bitmap_cache->cells[i].number + 1));
 			ZeroMemory(bitmap_cache->cells[i].entries, sizeof(rdpBitmap*) * (bitmap_cache->cells[i].number + 1));
 		}
+
+		if (settings->BitmapCachePersistEnabled && settings->BitmapCachePersistFile)
+			bitmap_cache_load_persistent_file(bitmap_cache);
 	}
 
 	return bitmap_cache;
@@ -319,10 +459,24 @@ void bitmap_cache_free(rdpBitmapCache* bitmap_cache)
 			}
 
 			free(bitmap_cache->cells[i].entries);
+			free(bitmap_cache->cells[i].persistent);
+		}
+
+		if (bitmap_cache->persistent != NULL)
+		{
+			persistent_cache_save(bitmap_cache->persistent, bitmap_cache->settings->BitmapCachePersistFile);
+			persistent_cache_free(bitmap_cache->persistent);
+		}
+
+		/* the pooled update bitmaps are freed on the surface once painted */
+		for (i = 0; i < (int) bitmap_cache->maxBitmaps; i++)
+		{
+			free(bitmap_cache->bitmaps[i]->data);
+			free(bitmap_cache->bitmaps[i]);
 		}
 
-		if (bitmap_cache->bitmap != NULL)
-			Bitmap_Free(bitmap_cache->context, bitmap_cache->bitmap);
+		free(bitmap_cache->bitmaps);
+		worker_pool_free(bitmap_cache->workers);
 
 		free(bitmap_cache->cells);
 		free(bitmap_cache);
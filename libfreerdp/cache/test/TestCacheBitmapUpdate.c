@@ -0,0 +1,289 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <winpr/crt.h>
+#include <winpr/interlocked.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/gdi/gdi.h>
+#include <freerdp/codec/color.h>
+#include <freerdp/cache/cache.h>
+#include <freerdp/utils/worker.h>
+#include <freerdp/utils/stopwatch.h>
+
+/**
+ * Replays full screen refreshes of a 16 bpp desktop, sent as bitmap updates
+ * of 64x64 tiles in interleaved RLE the way Windows servers send them,
+ * through the gdi: once with the rectangles decompressed one after another
+ * and once on worker threads.
+ *
+ * Both have to leave the same pixels on the surface, and the bitmaps the
+ * rectangles are decompressed into have to be kept from one update to the
+ * next.
+ */
+
+#define TEST_WIDTH		1024
+#define TEST_HEIGHT		768
+#define TEST_TILE		64
+#define TEST_TILES		((TEST_WIDTH / TEST_TILE) * (TEST_HEIGHT / TEST_TILE))
+#define TEST_UPDATES		4
+#define TEST_ROUNDS		20
+#define TEST_THREADS		3
+
+/* a fixed generator, so every platform replays the same updates */
+static UINT32 test_random(UINT32* seed)
+{
+	*seed = (*seed * 1103515245) + 12345;
+	return (*seed >> 16) & 0x7FFF;
+}
+
+static void test_write_length(BYTE** p, BYTE code, BYTE mega_mega, int length)
+{
+	if (length < 32)
+	{
+		*(*p)++ = (code << 5) | length;
+	}
+	else if (length < 256 + 32)
+	{
+		*(*p)++ = (code << 5);
+		*(*p)++ = length - 32;
+	}
+	else
+	{
+		*(*p)++ = mega_mega;
+		*(*p)++ = length & 0xFF;
+		*(*p)++ = (length >> 8) & 0xFF;
+	}
+}
+
+/**
+ * A tile of flat areas and of short stretches of detail, as in a window
+ * with text, written with color runs and color images only.
+ */
+static UINT32 test_encode_tile(BYTE* data, UINT32* seed)
+{
+	int i;
+	int length;
+	UINT16 color;
+	BYTE* p = data;
+	int left = TEST_TILE * TEST_TILE;
+
+	while (left > 0)
+	{
+		if (test_random(seed) % 3)
+		{
+			length = 1 + test_random(seed) % 400;
+			length = (length < left) ? length : left;
+			color = (UINT16) test_random(seed);
+
+			test_write_length(&p, 0x03, 0xF3, length);
+			*p++ = color & 0xFF;
+			*p++ = color >> 8;
+		}
+		else
+		{
+			length = 1 + test_random(seed) % 80;
+			length = (length < left) ? length : left;
+
+			test_write_length(&p, 0x04, 0xF4, length);
+
+			for (i = 0; i < length; i++)
+			{
+				color = (UINT16) test_random(seed);
+				*p++ = color & 0xFF;
+				*p++ = color >> 8;
+			}
+		}
+
+		left -= length;
+	}
+
+	return (UINT32) (p - data);
+}
+
+static void test_update_init(BITMAP_UPDATE* update, UINT32* seed)
+{
+	UINT32 i;
+	BITMAP_DATA* bitmap_data;
+
+	update->number = update->count = TEST_TILES;
+	update->rectangles = (BITMAP_DATA*) malloc(sizeof(BITMAP_DATA) * TEST_TILES);
+	ZeroMemory(update->rectangles, sizeof(BITMAP_DATA) * TEST_TILES);
+
+	for (i = 0; i < update->number; i++)
+	{
+		bitmap_data = &update->rectangles[i];
+
+		bitmap_data->destLeft = (i % (TEST_WIDTH / TEST_TILE)) * TEST_TILE;
+		bitmap_data->destTop = (i / (TEST_WIDTH / TEST_TILE)) * TEST_TILE;
+		bitmap_data->destRight = bitmap_data->destLeft + TEST_TILE - 1;
+		bitmap_data->destBottom = bitmap_data->destTop + TEST_TILE - 1;
+		bitmap_data->width = TEST_TILE;
+		bitmap_data->height = TEST_TILE;
+		bitmap_data->bitsPerPixel = 16;
+		bitmap_data->compressed = TRUE;
+
+		/* worst case of a color image order per pixel */
+		bitmap_data->bitmapDataStream = (BYTE*) malloc(TEST_TILE * TEST_TILE * 5);
+		bitmap_data->bitmapLength = test_encode_tile(bitmap_data->bitmapDataStream, seed);
+	}
+}
+
+static void test_update_free(BITMAP_UPDATE* update)
+{
+	UINT32 i;
+
+	for (i = 0; i < update->number; i++)
+		free(update->rectangles[i].bitmapDataStream);
+
+	free(update->rectangles);
+}
+
+/**
+ * Replays the updates with the given workers, returning the time it took
+ * and leaving a copy of the surface in screen.
+ */
+static double test_replay(freerdp* instance, BITMAP_UPDATE* updates, WORKER_POOL* workers, BYTE* screen)
+{
+	int i;
+	double elapsed;
+	STOPWATCH* stopwatch;
+	rdpGdi* gdi = instance->context->gdi;
+	rdpBitmapCache* bitmap_cache = instance->context->cache->bitmap;
+
+	worker_pool_free(bitmap_cache->workers);
+	bitmap_cache->workers = workers;
+
+	ZeroMemory(gdi->primary_buffer, TEST_WIDTH * TEST_HEIGHT * 4);
+
+	stopwatch = stopwatch_create();
+	stopwatch_start(stopwatch);
+
+	for (i = 0; i < TEST_ROUNDS * TEST_UPDATES; i++)
+		IFCALL(instance->update->BitmapUpdate, instance->context, &updates[i % TEST_UPDATES]);
+
+	stopwatch_stop(stopwatch);
+	elapsed = stopwatch_get_elapsed_time_in_seconds(stopwatch);
+	stopwatch_free(stopwatch);
+
+	CopyMemory(screen, gdi->primary_buffer, TEST_WIDTH * TEST_HEIGHT * 4);
+
+	return elapsed;
+}
+
+static void test_count_item(void* context, int index)
+{
+	InterlockedIncrement(&((LONG*) context)[index]);
+}
+
+static int test_worker_pool(void)
+{
+	int i;
+	int count;
+	int status = 0;
+	LONG items[100];
+	WORKER_POOL* pool;
+
+	pool = worker_pool_new(TEST_THREADS);
+
+	/* every item of every batch runs once, and batches smaller than the pool too */
+	for (count = 1; count <= 100; count += 33)
+	{
+		ZeroMemory(items, sizeof(items));
+		worker_pool_run(pool, count, test_count_item, items);
+
+		for (i = 0; i < 100; i++)
+		{
+			if (items[i] != ((i < count) ? 1 : 0))
+				status = -1;
+		}
+	}
+
+	worker_pool_free(pool);
+
+	if (status < 0)
+		printf("worker pool does not run every item once\n");
+
+	return status;
+}
+
+int TestCacheBitmapUpdate(int argc, char* argv[])
+{
+	int i;
+	int status = 0;
+	UINT32 seed = 1;
+	double serial_time;
+	double parallel_time;
+	BYTE* serial_screen;
+	BYTE* parallel_screen;
+	freerdp* instance;
+	rdpBitmap* pooled;
+	rdpBitmapCache* bitmap_cache;
+	BITMAP_UPDATE updates[TEST_UPDATES];
+
+	status |= test_worker_pool();
+
+	instance = freerdp_new();
+	freerdp_context_new(instance);
+
+	instance->settings->DesktopWidth = TEST_WIDTH;
+	instance->settings->DesktopHeight = TEST_HEIGHT;
+	instance->settings->ColorDepth = 16;
+
+	gdi_init(instance, CLRCONV_ALPHA | CLRBUF_32BPP, NULL);
+	bitmap_cache = instance->context->cache->bitmap;
+
+	for (i = 0; i < TEST_UPDATES; i++)
+		test_update_init(&updates[i], &seed);
+
+	serial_screen = (BYTE*) malloc(TEST_WIDTH * TEST_HEIGHT * 4);
+	parallel_screen = (BYTE*) malloc(TEST_WIDTH * TEST_HEIGHT * 4);
+
+	serial_time = test_replay(instance, updates, worker_pool_new(0), serial_screen);
+	pooled = bitmap_cache->bitmaps[0];
+
+	parallel_time = test_replay(instance, updates, worker_pool_new(TEST_THREADS), parallel_screen);
+
+	printf("%d updates of %d tiles: serial %.2f ms, %d threads %.2f ms per update, speedup %.2f\n",
+		TEST_ROUNDS * TEST_UPDATES, TEST_TILES, serial_time * 1000 / (TEST_ROUNDS * TEST_UPDATES),
+		TEST_THREADS + 1, parallel_time * 1000 / (TEST_ROUNDS * TEST_UPDATES), serial_time / parallel_time);
+
+	if (memcmp(serial_screen, parallel_screen, TEST_WIDTH * TEST_HEIGHT * 4) != 0)
+	{
+		printf("parallel decoding changes the surface\n");
+		status = -1;
+	}
+
+	for (i = 0; i < TEST_WIDTH * TEST_HEIGHT * 4; i += 4)
+	{
+		if (*((UINT32*) &serial_screen[i]) != *((UINT32*) &serial_screen[0]))
+			break;
+	}
+
+	if (i == TEST_WIDTH * TEST_HEIGHT * 4)
+	{
+		printf("updates are not painted\n");
+		status = -1;
+	}
+
+	if ((bitmap_cache->maxBitmaps != TEST_TILES) || (bitmap_cache->bitmaps[0] != pooled))
+	{
+		printf("update bitmaps are not reused\n");
+		status = -1;
+	}
+
+	for (i = 0; i < TEST_UPDATES; i++)
+		test_update_free(&updates[i]);
+
+	free(serial_screen);
+	free(parallel_screen);
+
+	cache_free(instance->context->cache);
+	gdi_free(instance);
+	freerdp_context_free(instance);
+	freerdp_free(instance);
+
+	return status;
+}
@@ -22,6 +22,7 @@
 #endif
 
 #include <freerdp/utils/stream.h>
+#include <freerdp/utils/trace.h>
 #include <freerdp/codec/color.h>
 
 #include <freerdp/codec/bitmap.h>
@@ -441,6 +442,9 @@ static BOOL bitmap_decompress4(BYTE* srcData, BYTE* dstData, int width, int heig
 BOOL bitmap_decompress(BYTE* srcData, BYTE* dstData, int width, int height, int size, int srcBpp, int dstBpp)
 {
         BYTE * TmpBfr;
+	UINT64 trace;
+
+	TRACE_BEGIN(trace);
 
 	if (srcBpp == 16 && dstBpp == 16)
 	{
@@ -480,5 +484,7 @@ BOOL bitmap_decompress(BYTE* srcData, BYTE* dstData, int width, int height, int
 		return FALSE;
 	}
 
+	TRACE_END(TRACE_CODEC_DECODE, trace);
+
 	return TRUE;
 }
@@ -31,6 +31,8 @@
 #include <freerdp/freerdp.h>
 #include <freerdp/codec/color.h>
 
+#include "color_kernels.h"
+
 int freerdp_get_pixel(BYTE* data, int x, int y, int width, int height, int bpp)
 {
 	int start;
@@ -356,399 +358,142 @@ UINT32 freerdp_color_convert_var_bgr(UINT32 srcColor, int srcBpp, int dstBpp, HC
 		return freerdp_color_convert_rgb_bgr(srcColor, srcBpp, dstBpp, clrconv);
 }
 
-BYTE* freerdp_image_convert_8bpp(BYTE* srcData, BYTE* dstData, int width, int height, int srcBpp, int dstBpp, HCLRCONV clrconv)
-{
-	int i;
-	BYTE red;
-	BYTE green;
-	BYTE blue;
-	UINT32 pixel;
-	BYTE *src8;
-	UINT16 *dst16;
-	UINT32 *dst32;
-
-	if (dstBpp == 8)
-	{
-		if (dstData == NULL)
-			dstData = (BYTE*) malloc(width * height);
-
-		memcpy(dstData, srcData, width * height);
-		return dstData;
-	}
-	else if (dstBpp == 15 || (dstBpp == 16 && clrconv->rgb555))
-	{
-		if (dstData == NULL)
-			dstData = (BYTE*) malloc(width * height * 2);
-
-		dst16 = (UINT16 *) dstData;
-		for (i = width * height; i > 0; i--)
-		{
-			pixel = *srcData;
-			srcData++;
-			red = clrconv->palette->entries[pixel].red;
-			green = clrconv->palette->entries[pixel].green;
-			blue = clrconv->palette->entries[pixel].blue;
-			pixel = (clrconv->invert) ? BGR15(red, green, blue) : RGB15(red, green, blue);
-			*dst16 = pixel;
-			dst16++;
-		}
-		return dstData;
-	}
-	else if (dstBpp == 16)
-	{
-		if (dstData == NULL)
-			dstData = (BYTE*) malloc(width * height * 2);
-
-		dst16 = (UINT16 *) dstData;
-		for (i = width * height; i > 0; i--)
-		{
-			pixel = *srcData;
-			srcData++;
-			red = clrconv->palette->entries[pixel].red;
-			green = clrconv->palette->entries[pixel].green;
-			blue = clrconv->palette->entries[pixel].blue;
-			pixel = (clrconv->invert) ? BGR16(red, green, blue) : RGB16(red, green, blue);
-			*dst16 = pixel;
-			dst16++;
-		}
-		return dstData;
-	}
-	else if (dstBpp == 32)
-	{
-		if (dstData == NULL)
-			dstData = (BYTE*) malloc(width * height * 4);
-
-		src8 = (BYTE*) srcData;
-		dst32 = (UINT32*) dstData;
-		for (i = width * height; i > 0; i--)
-		{
-			pixel = *src8;
-			src8++;
-			red = clrconv->palette->entries[pixel].red;
-			green = clrconv->palette->entries[pixel].green;
-			blue = clrconv->palette->entries[pixel].blue;
-			if (clrconv->alpha)
-			{
-				pixel = (clrconv->invert) ? ARGB32(0xFF, red, green, blue) : ABGR32(0xFF, red, green, blue);
-			}
-			else
-			{
-				pixel = (clrconv->invert) ? RGB32(red, green, blue) : BGR32(red, green, blue);
-			}
-			*dst32 = pixel;
-			dst32++;
-		}
-		return dstData;
-	}
-
-	return srcData;
-}
-
-BYTE* freerdp_image_convert_15bpp(BYTE* srcData, BYTE* dstData, int width, int height, int srcBpp, int dstBpp, HCLRCONV clrconv)
+/**
+ * Maps a source/destination depth pair and the clrconv flags to one of the
+ * conversion kernels. Palette based sources get their palette translated to
+ * the destination format in params->table, so the kernels only do lookups.
+ * Returns -1 for unsupported pairs.
+ */
+static int freerdp_image_convert_kernel(int srcBpp, int dstBpp, HCLRCONV clrconv, COLOR_KERNEL_PARAMS* params)
 {
 	int i;
 	BYTE red;
 	BYTE green;
 	BYTE blue;
-	UINT32 pixel;
-	UINT16 *src16;
-	UINT16 *dst16;
-	UINT32 *dst32;
-
-	if (dstBpp == 15 || (dstBpp == 16 && clrconv->rgb555))
-	{
-		if (dstData == NULL)
-			dstData = (BYTE*) malloc(width * height * 2);
-
-		memcpy(dstData, srcData, width * height * 2);
-
-		return dstData;
-	}
-	else if (dstBpp == 32)
-	{
-		if (dstData == NULL)
-			dstData = (BYTE*) malloc(width * height * 4);
-
-		src16 = (UINT16 *) srcData;
-		dst32 = (UINT32 *) dstData;
-		for (i = width * height; i > 0; i--)
-		{
-			pixel = *src16;
-			src16++;
-			GetBGR15(red, green, blue, pixel);
-			if (clrconv->alpha)
-			{
-				pixel = (clrconv->invert) ? ARGB32(0xFF, red, green, blue) : ABGR32(0xFF, red, green, blue);
-			}
-			else
-			{
-				pixel = (clrconv->invert) ? RGB32(red, green, blue) : BGR32(red, green, blue);
-			}
-			*dst32 = pixel;
-			dst32++;
-		}
-		return dstData;
-	}
-	else if (dstBpp == 16)
-	{
-		if (dstData == NULL)
-			dstData = (BYTE*) malloc(width * height * 2);
 
-		src16 = (UINT16 *) srcData;
-		dst16 = (UINT16 *) dstData;
-		for (i = width * height; i > 0; i--)
-		{
-			pixel = *src16;
-			src16++;
-			GetRGB_555(red, green, blue, pixel);
-			RGB_555_565(red, green, blue);
-			pixel = (clrconv->invert) ? BGR565(red, green, blue) : RGB565(red, green, blue);
-			*dst16 = pixel;
-			dst16++;
-		}
-		return dstData;
-	}
-
-	return srcData;
-}
-
-BYTE* freerdp_image_convert_16bpp(BYTE* srcData, BYTE* dstData, int width, int height, int srcBpp, int dstBpp, HCLRCONV clrconv)
-{
-	if (srcBpp == 15)
-		return freerdp_image_convert_15bpp(srcData, dstData, width, height, srcBpp, dstBpp, clrconv);
+	params->alpha = (clrconv->alpha) ? 0xFF000000 : 0;
 
-	if (dstBpp == 16)
+	switch (IBPP(srcBpp))
 	{
-		if (dstData == NULL)
-			dstData = (BYTE*) malloc(width * height * 2);
+		case 1:
+			if (dstBpp == 8)
+				return COLOR_KERNEL_COPY_8;
 
-		if (clrconv->rgb555)
-		{
-			int i;
-			BYTE red, green, blue;
-			UINT16* src16 = (UINT16 *) srcData;
-			UINT16* dst16 = (UINT16 *) dstData;
+			if ((dstBpp != 15) && (dstBpp != 16) && (dstBpp != 32))
+				break;
 
-			for (i = width * height; i > 0; i--)
+			for (i = 0; i < 256; i++)
 			{
-				GetRGB_565(red, green, blue, (*src16));
-				RGB_565_555(red, green, blue);
-				(*dst16) = (clrconv->invert) ? BGR555(red, green, blue) : RGB555(red, green, blue);
-				src16++;
-				dst16++;
+				red = clrconv->palette->entries[i].red;
+				green = clrconv->palette->entries[i].green;
+				blue = clrconv->palette->entries[i].blue;
+
+				if (dstBpp == 15 || (dstBpp == 16 && clrconv->rgb555))
+					params->table[i] = (clrconv->invert) ? BGR15(red, green, blue) : RGB15(red, green, blue);
+				else if (dstBpp == 16)
+					params->table[i] = (clrconv->invert) ? BGR16(red, green, blue) : RGB16(red, green, blue);
+				else if (clrconv->invert)
+					params->table[i] = params->alpha | RGB32(red, green, blue);
+				else
+					params->table[i] = params->alpha | BGR32(red, green, blue);
 			}
-		}
-		else
-		{
-			memcpy(dstData, srcData, width * height * 2);
-		}
 
-		return dstData;
-	}
-	else if (dstBpp == 24)
-	{
-		int i;
-		BYTE *dst8;
-		UINT16 *src16;
-		BYTE red, green, blue;
+			return (dstBpp == 32) ? COLOR_KERNEL_8_32 : COLOR_KERNEL_8_16;
 
-		if (dstData == NULL)
-			dstData = (BYTE*) malloc(width * height * 3);
-
-		dst8 = (BYTE*) dstData;
-		src16 = (UINT16*) srcData;
-
-		for (i = width * height; i > 0; i--)
-		{
-			GetBGR16(red, green, blue, *src16);
-			src16++;
-
-			if (clrconv->invert)
+		case 2:
+			if (srcBpp == 15)
 			{
-				*dst8++ = blue;
-				*dst8++ = green;
-				*dst8++ = red;
+				if (dstBpp == 15 || (dstBpp == 16 && clrconv->rgb555))
+					return COLOR_KERNEL_COPY_16;
+				else if (dstBpp == 32)
+					return (clrconv->invert) ? COLOR_KERNEL_15_32_RGB : COLOR_KERNEL_15_32_BGR;
+				else if (dstBpp == 16)
+					return (clrconv->invert) ? COLOR_KERNEL_15_16_BGR : COLOR_KERNEL_15_16_RGB;
 			}
 			else
 			{
-				*dst8++ = red;
-				*dst8++ = green;
-				*dst8++ = blue;
+				if (dstBpp == 16 && clrconv->rgb555)
+					return (clrconv->invert) ? COLOR_KERNEL_16_15_BGR : COLOR_KERNEL_16_15_RGB;
+				else if (dstBpp == 16)
+					return COLOR_KERNEL_COPY_16;
+				else if (dstBpp == 24)
+					return (clrconv->invert) ? COLOR_KERNEL_16_24_BGR : COLOR_KERNEL_16_24_RGB;
+				else if (dstBpp == 32)
+					return (clrconv->invert) ? COLOR_KERNEL_16_32_RGB : COLOR_KERNEL_16_32_BGR;
 			}
-		}
-		return dstData;
-	}
-	else if (dstBpp == 32)
-	{
-		int i;
-		UINT32 pixel;
-		UINT16* src16;
-		UINT32* dst32;
-		BYTE red, green, blue;
-
-		if (dstData == NULL)
-			dstData = (BYTE*) malloc(width * height * 4);
+			break;
 
-		src16 = (UINT16*) srcData;
-		dst32 = (UINT32*) dstData;
+		case 3:
+			if (dstBpp == 32)
+				return COLOR_KERNEL_24_32;
+			break;
 
-		for (i = width * height; i > 0; i--)
-		{
-			pixel = *src16;
-			src16++;
-			GetBGR16(red, green, blue, pixel);
-			if (clrconv->alpha)
-			{
-				pixel = (clrconv->invert) ? ARGB32(0xFF, red, green, blue) : ABGR32(0xFF, red, green, blue);
-			}
-			else
-			{
-				pixel = (clrconv->invert) ? RGB32(red, green, blue) : BGR32(red, green, blue);
-			}
-			*dst32 = pixel;
-			dst32++;
-		}
-		return dstData;
+		case 4:
+			if (dstBpp == 16)
+				return (clrconv->invert) ? COLOR_KERNEL_32_16_BGR : COLOR_KERNEL_32_16_RGB;
+			else if (dstBpp == 24)
+				return (clrconv->invert) ? COLOR_KERNEL_32_24_BGR : COLOR_KERNEL_32_24_RGB;
+			else if (dstBpp == 32)
+				return (clrconv->alpha) ? COLOR_KERNEL_32_32_ALPHA : COLOR_KERNEL_COPY_32;
+			break;
 	}
 
-	return srcData;
+	return -1;
 }
 
-BYTE* freerdp_image_convert_24bpp(BYTE* srcData, BYTE* dstData, int width, int height, int srcBpp, int dstBpp, HCLRCONV clrconv)
+/**
+ * Converts an image between color depths, optionally flipping it vertically
+ * in the same pass. The kernel is chosen once per call from the clrconv
+ * flags, so callers may change the flags between calls. Unsupported depth
+ * pairs return srcData unchanged, like freerdp_image_convert() always did.
+ */
+BYTE* freerdp_image_convert_ex(BYTE* srcData, BYTE* dstData, int width, int height, int srcBpp, int dstBpp, HCLRCONV clrconv, UINT32 flags)
 {
-	int i;
+	int y;
+	int kernel;
+	int srcStep;
+	int dstStep;
+	p_color_kernel convert;
+	COLOR_KERNEL_PARAMS params;
 
-	if (dstBpp == 32)
-	{
-		BYTE *dstp;
-		if (dstData == NULL)
-			dstData = (BYTE*) malloc(width * height * 4);
+	if (IBPP(srcBpp) == 0)
+		return NULL;
 
-		dstp = dstData;
-		for (i = width * height; i > 0; i--)
-		{
-			*(dstp++) = *(srcData++);
-			*(dstp++) = *(srcData++);
-			*(dstp++) = *(srcData++);
-			*(dstp++) = 0xFF;
-		}
-		return dstData;
-	}
+	kernel = freerdp_image_convert_kernel(srcBpp, dstBpp, clrconv, &params);
 
-	return srcData;
-}
+	if (kernel < 0)
+		return srcData;
 
-BYTE* freerdp_image_convert_32bpp(BYTE* srcData, BYTE* dstData, int width, int height, int srcBpp, int dstBpp, HCLRCONV clrconv)
-{
-	if (dstBpp == 16)
-	{
-		int index;
-		UINT16 *dst16;
-		UINT32 *src32;
-		BYTE red, green, blue;
+	srcStep = width * ((srcBpp + 7) / 8);
+	dstStep = width * ((dstBpp + 7) / 8);
 
-		if (dstData == NULL)
-			dstData = (BYTE*) malloc(width * height * 2);
+	if (dstData == NULL)
+		dstData = (BYTE*) malloc(dstStep * height);
 
-		dst16 = (UINT16*) dstData;
-		src32 = (UINT32*) srcData;
+	convert = freerdp_color_kernels_get()->kernels[kernel];
 
-		for (index = 0; index < width * height; index++)
-		{
-			GetBGR32(blue, green, red, *src32);
-			*dst16 = (clrconv->invert) ? BGR16(red, green, blue) : RGB16(red, green, blue);
-			src32++;
-			dst16++;
-		}
-		return dstData;
+	if (!(flags & FREERDP_IMAGE_FLIP))
+	{
+		convert(srcData, dstData, width * height, &params);
 	}
-	else if (dstBpp == 24)
+	else if (srcData == dstData)
 	{
-		BYTE *dstp;
-		int index;
-		BYTE red, green, blue;
-
-		if (dstData == NULL)
-			dstData = (BYTE*) malloc(width * height * 3);
-
-		dstp = dstData;
-		for (index = 0; index < width * height; index++)
-		{
-			red = *(srcData++);
-			green = *(srcData++);
-			blue = *(srcData++);
-
-			if (clrconv->invert)
-			{
-				*dstp++ = blue;
-				*dstp++ = green;
-				*dstp++ = red;
-			}
-			else
-			{
-				*dstp++ = red;
-				*dstp++ = green;
-				*dstp++ = blue;
-			}
-
-			srcData++;
-		}
-		return dstData;
+		/* rows cannot be moved before they are converted, flip afterwards */
+		convert(srcData, dstData, width * height, &params);
+		freerdp_bitmap_flip(dstData, dstData, dstStep, height);
 	}
-	else if (dstBpp == 32)
+	else
 	{
-		if (clrconv->alpha)
-		{
-			int x, y;
-			BYTE *dstp;
-
-			if (dstData == NULL)
-				dstData = (BYTE*) malloc(width * height * 4);
-
-			memcpy(dstData, srcData, width * height * 4);
-
-			dstp = dstData;
-			for (y = 0; y < height; y++)
-			{
-				for (x = 0; x < width * 4; x += 4)
-				{
-					dstp += 3;
-					*dstp = 0xFF;
-					dstp++;
-				}
-			}
-		}
-		else
-		{
-			if (dstData == NULL)
-				dstData = (BYTE*) malloc(width * height * 4);
-
-			memcpy(dstData, srcData, width * height * 4);
-		}
-
-		return dstData;
+		for (y = 0; y < height; y++)
+			convert(&srcData[y * srcStep], &dstData[(height - y - 1) * dstStep], width, &params);
 	}
 
-	return srcData;
+	return dstData;
 }
 
-p_freerdp_image_convert freerdp_image_convert_[5] =
-{
-	NULL,
-	freerdp_image_convert_8bpp,
-	freerdp_image_convert_16bpp,
-	freerdp_image_convert_24bpp,
-	freerdp_image_convert_32bpp
-};
-
 BYTE* freerdp_image_convert(BYTE* srcData, BYTE* dstData, int width, int height, int srcBpp, int dstBpp, HCLRCONV clrconv)
 {
-	p_freerdp_image_convert _p_freerdp_image_convert = freerdp_image_convert_[IBPP(srcBpp)];
-
-	if (_p_freerdp_image_convert != NULL)
-		return _p_freerdp_image_convert(srcData, dstData, width, height, srcBpp, dstBpp, clrconv);
-	else
-		return 0;
+	return freerdp_image_convert_ex(srcData, dstData, width, height, srcBpp, dstBpp, clrconv, 0);
 }
 
 void   freerdp_bitmap_flip(BYTE * src, BYTE * dst, int scanLineSz, int height)
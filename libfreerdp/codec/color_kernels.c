@@ -0,0 +1,382 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Color Conversion Kernels
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+
+#include "color_kernels.h"
+
+#ifdef WITH_SSE2
+#include "color_sse2.h"
+#endif
+
+#ifdef WITH_NEON
+#include "color_neon.h"
+#endif
+
+#ifndef COLOR_INIT_SIMD
+#define COLOR_INIT_SIMD(_kernels) do { } while (0)
+#endif
+
+static void color_copy_8(const BYTE* src, BYTE* dst, int count, const COLOR_KERNEL_PARAMS* params)
+{
+	if (src != dst)
+		memcpy(dst, src, count);
+}
+
+static void color_copy_16(const BYTE* src, BYTE* dst, int count, const COLOR_KERNEL_PARAMS* params)
+{
+	if (src != dst)
+		memcpy(dst, src, count * 2);
+}
+
+static void color_copy_32(const BYTE* src, BYTE* dst, int count, const COLOR_KERNEL_PARAMS* params)
+{
+	if (src != dst)
+		memcpy(dst, src, count * 4);
+}
+
+static void color_8_16(const BYTE* src, BYTE* dst, int count, const COLOR_KERNEL_PARAMS* params)
+{
+	UINT16* dst16 = (UINT16*) dst;
+
+	while (count-- > 0)
+		*dst16++ = (UINT16) params->table[*src++];
+}
+
+static void color_8_32(const BYTE* src, BYTE* dst, int count, const COLOR_KERNEL_PARAMS* params)
+{
+	UINT32* dst32 = (UINT32*) dst;
+
+	while (count-- > 0)
+		*dst32++ = params->table[*src++];
+}
+
+static void color_15_16_rgb(const BYTE* src, BYTE* dst, int count, const COLOR_KERNEL_PARAMS* params)
+{
+	BYTE red, green, blue;
+	UINT16* src16 = (UINT16*) src;
+	UINT16* dst16 = (UINT16*) dst;
+
+	while (count-- > 0)
+	{
+		GetRGB_555(red, green, blue, *src16);
+		RGB_555_565(red, green, blue);
+		*dst16++ = RGB565(red, green, blue);
+		src16++;
+	}
+}
+
+static void color_15_16_bgr(const BYTE* src, BYTE* dst, int count, const COLOR_KERNEL_PARAMS* params)
+{
+	BYTE red, green, blue;
+	UINT16* src16 = (UINT16*) src;
+	UINT16* dst16 = (UINT16*) dst;
+
+	while (count-- > 0)
+	{
+		GetRGB_555(red, green, blue, *src16);
+		RGB_555_565(red, green, blue);
+		*dst16++ = BGR565(red, green, blue);
+		src16++;
+	}
+}
+
+static void color_15_32_rgb(const BYTE* src, BYTE* dst, int count, const COLOR_KERNEL_PARAMS* params)
+{
+	BYTE red, green, blue;
+	UINT16* src16 = (UINT16*) src;
+	UINT32* dst32 = (UINT32*) dst;
+
+	while (count-- > 0)
+	{
+		GetBGR15(red, green, blue, *src16);
+		*dst32++ = params->alpha | RGB32(red, green, blue);
+		src16++;
+	}
+}
+
+static void color_15_32_bgr(const BYTE* src, BYTE* dst, int count, const COLOR_KERNEL_PARAMS* params)
+{
+	BYTE red, green, blue;
+	UINT16* src16 = (UINT16*) src;
+	UINT32* dst32 = (UINT32*) dst;
+
+	while (count-- > 0)
+	{
+		GetBGR15(red, green, blue, *src16);
+		*dst32++ = params->alpha | BGR32(red, green, blue);
+		src16++;
+	}
+}
+
+static void color_16_15_rgb(const BYTE* src, BYTE* dst, int count, const COLOR_KERNEL_PARAMS* params)
+{
+	BYTE red, green, blue;
+	UINT16* src16 = (UINT16*) src;
+	UINT16* dst16 = (UINT16*) dst;
+
+	while (count-- > 0)
+	{
+		GetRGB_565(red, green, blue, *src16);
+		RGB_565_555(red, green, blue);
+		*dst16++ = RGB555(red, green, blue);
+		src16++;
+	}
+}
+
+static void color_16_15_bgr(const BYTE* src, BYTE* dst, int count, const COLOR_KERNEL_PARAMS* params)
+{
+	BYTE red, green, blue;
+	UINT16* src16 = (UINT16*) src;
+	UINT16* dst16 = (UINT16*) dst;
+
+	while (count-- > 0)
+	{
+		GetRGB_565(red, green, blue, *src16);
+		RGB_565_555(red, green, blue);
+		*dst16++ = BGR555(red, green, blue);
+		src16++;
+	}
+}
+
+static void color_16_24_rgb(const BYTE* src, BYTE* dst, int count, const COLOR_KERNEL_PARAMS* params)
+{
+	BYTE red, green, blue;
+	UINT16* src16 = (UINT16*) src;
+
+	while (count-- > 0)
+	{
+		GetBGR16(red, green, blue, *src16);
+		*dst++ = red;
+		*dst++ = green;
+		*dst++ = blue;
+		src16++;
+	}
+}
+
+static void color_16_24_bgr(const BYTE* src, BYTE* dst, int count, const COLOR_KERNEL_PARAMS* params)
+{
+	BYTE red, green, blue;
+	UINT16* src16 = (UINT16*) src;
+
+	while (count-- > 0)
+	{
+		GetBGR16(red, green, blue, *src16);
+		*dst++ = blue;
+		*dst++ = green;
+		*dst++ = red;
+		src16++;
+	}
+}
+
+static void color_16_32_rgb(const BYTE* src, BYTE* dst, int count, const COLOR_KERNEL_PARAMS* params)
+{
+	BYTE red, green, blue;
+	UINT16* src16 = (UINT16*) src;
+	UINT32* dst32 = (UINT32*) dst;
+
+	while (count-- > 0)
+	{
+		GetBGR16(red, green, blue, *src16);
+		*dst32++ = params->alpha | RGB32(red, green, blue);
+		src16++;
+	}
+}
+
+static void color_16_32_bgr(const BYTE* src, BYTE* dst, int count, const COLOR_KERNEL_PARAMS* params)
+{
+	BYTE red, green, blue;
+	UINT16* src16 = (UINT16*) src;
+	UINT32* dst32 = (UINT32*) dst;
+
+	while (count-- > 0)
+	{
+		GetBGR16(red, green, blue, *src16);
+		*dst32++ = params->alpha | BGR32(red, green, blue);
+		src16++;
+	}
+}
+
+static void color_24_32(const BYTE* src, BYTE* dst, int count, const COLOR_KERNEL_PARAMS* params)
+{
+	while (count-- > 0)
+	{
+		*dst++ = *src++;
+		*dst++ = *src++;
+		*dst++ = *src++;
+		*dst++ = 0xFF;
+	}
+}
+
+static void color_32_16_rgb(const BYTE* src, BYTE* dst, int count, const COLOR_KERNEL_PARAMS* params)
+{
+	BYTE red, green, blue;
+	UINT32* src32 = (UINT32*) src;
+	UINT16* dst16 = (UINT16*) dst;
+
+	while (count-- > 0)
+	{
+		GetRGB32(red, green, blue, *src32);
+		*dst16++ = RGB16(red, green, blue);
+		src32++;
+	}
+}
+
+static void color_32_16_bgr(const BYTE* src, BYTE* dst, int count, const COLOR_KERNEL_PARAMS* params)
+{
+	BYTE red, green, blue;
+	UINT32* src32 = (UINT32*) src;
+	UINT16* dst16 = (UINT16*) dst;
+
+	while (count-- > 0)
+	{
+		GetRGB32(red, green, blue, *src32);
+		*dst16++ = BGR16(red, green, blue);
+		src32++;
+	}
+}
+
+static void color_32_24_rgb(const BYTE* src, BYTE* dst, int count, const COLOR_KERNEL_PARAMS* params)
+{
+	while (count-- > 0)
+	{
+		*dst++ = src[0];
+		*dst++ = src[1];
+		*dst++ = src[2];
+		src += 4;
+	}
+}
+
+static void color_32_24_bgr(const BYTE* src, BYTE* dst, int count, const COLOR_KERNEL_PARAMS* params)
+{
+	while (count-- > 0)
+	{
+		*dst++ = src[2];
+		*dst++ = src[1];
+		*dst++ = src[0];
+		src += 4;
+	}
+}
+
+static void color_32_32_alpha(const BYTE* src, BYTE* dst, int count, const COLOR_KERNEL_PARAMS* params)
+{
+	while (count-- > 0)
+	{
+		*dst++ = *src++;
+		*dst++ = *src++;
+		*dst++ = *src++;
+		*dst++ = 0xFF;
+		src++;
+	}
+}
+
+static const char* const color_kernel_names[COLOR_KERNEL_COUNT] =
+{
+	"copy_8",
+	"copy_16",
+	"copy_32",
+	"8_16",
+	"8_32",
+	"15_16_rgb",
+	"15_16_bgr",
+	"15_32_rgb",
+	"15_32_bgr",
+	"16_15_rgb",
+	"16_15_bgr",
+	"16_24_rgb",
+	"16_24_bgr",
+	"16_32_rgb",
+	"16_32_bgr",
+	"24_32",
+	"32_16_rgb",
+	"32_16_bgr",
+	"32_24_rgb",
+	"32_24_bgr",
+	"32_32_alpha"
+};
+
+static const COLOR_KERNELS color_kernels_generic =
+{
+	"generic",
+	{
+		color_copy_8,
+		color_copy_16,
+		color_copy_32,
+		color_8_16,
+		color_8_32,
+		color_15_16_rgb,
+		color_15_16_bgr,
+		color_15_32_rgb,
+		color_15_32_bgr,
+		color_16_15_rgb,
+		color_16_15_bgr,
+		color_16_24_rgb,
+		color_16_24_bgr,
+		color_16_32_rgb,
+		color_16_32_bgr,
+		color_24_32,
+		color_32_16_rgb,
+		color_32_16_bgr,
+		color_32_24_rgb,
+		color_32_24_bgr,
+		color_32_32_alpha
+	}
+};
+
+static COLOR_KERNELS color_kernels;
+static INIT_ONCE color_kernels_once = INIT_ONCE_STATIC_INIT;
+
+const COLOR_KERNELS* freerdp_color_kernels_generic(void)
+{
+	return &color_kernels_generic;
+}
+
+static BOOL CALLBACK color_kernels_init(PINIT_ONCE once, PVOID param, PVOID* context)
+{
+	CopyMemory(&color_kernels, &color_kernels_generic, sizeof(COLOR_KERNELS));
+	COLOR_INIT_SIMD(&color_kernels);
+
+	return TRUE;
+}
+
+/**
+ * The kernel table is filled once per process: the generic kernels first,
+ * then whatever the SIMD module for this build replaces.
+ */
+const COLOR_KERNELS* freerdp_color_kernels_get(void)
+{
+	InitOnceExecuteOnce(&color_kernels_once, color_kernels_init, NULL, NULL);
+
+	return &color_kernels;
+}
+
+const char* freerdp_color_kernel_name(int kernel)
+{
+	if ((kernel < 0) || (kernel >= COLOR_KERNEL_COUNT))
+		return "unknown";
+
+	return color_kernel_names[kernel];
+}
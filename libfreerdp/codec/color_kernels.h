@@ -0,0 +1,79 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Color Conversion Kernels
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __COLOR_KERNELS_H
+#define __COLOR_KERNELS_H
+
+#include <freerdp/api.h>
+#include <freerdp/types.h>
+#include <freerdp/codec/color.h>
+
+/**
+ * Every kernel converts one run of pixels. The naming follows the layout
+ * of the destination: _RGB kernels put red in the high bits of the
+ * destination pixel (RGB15/RGB16/RGB32, or R,G,B byte order for 24bpp),
+ * _BGR kernels put blue there. 32bpp destinations additionally get the
+ * alpha bits from the parameter block or'ed in.
+ */
+enum FREERDP_COLOR_KERNEL
+{
+	COLOR_KERNEL_COPY_8,
+	COLOR_KERNEL_COPY_16,
+	COLOR_KERNEL_COPY_32,
+	COLOR_KERNEL_8_16,		/* palette lookup, table prepared by the caller */
+	COLOR_KERNEL_8_32,		/* palette lookup, table prepared by the caller */
+	COLOR_KERNEL_15_16_RGB,
+	COLOR_KERNEL_15_16_BGR,
+	COLOR_KERNEL_15_32_RGB,
+	COLOR_KERNEL_15_32_BGR,
+	COLOR_KERNEL_16_15_RGB,
+	COLOR_KERNEL_16_15_BGR,
+	COLOR_KERNEL_16_24_RGB,
+	COLOR_KERNEL_16_24_BGR,
+	COLOR_KERNEL_16_32_RGB,
+	COLOR_KERNEL_16_32_BGR,
+	COLOR_KERNEL_24_32,
+	COLOR_KERNEL_32_16_RGB,
+	COLOR_KERNEL_32_16_BGR,
+	COLOR_KERNEL_32_24_RGB,
+	COLOR_KERNEL_32_24_BGR,
+	COLOR_KERNEL_32_32_ALPHA,
+	COLOR_KERNEL_COUNT
+};
+
+struct _COLOR_KERNEL_PARAMS
+{
+	UINT32 alpha;			/* 0 or 0xFF000000, or'ed into 32bpp destination pixels */
+	UINT32 table[256];		/* palette, already in the destination format */
+};
+typedef struct _COLOR_KERNEL_PARAMS COLOR_KERNEL_PARAMS;
+
+typedef void (*p_color_kernel)(const BYTE* src, BYTE* dst, int count, const COLOR_KERNEL_PARAMS* params);
+
+struct _COLOR_KERNELS
+{
+	const char* name;
+	p_color_kernel kernels[COLOR_KERNEL_COUNT];
+};
+typedef struct _COLOR_KERNELS COLOR_KERNELS;
+
+FREERDP_API const COLOR_KERNELS* freerdp_color_kernels_generic(void);
+FREERDP_API const COLOR_KERNELS* freerdp_color_kernels_get(void);
+
+FREERDP_API const char* freerdp_color_kernel_name(int kernel);
+
+#endif /* __COLOR_KERNELS_H */
@@ -0,0 +1,258 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Color Conversion Kernels - NEON Optimizations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#if defined(__ARM_NEON__)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arm_neon.h>
+
+#include "color_kernels.h"
+#include "color_neon.h"
+
+#if ANDROID
+#include "cpu-features.h"
+#endif
+
+/* the scalar kernels finish whatever does not fill a whole vector */
+#define COLOR_TAIL(_kernel, _src, _dst, _count, _params) \
+	if (_count > 0) \
+		freerdp_color_kernels_generic()->kernels[_kernel](_src, _dst, _count, _params)
+
+/* 5 and 6 bit channels to 8 bits, replicating the high bits into the low ones */
+#define EXPAND_5(_v)	vmovn_u16(vorrq_u16(vshlq_n_u16(_v, 3), vshrq_n_u16(_v, 2)))
+#define EXPAND_6(_v)	vmovn_u16(vorrq_u16(vshlq_n_u16(_v, 2), vshrq_n_u16(_v, 4)))
+
+static void color_16_32_neon(const BYTE* src, BYTE* dst, int count, const COLOR_KERNEL_PARAMS* params, BOOL rgb)
+{
+	uint16x8_t p;
+	uint8x8_t lo, hi;
+	uint8x8x4_t bgra;
+	uint16x8_t mask5 = vdupq_n_u16(0x1F);
+	uint16x8_t mask6 = vdupq_n_u16(0x3F);
+
+	bgra.val[3] = vdup_n_u8(params->alpha >> 24);
+
+	for (; count >= 8; count -= 8)
+	{
+		p = vld1q_u16((const UINT16*) src);
+
+		lo = EXPAND_5(vandq_u16(p, mask5));
+		bgra.val[1] = EXPAND_6(vandq_u16(vshrq_n_u16(p, 5), mask6));
+		hi = EXPAND_5(vshrq_n_u16(p, 11));
+
+		bgra.val[0] = rgb ? hi : lo;
+		bgra.val[2] = rgb ? lo : hi;
+		vst4_u8(dst, bgra);
+
+		src += 16;
+		dst += 32;
+	}
+
+	COLOR_TAIL(rgb ? COLOR_KERNEL_16_32_RGB : COLOR_KERNEL_16_32_BGR, src, dst, count, params);
+}
+
+static void color_16_32_rgb_neon(const BYTE* src, BYTE* dst, int count, const COLOR_KERNEL_PARAMS* params)
+{
+	color_16_32_neon(src, dst, count, params, TRUE);
+}
+
+static void color_16_32_bgr_neon(const BYTE* src, BYTE* dst, int count, const COLOR_KERNEL_PARAMS* params)
+{
+	color_16_32_neon(src, dst, count, params, FALSE);
+}
+
+static void color_15_32_neon(const BYTE* src, BYTE* dst, int count, const COLOR_KERNEL_PARAMS* params, BOOL rgb)
+{
+	uint16x8_t p;
+	uint8x8_t lo, hi;
+	uint8x8x4_t bgra;
+	uint16x8_t mask5 = vdupq_n_u16(0x1F);
+
+	bgra.val[3] = vdup_n_u8(params->alpha >> 24);
+
+	for (; count >= 8; count -= 8)
+	{
+		p = vld1q_u16((const UINT16*) src);
+
+		lo = EXPAND_5(vandq_u16(p, mask5));
+		bgra.val[1] = EXPAND_5(vandq_u16(vshrq_n_u16(p, 5), mask5));
+		hi = EXPAND_5(vandq_u16(vshrq_n_u16(p, 10), mask5));
+
+		bgra.val[0] = rgb ? hi : lo;
+		bgra.val[2] = rgb ? lo : hi;
+		vst4_u8(dst, bgra);
+
+		src += 16;
+		dst += 32;
+	}
+
+	COLOR_TAIL(rgb ? COLOR_KERNEL_15_32_RGB : COLOR_KERNEL_15_32_BGR, src, dst, count, params);
+}
+
+static void color_15_32_rgb_neon(const BYTE* src, BYTE* dst, int count, const COLOR_KERNEL_PARAMS* params)
+{
+	color_15_32_neon(src, dst, count, params, TRUE);
+}
+
+static void color_15_32_bgr_neon(const BYTE* src, BYTE* dst, int count, const COLOR_KERNEL_PARAMS* params)
+{
+	color_15_32_neon(src, dst, count, params, FALSE);
+}
+
+static void color_24_32_neon(const BYTE* src, BYTE* dst, int count, const COLOR_KERNEL_PARAMS* params)
+{
+	uint8x8x3_t rgb;
+	uint8x8x4_t bgra;
+
+	bgra.val[3] = vdup_n_u8(0xFF);
+
+	for (; count >= 8; count -= 8)
+	{
+		rgb = vld3_u8(src);
+		bgra.val[0] = rgb.val[0];
+		bgra.val[1] = rgb.val[1];
+		bgra.val[2] = rgb.val[2];
+		vst4_u8(dst, bgra);
+
+		src += 24;
+		dst += 32;
+	}
+
+	COLOR_TAIL(COLOR_KERNEL_24_32, src, dst, count, params);
+}
+
+static void color_32_24_neon(const BYTE* src, BYTE* dst, int count, const COLOR_KERNEL_PARAMS* params, BOOL rgb)
+{
+	uint8x8x4_t bgra;
+	uint8x8x3_t out;
+
+	for (; count >= 8; count -= 8)
+	{
+		bgra = vld4_u8(src);
+		out.val[0] = rgb ? bgra.val[0] : bgra.val[2];
+		out.val[1] = bgra.val[1];
+		out.val[2] = rgb ? bgra.val[2] : bgra.val[0];
+		vst3_u8(dst, out);
+
+		src += 32;
+		dst += 24;
+	}
+
+	COLOR_TAIL(rgb ? COLOR_KERNEL_32_24_RGB : COLOR_KERNEL_32_24_BGR, src, dst, count, params);
+}
+
+static void color_32_24_rgb_neon(const BYTE* src, BYTE* dst, int count, const COLOR_KERNEL_PARAMS* params)
+{
+	color_32_24_neon(src, dst, count, params, TRUE);
+}
+
+static void color_32_24_bgr_neon(const BYTE* src, BYTE* dst, int count, const COLOR_KERNEL_PARAMS* params)
+{
+	color_32_24_neon(src, dst, count, params, FALSE);
+}
+
+static void color_32_16_neon(const BYTE* src, BYTE* dst, int count, const COLOR_KERNEL_PARAMS* params, BOOL rgb)
+{
+	uint16x8_t p;
+	uint8x8x4_t bgra;
+
+	for (; count >= 8; count -= 8)
+	{
+		bgra = vld4_u8(src);
+
+		/* top 5 bits of the first channel, then 6 of green, then 5 of the last */
+		p = vshll_n_u8(rgb ? bgra.val[2] : bgra.val[0], 8);
+		p = vsriq_n_u16(p, vshll_n_u8(bgra.val[1], 8), 5);
+		p = vsriq_n_u16(p, vshll_n_u8(rgb ? bgra.val[0] : bgra.val[2], 8), 11);
+		vst1q_u16((UINT16*) dst, p);
+
+		src += 32;
+		dst += 16;
+	}
+
+	COLOR_TAIL(rgb ? COLOR_KERNEL_32_16_RGB : COLOR_KERNEL_32_16_BGR, src, dst, count, params);
+}
+
+static void color_32_16_rgb_neon(const BYTE* src, BYTE* dst, int count, const COLOR_KERNEL_PARAMS* params)
+{
+	color_32_16_neon(src, dst, count, params, TRUE);
+}
+
+static void color_32_16_bgr_neon(const BYTE* src, BYTE* dst, int count, const COLOR_KERNEL_PARAMS* params)
+{
+	color_32_16_neon(src, dst, count, params, FALSE);
+}
+
+static void color_32_32_alpha_neon(const BYTE* src, BYTE* dst, int count, const COLOR_KERNEL_PARAMS* params)
+{
+	uint32x4_t alpha = vdupq_n_u32(0xFF000000);
+
+	for (; count >= 4; count -= 4)
+	{
+		vst1q_u32((UINT32*) dst, vorrq_u32(vld1q_u32((const UINT32*) src), alpha));
+		src += 16;
+		dst += 16;
+	}
+
+	COLOR_TAIL(COLOR_KERNEL_32_32_ALPHA, src, dst, count, params);
+}
+
+static BOOL color_neon_supported(void)
+{
+#if ANDROID
+	UINT64 features;
+
+	if (android_getCpuFamily() != ANDROID_CPU_FAMILY_ARM)
+		return FALSE;
+
+	features = android_getCpuFeatures();
+
+	if (!(features & ANDROID_CPU_ARM_FEATURE_ARMv7))
+		return FALSE;
+
+	return (features & ANDROID_CPU_ARM_FEATURE_NEON) ? TRUE : FALSE;
+#else
+	return TRUE;
+#endif
+}
+
+void color_init_neon(COLOR_KERNELS* kernels)
+{
+	if (!color_neon_supported())
+		return;
+
+	kernels->name = "neon";
+
+	kernels->kernels[COLOR_KERNEL_15_32_RGB] = color_15_32_rgb_neon;
+	kernels->kernels[COLOR_KERNEL_15_32_BGR] = color_15_32_bgr_neon;
+	kernels->kernels[COLOR_KERNEL_16_32_RGB] = color_16_32_rgb_neon;
+	kernels->kernels[COLOR_KERNEL_16_32_BGR] = color_16_32_bgr_neon;
+	kernels->kernels[COLOR_KERNEL_24_32] = color_24_32_neon;
+	kernels->kernels[COLOR_KERNEL_32_16_RGB] = color_32_16_rgb_neon;
+	kernels->kernels[COLOR_KERNEL_32_16_BGR] = color_32_16_bgr_neon;
+	kernels->kernels[COLOR_KERNEL_32_24_RGB] = color_32_24_rgb_neon;
+	kernels->kernels[COLOR_KERNEL_32_24_BGR] = color_32_24_bgr_neon;
+	kernels->kernels[COLOR_KERNEL_32_32_ALPHA] = color_32_32_alpha_neon;
+}
+
+#endif /* __ARM_NEON__ */
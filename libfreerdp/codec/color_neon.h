@@ -0,0 +1,35 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Color Conversion Kernels - NEON Optimizations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __COLOR_NEON_H
+#define __COLOR_NEON_H
+
+#include "color_kernels.h"
+
+#if defined(__ARM_NEON__)
+
+void color_init_neon(COLOR_KERNELS* kernels);
+
+#ifndef COLOR_INIT_SIMD
+ #if defined(WITH_NEON)
+  #define COLOR_INIT_SIMD(_kernels) color_init_neon(_kernels)
+ #endif
+#endif
+
+#endif /* __ARM_NEON__ */
+
+#endif /* __COLOR_NEON_H */
@@ -0,0 +1,307 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Color Conversion Kernels - SSE2 Optimizations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <xmmintrin.h>
+#include <emmintrin.h>
+
+#include "color_kernels.h"
+#include "color_sse2.h"
+
+#ifdef _MSC_VER
+#define __attribute__(...)
+#endif
+
+#define CACHE_LINE_BYTES	64
+
+/* the scalar kernels finish whatever does not fill a whole vector */
+#define COLOR_TAIL(_kernel, _src, _dst, _count, _params) \
+	if (_count > 0) \
+		freerdp_color_kernels_generic()->kernels[_kernel](_src, _dst, _count, _params)
+
+/* 5 and 6 bit channels to 8 bits, replicating the high bits into the low ones */
+#define EXPAND_5(_v)	_mm_or_si128(_mm_slli_epi16(_v, 3), _mm_srli_epi16(_v, 2))
+#define EXPAND_6(_v)	_mm_or_si128(_mm_slli_epi16(_v, 2), _mm_srli_epi16(_v, 4))
+
+/**
+ * Interleaves eight 16-bit lanes holding byte 0 (low) and byte 1 (high)
+ * with eight lanes holding byte 2 into eight 32bpp pixels.
+ */
+static __inline void __attribute__((__gnu_inline__, __always_inline__, __artificial__))
+color_store_32_sse2(BYTE* dst, __m128i b0, __m128i g, __m128i b2, __m128i alpha)
+{
+	__m128i lo;
+
+	lo = _mm_or_si128(b0, _mm_slli_epi16(g, 8));
+	_mm_storeu_si128((__m128i*) dst, _mm_or_si128(_mm_unpacklo_epi16(lo, b2), alpha));
+	_mm_storeu_si128((__m128i*) (dst + 16), _mm_or_si128(_mm_unpackhi_epi16(lo, b2), alpha));
+}
+
+static void color_16_32_sse2(const BYTE* src, BYTE* dst, int count, const COLOR_KERNEL_PARAMS* params, BOOL rgb)
+{
+	__m128i p;
+	__m128i lo, g, hi;
+	__m128i alpha = _mm_set1_epi32(params->alpha);
+	__m128i mask5 = _mm_set1_epi16(0x1F);
+	__m128i mask6 = _mm_set1_epi16(0x3F);
+
+	for (; count >= 8; count -= 8)
+	{
+		_mm_prefetch((char*) src + CACHE_LINE_BYTES * 2, _MM_HINT_NTA);
+		p = _mm_loadu_si128((__m128i*) src);
+
+		lo = _mm_and_si128(p, mask5);
+		lo = EXPAND_5(lo);
+		g = _mm_and_si128(_mm_srli_epi16(p, 5), mask6);
+		g = EXPAND_6(g);
+		hi = _mm_srli_epi16(p, 11);
+		hi = EXPAND_5(hi);
+
+		if (rgb)
+			color_store_32_sse2(dst, hi, g, lo, alpha);
+		else
+			color_store_32_sse2(dst, lo, g, hi, alpha);
+
+		src += 16;
+		dst += 32;
+	}
+
+	COLOR_TAIL(rgb ? COLOR_KERNEL_16_32_RGB : COLOR_KERNEL_16_32_BGR, src, dst, count, params);
+}
+
+static void color_16_32_rgb_sse2(const BYTE* src, BYTE* dst, int count, const COLOR_KERNEL_PARAMS* params)
+{
+	color_16_32_sse2(src, dst, count, params, TRUE);
+}
+
+static void color_16_32_bgr_sse2(const BYTE* src, BYTE* dst, int count, const COLOR_KERNEL_PARAMS* params)
+{
+	color_16_32_sse2(src, dst, count, params, FALSE);
+}
+
+static void color_15_32_sse2(const BYTE* src, BYTE* dst, int count, const COLOR_KERNEL_PARAMS* params, BOOL rgb)
+{
+	__m128i p;
+	__m128i lo, g, hi;
+	__m128i alpha = _mm_set1_epi32(params->alpha);
+	__m128i mask5 = _mm_set1_epi16(0x1F);
+
+	for (; count >= 8; count -= 8)
+	{
+		_mm_prefetch((char*) src + CACHE_LINE_BYTES * 2, _MM_HINT_NTA);
+		p = _mm_loadu_si128((__m128i*) src);
+
+		lo = _mm_and_si128(p, mask5);
+		lo = EXPAND_5(lo);
+		g = _mm_and_si128(_mm_srli_epi16(p, 5), mask5);
+		g = EXPAND_5(g);
+		hi = _mm_and_si128(_mm_srli_epi16(p, 10), mask5);
+		hi = EXPAND_5(hi);
+
+		if (rgb)
+			color_store_32_sse2(dst, hi, g, lo, alpha);
+		else
+			color_store_32_sse2(dst, lo, g, hi, alpha);
+
+		src += 16;
+		dst += 32;
+	}
+
+	COLOR_TAIL(rgb ? COLOR_KERNEL_15_32_RGB : COLOR_KERNEL_15_32_BGR, src, dst, count, params);
+}
+
+static void color_15_32_rgb_sse2(const BYTE* src, BYTE* dst, int count, const COLOR_KERNEL_PARAMS* params)
+{
+	color_15_32_sse2(src, dst, count, params, TRUE);
+}
+
+static void color_15_32_bgr_sse2(const BYTE* src, BYTE* dst, int count, const COLOR_KERNEL_PARAMS* params)
+{
+	color_15_32_sse2(src, dst, count, params, FALSE);
+}
+
+static void color_15_16_sse2(const BYTE* src, BYTE* dst, int count, const COLOR_KERNEL_PARAMS* params, BOOL rgb)
+{
+	__m128i p;
+	__m128i lo, g, hi;
+	__m128i mask5 = _mm_set1_epi16(0x1F);
+
+	for (; count >= 8; count -= 8)
+	{
+		p = _mm_loadu_si128((__m128i*) src);
+
+		lo = _mm_and_si128(p, mask5);
+		g = _mm_and_si128(_mm_srli_epi16(p, 5), mask5);
+		g = _mm_or_si128(_mm_slli_epi16(g, 1), _mm_srli_epi16(g, 4));
+		hi = _mm_and_si128(_mm_srli_epi16(p, 10), mask5);
+
+		if (rgb)
+			p = _mm_or_si128(_mm_or_si128(_mm_slli_epi16(hi, 11), _mm_slli_epi16(g, 5)), lo);
+		else
+			p = _mm_or_si128(_mm_or_si128(_mm_slli_epi16(lo, 11), _mm_slli_epi16(g, 5)), hi);
+
+		_mm_storeu_si128((__m128i*) dst, p);
+
+		src += 16;
+		dst += 16;
+	}
+
+	COLOR_TAIL(rgb ? COLOR_KERNEL_15_16_RGB : COLOR_KERNEL_15_16_BGR, src, dst, count, params);
+}
+
+static void color_15_16_rgb_sse2(const BYTE* src, BYTE* dst, int count, const COLOR_KERNEL_PARAMS* params)
+{
+	color_15_16_sse2(src, dst, count, params, TRUE);
+}
+
+static void color_15_16_bgr_sse2(const BYTE* src, BYTE* dst, int count, const COLOR_KERNEL_PARAMS* params)
+{
+	color_15_16_sse2(src, dst, count, params, FALSE);
+}
+
+static void color_16_15_sse2(const BYTE* src, BYTE* dst, int count, const COLOR_KERNEL_PARAMS* params, BOOL rgb)
+{
+	__m128i p;
+	__m128i lo, g, hi;
+	__m128i mask5 = _mm_set1_epi16(0x1F);
+	__m128i maskg = _mm_set1_epi16(0x03E0);
+
+	for (; count >= 8; count -= 8)
+	{
+		p = _mm_loadu_si128((__m128i*) src);
+
+		lo = _mm_and_si128(p, mask5);
+		g = _mm_and_si128(_mm_srli_epi16(p, 1), maskg);
+		hi = _mm_srli_epi16(p, 11);
+
+		if (rgb)
+			p = _mm_or_si128(_mm_or_si128(_mm_slli_epi16(hi, 10), g), lo);
+		else
+			p = _mm_or_si128(_mm_or_si128(_mm_slli_epi16(lo, 10), g), hi);
+
+		_mm_storeu_si128((__m128i*) dst, p);
+
+		src += 16;
+		dst += 16;
+	}
+
+	COLOR_TAIL(rgb ? COLOR_KERNEL_16_15_RGB : COLOR_KERNEL_16_15_BGR, src, dst, count, params);
+}
+
+static void color_16_15_rgb_sse2(const BYTE* src, BYTE* dst, int count, const COLOR_KERNEL_PARAMS* params)
+{
+	color_16_15_sse2(src, dst, count, params, TRUE);
+}
+
+static void color_16_15_bgr_sse2(const BYTE* src, BYTE* dst, int count, const COLOR_KERNEL_PARAMS* params)
+{
+	color_16_15_sse2(src, dst, count, params, FALSE);
+}
+
+static void color_32_16_sse2(const BYTE* src, BYTE* dst, int count, const COLOR_KERNEL_PARAMS* params, BOOL rgb)
+{
+	int i;
+	__m128i p[2];
+	__m128i r, g, b;
+	__m128i mask5 = _mm_set1_epi32(0x1F);
+	__m128i maskg = _mm_set1_epi32(0x07E0);
+	__m128i maskh = _mm_set1_epi32(0xF800);
+
+	for (; count >= 8; count -= 8)
+	{
+		_mm_prefetch((char*) src + CACHE_LINE_BYTES * 2, _MM_HINT_NTA);
+
+		for (i = 0; i < 2; i++)
+		{
+			p[i] = _mm_loadu_si128((__m128i*) (src + i * 16));
+			g = _mm_and_si128(_mm_srli_epi32(p[i], 5), maskg);
+
+			if (rgb)
+			{
+				r = _mm_and_si128(_mm_srli_epi32(p[i], 8), maskh);
+				b = _mm_and_si128(_mm_srli_epi32(p[i], 3), mask5);
+			}
+			else
+			{
+				r = _mm_and_si128(_mm_srli_epi32(p[i], 19), mask5);
+				b = _mm_and_si128(_mm_slli_epi32(p[i], 8), maskh);
+			}
+
+			p[i] = _mm_or_si128(_mm_or_si128(r, g), b);
+
+			/* sign extend so that the saturating pack keeps all 16 bits */
+			p[i] = _mm_srai_epi32(_mm_slli_epi32(p[i], 16), 16);
+		}
+
+		_mm_storeu_si128((__m128i*) dst, _mm_packs_epi32(p[0], p[1]));
+
+		src += 32;
+		dst += 16;
+	}
+
+	COLOR_TAIL(rgb ? COLOR_KERNEL_32_16_RGB : COLOR_KERNEL_32_16_BGR, src, dst, count, params);
+}
+
+static void color_32_16_rgb_sse2(const BYTE* src, BYTE* dst, int count, const COLOR_KERNEL_PARAMS* params)
+{
+	color_32_16_sse2(src, dst, count, params, TRUE);
+}
+
+static void color_32_16_bgr_sse2(const BYTE* src, BYTE* dst, int count, const COLOR_KERNEL_PARAMS* params)
+{
+	color_32_16_sse2(src, dst, count, params, FALSE);
+}
+
+static void color_32_32_alpha_sse2(const BYTE* src, BYTE* dst, int count, const COLOR_KERNEL_PARAMS* params)
+{
+	__m128i alpha = _mm_set1_epi32(0xFF000000);
+
+	for (; count >= 8; count -= 8)
+	{
+		_mm_prefetch((char*) src + CACHE_LINE_BYTES * 2, _MM_HINT_NTA);
+		_mm_storeu_si128((__m128i*) dst, _mm_or_si128(_mm_loadu_si128((__m128i*) src), alpha));
+		_mm_storeu_si128((__m128i*) (dst + 16), _mm_or_si128(_mm_loadu_si128((__m128i*) (src + 16)), alpha));
+		src += 32;
+		dst += 32;
+	}
+
+	COLOR_TAIL(COLOR_KERNEL_32_32_ALPHA, src, dst, count, params);
+}
+
+void color_init_sse2(COLOR_KERNELS* kernels)
+{
+	kernels->name = "sse2";
+
+	kernels->kernels[COLOR_KERNEL_15_16_RGB] = color_15_16_rgb_sse2;
+	kernels->kernels[COLOR_KERNEL_15_16_BGR] = color_15_16_bgr_sse2;
+	kernels->kernels[COLOR_KERNEL_15_32_RGB] = color_15_32_rgb_sse2;
+	kernels->kernels[COLOR_KERNEL_15_32_BGR] = color_15_32_bgr_sse2;
+	kernels->kernels[COLOR_KERNEL_16_15_RGB] = color_16_15_rgb_sse2;
+	kernels->kernels[COLOR_KERNEL_16_15_BGR] = color_16_15_bgr_sse2;
+	kernels->kernels[COLOR_KERNEL_16_32_RGB] = color_16_32_rgb_sse2;
+	kernels->kernels[COLOR_KERNEL_16_32_BGR] = color_16_32_bgr_sse2;
+	kernels->kernels[COLOR_KERNEL_32_16_RGB] = color_32_16_rgb_sse2;
+	kernels->kernels[COLOR_KERNEL_32_16_BGR] = color_32_16_bgr_sse2;
+	kernels->kernels[COLOR_KERNEL_32_32_ALPHA] = color_32_32_alpha_sse2;
+}
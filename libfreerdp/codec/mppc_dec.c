@@ -29,6 +29,7 @@
 #include <winpr/crt.h>
 
 #include <freerdp/codec/mppc_dec.h>
+#include <freerdp/utils/trace.h>
 
 static BYTE HuffLenLEC[] = {
 0x6, 0x6, 0x6, 0x7, 0x7, 0x7, 0x7, 0x7, 0x7, 0x7, 0x7, 0x8, 0x8, 0x8, 0x8, 0x8, 0x8, 0x8, 0x9, 0x8, 0x9, 0x9, 0x9, 0x9, 0x8, 0x8, 0x9, 0x9, 0x9, 0x9, 0x9, 0x9, 0x8, 0x9, 0x9, 0xa, 0x9, 0x9, 0x9, 0x9, 0x9, 0x9, 0x9, 0xa, 0x9, 0xa, 0xa, 0xa, 0x9, 0x9, 0xa, 0x9, 0xa, 0x9, 0xa, 0x9, 0x9, 0x9, 0xa, 0xa, 0x9, 0xa, 0x9, 0x9, 0x8, 0x9, 0x9, 0x9, 0x9, 0xa, 0xa, 0xa, 0x9, 0x9, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0x9, 0x9, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0x9, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0x8, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0x9, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0x9, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0x9, 0x7, 0x9, 0x9, 0xa, 0x9, 0xa, 0xa, 0xa, 0x9, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0x9, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0xd, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0xb, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0x9, 0xa, 0xa, 0xa, 0xa, 0xa, 0x9, 0xa, 0xa, 0xa, 0xa, 0xa, 0x9, 0xa, 0xa, 0xa, 0x9, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0x9, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0x9, 0xa, 0x8, 0x9, 0x9, 0xa, 0x9, 0xa, 0xa, 0xa, 0x9, 0xa, 0xa, 0xa, 0x9, 0x9, 0x8, 0x7, 0xd, 0xd, 0x7, 0x7, 0xa, 0x7, 0x7, 0x6, 0x6, 0x6, 0x6, 0x5, 0x6, 0x6, 0x6, 0x5, 0x6, 0x5, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x8, 0x5, 0x6, 0x7, 0x7 }; 
@@ -130,30 +131,38 @@ UINT32 transposebits(UINT32 x)
 
 int decompress_rdp(struct rdp_mppc_dec* dec, BYTE* cbuf, int len, int ctype, UINT32* roff, UINT32* rlen)
 {
+	int status;
+	UINT64 trace;
 	int type = ctype & 0x0f;
 
+	TRACE_BEGIN(trace);
+
 	switch (type)
 	{
 		case PACKET_COMPR_TYPE_8K:
-			return decompress_rdp_4(dec, cbuf, len, ctype, roff, rlen);
+			status = decompress_rdp_4(dec, cbuf, len, ctype, roff, rlen);
 			break;
 
 		case PACKET_COMPR_TYPE_64K:
-			return decompress_rdp_5(dec, cbuf, len, ctype, roff, rlen);
+			status = decompress_rdp_5(dec, cbuf, len, ctype, roff, rlen);
 			break;
 
 		case PACKET_COMPR_TYPE_RDP6:
-			return decompress_rdp_6(dec, cbuf, len, ctype, roff, rlen);
+			status = decompress_rdp_6(dec, cbuf, len, ctype, roff, rlen);
 			break;
 
 		case PACKET_COMPR_TYPE_RDP61:
-			return decompress_rdp_61(dec, cbuf, len, ctype, roff, rlen);
+			status = decompress_rdp_61(dec, cbuf, len, ctype, roff, rlen);
 			break;
 
 		default:
 			printf("mppc.c: invalid RDP compression code 0x%2.2x\n", type);
 			return FALSE;
 	}
+
+	TRACE_END(TRACE_DECOMPRESS, trace);
+
+	return status;
 }
 
 /**
@@ -30,6 +30,7 @@
 
 #include <freerdp/codec/mppc_dec.h>
 #include <freerdp/codec/mppc_enc.h>
+#include <freerdp/utils/trace.h>
 
 #define MPPC_ENC_DEBUG 0
 
@@ -517,21 +518,28 @@ void mppc_enc_free(struct rdp_mppc_enc* enc)
 
 BOOL compress_rdp(struct rdp_mppc_enc* enc, BYTE* srcData, int len)
 {
+	UINT64 trace;
+	BOOL status = FALSE;
+
 	if ((enc == NULL) || (srcData == NULL) || (len <= 0) || (len > enc->buf_len))
 		return FALSE;
 
+	TRACE_BEGIN(trace);
+
 	switch (enc->protocol_type)
 	{
 		case PROTO_RDP_40:
-			return compress_rdp_4(enc, srcData, len);
+			status = compress_rdp_4(enc, srcData, len);
 			break;
 
 		case PROTO_RDP_50:
-			return compress_rdp_5(enc, srcData, len);
+			status = compress_rdp_5(enc, srcData, len);
 			break;
 	}
 
-	return FALSE;
+	TRACE_END(TRACE_COMPRESS, trace);
+
+	return status;
 }
 
 /**
@@ -33,6 +33,7 @@
 #include <winpr/crt.h>
 
 #include <freerdp/codec/nsc.h>
+#include <freerdp/utils/trace.h>
 
 #include "nsc_types.h"
 #include "nsc_encode.h"
@@ -41,6 +42,10 @@
 #include "nsc_sse2.h"
 #endif
 
+#ifdef WITH_NEON
+#include "nsc_neon.h"
+#endif
+
 #ifndef NSC_INIT_SIMD
 #define NSC_INIT_SIMD(_nsc_context) do { } while (0)
 #endif
@@ -102,45 +107,79 @@ static void nsc_decode(NSC_CONTEXT* context)
 	}
 }
 
+/**
+ * Returns non-zero if any byte of the 32-bit word is zero.
+ */
+#define NSC_HAS_ZERO_BYTE(_w) (((_w) - 0x01010101) & ~(_w) & 0x80808080)
+
 static void nsc_rle_decode(BYTE* in, BYTE* out, UINT32 origsz)
 {
 	UINT32 len;
 	UINT32 left;
+	UINT32 literal;
+	UINT32 maxliteral;
+	UINT32 word;
 	BYTE value;
 
 	left = origsz;
+
 	while (left > 4)
 	{
-		value = *in++;
+		/**
+		 * A run is only encoded while more than 5 bytes are left, everything
+		 * before the next pair of equal bytes is a literal. Look for that pair
+		 * four bytes at a time by comparing each word with itself shifted by
+		 * one byte, then finish the scan byte by byte.
+		 */
+		maxliteral = left - 5;
+		literal = 0;
+
+		while (literal + 4 <= maxliteral)
+		{
+			word = *((UINT32*) &in[literal]) ^ *((UINT32*) &in[literal + 1]);
+
+			if (NSC_HAS_ZERO_BYTE(word))
+				break;
+
+			literal += 4;
+		}
+
+		while ((literal < maxliteral) && (in[literal] != in[literal + 1]))
+			literal++;
+
+		if (literal > 0)
+		{
+			memcpy(out, in, literal);
+			in += literal;
+			out += literal;
+			left -= literal;
+		}
 
 		if (left == 5)
 		{
-			*out++ = value;
+			*out++ = *in++;
 			left--;
+			break;
 		}
-		else if (value == *in)
+
+		value = *in;
+		in += 2;
+
+		if (*in < 0xFF)
 		{
-			in++;
-			if (*in < 0xFF)
-			{
-				len = (UINT32) *in++;
-				len += 2;
-			}
-			else
-			{
-				in++;
-				len = *((UINT32*) in);
-				in += 4;
-			}
-			memset(out, value, len);
-			out += len;
-			left -= len;
+			len = (UINT32) *in++;
+			len += 2;
 		}
 		else
 		{
-			*out++ = value;
-			left--;
+			in++;
+			len = *((UINT32*) in);
+			in += 4;
 		}
+
+		memset(out, value, len);
+		out += len;
+		left -= len;
 	}
 
 	*((UINT32*)out) = *((UINT32*)in);
@@ -244,7 +283,7 @@ void nsc_context_free(NSC_CONTEXT* context)
 {
 	int i;
 
-	for (i = 0; i < 4; i++)
+	for (i = 0; i < 5; i++)
 	{
 		if (context->priv->plane_buf[i])
 			free(context->priv->plane_buf[i]);
@@ -267,7 +306,10 @@ NSC_CONTEXT* nsc_context_new(void)
 	NSC_CONTEXT* nsc_context;
 
 	nsc_context = (NSC_CONTEXT*) malloc(sizeof(NSC_CONTEXT));
+	ZeroMemory(nsc_context, sizeof(NSC_CONTEXT));
+
 	nsc_context->priv = (NSC_CONTEXT_PRIV*) malloc(sizeof(NSC_CONTEXT_PRIV));
+	ZeroMemory(nsc_context->priv, sizeof(NSC_CONTEXT_PRIV));
 
 	nsc_context->decode = nsc_decode;
 	nsc_context->encode = nsc_encode;
@@ -323,6 +365,9 @@ void nsc_process_message(NSC_CONTEXT* context, UINT16 bpp,
 	UINT16 width, UINT16 height, BYTE* data, UINT32 length)
 {
 	STREAM* s;
+	UINT64 trace;
+
+	TRACE_BEGIN(trace);
 
 	s = stream_new(0);
 	stream_attach(s, data, length);
@@ -342,4 +387,6 @@ void nsc_process_message(NSC_CONTEXT* context, UINT16 bpp,
 	PROFILER_ENTER(context->priv->prof_nsc_decode);
 	context->decode(context);
 	PROFILER_EXIT(context->priv->prof_nsc_decode);
+
+	TRACE_END(TRACE_CODEC_DECODE, trace);
 }
@@ -29,6 +29,7 @@
 #endif
 
 #include <freerdp/codec/nsc.h>
+#include <freerdp/utils/trace.h>
 
 #include "nsc_types.h"
 #include "nsc_encode.h"
@@ -192,9 +193,13 @@ static void nsc_encode_argb_to_aycocg(NSC_CONTEXT* context, BYTE* bmpdata, int r
 	}
 	if (context->nsc_stream.ChromaSubSamplingLevel > 0 && (y % 2) == 1)
 	{
-		memcpy(yplane + rw, yplane, rw);
-		memcpy(coplane + rw, coplane, rw);
-		memcpy(cgplane + rw, cgplane, rw);
+		/* duplicate the last row into the padding row */
+		yplane = context->priv->plane_buf[0] + y * rw;
+		coplane = context->priv->plane_buf[1] + y * rw;
+		cgplane = context->priv->plane_buf[2] + y * rw;
+		memcpy(yplane, yplane - rw, rw);
+		memcpy(coplane, coplane - rw, rw);
+		memcpy(cgplane, cgplane - rw, rw);
 	}
 }
 
@@ -333,6 +338,9 @@ void nsc_compose_message(NSC_CONTEXT* context, STREAM* s,
 	BYTE* bmpdata, int width, int height, int rowstride)
 {
 	int i;
+	UINT64 trace;
+
+	TRACE_BEGIN(trace);
 
 	context->width = width;
 	context->height = height;
@@ -366,4 +374,6 @@ void nsc_compose_message(NSC_CONTEXT* context, STREAM* s,
 			stream_write(s, context->priv->plane_buf[i], context->nsc_stream.PlaneByteCount[i]);
 		}
 	}
+
+	TRACE_END(TRACE_ENCODE, trace);
 }
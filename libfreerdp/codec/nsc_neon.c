@@ -0,0 +1,166 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * NSCodec Library - NEON Optimizations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#if defined(__ARM_NEON__)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arm_neon.h>
+
+#include "nsc_types.h"
+#include "nsc_neon.h"
+
+#if ANDROID
+#include "cpu-features.h"
+#endif
+
+static void nsc_decode_neon(NSC_CONTEXT* context)
+{
+	UINT16 x;
+	UINT16 y;
+	UINT16 rw;
+	BYTE shift;
+	BYTE subsampling;
+	BYTE* yplane;
+	BYTE* coplane;
+	BYTE* cgplane;
+	BYTE* aplane;
+	BYTE* bmpdata;
+	INT16 y_s;
+	INT16 co_s;
+	INT16 cg_s;
+	int8x8_t shift_val;
+	uint8x8_t co_u8;
+	uint8x8_t cg_u8;
+	int16x8_t y_val;
+	int16x8_t co_val;
+	int16x8_t cg_val;
+	uint8x8x4_t bgra;
+
+	bmpdata = context->bmpdata;
+	rw = ROUND_UP_TO(context->width, 8);
+	shift = context->nsc_stream.ColorLossLevel - 1; /* colorloss recovery + YCoCg shift */
+	subsampling = context->nsc_stream.ChromaSubSamplingLevel;
+	shift_val = vdup_n_s8(shift);
+
+	for (y = 0; y < context->height; y++)
+	{
+		if (subsampling > 0)
+		{
+			yplane = context->priv->plane_buf[0] + y * rw; /* Y */
+			coplane = context->priv->plane_buf[1] + (y >> 1) * (rw >> 1); /* Co, supersampled */
+			cgplane = context->priv->plane_buf[2] + (y >> 1) * (rw >> 1); /* Cg, supersampled */
+		}
+		else
+		{
+			yplane = context->priv->plane_buf[0] + y * context->width; /* Y */
+			coplane = context->priv->plane_buf[1] + y * context->width; /* Co */
+			cgplane = context->priv->plane_buf[2] + y * context->width; /* Cg */
+		}
+		aplane = context->priv->plane_buf[3] + y * context->width; /* A */
+
+		for (x = 0; x + 8 <= context->width; x += 8)
+		{
+			if (subsampling > 0)
+			{
+				/**
+				 * duplicate the first four chroma samples horizontally, the
+				 * extra bytes loaded stay within the (oversized) plane buffer
+				 */
+				co_u8 = vld1_u8(coplane);
+				cg_u8 = vld1_u8(cgplane);
+				co_u8 = vzip_u8(co_u8, co_u8).val[0];
+				cg_u8 = vzip_u8(cg_u8, cg_u8).val[0];
+				coplane += 4;
+				cgplane += 4;
+			}
+			else
+			{
+				co_u8 = vld1_u8(coplane);
+				cg_u8 = vld1_u8(cgplane);
+				coplane += 8;
+				cgplane += 8;
+			}
+
+			/* the 8-bit shift truncates like the (INT8) cast of the scalar decoder */
+			co_val = vmovl_s8(vreinterpret_s8_u8(vshl_u8(co_u8, shift_val)));
+			cg_val = vmovl_s8(vreinterpret_s8_u8(vshl_u8(cg_u8, shift_val)));
+			y_val = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(yplane)));
+
+			bgra.val[0] = vqmovun_s16(vsubq_s16(vsubq_s16(y_val, co_val), cg_val));
+			bgra.val[1] = vqmovun_s16(vaddq_s16(y_val, cg_val));
+			bgra.val[2] = vqmovun_s16(vsubq_s16(vaddq_s16(y_val, co_val), cg_val));
+			bgra.val[3] = vld1_u8(aplane);
+			vst4_u8(bmpdata, bgra);
+
+			bmpdata += 32;
+			yplane += 8;
+			aplane += 8;
+		}
+
+		for (; x < context->width; x++)
+		{
+			y_s = (INT16) *yplane;
+			co_s = (INT16) (INT8) (*coplane << shift);
+			cg_s = (INT16) (INT8) (*cgplane << shift);
+			*bmpdata++ = MINMAX(y_s - co_s - cg_s, 0, 0xFF);
+			*bmpdata++ = MINMAX(y_s + cg_s, 0, 0xFF);
+			*bmpdata++ = MINMAX(y_s + co_s - cg_s, 0, 0xFF);
+			*bmpdata++ = *aplane;
+			yplane++;
+			coplane += (subsampling > 0 ? x % 2 : 1);
+			cgplane += (subsampling > 0 ? x % 2 : 1);
+			aplane++;
+		}
+	}
+}
+
+static BOOL nsc_neon_supported(void)
+{
+#if ANDROID
+	UINT64 features;
+
+	if (android_getCpuFamily() != ANDROID_CPU_FAMILY_ARM)
+		return FALSE;
+
+	features = android_getCpuFeatures();
+
+	if (!(features & ANDROID_CPU_ARM_FEATURE_ARMv7))
+		return FALSE;
+
+	return (features & ANDROID_CPU_ARM_FEATURE_NEON) ? TRUE : FALSE;
+#else
+	return TRUE;
+#endif
+}
+
+void nsc_init_neon(NSC_CONTEXT* context)
+{
+	if (!nsc_neon_supported())
+		return;
+
+	IF_PROFILER(context->priv->prof_nsc_decode->name = "nsc_decode_neon");
+
+	context->decode = nsc_decode_neon;
+}
+
+#endif /* __ARM_NEON__ */
@@ -275,9 +275,13 @@ static void nsc_encode_argb_to_aycocg_sse2(NSC_CONTEXT* context, BYTE* bmpdata,
 	}
 	if (context->nsc_stream.ChromaSubSamplingLevel > 0 && (y % 2) == 1)
 	{
-		memcpy(yplane + rw, yplane, rw);
-		memcpy(coplane + rw, coplane, rw);
-		memcpy(cgplane + rw, cgplane, rw);
+		/* duplicate the last row into the padding row */
+		yplane = context->priv->plane_buf[0] + y * rw;
+		coplane = context->priv->plane_buf[1] + y * rw;
+		cgplane = context->priv->plane_buf[2] + y * rw;
+		memcpy(yplane, yplane - rw, rw);
+		memcpy(coplane, coplane - rw, rw);
+		memcpy(cgplane, cgplane - rw, rw);
 	}
 }
 
@@ -342,9 +346,126 @@ static void nsc_encode_sse2(NSC_CONTEXT* context, BYTE* bmpdata, int rowstride)
 	}
 }
 
+static void nsc_decode_sse2(NSC_CONTEXT* context)
+{
+	UINT16 x;
+	UINT16 y;
+	UINT16 rw;
+	BYTE shift;
+	BYTE subsampling;
+	BYTE* yplane;
+	BYTE* coplane;
+	BYTE* cgplane;
+	BYTE* aplane;
+	BYTE* bmpdata;
+	INT16 y_s;
+	INT16 co_s;
+	INT16 cg_s;
+	__m128i y_val;
+	__m128i co_val;
+	__m128i cg_val;
+	__m128i r_val;
+	__m128i g_val;
+	__m128i b_val;
+	__m128i a_val;
+	__m128i bg_val;
+	__m128i ra_val;
+	__m128i shift_val;
+	__m128i zero = _mm_setzero_si128();
+
+	bmpdata = context->bmpdata;
+	rw = ROUND_UP_TO(context->width, 8);
+	shift = context->nsc_stream.ColorLossLevel - 1; /* colorloss recovery + YCoCg shift */
+	subsampling = context->nsc_stream.ChromaSubSamplingLevel;
+
+	/**
+	 * Chroma bytes are moved into the high byte of each 16-bit lane so that
+	 * the colorloss shift truncates exactly like the (INT8) cast in the
+	 * scalar decoder, and an arithmetic shift brings them back sign-extended.
+	 */
+	shift_val = _mm_cvtsi32_si128(shift);
+
+	for (y = 0; y < context->height; y++)
+	{
+		if (subsampling > 0)
+		{
+			yplane = context->priv->plane_buf[0] + y * rw; /* Y */
+			coplane = context->priv->plane_buf[1] + (y >> 1) * (rw >> 1); /* Co, supersampled */
+			cgplane = context->priv->plane_buf[2] + (y >> 1) * (rw >> 1); /* Cg, supersampled */
+		}
+		else
+		{
+			yplane = context->priv->plane_buf[0] + y * context->width; /* Y */
+			coplane = context->priv->plane_buf[1] + y * context->width; /* Co */
+			cgplane = context->priv->plane_buf[2] + y * context->width; /* Cg */
+		}
+		aplane = context->priv->plane_buf[3] + y * context->width; /* A */
+
+		for (x = 0; x + 8 <= context->width; x += 8)
+		{
+			y_val = _mm_unpacklo_epi8(_mm_loadl_epi64((__m128i*) yplane), zero);
+			a_val = _mm_loadl_epi64((__m128i*) aplane);
+
+			if (subsampling > 0)
+			{
+				co_val = _mm_cvtsi32_si128(*((UINT32*) coplane));
+				cg_val = _mm_cvtsi32_si128(*((UINT32*) cgplane));
+				co_val = _mm_unpacklo_epi8(co_val, co_val);
+				cg_val = _mm_unpacklo_epi8(cg_val, cg_val);
+				coplane += 4;
+				cgplane += 4;
+			}
+			else
+			{
+				co_val = _mm_loadl_epi64((__m128i*) coplane);
+				cg_val = _mm_loadl_epi64((__m128i*) cgplane);
+				coplane += 8;
+				cgplane += 8;
+			}
+
+			co_val = _mm_srai_epi16(_mm_sll_epi16(_mm_unpacklo_epi8(zero, co_val), shift_val), 8);
+			cg_val = _mm_srai_epi16(_mm_sll_epi16(_mm_unpacklo_epi8(zero, cg_val), shift_val), 8);
+
+			r_val = _mm_sub_epi16(_mm_add_epi16(y_val, co_val), cg_val);
+			g_val = _mm_add_epi16(y_val, cg_val);
+			b_val = _mm_sub_epi16(_mm_sub_epi16(y_val, co_val), cg_val);
+
+			r_val = _mm_packus_epi16(r_val, r_val);
+			g_val = _mm_packus_epi16(g_val, g_val);
+			b_val = _mm_packus_epi16(b_val, b_val);
+
+			bg_val = _mm_unpacklo_epi8(b_val, g_val);
+			ra_val = _mm_unpacklo_epi8(r_val, a_val);
+			_mm_storeu_si128((__m128i*) bmpdata, _mm_unpacklo_epi16(bg_val, ra_val));
+			_mm_storeu_si128((__m128i*) (bmpdata + 16), _mm_unpackhi_epi16(bg_val, ra_val));
+
+			bmpdata += 32;
+			yplane += 8;
+			aplane += 8;
+		}
+
+		for (; x < context->width; x++)
+		{
+			y_s = (INT16) *yplane;
+			co_s = (INT16) (INT8) (*coplane << shift);
+			cg_s = (INT16) (INT8) (*cgplane << shift);
+			*bmpdata++ = MINMAX(y_s - co_s - cg_s, 0, 0xFF);
+			*bmpdata++ = MINMAX(y_s + cg_s, 0, 0xFF);
+			*bmpdata++ = MINMAX(y_s + co_s - cg_s, 0, 0xFF);
+			*bmpdata++ = *aplane;
+			yplane++;
+			coplane += (subsampling > 0 ? x % 2 : 1);
+			cgplane += (subsampling > 0 ? x % 2 : 1);
+			aplane++;
+		}
+	}
+}
+
 void nsc_init_sse2(NSC_CONTEXT* context)
 {
 	IF_PROFILER(context->priv->prof_nsc_encode->name = "nsc_encode_sse2");
+	IF_PROFILER(context->priv->prof_nsc_decode->name = "nsc_decode_sse2");
 
 	context->encode = nsc_encode_sse2;
+	context->decode = nsc_decode_sse2;
 }
@@ -33,6 +33,7 @@
 
 #include <freerdp/codec/rfx.h>
 #include <freerdp/constants.h>
+#include <freerdp/utils/trace.h>
 
 #include "rfx_constants.h"
 #include "rfx_types.h"
@@ -386,7 +387,93 @@ static void rfx_process_message_region(RFX_CONTEXT* context, RFX_MESSAGE* messag
 	}
 }
 
-static void rfx_process_message_tile(RFX_CONTEXT* context, RFX_TILE* tile, STREAM* s)
+/**
+ * Intersects the rectangle given by its edges with another one given by
+ * position and size. Returns FALSE when nothing is left.
+ */
+static BOOL rfx_clip_rect(int* left, int* top, int* right, int* bottom, int x, int y, int width, int height)
+{
+	if (*left < x)
+		*left = x;
+	if (*top < y)
+		*top = y;
+	if (*right > x + width)
+		*right = x + width;
+	if (*bottom > y + height)
+		*bottom = y + height;
+
+	return (*left < *right) && (*top < *bottom);
+}
+
+static void rfx_write_tile_rect(RFX_CONTEXT* context, RFX_SURFACE* surface,
+	int tile_left, int tile_top, int left, int top, int right, int bottom)
+{
+	BYTE* dst;
+	int bpp;
+
+	bpp = (surface->pixel_format == RDP_PIXEL_FORMAT_B8G8R8 ||
+		surface->pixel_format == RDP_PIXEL_FORMAT_R8G8B8) ? 3 : 4;
+
+	dst = surface->data + top * surface->stride + left * bpp;
+
+	rfx_decode_format_rgb_rect(context, surface->pixel_format,
+		left - tile_left, top - tile_top, right - left, bottom - top, dst, surface->stride);
+}
+
+/**
+ * Writes the last decoded tile to the surface, restricted to the parts
+ * covered by the message region, the surface and the caller's clip rects.
+ */
+static void rfx_write_tile(RFX_CONTEXT* context, RFX_MESSAGE* message, RFX_TILE* tile, RFX_SURFACE* surface)
+{
+	int i, j;
+	int tile_left;
+	int tile_top;
+	int left, top, right, bottom;
+	int clip_left, clip_top, clip_right, clip_bottom;
+
+	tile_left = surface->left + tile->x;
+	tile_top = surface->top + tile->y;
+
+	for (i = 0; i < message->num_rects; i++)
+	{
+		left = surface->left + message->rects[i].x;
+		top = surface->top + message->rects[i].y;
+		right = left + message->rects[i].width;
+		bottom = top + message->rects[i].height;
+
+		if (!rfx_clip_rect(&left, &top, &right, &bottom, tile_left, tile_top, 64, 64))
+			continue;
+
+		if (!rfx_clip_rect(&left, &top, &right, &bottom, 0, 0, surface->width, surface->height))
+			continue;
+
+		if (surface->num_clip_rects < 1)
+		{
+			rfx_write_tile_rect(context, surface, tile_left, tile_top, left, top, right, bottom);
+			continue;
+		}
+
+		for (j = 0; j < surface->num_clip_rects; j++)
+		{
+			clip_left = left;
+			clip_top = top;
+			clip_right = right;
+			clip_bottom = bottom;
+
+			if (rfx_clip_rect(&clip_left, &clip_top, &clip_right, &clip_bottom,
+				surface->clip_rects[j].x, surface->clip_rects[j].y,
+				surface->clip_rects[j].width, surface->clip_rects[j].height))
+			{
+				rfx_write_tile_rect(context, surface, tile_left, tile_top,
+					clip_left, clip_top, clip_right, clip_bottom);
+			}
+		}
+	}
+}
+
+static void rfx_process_message_tile(RFX_CONTEXT* context, RFX_MESSAGE* message, RFX_TILE* tile,
+	STREAM* s, RFX_SURFACE* surface)
 {
 	BYTE quantIdxY;
 	BYTE quantIdxCb;
@@ -410,14 +497,29 @@ static void rfx_process_message_tile(RFX_CONTEXT* context, RFX_TILE* tile, STREA
 	tile->x = xIdx * 64;
 	tile->y = yIdx * 64;
 
-	rfx_decode_rgb(context, s,
+	if (surface == NULL)
+	{
+		rfx_decode_rgb(context, s,
+			YLen, context->quants + (quantIdxY * 10),
+			CbLen, context->quants + (quantIdxCb * 10),
+			CrLen, context->quants + (quantIdxCr * 10),
+			tile->data);
+		return;
+	}
+
+	PROFILER_ENTER(context->priv->prof_rfx_decode_rgb);
+
+	rfx_decode_planes(context, s,
 		YLen, context->quants + (quantIdxY * 10),
 		CbLen, context->quants + (quantIdxCb * 10),
-		CrLen, context->quants + (quantIdxCr * 10),
-		tile->data);
+		CrLen, context->quants + (quantIdxCr * 10));
+
+	rfx_write_tile(context, message, tile, surface);
+
+	PROFILER_EXIT(context->priv->prof_rfx_decode_rgb);
 }
 
-static void rfx_process_message_tileset(RFX_CONTEXT* context, RFX_MESSAGE* message, STREAM* s)
+static void rfx_process_message_tileset(RFX_CONTEXT* context, RFX_MESSAGE* message, STREAM* s, RFX_SURFACE* surface)
 {
 	int i;
 	UINT16 subtype;
@@ -509,20 +611,28 @@ static void rfx_process_message_tileset(RFX_CONTEXT* context, RFX_MESSAGE* messa
 			break;
 		}
 
-		rfx_process_message_tile(context, message->tiles[i], s);
+		rfx_process_message_tile(context, message, message->tiles[i], s, surface);
 
 		stream_set_pos(s, pos);
 	}
 }
 
-RFX_MESSAGE* rfx_process_message(RFX_CONTEXT* context, BYTE* data, UINT32 length)
+/**
+ * Decodes a message. Without a surface every tile is decoded into its
+ * RFX_TILE data; with one, tiles are written straight into the surface and
+ * the returned message only carries the region and the tile positions.
+ */
+RFX_MESSAGE* rfx_process_message_surface(RFX_CONTEXT* context, BYTE* data, UINT32 length, RFX_SURFACE* surface)
 {
 	int pos;
 	STREAM* s;
 	UINT32 blockLen;
 	UINT32 blockType;
+	UINT64 trace;
 	RFX_MESSAGE* message;
 
+	TRACE_BEGIN(trace);
+
 	message = (RFX_MESSAGE*) malloc(sizeof(RFX_MESSAGE));
 	ZeroMemory(message, sizeof(RFX_MESSAGE));
 
@@ -584,7 +694,7 @@ RFX_MESSAGE* rfx_process_message(RFX_CONTEXT* context, BYTE* data, UINT32 length
 				break;
 
 			case WBT_EXTENSION:
-				rfx_process_message_tileset(context, message, s);
+				rfx_process_message_tileset(context, message, s, surface);
 				break;
 
 			default:
@@ -598,9 +708,16 @@ RFX_MESSAGE* rfx_process_message(RFX_CONTEXT* context, BYTE* data, UINT32 length
 	stream_detach(s);
 	stream_free(s);
 
+	TRACE_END(TRACE_CODEC_DECODE, trace);
+
 	return message;
 }
 
+RFX_MESSAGE* rfx_process_message(RFX_CONTEXT* context, BYTE* data, UINT32 length)
+{
+	return rfx_process_message_surface(context, data, length, NULL);
+}
+
 UINT16 rfx_message_get_tile_count(RFX_MESSAGE* message)
 {
 	return message->num_tiles;
@@ -789,10 +906,59 @@ static void rfx_compose_message_tile(RFX_CONTEXT* context, STREAM* s,
 	stream_set_pos(s, end_pos);
 }
 
+/**
+ * Mark the tiles of the image that intersect at least one of the rects.
+ * Rects are in image coordinates and may start anywhere in the image.
+ * @return number of marked tiles
+ */
+
+static int rfx_compose_message_tile_mask(BYTE* mask, int numTilesX, int numTilesY,
+	const RFX_RECT* rects, int num_rects, int width, int height)
+{
+	int i;
+	int count = 0;
+	int xIdx, yIdx;
+	int left, top, right, bottom;
+
+	if (num_rects < 1)
+	{
+		FillMemory(mask, numTilesX * numTilesY, 1);
+		return numTilesX * numTilesY;
+	}
+
+	ZeroMemory(mask, numTilesX * numTilesY);
+
+	for (i = 0; i < num_rects; i++)
+	{
+		left = rects[i].x;
+		top = rects[i].y;
+		right = MIN(rects[i].x + rects[i].width, width);
+		bottom = MIN(rects[i].y + rects[i].height, height);
+
+		if ((left >= right) || (top >= bottom))
+			continue;
+
+		for (yIdx = top / 64; yIdx <= (bottom - 1) / 64; yIdx++)
+		{
+			for (xIdx = left / 64; xIdx <= (right - 1) / 64; xIdx++)
+			{
+				if (!mask[yIdx * numTilesX + xIdx])
+				{
+					mask[yIdx * numTilesX + xIdx] = 1;
+					count++;
+				}
+			}
+		}
+	}
+
+	return count;
+}
+
 static void rfx_compose_message_tileset(RFX_CONTEXT* context, STREAM* s,
-	BYTE* image_data, int width, int height, int rowstride)
+	const RFX_RECT* rects, int num_rects, BYTE* image_data, int width, int height, int rowstride)
 {
 	int size;
+	BYTE* mask;
 	int start_pos, end_pos;
 	int i;
 	int numQuants;
@@ -827,7 +993,10 @@ static void rfx_compose_message_tileset(RFX_CONTEXT* context, STREAM* s,
 
 	numTilesX = (width + 63) / 64;
 	numTilesY = (height + 63) / 64;
-	numTiles = numTilesX * numTilesY;
+
+	/* only the tiles covered by the region are sent */
+	mask = (BYTE*) malloc(numTilesX * numTilesY);
+	numTiles = rfx_compose_message_tile_mask(mask, numTilesX, numTilesY, rects, num_rects, width, height);
 
 	size = 22 + numQuants * 5;
 	stream_check_size(s, size);
@@ -859,6 +1028,9 @@ static void rfx_compose_message_tileset(RFX_CONTEXT* context, STREAM* s,
 	{
 		for (xIdx = 0; xIdx < numTilesX; xIdx++)
 		{
+			if (!mask[yIdx * numTilesX + xIdx])
+				continue;
+
 			rfx_compose_message_tile(context, s,
 				image_data + yIdx * 64 * rowstride + xIdx * 8 * context->bits_per_pixel,
 				(xIdx < numTilesX - 1) ? 64 : width - xIdx * 64,
@@ -866,6 +1038,8 @@ static void rfx_compose_message_tileset(RFX_CONTEXT* context, STREAM* s,
 				rowstride, quantVals, quantIdxY, quantIdxCb, quantIdxCr, xIdx, yIdx);
 		}
 	}
+	free(mask);
+
 	tilesDataSize = stream_get_pos(s) - end_pos;
 	size += tilesDataSize;
 	end_pos = stream_get_pos(s);
@@ -893,17 +1067,30 @@ static void rfx_compose_message_data(RFX_CONTEXT* context, STREAM* s,
 {
 	rfx_compose_message_frame_begin(context, s);
 	rfx_compose_message_region(context, s, rects, num_rects);
-	rfx_compose_message_tileset(context, s, image_data, width, height, rowstride);
+	rfx_compose_message_tileset(context, s, rects, num_rects, image_data, width, height, rowstride);
 	rfx_compose_message_frame_end(context, s);
 }
 
+/**
+ * Encode the parts of an image covered by rects as one RemoteFX frame.
+ * The rects are relative to image_data and may be offset into it; only
+ * the 64x64 tiles they intersect are encoded. Tiles stay aligned to the
+ * image origin, which becomes the destination of the surface command.
+ */
+
 FREERDP_API void rfx_compose_message(RFX_CONTEXT* context, STREAM* s,
 	const RFX_RECT* rects, int num_rects, BYTE* image_data, int width, int height, int rowstride)
 {
+	UINT64 trace;
+
+	TRACE_BEGIN(trace);
+
 	/* Only the first frame should send the RemoteFX header */
 	if (context->frame_idx == 0 && !context->header_processed)
 		rfx_compose_message_header(context, s);
 
 	rfx_compose_message_data(context, s, rects, num_rects, image_data, width, height, rowstride);
+
+	TRACE_END(TRACE_ENCODE, trace);
 }
 
@@ -37,7 +37,7 @@
 #include "rfx_decode.h"
 
 static void rfx_decode_format_rgb(INT16* r_buf, INT16* g_buf, INT16* b_buf,
-	RDP_PIXEL_FORMAT pixel_format, BYTE* dst_buf)
+	RDP_PIXEL_FORMAT pixel_format, BYTE* dst_buf, int count)
 {
 	INT16* r = r_buf;
 	INT16* g = g_buf;
@@ -48,7 +48,7 @@ static void rfx_decode_format_rgb(INT16* r_buf, INT16* g_buf, INT16* b_buf,
 	switch (pixel_format)
 	{
 		case RDP_PIXEL_FORMAT_B8G8R8A8:
-			for (i = 0; i < 4096; i++)
+			for (i = 0; i < count; i++)
 			{
 				*dst++ = (BYTE) (*b++);
 				*dst++ = (BYTE) (*g++);
@@ -57,7 +57,7 @@ static void rfx_decode_format_rgb(INT16* r_buf, INT16* g_buf, INT16* b_buf,
 			}
 			break;
 		case RDP_PIXEL_FORMAT_R8G8B8A8:
-			for (i = 0; i < 4096; i++)
+			for (i = 0; i < count; i++)
 			{
 				*dst++ = (BYTE) (*r++);
 				*dst++ = (BYTE) (*g++);
@@ -66,7 +66,7 @@ static void rfx_decode_format_rgb(INT16* r_buf, INT16* g_buf, INT16* b_buf,
 			}
 			break;
 		case RDP_PIXEL_FORMAT_B8G8R8:
-			for (i = 0; i < 4096; i++)
+			for (i = 0; i < count; i++)
 			{
 				*dst++ = (BYTE) (*b++);
 				*dst++ = (BYTE) (*g++);
@@ -74,7 +74,7 @@ static void rfx_decode_format_rgb(INT16* r_buf, INT16* g_buf, INT16* b_buf,
 			}
 			break;
 		case RDP_PIXEL_FORMAT_R8G8B8:
-			for (i = 0; i < 4096; i++)
+			for (i = 0; i < count; i++)
 			{
 				*dst++ = (BYTE) (*r++);
 				*dst++ = (BYTE) (*g++);
@@ -173,13 +173,11 @@ static void rfx_decode_component(RFX_CONTEXT* context, const UINT32* quantizatio
 	PROFILER_EXIT(context->priv->prof_rfx_decode_component);
 }
 
-void rfx_decode_rgb(RFX_CONTEXT* context, STREAM* data_in,
+void rfx_decode_planes(RFX_CONTEXT* context, STREAM* data_in,
 	int y_size, const UINT32 * y_quants,
 	int cb_size, const UINT32 * cb_quants,
-	int cr_size, const UINT32 * cr_quants, BYTE* rgb_buffer)
+	int cr_size, const UINT32 * cr_quants)
 {
-	PROFILER_ENTER(context->priv->prof_rfx_decode_rgb);
-
 	rfx_decode_component(context, y_quants, stream_get_tail(data_in), y_size, context->priv->y_r_buffer); /* YData */
 	stream_seek(data_in, y_size);
 	rfx_decode_component(context, cb_quants, stream_get_tail(data_in), cb_size, context->priv->cb_g_buffer); /* CbData */
@@ -190,10 +188,46 @@ void rfx_decode_rgb(RFX_CONTEXT* context, STREAM* data_in,
 	PROFILER_ENTER(context->priv->prof_rfx_decode_ycbcr_to_rgb);
 		context->decode_ycbcr_to_rgb(context->priv->y_r_buffer, context->priv->cb_g_buffer, context->priv->cr_b_buffer);
 	PROFILER_EXIT(context->priv->prof_rfx_decode_ycbcr_to_rgb);
+}
+
+/**
+ * Writes the width x height block at (x, y) of the last tile decoded by
+ * rfx_decode_planes() to dst_buf, which points to the destination of the
+ * block's first pixel.
+ */
+void rfx_decode_format_rgb_rect(RFX_CONTEXT* context, RDP_PIXEL_FORMAT pixel_format,
+	int x, int y, int width, int height, BYTE* dst_buf, int dst_stride)
+{
+	int i;
+	int offset;
+
+	PROFILER_ENTER(context->priv->prof_rfx_decode_format_rgb);
+
+	for (i = 0; i < height; i++)
+	{
+		offset = (y + i) * 64 + x;
+
+		rfx_decode_format_rgb(context->priv->y_r_buffer + offset, context->priv->cb_g_buffer + offset,
+			context->priv->cr_b_buffer + offset, pixel_format, dst_buf, width);
+
+		dst_buf += dst_stride;
+	}
+
+	PROFILER_EXIT(context->priv->prof_rfx_decode_format_rgb);
+}
+
+void rfx_decode_rgb(RFX_CONTEXT* context, STREAM* data_in,
+	int y_size, const UINT32 * y_quants,
+	int cb_size, const UINT32 * cb_quants,
+	int cr_size, const UINT32 * cr_quants, BYTE* rgb_buffer)
+{
+	PROFILER_ENTER(context->priv->prof_rfx_decode_rgb);
+
+	rfx_decode_planes(context, data_in, y_size, y_quants, cb_size, cb_quants, cr_size, cr_quants);
 
 	PROFILER_ENTER(context->priv->prof_rfx_decode_format_rgb);
 		rfx_decode_format_rgb(context->priv->y_r_buffer, context->priv->cb_g_buffer, context->priv->cr_b_buffer,
-			context->pixel_format, rgb_buffer);
+			context->pixel_format, rgb_buffer, 4096);
 	PROFILER_EXIT(context->priv->prof_rfx_decode_format_rgb);
 	
 	PROFILER_EXIT(context->priv->prof_rfx_decode_rgb);
@@ -24,6 +24,13 @@
 
 void rfx_decode_ycbcr_to_rgb(INT16* y_r_buf, INT16* cb_g_buf, INT16* cr_b_buf);
 
+void rfx_decode_planes(RFX_CONTEXT* context, STREAM* data_in,
+	int y_size, const UINT32 * y_quants,
+	int cb_size, const UINT32 * cb_quants,
+	int cr_size, const UINT32 * cr_quants);
+void rfx_decode_format_rgb_rect(RFX_CONTEXT* context, RDP_PIXEL_FORMAT pixel_format,
+	int x, int y, int width, int height, BYTE* dst_buf, int dst_stride);
+
 void rfx_decode_rgb(RFX_CONTEXT* context, STREAM* data_in,
 	int y_size, const UINT32 * y_quants,
 	int cb_size, const UINT32 * cb_quants,
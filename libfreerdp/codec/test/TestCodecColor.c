@@ -0,0 +1,300 @@
+
+#include <stdio.h>
+#include <winpr/crt.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/codec/color.h>
+#include <freerdp/utils/stopwatch.h>
+
+#include "color_kernels.h"
+
+#define TEST_MAX_PIXELS		4096
+#define BENCH_PIXELS		(256 * 256)
+#define BENCH_ROUNDS		64
+
+static UINT32 test_seed = 0x12345678;
+
+static BYTE test_random_byte(void)
+{
+	test_seed = test_seed * 1103515245 + 12345;
+	return (BYTE) (test_seed >> 16);
+}
+
+static void test_fill_random(BYTE* data, int size)
+{
+	int i;
+
+	for (i = 0; i < size; i++)
+		data[i] = test_random_byte();
+}
+
+/**
+ * Every kernel of the table in use (SIMD if available) must produce
+ * exactly what the generic kernel produces, for run lengths that do and
+ * do not fill whole vectors and for misaligned buffers.
+ */
+static int test_color_kernels_match(void)
+{
+	int i, k;
+	int count;
+	int offset;
+	BYTE* src;
+	BYTE* dst1;
+	BYTE* dst2;
+	COLOR_KERNEL_PARAMS params;
+	const COLOR_KERNELS* generic = freerdp_color_kernels_generic();
+	const COLOR_KERNELS* kernels = freerdp_color_kernels_get();
+	int counts[] = { 1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 33, 63, 64, 65, 1000, TEST_MAX_PIXELS };
+
+	src = (BYTE*) malloc(TEST_MAX_PIXELS * 4 + 16);
+	dst1 = (BYTE*) malloc(TEST_MAX_PIXELS * 4 + 16);
+	dst2 = (BYTE*) malloc(TEST_MAX_PIXELS * 4 + 16);
+
+	test_fill_random(src, TEST_MAX_PIXELS * 4 + 16);
+	test_fill_random((BYTE*) params.table, sizeof(params.table));
+
+	for (k = 0; k < COLOR_KERNEL_COUNT; k++)
+	{
+		for (i = 0; i < sizeof(counts) / sizeof(counts[0]); i++)
+		{
+			for (offset = 0; offset <= 4; offset += 4)
+			{
+				count = counts[i];
+				params.alpha = (i & 1) ? 0xFF000000 : 0;
+
+				ZeroMemory(dst1, TEST_MAX_PIXELS * 4 + 16);
+				ZeroMemory(dst2, TEST_MAX_PIXELS * 4 + 16);
+
+				generic->kernels[k](src + offset, dst1 + offset, count, &params);
+				kernels->kernels[k](src + offset, dst2 + offset, count, &params);
+
+				if (memcmp(dst1, dst2, TEST_MAX_PIXELS * 4 + 16) != 0)
+				{
+					printf("color kernel %s (%s) differs from generic, count: %d offset: %d\n",
+						freerdp_color_kernel_name(k), kernels->name, count, offset);
+					return -1;
+				}
+			}
+		}
+	}
+
+	free(src);
+	free(dst1);
+	free(dst2);
+
+	return 0;
+}
+
+static int test_color_pixel(BYTE* src, int srcBpp, int dstBpp, int flags, HCLRCONV clrconv, UINT32 expected)
+{
+	UINT32 dst = 0;
+
+	clrconv->alpha = (flags & CLRCONV_ALPHA) ? 1 : 0;
+	clrconv->invert = (flags & CLRCONV_INVERT) ? 1 : 0;
+	clrconv->rgb555 = (flags & CLRCONV_RGB555) ? 1 : 0;
+
+	freerdp_image_convert(src, (BYTE*) &dst, 1, 1, srcBpp, dstBpp, clrconv);
+
+	if (dst != expected)
+	{
+		printf("%d -> %d bpp (flags 0x%X): expected 0x%08X, got 0x%08X\n",
+			srcBpp, dstBpp, flags, expected, dst);
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Spot checks of known pixel values, independent of the kernel code.
+ */
+static int test_color_pixels(void)
+{
+	int status = 0;
+	HCLRCONV clrconv;
+	PALETTE_ENTRY entries[256];
+	BYTE p8[1] = { 0x05 };
+	BYTE p16_red[2] = { 0x00, 0xF8 };
+	BYTE p16_green[2] = { 0xE0, 0x07 };
+	BYTE p15_red[2] = { 0x00, 0x7C };
+	BYTE p24[3] = { 0x11, 0x22, 0x33 };
+	BYTE p32[4] = { 0x33, 0x22, 0x11, 0x00 };
+	BYTE p32_red[4] = { 0x00, 0x00, 0xFF, 0x00 };
+
+	ZeroMemory(entries, sizeof(entries));
+	entries[5].red = 0x10;
+	entries[5].green = 0x20;
+	entries[5].blue = 0x30;
+
+	clrconv = freerdp_clrconv_new(0);
+	clrconv->palette->entries = entries;
+
+	status |= test_color_pixel(p16_red, 16, 32, 0, clrconv, 0x00FF0000);
+	status |= test_color_pixel(p16_red, 16, 32, CLRCONV_ALPHA | CLRCONV_INVERT, clrconv, 0xFF0000FF);
+	status |= test_color_pixel(p16_green, 16, 32, CLRCONV_ALPHA, clrconv, 0xFF00FF00);
+	status |= test_color_pixel(p16_red, 16, 16, CLRCONV_RGB555, clrconv, 0x7C00);
+	status |= test_color_pixel(p16_red, 16, 24, 0, clrconv, 0x00FF0000);
+	status |= test_color_pixel(p15_red, 15, 32, 0, clrconv, 0x00FF0000);
+	status |= test_color_pixel(p15_red, 15, 16, 0, clrconv, 0xF800);
+	status |= test_color_pixel(p24, 24, 32, 0, clrconv, 0xFF332211);
+	status |= test_color_pixel(p32, 32, 24, 0, clrconv, 0x112233);
+	status |= test_color_pixel(p32, 32, 24, CLRCONV_INVERT, clrconv, 0x332211);
+	status |= test_color_pixel(p32, 32, 32, CLRCONV_ALPHA, clrconv, 0xFF112233);
+	status |= test_color_pixel(p32_red, 32, 16, 0, clrconv, 0xF800);
+	status |= test_color_pixel(p32_red, 32, 16, CLRCONV_INVERT, clrconv, 0x001F);
+	status |= test_color_pixel(p8, 8, 32, CLRCONV_ALPHA, clrconv, 0xFF302010);
+	status |= test_color_pixel(p8, 8, 32, CLRCONV_INVERT, clrconv, 0x00102030);
+	status |= test_color_pixel(p8, 8, 16, 0, clrconv, 0x1106);
+
+	freerdp_clrconv_free(clrconv);
+
+	return status;
+}
+
+/**
+ * The fused flip must give the same result as converting and flipping in
+ * two passes, both into a separate buffer and in place.
+ */
+static int test_color_convert_flip(void)
+{
+	int i, flags;
+	int width = 37;
+	int height = 13;
+	BYTE* src;
+	BYTE* dst1;
+	BYTE* dst2;
+	BYTE* tmp;
+	HCLRCONV clrconv;
+	PALETTE_ENTRY entries[256];
+	int pairs[][2] =
+	{
+		{ 8, 16 }, { 8, 32 }, { 15, 16 }, { 15, 32 }, { 16, 16 }, { 16, 24 },
+		{ 16, 32 }, { 24, 32 }, { 32, 16 }, { 32, 24 }, { 32, 32 }
+	};
+
+	src = (BYTE*) malloc(width * height * 4);
+	dst1 = (BYTE*) malloc(width * height * 4);
+	dst2 = (BYTE*) malloc(width * height * 4);
+	tmp = (BYTE*) malloc(width * height * 4);
+
+	test_fill_random(src, width * height * 4);
+	test_fill_random((BYTE*) entries, sizeof(entries));
+
+	clrconv = freerdp_clrconv_new(0);
+	clrconv->palette->entries = entries;
+
+	for (i = 0; i < sizeof(pairs) / sizeof(pairs[0]); i++)
+	{
+		for (flags = 0; flags < 8; flags++)
+		{
+			int dstSize = width * height * ((pairs[i][1] + 7) / 8);
+
+			clrconv->alpha = (flags & CLRCONV_ALPHA) ? 1 : 0;
+			clrconv->invert = (flags & CLRCONV_INVERT) ? 1 : 0;
+			clrconv->rgb555 = (flags & CLRCONV_RGB555) ? 1 : 0;
+
+			freerdp_image_convert(src, tmp, width, height, pairs[i][0], pairs[i][1], clrconv);
+			freerdp_image_flip(tmp, dst1, width, height, pairs[i][1]);
+
+			freerdp_image_convert_ex(src, dst2, width, height, pairs[i][0], pairs[i][1], clrconv, FREERDP_IMAGE_FLIP);
+
+			if (memcmp(dst1, dst2, dstSize) != 0)
+			{
+				printf("fused flip differs: %d -> %d bpp, flags 0x%X\n", pairs[i][0], pairs[i][1], flags);
+				return -1;
+			}
+
+			if (pairs[i][0] != pairs[i][1])
+				continue;
+
+			CopyMemory(dst2, src, dstSize);
+			freerdp_image_convert_ex(dst2, dst2, width, height, pairs[i][0], pairs[i][1], clrconv, FREERDP_IMAGE_FLIP);
+
+			if (memcmp(dst1, dst2, dstSize) != 0)
+			{
+				printf("in place fused flip differs: %d -> %d bpp, flags 0x%X\n", pairs[i][0], pairs[i][1], flags);
+				return -1;
+			}
+		}
+	}
+
+	freerdp_clrconv_free(clrconv);
+
+	free(src);
+	free(dst1);
+	free(dst2);
+	free(tmp);
+
+	return 0;
+}
+
+static double test_color_kernel_speed(p_color_kernel kernel, BYTE* src, BYTE* dst, COLOR_KERNEL_PARAMS* params)
+{
+	int i;
+	double elapsed;
+	STOPWATCH* stopwatch;
+
+	stopwatch = stopwatch_create();
+	stopwatch_start(stopwatch);
+
+	for (i = 0; i < BENCH_ROUNDS; i++)
+		kernel(src, dst, BENCH_PIXELS, params);
+
+	stopwatch_stop(stopwatch);
+	elapsed = stopwatch_get_elapsed_time_in_seconds(stopwatch);
+	stopwatch_free(stopwatch);
+
+	if (elapsed <= 0.0)
+		return 0.0;
+
+	return ((double) BENCH_PIXELS * BENCH_ROUNDS) / (elapsed * 1000000.0);
+}
+
+/**
+ * Prints the throughput of every kernel in megapixels per second, for the
+ * generic implementation and for the table selected at runtime.
+ */
+static void test_color_kernels_benchmark(void)
+{
+	int k;
+	BYTE* src;
+	BYTE* dst;
+	COLOR_KERNEL_PARAMS params;
+	const COLOR_KERNELS* generic = freerdp_color_kernels_generic();
+	const COLOR_KERNELS* kernels = freerdp_color_kernels_get();
+
+	src = (BYTE*) malloc(BENCH_PIXELS * 4);
+	dst = (BYTE*) malloc(BENCH_PIXELS * 4);
+
+	test_fill_random(src, BENCH_PIXELS * 4);
+	test_fill_random((BYTE*) params.table, sizeof(params.table));
+	params.alpha = 0xFF000000;
+
+	printf("%-12s %12s %12s (MPixel/s)\n", "kernel", generic->name, kernels->name);
+
+	for (k = 0; k < COLOR_KERNEL_COUNT; k++)
+	{
+		printf("%-12s %12.1f %12.1f\n", freerdp_color_kernel_name(k),
+			test_color_kernel_speed(generic->kernels[k], src, dst, &params),
+			test_color_kernel_speed(kernels->kernels[k], src, dst, &params));
+	}
+
+	free(src);
+	free(dst);
+}
+
+int TestCodecColor(int argc, char* argv[])
+{
+	if (test_color_kernels_match() < 0)
+		return -1;
+
+	if (test_color_pixels() < 0)
+		return -1;
+
+	if (test_color_convert_flip() < 0)
+		return -1;
+
+	test_color_kernels_benchmark();
+
+	return 0;
+}
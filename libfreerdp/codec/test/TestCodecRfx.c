@@ -0,0 +1,193 @@
+
+#include <stdio.h>
+#include <winpr/crt.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/codec/rfx.h>
+#include <freerdp/utils/stream.h>
+
+#define IMAGE_WIDTH		200
+#define IMAGE_HEIGHT		150
+
+#define SURFACE_WIDTH		320
+#define SURFACE_HEIGHT		200
+
+#define TEST_TILES		9
+
+static RFX_RECT test_rects[] =
+{
+	{ 10, 5, 100, 60 },
+	{ 120, 70, 80, 80 }
+};
+
+static RFX_RECT test_clip_rects[] =
+{
+	{ 0, 0, 200, 120 },
+	{ 250, 150, 40, 40 }
+};
+
+static BOOL test_clip(int* left, int* top, int* right, int* bottom, const RFX_RECT* rect)
+{
+	*left = MAX(*left, rect->x);
+	*top = MAX(*top, rect->y);
+	*right = MIN(*right, rect->x + rect->width);
+	*bottom = MIN(*bottom, rect->y + rect->height);
+
+	return (*left < *right) && (*top < *bottom);
+}
+
+/**
+ * Builds the expected surface the way clients used to: decode every tile
+ * into its own buffer, then copy each tile clipped to each region rect.
+ */
+static void test_reference_surface(RFX_MESSAGE* message, RFX_SURFACE* surface, int bpp)
+{
+	int i, j, k, y;
+	int left, top, right, bottom;
+	RFX_RECT bounds = { 0, 0, SURFACE_WIDTH, SURFACE_HEIGHT };
+	RFX_RECT tile_rect;
+	RFX_RECT* clip;
+
+	for (i = 0; i < message->num_tiles; i++)
+	{
+		tile_rect.x = surface->left + message->tiles[i]->x;
+		tile_rect.y = surface->top + message->tiles[i]->y;
+		tile_rect.width = 64;
+		tile_rect.height = 64;
+
+		for (j = 0; j < message->num_rects; j++)
+		{
+			for (k = 0; k < MAX(surface->num_clip_rects, 1); k++)
+			{
+				clip = (surface->num_clip_rects > 0) ? &surface->clip_rects[k] : &bounds;
+
+				left = surface->left + message->rects[j].x;
+				top = surface->top + message->rects[j].y;
+				right = left + message->rects[j].width;
+				bottom = top + message->rects[j].height;
+
+				if (!test_clip(&left, &top, &right, &bottom, &tile_rect) ||
+					!test_clip(&left, &top, &right, &bottom, &bounds) ||
+					!test_clip(&left, &top, &right, &bottom, clip))
+					continue;
+
+				for (y = top; y < bottom; y++)
+				{
+					CopyMemory(&surface->data[y * surface->stride + left * bpp],
+						&message->tiles[i]->data[((y - tile_rect.y) * 64 + (left - tile_rect.x)) * bpp],
+						(right - left) * bpp);
+				}
+			}
+		}
+	}
+}
+
+static int test_rfx_surface(BYTE* encoded, int length, RDP_PIXEL_FORMAT format, int bpp, BOOL clip)
+{
+	int status = 0;
+	BYTE* expected;
+	BYTE* actual;
+	RFX_CONTEXT* context;
+	RFX_MESSAGE* message;
+	RFX_SURFACE surface;
+
+	expected = (BYTE*) malloc(SURFACE_WIDTH * SURFACE_HEIGHT * bpp);
+	actual = (BYTE*) malloc(SURFACE_WIDTH * SURFACE_HEIGHT * bpp);
+	FillMemory(expected, SURFACE_WIDTH * SURFACE_HEIGHT * bpp, 0x5A);
+	FillMemory(actual, SURFACE_WIDTH * SURFACE_HEIGHT * bpp, 0x5A);
+
+	ZeroMemory(&surface, sizeof(RFX_SURFACE));
+	surface.stride = SURFACE_WIDTH * bpp;
+	surface.width = SURFACE_WIDTH;
+	surface.height = SURFACE_HEIGHT;
+	surface.pixel_format = format;
+	surface.left = 150;
+	surface.top = 90;
+
+	if (clip)
+	{
+		surface.num_clip_rects = sizeof(test_clip_rects) / sizeof(test_clip_rects[0]);
+		surface.clip_rects = test_clip_rects;
+	}
+
+	context = rfx_context_new();
+	rfx_context_set_pixel_format(context, format);
+
+	surface.data = expected;
+	message = rfx_process_message(context, encoded, length);
+	test_reference_surface(message, &surface, bpp);
+	rfx_message_free(context, message);
+
+	surface.data = actual;
+	message = rfx_process_message_surface(context, encoded, length, &surface);
+
+	if (message->num_rects != sizeof(test_rects) / sizeof(test_rects[0]))
+	{
+		printf("unexpected number of rects: %d\n", message->num_rects);
+		status = -1;
+	}
+
+	/* of the 4x3 tiles of the image, three are outside of both rects */
+	if (message->num_tiles != TEST_TILES)
+	{
+		printf("unexpected number of tiles: %d\n", message->num_tiles);
+		status = -1;
+	}
+
+	rfx_message_free(context, message);
+	rfx_context_free(context);
+
+	if (memcmp(expected, actual, SURFACE_WIDTH * SURFACE_HEIGHT * bpp) != 0)
+	{
+		printf("surface decode differs from tile decode, bpp: %d clip: %d\n", bpp * 8, clip);
+		status = -1;
+	}
+
+	free(expected);
+	free(actual);
+
+	return status;
+}
+
+int TestCodecRfx(int argc, char* argv[])
+{
+	int x, y;
+	int status = 0;
+	BYTE* image;
+	STREAM* s;
+	RFX_CONTEXT* context;
+
+	image = (BYTE*) malloc(IMAGE_WIDTH * IMAGE_HEIGHT * 3);
+
+	for (y = 0; y < IMAGE_HEIGHT; y++)
+	{
+		for (x = 0; x < IMAGE_WIDTH; x++)
+		{
+			image[(y * IMAGE_WIDTH + x) * 3 + 0] = (BYTE) (x + y);
+			image[(y * IMAGE_WIDTH + x) * 3 + 1] = (BYTE) (x * 3);
+			image[(y * IMAGE_WIDTH + x) * 3 + 2] = (BYTE) ((x ^ y) & 0xF0);
+		}
+	}
+
+	context = rfx_context_new();
+	context->mode = RLGR3;
+	context->width = IMAGE_WIDTH;
+	context->height = IMAGE_HEIGHT;
+	rfx_context_set_pixel_format(context, RDP_PIXEL_FORMAT_R8G8B8);
+
+	s = stream_new(65536);
+	rfx_compose_message(context, s, test_rects, sizeof(test_rects) / sizeof(test_rects[0]),
+		image, IMAGE_WIDTH, IMAGE_HEIGHT, IMAGE_WIDTH * 3);
+	stream_seal(s);
+
+	status |= test_rfx_surface(s->data, s->size, RDP_PIXEL_FORMAT_B8G8R8A8, 4, FALSE);
+	status |= test_rfx_surface(s->data, s->size, RDP_PIXEL_FORMAT_B8G8R8A8, 4, TRUE);
+	status |= test_rfx_surface(s->data, s->size, RDP_PIXEL_FORMAT_R8G8B8, 3, FALSE);
+	status |= test_rfx_surface(s->data, s->size, RDP_PIXEL_FORMAT_R8G8B8, 3, TRUE);
+
+	stream_free(s);
+	rfx_context_free(context);
+	free(image);
+
+	return status;
+}
@@ -21,6 +21,8 @@
 #include "config.h"
 #endif
 
+#include <winpr/crt.h>
+
 #include "activation.h"
 
 /*
@@ -182,33 +184,303 @@ void rdp_write_persistent_list_entry(STREAM* s, UINT32 key1, UINT32 key2)
 	stream_write_UINT32(s, key2); /* key2 (4 bytes) */
 }
 
-void rdp_write_client_persistent_key_list_pdu(STREAM* s, rdpSettings* settings)
-{
-	stream_write_UINT16(s, 0); /* numEntriesCache0 (2 bytes) */
-	stream_write_UINT16(s, 0); /* numEntriesCache1 (2 bytes) */
-	stream_write_UINT16(s, 0); /* numEntriesCache2 (2 bytes) */
-	stream_write_UINT16(s, 0); /* numEntriesCache3 (2 bytes) */
-	stream_write_UINT16(s, 0); /* numEntriesCache4 (2 bytes) */
-	stream_write_UINT16(s, 0); /* totalEntriesCache0 (2 bytes) */
-	stream_write_UINT16(s, 0); /* totalEntriesCache1 (2 bytes) */
-	stream_write_UINT16(s, 0); /* totalEntriesCache2 (2 bytes) */
-	stream_write_UINT16(s, 0); /* totalEntriesCache3 (2 bytes) */
-	stream_write_UINT16(s, 0); /* totalEntriesCache4 (2 bytes) */
-	stream_write_BYTE(s, PERSIST_FIRST_PDU | PERSIST_LAST_PDU); /* bBitMask (1 byte) */
+rdpPersistentKeyList* rdp_persistent_key_list_new(void)
+{
+	rdpPersistentKeyList* list;
+
+	list = (rdpPersistentKeyList*) malloc(sizeof(rdpPersistentKeyList));
+
+	if (list != NULL)
+		ZeroMemory(list, sizeof(rdpPersistentKeyList));
+
+	return list;
+}
+
+void rdp_persistent_key_list_free(rdpPersistentKeyList* list)
+{
+	int i;
+
+	if (list != NULL)
+	{
+		for (i = 0; i < PERSIST_MAX_CELLS; i++)
+			free(list->keys[i]);
+
+		persistent_cache_free(list->cache);
+		free(list);
+	}
+}
+
+/**
+ * Takes the keys to announce from the persistent bitmap cache file: for
+ * each persistent cell, as many of its most recently used bitmaps as the
+ * cell holds. Returns FALSE, leaving the list empty, if there is nothing
+ * to announce.
+ */
+
+BOOL rdp_persistent_key_list_load(rdpPersistentKeyList* list, rdpSettings* settings)
+{
+	int i;
+	int count;
+	UINT32 id;
+	UINT32 max;
+	UINT32 total = 0;
+	rdpPersistentCache* cache;
+	PERSISTENT_CACHE_ENTRY** entries;
+
+	if (!settings->BitmapCachePersistEnabled || !settings->BitmapCachePersistFile)
+		return FALSE;
+
+	cache = persistent_cache_new();
+
+	if (!persistent_cache_load(cache, settings->BitmapCachePersistFile))
+	{
+		persistent_cache_free(cache);
+		return FALSE;
+	}
+
+	for (id = 0; (id < settings->BitmapCacheV2NumCells) && (id < PERSIST_MAX_CELLS); id++)
+	{
+		if (!settings->BitmapCacheV2CellInfo[id].persistent)
+			continue;
+
+		max = settings->BitmapCacheV2CellInfo[id].numEntries;
+
+		if (max > 0xFFFF)
+			max = 0xFFFF;
+
+		if (max > PERSIST_MAX_TOTAL_ENTRIES - total)
+			max = PERSIST_MAX_TOTAL_ENTRIES - total;
+
+		entries = (PERSISTENT_CACHE_ENTRY**) malloc(sizeof(PERSISTENT_CACHE_ENTRY*) * (max + 1));
+		count = persistent_cache_get_keys(cache, id, entries, max);
+
+		list->keys[id] = (UINT64*) malloc(sizeof(UINT64) * (count + 1));
+
+		for (i = 0; i < count; i++)
+			list->keys[id][i] = entries[i]->key;
+
+		list->totalEntries[id] = count;
+		total += count;
+
+		free(entries);
+	}
+
+	persistent_cache_free(cache);
+
+	return (total > 0) ? TRUE : FALSE;
+}
+
+/**
+ * Writes the next persistent key list PDU, with as many of the keys not
+ * written yet as fit. Returns TRUE once the last PDU has been written.
+ * An empty list is a single PDU without keys.
+ */
+
+BOOL rdp_write_client_persistent_key_list_pdu(STREAM* s, rdpPersistentKeyList* list)
+{
+	int i;
+	UINT32 j;
+	UINT64 key;
+	BYTE flags = 0;
+	BOOL last = TRUE;
+	UINT32 count = 0;
+	UINT32 numEntries[PERSIST_MAX_CELLS];
+
+	for (i = 0; i < PERSIST_MAX_CELLS; i++)
+	{
+		numEntries[i] = list->totalEntries[i] - list->numEntries[i];
+
+		if (numEntries[i] > PERSIST_MAX_PDU_ENTRIES - count)
+		{
+			numEntries[i] = PERSIST_MAX_PDU_ENTRIES - count;
+			last = FALSE;
+		}
+
+		count += numEntries[i];
+	}
+
+	if (!list->open)
+		flags |= PERSIST_FIRST_PDU;
+
+	if (last)
+		flags |= PERSIST_LAST_PDU;
+
+	list->open = !last;
+
+	stream_check_size(s, 24 + count * 8);
+
+	for (i = 0; i < PERSIST_MAX_CELLS; i++)
+		stream_write_UINT16(s, numEntries[i]); /* numEntriesCacheX (2 bytes) */
+
+	for (i = 0; i < PERSIST_MAX_CELLS; i++)
+		stream_write_UINT16(s, list->totalEntries[i]); /* totalEntriesCacheX (2 bytes) */
+
+	stream_write_BYTE(s, flags); /* bBitMask (1 byte) */
 	stream_write_BYTE(s, 0); /* pad1 (1 byte) */
 	stream_write_UINT16(s, 0); /* pad3 (2 bytes) */
 
 	/* entries */
+	for (i = 0; i < PERSIST_MAX_CELLS; i++)
+	{
+		for (j = 0; j < numEntries[i]; j++)
+		{
+			key = list->keys[i][list->numEntries[i] + j];
+			rdp_write_persistent_list_entry(s, (UINT32) key, (UINT32) (key >> 32));
+		}
+
+		list->numEntries[i] += numEntries[i];
+	}
+
+	return last;
+}
+
+/**
+ * Reads a persistent key list PDU into the keys the client has, which a
+ * first PDU starts over. Returns FALSE with the error info to disconnect
+ * with if the PDU is malformed or announces more keys than the cells of
+ * the client hold.
+ */
+
+BOOL rdp_read_client_persistent_key_list_pdu(STREAM* s, rdpSettings* settings, rdpPersistentKeyList* list, UINT32* errorInfo)
+{
+	int i;
+	UINT32 j;
+	BYTE flags;
+	UINT32 key1;
+	UINT32 key2;
+	UINT32 maxEntries;
+	UINT32 count = 0;
+	UINT32 total = 0;
+	UINT16 numEntries[PERSIST_MAX_CELLS];
+	UINT16 totalEntries[PERSIST_MAX_CELLS];
+
+	*errorInfo = ERRINFO_PERSISTENT_KEY_PDU_BAD_LENGTH;
+
+	if (stream_get_left(s) < 24)
+		return FALSE;
+
+	for (i = 0; i < PERSIST_MAX_CELLS; i++)
+	{
+		stream_read_UINT16(s, numEntries[i]); /* numEntriesCacheX (2 bytes) */
+		count += numEntries[i];
+	}
+
+	for (i = 0; i < PERSIST_MAX_CELLS; i++)
+	{
+		stream_read_UINT16(s, totalEntries[i]); /* totalEntriesCacheX (2 bytes) */
+		total += totalEntries[i];
+	}
+
+	stream_read_BYTE(s, flags); /* bBitMask (1 byte) */
+	stream_seek_BYTE(s); /* pad1 (1 byte) */
+	stream_seek_UINT16(s); /* pad3 (2 bytes) */
+
+	if (stream_get_left(s) < (int) (count * 8))
+		return FALSE;
+
+	*errorInfo = ERRINFO_PERSISTENT_KEY_PDU_ILLEGAL_FIRST;
+
+	if (((flags & PERSIST_FIRST_PDU) ? TRUE : FALSE) == list->open)
+		return FALSE;
+
+	if (flags & PERSIST_FIRST_PDU)
+	{
+		*errorInfo = ERRINFO_PERSISTENT_KEY_PDU_TOO_MANY_TOTAL_KEYS;
+
+		if (total > PERSIST_MAX_TOTAL_ENTRIES)
+			return FALSE;
+
+		*errorInfo = ERRINFO_PERSISTENT_KEY_PDU_TOO_MANY_CACHE_KEYS;
+
+		for (i = 0; i < PERSIST_MAX_CELLS; i++)
+		{
+			maxEntries = 0;
+
+			if ((UINT32) i < settings->BitmapCacheV2NumCells)
+				maxEntries = settings->BitmapCacheV2CellInfo[i].numEntries;
+
+			if (totalEntries[i] > maxEntries)
+				return FALSE;
+		}
+
+		if (!list->cache)
+			list->cache = persistent_cache_new();
+
+		persistent_cache_clear(list->cache);
+
+		for (i = 0; i < PERSIST_MAX_CELLS; i++)
+		{
+			list->numEntries[i] = 0;
+			list->totalEntries[i] = totalEntries[i];
+		}
+	}
+
+	*errorInfo = ERRINFO_PERSISTENT_KEY_PDU_TOO_MANY_CACHE_KEYS;
+
+	for (i = 0; i < PERSIST_MAX_CELLS; i++)
+	{
+		if (list->numEntries[i] + numEntries[i] > list->totalEntries[i])
+			return FALSE;
+	}
+
+	for (i = 0; i < PERSIST_MAX_CELLS; i++)
+	{
+		for (j = 0; j < numEntries[i]; j++)
+		{
+			stream_read_UINT32(s, key1); /* key1 (4 bytes) */
+			stream_read_UINT32(s, key2); /* key2 (4 bytes) */
+
+			persistent_cache_put_key(list->cache, ((UINT64) key2 << 32) | key1, i, list->numEntries[i]++);
+		}
+	}
+
+	list->open = (flags & PERSIST_LAST_PDU) ? FALSE : TRUE;
+	*errorInfo = 0;
+
+	return TRUE;
 }
 
 BOOL rdp_send_client_persistent_key_list_pdu(rdpRdp* rdp)
 {
 	STREAM* s;
+	BOOL last = FALSE;
+	rdpPersistentKeyList* list;
 
-	s = rdp_data_pdu_init(rdp);
-	rdp_write_client_persistent_key_list_pdu(s, rdp->settings);
+	list = rdp_persistent_key_list_new();
+	rdp_persistent_key_list_load(list, rdp->settings);
 
-	return rdp_send_data_pdu(rdp, s, DATA_PDU_TYPE_BITMAP_CACHE_PERSISTENT_LIST, rdp->mcs->user_id);
+	while (!last)
+	{
+		s = rdp_data_pdu_init(rdp);
+		last = rdp_write_client_persistent_key_list_pdu(s, list);
+
+		if (!rdp_send_data_pdu(rdp, s, DATA_PDU_TYPE_BITMAP_CACHE_PERSISTENT_LIST, rdp->mcs->user_id))
+		{
+			rdp_persistent_key_list_free(list);
+			return FALSE;
+		}
+	}
+
+	rdp_persistent_key_list_free(list);
+
+	return TRUE;
+}
+
+BOOL rdp_recv_client_persistent_key_list_pdu(rdpRdp* rdp, STREAM* s)
+{
+	UINT32 errorInfo;
+
+	if (!rdp->persist_list)
+		rdp->persist_list = rdp_persistent_key_list_new();
+
+	if (!rdp_read_client_persistent_key_list_pdu(s, rdp->settings, rdp->persist_list, &errorInfo))
+	{
+		printf("rdp_recv_client_persistent_key_list_pdu: invalid persistent key list, error info 0x%08X\n", errorInfo);
+		rdp->errorInfo = errorInfo;
+		return FALSE;
+	}
+
+	return TRUE;
 }
 
 BOOL rdp_recv_client_font_list_pdu(STREAM* s)
@@ -23,6 +23,7 @@
 #include "rdp.h"
 
 #include <freerdp/settings.h>
+#include <freerdp/utils/persistent.h>
 
 #define SYNCMSGTYPE_SYNC		0x0001
 
@@ -34,6 +35,28 @@
 #define PERSIST_FIRST_PDU		0x01
 #define PERSIST_LAST_PDU		0x02
 
+#define PERSIST_MAX_CELLS		5
+#define PERSIST_MAX_PDU_ENTRIES		169
+#define PERSIST_MAX_TOTAL_ENTRIES	262144
+
+typedef struct rdp_persistent_key_list rdpPersistentKeyList;
+
+/**
+ * The keys of a persistent key list, split over as many PDUs as needed.
+ * The client fills in keys and totalEntries and writes PDUs until the
+ * last one, numEntries counting the keys written. The server counts the
+ * keys read in numEntries and puts them in cache, with the index the
+ * client gives them.
+ */
+struct rdp_persistent_key_list
+{
+	BOOL open;
+	UINT32 numEntries[PERSIST_MAX_CELLS];
+	UINT32 totalEntries[PERSIST_MAX_CELLS];
+	UINT64* keys[PERSIST_MAX_CELLS];
+	rdpPersistentCache* cache;
+};
+
 #define FONTLIST_FIRST			0x0001
 #define FONTLIST_LAST			0x0002
 
@@ -50,7 +73,13 @@ BOOL rdp_recv_server_control_pdu(rdpRdp* rdp, STREAM* s);
 BOOL rdp_send_server_control_cooperate_pdu(rdpRdp* rdp);
 BOOL rdp_send_server_control_granted_pdu(rdpRdp* rdp);
 BOOL rdp_send_client_control_pdu(rdpRdp* rdp, UINT16 action);
+rdpPersistentKeyList* rdp_persistent_key_list_new(void);
+void rdp_persistent_key_list_free(rdpPersistentKeyList* list);
+BOOL rdp_persistent_key_list_load(rdpPersistentKeyList* list, rdpSettings* settings);
+BOOL rdp_write_client_persistent_key_list_pdu(STREAM* s, rdpPersistentKeyList* list);
+BOOL rdp_read_client_persistent_key_list_pdu(STREAM* s, rdpSettings* settings, rdpPersistentKeyList* list, UINT32* errorInfo);
 BOOL rdp_send_client_persistent_key_list_pdu(rdpRdp* rdp);
+BOOL rdp_recv_client_persistent_key_list_pdu(rdpRdp* rdp, STREAM* s);
 BOOL rdp_recv_client_font_list_pdu(STREAM* s);
 BOOL rdp_send_client_font_list_pdu(rdpRdp* rdp, UINT16 flags);
 BOOL rdp_recv_font_map_pdu(rdpRdp* rdp, STREAM* s);
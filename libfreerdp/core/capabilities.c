@@ -986,16 +986,38 @@ void rdp_write_bitmap_cache_cell_info(STREAM* s, BITMAP_CACHE_V2_CELL_INFO* cell
  * @param settings settings
  */
 
+void rdp_read_bitmap_cache_cell_info(STREAM* s, BITMAP_CACHE_V2_CELL_INFO* cellInfo)
+{
+	UINT32 info;
+
+	stream_read_UINT32(s, info);
+
+	cellInfo->numEntries = (info & 0x7FFFFFFF);
+	cellInfo->persistent = (info & 0x80000000) ? TRUE : FALSE;
+}
+
 void rdp_read_bitmap_cache_v2_capability_set(STREAM* s, UINT16 length, rdpSettings* settings)
 {
+	int i;
+	BYTE numCellCaches;
+
+	if (!settings->ServerMode)
+	{
+		stream_seek(s, 36);
+		return;
+	}
+
+	/* the server keeps the cells of the client, to check its persistent key list against */
+
 	stream_seek_UINT16(s); /* cacheFlags (2 bytes) */
 	stream_seek_BYTE(s); /* pad2 (1 byte) */
-	stream_seek_BYTE(s); /* numCellCaches (1 byte) */
-	stream_seek(s, 4); /* bitmapCache0CellInfo (4 bytes) */
-	stream_seek(s, 4); /* bitmapCache1CellInfo (4 bytes) */
-	stream_seek(s, 4); /* bitmapCache2CellInfo (4 bytes) */
-	stream_seek(s, 4); /* bitmapCache3CellInfo (4 bytes) */
-	stream_seek(s, 4); /* bitmapCache4CellInfo (4 bytes) */
+	stream_read_BYTE(s, numCellCaches); /* numCellCaches (1 byte) */
+
+	settings->BitmapCacheV2NumCells = (numCellCaches > 5) ? 5 : numCellCaches;
+
+	for (i = 0; i < 5; i++)
+		rdp_read_bitmap_cache_cell_info(s, &settings->BitmapCacheV2CellInfo[i]); /* bitmapCacheXCellInfo (4 bytes) */
+
 	stream_seek(s, 12); /* pad3 (12 bytes) */
 }
 
@@ -21,10 +21,14 @@
 #include "config.h"
 #endif
 
+#include <time.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+
 #include <freerdp/freerdp.h>
 #include <freerdp/peer.h>
 #include <freerdp/constants.h>
@@ -33,64 +37,373 @@
 #include "rdp.h"
 #include "channel.h"
 
-BOOL freerdp_channel_send(rdpRdp* rdp, UINT16 channel_id, BYTE* data, int size)
+static UINT64 freerdp_channel_now_ms(void)
+{
+#ifdef _WIN32
+	return GetTickCount64();
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ((UINT64) ts.tv_sec) * 1000 + (ts.tv_nsec / 1000000);
+#endif
+}
+
+static int freerdp_channel_find_index(rdpRdp* rdp, UINT16 channel_id)
+{
+	int i;
+
+	for (i = 0; i < (int) rdp->settings->ChannelCount; i++)
+	{
+		if (rdp->settings->ChannelDefArray[i].ChannelId == channel_id)
+			return i;
+	}
+
+	return -1;
+}
+
+static int freerdp_channel_weight(UINT32 options)
+{
+	if (options & CHANNEL_OPTION_PRI_HIGH)
+		return CHANNEL_WEIGHT_HIGH;
+
+	if (options & CHANNEL_OPTION_PRI_LOW)
+		return CHANNEL_WEIGHT_LOW;
+
+	return CHANNEL_WEIGHT_MED;
+}
+
+/**
+ * Send the next chunk of the message at the head of a channel queue.
+ * @return number of data bytes sent, -1 on error
+ */
+
+static int freerdp_channel_send_chunk(rdpRdp* rdp, rdpChannel* channel, rdpChannelMessage* message)
 {
 	STREAM* s;
 	UINT32 flags;
-	int i, left;
 	int chunk_size;
-	rdpChannel* channel = NULL;
 
-	for (i = 0; i < rdp->settings->ChannelCount; i++)
+	chunk_size = message->size - message->offset;
+	flags = (message->offset == 0) ? CHANNEL_FLAG_FIRST : 0;
+
+	if (chunk_size > (int) rdp->settings->VirtualChannelChunkSize)
+		chunk_size = rdp->settings->VirtualChannelChunkSize;
+	else
+		flags |= CHANNEL_FLAG_LAST;
+
+	if ((channel->options & CHANNEL_OPTION_SHOW_PROTOCOL))
+		flags |= CHANNEL_FLAG_SHOW_PROTOCOL;
+
+	s = rdp_send_stream_init(rdp);
+
+	stream_write_UINT32(s, message->size);
+	stream_write_UINT32(s, flags);
+	stream_check_size(s, chunk_size);
+	stream_write(s, &message->data[message->offset], chunk_size);
+
+	if (!rdp_send(rdp, s, channel->ChannelId))
+		return -1;
+
+	message->offset += chunk_size;
+
+	return chunk_size;
+}
+
+static void freerdp_channel_message_free(rdpChannelMessage* message)
+{
+	shared_buffer_unref(message->buffer);
+	free(message);
+}
+
+static void freerdp_channel_queue_account(rdpChannelQueue* queue, int length)
+{
+	UINT64 now;
+	UINT64 elapsed;
+
+	queue->bytes_sent += length;
+	queue->window_bytes += length;
+
+	now = freerdp_channel_now_ms();
+	elapsed = now - queue->window_start;
+
+	if (elapsed >= 1000)
 	{
-		if (rdp->settings->ChannelDefArray[i].ChannelId == channel_id)
+		queue->bytes_per_second = (UINT32) ((queue->window_bytes * 1000) / elapsed);
+		queue->window_bytes = 0;
+		queue->window_start = now;
+	}
+}
+
+/**
+ * Send queued chunks until about budget bytes went out or the queues are
+ * empty. Each visit of a channel in the round adds its weight worth of
+ * chunks to its deficit, and a channel keeps its turn while the deficit
+ * lasts, so a pass cut short by the budget resumes where it stopped.
+ * Called with the scheduler locked.
+ * @return number of messages still queued, -1 on error
+ */
+
+static int freerdp_channel_scheduler_pass(rdpChannelScheduler* scheduler, int budget)
+{
+	int length;
+	int status = 0;
+	rdpRdp* rdp = scheduler->rdp;
+	rdpChannelQueue* queue;
+	rdpChannelMessage* message;
+
+	while ((budget > 0) && (scheduler->queued_messages > 0))
+	{
+		queue = &scheduler->queues[scheduler->cursor];
+
+		if (queue->head && (queue->deficit <= 0))
+			queue->deficit += queue->weight * rdp->settings->VirtualChannelChunkSize;
+
+		while (queue->head && (queue->deficit > 0) && (budget > 0))
 		{
-			channel = &rdp->settings->ChannelDefArray[i];
-			break;
+			message = queue->head;
+			length = freerdp_channel_send_chunk(rdp, &rdp->settings->ChannelDefArray[scheduler->cursor], message);
+
+			if (length < 0)
+			{
+				status = -1;
+				break;
+			}
+
+			queue->deficit -= length;
+			queue->queued_bytes -= length;
+			budget -= length;
+			freerdp_channel_queue_account(queue, length);
+
+			if (message->offset < message->size)
+				continue;
+
+			queue->head = message->next;
+
+			if (queue->head == NULL)
+				queue->tail = NULL;
+
+			queue->queued_messages--;
+			queue->messages_sent++;
+			scheduler->queued_messages--;
+
+			freerdp_channel_message_free(message);
 		}
+
+		if (status < 0)
+			break;
+
+		if (queue->head == NULL)
+			queue->deficit = 0;
+
+		/* the budget ran out while this channel still had its turn */
+		if (queue->head && (queue->deficit > 0))
+			break;
+
+		scheduler->cursor = (scheduler->cursor + 1) % scheduler->num_queues;
 	}
 
-	if (channel == NULL)
+	if (status == 0)
+		status = scheduler->queued_messages;
+
+	/* keep the event set for as long as there is something left to send */
+	if ((scheduler->queued_messages > 0) != scheduler->signaled)
+	{
+		scheduler->signaled = (scheduler->queued_messages > 0) ? TRUE : FALSE;
+
+		if (scheduler->signaled)
+			SetEvent(scheduler->event);
+		else
+			ResetEvent(scheduler->event);
+	}
+
+	return status;
+}
+
+int freerdp_channel_scheduler_send(rdpChannelScheduler* scheduler, int budget)
+{
+	int status;
+
+	WaitForSingleObject(scheduler->mutex, INFINITE);
+	status = freerdp_channel_scheduler_pass(scheduler, budget);
+	ReleaseMutex(scheduler->mutex);
+
+	return status;
+}
+
+/**
+ * Queue a message for a static virtual channel and run a scheduler pass.
+ * The message holds a reference to buffer; without a buffer, data that is
+ * not sent by the time this returns is copied, so the caller keeps
+ * ownership of its data as with a synchronous send.
+ */
+
+static BOOL freerdp_channel_enqueue(rdpRdp* rdp, UINT16 channel_id, SHARED_BUFFER* buffer, BYTE* data, int size)
+{
+	int index;
+	int status;
+	rdpChannelQueue* queue;
+	rdpChannelMessage* message;
+	rdpChannelScheduler* scheduler = rdp->channel_scheduler;
+
+	index = freerdp_channel_find_index(rdp, channel_id);
+
+	if (index < 0)
 	{
 		printf("freerdp_channel_send: unknown channel_id %d\n", channel_id);
 		return FALSE;
 	}
 
-	flags = CHANNEL_FLAG_FIRST;
-	left = size;
-	while (left > 0)
+	if (size < 1)
+		return TRUE;
+
+	message = (rdpChannelMessage*) malloc(sizeof(rdpChannelMessage));
+	ZeroMemory(message, sizeof(rdpChannelMessage));
+
+	message->buffer = buffer ? shared_buffer_ref(buffer) : NULL;
+	message->data = data;
+	message->size = size;
+
+	WaitForSingleObject(scheduler->mutex, INFINITE);
+
+	if (index >= scheduler->num_queues)
 	{
-		s = rdp_send_stream_init(rdp);
+		scheduler->queues = (rdpChannelQueue*) realloc(scheduler->queues, sizeof(rdpChannelQueue) * (index + 1));
+		ZeroMemory(&scheduler->queues[scheduler->num_queues], sizeof(rdpChannelQueue) * (index + 1 - scheduler->num_queues));
+		scheduler->num_queues = index + 1;
+	}
 
-		if (left > (int) rdp->settings->VirtualChannelChunkSize)
-		{
-			chunk_size = rdp->settings->VirtualChannelChunkSize;
-		}
-		else
-		{
-			chunk_size = left;
-			flags |= CHANNEL_FLAG_LAST;
-		}
-		if ((channel->options & CHANNEL_OPTION_SHOW_PROTOCOL))
-		{
-			flags |= CHANNEL_FLAG_SHOW_PROTOCOL;
-		}
+	queue = &scheduler->queues[index];
+	queue->weight = freerdp_channel_weight(rdp->settings->ChannelDefArray[index].options);
+
+	if (queue->window_start == 0)
+		queue->window_start = freerdp_channel_now_ms();
+
+	if (queue->tail)
+		queue->tail->next = message;
+	else
+		queue->head = message;
 
-		stream_write_UINT32(s, size);
-		stream_write_UINT32(s, flags);
-		stream_check_size(s, chunk_size);
-		stream_write(s, data, chunk_size);
+	queue->tail = message;
+	queue->queued_messages++;
+	queue->queued_bytes += size;
+	scheduler->queued_messages++;
 
-		rdp_send(rdp, s, channel_id);
+	status = freerdp_channel_scheduler_pass(scheduler, CHANNEL_SCHEDULER_BURST_SIZE);
 
-		data += chunk_size;
-		left -= chunk_size;
-		flags = 0;
+	/* a message that went out entirely is freed and no longer the tail */
+	if ((queue->tail == message) && (message->buffer == NULL))
+	{
+		message->buffer = shared_buffer_new(size);
+		CopyMemory(message->buffer->data, data, size);
+		message->data = message->buffer->data;
 	}
 
+	ReleaseMutex(scheduler->mutex);
+
+	return (status < 0) ? FALSE : TRUE;
+}
+
+BOOL freerdp_channel_send(rdpRdp* rdp, UINT16 channel_id, BYTE* data, int size)
+{
+	return freerdp_channel_enqueue(rdp, channel_id, NULL, data, size);
+}
+
+/**
+ * Send data that lies within a shared buffer. The buffer is referenced
+ * until the data is sent instead of being copied.
+ */
+
+BOOL freerdp_channel_send_buffer(rdpRdp* rdp, UINT16 channel_id, SHARED_BUFFER* buffer, BYTE* data, int size)
+{
+	return freerdp_channel_enqueue(rdp, channel_id, buffer, data, size);
+}
+
+void freerdp_channel_scheduler_get_fds(rdpChannelScheduler* scheduler, void** rfds, int* rcount)
+{
+	int fd;
+
+	fd = GetEventFileDescriptor(scheduler->event);
+
+	if (fd != -1)
+	{
+		rfds[*rcount] = (void*) (long) fd;
+		(*rcount)++;
+	}
+}
+
+BOOL freerdp_channel_scheduler_get_stats(rdpChannelScheduler* scheduler, UINT16 channel_id, RDP_CHANNEL_STATS* stats)
+{
+	int index;
+	rdpChannelQueue* queue;
+
+	ZeroMemory(stats, sizeof(RDP_CHANNEL_STATS));
+
+	index = freerdp_channel_find_index(scheduler->rdp, channel_id);
+
+	if (index < 0)
+		return FALSE;
+
+	WaitForSingleObject(scheduler->mutex, INFINITE);
+
+	if (index < scheduler->num_queues)
+	{
+		queue = &scheduler->queues[index];
+
+		stats->QueuedMessages = queue->queued_messages;
+		stats->QueuedBytes = queue->queued_bytes;
+		stats->MessagesSent = queue->messages_sent;
+		stats->BytesSent = queue->bytes_sent;
+		stats->BytesPerSecond = queue->bytes_per_second;
+	}
+
+	ReleaseMutex(scheduler->mutex);
+
 	return TRUE;
 }
 
+rdpChannelScheduler* freerdp_channel_scheduler_new(rdpRdp* rdp)
+{
+	rdpChannelScheduler* scheduler;
+
+	scheduler = (rdpChannelScheduler*) malloc(sizeof(rdpChannelScheduler));
+
+	if (scheduler != NULL)
+	{
+		ZeroMemory(scheduler, sizeof(rdpChannelScheduler));
+
+		scheduler->rdp = rdp;
+		scheduler->event = CreateEvent(NULL, TRUE, FALSE, NULL);
+		scheduler->mutex = CreateMutex(NULL, FALSE, NULL);
+	}
+
+	return scheduler;
+}
+
+void freerdp_channel_scheduler_free(rdpChannelScheduler* scheduler)
+{
+	int i;
+	rdpChannelMessage* message;
+
+	if (scheduler != NULL)
+	{
+		for (i = 0; i < scheduler->num_queues; i++)
+		{
+			while ((message = scheduler->queues[i].head) != NULL)
+			{
+				scheduler->queues[i].head = message->next;
+				freerdp_channel_message_free(message);
+			}
+		}
+
+		free(scheduler->queues);
+		CloseHandle(scheduler->event);
+		CloseHandle(scheduler->mutex);
+		free(scheduler);
+	}
+}
+
 void freerdp_channel_process(freerdp* instance, STREAM* s, UINT16 channel_id)
 {
 	UINT32 length;
@@ -20,7 +20,78 @@
 #ifndef __CHANNEL_H
 #define __CHANNEL_H
 
+#include <winpr/synch.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/utils/buffer.h>
+
+typedef struct rdp_channel_message rdpChannelMessage;
+typedef struct rdp_channel_queue rdpChannelQueue;
+typedef struct rdp_channel_scheduler rdpChannelScheduler;
+
+/* chunk bytes sent per scheduler pass before the caller gets control back */
+#define CHANNEL_SCHEDULER_BURST_SIZE	16384
+
+/* round robin weights of the CHANNEL_OPTION_PRI_* classes */
+#define CHANNEL_WEIGHT_HIGH		4
+#define CHANNEL_WEIGHT_MED		2
+#define CHANNEL_WEIGHT_LOW		1
+
+/* data lies within buffer, which the message holds a reference to */
+struct rdp_channel_message
+{
+	SHARED_BUFFER* buffer;
+	BYTE* data;
+	int size;
+	int offset;
+	rdpChannelMessage* next;
+};
+
+struct rdp_channel_queue
+{
+	int weight;
+	int deficit;
+	rdpChannelMessage* head;
+	rdpChannelMessage* tail;
+
+	UINT32 queued_messages;
+	UINT32 queued_bytes;
+	UINT64 messages_sent;
+	UINT64 bytes_sent;
+
+	UINT64 window_start;
+	UINT64 window_bytes;
+	UINT32 bytes_per_second;
+};
+
+/**
+ * Outgoing static virtual channel data is queued per channel and sent in
+ * chunks, a bounded burst per pass, so that a bulk transfer on one channel
+ * neither holds up the other channels nor the graphics and input PDUs sent
+ * in between passes. Channels are served by deficit round robin weighted
+ * by their CHANNEL_OPTION_PRI_* option; each channel stays in FIFO order.
+ */
+struct rdp_channel_scheduler
+{
+	rdpRdp* rdp;
+	HANDLE event;
+	HANDLE mutex;
+	BOOL signaled;
+
+	int cursor;
+	UINT32 queued_messages;
+	int num_queues;
+	rdpChannelQueue* queues;
+};
+
 BOOL freerdp_channel_send(rdpRdp* rdp, UINT16 channel_id, BYTE* data, int size);
+BOOL freerdp_channel_send_buffer(rdpRdp* rdp, UINT16 channel_id, SHARED_BUFFER* buffer, BYTE* data, int size);
+int freerdp_channel_scheduler_send(rdpChannelScheduler* scheduler, int budget);
+void freerdp_channel_scheduler_get_fds(rdpChannelScheduler* scheduler, void** rfds, int* rcount);
+BOOL freerdp_channel_scheduler_get_stats(rdpChannelScheduler* scheduler, UINT16 channel_id, RDP_CHANNEL_STATS* stats);
+
+rdpChannelScheduler* freerdp_channel_scheduler_new(rdpRdp* rdp);
+void freerdp_channel_scheduler_free(rdpChannelScheduler* scheduler);
 void freerdp_channel_process(freerdp* instance, STREAM* s, UINT16 channel_id);
 void freerdp_channel_peer_process(freerdp_peer* client, STREAM* s, UINT16 channel_id);
 
@@ -199,6 +199,7 @@ BOOL rdp_client_redirect(rdpRdp* rdp)
 	free(settings->ClientAddress);
 
 	rdp->transport = transport_new(settings);
+	rdp->transport->stats = &rdp->stats;
 	rdp->license = license_new(rdp);
 	rdp->nego = nego_new(rdp->transport);
 	rdp->mcs = mcs_new(rdp->transport);
@@ -579,8 +580,6 @@ BOOL rdp_server_accept_nego(rdpRdp* rdp, STREAM* s)
 	BOOL status;
 	rdpSettings* settings = rdp->settings;
 
-	transport_set_blocking_mode(rdp->transport, TRUE);
-
 	if (!nego_read_request(rdp->nego, s))
 		return FALSE;
 
@@ -630,13 +629,34 @@ BOOL rdp_server_accept_nego(rdpRdp* rdp, STREAM* s)
 	if (!status)
 		return FALSE;
 
-	transport_set_blocking_mode(rdp->transport, FALSE);
-
-	rdp->state = CONNECTION_STATE_NEGO;
+	/* the TLS and NLA handshakes are driven by rdp_server_accept_security() */
+	if (rdp->nego->selected_protocol == PROTOCOL_RDP)
+		rdp->state = CONNECTION_STATE_NEGO;
+	else
+		rdp->state = CONNECTION_STATE_SECURITY;
 
 	return TRUE;
 }
 
+/**
+ * Advance the security handshake negotiated in rdp_server_accept_nego()
+ * without blocking on the client.
+ * @param rdp RDP module
+ * @return 1 when the handshake is complete, 0 when waiting for the client, -1 on failure
+ */
+
+int rdp_server_accept_security(rdpRdp* rdp)
+{
+	int status;
+
+	status = transport_accept_check(rdp->transport);
+
+	if (status > 0)
+		rdp->state = CONNECTION_STATE_NEGO;
+
+	return status;
+}
+
 BOOL rdp_server_accept_mcs_connect_initial(rdpRdp* rdp, STREAM* s)
 {
 	int i;
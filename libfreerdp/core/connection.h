@@ -32,6 +32,7 @@
 enum CONNECTION_STATE
 {
 	CONNECTION_STATE_INITIAL = 0,
+	CONNECTION_STATE_SECURITY,
 	CONNECTION_STATE_NEGO,
 	CONNECTION_STATE_MCS_CONNECT,
 	CONNECTION_STATE_MCS_ERECT_DOMAIN,
@@ -54,6 +55,7 @@ BOOL rdp_client_connect_demand_active(rdpRdp* rdp, STREAM* s);
 BOOL rdp_client_connect_finalize(rdpRdp* rdp);
 
 BOOL rdp_server_accept_nego(rdpRdp* rdp, STREAM* s);
+int rdp_server_accept_security(rdpRdp* rdp);
 BOOL rdp_server_accept_mcs_connect_initial(rdpRdp* rdp, STREAM* s);
 BOOL rdp_server_accept_mcs_erect_domain_request(rdpRdp* rdp, STREAM* s);
 BOOL rdp_server_accept_mcs_attach_user_request(rdpRdp* rdp, STREAM* s);
@@ -175,6 +175,9 @@ static void fastpath_recv_update_common(rdpFastPath* fastpath, STREAM* s)
 		case UPDATE_TYPE_BITMAP:
 			update_read_bitmap(update, s, &update->bitmap_update);
 			IFCALL(update->BitmapUpdate, context, &update->bitmap_update);
+
+			if (!fastpath->rdp->in_received_frame)
+				fastpath->rdp->stats.FramesReceived++;
 			break;
 
 		case UPDATE_TYPE_PALETTE:
@@ -295,6 +298,10 @@ static BOOL fastpath_recv_update_data(rdpFastPath* fastpath, STREAM* s)
 			comp_stream->data = rdp->mppc_dec->history_buf + roff;
 			comp_stream->p = comp_stream->data;
 			comp_stream->size = rlen;
+
+			rdp->stats.CompressedBytesReceived += size;
+			rdp->stats.DecompressedBytesReceived += rlen;
+
 			size = comp_stream->size;
 		}
 		else
@@ -328,6 +335,8 @@ static BOOL fastpath_recv_update_data(rdpFastPath* fastpath, STREAM* s)
 
 	if (update_stream)
 	{
+		rdp->stats.UpdatesReceived++;
+
 		if (!fastpath_recv_update(fastpath, updateCode, totalSize, update_stream))
 			return FALSE;
 	}
@@ -344,6 +353,8 @@ BOOL fastpath_recv_updates(rdpFastPath* fastpath, STREAM* s)
 {
 	rdpUpdate* update = fastpath->rdp->update;
 
+	fastpath->rdp->stats.FastPathPdusReceived++;
+
 	IFCALL(update->BeginPaint, update->context);
 
 	while (stream_get_left(s) >= 3)
@@ -510,6 +521,8 @@ BOOL fastpath_recv_inputs(rdpFastPath* fastpath, STREAM* s)
 {
 	BYTE i;
 
+	fastpath->rdp->stats.FastPathPdusReceived++;
+
 	if (fastpath->numberEvents == 0)
 	{
 		/**
@@ -620,6 +633,8 @@ BOOL fastpath_send_input_pdu(rdpFastPath* fastpath, STREAM* s)
 	if (transport_write(fastpath->rdp->transport, s) < 0)
 		return FALSE;
 
+	rdp->stats.FastPathPdusSent++;
+
 	return TRUE;
 }
 
@@ -630,6 +645,10 @@ STREAM* fastpath_update_pdu_init(rdpFastPath* fastpath)
 	stream_seek(s, 3); /* fpOutputHeader, length1 and length2 */
 	stream_seek(s, fastpath_get_sec_bytes(fastpath->rdp));
 	stream_seek(s, 3); /* updateHeader, size */
+
+	/* the update is serialized from here until fastpath_send_update_pdu() writes it out */
+	fastpath->encode_start = trace_get_time();
+
 	return s;
 }
 
@@ -692,6 +711,9 @@ BOOL fastpath_send_update_pdu(rdpFastPath* fastpath, BYTE updateCode, STREAM* s)
 					stream_attach(comp_update, bm, pdu_data_bytes + header_bytes);
 					ls = comp_update;
 				}
+
+				rdp->stats.UncompressedBytesSent += dlen;
+				rdp->stats.CompressedBytesSent += pdu_data_bytes;
 			}
 			else
 				printf("fastpath_send_update_pdu: mppc_encode failed\n");
@@ -744,12 +766,20 @@ BOOL fastpath_send_update_pdu(rdpFastPath* fastpath, BYTE updateCode, STREAM* s)
 			security_encrypt(ptr_to_crypt, bytes_to_crypt, rdp);
 		}
 
+		if (fastpath->encode_start != 0)
+			rdp->stats.UpdateEncodeTime += (trace_get_time() - fastpath->encode_start) / 1000;
+
 		if (transport_write(fastpath->rdp->transport, update) < 0)
 		{
 			result = FALSE;
 			break;
 		}
 
+		rdp->stats.FastPathPdusSent++;
+
+		/* the next fragment is compressed and encrypted after the write */
+		fastpath->encode_start = trace_get_time();
+
 		/* Reserve 6 + sec_bytes bytes for the next fragment header, if any. */
 		stream_set_mark(s, holdp + dlen);
 	}
@@ -759,6 +789,11 @@ BOOL fastpath_send_update_pdu(rdpFastPath* fastpath, BYTE updateCode, STREAM* s)
 	stream_free(update);
 	stream_free(comp_update);
 
+	fastpath->encode_start = 0;
+
+	if (result)
+		rdp->stats.UpdatesSent++;
+
 	return result;
 }
 
@@ -100,6 +100,7 @@ struct rdp_fastpath
 	BYTE encryptionFlags;
 	BYTE numberEvents;
 	STREAM* updateData;
+	UINT64 encode_start;
 };
 
 UINT16 fastpath_header_length(STREAM* s);
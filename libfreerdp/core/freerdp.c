@@ -24,6 +24,7 @@
 #include "rdp.h"
 #include "input.h"
 #include "update.h"
+#include "replay.h"
 #include "surface.h"
 #include "transport.h"
 #include "connection.h"
@@ -164,6 +165,7 @@ BOOL freerdp_get_fds(freerdp* instance, void** rfds, int* rcount, void** wfds, i
 
 	rdp = instance->context->rdp;
 	transport_get_fds(rdp->transport, rfds, rcount);
+	freerdp_channel_scheduler_get_fds(rdp->channel_scheduler, rfds, rcount);
 
 	return TRUE;
 }
@@ -183,11 +185,81 @@ BOOL freerdp_check_fds(freerdp* instance)
 	return TRUE;
 }
 
+/** Plays a session dump written by a client with the DumpSession setting, instead of connecting.
+ *  The instance goes through PreConnect, the first activation of the dump and PostConnect, the way
+ *  freerdp_connect() would take it; the PDUs of the dump are then played by freerdp_replay_check().
+ *  Nothing is sent, and virtual channel data is handed to ReceiveChannelData as it was received.
+ *
+ *  @param instance - pointer to a rdp_freerdp structure, as for freerdp_connect().
+ *  @param filename - the session dump.
+ *
+ *  @return TRUE if successful. FALSE otherwise.
+ */
+BOOL freerdp_replay_open(freerdp* instance, char* filename)
+{
+	rdpRdp* rdp;
+	BOOL status = TRUE;
+
+	rdp = instance->context->rdp;
+
+	IFCALLRET(instance->PreConnect, status, instance);
+
+	if (status != TRUE)
+		return FALSE;
+
+	rdp->replay = replay_new(filename, FALSE);
+
+	if (rdp->replay == NULL)
+		return FALSE;
+
+	if ((replay_check(rdp) < 1) || (rdp->replay->activations == 0))
+	{
+		printf("%s is not a session dump\n", filename);
+		return FALSE;
+	}
+
+	IFCALLRET(instance->PostConnect, status, instance);
+
+	return status;
+}
+
+/** Plays the next PDU of the session dump opened by freerdp_replay_open().
+ *  @return 1 if a PDU was played, 0 at the end of the dump, -1 on error.
+ */
+int freerdp_replay_check(freerdp* instance)
+{
+	return replay_check(instance->context->rdp);
+}
+
 static int freerdp_send_channel_data(freerdp* instance, int channel_id, BYTE* data, int size)
 {
 	return rdp_send_channel_data(instance->context->rdp, channel_id, data, size);
 }
 
+static int freerdp_send_channel_buffer(freerdp* instance, int channel_id, SHARED_BUFFER* buffer, BYTE* data, int size)
+{
+	return freerdp_channel_send_buffer(instance->context->rdp, channel_id, buffer, data, size);
+}
+
+/**
+ * Get the send queue depth and throughput of a static virtual channel.
+ */
+
+BOOL freerdp_get_channel_stats(freerdp* instance, int channelId, RDP_CHANNEL_STATS* stats)
+{
+	return freerdp_channel_scheduler_get_stats(instance->context->rdp->channel_scheduler, channelId, stats);
+}
+
+/**
+ * Get the byte, PDU and frame counters of the connection, both ways.
+ */
+
+BOOL freerdp_get_session_stats(freerdp* instance, RDP_SESSION_STATS* stats)
+{
+	CopyMemory(stats, &instance->context->rdp->stats, sizeof(RDP_SESSION_STATS));
+	return TRUE;
+}
+
 BOOL freerdp_disconnect(freerdp* instance)
 {
 	rdpRdp* rdp;
@@ -295,6 +367,7 @@ freerdp* freerdp_new()
 	{
 		instance->context_size = sizeof(rdpContext);
 		instance->SendChannelData = freerdp_send_channel_data;
+		instance->SendChannelBuffer = freerdp_send_channel_buffer;
 	}
 
 	return instance;
@@ -24,6 +24,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <fcntl.h>
 
 #include <winpr/crt.h>
@@ -75,7 +76,28 @@ static const char *inet_ntop(int af, const void* src, char* dst, socklen_t cnt)
 #endif
 #endif
 
-static BOOL freerdp_listener_open(freerdp_listener* instance, const char* bind_address, UINT16 port)
+static BOOL freerdp_listener_add_socket(rdpListener* listener, int sockfd, int type)
+{
+	if (listener->num_sockfds >= LISTENER_MAX_SOCKETS)
+		return FALSE;
+
+	listener->sockfds[listener->num_sockfds] = sockfd;
+	listener->socktypes[listener->num_sockfds] = type;
+	listener->num_sockfds++;
+
+	return TRUE;
+}
+
+static void freerdp_listener_remove_socket(rdpListener* listener, int index)
+{
+	close(listener->sockfds[index]);
+
+	listener->num_sockfds--;
+	listener->sockfds[index] = listener->sockfds[listener->num_sockfds];
+	listener->socktypes[index] = listener->socktypes[listener->num_sockfds];
+}
+
+static BOOL freerdp_listener_open_ex(freerdp_listener* instance, const char* bind_address, UINT16 port, BOOL reuse_port)
 {
 	rdpListener* listener = (rdpListener*) instance->listener;
 	int status;
@@ -110,7 +132,7 @@ static BOOL freerdp_listener_open(freerdp_listener* instance, const char* bind_a
 		return FALSE;
 	}
 
-	for (ai = res; ai && listener->num_sockfds < 5; ai = ai->ai_next)
+	for (ai = res; ai && listener->num_sockfds < LISTENER_MAX_SOCKETS; ai = ai->ai_next)
 	{
 		if (ai->ai_family != AF_INET && ai->ai_family != AF_INET6)
 			continue;
@@ -128,6 +150,22 @@ static BOOL freerdp_listener_open(freerdp_listener* instance, const char* bind_a
 		if (setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, (void*) &option_value, sizeof(option_value)) == -1)
 			perror("setsockopt");
 
+		if (reuse_port)
+		{
+#ifdef SO_REUSEPORT
+			if (setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, (void*) &option_value, sizeof(option_value)) == -1)
+			{
+				perror("setsockopt SO_REUSEPORT");
+				close(sockfd);
+				continue;
+			}
+#else
+			printf("SO_REUSEPORT is not supported on this platform\n");
+			close(sockfd);
+			continue;
+#endif
+		}
+
 #ifndef _WIN32
 		fcntl(sockfd, F_SETFL, O_NONBLOCK);
 #else
@@ -158,7 +196,7 @@ static BOOL freerdp_listener_open(freerdp_listener* instance, const char* bind_a
 			continue;
 		}
 
-		listener->sockfds[listener->num_sockfds++] = sockfd;
+		freerdp_listener_add_socket(listener, sockfd, LISTENER_SOCKET_ACCEPT);
 
 		if (ai->ai_family == AF_INET)
 			sin_addr = &(((struct sockaddr_in*) ai->ai_addr)->sin_addr);
@@ -173,7 +211,17 @@ static BOOL freerdp_listener_open(freerdp_listener* instance, const char* bind_a
 	return (listener->num_sockfds > 0 ? TRUE : FALSE);
 }
 
-static BOOL freerdp_listener_open_local(freerdp_listener* instance, const char* path)
+static BOOL freerdp_listener_open(freerdp_listener* instance, const char* bind_address, UINT16 port)
+{
+	return freerdp_listener_open_ex(instance, bind_address, port, FALSE);
+}
+
+static BOOL freerdp_listener_open_reuse_port(freerdp_listener* instance, const char* bind_address, UINT16 port)
+{
+	return freerdp_listener_open_ex(instance, bind_address, port, TRUE);
+}
+
+static BOOL freerdp_listener_open_local_ex(freerdp_listener* instance, const char* path, int type)
 {
 #ifndef _WIN32
 	int status;
@@ -181,6 +229,9 @@ static BOOL freerdp_listener_open_local(freerdp_listener* instance, const char*
 	struct sockaddr_un addr;
 	rdpListener* listener = (rdpListener*) instance->listener;
 
+	if (listener->num_sockfds >= LISTENER_MAX_SOCKETS)
+		return FALSE;
+
 	sockfd = socket(AF_UNIX, SOCK_STREAM, 0);
 
 	if (sockfd == -1)
@@ -213,13 +264,93 @@ static BOOL freerdp_listener_open_local(freerdp_listener* instance, const char*
 		return FALSE;
 	}
 
-	listener->sockfds[listener->num_sockfds++] = sockfd;
+	freerdp_listener_add_socket(listener, sockfd, type);
 
 	printf("Listening on socket %s.\n", addr.sun_path);
 
 	return TRUE;
 #else
+	return (type == LISTENER_SOCKET_ACCEPT) ? TRUE : FALSE;
+#endif
+}
+
+static BOOL freerdp_listener_open_local(freerdp_listener* instance, const char* path)
+{
+	return freerdp_listener_open_local_ex(instance, path, LISTENER_SOCKET_ACCEPT);
+}
+
+static BOOL freerdp_listener_open_handoff(freerdp_listener* instance, const char* path)
+{
+	return freerdp_listener_open_local_ex(instance, path, LISTENER_SOCKET_HANDOFF);
+}
+
+/**
+ * Pass the socket of a peer to the listener that opened path with
+ * OpenHandoff, over a short-lived Unix domain socket connection.
+ */
+
+static BOOL freerdp_listener_handoff_peer(freerdp_listener* instance, const char* path, freerdp_peer* client)
+{
+#ifndef _WIN32
+	int sockfd;
+	BYTE data = 0;
+	struct iovec iov;
+	struct msghdr msg;
+	struct cmsghdr* cmsg;
+	struct sockaddr_un addr;
+	char control[CMSG_SPACE(sizeof(int))];
+
+	sockfd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+	if (sockfd == -1)
+	{
+		perror("socket");
+		return FALSE;
+	}
+
+	ZeroMemory(&addr, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+	if (connect(sockfd, (struct sockaddr*) &addr, sizeof(addr)) != 0)
+	{
+		perror("connect");
+		close(sockfd);
+		return FALSE;
+	}
+
+	ZeroMemory(&msg, sizeof(msg));
+	ZeroMemory(control, sizeof(control));
+
+	iov.iov_base = &data;
+	iov.iov_len = sizeof(data);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+	CopyMemory(CMSG_DATA(cmsg), &client->sockfd, sizeof(int));
+
+	if (sendmsg(sockfd, &msg, 0) != sizeof(data))
+	{
+		perror("sendmsg");
+		close(sockfd);
+		return FALSE;
+	}
+
+	close(sockfd);
+
+	/* the receiving process now owns the connection */
+	close(client->sockfd);
+	freerdp_peer_free(client);
+
 	return TRUE;
+#else
+	return FALSE;
 #endif
 }
 
@@ -254,12 +385,92 @@ static BOOL freerdp_listener_get_fds(freerdp_listener* instance, void** rfds, in
 	return TRUE;
 }
 
+static void freerdp_listener_peer_accepted(freerdp_listener* instance, int peer_sockfd, struct sockaddr_storage* peer_addr)
+{
+	void* sin_addr;
+	freerdp_peer* client;
+
+	client = freerdp_peer_new(peer_sockfd);
+
+	sin_addr = NULL;
+	if (peer_addr->ss_family == AF_INET)
+		sin_addr = &(((struct sockaddr_in*) peer_addr)->sin_addr);
+	else if (peer_addr->ss_family == AF_INET6)
+		sin_addr = &(((struct sockaddr_in6*) peer_addr)->sin6_addr);
+#ifndef _WIN32
+	else if (peer_addr->ss_family == AF_UNIX)
+		client->local = TRUE;
+#endif
+
+	if (sin_addr)
+		inet_ntop(peer_addr->ss_family, sin_addr, client->hostname, sizeof(client->hostname));
+
+	IFCALL(instance->PeerAccepted, instance, client);
+}
+
+#ifndef _WIN32
+
+/**
+ * Receive the peer sockets queued on a handoff channel.
+ * @return FALSE once the sending side has closed the channel
+ */
+
+static BOOL freerdp_listener_check_channel(freerdp_listener* instance, int sockfd)
+{
+	BYTE data;
+	int peer_sockfd;
+	ssize_t status;
+	struct iovec iov;
+	struct msghdr msg;
+	struct cmsghdr* cmsg;
+	socklen_t peer_addr_size;
+	struct sockaddr_storage peer_addr;
+	char control[CMSG_SPACE(sizeof(int))];
+
+	while (1)
+	{
+		ZeroMemory(&msg, sizeof(msg));
+
+		iov.iov_base = &data;
+		iov.iov_len = sizeof(data);
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+
+		status = recvmsg(sockfd, &msg, 0);
+
+		if (status < 0)
+			return ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR)) ? TRUE : FALSE;
+
+		if (status == 0)
+			return FALSE;
+
+		cmsg = CMSG_FIRSTHDR(&msg);
+
+		if (!cmsg || (cmsg->cmsg_level != SOL_SOCKET) || (cmsg->cmsg_type != SCM_RIGHTS))
+			continue;
+
+		CopyMemory(&peer_sockfd, CMSG_DATA(cmsg), sizeof(int));
+
+		fcntl(peer_sockfd, F_SETFL, fcntl(peer_sockfd, F_GETFL) & ~O_NONBLOCK);
+
+		ZeroMemory(&peer_addr, sizeof(peer_addr));
+		peer_addr_size = sizeof(peer_addr);
+		getpeername(peer_sockfd, (struct sockaddr*) &peer_addr, &peer_addr_size);
+
+		freerdp_listener_peer_accepted(instance, peer_sockfd, &peer_addr);
+	}
+
+	return TRUE;
+}
+
+#endif
+
 static BOOL freerdp_listener_check_fds(freerdp_listener* instance)
 {
 	int i;
-	void* sin_addr;
 	int peer_sockfd;
-	freerdp_peer* client;
 	socklen_t peer_addr_size;
 	struct sockaddr_storage peer_addr;
 	rdpListener* listener = (rdpListener*) instance->listener;
@@ -269,6 +480,16 @@ static BOOL freerdp_listener_check_fds(freerdp_listener* instance)
 
 	for (i = 0; i < listener->num_sockfds; i++)
 	{
+#ifndef _WIN32
+		if (listener->socktypes[i] == LISTENER_SOCKET_CHANNEL)
+		{
+			if (!freerdp_listener_check_channel(instance, listener->sockfds[i]))
+				freerdp_listener_remove_socket(listener, i--);
+
+			continue;
+		}
+#endif
+
 		peer_addr_size = sizeof(peer_addr);
 		peer_sockfd = accept(listener->sockfds[i], (struct sockaddr*) &peer_addr, &peer_addr_size);
 
@@ -288,22 +509,21 @@ static BOOL freerdp_listener_check_fds(freerdp_listener* instance)
 			return FALSE;
 		}
 
-		client = freerdp_peer_new(peer_sockfd);
-
-		sin_addr = NULL;
-		if (peer_addr.ss_family == AF_INET)
-			sin_addr = &(((struct sockaddr_in*) &peer_addr)->sin_addr);
-		else if (peer_addr.ss_family == AF_INET6)
-			sin_addr = &(((struct sockaddr_in6*) &peer_addr)->sin6_addr);
+		if (listener->socktypes[i] == LISTENER_SOCKET_HANDOFF)
+		{
 #ifndef _WIN32
-		else if (peer_addr.ss_family == AF_UNIX)
-			client->local = TRUE;
-#endif
+			fcntl(peer_sockfd, F_SETFL, O_NONBLOCK);
 
-		if (sin_addr)
-			inet_ntop(peer_addr.ss_family, sin_addr, client->hostname, sizeof(client->hostname));
+			if (!freerdp_listener_add_socket(listener, peer_sockfd, LISTENER_SOCKET_CHANNEL))
+			{
+				printf("freerdp_listener: too many handoff channels\n");
+				close(peer_sockfd);
+			}
+#endif
+			continue;
+		}
 
-		IFCALL(instance->PeerAccepted, instance, client);
+		freerdp_listener_peer_accepted(instance, peer_sockfd, &peer_addr);
 	}
 
 	return TRUE;
@@ -318,7 +538,10 @@ freerdp_listener* freerdp_listener_new(void)
 	ZeroMemory(instance, sizeof(freerdp_listener));
 
 	instance->Open = freerdp_listener_open;
+	instance->OpenReusePort = freerdp_listener_open_reuse_port;
 	instance->OpenLocal = freerdp_listener_open_local;
+	instance->OpenHandoff = freerdp_listener_open_handoff;
+	instance->HandoffPeer = freerdp_listener_handoff_peer;
 	instance->GetFileDescriptor = freerdp_listener_get_fds;
 	instance->CheckFileDescriptor = freerdp_listener_check_fds;
 	instance->Close = freerdp_listener_close;
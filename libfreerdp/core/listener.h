@@ -25,11 +25,18 @@ typedef struct rdp_listener rdpListener;
 #include "rdp.h"
 #include <freerdp/listener.h>
 
+#define LISTENER_MAX_SOCKETS		32
+
+#define LISTENER_SOCKET_ACCEPT		0 /* accepted connections are peers */
+#define LISTENER_SOCKET_HANDOFF		1 /* accepted connections are handoff channels */
+#define LISTENER_SOCKET_CHANNEL		2 /* handoff channel carrying peer sockets */
+
 struct rdp_listener
 {
 	freerdp_listener* instance;
 
- 	int sockfds[5];
+	int sockfds[LISTENER_MAX_SOCKETS];
+	int socktypes[LISTENER_MAX_SOCKETS];
 	int num_sockfds;
 };
 
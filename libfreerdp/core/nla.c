@@ -92,15 +92,6 @@
 
 #define TERMSRV_SPN_PREFIX	"TERMSRV/"
 
-void credssp_send(rdpCredssp* credssp);
-int credssp_recv(rdpCredssp* credssp);
-void credssp_buffer_print(rdpCredssp* credssp);
-void credssp_buffer_free(rdpCredssp* credssp);
-SECURITY_STATUS credssp_encrypt_public_key_echo(rdpCredssp* credssp);
-SECURITY_STATUS credssp_decrypt_public_key_echo(rdpCredssp* credssp);
-SECURITY_STATUS credssp_encrypt_ts_credentials(rdpCredssp* credssp);
-SECURITY_STATUS credssp_decrypt_ts_credentials(rdpCredssp* credssp);
-
 /**
  * Initialize NTLMSSP authentication module (client).
  * @param credssp
@@ -373,27 +364,22 @@ int credssp_client_authenticate(rdpCredssp* credssp)
  * @return 1 if authentication is successful
  */
 
-int credssp_server_authenticate(rdpCredssp* credssp)
+/**
+ * Prepare the server side of the CredSSP exchange. The exchange itself is
+ * driven by credssp_server_recv(), one TSRequest at a time.
+ * @param credssp
+ * @return 1 on success, -1 on failure
+ */
+
+int credssp_server_begin(rdpCredssp* credssp)
 {
-	UINT32 cbMaxToken;
-	ULONG fContextReq;
-	ULONG pfContextAttr;
 	SECURITY_STATUS status;
-	CredHandle credentials;
 	TimeStamp expiration;
-	PSecPkgInfo pPackageInfo;
-	SecBuffer input_buffer;
-	SecBuffer output_buffer;
-	SecBufferDesc input_buffer_desc;
-	SecBufferDesc output_buffer_desc;
-	BOOL have_context;
-	BOOL have_input_buffer;
-	BOOL have_pub_key_auth;
 
 	sspi_GlobalInit();
 
 	if (credssp_ntlm_server_init(credssp) == 0)
-		return 0;
+		return -1;
 
 #ifdef WITH_NATIVE_SSPI
 	if (!credssp->SspiModule)
@@ -410,7 +396,7 @@ int credssp_server_authenticate(rdpCredssp* credssp)
 		if (!hSSPI)
 		{
 			_tprintf(_T("Failed to load SSPI module: %s\n"), credssp->SspiModule);
-			return 0;
+			return -1;
 		}
 
 #ifdef UNICODE
@@ -428,32 +414,27 @@ int credssp_server_authenticate(rdpCredssp* credssp)
 	}
 #endif
 
-	status = credssp->table->QuerySecurityPackageInfo(NLA_PKG_NAME, &pPackageInfo);
+	status = credssp->table->QuerySecurityPackageInfo(NLA_PKG_NAME, &credssp->pPackageInfo);
 
 	if (status != SEC_E_OK)
 	{
 		printf("QuerySecurityPackageInfo status: 0x%08X\n", status);
-		return 0;
+		return -1;
 	}
 
-	cbMaxToken = pPackageInfo->cbMaxToken;
+	credssp->cbMaxToken = credssp->pPackageInfo->cbMaxToken;
 
 	status = credssp->table->AcquireCredentialsHandle(NULL, NLA_PKG_NAME,
-			SECPKG_CRED_INBOUND, NULL, NULL, NULL, NULL, &credentials, &expiration);
+			SECPKG_CRED_INBOUND, NULL, NULL, NULL, NULL, &credssp->credentials, &expiration);
 
 	if (status != SEC_E_OK)
 	{
 		printf("AcquireCredentialsHandle status: 0x%08X\n", status);
-		return 0;
+		return -1;
 	}
 
-	have_context = FALSE;
-	have_input_buffer = FALSE;
-	have_pub_key_auth = FALSE;
-	ZeroMemory(&input_buffer, sizeof(SecBuffer));
-	ZeroMemory(&output_buffer, sizeof(SecBuffer));
-	ZeroMemory(&input_buffer_desc, sizeof(SecBufferDesc));
-	ZeroMemory(&output_buffer_desc, sizeof(SecBufferDesc));
+	credssp->have_context = FALSE;
+	credssp->have_pub_key_auth = FALSE;
 	ZeroMemory(&credssp->ContextSizes, sizeof(SecPkgContext_Sizes));
 
 	/* 
@@ -463,135 +444,146 @@ int credssp_server_authenticate(rdpCredssp* credssp)
 	 * ASC_REQ_ALLOCATE_MEMORY
 	 */
 
-	fContextReq = 0;
-	fContextReq |= ASC_REQ_MUTUAL_AUTH;
-	fContextReq |= ASC_REQ_CONFIDENTIALITY;
+	credssp->fContextReq = 0;
+	credssp->fContextReq |= ASC_REQ_MUTUAL_AUTH;
+	credssp->fContextReq |= ASC_REQ_CONFIDENTIALITY;
 
-	fContextReq |= ASC_REQ_CONNECTION;
-	fContextReq |= ASC_REQ_USE_SESSION_KEY;
+	credssp->fContextReq |= ASC_REQ_CONNECTION;
+	credssp->fContextReq |= ASC_REQ_USE_SESSION_KEY;
 
-	fContextReq |= ASC_REQ_REPLAY_DETECT;
-	fContextReq |= ASC_REQ_SEQUENCE_DETECT;
+	credssp->fContextReq |= ASC_REQ_REPLAY_DETECT;
+	credssp->fContextReq |= ASC_REQ_SEQUENCE_DETECT;
 
-	fContextReq |= ASC_REQ_EXTENDED_ERROR;
+	credssp->fContextReq |= ASC_REQ_EXTENDED_ERROR;
 
-	while (TRUE)
-	{
-		input_buffer_desc.ulVersion = SECBUFFER_VERSION;
-		input_buffer_desc.cBuffers = 1;
-		input_buffer_desc.pBuffers = &input_buffer;
-		input_buffer.BufferType = SECBUFFER_TOKEN;
+	return 1;
+}
 
-		/* receive authentication token */
+/**
+ * Process one authentication token received from the client and send the
+ * reply token.
+ * @return 1 when the security context is established, 0 when another token is expected, -1 on failure
+ */
 
-		input_buffer_desc.ulVersion = SECBUFFER_VERSION;
-		input_buffer_desc.cBuffers = 1;
-		input_buffer_desc.pBuffers = &input_buffer;
-		input_buffer.BufferType = SECBUFFER_TOKEN;
+static int credssp_server_accept_token(rdpCredssp* credssp)
+{
+	ULONG pfContextAttr;
+	SECURITY_STATUS status;
+	TimeStamp expiration;
+	SecBuffer input_buffer;
+	SecBuffer output_buffer;
+	SecBufferDesc input_buffer_desc;
+	SecBufferDesc output_buffer_desc;
 
-		if (credssp_recv(credssp) < 0)
-			return -1;
+	ZeroMemory(&input_buffer, sizeof(SecBuffer));
+	ZeroMemory(&output_buffer, sizeof(SecBuffer));
+	ZeroMemory(&input_buffer_desc, sizeof(SecBufferDesc));
+	ZeroMemory(&output_buffer_desc, sizeof(SecBufferDesc));
+
+	input_buffer_desc.ulVersion = SECBUFFER_VERSION;
+	input_buffer_desc.cBuffers = 1;
+	input_buffer_desc.pBuffers = &input_buffer;
+	input_buffer.BufferType = SECBUFFER_TOKEN;
 
 #ifdef WITH_DEBUG_CREDSSP
-		printf("Receiving Authentication Token\n");
-		credssp_buffer_print(credssp);
+	printf("Receiving Authentication Token\n");
+	credssp_buffer_print(credssp);
 #endif
 
-		input_buffer.pvBuffer = credssp->negoToken.pvBuffer;
-		input_buffer.cbBuffer = credssp->negoToken.cbBuffer;
-
-		if (credssp->negoToken.cbBuffer < 1)
-		{
-			printf("CredSSP: invalid negoToken!\n");
-			return -1;
-		}
+	input_buffer.pvBuffer = credssp->negoToken.pvBuffer;
+	input_buffer.cbBuffer = credssp->negoToken.cbBuffer;
 
-		output_buffer_desc.ulVersion = SECBUFFER_VERSION;
-		output_buffer_desc.cBuffers = 1;
-		output_buffer_desc.pBuffers = &output_buffer;
-		output_buffer.BufferType = SECBUFFER_TOKEN;
-		output_buffer.cbBuffer = cbMaxToken;
-		output_buffer.pvBuffer = malloc(output_buffer.cbBuffer);
-
-		status = credssp->table->AcceptSecurityContext(&credentials,
-			have_context? &credssp->context: NULL,
-			&input_buffer_desc, fContextReq, SECURITY_NATIVE_DREP, &credssp->context,
-			&output_buffer_desc, &pfContextAttr, &expiration);
+	if (credssp->negoToken.cbBuffer < 1)
+	{
+		printf("CredSSP: invalid negoToken!\n");
+		return -1;
+	}
 
-		credssp->negoToken.pvBuffer = output_buffer.pvBuffer;
-		credssp->negoToken.cbBuffer = output_buffer.cbBuffer;
+	output_buffer_desc.ulVersion = SECBUFFER_VERSION;
+	output_buffer_desc.cBuffers = 1;
+	output_buffer_desc.pBuffers = &output_buffer;
+	output_buffer.BufferType = SECBUFFER_TOKEN;
+	output_buffer.cbBuffer = credssp->cbMaxToken;
+	output_buffer.pvBuffer = malloc(output_buffer.cbBuffer);
 
-		if ((status == SEC_I_COMPLETE_AND_CONTINUE) || (status == SEC_I_COMPLETE_NEEDED))
-		{
-			if (credssp->table->CompleteAuthToken != NULL)
-				credssp->table->CompleteAuthToken(&credssp->context, &output_buffer_desc);
+	status = credssp->table->AcceptSecurityContext(&credssp->credentials,
+		credssp->have_context? &credssp->context: NULL,
+		&input_buffer_desc, credssp->fContextReq, SECURITY_NATIVE_DREP, &credssp->context,
+		&output_buffer_desc, &pfContextAttr, &expiration);
 
-			if (status == SEC_I_COMPLETE_NEEDED)
-				status = SEC_E_OK;
-			else if (status == SEC_I_COMPLETE_AND_CONTINUE)
-				status = SEC_I_CONTINUE_NEEDED;
-		}
-
-		if (status == SEC_E_OK)
-		{
-			have_pub_key_auth = TRUE;
+	sspi_SecBufferFree(&credssp->negoToken);
+	credssp->negoToken.pvBuffer = output_buffer.pvBuffer;
+	credssp->negoToken.cbBuffer = output_buffer.cbBuffer;
 
-			if (credssp->table->QueryContextAttributes(&credssp->context, SECPKG_ATTR_SIZES, &credssp->ContextSizes) != SEC_E_OK)
-			{
-				printf("QueryContextAttributes SECPKG_ATTR_SIZES failure\n");
-				return 0;
-			}
+	if ((status == SEC_I_COMPLETE_AND_CONTINUE) || (status == SEC_I_COMPLETE_NEEDED))
+	{
+		if (credssp->table->CompleteAuthToken != NULL)
+			credssp->table->CompleteAuthToken(&credssp->context, &output_buffer_desc);
 
-			if (credssp_decrypt_public_key_echo(credssp) != SEC_E_OK)
-			{
-				printf("Error: could not verify client's public key echo\n");
-				return -1;
-			}
+		if (status == SEC_I_COMPLETE_NEEDED)
+			status = SEC_E_OK;
+		else if (status == SEC_I_COMPLETE_AND_CONTINUE)
+			status = SEC_I_CONTINUE_NEEDED;
+	}
 
-			sspi_SecBufferFree(&credssp->negoToken);
-			credssp->negoToken.pvBuffer = NULL;
-			credssp->negoToken.cbBuffer = 0;
+	if (status == SEC_E_OK)
+	{
+		credssp->have_pub_key_auth = TRUE;
 
-			credssp_encrypt_public_key_echo(credssp);
+		if (credssp->table->QueryContextAttributes(&credssp->context, SECPKG_ATTR_SIZES, &credssp->ContextSizes) != SEC_E_OK)
+		{
+			printf("QueryContextAttributes SECPKG_ATTR_SIZES failure\n");
+			return -1;
 		}
 
-		if ((status != SEC_E_OK) && (status != SEC_I_CONTINUE_NEEDED))
+		if (credssp_decrypt_public_key_echo(credssp) != SEC_E_OK)
 		{
-			printf("AcceptSecurityContext status: 0x%08X\n", status);
+			printf("Error: could not verify client's public key echo\n");
 			return -1;
 		}
 
-		/* send authentication token */
+		sspi_SecBufferFree(&credssp->negoToken);
+		credssp->negoToken.pvBuffer = NULL;
+		credssp->negoToken.cbBuffer = 0;
+
+		credssp_encrypt_public_key_echo(credssp);
+	}
+
+	if ((status != SEC_E_OK) && (status != SEC_I_CONTINUE_NEEDED))
+	{
+		printf("AcceptSecurityContext status: 0x%08X\n", status);
+		return -1;
+	}
+
+	/* send authentication token */
 
 #ifdef WITH_DEBUG_CREDSSP
-		printf("Sending Authentication Token\n");
-		credssp_buffer_print(credssp);
+	printf("Sending Authentication Token\n");
+	credssp_buffer_print(credssp);
 #endif
 
-		credssp_send(credssp);
-		credssp_buffer_free(credssp);
+	credssp_send(credssp);
+	credssp_buffer_free(credssp);
 
-		if (status != SEC_I_CONTINUE_NEEDED)
-			break;
+	credssp->have_context = TRUE;
 
-		have_context = TRUE;
-	}
+	return (status == SEC_I_CONTINUE_NEEDED) ? 0 : 1;
+}
 
-	/* Receive encrypted credentials */
+/**
+ * Check the encrypted credentials sent by the client once the security
+ * context is established.
+ * @return 1 on success, -1 on failure
+ */
 
-	if (credssp_recv(credssp) < 0)
-		return -1;
+static int credssp_server_accept_credentials(rdpCredssp* credssp)
+{
+	SECURITY_STATUS status;
 
 	if (credssp_decrypt_ts_credentials(credssp) != SEC_E_OK)
 	{
-		printf("Could not decrypt TSCredentials status: 0x%08X\n", status);
-		return 0;
-	}
-
-	if (status != SEC_E_OK)
-	{
-		printf("AcceptSecurityContext status: 0x%08X\n", status);
-		return 0;
+		printf("Could not decrypt TSCredentials\n");
+		return -1;
 	}
 
 	status = credssp->table->ImpersonateSecurityContext(&credssp->context);
@@ -599,7 +591,7 @@ int credssp_server_authenticate(rdpCredssp* credssp)
 	if (status != SEC_E_OK)
 	{
 		printf("ImpersonateSecurityContext status: 0x%08X\n", status);
-		return 0;
+		return -1;
 	}
 	else
 	{
@@ -608,15 +600,70 @@ int credssp_server_authenticate(rdpCredssp* credssp)
 		if (status != SEC_E_OK)
 		{
 			printf("RevertSecurityContext status: 0x%08X\n", status);
-			return 0;
+			return -1;
 		}
 	}
 
-	credssp->table->FreeContextBuffer(pPackageInfo);
+	credssp->table->FreeContextBuffer(credssp->pPackageInfo);
+	credssp->pPackageInfo = NULL;
 
 	return 1;
 }
 
+/**
+ * Feed one complete TSRequest received from the client to the server
+ * state machine started by credssp_server_begin().
+ * @param credssp
+ * @param s stream holding exactly one TSRequest
+ * @return 1 when authentication is complete, 0 when more TSRequests are expected, -1 on failure
+ */
+
+int credssp_server_recv(rdpCredssp* credssp, STREAM* s)
+{
+	int status;
+
+	if (credssp_decode_ts_request(credssp, s) < 0)
+		return -1;
+
+	if (!credssp->have_pub_key_auth)
+	{
+		status = credssp_server_accept_token(credssp);
+		return (status < 0) ? -1 : 0;
+	}
+
+	return credssp_server_accept_credentials(credssp);
+}
+
+int credssp_server_authenticate(rdpCredssp* credssp)
+{
+	STREAM* s;
+	int status;
+
+	if (credssp_server_begin(credssp) < 0)
+		return -1;
+
+	do
+	{
+		s = stream_new(4096);
+
+		status = transport_read(credssp->transport, s);
+
+		if (status < 0)
+		{
+			printf("credssp_recv() error: %d\n", status);
+			stream_free(s);
+			return -1;
+		}
+
+		s->size = status;
+		status = credssp_server_recv(credssp, s);
+		stream_free(s);
+	}
+	while (status == 0);
+
+	return status;
+}
+
 /**
  * Authenticate using CredSSP.
  * @param credssp
@@ -1141,9 +1188,7 @@ void credssp_send(rdpCredssp* credssp)
 int credssp_recv(rdpCredssp* credssp)
 {
 	STREAM* s;
-	int length;
 	int status;
-	UINT32 version;
 
 	s = stream_new(4096);
 
@@ -1157,6 +1202,24 @@ int credssp_recv(rdpCredssp* credssp)
 		return -1;
 	}
 
+	status = credssp_decode_ts_request(credssp, s);
+	stream_free(s);
+
+	return status;
+}
+
+/**
+ * Decode a TSRequest into the negoToken, authInfo and pubKeyAuth buffers.
+ * @param credssp
+ * @param s
+ * @return 0 on success, -1 on failure
+ */
+
+int credssp_decode_ts_request(rdpCredssp* credssp, STREAM* s)
+{
+	int length;
+	UINT32 version;
+
 	/* TSRequest */
 	ber_read_sequence_tag(s, &length);
 	ber_read_contextual_tag(s, 0, &length, TRUE);
@@ -1192,8 +1255,6 @@ int credssp_recv(rdpCredssp* credssp)
 		credssp->pubKeyAuth.cbBuffer = length;
 	}
 
-	stream_free(s);
-
 	return 0;
 }
 
@@ -1296,6 +1357,10 @@ void credssp_free(rdpCredssp* credssp)
 		if (credssp->table)
 			credssp->table->DeleteSecurityContext(&credssp->context);
 
+		if (credssp->table && credssp->pPackageInfo)
+			credssp->table->FreeContextBuffer(credssp->pPackageInfo);
+
+		credssp_buffer_free(credssp);
 		sspi_SecBufferFree(&credssp->PublicKey);
 		sspi_SecBufferFree(&credssp->ts_credentials);
 
@@ -55,10 +55,31 @@ struct rdp_credssp
 	SEC_WINNT_AUTH_IDENTITY identity;
 	PSecurityFunctionTable table;
 	SecPkgContext_Sizes ContextSizes;
+
+	/* server side state, see credssp_server_begin() */
+	CredHandle credentials;
+	PSecPkgInfo pPackageInfo;
+	UINT32 cbMaxToken;
+	ULONG fContextReq;
+	BOOL have_context;
+	BOOL have_pub_key_auth;
 };
 
 int credssp_authenticate(rdpCredssp* credssp);
 
+int credssp_server_begin(rdpCredssp* credssp);
+int credssp_server_recv(rdpCredssp* credssp, STREAM* s);
+
+void credssp_send(rdpCredssp* credssp);
+int credssp_recv(rdpCredssp* credssp);
+int credssp_decode_ts_request(rdpCredssp* credssp, STREAM* s);
+void credssp_buffer_print(rdpCredssp* credssp);
+void credssp_buffer_free(rdpCredssp* credssp);
+SECURITY_STATUS credssp_encrypt_public_key_echo(rdpCredssp* credssp);
+SECURITY_STATUS credssp_decrypt_public_key_echo(rdpCredssp* credssp);
+SECURITY_STATUS credssp_encrypt_ts_credentials(rdpCredssp* credssp);
+SECURITY_STATUS credssp_decrypt_ts_credentials(rdpCredssp* credssp);
+
 rdpCredssp* credssp_new(freerdp* instance, rdpTransport* transport, rdpSettings* settings);
 void credssp_free(rdpCredssp* credssp);
 
@@ -28,6 +28,7 @@
 #include <freerdp/api.h>
 #include <freerdp/graphics.h>
 #include <freerdp/codec/bitmap.h>
+#include <freerdp/utils/trace.h>
 
 #include "orders.h"
 
@@ -2033,8 +2034,11 @@ void update_recv_altsec_order(rdpUpdate* update, STREAM* s, BYTE flags)
 
 BOOL update_recv_order(rdpUpdate* update, STREAM* s)
 {
+	UINT64 trace;
 	BYTE controlFlags;
 
+	TRACE_BEGIN(trace);
+
 	stream_read_BYTE(s, controlFlags); /* controlFlags (1 byte) */
 
 	if (!(controlFlags & ORDER_STANDARD))
@@ -2047,5 +2051,7 @@ BOOL update_recv_order(rdpUpdate* update, STREAM* s)
 			return FALSE;
 	}
 
+	TRACE_END(TRACE_ORDER_DECODE, trace);
+
 	return TRUE;
 }
@@ -50,9 +50,29 @@ static BOOL freerdp_peer_get_fds(freerdp_peer* client, void** rfds, int* rcount)
 	rfds[*rcount] = (void*)(long)(client->context->rdp->transport->TcpIn->sockfd);
 	(*rcount)++;
 
+	freerdp_channel_scheduler_get_fds(client->context->rdp->channel_scheduler, rfds, rcount);
+
 	return TRUE;
 }
 
+static void peer_logon(freerdp_peer* client)
+{
+	rdpRdp* rdp = client->context->rdp;
+	rdpCredssp* credssp = rdp->transport->credssp;
+
+	if ((rdp->nego->selected_protocol & PROTOCOL_NLA) && credssp)
+	{
+		sspi_CopyAuthIdentity(&client->identity, &(credssp->identity));
+		IFCALLRET(client->Logon, client->authenticated, client, &client->identity, TRUE);
+		credssp_free(credssp);
+		rdp->transport->credssp = NULL;
+	}
+	else
+	{
+		IFCALLRET(client->Logon, client->authenticated, client, &client->identity, FALSE);
+	}
+}
+
 static BOOL freerdp_peer_check_fds(freerdp_peer* client)
 {
 	int status;
@@ -60,6 +80,19 @@ static BOOL freerdp_peer_check_fds(freerdp_peer* client)
 
 	rdp = client->context->rdp;
 
+	if (rdp->state == CONNECTION_STATE_SECURITY)
+	{
+		status = rdp_server_accept_security(rdp);
+
+		if (status < 0)
+			return FALSE;
+
+		if (status == 0)
+			return TRUE;
+
+		peer_logon(client);
+	}
+
 	status = rdp_check_fds(rdp);
 
 	if (status < 0)
@@ -97,7 +130,8 @@ static BOOL peer_recv_data_pdu(freerdp_peer* client, STREAM* s)
 			break;
 
 		case DATA_PDU_TYPE_BITMAP_CACHE_PERSISTENT_LIST:
-			/* TODO: notify server bitmap cache data */
+			if (!rdp_recv_client_persistent_key_list_pdu(client->context->rdp, s))
+				return FALSE;
 			break;
 
 		case DATA_PDU_TYPE_FONT_LIST:
@@ -258,16 +292,9 @@ static BOOL peer_recv_callback(rdpTransport* transport, STREAM* s, void* extra)
 			if (!rdp_server_accept_nego(rdp, s))
 				return FALSE;
 
-			if (rdp->nego->selected_protocol & PROTOCOL_NLA)
-			{
-				sspi_CopyAuthIdentity(&client->identity, &(rdp->nego->transport->credssp->identity));
-				IFCALLRET(client->Logon, client->authenticated, client, &client->identity, TRUE);
-				credssp_free(rdp->nego->transport->credssp);
-			}
-			else
-			{
-				IFCALLRET(client->Logon, client->authenticated, client, &client->identity, FALSE);
-			}
+			/* with TLS or NLA the logon happens once the handshake completes */
+			if (rdp->state == CONNECTION_STATE_NEGO)
+				peer_logon(client);
 
 			break;
 
@@ -358,6 +385,36 @@ static int freerdp_peer_send_channel_data(freerdp_peer* client, int channelId, B
 	return rdp_send_channel_data(client->context->rdp, channelId, data, size);
 }
 
+static int freerdp_peer_send_channel_buffer(freerdp_peer* client, int channelId, SHARED_BUFFER* buffer, BYTE* data, int size)
+{
+	return freerdp_channel_send_buffer(client->context->rdp, channelId, buffer, data, size);
+}
+
+BOOL freerdp_peer_get_channel_stats(freerdp_peer* client, int channelId, RDP_CHANNEL_STATS* stats)
+{
+	return freerdp_channel_scheduler_get_stats(client->context->rdp->channel_scheduler, channelId, stats);
+}
+
+BOOL freerdp_peer_get_session_stats(freerdp_peer* client, RDP_SESSION_STATS* stats)
+{
+	CopyMemory(stats, &client->context->rdp->stats, sizeof(RDP_SESSION_STATS));
+	return TRUE;
+}
+
+/**
+ * The bitmaps the client announced in its persistent key list, by key,
+ * each with the cell and index it has it at, or NULL if it announced none.
+ * A server can have the client draw them from its cache instead of
+ * sending them again.
+ */
+
+rdpPersistentCache* freerdp_peer_get_persistent_keys(freerdp_peer* client)
+{
+	rdpPersistentKeyList* list = client->context->rdp->persist_list;
+
+	return list ? list->cache : NULL;
+}
+
 void freerdp_peer_context_new(freerdp_peer* client)
 {
 	rdpRdp* rdp;
@@ -411,6 +468,7 @@ freerdp_peer* freerdp_peer_new(int sockfd)
 		client->Close = freerdp_peer_close;
 		client->Disconnect = freerdp_peer_disconnect;
 		client->SendChannelData = freerdp_peer_send_channel_data;
+		client->SendChannelBuffer = freerdp_peer_send_channel_buffer;
 	}
 
 	return client;
@@ -420,8 +478,12 @@ void freerdp_peer_free(freerdp_peer* client)
 {
 	if (client)
 	{
-		rdp_free(client->context->rdp);
-		free(client->context);
+		if (client->context)
+		{
+			rdp_free(client->context->rdp);
+			free(client->context);
+		}
+
 		free(client);
 	}
 }
@@ -26,8 +26,10 @@
 #include "rdp.h"
 
 #include "info.h"
+#include "replay.h"
 #include "redirection.h"
 
+#include <freerdp/peer.h>
 #include <freerdp/crypto/per.h>
 
 #ifdef WITH_DEBUG_RDP
@@ -498,6 +500,9 @@ BOOL rdp_recv_data_pdu(rdpRdp* rdp, STREAM* s)
 			comp_stream->data = rdp->mppc_dec->history_buf + roff;
 			comp_stream->p = comp_stream->data;
 			comp_stream->size = rlen;
+
+			rdp->stats.CompressedBytesReceived += compressed_len - 18;
+			rdp->stats.DecompressedBytesReceived += rlen;
 		}
 		else
 		{
@@ -516,6 +521,7 @@ BOOL rdp_recv_data_pdu(rdpRdp* rdp, STREAM* s)
 	switch (type)
 	{
 		case DATA_PDU_TYPE_UPDATE:
+			rdp->stats.UpdatesReceived++;
 			if (!update_recv(rdp->update, comp_stream))
 				return FALSE;
 			break;
@@ -835,6 +841,9 @@ static BOOL rdp_recv_callback(rdpTransport* transport, STREAM* s, void* extra)
 {
 	rdpRdp* rdp = (rdpRdp*) extra;
 
+	if ((rdp->state == CONNECTION_STATE_FINALIZATION) || (rdp->state == CONNECTION_STATE_ACTIVE))
+		replay_record_pdu(rdp, s);
+
 	switch (rdp->state)
 	{
 		case CONNECTION_STATE_NEGO:
@@ -863,6 +872,8 @@ static BOOL rdp_recv_callback(rdpTransport* transport, STREAM* s, void* extra)
 				printf("rdp_client_connect_demand_active failed\n");
 				return FALSE;
 			}
+			if (rdp->settings->DumpSession && (rdp->state == CONNECTION_STATE_FINALIZATION))
+				replay_record_activation(rdp);
 			break;
 
 		case CONNECTION_STATE_FINALIZATION:
@@ -885,6 +896,16 @@ static BOOL rdp_recv_callback(rdpTransport* transport, STREAM* s, void* extra)
 	return TRUE;
 }
 
+/**
+ * Process a PDU that was not received by the transport, such as one read
+ * from a session dump, the same as if it had been.
+ */
+
+BOOL rdp_recv_replay_pdu(rdpRdp* rdp, STREAM* s)
+{
+	return rdp_recv_callback(rdp->transport, s, rdp);
+}
+
 int rdp_send_channel_data(rdpRdp* rdp, int channel_id, BYTE* data, int size)
 {
 	return freerdp_channel_send(rdp, channel_id, data, size);
@@ -902,9 +923,46 @@ void rdp_set_blocking_mode(rdpRdp* rdp, BOOL blocking)
 	transport_set_blocking_mode(rdp->transport, blocking);
 }
 
+/**
+ * Pass the session counters to the SessionStats callback of the client
+ * or server, at most once every RDP_SESSION_STATS_INTERVAL milliseconds.
+ */
+
+static void rdp_report_session_stats(rdpRdp* rdp)
+{
+	UINT64 now;
+	RDP_SESSION_STATS stats;
+	rdpContext* context = rdp->update->context;
+
+	now = trace_get_time() / 1000000;
+
+	if (now - rdp->stats_time < RDP_SESSION_STATS_INTERVAL)
+		return;
+
+	rdp->stats_time = now;
+	CopyMemory(&stats, &rdp->stats, sizeof(RDP_SESSION_STATS));
+
+	if (context->peer != NULL)
+		IFCALL(context->peer->SessionStats, context->peer, &stats);
+	else if (rdp->instance != NULL)
+		IFCALL(rdp->instance->SessionStats, rdp->instance, &stats);
+}
+
 int rdp_check_fds(rdpRdp* rdp)
 {
-	return transport_check_fds(&(rdp->transport));
+	int status;
+
+	status = transport_check_fds(&(rdp->transport));
+
+	if (status < 0)
+		return status;
+
+	if (freerdp_channel_scheduler_send(rdp->channel_scheduler, CHANNEL_SCHEDULER_BURST_SIZE) < 0)
+		return -1;
+
+	rdp_report_session_stats(rdp);
+
+	return status;
 }
 
 /**
@@ -930,6 +988,8 @@ rdpRdp* rdp_new(freerdp* instance)
 
 		rdp->extension = extension_new(instance);
 		rdp->transport = transport_new(rdp->settings);
+		rdp->transport->stats = &rdp->stats;
+		rdp->stats_time = trace_get_time() / 1000000;
 		rdp->license = license_new(rdp);
 		rdp->input = input_new(rdp);
 		rdp->update = update_new(rdp);
@@ -939,6 +999,7 @@ rdpRdp* rdp_new(freerdp* instance)
 		rdp->redirection = redirection_new();
 		rdp->mppc_dec = mppc_dec_new();
 		rdp->mppc_enc = mppc_enc_new(PROTO_RDP_50);
+		rdp->channel_scheduler = freerdp_channel_scheduler_new(rdp);
 	}
 
 	return rdp;
@@ -970,6 +1031,9 @@ void rdp_free(rdpRdp* rdp)
 		redirection_free(rdp->redirection);
 		mppc_dec_free(rdp->mppc_dec);
 		mppc_enc_free(rdp->mppc_enc);
+		freerdp_channel_scheduler_free(rdp->channel_scheduler);
+		rdp_persistent_key_list_free(rdp->persist_list);
+		replay_free(rdp->replay);
 		free(rdp);
 	}
 }
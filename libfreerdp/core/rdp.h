@@ -45,6 +45,7 @@
 #include <freerdp/settings.h>
 #include <freerdp/utils/debug.h>
 #include <freerdp/utils/stream.h>
+#include <freerdp/utils/trace.h>
 #include <freerdp/codec/mppc_dec.h>
 #include <freerdp/codec/mppc_enc.h>
 
@@ -70,6 +71,8 @@
 #define RDP_SHARE_DATA_HEADER_LENGTH	12
 #define RDP_PACKET_HEADER_MAX_LENGTH	(TPDU_DATA_LENGTH + MCS_SEND_DATA_HEADER_MAX_LENGTH)
 
+#define RDP_SESSION_STATS_INTERVAL	1000
+
 #define PDU_TYPE_DEMAND_ACTIVE		0x1
 #define PDU_TYPE_CONFIRM_ACTIVE		0x3
 #define PDU_TYPE_DEACTIVATE_ALL		0x6
@@ -131,6 +134,9 @@ struct rdp_rdp
 	struct rdp_extension* extension;
 	struct rdp_mppc_dec* mppc_dec;
 	struct rdp_mppc_enc* mppc_enc;
+	struct rdp_channel_scheduler* channel_scheduler;
+	struct rdp_persistent_key_list* persist_list;
+	struct rdp_replay* replay;
 	struct crypto_rc4_struct* rc4_decrypt_key;
 	int decrypt_use_count;
 	int decrypt_checksum_use_count;
@@ -155,6 +161,10 @@ struct rdp_rdp
 	UINT32 errorInfo;
 	UINT32 finalize_sc_pdus;
 	BOOL disconnect;
+	RDP_SESSION_STATS stats;
+	UINT64 stats_time;
+	BOOL in_sent_frame;
+	BOOL in_received_frame;
 };
 
 void rdp_read_security_header(STREAM* s, UINT16* flags);
@@ -186,6 +196,7 @@ void rdp_recv(rdpRdp* rdp);
 int rdp_send_channel_data(rdpRdp* rdp, int channel_id, BYTE* data, int size);
 
 BOOL rdp_recv_out_of_sequence_pdu(rdpRdp* rdp, STREAM* s);
+BOOL rdp_recv_replay_pdu(rdpRdp* rdp, STREAM* s);
 
 void rdp_set_blocking_mode(rdpRdp* rdp, BOOL blocking);
 int rdp_check_fds(rdpRdp* rdp);
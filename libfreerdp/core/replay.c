@@ -0,0 +1,207 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Session Dump and Replay
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <winpr/crt.h>
+
+#include "replay.h"
+
+rdpReplay* replay_new(char* filename, BOOL record)
+{
+	rdpPcap* pcap;
+	rdpReplay* replay;
+
+	pcap = pcap_open(filename, record);
+
+	if (pcap == NULL)
+		return NULL;
+
+	replay = (rdpReplay*) malloc(sizeof(rdpReplay));
+	ZeroMemory(replay, sizeof(rdpReplay));
+
+	replay->pcap = pcap;
+	replay->record = record;
+	replay->s = stream_new(REPLAY_ACTIVATION_LENGTH);
+
+	return replay;
+}
+
+void replay_free(rdpReplay* replay)
+{
+	if (replay == NULL)
+		return;
+
+	pcap_close(replay->pcap);
+	stream_free(replay->s);
+	free(replay);
+}
+
+/**
+ * Records the desktop of an activation, opening the dump on the first
+ * one. PDUs protected by standard RDP security could not be read back
+ * without the session keys, so only TLS and NLA sessions are dumped.
+ */
+
+void replay_record_activation(rdpRdp* rdp)
+{
+	STREAM* s;
+	rdpSettings* settings = rdp->settings;
+
+	if (rdp->replay == NULL)
+	{
+		if (settings->DisableEncryption)
+		{
+			printf("session dumps need TLS or NLA security, not dumping %s\n", settings->DumpSessionFile);
+			settings->DumpSession = FALSE;
+			return;
+		}
+
+		rdp->replay = replay_new(settings->DumpSessionFile, TRUE);
+
+		if (rdp->replay == NULL)
+		{
+			settings->DumpSession = FALSE;
+			return;
+		}
+	}
+
+	if (!rdp->replay->record)
+		return;
+
+	s = rdp->replay->s;
+	stream_set_pos(s, 0);
+
+	stream_write_UINT32(s, REPLAY_SIGNATURE); /* signature (4 bytes) */
+	stream_write_UINT16(s, REPLAY_VERSION); /* version (2 bytes) */
+	stream_write_UINT16(s, settings->DesktopWidth); /* desktopWidth (2 bytes) */
+	stream_write_UINT16(s, settings->DesktopHeight); /* desktopHeight (2 bytes) */
+	stream_write_UINT16(s, settings->ColorDepth); /* colorDepth (2 bytes) */
+
+	pcap_add_record(rdp->replay->pcap, stream_get_head(s), stream_get_length(s));
+	pcap_flush(rdp->replay->pcap);
+
+	rdp->replay->activations++;
+}
+
+void replay_record_pdu(rdpRdp* rdp, STREAM* s)
+{
+	if ((rdp->replay == NULL) || !rdp->replay->record)
+		return;
+
+	pcap_add_record(rdp->replay->pcap, stream_get_head(s), stream_get_size(s));
+	pcap_flush(rdp->replay->pcap);
+}
+
+static BOOL replay_is_activation(STREAM* s)
+{
+	UINT32 signature;
+
+	if (stream_get_size(s) != REPLAY_ACTIVATION_LENGTH)
+		return FALSE;
+
+	stream_read_UINT32(s, signature);
+	stream_set_pos(s, 0);
+
+	return (signature == REPLAY_SIGNATURE) ? TRUE : FALSE;
+}
+
+/**
+ * Activates the session the way the demand active PDU did when it was
+ * dumped, resizing the desktop on a reactivation.
+ */
+
+static BOOL replay_recv_activation(rdpRdp* rdp, STREAM* s)
+{
+	UINT16 version;
+	UINT16 width;
+	UINT16 height;
+	UINT16 colorDepth;
+	rdpSettings* settings = rdp->settings;
+
+	stream_seek_UINT32(s); /* signature (4 bytes) */
+	stream_read_UINT16(s, version); /* version (2 bytes) */
+	stream_read_UINT16(s, width); /* desktopWidth (2 bytes) */
+	stream_read_UINT16(s, height); /* desktopHeight (2 bytes) */
+	stream_read_UINT16(s, colorDepth); /* colorDepth (2 bytes) */
+
+	if (version != REPLAY_VERSION)
+	{
+		printf("unsupported session dump version %d\n", version);
+		return FALSE;
+	}
+
+	if (rdp->replay->activations == 0)
+	{
+		/* no RDP security: the PDUs were dumped as TLS handed them over */
+		settings->DisableEncryption = FALSE;
+		settings->DesktopWidth = width;
+		settings->DesktopHeight = height;
+		settings->ColorDepth = colorDepth;
+		rdp->finalize_sc_pdus = 0;
+	}
+	else if ((width != settings->DesktopWidth) || (height != settings->DesktopHeight))
+	{
+		settings->DesktopWidth = width;
+		settings->DesktopHeight = height;
+		IFCALL(rdp->update->DesktopResize, rdp->update->context);
+	}
+
+	rdp->replay->activations++;
+	rdp->state = CONNECTION_STATE_FINALIZATION;
+	update_reset_state(rdp->update);
+
+	return TRUE;
+}
+
+/**
+ * Plays the next record of a session dump.
+ * @return 1 if a record was played, 0 at the end of the dump, -1 on error
+ */
+
+int replay_check(rdpRdp* rdp)
+{
+	STREAM* s;
+	int status = 1;
+	pcap_record record;
+
+	if (!pcap_get_next_record_header(rdp->replay->pcap, &record))
+		return 0;
+
+	s = stream_new(record.length);
+	record.data = stream_get_head(s);
+	pcap_get_next_record_content(rdp->replay->pcap, &record);
+
+	if (replay_is_activation(s))
+	{
+		if (!replay_recv_activation(rdp, s))
+			status = -1;
+	}
+	else if ((rdp->replay->activations == 0) || !rdp_recv_replay_pdu(rdp, s))
+	{
+		status = -1;
+	}
+
+	stream_free(s);
+
+	return status;
+}
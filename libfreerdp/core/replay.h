@@ -0,0 +1,57 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Session Dump and Replay
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __REPLAY_H
+#define __REPLAY_H
+
+typedef struct rdp_replay rdpReplay;
+
+#include "rdp.h"
+
+#include <freerdp/utils/pcap.h>
+#include <freerdp/utils/stream.h>
+
+/**
+ * A session dump is a pcap file of the PDUs a client received once its
+ * session was activated, one record per PDU as the transport handed it
+ * over, TPKT or fast-path. Every activation is recorded before the PDUs
+ * following it, in a record of its own starting with the signature
+ * instead of a TPKT or fast-path header.
+ */
+
+#define REPLAY_SIGNATURE		0x53504452 /* "RDPS" */
+#define REPLAY_VERSION			1
+#define REPLAY_ACTIVATION_LENGTH	12
+
+struct rdp_replay
+{
+	rdpPcap* pcap;
+	BOOL record;
+	STREAM* s;
+
+	UINT32 activations;
+};
+
+rdpReplay* replay_new(char* filename, BOOL record);
+void replay_free(rdpReplay* replay);
+
+void replay_record_activation(rdpRdp* rdp);
+void replay_record_pdu(rdpRdp* rdp, STREAM* s);
+
+int replay_check(rdpRdp* rdp);
+
+#endif /* __REPLAY_H */
@@ -0,0 +1,620 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * RDP Server Runtime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <winpr/crt.h>
+
+#include "runtime.h"
+
+#ifdef HAVE_SYS_EPOLL_H
+
+#include <time.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+
+/**
+ * Each worker owns an epoll set and the sessions registered in it. Peers
+ * are handed to a worker through its pipe and from then on only touched by
+ * that worker thread, so no per-session locking is needed. A NULL pointer
+ * written to the pipe asks the worker to close its sessions and exit.
+ */
+
+static BOOL freerdp_runtime_default_get_fds(freerdp_runtime* instance, freerdp_peer* client, void** rfds, int* rcount)
+{
+	return client->GetFileDescriptor(client, rfds, rcount);
+}
+
+static BOOL freerdp_runtime_default_check_fds(freerdp_runtime* instance, freerdp_peer* client)
+{
+	return client->CheckFileDescriptor(client);
+}
+
+static void freerdp_runtime_default_closed(freerdp_runtime* instance, freerdp_peer* client)
+{
+	client->Disconnect(client);
+	freerdp_peer_context_free(client);
+	freerdp_peer_free(client);
+}
+
+static BOOL freerdp_runtime_session_has_fd(rdpRuntimeSession* session, int fd)
+{
+	int i;
+
+	for (i = 0; i < session->num_fds; i++)
+	{
+		if (session->fds[i] == fd)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+/**
+ * Brings the epoll registration of a session in line with the descriptors
+ * its peer currently reports. The set only changes when channels come and
+ * go, so this is a handful of compares per dispatch in the common case.
+ */
+static BOOL freerdp_runtime_session_update_fds(rdpRuntimeSession* session)
+{
+	int i, j;
+	int fd;
+	int rcount;
+	BOOL found;
+	void* rfds[RUNTIME_MAX_FDS];
+	struct epoll_event event;
+	rdpRuntimeWorker* worker = session->worker;
+	freerdp_runtime* instance = worker->runtime->instance;
+
+	rcount = 0;
+
+	if (instance->PeerGetFileDescriptor(instance, session->client, rfds, &rcount) != TRUE)
+		return FALSE;
+
+	for (i = 0; i < session->num_fds; )
+	{
+		found = FALSE;
+
+		for (j = 0; j < rcount; j++)
+		{
+			if ((int)(long)(rfds[j]) == session->fds[i])
+			{
+				found = TRUE;
+				break;
+			}
+		}
+
+		if (found)
+		{
+			i++;
+			continue;
+		}
+
+		epoll_ctl(worker->epfd, EPOLL_CTL_DEL, session->fds[i], NULL);
+		session->fds[i] = session->fds[--session->num_fds];
+	}
+
+	for (i = 0; i < rcount; i++)
+	{
+		fd = (int)(long)(rfds[i]);
+
+		if ((fd < 0) || freerdp_runtime_session_has_fd(session, fd))
+			continue;
+
+		if (session->num_fds >= RUNTIME_MAX_FDS)
+			break;
+
+		ZeroMemory(&event, sizeof(event));
+		event.events = EPOLLIN;
+		event.data.ptr = session;
+
+		if (epoll_ctl(worker->epfd, EPOLL_CTL_ADD, fd, &event) != 0)
+		{
+			perror("epoll_ctl");
+			continue;
+		}
+
+		session->fds[session->num_fds++] = fd;
+	}
+
+	return (session->num_fds > 0) ? TRUE : FALSE;
+}
+
+/**
+ * The session structure itself is only freed at the end of the current
+ * epoll batch, since later events of the same batch may still point to it.
+ */
+static void freerdp_runtime_session_close(rdpRuntimeSession* session)
+{
+	int i;
+	rdpRuntimeWorker* worker = session->worker;
+	rdpRuntime* runtime = worker->runtime;
+	freerdp_runtime* instance = runtime->instance;
+
+	for (i = 0; i < session->num_fds; i++)
+		epoll_ctl(worker->epfd, EPOLL_CTL_DEL, session->fds[i], NULL);
+
+	session->num_fds = 0;
+	session->closed = TRUE;
+
+	if (session->prev)
+		session->prev->next = session->next;
+	else
+		worker->sessions = session->next;
+
+	if (session->next)
+		session->next->prev = session->prev;
+
+	session->prev = NULL;
+	session->next = worker->closed;
+	worker->closed = session;
+
+	pthread_mutex_lock(&runtime->mutex);
+	worker->num_sessions--;
+	pthread_mutex_unlock(&runtime->mutex);
+
+	instance->PeerClosed(instance, session->client);
+}
+
+static void freerdp_runtime_session_open(rdpRuntimeWorker* worker, freerdp_peer* client)
+{
+	rdpRuntimeSession* session;
+
+	session = (rdpRuntimeSession*) malloc(sizeof(rdpRuntimeSession));
+	ZeroMemory(session, sizeof(rdpRuntimeSession));
+
+	session->client = client;
+	session->worker = worker;
+
+	session->next = worker->sessions;
+	if (worker->sessions)
+		worker->sessions->prev = session;
+	worker->sessions = session;
+
+	if (freerdp_runtime_session_update_fds(session) != TRUE)
+	{
+		fprintf(stderr, "freerdp_runtime: failed to get peer file descriptors\n");
+		freerdp_runtime_session_close(session);
+	}
+}
+
+static void freerdp_runtime_session_dispatch(rdpRuntimeSession* session)
+{
+	rdpRuntimeWorker* worker = session->worker;
+	freerdp_runtime* instance = worker->runtime->instance;
+
+	worker->dispatches++;
+
+	if (instance->PeerCheckFileDescriptor(instance, session->client) != TRUE)
+	{
+		freerdp_runtime_session_close(session);
+		return;
+	}
+
+	if (freerdp_runtime_session_update_fds(session) != TRUE)
+		freerdp_runtime_session_close(session);
+}
+
+/**
+ * Registers the peers queued on the worker pipe. Returns FALSE once the
+ * stop marker has been read.
+ */
+static BOOL freerdp_runtime_worker_drain(rdpRuntimeWorker* worker)
+{
+	int i;
+	int count;
+	ssize_t status;
+	freerdp_peer* clients[RUNTIME_MAX_EVENTS];
+
+	while (1)
+	{
+		status = read(worker->pipefds[0], clients, sizeof(clients));
+
+		if (status < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			return TRUE;
+		}
+
+		if (status == 0)
+			return FALSE;
+
+		count = (int) (status / sizeof(freerdp_peer*));
+
+		for (i = 0; i < count; i++)
+		{
+			if (clients[i] == NULL)
+				return FALSE;
+
+			freerdp_runtime_session_open(worker, clients[i]);
+		}
+	}
+
+	return TRUE;
+}
+
+static void* freerdp_runtime_worker_main(void* arg)
+{
+	int i;
+	int count;
+	BOOL running = TRUE;
+	rdpRuntimeSession* session;
+	struct epoll_event events[RUNTIME_MAX_EVENTS];
+	rdpRuntimeWorker* worker = (rdpRuntimeWorker*) arg;
+
+	while (running)
+	{
+		count = epoll_wait(worker->epfd, events, RUNTIME_MAX_EVENTS, -1);
+
+		if (count < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			perror("epoll_wait");
+			break;
+		}
+
+		worker->batch++;
+
+		for (i = 0; i < count; i++)
+		{
+			session = (rdpRuntimeSession*) events[i].data.ptr;
+
+			if (session == NULL)
+			{
+				if (freerdp_runtime_worker_drain(worker) != TRUE)
+					running = FALSE;
+
+				continue;
+			}
+
+			/* a peer checks all of its descriptors at once */
+			if (session->closed || (session->batch == worker->batch))
+				continue;
+
+			session->batch = worker->batch;
+			freerdp_runtime_session_dispatch(session);
+		}
+
+		while (worker->closed)
+		{
+			session = worker->closed;
+			worker->closed = session->next;
+			free(session);
+		}
+	}
+
+	while (worker->sessions)
+		freerdp_runtime_session_close(worker->sessions);
+
+	while (worker->closed)
+	{
+		session = worker->closed;
+		worker->closed = session->next;
+		free(session);
+	}
+
+	return NULL;
+}
+
+static void freerdp_runtime_worker_uninit(rdpRuntimeWorker* worker)
+{
+	if (worker->epfd >= 0)
+		close(worker->epfd);
+
+	if (worker->pipefds[0] >= 0)
+		close(worker->pipefds[0]);
+
+	if (worker->pipefds[1] >= 0)
+		close(worker->pipefds[1]);
+
+	worker->epfd = -1;
+	worker->pipefds[0] = -1;
+	worker->pipefds[1] = -1;
+}
+
+static BOOL freerdp_runtime_worker_init(rdpRuntimeWorker* worker)
+{
+	struct epoll_event event;
+
+	worker->epfd = epoll_create(RUNTIME_MAX_EVENTS);
+
+	if (worker->epfd < 0)
+	{
+		perror("epoll_create");
+		return FALSE;
+	}
+
+	if (pipe(worker->pipefds) != 0)
+	{
+		perror("pipe");
+		worker->pipefds[0] = worker->pipefds[1] = -1;
+		freerdp_runtime_worker_uninit(worker);
+		return FALSE;
+	}
+
+	fcntl(worker->pipefds[0], F_SETFL, O_NONBLOCK);
+	fcntl(worker->epfd, F_SETFD, FD_CLOEXEC);
+	fcntl(worker->pipefds[0], F_SETFD, FD_CLOEXEC);
+	fcntl(worker->pipefds[1], F_SETFD, FD_CLOEXEC);
+
+	ZeroMemory(&event, sizeof(event));
+	event.events = EPOLLIN;
+	event.data.ptr = NULL;
+
+	if (epoll_ctl(worker->epfd, EPOLL_CTL_ADD, worker->pipefds[0], &event) != 0)
+	{
+		perror("epoll_ctl");
+		freerdp_runtime_worker_uninit(worker);
+		return FALSE;
+	}
+
+	worker->batch = 0;
+	worker->dispatches = 0;
+	worker->num_sessions = 0;
+
+	return TRUE;
+}
+
+static void freerdp_runtime_stop(freerdp_runtime* instance)
+{
+	int i;
+	freerdp_peer* marker = NULL;
+	rdpRuntime* runtime = (rdpRuntime*) instance->runtime;
+
+	pthread_mutex_lock(&runtime->mutex);
+
+	if (!runtime->started)
+	{
+		pthread_mutex_unlock(&runtime->mutex);
+		return;
+	}
+
+	runtime->started = FALSE;
+
+	for (i = 0; i < runtime->num_workers; i++)
+	{
+		if (runtime->workers[i].started)
+		{
+			if (write(runtime->workers[i].pipefds[1], &marker, sizeof(marker)) != sizeof(marker))
+				perror("write");
+		}
+	}
+
+	pthread_mutex_unlock(&runtime->mutex);
+
+	for (i = 0; i < runtime->num_workers; i++)
+	{
+		if (runtime->workers[i].started)
+			pthread_join(runtime->workers[i].thread, NULL);
+
+		runtime->workers[i].started = FALSE;
+		freerdp_runtime_worker_uninit(&runtime->workers[i]);
+	}
+}
+
+static BOOL freerdp_runtime_start(freerdp_runtime* instance)
+{
+	int i;
+	rdpRuntimeWorker* worker;
+	rdpRuntime* runtime = (rdpRuntime*) instance->runtime;
+
+	pthread_mutex_lock(&runtime->mutex);
+
+	if (runtime->started)
+	{
+		pthread_mutex_unlock(&runtime->mutex);
+		return TRUE;
+	}
+
+	for (i = 0; i < runtime->num_workers; i++)
+	{
+		worker = &runtime->workers[i];
+
+		if (freerdp_runtime_worker_init(worker) != TRUE)
+			break;
+
+		if (pthread_create(&worker->thread, NULL, freerdp_runtime_worker_main, worker) != 0)
+		{
+			perror("pthread_create");
+			freerdp_runtime_worker_uninit(worker);
+			break;
+		}
+
+		worker->started = TRUE;
+	}
+
+	runtime->started = TRUE;
+	pthread_mutex_unlock(&runtime->mutex);
+
+	if (i < runtime->num_workers)
+	{
+		freerdp_runtime_stop(instance);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/**
+ * Binds the peer to the worker currently serving the fewest sessions.
+ */
+static BOOL freerdp_runtime_add_peer(freerdp_runtime* instance, freerdp_peer* client)
+{
+	int i;
+	ssize_t status;
+	rdpRuntimeWorker* worker;
+	rdpRuntime* runtime = (rdpRuntime*) instance->runtime;
+
+	pthread_mutex_lock(&runtime->mutex);
+
+	if (!runtime->started)
+	{
+		pthread_mutex_unlock(&runtime->mutex);
+		return FALSE;
+	}
+
+	worker = &runtime->workers[0];
+
+	for (i = 1; i < runtime->num_workers; i++)
+	{
+		if (runtime->workers[i].num_sessions < worker->num_sessions)
+			worker = &runtime->workers[i];
+	}
+
+	worker->num_sessions++;
+
+	do
+	{
+		status = write(worker->pipefds[1], &client, sizeof(client));
+	}
+	while ((status < 0) && (errno == EINTR));
+
+	if (status != sizeof(client))
+	{
+		perror("write");
+		worker->num_sessions--;
+		pthread_mutex_unlock(&runtime->mutex);
+		return FALSE;
+	}
+
+	pthread_mutex_unlock(&runtime->mutex);
+
+	return TRUE;
+}
+
+static BOOL freerdp_runtime_get_worker_stats(freerdp_runtime* instance, int index, RUNTIME_WORKER_STATS* stats)
+{
+	clockid_t clock;
+	struct timespec ts;
+	rdpRuntimeWorker* worker;
+	rdpRuntime* runtime = (rdpRuntime*) instance->runtime;
+
+	if ((index < 0) || (index >= runtime->num_workers))
+		return FALSE;
+
+	worker = &runtime->workers[index];
+
+	pthread_mutex_lock(&runtime->mutex);
+
+	stats->sessions = worker->num_sessions;
+	stats->dispatches = worker->dispatches;
+	stats->cpu_time_us = 0;
+
+	if (worker->started && (pthread_getcpuclockid(worker->thread, &clock) == 0))
+	{
+		if (clock_gettime(clock, &ts) == 0)
+			stats->cpu_time_us = ((UINT64) ts.tv_sec) * 1000000 + (ts.tv_nsec / 1000);
+	}
+
+	pthread_mutex_unlock(&runtime->mutex);
+
+	return TRUE;
+}
+
+freerdp_runtime* freerdp_runtime_new(int num_workers)
+{
+	int i;
+	long cpus;
+	rdpRuntime* runtime;
+	freerdp_runtime* instance;
+
+	if (num_workers < 1)
+	{
+		cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		num_workers = (cpus > 0) ? (int) cpus : 1;
+	}
+
+	instance = (freerdp_runtime*) malloc(sizeof(freerdp_runtime));
+	ZeroMemory(instance, sizeof(freerdp_runtime));
+
+	instance->num_workers = num_workers;
+
+	instance->Start = freerdp_runtime_start;
+	instance->Stop = freerdp_runtime_stop;
+	instance->AddPeer = freerdp_runtime_add_peer;
+	instance->GetWorkerStats = freerdp_runtime_get_worker_stats;
+
+	instance->PeerGetFileDescriptor = freerdp_runtime_default_get_fds;
+	instance->PeerCheckFileDescriptor = freerdp_runtime_default_check_fds;
+	instance->PeerClosed = freerdp_runtime_default_closed;
+
+	runtime = (rdpRuntime*) malloc(sizeof(rdpRuntime));
+	ZeroMemory(runtime, sizeof(rdpRuntime));
+
+	runtime->instance = instance;
+	runtime->num_workers = num_workers;
+	pthread_mutex_init(&runtime->mutex, NULL);
+
+	runtime->workers = (rdpRuntimeWorker*) malloc(sizeof(rdpRuntimeWorker) * num_workers);
+	ZeroMemory(runtime->workers, sizeof(rdpRuntimeWorker) * num_workers);
+
+	for (i = 0; i < num_workers; i++)
+	{
+		runtime->workers[i].runtime = runtime;
+		runtime->workers[i].epfd = -1;
+		runtime->workers[i].pipefds[0] = -1;
+		runtime->workers[i].pipefds[1] = -1;
+	}
+
+	instance->runtime = (void*) runtime;
+
+	return instance;
+}
+
+void freerdp_runtime_free(freerdp_runtime* instance)
+{
+	rdpRuntime* runtime;
+
+	if (!instance)
+		return;
+
+	runtime = (rdpRuntime*) instance->runtime;
+
+	freerdp_runtime_stop(instance);
+
+	pthread_mutex_destroy(&runtime->mutex);
+	free(runtime->workers);
+	free(runtime);
+
+	free(instance);
+}
+
+#else
+
+freerdp_runtime* freerdp_runtime_new(int num_workers)
+{
+	return NULL;
+}
+
+void freerdp_runtime_free(freerdp_runtime* instance)
+{
+
+}
+
+#endif
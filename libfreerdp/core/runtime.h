@@ -0,0 +1,80 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * RDP Server Runtime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __RUNTIME_H
+#define __RUNTIME_H
+
+typedef struct rdp_runtime rdpRuntime;
+typedef struct rdp_runtime_worker rdpRuntimeWorker;
+typedef struct rdp_runtime_session rdpRuntimeSession;
+
+#include "rdp.h"
+#include <freerdp/runtime.h>
+
+#ifdef HAVE_SYS_EPOLL_H
+
+#include <pthread.h>
+
+#define RUNTIME_MAX_FDS		32
+#define RUNTIME_MAX_EVENTS	64
+
+struct rdp_runtime_session
+{
+	freerdp_peer* client;
+	rdpRuntimeWorker* worker;
+
+	int fds[RUNTIME_MAX_FDS];
+	int num_fds;
+
+	BOOL closed;
+	UINT32 batch;
+
+	rdpRuntimeSession* prev;
+	rdpRuntimeSession* next;
+};
+
+struct rdp_runtime_worker
+{
+	rdpRuntime* runtime;
+	pthread_t thread;
+	BOOL started;
+
+	int epfd;
+	int pipefds[2];
+
+	int num_sessions;
+	UINT64 dispatches;
+	UINT32 batch;
+
+	rdpRuntimeSession* sessions;
+	rdpRuntimeSession* closed;
+};
+
+struct rdp_runtime
+{
+	freerdp_runtime* instance;
+
+	pthread_mutex_t mutex;
+	BOOL started;
+
+	int num_workers;
+	rdpRuntimeWorker* workers;
+};
+
+#endif
+
+#endif
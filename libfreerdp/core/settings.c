@@ -445,6 +445,8 @@ void freerdp_settings_free(rdpSettings* settings)
 		free(settings->ServerAutoReconnectCookie);
 		free(settings->ClientTimeZone);
 		free(settings->BitmapCacheV2CellInfo);
+		free(settings->BitmapCachePersistFile);
+		free(settings->DumpSessionFile);
 		free(settings->GlyphCache);
 		free(settings->FragCache);
 		key_free(settings->RdpServerRsaKey);
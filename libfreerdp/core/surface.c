@@ -45,6 +45,9 @@ static int update_recv_surfcmd_surface_bits(rdpUpdate* update, STREAM* s)
 
 	IFCALL(update->SurfaceBits, update->context, cmd);
 
+	if (!update->context->rdp->in_received_frame)
+		update->context->rdp->stats.FramesReceived++;
+
 	stream_set_pos(s, pos);
 
 	return 20 + cmd->bitmapDataLength;
@@ -68,6 +71,16 @@ static int update_recv_surfcmd_frame_marker(rdpUpdate* update, STREAM* s)
 
 	IFCALL(update->SurfaceFrameMarker, update->context, marker);
 
+	if (marker->frameAction == SURFACECMD_FRAMEACTION_BEGIN)
+	{
+		update->context->rdp->in_received_frame = TRUE;
+	}
+	else if (marker->frameAction == SURFACECMD_FRAMEACTION_END)
+	{
+		update->context->rdp->in_received_frame = FALSE;
+		update->context->rdp->stats.FramesReceived++;
+	}
+
 	if (update->context->rdp->settings->ReceivedCapabilities[CAPSET_TYPE_FRAME_ACKNOWLEDGE] && update->context->rdp->settings->FrameAcknowledge > 0 && marker->frameAction == SURFACECMD_FRAMEACTION_END)
 	{
 		update_send_frame_acknowledge(update->context->rdp, marker->frameId);
@@ -0,0 +1,328 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include <winpr/crt.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/utils/stopwatch.h>
+
+#include "transport.h"
+
+/**
+ * Connection rate benchmark for the server side TLS accept state machine.
+ * A single thread keeps TEST_CONCURRENCY loopback TCP connections in their
+ * handshake at once, stepping the server transport with
+ * transport_accept_check() and an OpenSSL client with SSL_do_handshake()
+ * whenever their sockets are readable. A blocking accept would serialize
+ * the handshakes; here they all progress together.
+ *
+ * Usage: TestCoreAccept [handshakes] [concurrency]
+ */
+
+#define TEST_HANDSHAKES		128
+#define TEST_CONCURRENCY	16
+
+typedef struct
+{
+	int server_fd;
+	int client_fd;
+	SSL* client_ssl;
+	BOOL client_done;
+	BOOL server_done;
+	rdpSettings* settings;
+	rdpTransport* transport;
+} testConnection;
+
+static int test_listen(UINT16* port)
+{
+	int sockfd;
+	socklen_t length;
+	struct sockaddr_in addr;
+
+	sockfd = socket(AF_INET, SOCK_STREAM, 0);
+
+	ZeroMemory(&addr, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = 0;
+
+	if (bind(sockfd, (struct sockaddr*) &addr, sizeof(addr)) != 0)
+	{
+		perror("bind");
+		close(sockfd);
+		return -1;
+	}
+
+	if (listen(sockfd, 128) != 0)
+	{
+		perror("listen");
+		close(sockfd);
+		return -1;
+	}
+
+	length = sizeof(addr);
+	getsockname(sockfd, (struct sockaddr*) &addr, &length);
+	*port = ntohs(addr.sin_port);
+
+	return sockfd;
+}
+
+static BOOL test_connection_open(testConnection* connection, int listenfd, UINT16 port, SSL_CTX* client_ctx)
+{
+	int option_value = 1;
+	struct sockaddr_in addr;
+
+	ZeroMemory(connection, sizeof(testConnection));
+
+	ZeroMemory(&addr, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(port);
+
+	connection->client_fd = socket(AF_INET, SOCK_STREAM, 0);
+
+	if (connect(connection->client_fd, (struct sockaddr*) &addr, sizeof(addr)) != 0)
+	{
+		perror("connect");
+		return FALSE;
+	}
+
+	connection->server_fd = accept(listenfd, NULL, NULL);
+
+	if (connection->server_fd < 0)
+	{
+		perror("accept");
+		return FALSE;
+	}
+
+	setsockopt(connection->client_fd, IPPROTO_TCP, TCP_NODELAY, &option_value, sizeof(option_value));
+	setsockopt(connection->server_fd, IPPROTO_TCP, TCP_NODELAY, &option_value, sizeof(option_value));
+	fcntl(connection->client_fd, F_SETFL, O_NONBLOCK);
+
+	connection->settings = freerdp_settings_new(NULL);
+	connection->settings->ServerMode = TRUE;
+	connection->settings->CertificateFile = _strdup(TEST_SERVER_CERT);
+	connection->settings->PrivateKeyFile = _strdup(TEST_SERVER_KEY);
+
+	connection->transport = transport_new(connection->settings);
+	transport_attach(connection->transport, connection->server_fd);
+	transport_set_blocking_mode(connection->transport, FALSE);
+
+	if (transport_accept_tls(connection->transport) != TRUE)
+	{
+		printf("transport_accept_tls failed\n");
+		return FALSE;
+	}
+
+	connection->client_ssl = SSL_new(client_ctx);
+	SSL_set_fd(connection->client_ssl, connection->client_fd);
+	SSL_set_connect_state(connection->client_ssl);
+
+	return TRUE;
+}
+
+static void test_connection_close(testConnection* connection)
+{
+	if (connection->client_ssl)
+		SSL_free(connection->client_ssl);
+
+	if (connection->transport)
+		transport_free(connection->transport);
+
+	if (connection->settings)
+		freerdp_settings_free(connection->settings);
+
+	if (connection->client_fd >= 0)
+		close(connection->client_fd);
+
+	if (connection->server_fd >= 0)
+		close(connection->server_fd);
+
+	ZeroMemory(connection, sizeof(testConnection));
+	connection->client_fd = -1;
+	connection->server_fd = -1;
+}
+
+/**
+ * @return 1 when both sides have completed the handshake, 0 if not yet, -1 on failure
+ */
+static int test_connection_step(testConnection* connection)
+{
+	int status;
+
+	if (!connection->client_done)
+	{
+		status = SSL_do_handshake(connection->client_ssl);
+
+		if (status > 0)
+		{
+			connection->client_done = TRUE;
+		}
+		else
+		{
+			status = SSL_get_error(connection->client_ssl, status);
+
+			if ((status != SSL_ERROR_WANT_READ) && (status != SSL_ERROR_WANT_WRITE))
+			{
+				printf("client handshake failed: %d\n", status);
+				return -1;
+			}
+		}
+	}
+
+	if (!connection->server_done)
+	{
+		status = transport_accept_check(connection->transport);
+
+		if (status < 0)
+			return -1;
+
+		if (status > 0)
+			connection->server_done = TRUE;
+	}
+
+	return (connection->client_done && connection->server_done) ? 1 : 0;
+}
+
+int TestCoreAccept(int argc, char* argv[])
+{
+	int i;
+	int listenfd;
+	int started;
+	int completed;
+	int active;
+	int handshakes = TEST_HANDSHAKES;
+	int concurrency = TEST_CONCURRENCY;
+	int status;
+	UINT16 port;
+	double elapsed;
+	SSL_CTX* client_ctx;
+	STOPWATCH* stopwatch;
+	struct pollfd* pfds;
+	testConnection* connections;
+
+	if (argc > 1)
+		handshakes = atoi(argv[1]);
+
+	if (argc > 2)
+		concurrency = atoi(argv[2]);
+
+	if (handshakes < 1)
+		handshakes = TEST_HANDSHAKES;
+
+	if (concurrency < 1)
+		concurrency = TEST_CONCURRENCY;
+
+	concurrency = MIN(concurrency, handshakes);
+
+	SSL_load_error_strings();
+	SSL_library_init();
+
+	listenfd = test_listen(&port);
+
+	if (listenfd < 0)
+		return -1;
+
+	client_ctx = SSL_CTX_new(SSLv23_client_method());
+
+	connections = (testConnection*) malloc(sizeof(testConnection) * concurrency);
+	pfds = (struct pollfd*) malloc(sizeof(struct pollfd) * concurrency * 2);
+
+	started = 0;
+	completed = 0;
+	status = 0;
+
+	stopwatch = stopwatch_create();
+	stopwatch_start(stopwatch);
+
+	for (i = 0; i < concurrency; i++)
+	{
+		if (!test_connection_open(&connections[i], listenfd, port, client_ctx))
+			return -1;
+
+		started++;
+	}
+
+	active = concurrency;
+
+	while (active > 0)
+	{
+		for (i = 0; i < concurrency; i++)
+		{
+			pfds[i * 2].fd = connections[i].client_fd;
+			pfds[i * 2].events = POLLIN;
+			pfds[i * 2 + 1].fd = connections[i].server_fd;
+			pfds[i * 2 + 1].events = POLLIN;
+		}
+
+		poll(pfds, concurrency * 2, 100);
+
+		for (i = 0; i < concurrency; i++)
+		{
+			if (connections[i].transport == NULL)
+				continue;
+
+			status = test_connection_step(&connections[i]);
+
+			if (status < 0)
+				break;
+
+			if (status == 0)
+				continue;
+
+			test_connection_close(&connections[i]);
+			completed++;
+			active--;
+
+			if (started < handshakes)
+			{
+				if (!test_connection_open(&connections[i], listenfd, port, client_ctx))
+				{
+					status = -1;
+					break;
+				}
+
+				started++;
+				active++;
+			}
+		}
+
+		if (status < 0)
+			break;
+	}
+
+	stopwatch_stop(stopwatch);
+	elapsed = stopwatch_get_elapsed_time_in_seconds(stopwatch);
+	stopwatch_free(stopwatch);
+
+	for (i = 0; i < concurrency; i++)
+	{
+		if (connections[i].transport)
+			test_connection_close(&connections[i]);
+	}
+
+	free(pfds);
+	free(connections);
+	SSL_CTX_free(client_ctx);
+	close(listenfd);
+
+	if (status < 0)
+	{
+		printf("handshake %d of %d failed\n", completed + 1, handshakes);
+		return -1;
+	}
+
+	printf("%d TLS handshakes, %d concurrent, in %.3f s: %.1f handshakes/s\n",
+		completed, concurrency, elapsed, (elapsed > 0.0) ? (completed / elapsed) : 0.0);
+
+	return 0;
+}
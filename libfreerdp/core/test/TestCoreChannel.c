@@ -0,0 +1,333 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <winpr/crt.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/peer.h>
+
+#include "rdp.h"
+#include "channel.h"
+
+/**
+ * Checks the virtual channel send scheduler on a peer whose transport is
+ * one end of a socketpair. The other end is parsed back into channel
+ * chunks: every channel has to come out in FIFO order with the sender's
+ * data even when the sender reuses its buffer right away, the channels
+ * backlogged together have to share the link by their priority weights,
+ * and a small high priority message has to get past a bulk backlog on the
+ * pass that queued it. Data sent from a shared buffer has to be sent in
+ * place, keeping the buffer referenced until the last chunk is out.
+ */
+
+#define TEST_CHANNEL_HIGH	1004
+#define TEST_CHANNEL_MED	1005
+#define TEST_CHANNEL_LOW	1006
+
+#define TEST_BULK_SIZE		(256 * 1024)
+
+typedef struct
+{
+	UINT16 id;
+	BYTE* data;
+	int size;
+	int offset;
+	int chunks;
+	int messages;
+} testChannel;
+
+static testChannel test_channels[3];
+static int test_sequence[4096];
+static int test_sequence_length = 0;
+
+static testChannel* test_find_channel(UINT16 id)
+{
+	int i;
+
+	for (i = 0; i < 3; i++)
+	{
+		if (test_channels[i].id == id)
+			return &test_channels[i];
+	}
+
+	return NULL;
+}
+
+static void test_pattern(BYTE* data, int size, int seed)
+{
+	int i;
+
+	for (i = 0; i < size; i++)
+		data[i] = (BYTE) ((i * 7) + seed);
+}
+
+/**
+ * Read one PDU: TPKT, X.224 data, MCS send data indication, then the
+ * channel PDU header and the chunk.
+ * @return 1 on a chunk, 0 if nothing is pending, -1 on error
+ */
+
+static int test_read_chunk(int fd)
+{
+	int length;
+	UINT32 total;
+	UINT32 flags;
+	UINT16 id;
+	BYTE header[23];
+	BYTE chunk[65536];
+	testChannel* channel;
+
+	length = recv(fd, header, 4, MSG_DONTWAIT | MSG_PEEK);
+
+	if (length < 4)
+		return ((length < 0) && (errno == EAGAIN)) ? 0 : -1;
+
+	if (recv(fd, header, sizeof(header), MSG_WAITALL) != sizeof(header))
+		return -1;
+
+	length = ((header[2] << 8) | header[3]) - sizeof(header);
+	id = (header[10] << 8) | header[11];
+	total = header[15] | (header[16] << 8) | (header[17] << 16) | (header[18] << 24);
+	flags = header[19] | (header[20] << 8) | (header[21] << 16) | (header[22] << 24);
+
+	if ((length < 0) || (length > (int) sizeof(chunk)) || (recv(fd, chunk, length, MSG_WAITALL) != length))
+		return -1;
+
+	channel = test_find_channel(id);
+
+	if (channel == NULL)
+	{
+		printf("chunk for unknown channel %d\n", id);
+		return -1;
+	}
+
+	if (((flags & CHANNEL_FLAG_FIRST) != 0) != (channel->offset == 0))
+	{
+		printf("channel %d: misplaced first flag\n", id);
+		return -1;
+	}
+
+	if ((channel->offset + length > channel->size) || (total != (UINT32) channel->size) ||
+		(memcmp(&channel->data[channel->offset], chunk, length) != 0))
+	{
+		printf("channel %d: data out of order at %d\n", id, channel->offset);
+		return -1;
+	}
+
+	channel->offset += length;
+	channel->chunks++;
+
+	if (((flags & CHANNEL_FLAG_LAST) != 0) != (channel->offset == channel->size))
+	{
+		printf("channel %d: misplaced last flag\n", id);
+		return -1;
+	}
+
+	if (channel->offset == channel->size)
+	{
+		channel->offset = 0;
+		channel->messages++;
+	}
+
+	if (test_sequence_length < 4096)
+		test_sequence[test_sequence_length++] = channel - test_channels;
+
+	return 1;
+}
+
+static int test_released = 0;
+
+static void test_buffer_free(SHARED_BUFFER* buffer)
+{
+	test_released++;
+}
+
+static int test_drain(int fd)
+{
+	int status;
+
+	while ((status = test_read_chunk(fd)) > 0);
+
+	return status;
+}
+
+int TestCoreChannel(int argc, char* argv[])
+{
+	int i;
+	int sv[2];
+	int counts[3];
+	int status;
+	BYTE* buffer;
+	BYTE small[64];
+	SHARED_BUFFER* shared;
+	rdpRdp* rdp;
+	rdpSettings* settings;
+	freerdp_peer* client;
+	RDP_CHANNEL_STATS stats;
+	UINT32 options[3] = { CHANNEL_OPTION_PRI_HIGH, 0, CHANNEL_OPTION_PRI_LOW };
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0)
+	{
+		perror("socketpair");
+		return -1;
+	}
+
+	client = freerdp_peer_new(sv[0]);
+	freerdp_peer_context_new(client);
+
+	rdp = client->context->rdp;
+	settings = client->settings;
+
+	for (i = 0; i < 3; i++)
+	{
+		sprintf_s(settings->ChannelDefArray[i].Name, 8, "test%d", i);
+		settings->ChannelDefArray[i].options = options[i];
+		settings->ChannelDefArray[i].ChannelId = TEST_CHANNEL_HIGH + i;
+
+		test_channels[i].id = TEST_CHANNEL_HIGH + i;
+		test_channels[i].size = TEST_BULK_SIZE;
+		test_channels[i].data = (BYTE*) malloc(TEST_BULK_SIZE);
+		test_pattern(test_channels[i].data, TEST_BULK_SIZE, i);
+	}
+
+	settings->ChannelCount = 3;
+	status = 0;
+
+	/* queue a bulk message per channel, lowest priority first, reusing one buffer */
+	buffer = (BYTE*) malloc(TEST_BULK_SIZE);
+
+	for (i = 2; i >= 0; i--)
+	{
+		CopyMemory(buffer, test_channels[i].data, TEST_BULK_SIZE);
+		client->SendChannelData(client, test_channels[i].id, buffer, TEST_BULK_SIZE);
+		ZeroMemory(buffer, TEST_BULK_SIZE);
+	}
+
+	freerdp_peer_get_channel_stats(client, TEST_CHANNEL_LOW, &stats);
+
+	if ((stats.QueuedMessages != 1) || (stats.QueuedBytes == 0) || (stats.QueuedBytes >= TEST_BULK_SIZE))
+	{
+		printf("unexpected low priority queue: %d messages, %d bytes\n", stats.QueuedMessages, stats.QueuedBytes);
+		status = -1;
+	}
+
+	while ((status == 0) && (freerdp_channel_scheduler_send(rdp->channel_scheduler, CHANNEL_SCHEDULER_BURST_SIZE) > 0))
+		status = test_drain(sv[1]);
+
+	if ((status == 0) && (test_drain(sv[1]) < 0))
+		status = -1;
+
+	for (i = 0; (i < 3) && (status == 0); i++)
+	{
+		if (test_channels[i].messages != 1)
+		{
+			printf("channel %d: %d messages received\n", test_channels[i].id, test_channels[i].messages);
+			status = -1;
+		}
+	}
+
+	/* while all three were backlogged the link has to be shared by weight */
+	ZeroMemory(counts, sizeof(counts));
+
+	for (i = 0; i < MIN(test_sequence_length, 140); i++)
+		counts[test_sequence[i]]++;
+
+	printf("chunks in the first %d: high %d med %d low %d\n", i, counts[0], counts[1], counts[2]);
+
+	if ((status == 0) && !((counts[0] > counts[1]) && (counts[1] > counts[2]) && (counts[2] > 0)))
+	{
+		printf("channels were not interleaved by priority\n");
+		status = -1;
+	}
+
+	/* a small high priority message behind a bulk backlog on a low priority channel */
+	if (status == 0)
+	{
+		test_channels[2].size = TEST_BULK_SIZE;
+		client->SendChannelData(client, TEST_CHANNEL_LOW, test_channels[2].data, TEST_BULK_SIZE);
+		client->SendChannelData(client, TEST_CHANNEL_LOW, test_channels[2].data, TEST_BULK_SIZE);
+
+		test_pattern(small, sizeof(small), 99);
+		free(test_channels[0].data);
+		test_channels[0].data = (BYTE*) malloc(sizeof(small));
+		CopyMemory(test_channels[0].data, small, sizeof(small));
+		test_channels[0].size = sizeof(small);
+		test_channels[0].messages = 0;
+
+		client->SendChannelData(client, TEST_CHANNEL_HIGH, small, sizeof(small));
+
+		if (test_drain(sv[1]) < 0)
+			status = -1;
+
+		if ((status == 0) && (test_channels[0].messages != 1))
+		{
+			printf("high priority message waited behind the bulk backlog\n");
+			status = -1;
+		}
+
+		freerdp_peer_get_channel_stats(client, TEST_CHANNEL_LOW, &stats);
+
+		if ((status == 0) && (stats.QueuedMessages != 2))
+		{
+			printf("expected 2 low priority messages queued, got %d\n", stats.QueuedMessages);
+			status = -1;
+		}
+
+		while ((status == 0) && (freerdp_channel_scheduler_send(rdp->channel_scheduler, CHANNEL_SCHEDULER_BURST_SIZE) > 0))
+			status = test_drain(sv[1]);
+
+		if ((status == 0) && (test_drain(sv[1]) < 0))
+			status = -1;
+
+		freerdp_peer_get_channel_stats(client, TEST_CHANNEL_LOW, &stats);
+
+		if ((status == 0) && ((stats.QueuedMessages != 0) || (stats.MessagesSent != 3) ||
+			(stats.BytesSent != 3 * TEST_BULK_SIZE) || (test_channels[2].messages != 3)))
+		{
+			printf("low priority channel: %d queued, %d sent, %d bytes\n",
+				stats.QueuedMessages, (int) stats.MessagesSent, (int) stats.BytesSent);
+			status = -1;
+		}
+	}
+
+	/* a bulk message sent from a shared buffer */
+	if (status == 0)
+	{
+		shared = shared_buffer_attach(test_channels[2].data, TEST_BULK_SIZE, test_buffer_free, NULL);
+		client->SendChannelBuffer(client, TEST_CHANNEL_LOW, shared, shared->data, shared->size);
+		shared_buffer_unref(shared);
+
+		if (test_released != 0)
+		{
+			printf("shared buffer released while its data is still queued\n");
+			status = -1;
+		}
+
+		while ((status == 0) && (freerdp_channel_scheduler_send(rdp->channel_scheduler, CHANNEL_SCHEDULER_BURST_SIZE) > 0))
+			status = test_drain(sv[1]);
+
+		if ((status == 0) && (test_drain(sv[1]) < 0))
+			status = -1;
+
+		if ((status == 0) && ((test_released != 1) || (test_channels[2].messages != 4)))
+		{
+			printf("shared buffer: released %d times, %d messages received\n", test_released, test_channels[2].messages);
+			status = -1;
+		}
+	}
+
+	for (i = 0; i < 3; i++)
+		free(test_channels[i].data);
+
+	free(buffer);
+	close(sv[1]);
+
+	freerdp_peer_context_free(client);
+	freerdp_peer_free(client);
+
+	return status;
+}
@@ -0,0 +1,405 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <winpr/crt.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/listener.h>
+
+/**
+ * Spreads connections across worker processes that all listen on the same
+ * port with OpenReusePort. Each worker reports every accepted peer to the
+ * parent with one byte holding its index; the parent checks that every
+ * connection was accepted exactly once and that more than one worker got a
+ * share of them.
+ *
+ * The handoff mode is checked in process: a socketpair end is passed with
+ * HandoffPeer and has to come back through PeerAccepted as a working peer.
+ *
+ * Usage: TestCoreListener [connections] [workers]
+ */
+
+#define TEST_CONNECTIONS	64
+#define TEST_WORKERS		4
+
+static int test_report_fd = -1;
+static BYTE test_worker_index = 0;
+static freerdp_peer* test_handoff_client = NULL;
+
+static void test_worker_peer_accepted(freerdp_listener* instance, freerdp_peer* client)
+{
+	if (write(test_report_fd, &test_worker_index, 1) != 1)
+		perror("write");
+
+	close(client->sockfd);
+	freerdp_peer_free(client);
+}
+
+static int test_worker_main(UINT16 port, int ready_fd, int control_fd)
+{
+	int i;
+	int max_fds;
+	int rcount;
+	void* rfds[32];
+	fd_set rfds_set;
+	freerdp_listener* instance;
+
+	instance = freerdp_listener_new();
+	instance->PeerAccepted = test_worker_peer_accepted;
+
+	if (!instance->OpenReusePort(instance, "127.0.0.1", port))
+	{
+		printf("worker %d: OpenReusePort failed\n", test_worker_index);
+		return 1;
+	}
+
+	if (write(ready_fd, &test_worker_index, 1) != 1)
+		return 1;
+
+	while (1)
+	{
+		rcount = 0;
+		ZeroMemory(rfds, sizeof(rfds));
+
+		if (!instance->GetFileDescriptor(instance, rfds, &rcount))
+			break;
+
+		FD_ZERO(&rfds_set);
+		FD_SET(control_fd, &rfds_set);
+		max_fds = control_fd;
+
+		for (i = 0; i < rcount; i++)
+		{
+			int fd = (int)(long)(rfds[i]);
+
+			if (fd > max_fds)
+				max_fds = fd;
+
+			FD_SET(fd, &rfds_set);
+		}
+
+		if (select(max_fds + 1, &rfds_set, NULL, NULL, NULL) == -1)
+		{
+			if (errno == EINTR)
+				continue;
+
+			break;
+		}
+
+		/* the parent closes the control pipe to stop the workers */
+		if (FD_ISSET(control_fd, &rfds_set))
+			break;
+
+		if (!instance->CheckFileDescriptor(instance))
+			break;
+	}
+
+	instance->Close(instance);
+	freerdp_listener_free(instance);
+
+	return 0;
+}
+
+static int test_free_port(UINT16* port)
+{
+	int sockfd;
+	socklen_t length;
+	struct sockaddr_in addr;
+
+	sockfd = socket(AF_INET, SOCK_STREAM, 0);
+
+	ZeroMemory(&addr, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if (bind(sockfd, (struct sockaddr*) &addr, sizeof(addr)) != 0)
+	{
+		perror("bind");
+		close(sockfd);
+		return -1;
+	}
+
+	length = sizeof(addr);
+	getsockname(sockfd, (struct sockaddr*) &addr, &length);
+	*port = ntohs(addr.sin_port);
+
+	close(sockfd);
+
+	return 0;
+}
+
+static BOOL test_read_bytes(int fd, BYTE* buffer, int count)
+{
+	int length;
+	struct pollfd pfd;
+
+	while (count > 0)
+	{
+		pfd.fd = fd;
+		pfd.events = POLLIN;
+
+		if (poll(&pfd, 1, 5000) < 1)
+			return FALSE;
+
+		length = read(fd, buffer, count);
+
+		if (length <= 0)
+			return FALSE;
+
+		buffer += length;
+		count -= length;
+	}
+
+	return TRUE;
+}
+
+static int test_listener_reuse_port(int num_connections, int num_workers)
+{
+	int i;
+	int fd;
+	int status = 0;
+	int used_workers;
+	int ready_pipe[2];
+	int report_pipe[2];
+	int control_pipe[2];
+	int* counts;
+	BYTE* reports;
+	pid_t* pids;
+	UINT16 port;
+	struct sockaddr_in addr;
+
+#ifndef SO_REUSEPORT
+	printf("SO_REUSEPORT is not supported, skipping\n");
+	return 0;
+#endif
+
+	if (test_free_port(&port) < 0)
+		return -1;
+
+	if ((pipe(ready_pipe) != 0) || (pipe(report_pipe) != 0) || (pipe(control_pipe) != 0))
+	{
+		perror("pipe");
+		return -1;
+	}
+
+	pids = (pid_t*) malloc(sizeof(pid_t) * num_workers);
+	counts = (int*) malloc(sizeof(int) * num_workers);
+	reports = (BYTE*) malloc(num_connections);
+	ZeroMemory(counts, sizeof(int) * num_workers);
+
+	for (i = 0; i < num_workers; i++)
+	{
+		pids[i] = fork();
+
+		if (pids[i] == 0)
+		{
+			close(ready_pipe[0]);
+			close(report_pipe[0]);
+			close(control_pipe[1]);
+
+			test_worker_index = (BYTE) i;
+			test_report_fd = report_pipe[1];
+
+			_exit(test_worker_main(port, ready_pipe[1], control_pipe[0]));
+		}
+	}
+
+	close(ready_pipe[1]);
+	close(report_pipe[1]);
+	close(control_pipe[0]);
+
+	if (!test_read_bytes(ready_pipe[0], reports, num_workers))
+	{
+		printf("not all workers are listening\n");
+		status = -1;
+	}
+
+	ZeroMemory(&addr, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(port);
+
+	for (i = 0; (i < num_connections) && (status == 0); i++)
+	{
+		fd = socket(AF_INET, SOCK_STREAM, 0);
+
+		if (connect(fd, (struct sockaddr*) &addr, sizeof(addr)) != 0)
+		{
+			perror("connect");
+			status = -1;
+		}
+
+		close(fd);
+	}
+
+	if ((status == 0) && !test_read_bytes(report_pipe[0], reports, num_connections))
+	{
+		printf("not all connections were accepted\n");
+		status = -1;
+	}
+
+	close(control_pipe[1]);
+
+	for (i = 0; i < num_workers; i++)
+		waitpid(pids[i], NULL, 0);
+
+	if (status == 0)
+	{
+		for (i = 0; i < num_connections; i++)
+			counts[reports[i] % num_workers]++;
+
+		used_workers = 0;
+
+		for (i = 0; i < num_workers; i++)
+		{
+			printf("worker %d: %d connections\n", i, counts[i]);
+
+			if (counts[i] > 0)
+				used_workers++;
+		}
+
+		/* with this many connections a single worker getting all is a broken REUSEPORT group */
+		if ((num_workers > 1) && (num_connections >= 4 * num_workers) && (used_workers < 2))
+		{
+			printf("connections were not spread across workers\n");
+			status = -1;
+		}
+	}
+
+	close(ready_pipe[0]);
+	close(report_pipe[0]);
+
+	free(reports);
+	free(counts);
+	free(pids);
+
+	return status;
+}
+
+static void test_handoff_peer_accepted(freerdp_listener* instance, freerdp_peer* client)
+{
+	test_handoff_client = client;
+}
+
+static int test_listener_handoff(void)
+{
+	int i;
+	int sv[2];
+	int status = 0;
+	char path[64];
+	BYTE data = 0x5A;
+	freerdp_peer* client;
+	freerdp_listener* instance;
+
+	sprintf_s(path, sizeof(path), "/tmp/TestCoreListener.%d", (int) getpid());
+
+	instance = freerdp_listener_new();
+	instance->PeerAccepted = test_handoff_peer_accepted;
+
+	if (!instance->OpenHandoff(instance, path))
+	{
+		printf("OpenHandoff failed\n");
+		freerdp_listener_free(instance);
+		return -1;
+	}
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0)
+	{
+		perror("socketpair");
+		status = -1;
+	}
+
+	if (status == 0)
+	{
+		client = freerdp_peer_new(sv[0]);
+
+		if (!instance->HandoffPeer(instance, path, client))
+		{
+			printf("HandoffPeer failed\n");
+			close(sv[0]);
+			freerdp_peer_free(client);
+			status = -1;
+		}
+	}
+
+	for (i = 0; (i < 100) && (status == 0) && !test_handoff_client; i++)
+	{
+		instance->CheckFileDescriptor(instance);
+
+		if (!test_handoff_client)
+			usleep(1000);
+	}
+
+	if ((status == 0) && !test_handoff_client)
+	{
+		printf("handed off peer was not accepted\n");
+		status = -1;
+	}
+
+	if (status == 0)
+	{
+		if (!test_handoff_client->local)
+		{
+			printf("handed off peer is not marked local\n");
+			status = -1;
+		}
+
+		data = 0;
+
+		if ((write(sv[1], "\x5A", 1) != 1) ||
+			(read(test_handoff_client->sockfd, &data, 1) != 1) || (data != 0x5A))
+		{
+			printf("handed off peer socket does not work\n");
+			status = -1;
+		}
+
+		close(test_handoff_client->sockfd);
+		freerdp_peer_free(test_handoff_client);
+	}
+
+	close(sv[1]);
+
+	instance->Close(instance);
+	freerdp_listener_free(instance);
+	unlink(path);
+
+	return status;
+}
+
+int TestCoreListener(int argc, char* argv[])
+{
+	int num_connections = TEST_CONNECTIONS;
+	int num_workers = TEST_WORKERS;
+
+	if (argc > 1)
+		num_connections = atoi(argv[1]);
+
+	if (argc > 2)
+		num_workers = atoi(argv[2]);
+
+	if (num_connections < 1)
+		num_connections = TEST_CONNECTIONS;
+
+	if ((num_workers < 1) || (num_workers > 255))
+		num_workers = TEST_WORKERS;
+
+	signal(SIGPIPE, SIG_IGN);
+
+	if (test_listener_reuse_port(num_connections, num_workers) < 0)
+		return -1;
+
+	if (test_listener_handoff() < 0)
+		return -1;
+
+	return 0;
+}
@@ -0,0 +1,530 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <winpr/crt.h>
+#include <winpr/sspi.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/peer.h>
+#include <freerdp/crypto/crypto.h>
+
+#include "rdp.h"
+#include "nla.h"
+#include "transport.h"
+
+/**
+ * Runs the server side of an NLA handshake through to logon on the
+ * non-blocking path, stepping a peer with CheckFileDescriptor() against a
+ * client driven by hand: an X.224 connection request, an OpenSSL TLS
+ * handshake, and CredSSP over the NTLM package.
+ *
+ * The client's TSRequests are encoded by credssp_send() into a socketpair
+ * and handed to TLS in chosen pieces, so that the server sees the
+ * negotiate TSRequest and the authenticate TSRequest each split across
+ * reads, and the authenticate and credentials TSRequests in the same read.
+ * The credentials are pipelined without waiting for the server's public
+ * key echo, which is checked once the peer has logged on.
+ */
+
+#define TEST_USER	"test"
+#define TEST_DOMAIN	"FREERDP"
+#define TEST_PASSWORD	"password"
+
+/* X.224 connection request with an RDP_NEG_REQ for PROTOCOL_NLA | PROTOCOL_TLS */
+static BYTE test_connection_request[] =
+{
+	0x03, 0x00, 0x00, 0x13, 0x0E, 0xE0, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x01, 0x00, 0x08, 0x00, 0x03, 0x00, 0x00, 0x00
+};
+
+/* X.224 connection confirm with an RDP_NEG_RSP */
+#define TEST_CONNECTION_CONFIRM_SIZE	19
+
+typedef struct
+{
+	int fd;
+	SSL* ssl;
+	int capture[2];
+	rdpSettings* settings;
+	rdpTransport* transport;
+	rdpCredssp* credssp;
+	CredHandle credentials;
+	BOOL have_credentials;
+} testClient;
+
+static int test_logons = 0;
+static BOOL test_logon_automatic = FALSE;
+static SEC_WINNT_AUTH_IDENTITY test_logon_identity;
+
+static BOOL test_peer_logon(freerdp_peer* client, SEC_WINNT_AUTH_IDENTITY* identity, BOOL automatic)
+{
+	test_logons++;
+	test_logon_automatic = automatic;
+	sspi_CopyAuthIdentity(&test_logon_identity, identity);
+
+	return TRUE;
+}
+
+/* lets the peer process whatever the client has sent so far */
+static int test_peer_step(freerdp_peer* client)
+{
+	int i;
+	struct pollfd pfd;
+
+	pfd.fd = client->context->rdp->transport->TcpIn->sockfd;
+	pfd.events = POLLIN;
+
+	for (i = 0; i < 4; i++)
+	{
+		if (poll(&pfd, 1, 10) < 0)
+			return -1;
+
+		if (!client->CheckFileDescriptor(client))
+		{
+			printf("peer fails to check its file descriptor\n");
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static int test_client_write(testClient* tc, BYTE* data, int length)
+{
+	int status;
+
+	status = SSL_write(tc->ssl, data, length);
+
+	if (status != length)
+	{
+		printf("client fails to write %d bytes: %d\n", length, SSL_get_error(tc->ssl, status));
+		return -1;
+	}
+
+	return 0;
+}
+
+/* takes the TSRequests credssp_send() has written so far off the socketpair */
+static int test_client_capture(testClient* tc, BYTE* data, int size)
+{
+	int status;
+
+	status = recv(tc->capture[0], data, size, MSG_DONTWAIT);
+
+	if (status <= 0)
+	{
+		printf("client has no TSRequest to send\n");
+		return -1;
+	}
+
+	return status;
+}
+
+/* reads one whole TSRequest from the server and decodes it */
+static int test_client_recv(testClient* tc, freerdp_peer* client)
+{
+	int i;
+	int pos;
+	int status;
+	int length;
+	STREAM* s;
+
+	s = stream_new(4096);
+	pos = 0;
+	length = 0;
+
+	for (i = 0; i < 100; i++)
+	{
+		status = SSL_read(tc->ssl, stream_get_tail(s), stream_get_left(s));
+
+		if (status > 0)
+		{
+			stream_seek(s, status);
+			pos = stream_get_pos(s);
+
+			if (pos >= 4)
+			{
+				BYTE* data = stream_get_head(s);
+
+				/* DER length of the TSRequest SEQUENCE, short or long form */
+				if (!(data[1] & 0x80))
+					length = 2 + data[1];
+				else if (data[1] == 0x81)
+					length = 3 + data[2];
+				else
+					length = 4 + ((data[2] << 8) | data[3]);
+
+				if (pos >= length)
+					break;
+			}
+
+			continue;
+		}
+
+		if (SSL_get_error(tc->ssl, status) != SSL_ERROR_WANT_READ)
+			break;
+
+		if (test_peer_step(client) < 0)
+			break;
+	}
+
+	if ((length == 0) || (pos < length))
+	{
+		printf("client fails to receive a TSRequest\n");
+		stream_free(s);
+		return -1;
+	}
+
+	stream_set_pos(s, 0);
+	status = credssp_decode_ts_request(tc->credssp, s);
+	stream_free(s);
+
+	return status;
+}
+
+static int test_client_connect(testClient* tc, freerdp_peer* client)
+{
+	int i;
+	int status;
+	BYTE* PublicKey;
+	DWORD PublicKeyLength;
+	BYTE confirm[TEST_CONNECTION_CONFIRM_SIZE];
+	struct crypto_cert_struct cert;
+	SSL_CTX* ctx;
+
+	if (write(tc->fd, test_connection_request, sizeof(test_connection_request)) != sizeof(test_connection_request))
+		return -1;
+
+	if (test_peer_step(client) < 0)
+		return -1;
+
+	if ((read(tc->fd, confirm, sizeof(confirm)) != sizeof(confirm)) || (confirm[11] != 0x02) || (confirm[15] != 0x02))
+	{
+		printf("server does not select NLA\n");
+		return -1;
+	}
+
+	fcntl(tc->fd, F_SETFL, O_NONBLOCK);
+
+	ctx = SSL_CTX_new(SSLv23_client_method());
+	tc->ssl = SSL_new(ctx);
+	SSL_CTX_free(ctx);
+	SSL_set_fd(tc->ssl, tc->fd);
+	SSL_set_connect_state(tc->ssl);
+
+	for (i = 0; i < 100; i++)
+	{
+		status = SSL_do_handshake(tc->ssl);
+
+		if (status > 0)
+			break;
+
+		status = SSL_get_error(tc->ssl, status);
+
+		if ((status != SSL_ERROR_WANT_READ) && (status != SSL_ERROR_WANT_WRITE))
+		{
+			printf("client handshake failed: %d\n", status);
+			return -1;
+		}
+
+		if (test_peer_step(client) < 0)
+			return -1;
+	}
+
+	/* the server only gets to see the end of the handshake on its next step */
+	if ((test_peer_step(client) < 0) || (client->context->rdp->transport->credssp == NULL))
+	{
+		printf("server does not start CredSSP after TLS\n");
+		return -1;
+	}
+
+	cert.px509 = SSL_get_peer_certificate(tc->ssl);
+	status = crypto_cert_get_public_key(&cert, &PublicKey, &PublicKeyLength);
+	X509_free(cert.px509);
+
+	if (!status)
+		return -1;
+
+	tc->credssp->PublicKey.pvBuffer = PublicKey;
+	tc->credssp->PublicKey.cbBuffer = PublicKeyLength;
+
+	return 0;
+}
+
+/**
+ * winpr's NTLM package looks the password hash up in /etc/winpr/SAM unless
+ * its credentials carry a password, so the server is given the password
+ * instead of a SAM file, before it sees the first token.
+ */
+static int test_server_credentials(freerdp_peer* client)
+{
+	TimeStamp expiration;
+	SEC_WINNT_AUTH_IDENTITY identity;
+	rdpCredssp* credssp = client->context->rdp->transport->credssp;
+
+	ZeroMemory(&identity, sizeof(SEC_WINNT_AUTH_IDENTITY));
+	sspi_SetAuthIdentity(&identity, TEST_USER, TEST_DOMAIN, TEST_PASSWORD);
+
+	credssp->table->FreeCredentialsHandle(&credssp->credentials);
+
+	if (credssp->table->AcquireCredentialsHandle(NULL, NTLMSP_NAME, SECPKG_CRED_INBOUND,
+			NULL, &identity, NULL, NULL, &credssp->credentials, &expiration) != SEC_E_OK)
+		return -1;
+
+	return 0;
+}
+
+/* runs InitializeSecurityContext() on the token last received, if any */
+static SECURITY_STATUS test_client_token(testClient* tc, BOOL have_input)
+{
+	ULONG pfContextAttr;
+	TimeStamp expiration;
+	SECURITY_STATUS status;
+	SecBuffer input_buffer;
+	SecBuffer output_buffer;
+	SecBufferDesc input_buffer_desc;
+	SecBufferDesc output_buffer_desc;
+	rdpCredssp* credssp = tc->credssp;
+
+	input_buffer_desc.ulVersion = SECBUFFER_VERSION;
+	input_buffer_desc.cBuffers = 1;
+	input_buffer_desc.pBuffers = &input_buffer;
+	input_buffer.BufferType = SECBUFFER_TOKEN;
+	input_buffer.pvBuffer = credssp->negoToken.pvBuffer;
+	input_buffer.cbBuffer = credssp->negoToken.cbBuffer;
+
+	output_buffer_desc.ulVersion = SECBUFFER_VERSION;
+	output_buffer_desc.cBuffers = 1;
+	output_buffer_desc.pBuffers = &output_buffer;
+	output_buffer.BufferType = SECBUFFER_TOKEN;
+	output_buffer.cbBuffer = 4096;
+	output_buffer.pvBuffer = malloc(output_buffer.cbBuffer);
+
+	status = credssp->table->InitializeSecurityContext(&tc->credentials,
+			(have_input) ? &credssp->context : NULL, NULL,
+			ISC_REQ_MUTUAL_AUTH | ISC_REQ_CONFIDENTIALITY | ISC_REQ_USE_SESSION_KEY, 0,
+			SECURITY_NATIVE_DREP, (have_input) ? &input_buffer_desc : NULL,
+			0, &credssp->context, &output_buffer_desc, &pfContextAttr, &expiration);
+
+	credssp_buffer_free(credssp);
+	credssp->negoToken.pvBuffer = output_buffer.pvBuffer;
+	credssp->negoToken.cbBuffer = output_buffer.cbBuffer;
+
+	if ((status == SEC_I_COMPLETE_AND_CONTINUE) || (status == SEC_I_COMPLETE_NEEDED))
+	{
+		credssp->table->CompleteAuthToken(&credssp->context, &output_buffer_desc);
+		status = (status == SEC_I_COMPLETE_NEEDED) ? SEC_E_OK : SEC_I_CONTINUE_NEEDED;
+	}
+
+	return status;
+}
+
+static int test_client_authenticate(testClient* tc, freerdp_peer* client)
+{
+	int length;
+	BYTE negotiate[512];
+	BYTE authenticate[4096];
+	rdpCredssp* credssp = tc->credssp;
+	TimeStamp expiration;
+
+	credssp->table = InitSecurityInterface();
+	sspi_SetAuthIdentity(&credssp->identity, TEST_USER, TEST_DOMAIN, TEST_PASSWORD);
+
+	if (credssp->table->AcquireCredentialsHandle(NULL, NTLMSP_NAME, SECPKG_CRED_OUTBOUND,
+			NULL, &credssp->identity, NULL, NULL, &tc->credentials, &expiration) != SEC_E_OK)
+		return -1;
+
+	tc->have_credentials = TRUE;
+
+	/* negotiate, its DER header split across reads */
+
+	if (test_client_token(tc, FALSE) != SEC_I_CONTINUE_NEEDED)
+		return -1;
+
+	credssp_send(credssp);
+	credssp_buffer_free(credssp);
+
+	if ((length = test_client_capture(tc, negotiate, sizeof(negotiate))) < 0)
+		return -1;
+
+	if ((test_client_write(tc, negotiate, 1) < 0) || (test_peer_step(client) < 0))
+		return -1;
+
+	if ((test_client_write(tc, &negotiate[1], length - 1) < 0) || (test_peer_step(client) < 0))
+		return -1;
+
+	/* challenge */
+
+	if (test_client_recv(tc, client) < 0)
+		return -1;
+
+	if (test_client_token(tc, TRUE) != SEC_E_OK)
+	{
+		printf("client fails to process the challenge\n");
+		return -1;
+	}
+
+	/* authenticate with the public key, and the credentials right behind it */
+
+	if (credssp->table->QueryContextAttributes(&credssp->context, SECPKG_ATTR_SIZES, &credssp->ContextSizes) != SEC_E_OK)
+		return -1;
+
+	credssp_encrypt_public_key_echo(credssp);
+	credssp_send(credssp);
+	credssp_buffer_free(credssp);
+
+	if (credssp_encrypt_ts_credentials(credssp) != SEC_E_OK)
+		return -1;
+
+	credssp_send(credssp);
+	credssp_buffer_free(credssp);
+
+	if ((length = test_client_capture(tc, authenticate, sizeof(authenticate))) < 0)
+		return -1;
+
+	if ((test_client_write(tc, authenticate, 100) < 0) || (test_peer_step(client) < 0))
+		return -1;
+
+	if (test_logons != 0)
+	{
+		printf("peer logs on with half a TSRequest\n");
+		return -1;
+	}
+
+	if ((test_client_write(tc, &authenticate[100], length - 100) < 0) || (test_peer_step(client) < 0))
+		return -1;
+
+	/* the server's public key echo */
+
+	if (test_client_recv(tc, client) < 0)
+		return -1;
+
+	if (credssp_decrypt_public_key_echo(credssp) != SEC_E_OK)
+	{
+		printf("client fails to verify the server's public key echo\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+static int test_client_open(testClient* tc, int fd)
+{
+	ZeroMemory(tc, sizeof(testClient));
+	tc->fd = fd;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, tc->capture) != 0)
+	{
+		perror("socketpair");
+		return -1;
+	}
+
+	/* settings without an instance are a server's */
+	tc->settings = freerdp_settings_new(NULL);
+	tc->settings->ServerMode = FALSE;
+	tc->transport = transport_new(tc->settings);
+	transport_attach(tc->transport, tc->capture[1]);
+	tc->credssp = credssp_new(NULL, tc->transport, tc->settings);
+
+	return 0;
+}
+
+static void test_client_close(testClient* tc)
+{
+	if (tc->have_credentials)
+		tc->credssp->table->FreeCredentialsHandle(&tc->credentials);
+
+	credssp_free(tc->credssp);
+	transport_free(tc->transport);
+	freerdp_settings_free(tc->settings);
+	close(tc->capture[0]);
+
+	if (tc->ssl)
+		SSL_free(tc->ssl);
+
+	close(tc->fd);
+}
+
+int TestCoreNla(int argc, char* argv[])
+{
+	int sv[2];
+	int status;
+	testClient tc;
+	freerdp_peer* client;
+	SEC_WINNT_AUTH_IDENTITY identity;
+
+	SSL_load_error_strings();
+	SSL_library_init();
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0)
+	{
+		perror("socketpair");
+		return -1;
+	}
+
+	client = freerdp_peer_new(sv[0]);
+	freerdp_peer_context_new(client);
+
+	client->settings->CertificateFile = _strdup(TEST_SERVER_CERT);
+	client->settings->PrivateKeyFile = _strdup(TEST_SERVER_KEY);
+	client->settings->NlaSecurity = TRUE;
+	client->settings->TlsSecurity = TRUE;
+	client->settings->RdpSecurity = FALSE;
+	client->Logon = test_peer_logon;
+	client->Initialize(client);
+
+	ZeroMemory(&test_logon_identity, sizeof(SEC_WINNT_AUTH_IDENTITY));
+
+	status = test_client_open(&tc, sv[1]);
+
+	if (status == 0)
+		status = test_client_connect(&tc, client);
+
+	if (status == 0)
+		status = test_server_credentials(client);
+
+	if (status == 0)
+		status = test_client_authenticate(&tc, client);
+
+	if (status == 0)
+	{
+		ZeroMemory(&identity, sizeof(SEC_WINNT_AUTH_IDENTITY));
+		sspi_SetAuthIdentity(&identity, TEST_USER, TEST_DOMAIN, TEST_PASSWORD);
+
+		if ((test_logons != 1) || !test_logon_automatic || !client->authenticated ||
+			(test_logon_identity.UserLength != identity.UserLength) ||
+			(memcmp(test_logon_identity.User, identity.User, identity.UserLength * 2) != 0))
+		{
+			printf("peer logs on %d times, automatic: %d, authenticated: %d\n",
+				test_logons, test_logon_automatic, client->authenticated);
+			status = -1;
+		}
+
+		if (client->context->rdp->state != CONNECTION_STATE_NEGO)
+		{
+			printf("peer is not waiting for the MCS connect initial\n");
+			status = -1;
+		}
+
+		free(identity.User);
+		free(identity.Domain);
+		free(identity.Password);
+	}
+
+	test_client_close(&tc);
+
+	freerdp_peer_context_free(client);
+	freerdp_peer_free(client);
+
+	free(test_logon_identity.User);
+	free(test_logon_identity.Domain);
+	free(test_logon_identity.Password);
+
+	return status;
+}
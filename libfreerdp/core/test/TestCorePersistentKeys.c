@@ -0,0 +1,462 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <winpr/crt.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/utils/stream.h>
+#include <freerdp/utils/persistent.h>
+
+#include "activation.h"
+
+/**
+ * Connects a client to a server twice, in memory, with a persistent
+ * bitmap cache file in between. The server draws a desktop of 64x64 tiles
+ * in cell 2 and 16x16 icons in cell 0, sending each bitmap once in a
+ * cache bitmap order with a key, as long as the client did not announce
+ * the key in its persistent key list. The client keeps the bitmaps of the
+ * first session in the file, and on the second connection announces them
+ * in key list PDUs, which the server parses. One tile in ten changed in
+ * between.
+ *
+ * The second session has to send only the changed bitmaps, the key list
+ * PDUs split at 169 keys, with the same indices on both sides, and the
+ * server has to reject malformed key lists.
+ */
+
+#define TEST_FILE		"TestCorePersistentKeys.bmc"
+#define TEST_TILES		1200
+#define TEST_ICONS		400
+#define TEST_CLIENT_ICONS	300
+#define TEST_TILE_CELL		2
+#define TEST_ICON_CELL		0
+#define TEST_BPP		16
+
+typedef struct
+{
+	UINT64 key;
+	UINT32 id;
+	UINT32 size;
+	BYTE* data;
+} testBitmap;
+
+typedef struct
+{
+	UINT32 orders;
+	UINT32 order_bytes;
+	UINT32 pdus;
+	UINT32 pdu_bytes;
+	UINT32 next_index[PERSISTENT_CACHE_MAX_CELLS];
+} testSession;
+
+/* a fixed generator, so every platform draws the same desktop */
+static UINT32 test_random(UINT32* seed)
+{
+	*seed = (*seed * 1103515245) + 12345;
+	return (*seed >> 16) & 0x7FFF;
+}
+
+/* the server keys bitmaps by their content */
+static UINT64 test_key(BYTE* data, UINT32 size)
+{
+	UINT32 i;
+	UINT64 hash = 0xCBF29CE484222325ULL;
+
+	for (i = 0; i < size; i++)
+	{
+		hash ^= data[i];
+		hash *= 0x100000001B3ULL;
+	}
+
+	return hash;
+}
+
+static void test_bitmap_init(testBitmap* bitmap, UINT32 id, UINT32 width, UINT32 seed)
+{
+	UINT32 i;
+
+	bitmap->id = id;
+	bitmap->size = width * width * (TEST_BPP / 8);
+	bitmap->data = (BYTE*) malloc(bitmap->size);
+
+	for (i = 0; i < bitmap->size; i++)
+		bitmap->data[i] = (BYTE) test_random(&seed);
+
+	bitmap->key = test_key(bitmap->data, bitmap->size);
+}
+
+/**
+ * The length of a cache bitmap v2 order with a key, uncompressed: the
+ * secondary order header, the key, width and height in one byte, the
+ * bitmap length and the cache index in two bytes each, and the data.
+ */
+static UINT32 test_cache_bitmap_v2_length(testBitmap* bitmap)
+{
+	return 6 + 8 + 1 + 2 + 2 + bitmap->size;
+}
+
+static rdpSettings* test_client_settings(BOOL persistent)
+{
+	UINT32 i;
+	rdpSettings* settings;
+
+	settings = freerdp_settings_new(NULL);
+
+	if (persistent)
+	{
+		settings->BitmapCachePersistEnabled = TRUE;
+		settings->BitmapCachePersistFile = _strdup(TEST_FILE);
+
+		for (i = 0; i < settings->BitmapCacheV2NumCells; i++)
+			settings->BitmapCacheV2CellInfo[i].persistent = TRUE;
+
+		settings->BitmapCacheV2CellInfo[TEST_ICON_CELL].numEntries = TEST_CLIENT_ICONS;
+	}
+
+	return settings;
+}
+
+/**
+ * Sends the key list of the client to the server, returning the number of
+ * keys the server got, or -1 if a PDU was rejected or flagged wrong.
+ */
+static int test_key_list_exchange(rdpSettings* client, rdpSettings* server, rdpPersistentKeyList* received, testSession* session)
+{
+	int i;
+	int keys = 0;
+	BOOL last = FALSE;
+	BYTE flags;
+	UINT32 errorInfo;
+	STREAM* s;
+	STREAM in;
+	rdpPersistentKeyList* list;
+
+	s = stream_new(2048);
+	list = rdp_persistent_key_list_new();
+	rdp_persistent_key_list_load(list, client);
+
+	while (!last)
+	{
+		stream_set_pos(s, 0);
+		last = rdp_write_client_persistent_key_list_pdu(s, list);
+
+		session->pdus++;
+		session->pdu_bytes += stream_get_length(s);
+
+		flags = stream_get_head(s)[20];
+
+		if (((flags & PERSIST_FIRST_PDU) ? TRUE : FALSE) != (session->pdus == 1) ||
+			((flags & PERSIST_LAST_PDU) ? TRUE : FALSE) != last ||
+			(stream_get_length(s) > 24 + PERSIST_MAX_PDU_ENTRIES * 8))
+		{
+			printf("key list PDU %d is flagged 0x%02X or too long\n", session->pdus, flags);
+			keys = -1;
+			break;
+		}
+
+		stream_attach((&in), stream_get_head(s), stream_get_length(s));
+
+		if (!rdp_read_client_persistent_key_list_pdu(&in, server, received, &errorInfo))
+		{
+			printf("server rejected key list PDU %d, error info 0x%08X\n", session->pdus, errorInfo);
+			keys = -1;
+			break;
+		}
+	}
+
+	if (keys == 0)
+	{
+		for (i = 0; i < PERSIST_MAX_CELLS; i++)
+			keys += received->numEntries[i];
+	}
+
+	rdp_persistent_key_list_free(list);
+	stream_free(s);
+
+	return keys;
+}
+
+/**
+ * The server draws the bitmaps, sending those whose key the client did
+ * not announce to free indices of their cells. The client keeps every
+ * bitmap it receives, as its bitmap cache does for persistent cells.
+ */
+static void test_session_draw(testSession* session, testBitmap* bitmaps, int count,
+		rdpPersistentCache* announced, rdpPersistentCache* client)
+{
+	int i;
+
+	for (i = 0; i < count; i++)
+	{
+		if (announced && persistent_cache_find(announced, bitmaps[i].key))
+			continue;
+
+		session->orders++;
+		session->order_bytes += test_cache_bitmap_v2_length(&bitmaps[i]);
+
+		persistent_cache_put(client, bitmaps[i].key, bitmaps[i].id, 64, 64, TEST_BPP, 0,
+				bitmaps[i].data, bitmaps[i].size);
+
+		if (announced)
+			persistent_cache_put_key(announced, bitmaps[i].key, bitmaps[i].id, session->next_index[bitmaps[i].id]);
+
+		session->next_index[bitmaps[i].id]++;
+	}
+}
+
+static int test_session_indices(rdpPersistentCache* announced, rdpSettings* settings)
+{
+	int i;
+	int count;
+	int errors = 0;
+	UINT32 id;
+	BYTE* data;
+	rdpPersistentCache* cache;
+	PERSISTENT_CACHE_ENTRY* found;
+	PERSISTENT_CACHE_ENTRY** entries;
+
+	/* the bitmap cache of the client, set up after the key list was sent */
+	cache = persistent_cache_new();
+	persistent_cache_load(cache, settings->BitmapCachePersistFile);
+	entries = (PERSISTENT_CACHE_ENTRY**) malloc(sizeof(PERSISTENT_CACHE_ENTRY*) * 4096);
+
+	for (id = 0; id < PERSISTENT_CACHE_MAX_CELLS; id++)
+	{
+		count = persistent_cache_get_keys(cache, id, entries, settings->BitmapCacheV2CellInfo[id].numEntries);
+
+		for (i = 0; i < count; i++)
+		{
+			found = persistent_cache_find(announced, entries[i]->key);
+			data = persistent_cache_get_data(cache, entries[i]);
+
+			if (!found || (found->id != id) || (found->index != (UINT32) i) ||
+				!data || (test_key(data, entries[i]->length) != entries[i]->key))
+			{
+				errors++;
+			}
+		}
+	}
+
+	free(entries);
+	persistent_cache_free(cache);
+
+	return errors;
+}
+
+static BOOL test_reject(rdpSettings* server, BYTE* pdu, int length, UINT32 expected, const char* what)
+{
+	STREAM in;
+	UINT32 errorInfo;
+	BOOL status = TRUE;
+	rdpPersistentKeyList* list;
+
+	list = rdp_persistent_key_list_new();
+	stream_attach((&in), pdu, length);
+
+	if (rdp_read_client_persistent_key_list_pdu(&in, server, list, &errorInfo) || (errorInfo != expected))
+	{
+		printf("%s: not rejected with error info 0x%08X\n", what, expected);
+		status = FALSE;
+	}
+
+	rdp_persistent_key_list_free(list);
+
+	return status;
+}
+
+static void test_write_header(BYTE* pdu, UINT16 numEntries0, UINT16 totalEntries0, UINT16 totalEntries2, BYTE flags)
+{
+	STREAM stream;
+	STREAM* s = &stream;
+
+	stream_attach(s, pdu, 24);
+	stream_write_UINT16(s, numEntries0);
+	stream_write_zero(s, 8);
+	stream_write_UINT16(s, totalEntries0);
+	stream_write_UINT16(s, 0xFFFF);
+	stream_write_UINT16(s, totalEntries2);
+	stream_write_UINT16(s, 0xFFFF);
+	stream_write_UINT16(s, 0xFFFF);
+	stream_write_BYTE(s, flags);
+	stream_write_zero(s, 3);
+}
+
+static int test_validation(void)
+{
+	int status = 0;
+	BYTE pdu[24 + 16];
+	rdpSettings* server;
+
+	server = freerdp_settings_new(NULL);
+	ZeroMemory(pdu, sizeof(pdu));
+
+	/* cells large enough for the totals below, all but the last check */
+	server->BitmapCacheV2CellInfo[0].numEntries = 0xFFFF;
+	server->BitmapCacheV2CellInfo[1].numEntries = 0xFFFF;
+	server->BitmapCacheV2CellInfo[2].numEntries = 0xFFFF;
+	server->BitmapCacheV2CellInfo[3].numEntries = 0xFFFF;
+	server->BitmapCacheV2CellInfo[4].numEntries = 0xFFFF;
+
+	test_write_header(pdu, 2, 0xFFFF, 0xFFFF, PERSIST_FIRST_PDU | PERSIST_LAST_PDU);
+
+	if (!test_reject(server, pdu, 24 + 8, ERRINFO_PERSISTENT_KEY_PDU_BAD_LENGTH, "truncated entries"))
+		status = -1;
+
+	if (!test_reject(server, pdu, 24 + 16, ERRINFO_PERSISTENT_KEY_PDU_TOO_MANY_TOTAL_KEYS, "too many keys"))
+		status = -1;
+
+	test_write_header(pdu, 2, 2, 0, PERSIST_LAST_PDU);
+
+	if (!test_reject(server, pdu, 24 + 16, ERRINFO_PERSISTENT_KEY_PDU_ILLEGAL_FIRST, "list without a first PDU"))
+		status = -1;
+
+	test_write_header(pdu, 2, 1, 0, PERSIST_FIRST_PDU | PERSIST_LAST_PDU);
+	server->BitmapCacheV2CellInfo[1].numEntries = 600;
+	server->BitmapCacheV2CellInfo[3].numEntries = 0xFFFF;
+
+	if (!test_reject(server, pdu, 24 + 16, ERRINFO_PERSISTENT_KEY_PDU_TOO_MANY_CACHE_KEYS, "keys beyond the cell"))
+		status = -1;
+
+	freerdp_settings_free(server);
+
+	return status;
+}
+
+int TestCorePersistentKeys(int argc, char* argv[])
+{
+	int i;
+	int keys;
+	int errors;
+	int status = 0;
+	UINT32 expected;
+	testBitmap* first;
+	testBitmap* second;
+	testSession session1;
+	testSession session2;
+	rdpSettings* client;
+	rdpSettings* server;
+	rdpPersistentCache* store;
+	rdpPersistentKeyList* received;
+
+	remove(TEST_FILE);
+
+	first = (testBitmap*) malloc(sizeof(testBitmap) * (TEST_TILES + TEST_ICONS));
+	second = (testBitmap*) malloc(sizeof(testBitmap) * (TEST_TILES + TEST_ICONS));
+
+	for (i = 0; i < TEST_TILES; i++)
+		test_bitmap_init(&first[i], TEST_TILE_CELL, 64, i + 1);
+
+	for (i = 0; i < TEST_ICONS; i++)
+		test_bitmap_init(&first[TEST_TILES + i], TEST_ICON_CELL, 16, 100000 + i);
+
+	/* one tile in ten changes between the sessions */
+	for (i = 0; i < TEST_TILES + TEST_ICONS; i++)
+	{
+		if ((i < TEST_TILES) && (i % 10 == 0))
+			test_bitmap_init(&second[i], TEST_TILE_CELL, 64, 200000 + i);
+		else
+			second[i] = first[i];
+	}
+
+	/* the first session, without a cache file */
+	ZeroMemory(&session1, sizeof(testSession));
+	store = persistent_cache_new();
+	test_session_draw(&session1, first, TEST_TILES + TEST_ICONS, NULL, store);
+	persistent_cache_set_max_entries(store, TEST_ICON_CELL, TEST_ICONS);
+
+	if (!persistent_cache_save(store, TEST_FILE))
+	{
+		printf("failed to save %s\n", TEST_FILE);
+		status = -1;
+	}
+
+	persistent_cache_free(store);
+
+	/* the second session, with the key list */
+	ZeroMemory(&session2, sizeof(testSession));
+	client = test_client_settings(TRUE);
+	server = test_client_settings(FALSE);
+	received = rdp_persistent_key_list_new();
+
+	keys = test_key_list_exchange(client, server, received, &session2);
+
+	/* the client announces only as many icons as its cell holds, the most recently received */
+	expected = TEST_TILES + TEST_CLIENT_ICONS;
+
+	if (keys != (int) expected)
+	{
+		printf("server got %d keys, expected %d\n", keys, expected);
+		status = -1;
+	}
+	else
+	{
+		if (persistent_cache_find(received->cache, first[TEST_TILES].key) ||
+			!persistent_cache_find(received->cache, first[TEST_TILES + TEST_ICONS - 1].key))
+		{
+			printf("client did not announce the most recent icons\n");
+			status = -1;
+		}
+
+		errors = test_session_indices(received->cache, client);
+
+		if (errors)
+		{
+			printf("%d keys announced at other indices than the client cache has them\n", errors);
+			status = -1;
+		}
+
+		if (session2.pdus != (expected + PERSIST_MAX_PDU_ENTRIES - 1) / PERSIST_MAX_PDU_ENTRIES)
+		{
+			printf("%d keys sent in %d PDUs\n", expected, session2.pdus);
+			status = -1;
+		}
+	}
+
+	for (i = 0; i < PERSISTENT_CACHE_MAX_CELLS; i++)
+		session2.next_index[i] = received->numEntries[i];
+
+	store = persistent_cache_new();
+	test_session_draw(&session2, second, TEST_TILES + TEST_ICONS, received->cache, store);
+	persistent_cache_free(store);
+
+	printf("first session:  %5d bitmaps, %8d bytes\n", session1.orders, session1.order_bytes);
+	printf("second session: %5d bitmaps, %8d bytes, %d key list PDUs of %d bytes\n",
+		session2.orders, session2.order_bytes, session2.pdus, session2.pdu_bytes);
+	printf("saved %.1f%% of the bitmap cache traffic\n",
+		100.0 - 100.0 * (session2.order_bytes + session2.pdu_bytes) / session1.order_bytes);
+
+	/* the changed tiles, and the icons the client had to leave out */
+	if (session2.orders != TEST_TILES / 10 + (TEST_ICONS - TEST_CLIENT_ICONS))
+	{
+		printf("second session sent %d bitmaps\n", session2.orders);
+		status = -1;
+	}
+
+	if ((session2.order_bytes + session2.pdu_bytes) * 5 > session1.order_bytes)
+	{
+		printf("persistent cache saves too little\n");
+		status = -1;
+	}
+
+	status |= test_validation();
+
+	rdp_persistent_key_list_free(received);
+	freerdp_settings_free(client);
+	freerdp_settings_free(server);
+
+	for (i = 0; i < TEST_TILES + TEST_ICONS; i++)
+	{
+		if (second[i].data != first[i].data)
+			free(second[i].data);
+
+		free(first[i].data);
+	}
+
+	free(first);
+	free(second);
+	remove(TEST_FILE);
+
+	return status;
+}
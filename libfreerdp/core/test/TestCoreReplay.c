@@ -0,0 +1,288 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <winpr/crt.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/gdi/gdi.h>
+#include <freerdp/cache/cache.h>
+#include <freerdp/utils/stream.h>
+
+#include "replay.h"
+
+/**
+ * Dumps a session the way a client does once it is activated: a 16 bpp
+ * desktop of 32x32 tiles, sent one row of tiles per fast-path bitmap
+ * update, then a reactivation with a larger desktop and more updates.
+ * The tiles are black or white in a checkerboard that flips every frame.
+ *
+ * Played back through the gdi, the dump has to resize the desktop, paint
+ * every update and leave the checkerboard of the last frame on the
+ * surface, the same on every replay. Sessions with standard RDP security
+ * must not be dumped.
+ */
+
+#define TEST_FILE		"TestCoreReplay.pcap"
+#define TEST_TILE		32
+#define TEST_FRAMES		2
+#define TEST_BPP		16
+
+static int test_sizes[2][2] = { { 256, 128 }, { 320, 192 } };
+
+static UINT32 test_end_paints;
+
+static UINT16 test_tile_color(int x, int y, int frame)
+{
+	return (((x / TEST_TILE) + (y / TEST_TILE) + frame) & 1) ? 0xFFFF : 0x0000;
+}
+
+/* a fast-path PDU with a bitmap update of a row of uncompressed tiles */
+static STREAM* test_bitmap_pdu(int width, int row, int frame)
+{
+	int i;
+	int x, y;
+	int tiles;
+	int length;
+	UINT16 color;
+	STREAM* s;
+
+	tiles = width / TEST_TILE;
+	length = 3 + 3 + 4 + tiles * (18 + TEST_TILE * TEST_TILE * 2);
+
+	s = stream_new(length);
+
+	stream_write_BYTE(s, 0); /* fpOutputHeader (1 byte) */
+	stream_write_BYTE(s, 0x80 | (length >> 8)); /* length1 (1 byte) */
+	stream_write_BYTE(s, length & 0xFF); /* length2 (1 byte) */
+
+	stream_write_BYTE(s, FASTPATH_UPDATETYPE_BITMAP); /* updateHeader (1 byte) */
+	stream_write_UINT16(s, length - 6); /* size (2 bytes) */
+
+	stream_write_UINT16(s, UPDATE_TYPE_BITMAP); /* updateType (2 bytes) */
+	stream_write_UINT16(s, tiles); /* numberRectangles (2 bytes) */
+
+	for (i = 0; i < tiles; i++)
+	{
+		x = i * TEST_TILE;
+		y = row * TEST_TILE;
+
+		stream_write_UINT16(s, x); /* destLeft (2 bytes) */
+		stream_write_UINT16(s, y); /* destTop (2 bytes) */
+		stream_write_UINT16(s, x + TEST_TILE - 1); /* destRight (2 bytes) */
+		stream_write_UINT16(s, y + TEST_TILE - 1); /* destBottom (2 bytes) */
+		stream_write_UINT16(s, TEST_TILE); /* width (2 bytes) */
+		stream_write_UINT16(s, TEST_TILE); /* height (2 bytes) */
+		stream_write_UINT16(s, TEST_BPP); /* bitsPerPixel (2 bytes) */
+		stream_write_UINT16(s, 0); /* flags (2 bytes) */
+		stream_write_UINT16(s, TEST_TILE * TEST_TILE * 2); /* bitmapLength (2 bytes) */
+
+		color = test_tile_color(x, y, frame);
+
+		for (x = 0; x < TEST_TILE * TEST_TILE; x++)
+			stream_write_UINT16(s, color);
+	}
+
+	stream_seal(s);
+
+	return s;
+}
+
+static int test_record(void)
+{
+	int i;
+	int row;
+	int frame;
+	STREAM* s;
+	rdpRdp* rdp;
+	freerdp* instance;
+	rdpSettings* settings;
+
+	instance = freerdp_new();
+	freerdp_context_new(instance);
+
+	rdp = instance->context->rdp;
+	settings = instance->settings;
+
+	settings->DumpSession = TRUE;
+	settings->DumpSessionFile = _strdup(TEST_FILE);
+	settings->ColorDepth = TEST_BPP;
+
+	for (i = 0; i < 2; i++)
+	{
+		settings->DesktopWidth = test_sizes[i][0];
+		settings->DesktopHeight = test_sizes[i][1];
+		replay_record_activation(rdp);
+
+		for (frame = 0; frame < TEST_FRAMES; frame++)
+		{
+			for (row = 0; row < test_sizes[i][1] / TEST_TILE; row++)
+			{
+				s = test_bitmap_pdu(test_sizes[i][0], row, frame);
+				replay_record_pdu(rdp, s);
+				stream_free(s);
+			}
+		}
+	}
+
+	i = (rdp->replay != NULL) ? 0 : -1;
+
+	freerdp_context_free(instance);
+	freerdp_free(instance);
+
+	if (i < 0)
+		printf("session is not dumped\n");
+
+	return i;
+}
+
+static int test_record_rdp_security(void)
+{
+	int status = 0;
+	freerdp* instance;
+	rdpSettings* settings;
+
+	instance = freerdp_new();
+	freerdp_context_new(instance);
+
+	settings = instance->settings;
+	settings->DumpSession = TRUE;
+	settings->DumpSessionFile = _strdup(TEST_FILE ".rdp");
+	settings->DisableEncryption = TRUE;
+
+	replay_record_activation(instance->context->rdp);
+
+	if ((instance->context->rdp->replay != NULL) || settings->DumpSession)
+	{
+		printf("session with standard RDP security is dumped\n");
+		status = -1;
+	}
+
+	freerdp_context_free(instance);
+	freerdp_free(instance);
+
+	remove(TEST_FILE ".rdp");
+
+	return status;
+}
+
+static void test_end_paint(rdpContext* context)
+{
+	test_end_paints++;
+}
+
+static void test_desktop_resize(rdpContext* context)
+{
+	rdpSettings* settings = context->instance->settings;
+
+	gdi_resize(context->gdi, settings->DesktopWidth, settings->DesktopHeight);
+}
+
+static BOOL test_post_connect(freerdp* instance)
+{
+	gdi_init(instance, CLRCONV_ALPHA | CLRBUF_32BPP, NULL);
+
+	instance->update->EndPaint = test_end_paint;
+	instance->update->DesktopResize = test_desktop_resize;
+
+	return TRUE;
+}
+
+/* plays the dump, returning a checksum of the surface it leaves */
+static int test_replay(UINT32* checksum)
+{
+	int x, y;
+	int status;
+	int records = 0;
+	UINT32 pixel;
+	UINT32 expected;
+	rdpGdi* gdi;
+	freerdp* instance;
+
+	test_end_paints = 0;
+
+	instance = freerdp_new();
+	instance->PostConnect = test_post_connect;
+	freerdp_context_new(instance);
+
+	if (!freerdp_replay_open(instance, TEST_FILE))
+	{
+		printf("session dump does not open\n");
+		return -1;
+	}
+
+	while ((status = freerdp_replay_check(instance)) > 0)
+		records++;
+
+	gdi = instance->context->gdi;
+
+	if ((status < 0) || (records != 1 + (128 + 192) / TEST_TILE * TEST_FRAMES))
+	{
+		printf("%d records of the session dump are played\n", records);
+		status = -1;
+	}
+
+	if (test_end_paints != (128 + 192) / TEST_TILE * TEST_FRAMES)
+	{
+		printf("%d frames are painted\n", test_end_paints);
+		status = -1;
+	}
+
+	if ((gdi->width != test_sizes[1][0]) || (gdi->height != test_sizes[1][1]))
+	{
+		printf("desktop is not resized\n");
+		status = -1;
+	}
+
+	*checksum = 0;
+
+	for (y = 0; (y < gdi->height) && (status == 0); y++)
+	{
+		for (x = 0; x < gdi->width; x++)
+		{
+			pixel = ((UINT32*) gdi->primary_buffer)[y * gdi->width + x] & 0x00FFFFFF;
+			expected = test_tile_color(x, y, TEST_FRAMES - 1) ? 0x00FFFFFF : 0;
+
+			if (pixel != expected)
+			{
+				printf("pixel %d,%d is 0x%06X, not 0x%06X\n", x, y, pixel, expected);
+				status = -1;
+				break;
+			}
+
+			*checksum = (*checksum * 31) + pixel;
+		}
+	}
+
+	cache_free(instance->context->cache);
+	gdi_free(instance);
+	freerdp_context_free(instance);
+	freerdp_free(instance);
+
+	return status;
+}
+
+int TestCoreReplay(int argc, char* argv[])
+{
+	int status = 0;
+	UINT32 first = 0;
+	UINT32 second = 0;
+
+	status |= test_record_rdp_security();
+
+	if (test_record() < 0)
+		return -1;
+
+	status |= test_replay(&first);
+	status |= test_replay(&second);
+
+	if (first != second)
+	{
+		printf("replays leave different surfaces\n");
+		status = -1;
+	}
+
+	remove(TEST_FILE);
+
+	return status;
+}
@@ -0,0 +1,401 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include <winpr/crt.h>
+#include <winpr/interlocked.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/runtime.h>
+
+/**
+ * Load test for the server runtime. Every session is a fake peer on one
+ * end of a socketpair that answers each request PDU with a checksum of its
+ * payload, standing in for the decode work of a real peer. Driver threads
+ * keep one request in flight per session on the other end.
+ *
+ * Sessions per core is derived from the worker CPU time spent per request,
+ * for a session profile of TEST_SESSION_PDU_RATE PDUs per second.
+ *
+ * The fake peer is embedded at the start of its test session so the
+ * callbacks can get back to the session from the peer pointer.
+ *
+ * Usage: TestCoreRuntime [sessions] [milliseconds] [workers]
+ */
+
+#define TEST_SESSIONS			256
+#define TEST_DURATION_MS		500
+#define TEST_REQUEST_SIZE		1024
+#define TEST_SESSION_PDU_RATE		100
+
+typedef struct
+{
+	freerdp_peer client;
+	int fd;
+	pthread_t thread;
+	BOOL dispatched;
+	UINT32 expected;
+	UINT64 replies;
+} testSession;
+
+typedef struct
+{
+	testSession* sessions;
+	int first;
+	int count;
+	UINT64 deadline;
+	UINT64 replies;
+	int errors;
+} testDriver;
+
+static LONG test_closed = 0;
+static LONG test_affinity_errors = 0;
+
+static UINT64 test_now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ((UINT64) ts.tv_sec) * 1000000 + (ts.tv_nsec / 1000);
+}
+
+static UINT32 test_checksum(BYTE* data, int length)
+{
+	int i;
+	UINT32 sum = 0;
+
+	for (i = 0; i < length; i++)
+		sum = (sum << 5) + sum + data[i];
+
+	return sum;
+}
+
+static BOOL test_peer_get_fds(freerdp_peer* client, void** rfds, int* rcount)
+{
+	rfds[*rcount] = (void*)(long)(client->sockfd);
+	(*rcount)++;
+
+	return TRUE;
+}
+
+static BOOL test_peer_check_fds(freerdp_peer* client)
+{
+	ssize_t status;
+	UINT32 checksum;
+	BYTE request[TEST_REQUEST_SIZE];
+	testSession* session = (testSession*) client;
+
+	if (!session->dispatched)
+	{
+		session->thread = pthread_self();
+		session->dispatched = TRUE;
+	}
+	else if (!pthread_equal(session->thread, pthread_self()))
+	{
+		InterlockedIncrement(&test_affinity_errors);
+	}
+
+	while (1)
+	{
+		status = recv(client->sockfd, request, sizeof(request), MSG_DONTWAIT);
+
+		if (status < 0)
+			return ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR)) ? TRUE : FALSE;
+
+		if (status == 0)
+			return FALSE;
+
+		checksum = test_checksum(request, (int) status);
+
+		if (send(client->sockfd, &checksum, sizeof(checksum), MSG_DONTWAIT) != sizeof(checksum))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static void test_peer_closed(freerdp_runtime* runtime, freerdp_peer* client)
+{
+	close(client->sockfd);
+
+	InterlockedIncrement(&test_closed);
+}
+
+static BOOL test_driver_send(testSession* session)
+{
+	int i;
+	BYTE request[TEST_REQUEST_SIZE];
+
+	for (i = 0; i < TEST_REQUEST_SIZE; i++)
+		request[i] = (BYTE) (session->replies + i);
+
+	session->expected = test_checksum(request, TEST_REQUEST_SIZE);
+
+	return (send(session->fd, request, sizeof(request), 0) == sizeof(request)) ? TRUE : FALSE;
+}
+
+static void* test_driver_main(void* arg)
+{
+	int i;
+	int count;
+	int epfd;
+	UINT32 checksum;
+	testSession* session;
+	struct epoll_event event;
+	struct epoll_event events[64];
+	testDriver* driver = (testDriver*) arg;
+
+	epfd = epoll_create(64);
+
+	for (i = driver->first; i < driver->first + driver->count; i++)
+	{
+		session = &driver->sessions[i];
+
+		ZeroMemory(&event, sizeof(event));
+		event.events = EPOLLIN;
+		event.data.ptr = session;
+		epoll_ctl(epfd, EPOLL_CTL_ADD, session->fd, &event);
+
+		if (!test_driver_send(session))
+			driver->errors++;
+	}
+
+	while (test_now_us() < driver->deadline)
+	{
+		count = epoll_wait(epfd, events, 64, 10);
+
+		for (i = 0; i < count; i++)
+		{
+			session = (testSession*) events[i].data.ptr;
+
+			if (recv(session->fd, &checksum, sizeof(checksum), 0) != sizeof(checksum))
+			{
+				driver->errors++;
+				continue;
+			}
+
+			if (checksum != session->expected)
+				driver->errors++;
+
+			session->replies++;
+			driver->replies++;
+
+			if (!test_driver_send(session))
+				driver->errors++;
+		}
+	}
+
+	close(epfd);
+
+	return NULL;
+}
+
+static int test_runtime_load(int num_sessions, int duration_ms, int num_workers)
+{
+	int i;
+	int sv[2];
+	int status = 0;
+	int num_drivers;
+	int min_sessions;
+	int max_sessions;
+	UINT64 start;
+	UINT64 elapsed;
+	UINT64 replies;
+	UINT64 cpu_time_us;
+	double us_per_request;
+	testSession* sessions;
+	testDriver* drivers;
+	pthread_t* threads;
+	freerdp_peer* client;
+	freerdp_runtime* runtime;
+	RUNTIME_WORKER_STATS stats;
+
+	runtime = freerdp_runtime_new(num_workers);
+
+	if (!runtime)
+	{
+		printf("freerdp_runtime_new failed\n");
+		return -1;
+	}
+
+	runtime->PeerClosed = test_peer_closed;
+
+	if (!runtime->Start(runtime))
+	{
+		printf("runtime start failed\n");
+		freerdp_runtime_free(runtime);
+		return -1;
+	}
+
+	test_closed = 0;
+	test_affinity_errors = 0;
+
+	sessions = (testSession*) malloc(sizeof(testSession) * num_sessions);
+	ZeroMemory(sessions, sizeof(testSession) * num_sessions);
+
+	for (i = 0; i < num_sessions; i++)
+	{
+		if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) != 0)
+		{
+			perror("socketpair");
+			num_sessions = i;
+			status = -1;
+			break;
+		}
+
+		client = &sessions[i].client;
+
+		client->sockfd = sv[0];
+		client->GetFileDescriptor = test_peer_get_fds;
+		client->CheckFileDescriptor = test_peer_check_fds;
+
+		sessions[i].fd = sv[1];
+
+		if (!runtime->AddPeer(runtime, client))
+		{
+			printf("AddPeer failed\n");
+			status = -1;
+		}
+	}
+
+	min_sessions = num_sessions;
+	max_sessions = 0;
+	cpu_time_us = 0;
+
+	for (i = 0; i < runtime->num_workers; i++)
+	{
+		runtime->GetWorkerStats(runtime, i, &stats);
+
+		min_sessions = MIN(min_sessions, stats.sessions);
+		max_sessions = MAX(max_sessions, stats.sessions);
+		cpu_time_us -= stats.cpu_time_us;
+	}
+
+	if (max_sessions - min_sessions > 1)
+	{
+		printf("sessions are not balanced across workers: %d - %d\n", min_sessions, max_sessions);
+		status = -1;
+	}
+
+	num_drivers = MAX(1, MIN(runtime->num_workers, num_sessions));
+	drivers = (testDriver*) malloc(sizeof(testDriver) * num_drivers);
+	threads = (pthread_t*) malloc(sizeof(pthread_t) * num_drivers);
+	ZeroMemory(drivers, sizeof(testDriver) * num_drivers);
+
+	start = test_now_us();
+
+	for (i = 0; i < num_drivers; i++)
+	{
+		drivers[i].sessions = sessions;
+		drivers[i].first = (num_sessions * i) / num_drivers;
+		drivers[i].count = ((num_sessions * (i + 1)) / num_drivers) - drivers[i].first;
+		drivers[i].deadline = start + duration_ms * 1000;
+
+		pthread_create(&threads[i], NULL, test_driver_main, &drivers[i]);
+	}
+
+	replies = 0;
+
+	for (i = 0; i < num_drivers; i++)
+	{
+		pthread_join(threads[i], NULL);
+
+		replies += drivers[i].replies;
+
+		if (drivers[i].errors)
+		{
+			printf("driver %d: %d errors\n", i, drivers[i].errors);
+			status = -1;
+		}
+	}
+
+	elapsed = test_now_us() - start;
+
+	for (i = 0; i < runtime->num_workers; i++)
+	{
+		runtime->GetWorkerStats(runtime, i, &stats);
+		cpu_time_us += stats.cpu_time_us;
+	}
+
+	for (i = 0; i < num_sessions; i++)
+	{
+		if (sessions[i].replies == 0)
+		{
+			printf("session %d was never served\n", i);
+			status = -1;
+			break;
+		}
+	}
+
+	/* closing the driver ends must close every session */
+	for (i = 0; i < num_sessions; i++)
+		close(sessions[i].fd);
+
+	for (i = 0; (i < 500) && (test_closed < num_sessions); i++)
+		usleep(10000);
+
+	if (test_closed != num_sessions)
+	{
+		printf("%d of %d sessions closed\n", (int) test_closed, num_sessions);
+		status = -1;
+	}
+
+	runtime->Stop(runtime);
+
+	if (test_affinity_errors)
+	{
+		printf("%d dispatches ran on a different worker thread\n", (int) test_affinity_errors);
+		status = -1;
+	}
+
+	us_per_request = replies ? ((double) cpu_time_us / (double) replies) : 0.0;
+
+	printf("workers: %2d sessions: %5d requests/s: %9.0f worker cpu/request: %6.2f us sessions/core @%d PDU/s: %6.0f\n",
+		runtime->num_workers, num_sessions, (replies * 1000000.0) / (double) elapsed,
+		us_per_request, TEST_SESSION_PDU_RATE,
+		(us_per_request > 0.0) ? (1000000.0 / (us_per_request * TEST_SESSION_PDU_RATE)) : 0.0);
+
+	freerdp_runtime_free(runtime);
+
+	free(threads);
+	free(drivers);
+	free(sessions);
+
+	return status;
+}
+
+int TestCoreRuntime(int argc, char* argv[])
+{
+	int num_sessions = TEST_SESSIONS;
+	int duration_ms = TEST_DURATION_MS;
+	int num_workers = 0;
+
+	if (argc > 1)
+		num_sessions = atoi(argv[1]);
+
+	if (argc > 2)
+		duration_ms = atoi(argv[2]);
+
+	if (argc > 3)
+		num_workers = atoi(argv[3]);
+
+	if (num_sessions < 1)
+		num_sessions = TEST_SESSIONS;
+
+	if (num_workers < 1)
+	{
+		if (test_runtime_load(num_sessions, duration_ms, 1) < 0)
+			return -1;
+	}
+
+	if (test_runtime_load(num_sessions, duration_ms, num_workers) < 0)
+		return -1;
+
+	return 0;
+}
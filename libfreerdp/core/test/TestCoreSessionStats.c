@@ -0,0 +1,324 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <winpr/crt.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/peer.h>
+
+#include "rdp.h"
+#include "surface.h"
+
+/**
+ * Sends frames from a peer to a client over a socketpair: a frame begin
+ * marker, surface bits large enough to be fragmented, and a frame end
+ * marker. The peer has to count the bytes, PDUs, updates and frames such
+ * a frame takes on the wire, and the client the same on receipt, once
+ * plain and once through the bulk compressor, where both have to agree
+ * on the bytes it saved. Surface bits sent without markers, as to clients
+ * not acknowledging frames, have to count as a frame each.
+ *
+ * The SessionStats callbacks of both sides have to be called from their
+ * check fds functions once the reporting interval has passed.
+ */
+
+#define TEST_BITMAP_SIZE	40000
+
+/* the fast-path PDU size fastpath_send_update_pdu() fragments at */
+#define TEST_MAX_PDU_SIZE	0x3FFF
+
+/* a surface frame marker with its update and fast-path headers */
+#define TEST_MARKER_PDU_SIZE	(3 + 3 + 8)
+
+#define TEST_SURFACE_BITS_SIZE	(22 + TEST_BITMAP_SIZE)
+#define TEST_FRAGMENTS		((TEST_SURFACE_BITS_SIZE + TEST_MAX_PDU_SIZE - 7) / (TEST_MAX_PDU_SIZE - 6))
+
+static int test_client_reports = 0;
+static int test_peer_reports = 0;
+static RDP_SESSION_STATS test_client_report;
+static RDP_SESSION_STATS test_peer_report;
+
+static void test_client_session_stats(freerdp* instance, RDP_SESSION_STATS* stats)
+{
+	test_client_reports++;
+	CopyMemory(&test_client_report, stats, sizeof(RDP_SESSION_STATS));
+}
+
+static void test_peer_session_stats(freerdp_peer* client, RDP_SESSION_STATS* stats)
+{
+	test_peer_reports++;
+	CopyMemory(&test_peer_report, stats, sizeof(RDP_SESSION_STATS));
+}
+
+static void test_send_surface_bits(freerdp_peer* client, BYTE* bitmap)
+{
+	SURFACE_BITS_COMMAND command;
+
+	ZeroMemory(&command, sizeof(SURFACE_BITS_COMMAND));
+	command.cmdType = CMDTYPE_STREAM_SURFACE_BITS;
+	command.bpp = 32;
+	command.width = 100;
+	command.height = TEST_BITMAP_SIZE / 400;
+	command.destRight = command.width;
+	command.destBottom = command.height;
+	command.bitmapDataLength = TEST_BITMAP_SIZE;
+	command.bitmapData = bitmap;
+	client->update->SurfaceBits(client->context, &command);
+}
+
+static void test_send_frame(freerdp_peer* client, BYTE* bitmap, UINT32 frameId)
+{
+	SURFACE_FRAME_MARKER marker;
+	rdpUpdate* update = client->update;
+
+	marker.frameAction = SURFACECMD_FRAMEACTION_BEGIN;
+	marker.frameId = frameId;
+	update->SurfaceFrameMarker(client->context, &marker);
+
+	test_send_surface_bits(client, bitmap);
+
+	marker.frameAction = SURFACECMD_FRAMEACTION_END;
+	update->SurfaceFrameMarker(client->context, &marker);
+}
+
+/* lets the client read all the peer has sent so far */
+static int test_receive(freerdp* instance, freerdp_peer* client)
+{
+	int i;
+	RDP_SESSION_STATS sent;
+	RDP_SESSION_STATS received;
+
+	freerdp_peer_get_session_stats(client, &sent);
+
+	for (i = 0; i < 1000; i++)
+	{
+		if (!freerdp_check_fds(instance))
+		{
+			printf("client fails to receive\n");
+			return -1;
+		}
+
+		freerdp_get_session_stats(instance, &received);
+
+		if (received.BytesReceived == sent.BytesSent)
+			return 0;
+	}
+
+	printf("client receives %d of %d bytes\n", (int) received.BytesReceived, (int) sent.BytesSent);
+
+	return -1;
+}
+
+static int test_compare(RDP_SESSION_STATS* sent, RDP_SESSION_STATS* received)
+{
+	if ((received->BytesReceived != sent->BytesSent) || (received->PdusReceived != sent->PdusSent) ||
+		(received->FastPathPdusReceived != sent->FastPathPdusSent) ||
+		(received->UpdatesReceived != sent->UpdatesSent) || (received->FramesReceived != sent->FramesSent))
+	{
+		printf("client receives %d bytes, %d pdus, %d fast-path pdus, %d updates, %d frames\n",
+			(int) received->BytesReceived, (int) received->PdusReceived, (int) received->FastPathPdusReceived,
+			(int) received->UpdatesReceived, (int) received->FramesReceived);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int test_plain(freerdp* instance, freerdp_peer* client, BYTE* bitmap)
+{
+	int status = 0;
+	RDP_SESSION_STATS sent;
+	RDP_SESSION_STATS received;
+
+	test_send_frame(client, bitmap, 1);
+
+	if (test_receive(instance, client) < 0)
+		return -1;
+
+	freerdp_peer_get_session_stats(client, &sent);
+	freerdp_get_session_stats(instance, &received);
+
+	if ((sent.BytesSent != 2 * TEST_MARKER_PDU_SIZE + TEST_SURFACE_BITS_SIZE + 6 * TEST_FRAGMENTS) ||
+		(sent.PdusSent != 2 + TEST_FRAGMENTS) || (sent.FastPathPdusSent != 2 + TEST_FRAGMENTS) ||
+		(sent.UpdatesSent != 3) || (sent.FramesSent != 1))
+	{
+		printf("peer sends %d bytes, %d pdus, %d fast-path pdus, %d updates, %d frames\n",
+			(int) sent.BytesSent, (int) sent.PdusSent, (int) sent.FastPathPdusSent,
+			(int) sent.UpdatesSent, (int) sent.FramesSent);
+		status = -1;
+	}
+
+	if ((sent.UncompressedBytesSent != 0) || (received.DecompressedBytesReceived != 0))
+	{
+		printf("bytes are counted as compressed while compression is off\n");
+		status = -1;
+	}
+
+	status |= test_compare(&sent, &received);
+
+	return status;
+}
+
+static int test_compressed(freerdp* instance, freerdp_peer* client, BYTE* bitmap)
+{
+	int status = 0;
+	RDP_SESSION_STATS sent;
+	RDP_SESSION_STATS received;
+
+	client->settings->CompressionEnabled = TRUE;
+
+	test_send_frame(client, bitmap, 2);
+
+	if (test_receive(instance, client) < 0)
+		return -1;
+
+	freerdp_peer_get_session_stats(client, &sent);
+	freerdp_get_session_stats(instance, &received);
+
+	if ((sent.UpdatesSent != 6) || (sent.FramesSent != 2))
+	{
+		printf("peer sends %d updates, %d frames\n", (int) sent.UpdatesSent, (int) sent.FramesSent);
+		status = -1;
+	}
+
+	if ((sent.UncompressedBytesSent != 2 * 8 + TEST_SURFACE_BITS_SIZE) ||
+		(sent.CompressedBytesSent * 4 > sent.UncompressedBytesSent))
+	{
+		printf("compressor takes %d bytes and gives %d\n",
+			(int) sent.UncompressedBytesSent, (int) sent.CompressedBytesSent);
+		status = -1;
+	}
+
+	/* what the compressor sends flat arrives uncounted, but saves nothing either */
+	if ((received.DecompressedBytesReceived < TEST_SURFACE_BITS_SIZE) ||
+		(received.DecompressedBytesReceived - received.CompressedBytesReceived !=
+			sent.UncompressedBytesSent - sent.CompressedBytesSent))
+	{
+		printf("decompressor takes %d bytes and gives %d\n",
+			(int) received.CompressedBytesReceived, (int) received.DecompressedBytesReceived);
+		status = -1;
+	}
+
+	status |= test_compare(&sent, &received);
+
+	return status;
+}
+
+static int test_unmarked(freerdp* instance, freerdp_peer* client, BYTE* bitmap)
+{
+	int status = 0;
+	RDP_SESSION_STATS sent;
+	RDP_SESSION_STATS received;
+
+	test_send_surface_bits(client, bitmap);
+	test_send_surface_bits(client, bitmap);
+
+	if (test_receive(instance, client) < 0)
+		return -1;
+
+	freerdp_peer_get_session_stats(client, &sent);
+	freerdp_get_session_stats(instance, &received);
+
+	if ((sent.UpdatesSent != 8) || (sent.FramesSent != 4))
+	{
+		printf("peer sends %d updates, %d frames\n", (int) sent.UpdatesSent, (int) sent.FramesSent);
+		status = -1;
+	}
+
+	status |= test_compare(&sent, &received);
+
+	return status;
+}
+
+static int test_reports(freerdp* instance, freerdp_peer* client)
+{
+	int status = 0;
+
+	instance->SessionStats = test_client_session_stats;
+	client->SessionStats = test_peer_session_stats;
+
+	freerdp_check_fds(instance);
+	client->CheckFileDescriptor(client);
+
+	if ((test_client_reports != 0) || (test_peer_reports != 0))
+	{
+		printf("stats are reported before the interval has passed\n");
+		status = -1;
+	}
+
+	/* as if the last report was an interval ago */
+	instance->context->rdp->stats_time -= RDP_SESSION_STATS_INTERVAL;
+	client->context->rdp->stats_time -= RDP_SESSION_STATS_INTERVAL;
+
+	freerdp_check_fds(instance);
+	client->CheckFileDescriptor(client);
+
+	if ((test_client_reports != 1) || (test_peer_reports != 1))
+	{
+		printf("stats are reported %d times to the client, %d times to the peer\n",
+			test_client_reports, test_peer_reports);
+		return -1;
+	}
+
+	status |= test_compare(&test_peer_report, &test_client_report);
+
+	return status;
+}
+
+int TestCoreSessionStats(int argc, char* argv[])
+{
+	int i;
+	int sv[2];
+	int status = 0;
+	BYTE* bitmap;
+	freerdp* instance;
+	freerdp_peer* client;
+	rdpRdp* rdp;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0)
+	{
+		perror("socketpair");
+		return -1;
+	}
+
+	client = freerdp_peer_new(sv[0]);
+	freerdp_peer_context_new(client);
+	client->context->rdp->state = CONNECTION_STATE_ACTIVE;
+
+	instance = freerdp_new();
+	freerdp_context_new(instance);
+
+	rdp = instance->context->rdp;
+	transport_attach(rdp->transport, sv[1]);
+	rdp_set_blocking_mode(rdp, FALSE);
+	rdp->state = CONNECTION_STATE_ACTIVE;
+
+	bitmap = (BYTE*) malloc(TEST_BITMAP_SIZE);
+
+	for (i = 0; i < TEST_BITMAP_SIZE; i++)
+		bitmap[i] = (BYTE) ((i / 400) & 0x0F);
+
+	status |= test_plain(instance, client, bitmap);
+
+	if (status == 0)
+		status |= test_compressed(instance, client, bitmap);
+
+	if (status == 0)
+		status |= test_unmarked(instance, client, bitmap);
+
+	if (status == 0)
+		status |= test_reports(instance, client);
+
+	free(bitmap);
+
+	freerdp_context_free(instance);
+	freerdp_free(instance);
+
+	freerdp_peer_context_free(client);
+	freerdp_peer_free(client);
+
+	return status;
+}
@@ -32,6 +32,7 @@
 #include <freerdp/utils/sleep.h>
 #include <freerdp/utils/stream.h>
 #include <freerdp/utils/hexdump.h>
+#include <freerdp/utils/trace.h>
 #include <freerdp/errorcodes.h>
 
 #include <time.h>
@@ -68,6 +69,9 @@ STREAM* transport_send_stream_init(rdpTransport* transport, int size)
 void transport_attach(rdpTransport* transport, int sockfd)
 {
 	transport->TcpIn->sockfd = sockfd;
+
+	transport->SplitInputOutput = FALSE;
+	transport->TcpOut = transport->TcpIn;
 }
 
 BOOL transport_disconnect(rdpTransport* transport)
@@ -218,61 +222,50 @@ BOOL transport_accept_rdp(rdpTransport* transport)
 	return TRUE;
 }
 
-BOOL transport_accept_tls(rdpTransport* transport)
+/**
+ * The server side TLS and NLA handshakes are not run to completion here:
+ * transport_accept_tls() and transport_accept_nla() only set them up, and
+ * transport_accept_check() then advances them as data arrives on the
+ * non-blocking socket, so a slow client never holds the calling thread.
+ */
+
+static BOOL transport_accept_tls_begin(rdpTransport* transport, BOOL nla)
 {
 	if (transport->TlsIn == NULL)
 		transport->TlsIn = tls_new(transport->settings);
 
+	if (transport->TlsOut == NULL)
+		transport->TlsOut = transport->TlsIn;
+
 	transport->layer = TRANSPORT_LAYER_TLS;
 	transport->TlsIn->sockfd = transport->TcpIn->sockfd;
 
-	if (tls_accept(transport->TlsIn, transport->settings->CertificateFile, transport->settings->PrivateKeyFile) != TRUE)
+	if (tls_accept_begin(transport->TlsIn, transport->settings->CertificateFile, transport->settings->PrivateKeyFile) != TRUE)
 		return FALSE;
 
+	transport->accept_nla = nla;
+	transport->accept_state = TRANSPORT_ACCEPT_TLS;
+
 	return TRUE;
 }
 
-BOOL transport_accept_nla(rdpTransport* transport)
+BOOL transport_accept_tls(rdpTransport* transport)
 {
-	freerdp* instance;
-	rdpSettings* settings;
-
-	if (transport->TlsIn == NULL)
-		transport->TlsIn = tls_new(transport->settings);
-
-	transport->layer = TRANSPORT_LAYER_TLS;
-	transport->TlsIn->sockfd = transport->TcpIn->sockfd;
-
-	if (tls_accept(transport->TlsIn, transport->settings->CertificateFile, transport->settings->PrivateKeyFile) != TRUE)
-		return FALSE;
-
-	/* Network Level Authentication */
-
-	if (transport->settings->Authentication != TRUE)
-		return TRUE;
-
-	settings = transport->settings;
-	instance = (freerdp*) settings->instance;
-
-	if (transport->credssp == NULL)
-		transport->credssp = credssp_new(instance, transport, settings);
-
-	if (credssp_authenticate(transport->credssp) < 0)
-	{
-		printf("client authentication failure\n");
-		credssp_free(transport->credssp);
-		return FALSE;
-	}
-
-	/* don't free credssp module yet, we need to copy the credentials from it first */
+	return transport_accept_tls_begin(transport, FALSE);
+}
 
-	return TRUE;
+BOOL transport_accept_nla(rdpTransport* transport)
+{
+	return transport_accept_tls_begin(transport, TRUE);
 }
 
 int transport_read(rdpTransport* transport, STREAM* s)
 {
+	UINT64 trace;
 	int status = -1;
 
+	TRACE_BEGIN(trace);
+
 	while (TRUE)
 	{
 		if (transport->layer == TRANSPORT_LAYER_TLS)
@@ -291,6 +284,14 @@ int transport_read(rdpTransport* transport, STREAM* s)
 		break;
 	}
 
+	if (status > 0)
+	{
+		TRACE_END(TRACE_TRANSPORT_READ, trace);
+
+		if (transport->stats)
+			transport->stats->BytesReceived += status;
+	}
+
 #ifdef WITH_DEBUG_TRANSPORT
 	if (status > 0)
 	{
@@ -317,10 +318,177 @@ static int transport_read_nonblocking(rdpTransport* transport)
 	return status;
 }
 
+/**
+ * Detach the first length bytes of the receive buffer as a PDU of their
+ * own, keeping whatever follows for the next one.
+ */
+
+static STREAM* transport_split_pdu(rdpTransport* transport, int pos, int length)
+{
+	STREAM* received;
+
+	received = transport->recv_buffer;
+	transport->recv_buffer = stream_new(BUFFER_SIZE);
+
+	if (pos > length)
+	{
+		stream_set_pos(received, length);
+		stream_check_size(transport->recv_buffer, pos - length);
+		stream_copy(transport->recv_buffer, received, pos - length);
+	}
+
+	stream_set_pos(received, length);
+	stream_seal(received);
+	stream_set_pos(received, 0);
+
+	return received;
+}
+
+/**
+ * Length of the DER encoded TSRequest at the head of data.
+ * @return the PDU length, 0 if the header is incomplete, -1 if it is not a TSRequest
+ */
+
+static int transport_ts_request_length(BYTE* data, int size)
+{
+	int i;
+	int count;
+	int length;
+
+	if (size < 2)
+		return 0;
+
+	if (data[0] != 0x30)
+		return -1;
+
+	if (!(data[1] & 0x80))
+		return 2 + data[1];
+
+	count = data[1] & 0x7F;
+
+	if ((count < 1) || (count > 3))
+		return -1;
+
+	if (size < 2 + count)
+		return 0;
+
+	length = 0;
+
+	for (i = 0; i < count; i++)
+		length = (length << 8) | data[2 + i];
+
+	return 2 + count + length;
+}
+
+static int transport_accept_check_nla(rdpTransport* transport)
+{
+	int pos;
+	int length;
+	int status;
+	STREAM* received;
+
+	while (1)
+	{
+		status = transport_read_nonblocking(transport);
+
+		if (status < 0)
+			return -1;
+
+		pos = stream_get_pos(transport->recv_buffer);
+		length = transport_ts_request_length(stream_get_head(transport->recv_buffer), pos);
+
+		if (length < 0)
+		{
+			printf("transport_accept_check: protocol error, not a TSRequest.\n");
+			return -1;
+		}
+
+		if ((length > 0) && (pos >= length))
+		{
+			received = transport_split_pdu(transport, pos, length);
+			status = credssp_server_recv(transport->credssp, received);
+			stream_free(received);
+
+			if (status < 0)
+			{
+				printf("client authentication failure\n");
+				credssp_free(transport->credssp);
+				transport->credssp = NULL;
+				return -1;
+			}
+
+			/* don't free credssp module yet, we need to copy the credentials from it first */
+
+			if (status > 0)
+			{
+				transport->accept_state = TRANSPORT_ACCEPT_NONE;
+				return 1;
+			}
+
+			continue;
+		}
+
+		if (status == 0)
+			return 0;
+	}
+}
+
+/**
+ * Advance the server side handshake started by transport_accept_tls() or
+ * transport_accept_nla() with whatever the client has sent so far.
+ * @return 1 when the handshake is complete, 0 when waiting for the client, -1 on failure
+ */
+
+int transport_accept_check(rdpTransport* transport)
+{
+	int status;
+	freerdp* instance;
+	rdpSettings* settings = transport->settings;
+
+	if (transport->accept_state == TRANSPORT_ACCEPT_TLS)
+	{
+		status = tls_accept_continue(transport->TlsIn);
+
+		if (status <= 0)
+			return status;
+
+		/* Network Level Authentication */
+
+		if ((transport->accept_nla != TRUE) || (settings->Authentication != TRUE))
+		{
+			transport->accept_state = TRANSPORT_ACCEPT_NONE;
+			return 1;
+		}
+
+		instance = (freerdp*) settings->instance;
+
+		if (transport->credssp == NULL)
+			transport->credssp = credssp_new(instance, transport, settings);
+
+		if (credssp_server_begin(transport->credssp) < 0)
+		{
+			printf("client authentication failure\n");
+			credssp_free(transport->credssp);
+			transport->credssp = NULL;
+			return -1;
+		}
+
+		transport->accept_state = TRANSPORT_ACCEPT_NLA;
+	}
+
+	if (transport->accept_state == TRANSPORT_ACCEPT_NLA)
+		return transport_accept_check_nla(transport);
+
+	return 1;
+}
+
 int transport_write(rdpTransport* transport, STREAM* s)
 {
 	int status = -1;
 	int length;
+	UINT64 trace;
+
+	TRACE_BEGIN(trace);
 
 	length = stream_get_length(s);
 	stream_set_pos(s, 0);
@@ -361,6 +529,9 @@ int transport_write(rdpTransport* transport, STREAM* s)
 
 		length -= status;
 		stream_seek(s, status);
+
+		if (transport->stats)
+			transport->stats->BytesSent += status;
 	}
 
 	if (status < 0)
@@ -368,6 +539,12 @@ int transport_write(rdpTransport* transport, STREAM* s)
 		/* A write error indicates that the peer has dropped the connection */
 		transport->layer = TRANSPORT_LAYER_CLOSED;
 	}
+	else if (transport->stats)
+	{
+		transport->stats->PdusSent++;
+	}
+
+	TRACE_END(TRACE_SEND, trace);
 
 	return status;
 }
@@ -476,19 +653,10 @@ int transport_check_fds(rdpTransport** ptransport)
 		 * A complete packet has been received. In case there are trailing data
 		 * for the next packet, we copy it to the new receive buffer.
 		 */
-		received = transport->recv_buffer;
-		transport->recv_buffer = stream_new(BUFFER_SIZE);
+		received = transport_split_pdu(transport, pos, length);
 
-		if (pos > length)
-		{
-			stream_set_pos(received, length);
-			stream_check_size(transport->recv_buffer, pos - length);
-			stream_copy(transport->recv_buffer, received, pos - length);
-		}
-
-		stream_set_pos(received, length);
-		stream_seal(received);
-		stream_set_pos(received, 0);
+		if (transport->stats)
+			transport->stats->PdusReceived++;
 
 		if (transport->recv_callback(transport, received, transport->recv_extra) == FALSE)
 			status = -1;
@@ -501,6 +669,10 @@ int transport_check_fds(rdpTransport** ptransport)
 		/* transport might now have been freed by rdp_client_redirect and a new rdp->transport created */
 		transport = *ptransport;
 
+		/* the next bytes belong to the security handshake the callback started */
+		if (transport->accept_state != TRANSPORT_ACCEPT_NONE)
+			break;
+
 		if (transport->ProcessSinglePdu)
 		{
 			/* one at a time but set event if data buffered
@@ -28,6 +28,13 @@ typedef enum
 	TRANSPORT_LAYER_CLOSED
 } TRANSPORT_LAYER;
 
+typedef enum
+{
+	TRANSPORT_ACCEPT_NONE,
+	TRANSPORT_ACCEPT_TLS,
+	TRANSPORT_ACCEPT_NLA
+} TRANSPORT_ACCEPT_STATE;
+
 typedef struct rdp_transport rdpTransport;
 
 #include "tcp.h"
@@ -39,6 +46,7 @@ typedef struct rdp_transport rdpTransport;
 
 #include <time.h>
 #include <freerdp/types.h>
+#include <freerdp/freerdp.h>
 #include <freerdp/settings.h>
 #include <freerdp/utils/stream.h>
 
@@ -58,12 +66,15 @@ struct rdp_transport
 	rdpSettings* settings;
 	UINT32 usleep_interval;
 	void* recv_extra;
+	RDP_SESSION_STATS* stats;
 	STREAM* recv_buffer;
 	TransportRecv recv_callback;
 	HANDLE recv_event;
 	BOOL blocking;
 	BOOL ProcessSinglePdu;
 	BOOL SplitInputOutput;
+	BOOL accept_nla;
+	TRANSPORT_ACCEPT_STATE accept_state;
 };
 
 STREAM* transport_recv_stream_init(rdpTransport* transport, int size);
@@ -78,6 +89,7 @@ BOOL transport_connect_tsg(rdpTransport* transport);
 BOOL transport_accept_rdp(rdpTransport* transport);
 BOOL transport_accept_tls(rdpTransport* transport);
 BOOL transport_accept_nla(rdpTransport* transport);
+int transport_accept_check(rdpTransport* transport);
 int transport_read(rdpTransport* transport, STREAM* s);
 int transport_write(rdpTransport* transport, STREAM* s);
 void transport_get_fds(rdpTransport* transport, void** rfds, int* rcount);
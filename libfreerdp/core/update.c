@@ -288,6 +288,9 @@ BOOL update_recv(rdpUpdate* update, STREAM* s)
 		case UPDATE_TYPE_BITMAP:
 			update_read_bitmap(update, s, &update->bitmap_update);
 			IFCALL(update->BitmapUpdate, context, &update->bitmap_update);
+
+			if (!context->rdp->in_received_frame)
+				context->rdp->stats.FramesReceived++;
 			break;
 
 		case UPDATE_TYPE_PALETTE:
@@ -429,6 +432,9 @@ static void update_send_surface_bits(rdpContext* context, SURFACE_BITS_COMMAND*
 	update_write_surfcmd_surface_bits_header(s, surface_bits_command);
 	stream_write(s, surface_bits_command->bitmapData, surface_bits_command->bitmapDataLength);
 	fastpath_send_update_pdu(rdp->fastpath, FASTPATH_UPDATETYPE_SURFCMDS, s);
+
+	if (!rdp->in_sent_frame)
+		rdp->stats.FramesSent++;
 }
 
 static void update_send_surface_frame_marker(rdpContext* context, SURFACE_FRAME_MARKER* surface_frame_marker)
@@ -439,6 +445,16 @@ static void update_send_surface_frame_marker(rdpContext* context, SURFACE_FRAME_
 	s = fastpath_update_pdu_init(rdp->fastpath);
 	update_write_surfcmd_frame_marker(s, surface_frame_marker->frameAction, surface_frame_marker->frameId);
 	fastpath_send_update_pdu(rdp->fastpath, FASTPATH_UPDATETYPE_SURFCMDS, s);
+
+	if (surface_frame_marker->frameAction == SURFACECMD_FRAMEACTION_BEGIN)
+	{
+		rdp->in_sent_frame = TRUE;
+	}
+	else if (surface_frame_marker->frameAction == SURFACECMD_FRAMEACTION_END)
+	{
+		rdp->in_sent_frame = FALSE;
+		rdp->stats.FramesSent++;
+	}
 }
 
 static void update_send_synchronize(rdpContext* context)
@@ -154,11 +154,15 @@ BOOL tls_connect(rdpTls* tls)
 	return TRUE;
 }
 
-BOOL tls_accept(rdpTls* tls, const char* cert_file, const char* privatekey_file)
+/**
+ * Sets up the server side of a TLS connection without running the
+ * handshake, which is then driven by tls_accept_continue().
+ */
+
+BOOL tls_accept_begin(rdpTls* tls, const char* cert_file, const char* privatekey_file)
 {
 	CryptoCert cert;
 	long options = 0;
-	int connection_status;
 
 	tls->ctx = SSL_CTX_new(SSLv23_server_method());
 
@@ -250,34 +254,55 @@ BOOL tls_accept(rdpTls* tls, const char* cert_file, const char* privatekey_file)
 		return FALSE;
 	}
 
-	while (1)
-	{
-		connection_status = SSL_accept(tls->ssl);
+	return TRUE;
+}
 
-		if (connection_status <= 0)
-		{
-			switch (SSL_get_error(tls->ssl, connection_status))
-			{
-				case SSL_ERROR_WANT_READ:
-				case SSL_ERROR_WANT_WRITE:
-					break;
+/**
+ * Advances the server handshake as far as the socket allows.
+ * @return 1 when the handshake is complete, 0 when it needs more data, -1 on error
+ */
 
-				default:
-					if (tls_print_error("SSL_accept", tls->ssl, connection_status))
-						return FALSE;
-					break;
+int tls_accept_continue(rdpTls* tls)
+{
+	int connection_status;
 
-			}
-		}
-		else
-		{
+	connection_status = SSL_accept(tls->ssl);
+
+	if (connection_status > 0)
+	{
+		printf("TLS connection accepted\n");
+		return 1;
+	}
+
+	switch (SSL_get_error(tls->ssl, connection_status))
+	{
+		case SSL_ERROR_WANT_READ:
+		case SSL_ERROR_WANT_WRITE:
+			return 0;
+
+		default:
+			if (tls_print_error("SSL_accept", tls->ssl, connection_status))
+				return -1;
 			break;
-		}
 	}
 
-	printf("TLS connection accepted\n");
+	return 0;
+}
 
-	return TRUE;
+/**
+ * Accepts a TLS connection, blocking until the handshake is done.
+ */
+
+BOOL tls_accept(rdpTls* tls, const char* cert_file, const char* privatekey_file)
+{
+	int status;
+
+	if (tls_accept_begin(tls, cert_file, privatekey_file) != TRUE)
+		return FALSE;
+
+	while ((status = tls_accept_continue(tls)) == 0);
+
+	return (status > 0) ? TRUE : FALSE;
 }
 
 BOOL tls_disconnect(rdpTls* tls)
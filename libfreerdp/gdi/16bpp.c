@@ -38,6 +38,8 @@
 
 #include <freerdp/gdi/16bpp.h>
 
+#include "rop.h"
+
 UINT16 gdi_get_color_16bpp(HGDI_DC hdc, GDI_COLOR color)
 {
 	BYTE r, g, b;
@@ -73,10 +75,11 @@ UINT16 gdi_get_color_16bpp(HGDI_DC hdc, GDI_COLOR color)
 
 int FillRect_16bpp(HGDI_DC hdc, HGDI_RECT rect, HGDI_BRUSH hbr)
 {
-	int x, y;
+	int y;
 	UINT16 *dstp;
 	int nXDest, nYDest;
 	int nWidth, nHeight;
+	const GDI_ROP_KERNELS* rop = gdi_rop_kernels_get();
 
 	UINT16 color16;
 	
@@ -92,13 +95,7 @@ int FillRect_16bpp(HGDI_DC hdc, HGDI_RECT rect, HGDI_BRUSH hbr)
 		dstp = (UINT16*) gdi_get_bitmap_pointer(hdc, nXDest, nYDest + y);
 
 		if (dstp != 0)
-		{
-			for (x = 0; x < nWidth; x++)
-			{
-				*dstp = color16;
-				dstp++;
-			}
-		}
+			rop->fill_16((BYTE*) dstp, nWidth, color16);
 	}
 
 	gdi_InvalidateRegion(hdc, nXDest, nYDest, nWidth, nHeight);
@@ -142,6 +139,7 @@ static int BitBlt_SRCCOPY_16bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWi
 	int y;
 	BYTE* srcp;
 	BYTE* dstp;
+	const GDI_ROP_KERNELS* rop = gdi_rop_kernels_get();
 
 	if ((hdcDest->selectedObject != hdcSrc->selectedObject) ||
 	    gdi_CopyOverlap(nXDest, nYDest, nWidth, nHeight, nXSrc, nYSrc) == 0)
@@ -152,7 +150,7 @@ static int BitBlt_SRCCOPY_16bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWi
 			dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
 
 			if (srcp != 0 && dstp != 0)
-				memcpy(dstp, srcp, nWidth * hdcDest->bytesPerPixel);
+				rop->srccopy(dstp, srcp, nWidth * hdcDest->bytesPerPixel);
 		}
 
 		return 0;
@@ -297,24 +295,18 @@ static int BitBlt_NOTSRCERASE_16bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int
 
 static int BitBlt_SRCINVERT_16bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc)
 {
-	int x, y;
-	UINT16* srcp;
-	UINT16* dstp;
-		
+	int y;
+	BYTE* srcp;
+	BYTE* dstp;
+	const GDI_ROP_KERNELS* rop = gdi_rop_kernels_get();
+
 	for (y = 0; y < nHeight; y++)
 	{
-		srcp = (UINT16*) gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
-		dstp = (UINT16*) gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
+		srcp = gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
+		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
 
-		if (dstp != 0)
-		{
-			for (x = 0; x < nWidth; x++)
-			{
-				*dstp ^= *srcp;
-				srcp++;
-				dstp++;
-			}
-		}
+		if (srcp != 0 && dstp != 0)
+			rop->srcinvert(dstp, srcp, nWidth * hdcDest->bytesPerPixel);
 	}
 
 	return 0;
@@ -322,24 +314,18 @@ static int BitBlt_SRCINVERT_16bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int n
 
 static int BitBlt_SRCAND_16bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc)
 {
-	int x, y;
-	UINT16* srcp;
-	UINT16* dstp;
-		
+	int y;
+	BYTE* srcp;
+	BYTE* dstp;
+	const GDI_ROP_KERNELS* rop = gdi_rop_kernels_get();
+
 	for (y = 0; y < nHeight; y++)
 	{
-		srcp = (UINT16*) gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
-		dstp = (UINT16*) gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
+		srcp = gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
+		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
 
-		if (dstp != 0)
-		{
-			for (x = 0; x < nWidth; x++)
-			{
-				*dstp &= *srcp;
-				srcp++;
-				dstp++;
-			}
-		}
+		if (srcp != 0 && dstp != 0)
+			rop->srcand(dstp, srcp, nWidth * hdcDest->bytesPerPixel);
 	}
 
 	return 0;
@@ -372,12 +358,12 @@ static int BitBlt_SRCPAINT_16bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nW
 
 static int BitBlt_DSPDxax_16bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc)
 {	
-	int x, y;
+	int y;
 	BYTE* srcp;
-	UINT16* dstp;
-	UINT16 src16;
+	BYTE* dstp;
 	UINT16 color16;
 	HGDI_BITMAP hSrcBmp;
+	const GDI_ROP_KERNELS* rop = gdi_rop_kernels_get();
 
 	/* D = (S & P) | (~S & D) */
 	/* DSPDxax, used to draw glyphs */
@@ -394,19 +380,11 @@ static int BitBlt_DSPDxax_16bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWi
 	
 	for (y = 0; y < nHeight; y++)
 	{
-		srcp = (BYTE*) gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
-		dstp = (UINT16*) gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
+		srcp = gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
+		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
 
-		if (dstp != 0)
-		{
-			for (x = 0; x < nWidth; x++)
-			{
-				src16 = (*srcp << 8) | *srcp;
-				*dstp = (src16 & color16) | (~src16 & *dstp);
-				srcp++;
-				dstp++;
-			}
-		}
+		if (srcp != 0 && dstp != 0)
+			rop->dspdxax_16(dstp, srcp, nWidth, color16);
 	}
 
 	return 0;
@@ -626,22 +604,35 @@ static int BitBlt_PATCOPY_16bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWi
 	UINT16* dstp;
 	UINT16* patp;
 	UINT16 color16;
+	HGDI_BITMAP hBmpBrush;
+	const GDI_ROP_KERNELS* rop = gdi_rop_kernels_get();
 
 	if (hdcDest->brush->style == GDI_BS_SOLID)
 	{
 		color16 = gdi_get_color_16bpp(hdcDest, hdcDest->brush->color);
 
+		for (y = 0; y < nHeight; y++)
+		{
+			dstp = (UINT16*) gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
+
+			if (dstp != 0)
+				rop->fill_16((BYTE*) dstp, nWidth, color16);
+		}
+	}
+	else if ((hdcDest->brush->style == GDI_BS_PATTERN) &&
+			(hdcDest->brush->pattern->bytesPerPixel == hdcDest->bytesPerPixel))
+	{
+		hBmpBrush = hdcDest->brush->pattern;
+
 		for (y = 0; y < nHeight; y++)
 		{
 			dstp = (UINT16*) gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
 
 			if (dstp != 0)
 			{
-				for (x = 0; x < nWidth; x++)
-				{
-					*dstp = color16;
-					dstp++;
-				}
+				rop->fill_pattern((BYTE*) dstp, nWidth * hdcDest->bytesPerPixel,
+					&hBmpBrush->data[(y % hBmpBrush->height) * hBmpBrush->scanline],
+					hBmpBrush->width * hBmpBrush->bytesPerPixel);
 			}
 		}
 	}
@@ -38,6 +38,8 @@
 
 #include <freerdp/gdi/32bpp.h>
 
+#include "rop.h"
+
 UINT32 gdi_get_color_32bpp(HGDI_DC hdc, GDI_COLOR color)
 {
 	UINT32 color32;
@@ -60,11 +62,12 @@ UINT32 gdi_get_color_32bpp(HGDI_DC hdc, GDI_COLOR color)
 
 int FillRect_32bpp(HGDI_DC hdc, HGDI_RECT rect, HGDI_BRUSH hbr)
 {
-	int x, y;
+	int y;
 	UINT32 *dstp;
 	UINT32 color32;
 	int nXDest, nYDest;
 	int nWidth, nHeight;
+	const GDI_ROP_KERNELS* rop = gdi_rop_kernels_get();
 
 	gdi_RectToCRgn(rect, &nXDest, &nYDest, &nWidth, &nHeight);
 	
@@ -78,13 +81,7 @@ int FillRect_32bpp(HGDI_DC hdc, HGDI_RECT rect, HGDI_BRUSH hbr)
 		dstp = (UINT32*) gdi_get_bitmap_pointer(hdc, nXDest, nYDest + y);
 
 		if (dstp != 0)
-		{
-			for (x = 0; x < nWidth; x++)
-			{
-				*dstp = color32;
-				dstp++;
-			}
-		}
+			rop->fill_32((BYTE*) dstp, nWidth, color32);
 	}
 
 	gdi_InvalidateRegion(hdc, nXDest, nYDest, nWidth, nHeight);
@@ -159,6 +156,7 @@ static int BitBlt_SRCCOPY_32bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWi
 	int y;
 	BYTE* srcp;
 	BYTE* dstp;
+	const GDI_ROP_KERNELS* rop = gdi_rop_kernels_get();
 
 	if ((hdcDest->selectedObject != hdcSrc->selectedObject) ||
 	    gdi_CopyOverlap(nXDest, nYDest, nWidth, nHeight, nXSrc, nYSrc) == 0)
@@ -169,7 +167,7 @@ static int BitBlt_SRCCOPY_32bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWi
 			dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
 
 			if (srcp != 0 && dstp != 0)
-				memcpy(dstp, srcp, nWidth * hdcDest->bytesPerPixel);
+				rop->srccopy(dstp, srcp, nWidth * hdcDest->bytesPerPixel);
 		}
 
 		return 0;
@@ -314,24 +312,18 @@ static int BitBlt_NOTSRCERASE_32bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int
 
 static int BitBlt_SRCINVERT_32bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc)
 {
-	int x, y;
-	UINT32* srcp;
-	UINT32* dstp;
-		
+	int y;
+	BYTE* srcp;
+	BYTE* dstp;
+	const GDI_ROP_KERNELS* rop = gdi_rop_kernels_get();
+
 	for (y = 0; y < nHeight; y++)
 	{
-		srcp = (UINT32*) gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
-		dstp = (UINT32*) gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
+		srcp = gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
+		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
 
-		if (dstp != 0)
-		{
-			for (x = 0; x < nWidth; x++)
-			{
-				*dstp ^= *srcp;
-				srcp++;
-				dstp++;
-			}
-		}
+		if (srcp != 0 && dstp != 0)
+			rop->srcinvert(dstp, srcp, nWidth * hdcDest->bytesPerPixel);
 	}
 
 	return 0;
@@ -339,24 +331,18 @@ static int BitBlt_SRCINVERT_32bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int n
 
 static int BitBlt_SRCAND_32bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc)
 {
-	int x, y;
-	UINT32* srcp;
-	UINT32* dstp;
-		
+	int y;
+	BYTE* srcp;
+	BYTE* dstp;
+	const GDI_ROP_KERNELS* rop = gdi_rop_kernels_get();
+
 	for (y = 0; y < nHeight; y++)
 	{
-		srcp = (UINT32*) gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
-		dstp = (UINT32*) gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
+		srcp = gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
+		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
 
-		if (dstp != 0)
-		{
-			for (x = 0; x < nWidth; x++)
-			{
-				*dstp &= *srcp;
-				srcp++;
-				dstp++;
-			}
-		}
+		if (srcp != 0 && dstp != 0)
+			rop->srcand(dstp, srcp, nWidth * hdcDest->bytesPerPixel);
 	}
 
 	return 0;
@@ -394,9 +380,10 @@ static int BitBlt_DSPDxax_32bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWi
 	UINT32* dstp;
 	UINT32* patp;
 	BYTE* srcp8;
-	UINT32 src32;
+	BYTE* dstp8;
 	UINT32 color32;
 	HGDI_BITMAP hSrcBmp;
+	const GDI_ROP_KERNELS* rop = gdi_rop_kernels_get();
 
 	/* D = (S & P) | (~S & D) */
 
@@ -409,25 +396,13 @@ static int BitBlt_DSPDxax_32bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWi
 	{
 		/* DSPDxax, used to draw glyphs */
 
-		srcp = (UINT32*) & src32;
-
 		for (y = 0; y < nHeight; y++)
 		{
-			srcp8 = (BYTE*) gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
-			dstp = (UINT32*) gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
-
-			if (dstp != 0)
-			{
-				for (x = 0; x < nWidth; x++)
-				{
-					*srcp = ((*srcp8) | (*srcp8 << 8) | (*srcp8 << 16) | (*srcp8 << 24));
+			srcp8 = gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
+			dstp8 = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
 
-					*dstp = (*srcp & *patp) | (~(*srcp) & *dstp);
-					dstp++;
-
-					srcp8++;
-				}
-			}
+			if (srcp8 != 0 && dstp8 != 0)
+				rop->dspdxax_32(dstp8, srcp8, nWidth, color32);
 		}
 	}
 	else
@@ -668,22 +643,35 @@ static int BitBlt_PATCOPY_32bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWi
 	UINT32* dstp;
 	UINT32* patp;
 	UINT32 color32;
+	HGDI_BITMAP hBmpBrush;
+	const GDI_ROP_KERNELS* rop = gdi_rop_kernels_get();
 
 	if (hdcDest->brush->style == GDI_BS_SOLID)
 	{
 		color32 = gdi_get_color_32bpp(hdcDest, hdcDest->brush->color);
 
+		for (y = 0; y < nHeight; y++)
+		{
+			dstp = (UINT32*) gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
+
+			if (dstp != 0)
+				rop->fill_32((BYTE*) dstp, nWidth, color32);
+		}
+	}
+	else if ((hdcDest->brush->style == GDI_BS_PATTERN) &&
+			(hdcDest->brush->pattern->bytesPerPixel == hdcDest->bytesPerPixel))
+	{
+		hBmpBrush = hdcDest->brush->pattern;
+
 		for (y = 0; y < nHeight; y++)
 		{
 			dstp = (UINT32*) gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
 
 			if (dstp != 0)
 			{
-				for (x = 0; x < nWidth; x++)
-				{
-					*dstp = color32;
-					dstp++;
-				}
+				rop->fill_pattern((BYTE*) dstp, nWidth * hdcDest->bytesPerPixel,
+					&hBmpBrush->data[(y % hBmpBrush->height) * hBmpBrush->scanline],
+					hBmpBrush->width * hBmpBrush->bytesPerPixel);
 			}
 		}
 	}
@@ -38,6 +38,8 @@
 
 #include <freerdp/gdi/8bpp.h>
 
+#include "rop.h"
+
 BYTE gdi_get_color_8bpp(HGDI_DC hdc, GDI_COLOR color)
 {
 	/* TODO: Implement 8bpp gdi_get_color_8bpp() */
@@ -87,6 +89,7 @@ static int BitBlt_SRCCOPY_8bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWid
 	int y;
 	BYTE* srcp;
 	BYTE* dstp;
+	const GDI_ROP_KERNELS* rop = gdi_rop_kernels_get();
 
 	if ((hdcDest->selectedObject != hdcSrc->selectedObject) ||
 	    gdi_CopyOverlap(nXDest, nYDest, nWidth, nHeight, nXSrc, nYSrc) == 0)
@@ -97,7 +100,7 @@ static int BitBlt_SRCCOPY_8bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWid
 			dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
 
 			if (srcp != 0 && dstp != 0)
-				memcpy(dstp, srcp, nWidth * hdcDest->bytesPerPixel);
+				rop->srccopy(dstp, srcp, nWidth * hdcDest->bytesPerPixel);
 		}
 
 		return 0;
@@ -242,24 +245,18 @@ static int BitBlt_NOTSRCERASE_8bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int
 
 static int BitBlt_SRCINVERT_8bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc)
 {
-	int x, y;
+	int y;
 	BYTE* srcp;
 	BYTE* dstp;
-		
+	const GDI_ROP_KERNELS* rop = gdi_rop_kernels_get();
+
 	for (y = 0; y < nHeight; y++)
 	{
 		srcp = gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
 		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
 
-		if (dstp != 0)
-		{
-			for (x = 0; x < nWidth; x++)
-			{
-				*dstp ^= *srcp;
-				srcp++;
-				dstp++;
-			}
-		}
+		if (srcp != 0 && dstp != 0)
+			rop->srcinvert(dstp, srcp, nWidth * hdcDest->bytesPerPixel);
 	}
 
 	return 0;
@@ -267,24 +264,18 @@ static int BitBlt_SRCINVERT_8bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nW
 
 static int BitBlt_SRCAND_8bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc)
 {
-	int x, y;
+	int y;
 	BYTE* srcp;
 	BYTE* dstp;
-		
+	const GDI_ROP_KERNELS* rop = gdi_rop_kernels_get();
+
 	for (y = 0; y < nHeight; y++)
 	{
 		srcp = gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
 		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
 
-		if (dstp != 0)
-		{
-			for (x = 0; x < nWidth; x++)
-			{
-				*dstp &= *srcp;
-				srcp++;
-				dstp++;
-			}
-		}
+		if (srcp != 0 && dstp != 0)
+			rop->srcand(dstp, srcp, nWidth * hdcDest->bytesPerPixel);
 	}
 
 	return 0;
@@ -540,6 +531,8 @@ static int BitBlt_PATCOPY_8bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWid
 	BYTE* dstp;
 	BYTE* patp;
 	BYTE palIndex;
+	HGDI_BITMAP hBmpBrush;
+	const GDI_ROP_KERNELS* rop = gdi_rop_kernels_get();
 
 	if(hdcDest->brush->style == GDI_BS_SOLID)
 	{
@@ -547,13 +540,24 @@ static int BitBlt_PATCOPY_8bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWid
 		for (y = 0; y < nHeight; y++)
 		{
 			dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
+			if (dstp != 0)
+				memset(dstp, palIndex, nWidth);
+		}
+	}
+	else if ((hdcDest->brush->style == GDI_BS_PATTERN) &&
+			(hdcDest->brush->pattern->bytesPerPixel == hdcDest->bytesPerPixel))
+	{
+		hBmpBrush = hdcDest->brush->pattern;
+
+		for (y = 0; y < nHeight; y++)
+		{
+			dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
+
 			if (dstp != 0)
 			{
-				for (x = 0; x < nWidth; x++)
-				{
-					*dstp = palIndex;
-					dstp++;
-				}
+				rop->fill_pattern(dstp, nWidth,
+					&hBmpBrush->data[(y % hBmpBrush->height) * hBmpBrush->scanline],
+					hBmpBrush->width);
 			}
 		}
 	}
@@ -82,6 +82,7 @@ HGDI_DC gdi_CreateDC(HCLRCONV clrconv, int bpp)
 	hDC->hwnd->count = 32;
 	hDC->hwnd->cinvalid = (HGDI_RGN) malloc(sizeof(GDI_RGN) * hDC->hwnd->count);
 	hDC->hwnd->ninvalid = 0;
+	hDC->hwnd->invalidRgn = gdi_RegionNew();
 
 	return hDC;
 }
@@ -227,6 +228,8 @@ int gdi_DeleteDC(HGDI_DC hdc)
 		if (hdc->hwnd->invalid != NULL)
 			free(hdc->hwnd->invalid);
 
+		gdi_RegionFree(hdc->hwnd->invalidRgn);
+
 		free(hdc->hwnd);
 	}
 
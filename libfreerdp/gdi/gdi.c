@@ -50,6 +50,7 @@
 #include <freerdp/gdi/gdi.h>
 
 #include "gdi.h"
+#include "rop.h"
 
 /* Ternary Raster Operation Table */
 static const UINT32 rop3_code_table[] =
@@ -687,11 +688,28 @@ void gdi_ellipse_cb(rdpContext* context, ELLIPSE_CB_ORDER* ellipse_cb)
 
 int tilenum = 0;
 
+/**
+ * Pixel format RemoteFX tiles are decoded to for a primary surface of the
+ * given depth, with red and blue swapped when the color converter inverts.
+ * @return the pixel format, or -1 if tiles can't be decoded in place
+ */
+
+static int gdi_get_rfx_pixel_format(int bpp, BOOL invert)
+{
+	if (bpp == 32)
+		return (invert) ? RDP_PIXEL_FORMAT_R8G8B8A8 : RDP_PIXEL_FORMAT_B8G8R8A8;
+
+	if (bpp == 24)
+		return (invert) ? RDP_PIXEL_FORMAT_R8G8B8 : RDP_PIXEL_FORMAT_B8G8R8;
+
+	return -1;
+}
+
 void gdi_surface_bits(rdpContext* context, SURFACE_BITS_COMMAND* surface_bits_command)
 {
+	int pixel_format;
 	int i, j;
 	int tx, ty;
-	char* tile_bitmap;
 	RFX_MESSAGE* message;
 	rdpGdi* gdi = context->gdi;
 	RFX_CONTEXT* rfx_context = (RFX_CONTEXT*) gdi->rfx_context;
@@ -705,10 +723,44 @@ void gdi_surface_bits(rdpContext* context, SURFACE_BITS_COMMAND* surface_bits_co
 		surface_bits_command->width, surface_bits_command->height,
 		surface_bits_command->bitmapDataLength);
 
-	tile_bitmap = (char*) malloc(32);
-	ZeroMemory(tile_bitmap, 32);
+	pixel_format = gdi_get_rfx_pixel_format(gdi->dstBpp, gdi->clrconv->invert);
+
+	if ((surface_bits_command->codecID == CODEC_ID_REMOTEFX) && (pixel_format >= 0))
+	{
+		int width, height;
+		RFX_SURFACE surface;
+
+		/* decode straight into the primary surface, clipped to the message region */
+		ZeroMemory(&surface, sizeof(RFX_SURFACE));
+		surface.data = gdi->primary->bitmap->data;
+		surface.stride = gdi->primary->bitmap->scanline;
+		surface.width = gdi->primary->bitmap->width;
+		surface.height = gdi->primary->bitmap->height;
+		surface.pixel_format = (RDP_PIXEL_FORMAT) pixel_format;
+		surface.left = surface_bits_command->destLeft;
+		surface.top = surface_bits_command->destTop;
+
+		message = rfx_process_message_surface(rfx_context,
+				surface_bits_command->bitmapData, surface_bits_command->bitmapDataLength, &surface);
+
+		DEBUG_GDI("num_rects %d num_tiles %d", message->num_rects, message->num_tiles);
+
+		gdi_SetNullClipRgn(gdi->primary->hdc);
+
+		for (i = 0; i < message->num_rects; i++)
+		{
+			tx = surface_bits_command->destLeft + message->rects[i].x;
+			ty = surface_bits_command->destTop + message->rects[i].y;
+			width = message->rects[i].width;
+			height = message->rects[i].height;
+
+			if (gdi_ClipCoords(gdi->primary->hdc, &tx, &ty, &width, &height, NULL, NULL))
+				gdi_InvalidateRegion(gdi->primary->hdc, tx, ty, width, height);
+		}
 
-	if (surface_bits_command->codecID == CODEC_ID_REMOTEFX)
+		rfx_message_free(rfx_context, message);
+	}
+	else if (surface_bits_command->codecID == CODEC_ID_REMOTEFX)
 	{
 		message = rfx_process_message(rfx_context,
 				surface_bits_command->bitmapData, surface_bits_command->bitmapDataLength);
@@ -724,8 +776,11 @@ void gdi_surface_bits(rdpContext* context, SURFACE_BITS_COMMAND* surface_bits_co
 			freerdp_image_convert(message->tiles[i]->data, gdi->tile->bitmap->data, 64, 64, 32, 32, gdi->clrconv);
 
 #ifdef DUMP_REMOTEFX_TILES
-			sprintf(tile_bitmap, "/tmp/rfx/tile_%d.bmp", tilenum++);
-			freerdp_bitmap_write(tile_bitmap, gdi->tile->bitmap->data, 64, 64, 32);
+			{
+				char tile_bitmap[32];
+				sprintf(tile_bitmap, "/tmp/rfx/tile_%d.bmp", tilenum++);
+				freerdp_bitmap_write(tile_bitmap, gdi->tile->bitmap->data, 64, 64, 32);
+			}
 #endif
 
 			for (j = 0; j < message->num_rects; j++)
@@ -764,27 +819,9 @@ void gdi_surface_bits(rdpContext* context, SURFACE_BITS_COMMAND* surface_bits_co
 		gdi->image->bitmap->data = (BYTE*) realloc(gdi->image->bitmap->data,
 				gdi->image->bitmap->width * gdi->image->bitmap->height * 4);
 
-		if ((surface_bits_command->bpp != 32) || (gdi->clrconv->alpha == TRUE))
-		{
-			BYTE* temp_image;
-
-			freerdp_image_convert(surface_bits_command->bitmapData, gdi->image->bitmap->data,
+		freerdp_image_convert_ex(surface_bits_command->bitmapData, gdi->image->bitmap->data,
 				gdi->image->bitmap->width, gdi->image->bitmap->height,
-				gdi->image->bitmap->bitsPerPixel, 32, gdi->clrconv);
-
-			surface_bits_command->bpp = 32;
-			surface_bits_command->bitmapData = gdi->image->bitmap->data;
-
-			temp_image = (BYTE*) malloc(gdi->image->bitmap->width * gdi->image->bitmap->height * 4);
-			freerdp_image_flip(gdi->image->bitmap->data, temp_image, gdi->image->bitmap->width, gdi->image->bitmap->height, 32);
-			free(gdi->image->bitmap->data);
-			gdi->image->bitmap->data = temp_image;
-		}
-		else
-		{
-			freerdp_image_flip(surface_bits_command->bitmapData, gdi->image->bitmap->data,
-					gdi->image->bitmap->width, gdi->image->bitmap->height, 32);
-		}
+				gdi->image->bitmap->bitsPerPixel, 32, gdi->clrconv, FREERDP_IMAGE_FLIP);
 
 		gdi_BitBlt(gdi->primary->hdc, surface_bits_command->destLeft, surface_bits_command->destTop,
 				surface_bits_command->width, surface_bits_command->height, gdi->image->hdc, 0, 0, GDI_SRCCOPY);
@@ -793,9 +830,6 @@ void gdi_surface_bits(rdpContext* context, SURFACE_BITS_COMMAND* surface_bits_co
 	{
 		printf("Unsupported codecID %d\n", surface_bits_command->codecID);
 	}
-
-	if (tile_bitmap != NULL)
-		free(tile_bitmap);
 }
 
 /**
@@ -852,6 +886,7 @@ void gdi_init_primary(rdpGdi* gdi)
 	gdi->primary->hdc->hwnd->count = 32;
 	gdi->primary->hdc->hwnd->cinvalid = (HGDI_RGN) malloc(sizeof(GDI_RGN) * gdi->primary->hdc->hwnd->count);
 	gdi->primary->hdc->hwnd->ninvalid = 0;
+	gdi->primary->hdc->hwnd->invalidRgn = gdi_RegionNew();
 }
 
 void gdi_resize(rdpGdi* gdi, int width, int height)
@@ -893,6 +928,9 @@ int gdi_init(freerdp* instance, UINT32 flags, BYTE* buffer)
 	gdi->srcBpp = instance->settings->ColorDepth;
 	gdi->primary_buffer = buffer;
 
+	/* select the raster operation kernels before anything gets drawn */
+	gdi_rop_kernels_get();
+
 	/* default internal buffer format */
 	gdi->dstBpp = 32;
 	gdi->bytesPerPixel = 4;
@@ -24,6 +24,9 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <limits.h>
+
+#include <winpr/crt.h>
 
 #include <freerdp/api.h>
 #include <freerdp/freerdp.h>
@@ -31,6 +34,9 @@
 
 #include <freerdp/gdi/region.h>
 
+/* beyond this, the invalid region is simplified at the cost of repainting more */
+#define GDI_INVALID_MAX_RECTS		64
+
 /**
  * Create a region from rectangular coordinates.\n
  * @msdn{dd183514}
@@ -353,8 +359,445 @@ INLINE int gdi_PtInRect(HGDI_RECT rc, int x, int y)
 	return 0;
 }
 
+/**
+ * Create an empty complex region.
+ * @return new region
+ */
+
+HGDI_REGION gdi_RegionNew(void)
+{
+	HGDI_REGION region = (HGDI_REGION) malloc(sizeof(GDI_REGION));
+	ZeroMemory(region, sizeof(GDI_REGION));
+
+	region->maxRects = 16;
+	region->rects = (GDI_RGN*) malloc(sizeof(GDI_RGN) * region->maxRects);
+	region->extents.objectType = GDIOBJECT_REGION;
+	region->extents.null = 1;
+
+	return region;
+}
+
+/**
+ * Free a complex region.
+ * @param region region
+ */
+
+void gdi_RegionFree(HGDI_REGION region)
+{
+	if (region == NULL)
+		return;
+
+	free(region->rects);
+	free(region);
+}
+
+/**
+ * Remove all rectangles from a complex region.
+ * @param region region
+ */
+
+void gdi_RegionClear(HGDI_REGION region)
+{
+	region->numRects = 0;
+	gdi_SetRgn(&region->extents, 0, 0, 0, 0);
+	region->extents.null = 1;
+}
+
+/**
+ * Check if a complex region is empty.
+ * @param region region
+ * @return 1 if empty, 0 otherwise
+ */
+
+int gdi_RegionIsEmpty(HGDI_REGION region)
+{
+	return (region->numRects < 1) ? 1 : 0;
+}
+
+/**
+ * Get the rectangles of a complex region, in y-x banded order.
+ * @param region region
+ * @param count number of rectangles
+ * @return rectangle array, owned by the region
+ */
+
+GDI_RGN* gdi_RegionGetRects(HGDI_REGION region, int* count)
+{
+	*count = region->numRects;
+	return region->rects;
+}
+
+static void gdi_region_reserve(HGDI_REGION region, int count)
+{
+	if (count <= region->maxRects)
+		return;
+
+	while (region->maxRects < count)
+		region->maxRects *= 2;
+
+	region->rects = (GDI_RGN*) realloc(region->rects, sizeof(GDI_RGN) * region->maxRects);
+}
+
+static void gdi_region_update_extents(HGDI_REGION region)
+{
+	int i;
+	int left, right;
+	GDI_RGN* first;
+	GDI_RGN* last;
+
+	if (region->numRects < 1)
+	{
+		gdi_SetRgn(&region->extents, 0, 0, 0, 0);
+		region->extents.null = 1;
+		return;
+	}
+
+	first = &region->rects[0];
+	last = &region->rects[region->numRects - 1];
+	left = first->x;
+	right = first->x + first->w;
+
+	for (i = 1; i < region->numRects; i++)
+	{
+		if (region->rects[i].x < left)
+			left = region->rects[i].x;
+
+		if (region->rects[i].x + region->rects[i].w > right)
+			right = region->rects[i].x + region->rects[i].w;
+	}
+
+	gdi_SetRgn(&region->extents, left, first->y, right - left, last->y + last->h - first->y);
+}
+
+/**
+ * Number of rectangles in the band starting at the given index.
+ */
+
+static int gdi_region_band_size(GDI_RGN* rects, int count, int index)
+{
+	int size = 1;
+
+	while ((index + size < count) && (rects[index + size].y == rects[index].y))
+		size++;
+
+	return size;
+}
+
+/**
+ * Append a band to a region being built, merging it into the previous band
+ * when both touch vertically and have the same horizontal spans.
+ * @return index of the band that received the rectangles
+ */
+
+static int gdi_region_append_band(HGDI_REGION region, int prevBand, int* spans, int nspans, int top, int bottom)
+{
+	int i;
+	int prevSize;
+	int bandStart;
+	GDI_RGN* rect;
+
+	if (nspans < 1)
+		return prevBand;
+
+	if (prevBand >= 0)
+	{
+		prevSize = region->numRects - prevBand;
+		rect = &region->rects[prevBand];
+
+		if ((prevSize == nspans) && (rect->y + rect->h == top))
+		{
+			for (i = 0; i < nspans; i++)
+			{
+				if ((rect[i].x != spans[2 * i]) || (rect[i].x + rect[i].w != spans[2 * i + 1]))
+					break;
+			}
+
+			if (i == nspans)
+			{
+				for (i = 0; i < nspans; i++)
+					rect[i].h = bottom - rect[i].y;
+
+				return prevBand;
+			}
+		}
+	}
+
+	gdi_region_reserve(region, region->numRects + nspans);
+	bandStart = region->numRects;
+
+	for (i = 0; i < nspans; i++)
+	{
+		rect = &region->rects[region->numRects++];
+		rect->objectType = GDIOBJECT_REGION;
+		gdi_SetRgn(rect, spans[2 * i], top, spans[2 * i + 1] - spans[2 * i], bottom - top);
+	}
+
+	return bandStart;
+}
+
+static BOOL gdi_region_op(int mode, BOOL inA, BOOL inB)
+{
+	switch (mode)
+	{
+		case GDI_RGN_AND:
+			return inA && inB;
+
+		case GDI_RGN_OR:
+			return inA || inB;
+
+		case GDI_RGN_DIFF:
+			return inA && !inB;
+	}
+
+	return FALSE;
+}
+
+/**
+ * Combine the horizontal spans of one band of each source into spans,
+ * stored as left/right pairs. Touching output spans are merged.
+ * @return number of spans
+ */
+
+static int gdi_region_combine_spans(GDI_RGN* a, int na, GDI_RGN* b, int nb, int mode, int* spans)
+{
+	int x, next;
+	int i = 0, j = 0;
+	int nspans = 0;
+	BOOL inA, inB;
+
+	x = (na > 0) ? a[0].x : b[0].x;
+
+	if ((nb > 0) && (b[0].x < x))
+		x = b[0].x;
+
+	while ((i < na) || (j < nb))
+	{
+		inA = (i < na) && (a[i].x <= x);
+		inB = (j < nb) && (b[j].x <= x);
+
+		next = INT_MAX;
+
+		if (i < na)
+			next = inA ? (a[i].x + a[i].w) : a[i].x;
+
+		if (j < nb)
+			next = MIN(next, inB ? (b[j].x + b[j].w) : b[j].x);
+
+		if (gdi_region_op(mode, inA, inB))
+		{
+			if ((nspans > 0) && (spans[2 * nspans - 1] == x))
+			{
+				spans[2 * nspans - 1] = next;
+			}
+			else
+			{
+				spans[2 * nspans] = x;
+				spans[2 * nspans + 1] = next;
+				nspans++;
+			}
+		}
+
+		x = next;
+
+		if (inA && (a[i].x + a[i].w == x))
+			i++;
+
+		if (inB && (b[j].x + b[j].w == x))
+			j++;
+	}
+
+	return nspans;
+}
+
+/**
+ * Combine two complex regions. The destination may be one of the sources.\n
+ * @msdn{dd162637}
+ * @param dst destination region
+ * @param src1 first source region
+ * @param src2 second source region
+ * @param mode GDI_RGN_AND, GDI_RGN_OR or GDI_RGN_DIFF
+ * @return 1 if successful, 0 otherwise
+ */
+
+int gdi_RegionCombine(HGDI_REGION dst, HGDI_REGION src1, HGDI_REGION src2, int mode)
+{
+	int y, next;
+	int ia = 0, ib = 0;
+	int sa, sb;
+	int na, nb;
+	int nspans;
+	int prevBand = -1;
+	int* spans;
+	BOOL inA, inB;
+	GDI_REGION result;
+
+	if ((mode != GDI_RGN_AND) && (mode != GDI_RGN_OR) && (mode != GDI_RGN_DIFF))
+		return 0;
+
+	na = src1->numRects;
+	nb = src2->numRects;
+
+	ZeroMemory(&result, sizeof(GDI_REGION));
+	result.maxRects = MAX(na + nb, 16);
+	result.rects = (GDI_RGN*) malloc(sizeof(GDI_RGN) * result.maxRects);
+	spans = (int*) malloc(sizeof(int) * 2 * (na + nb + 1));
+
+	y = 0;
+
+	if (na > 0)
+		y = src1->rects[0].y;
+
+	if ((nb > 0) && ((na < 1) || (src2->rects[0].y < y)))
+		y = src2->rects[0].y;
+
+	while ((ia < na) || (ib < nb))
+	{
+		inA = (ia < na) && (src1->rects[ia].y <= y);
+		inB = (ib < nb) && (src2->rects[ib].y <= y);
+
+		if (!inA && !inB)
+		{
+			/* gap between bands in both regions */
+			y = (ia < na) ? src1->rects[ia].y : INT_MAX;
+
+			if (ib < nb)
+				y = MIN(y, src2->rects[ib].y);
+
+			continue;
+		}
+
+		next = INT_MAX;
+
+		if (ia < na)
+			next = inA ? (src1->rects[ia].y + src1->rects[ia].h) : src1->rects[ia].y;
+
+		if (ib < nb)
+			next = MIN(next, inB ? (src2->rects[ib].y + src2->rects[ib].h) : src2->rects[ib].y);
+
+		sa = inA ? gdi_region_band_size(src1->rects, na, ia) : 0;
+		sb = inB ? gdi_region_band_size(src2->rects, nb, ib) : 0;
+
+		nspans = gdi_region_combine_spans(&src1->rects[ia], sa, &src2->rects[ib], sb, mode, spans);
+		prevBand = gdi_region_append_band(&result, prevBand, spans, nspans, y, next);
+
+		y = next;
+
+		if (inA && (src1->rects[ia].y + src1->rects[ia].h == y))
+			ia += sa;
+
+		if (inB && (src2->rects[ib].y + src2->rects[ib].h == y))
+			ib += sb;
+	}
+
+	free(spans);
+	free(dst->rects);
+
+	dst->rects = result.rects;
+	dst->numRects = result.numRects;
+	dst->maxRects = result.maxRects;
+	gdi_region_update_extents(dst);
+
+	return 1;
+}
+
+/**
+ * Combine a complex region with a rectangle.
+ * @param region region, receives the result
+ * @param x left
+ * @param y top
+ * @param w width
+ * @param h height
+ * @param mode GDI_RGN_AND, GDI_RGN_OR or GDI_RGN_DIFF
+ * @return 1 if successful, 0 otherwise
+ */
+
+int gdi_RegionCombineRect(HGDI_REGION region, int x, int y, int w, int h, int mode)
+{
+	GDI_RGN rect;
+	GDI_REGION src;
+
+	if ((w <= 0) || (h <= 0))
+	{
+		if (mode == GDI_RGN_AND)
+			gdi_RegionClear(region);
+
+		return 1;
+	}
+
+	if ((mode == GDI_RGN_OR) && (region->numRects < 1))
+	{
+		/* common case: first rectangle of an invalid region */
+		region->rects[0].objectType = GDIOBJECT_REGION;
+		gdi_SetRgn(&region->rects[0], x, y, w, h);
+		region->numRects = 1;
+		gdi_SetRgn(&region->extents, x, y, w, h);
+		return 1;
+	}
+
+	rect.objectType = GDIOBJECT_REGION;
+	gdi_SetRgn(&rect, x, y, w, h);
+
+	src.numRects = 1;
+	src.maxRects = 1;
+	src.rects = &rect;
+	gdi_SetRgn(&src.extents, x, y, w, h);
+
+	return gdi_RegionCombine(region, region, &src, mode);
+}
+
+/**
+ * Reduce the number of rectangles of a complex region by growing it.
+ * Each band is first replaced by its horizontal extent, which lets
+ * bands coalesce vertically; if that still leaves more than maxRects
+ * rectangles the region is replaced by its bounding box.
+ * @param region region
+ * @param maxRects maximum number of rectangles to keep
+ * @return number of rectangles
+ */
+
+int gdi_RegionSimplify(HGDI_REGION region, int maxRects)
+{
+	int i, size;
+	int count = 0;
+	int prevBand = -1;
+	int span[2];
+	GDI_RGN* rects;
+
+	if (region->numRects <= maxRects)
+		return region->numRects;
+
+	rects = region->rects;
+	region->rects = (GDI_RGN*) malloc(sizeof(GDI_RGN) * region->maxRects);
+	count = region->numRects;
+	region->numRects = 0;
+
+	for (i = 0; i < count; i += size)
+	{
+		size = gdi_region_band_size(rects, count, i);
+		span[0] = rects[i].x;
+		span[1] = rects[i + size - 1].x + rects[i + size - 1].w;
+		prevBand = gdi_region_append_band(region, prevBand, span, 1, rects[i].y, rects[i].y + rects[i].h);
+	}
+
+	free(rects);
+
+	if (region->numRects > maxRects)
+	{
+		gdi_region_update_extents(region);
+		region->rects[0] = region->extents;
+		region->numRects = 1;
+	}
+
+	gdi_region_update_extents(region);
+
+	return region->numRects;
+}
+
 /**
  * Invalidate a given region, such that it is redrawn on the next region update.\n
+ * Besides the rectangle list and the bounding box, the exact area is tracked
+ * in the window's complex region, which restarts from scratch whenever the
+ * bounding box has been reset by the consumer.\n
  * @msdn{dd145003}
  * @param hdc device context
  * @param x x1
@@ -390,6 +833,20 @@ INLINE int gdi_InvalidateRegion(HGDI_DC hdc, int x, int y, int w, int h)
 
 	invalid = hdc->hwnd->invalid;
 
+	if (hdc->hwnd->invalidRgn != NULL)
+	{
+		if (invalid->null)
+			gdi_RegionClear(hdc->hwnd->invalidRgn);
+
+		gdi_CRgnToRect(x, y, w, h, &rgn);
+		rgn.left = MAX(rgn.left, 0);
+		rgn.top = MAX(rgn.top, 0);
+
+		gdi_RegionCombineRect(hdc->hwnd->invalidRgn, rgn.left, rgn.top,
+			rgn.right - rgn.left + 1, rgn.bottom - rgn.top + 1, GDI_RGN_OR);
+		gdi_RegionSimplify(hdc->hwnd->invalidRgn, GDI_INVALID_MAX_RECTS);
+	}
+
 	if (invalid->null)
 	{
 		invalid->x = x;
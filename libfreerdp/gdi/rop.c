@@ -0,0 +1,159 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * GDI Raster Operation Kernels
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+
+#include "rop.h"
+
+#ifdef WITH_SSE2
+#include "rop_sse2.h"
+#endif
+
+#ifdef WITH_NEON
+#include "rop_neon.h"
+#endif
+
+#ifndef ROP_INIT_SIMD
+#define ROP_INIT_SIMD(_kernels) do { } while (0)
+#endif
+
+static void rop_srccopy(BYTE* dst, const BYTE* src, int length)
+{
+	memcpy(dst, src, length);
+}
+
+static void rop_srcinvert(BYTE* dst, const BYTE* src, int length)
+{
+	while (length-- > 0)
+		*dst++ ^= *src++;
+}
+
+static void rop_srcand(BYTE* dst, const BYTE* src, int length)
+{
+	while (length-- > 0)
+		*dst++ &= *src++;
+}
+
+static void rop_fill_16(BYTE* dst, int count, UINT16 color)
+{
+	UINT16* dst16 = (UINT16*) dst;
+
+	while (count-- > 0)
+		*dst16++ = color;
+}
+
+static void rop_fill_32(BYTE* dst, int count, UINT32 color)
+{
+	UINT32* dst32 = (UINT32*) dst;
+
+	while (count-- > 0)
+		*dst32++ = color;
+}
+
+static void rop_fill_pattern(BYTE* dst, int length, const BYTE* pattern, int period)
+{
+	int size;
+
+	size = MIN(period, length);
+	memcpy(dst, pattern, size);
+
+	/* keep doubling what has been written so far */
+	while (size < length)
+	{
+		int chunk = MIN(size, length - size);
+		memcpy(&dst[size], dst, chunk);
+		size += chunk;
+	}
+}
+
+static void rop_dspdxax_16(BYTE* dst, const BYTE* mask, int count, UINT16 color)
+{
+	UINT16 src16;
+	UINT16* dst16 = (UINT16*) dst;
+
+	while (count-- > 0)
+	{
+		src16 = (*mask << 8) | *mask;
+		*dst16 = (src16 & color) | (~src16 & *dst16);
+		mask++;
+		dst16++;
+	}
+}
+
+static void rop_dspdxax_32(BYTE* dst, const BYTE* mask, int count, UINT32 color)
+{
+	UINT32 src32;
+	UINT32* dst32 = (UINT32*) dst;
+
+	while (count-- > 0)
+	{
+		src32 = *mask * 0x01010101;
+		*dst32 = (src32 & color) | (~src32 & *dst32);
+		mask++;
+		dst32++;
+	}
+}
+
+static const GDI_ROP_KERNELS rop_kernels_generic =
+{
+	"generic",
+	rop_srccopy,
+	rop_srcinvert,
+	rop_srcand,
+	rop_fill_16,
+	rop_fill_32,
+	rop_fill_pattern,
+	rop_dspdxax_16,
+	rop_dspdxax_32
+};
+
+static GDI_ROP_KERNELS rop_kernels;
+static INIT_ONCE rop_kernels_once = INIT_ONCE_STATIC_INIT;
+
+const GDI_ROP_KERNELS* gdi_rop_kernels_generic(void)
+{
+	return &rop_kernels_generic;
+}
+
+static BOOL CALLBACK rop_kernels_init(PINIT_ONCE once, PVOID param, PVOID* context)
+{
+	CopyMemory(&rop_kernels, &rop_kernels_generic, sizeof(GDI_ROP_KERNELS));
+	ROP_INIT_SIMD(&rop_kernels);
+
+	return TRUE;
+}
+
+/**
+ * Like the color conversion kernels, the table is filled once per process
+ * with the generic kernels and then patched by the SIMD module of the build.
+ * gdi_init() fetches it up front; other users get it lazily.
+ */
+const GDI_ROP_KERNELS* gdi_rop_kernels_get(void)
+{
+	InitOnceExecuteOnce(&rop_kernels_once, rop_kernels_init, NULL, NULL);
+
+	return &rop_kernels;
+}
@@ -0,0 +1,56 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * GDI Raster Operation Kernels
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __GDI_ROP_H
+#define __GDI_ROP_H
+
+#include <freerdp/api.h>
+#include <freerdp/types.h>
+
+/**
+ * Row kernels behind the hot raster operations. Bitwise operations
+ * work on bytes and are shared by all color depths, fills and glyph
+ * masking come in one flavour per pixel size.
+ */
+struct _GDI_ROP_KERNELS
+{
+	const char* name;
+
+	/* D = S */
+	void (*srccopy)(BYTE* dst, const BYTE* src, int length);
+	/* D = D ^ S */
+	void (*srcinvert)(BYTE* dst, const BYTE* src, int length);
+	/* D = D & S */
+	void (*srcand)(BYTE* dst, const BYTE* src, int length);
+
+	/* D = P, solid */
+	void (*fill_16)(BYTE* dst, int count, UINT16 color);
+	void (*fill_32)(BYTE* dst, int count, UINT32 color);
+
+	/* D = P, pattern row of period bytes repeated from its first byte */
+	void (*fill_pattern)(BYTE* dst, int length, const BYTE* pattern, int period);
+
+	/* D = (S & P) | (~S & D), S being one mask byte per pixel (glyphs) */
+	void (*dspdxax_16)(BYTE* dst, const BYTE* mask, int count, UINT16 color);
+	void (*dspdxax_32)(BYTE* dst, const BYTE* mask, int count, UINT32 color);
+};
+typedef struct _GDI_ROP_KERNELS GDI_ROP_KERNELS;
+
+FREERDP_API const GDI_ROP_KERNELS* gdi_rop_kernels_generic(void);
+FREERDP_API const GDI_ROP_KERNELS* gdi_rop_kernels_get(void);
+
+#endif /* __GDI_ROP_H */
@@ -0,0 +1,196 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * GDI Raster Operation Kernels - NEON Optimizations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#if defined(__ARM_NEON__)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arm_neon.h>
+
+#include "rop.h"
+#include "rop_neon.h"
+
+#if ANDROID
+#include "cpu-features.h"
+#endif
+
+static void rop_srcinvert_neon(BYTE* dst, const BYTE* src, int length)
+{
+	for (; length >= 16; length -= 16)
+	{
+		vst1q_u8(dst, veorq_u8(vld1q_u8(dst), vld1q_u8(src)));
+		src += 16;
+		dst += 16;
+	}
+
+	while (length-- > 0)
+		*dst++ ^= *src++;
+}
+
+static void rop_srcand_neon(BYTE* dst, const BYTE* src, int length)
+{
+	for (; length >= 16; length -= 16)
+	{
+		vst1q_u8(dst, vandq_u8(vld1q_u8(dst), vld1q_u8(src)));
+		src += 16;
+		dst += 16;
+	}
+
+	while (length-- > 0)
+		*dst++ &= *src++;
+}
+
+static void rop_store_32_neon(BYTE* dst, int length, const BYTE* pattern)
+{
+	uint8x16_t lo, hi;
+
+	lo = vld1q_u8(pattern);
+	hi = vld1q_u8(pattern + 16);
+
+	for (; length >= 32; length -= 32)
+	{
+		vst1q_u8(dst, lo);
+		vst1q_u8(dst + 16, hi);
+		dst += 32;
+	}
+
+	if (length > 0)
+		memcpy(dst, pattern, length);
+}
+
+static void rop_fill_16_neon(BYTE* dst, int count, UINT16 color)
+{
+	BYTE pattern[32];
+	vst1q_u16((UINT16*) pattern, vdupq_n_u16(color));
+	vst1q_u16((UINT16*) (pattern + 16), vdupq_n_u16(color));
+	rop_store_32_neon(dst, count * 2, pattern);
+}
+
+static void rop_fill_32_neon(BYTE* dst, int count, UINT32 color)
+{
+	BYTE pattern[32];
+	vst1q_u32((UINT32*) pattern, vdupq_n_u32(color));
+	vst1q_u32((UINT32*) (pattern + 16), vdupq_n_u32(color));
+	rop_store_32_neon(dst, count * 4, pattern);
+}
+
+static void rop_fill_pattern_neon(BYTE* dst, int length, const BYTE* pattern, int period)
+{
+	int i;
+	BYTE expanded[32];
+
+	if ((period < 1) || (period > 32) || (32 % period) != 0)
+	{
+		gdi_rop_kernels_generic()->fill_pattern(dst, length, pattern, period);
+		return;
+	}
+
+	for (i = 0; i < 32; i += period)
+		memcpy(&expanded[i], pattern, period);
+
+	rop_store_32_neon(dst, length, expanded);
+}
+
+static void rop_dspdxax_16_neon(BYTE* dst, const BYTE* mask, int count, UINT16 color)
+{
+	uint8x8_t m;
+	uint16x8_t s;
+	uint16x8_t c = vdupq_n_u16(color);
+
+	for (; count >= 8; count -= 8)
+	{
+		m = vld1_u8(mask);
+		s = vreinterpretq_u16_u8(vcombine_u8(vzip_u8(m, m).val[0], vzip_u8(m, m).val[1]));
+		vst1q_u16((UINT16*) dst, vbslq_u16(s, c, vld1q_u16((UINT16*) dst)));
+		mask += 8;
+		dst += 16;
+	}
+
+	if (count > 0)
+		gdi_rop_kernels_generic()->dspdxax_16(dst, mask, count, color);
+}
+
+static void rop_dspdxax_32_neon(BYTE* dst, const BYTE* mask, int count, UINT32 color)
+{
+	uint8x8_t m;
+	uint8x8x2_t w;
+	uint16x4x2_t s;
+	uint32x4_t c = vdupq_n_u32(color);
+
+	for (; count >= 8; count -= 8)
+	{
+		/* each mask byte becomes a word, then a dword */
+		m = vld1_u8(mask);
+		w = vzip_u8(m, m);
+
+		s = vzip_u16(vreinterpret_u16_u8(w.val[0]), vreinterpret_u16_u8(w.val[0]));
+		vst1q_u32((UINT32*) dst, vbslq_u32(vreinterpretq_u32_u16(vcombine_u16(s.val[0], s.val[1])),
+			c, vld1q_u32((UINT32*) dst)));
+
+		s = vzip_u16(vreinterpret_u16_u8(w.val[1]), vreinterpret_u16_u8(w.val[1]));
+		vst1q_u32((UINT32*) (dst + 16), vbslq_u32(vreinterpretq_u32_u16(vcombine_u16(s.val[0], s.val[1])),
+			c, vld1q_u32((UINT32*) (dst + 16))));
+
+		mask += 8;
+		dst += 32;
+	}
+
+	if (count > 0)
+		gdi_rop_kernels_generic()->dspdxax_32(dst, mask, count, color);
+}
+
+static BOOL rop_neon_supported(void)
+{
+#if ANDROID
+	UINT64 features;
+
+	if (android_getCpuFamily() != ANDROID_CPU_FAMILY_ARM)
+		return FALSE;
+
+	features = android_getCpuFeatures();
+
+	if (!(features & ANDROID_CPU_ARM_FEATURE_ARMv7))
+		return FALSE;
+
+	return (features & ANDROID_CPU_ARM_FEATURE_NEON) ? TRUE : FALSE;
+#else
+	return TRUE;
+#endif
+}
+
+void rop_init_neon(GDI_ROP_KERNELS* kernels)
+{
+	if (!rop_neon_supported())
+		return;
+
+	kernels->name = "neon";
+
+	kernels->srcinvert = rop_srcinvert_neon;
+	kernels->srcand = rop_srcand_neon;
+	kernels->fill_16 = rop_fill_16_neon;
+	kernels->fill_32 = rop_fill_32_neon;
+	kernels->fill_pattern = rop_fill_pattern_neon;
+	kernels->dspdxax_16 = rop_dspdxax_16_neon;
+	kernels->dspdxax_32 = rop_dspdxax_32_neon;
+}
+
+#endif /* __ARM_NEON__ */
@@ -0,0 +1,208 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * GDI Raster Operation Kernels - SSE2 Optimizations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <xmmintrin.h>
+#include <emmintrin.h>
+
+#include "rop.h"
+#include "rop_sse2.h"
+
+static void rop_srcinvert_sse2(BYTE* dst, const BYTE* src, int length)
+{
+	__m128i a, b;
+
+	for (; length >= 32; length -= 32)
+	{
+		a = _mm_xor_si128(_mm_loadu_si128((__m128i*) dst), _mm_loadu_si128((__m128i*) src));
+		b = _mm_xor_si128(_mm_loadu_si128((__m128i*) (dst + 16)), _mm_loadu_si128((__m128i*) (src + 16)));
+		_mm_storeu_si128((__m128i*) dst, a);
+		_mm_storeu_si128((__m128i*) (dst + 16), b);
+		src += 32;
+		dst += 32;
+	}
+
+	for (; length >= 16; length -= 16)
+	{
+		_mm_storeu_si128((__m128i*) dst, _mm_xor_si128(_mm_loadu_si128((__m128i*) dst), _mm_loadu_si128((__m128i*) src)));
+		src += 16;
+		dst += 16;
+	}
+
+	while (length-- > 0)
+		*dst++ ^= *src++;
+}
+
+static void rop_srcand_sse2(BYTE* dst, const BYTE* src, int length)
+{
+	__m128i a, b;
+
+	for (; length >= 32; length -= 32)
+	{
+		a = _mm_and_si128(_mm_loadu_si128((__m128i*) dst), _mm_loadu_si128((__m128i*) src));
+		b = _mm_and_si128(_mm_loadu_si128((__m128i*) (dst + 16)), _mm_loadu_si128((__m128i*) (src + 16)));
+		_mm_storeu_si128((__m128i*) dst, a);
+		_mm_storeu_si128((__m128i*) (dst + 16), b);
+		src += 32;
+		dst += 32;
+	}
+
+	for (; length >= 16; length -= 16)
+	{
+		_mm_storeu_si128((__m128i*) dst, _mm_and_si128(_mm_loadu_si128((__m128i*) dst), _mm_loadu_si128((__m128i*) src)));
+		src += 16;
+		dst += 16;
+	}
+
+	while (length-- > 0)
+		*dst++ &= *src++;
+}
+
+/**
+ * Stores a 32-byte pattern over a row. Whatever does not fill a whole
+ * pattern is taken from its start, so the phase stays the same.
+ */
+static void rop_store_32_sse2(BYTE* dst, int length, const BYTE* pattern)
+{
+	__m128i lo, hi;
+
+	lo = _mm_loadu_si128((__m128i*) pattern);
+	hi = _mm_loadu_si128((__m128i*) (pattern + 16));
+
+	for (; length >= 32; length -= 32)
+	{
+		_mm_storeu_si128((__m128i*) dst, lo);
+		_mm_storeu_si128((__m128i*) (dst + 16), hi);
+		dst += 32;
+	}
+
+	if (length > 0)
+		memcpy(dst, pattern, length);
+}
+
+static void rop_fill_16_sse2(BYTE* dst, int count, UINT16 color)
+{
+	BYTE pattern[32];
+	_mm_storeu_si128((__m128i*) pattern, _mm_set1_epi16((short) color));
+	_mm_storeu_si128((__m128i*) (pattern + 16), _mm_set1_epi16((short) color));
+	rop_store_32_sse2(dst, count * 2, pattern);
+}
+
+static void rop_fill_32_sse2(BYTE* dst, int count, UINT32 color)
+{
+	BYTE pattern[32];
+	_mm_storeu_si128((__m128i*) pattern, _mm_set1_epi32((int) color));
+	_mm_storeu_si128((__m128i*) (pattern + 16), _mm_set1_epi32((int) color));
+	rop_store_32_sse2(dst, count * 4, pattern);
+}
+
+static void rop_fill_pattern_sse2(BYTE* dst, int length, const BYTE* pattern, int period)
+{
+	int i;
+	BYTE expanded[32];
+
+	if ((period < 1) || (period > 32) || (32 % period) != 0)
+	{
+		/* 24bpp and odd sized brushes */
+		gdi_rop_kernels_generic()->fill_pattern(dst, length, pattern, period);
+		return;
+	}
+
+	for (i = 0; i < 32; i += period)
+		memcpy(&expanded[i], pattern, period);
+
+	rop_store_32_sse2(dst, length, expanded);
+}
+
+static void rop_dspdxax_16_sse2(BYTE* dst, const BYTE* mask, int count, UINT16 color)
+{
+	__m128i m, s, d;
+	__m128i c = _mm_set1_epi16((short) color);
+
+	for (; count >= 16; count -= 16)
+	{
+		m = _mm_loadu_si128((__m128i*) mask);
+
+		s = _mm_unpacklo_epi8(m, m);
+		d = _mm_loadu_si128((__m128i*) dst);
+		_mm_storeu_si128((__m128i*) dst, _mm_or_si128(_mm_and_si128(s, c), _mm_andnot_si128(s, d)));
+
+		s = _mm_unpackhi_epi8(m, m);
+		d = _mm_loadu_si128((__m128i*) (dst + 16));
+		_mm_storeu_si128((__m128i*) (dst + 16), _mm_or_si128(_mm_and_si128(s, c), _mm_andnot_si128(s, d)));
+
+		mask += 16;
+		dst += 32;
+	}
+
+	if (count > 0)
+		gdi_rop_kernels_generic()->dspdxax_16(dst, mask, count, color);
+}
+
+static void rop_dspdxax_32_sse2(BYTE* dst, const BYTE* mask, int count, UINT32 color)
+{
+	int i;
+	__m128i m, w, s, d;
+	__m128i c = _mm_set1_epi32((int) color);
+
+	for (; count >= 16; count -= 16)
+	{
+		m = _mm_loadu_si128((__m128i*) mask);
+
+		for (i = 0; i < 2; i++)
+		{
+			/* each mask byte becomes a word, then a dword */
+			w = (i == 0) ? _mm_unpacklo_epi8(m, m) : _mm_unpackhi_epi8(m, m);
+
+			s = _mm_unpacklo_epi16(w, w);
+			d = _mm_loadu_si128((__m128i*) dst);
+			_mm_storeu_si128((__m128i*) dst, _mm_or_si128(_mm_and_si128(s, c), _mm_andnot_si128(s, d)));
+
+			s = _mm_unpackhi_epi16(w, w);
+			d = _mm_loadu_si128((__m128i*) (dst + 16));
+			_mm_storeu_si128((__m128i*) (dst + 16), _mm_or_si128(_mm_and_si128(s, c), _mm_andnot_si128(s, d)));
+
+			dst += 32;
+		}
+
+		mask += 16;
+	}
+
+	if (count > 0)
+		gdi_rop_kernels_generic()->dspdxax_32(dst, mask, count, color);
+}
+
+void rop_init_sse2(GDI_ROP_KERNELS* kernels)
+{
+	kernels->name = "sse2";
+
+	/* srccopy stays with memcpy, which the C library already vectorizes */
+	kernels->srcinvert = rop_srcinvert_sse2;
+	kernels->srcand = rop_srcand_sse2;
+	kernels->fill_16 = rop_fill_16_sse2;
+	kernels->fill_32 = rop_fill_32_sse2;
+	kernels->fill_pattern = rop_fill_pattern_sse2;
+	kernels->dspdxax_16 = rop_dspdxax_16_sse2;
+	kernels->dspdxax_32 = rop_dspdxax_32_sse2;
+}
@@ -0,0 +1,29 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * GDI Raster Operation Kernels - SSE2 Optimizations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __GDI_ROP_SSE2_H
+#define __GDI_ROP_SSE2_H
+
+#include "rop.h"
+
+void rop_init_sse2(GDI_ROP_KERNELS* kernels);
+
+#ifndef ROP_INIT_SIMD
+#define ROP_INIT_SIMD(_kernels) rop_init_sse2(_kernels)
+#endif
+
+#endif /* __GDI_ROP_SSE2_H */
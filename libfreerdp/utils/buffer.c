@@ -0,0 +1,234 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Reference Counted Buffers
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/interlocked.h>
+
+#include <freerdp/utils/buffer.h>
+
+/**
+ * Allocate a buffer of size bytes, in the same block as its header.
+ */
+
+SHARED_BUFFER* shared_buffer_new(int size)
+{
+	SHARED_BUFFER* buffer;
+
+	buffer = (SHARED_BUFFER*) malloc(sizeof(SHARED_BUFFER) + size);
+
+	if (buffer != NULL)
+	{
+		ZeroMemory(buffer, sizeof(SHARED_BUFFER));
+
+		buffer->refcount = 1;
+		buffer->data = (BYTE*) &buffer[1];
+		buffer->size = size;
+	}
+
+	return buffer;
+}
+
+/**
+ * Share an existing buffer. Without a Free callback the buffer has to come
+ * from malloc and is freed with the last reference.
+ */
+
+SHARED_BUFFER* shared_buffer_attach(BYTE* data, int size, pSharedBufferFree Free, void* context)
+{
+	SHARED_BUFFER* buffer;
+
+	buffer = (SHARED_BUFFER*) malloc(sizeof(SHARED_BUFFER));
+
+	if (buffer != NULL)
+	{
+		ZeroMemory(buffer, sizeof(SHARED_BUFFER));
+
+		buffer->refcount = 1;
+		buffer->data = data;
+		buffer->size = size;
+		buffer->context = context;
+		buffer->Free = Free;
+	}
+
+	return buffer;
+}
+
+/**
+ * Take over the buffer of a stream. The stream is left without a buffer
+ * and gets a new one on its next stream_check_size().
+ */
+
+SHARED_BUFFER* shared_buffer_detach_stream(STREAM* s)
+{
+	SHARED_BUFFER* buffer;
+
+	buffer = shared_buffer_attach(stream_get_head(s), stream_get_size(s), NULL, NULL);
+	stream_detach(s);
+
+	return buffer;
+}
+
+SHARED_BUFFER* shared_buffer_ref(SHARED_BUFFER* buffer)
+{
+	InterlockedIncrement(&buffer->refcount);
+
+	return buffer;
+}
+
+void shared_buffer_unref(SHARED_BUFFER* buffer)
+{
+	if (buffer == NULL)
+		return;
+
+	if (InterlockedDecrement(&buffer->refcount) > 0)
+		return;
+
+	if (buffer->Free)
+		buffer->Free(buffer);
+	else if (buffer->data != (BYTE*) &buffer[1])
+		free(buffer->data);
+
+	free(buffer);
+}
+
+SHARED_BUFFER_POOL* shared_buffer_pool_new(int max_free)
+{
+	SHARED_BUFFER_POOL* pool;
+
+	pool = (SHARED_BUFFER_POOL*) malloc(sizeof(SHARED_BUFFER_POOL));
+
+	if (pool != NULL)
+	{
+		ZeroMemory(pool, sizeof(SHARED_BUFFER_POOL));
+
+		pool->refcount = 1;
+		pool->mutex = CreateMutex(NULL, FALSE, NULL);
+		pool->max_free = max_free;
+		pool->free_list = (BYTE**) malloc(sizeof(BYTE*) * (max_free > 0 ? max_free : 1));
+	}
+
+	return pool;
+}
+
+static void shared_buffer_pool_drop_free(SHARED_BUFFER_POOL* pool)
+{
+	while (pool->free_count > 0)
+		free(pool->free_list[--pool->free_count]);
+}
+
+static void shared_buffer_pool_unref(SHARED_BUFFER_POOL* pool)
+{
+	if (InterlockedDecrement(&pool->refcount) > 0)
+		return;
+
+	shared_buffer_pool_drop_free(pool);
+
+	CloseHandle(pool->mutex);
+	free(pool->free_list);
+	free(pool);
+}
+
+/**
+ * Close the pool. Buffers still in use are freed when released.
+ */
+
+void shared_buffer_pool_free(SHARED_BUFFER_POOL* pool)
+{
+	if (pool == NULL)
+		return;
+
+	WaitForSingleObject(pool->mutex, INFINITE);
+	pool->closed = TRUE;
+	shared_buffer_pool_drop_free(pool);
+	ReleaseMutex(pool->mutex);
+
+	shared_buffer_pool_unref(pool);
+}
+
+static void shared_buffer_pool_release(SHARED_BUFFER* buffer)
+{
+	SHARED_BUFFER_POOL* pool = (SHARED_BUFFER_POOL*) buffer->context;
+
+	WaitForSingleObject(pool->mutex, INFINITE);
+
+	if (!pool->closed && (buffer->size == pool->size) && (pool->free_count < pool->max_free))
+		pool->free_list[pool->free_count++] = buffer->data;
+	else
+		free(buffer->data);
+
+	ReleaseMutex(pool->mutex);
+
+	shared_buffer_pool_unref(pool);
+}
+
+/**
+ * Take a buffer of size bytes from the pool. Its contents are undefined,
+ * the caller is expected to overwrite all of it.
+ */
+
+SHARED_BUFFER* shared_buffer_pool_get(SHARED_BUFFER_POOL* pool, int size)
+{
+	BYTE* data = NULL;
+	SHARED_BUFFER* buffer;
+
+	WaitForSingleObject(pool->mutex, INFINITE);
+
+	if (size != pool->size)
+	{
+		shared_buffer_pool_drop_free(pool);
+		pool->size = size;
+	}
+
+	if (pool->free_count > 0)
+	{
+		data = pool->free_list[--pool->free_count];
+		pool->hits++;
+	}
+	else
+	{
+		pool->misses++;
+	}
+
+	ReleaseMutex(pool->mutex);
+
+	if (data == NULL)
+	{
+		data = (BYTE*) malloc(size);
+
+		if (data == NULL)
+			return NULL;
+	}
+
+	buffer = shared_buffer_attach(data, size, shared_buffer_pool_release, pool);
+
+	if (buffer == NULL)
+	{
+		free(data);
+		return NULL;
+	}
+
+	InterlockedIncrement(&pool->refcount);
+
+	return buffer;
+}
@@ -26,10 +26,20 @@
 #include <string.h>
 
 #include <winpr/crt.h>
+#include <winpr/synch.h>
 
 #include <freerdp/types.h>
 #include <freerdp/utils/dsp.h>
 
+#include "resample.h"
+
+/**
+ * 16-bit samples go through the streaming resampler, which keeps its
+ * input history from one call to the next, so consecutive packets of a
+ * stream resample as one. The number of frames returned for packets of
+ * the same size can therefore differ by one.
+ */
+
 static void freerdp_dsp_resample(FREERDP_DSP_CONTEXT* context,
 	const BYTE* src, int bytes_per_sample,
 	UINT32 schan, UINT32 srate, int sframes,
@@ -43,6 +53,12 @@ static void freerdp_dsp_resample(FREERDP_DSP_CONTEXT* context,
 	int n1, n2;
 	int sbytes, rbytes;
 
+	if (bytes_per_sample == 2)
+	{
+		freerdp_dsp_resample_s16(context, (const INT16*) src, schan, srate, sframes, rchan, rrate);
+		return;
+	}
+
 	sbytes = bytes_per_sample * schan;
 	rbytes = bytes_per_sample * rchan;
 	rframes = sframes * rrate / srate;
@@ -101,259 +117,354 @@ static const INT16 ima_step_size_table[] =
 	15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767 
 };
 
-static UINT16 dsp_decode_ima_adpcm_sample(ADPCM* adpcm,
-	int channel, BYTE sample)
+#define IMA_MAX_STEP	88
+
+/**
+ * Per step index and 3-bit magnitude code: the magnitude of the
+ * difference the code stands for, the smallest difference the encoder
+ * maps to the code, and the step index that follows it. The sign bit
+ * changes none of them.
+ */
+static INT32 ima_diff_table[(IMA_MAX_STEP + 1) * 8];
+static INT32 ima_threshold_table[(IMA_MAX_STEP + 1) * 8];
+static BYTE ima_next_step_table[(IMA_MAX_STEP + 1) * 8];
+static INIT_ONCE ima_tables_once = INIT_ONCE_STATIC_INIT;
+
+static BOOL CALLBACK dsp_init_ima_tables(PINIT_ONCE once, PVOID param, PVOID* context)
 {
+	int step;
+	int code;
+	int next;
 	INT32 ss;
+	INT32 diff;
+
+	for (step = 0; step <= IMA_MAX_STEP; step++)
+	{
+		ss = ima_step_size_table[step];
+
+		for (code = 0; code < 8; code++)
+		{
+			diff = ss >> 3;
+			if (code & 1)
+				diff += ss >> 2;
+			if (code & 2)
+				diff += ss >> 1;
+			if (code & 4)
+				diff += ss;
+
+			next = step + ima_step_index_table[code];
+			if (next < 0)
+				next = 0;
+			else if (next > IMA_MAX_STEP)
+				next = IMA_MAX_STEP;
+
+			ima_diff_table[step * 8 + code] = diff;
+			ima_threshold_table[step * 8 + code] = diff - (ss >> 3);
+			ima_next_step_table[step * 8 + code] = (BYTE) next;
+		}
+	}
+
+	return TRUE;
+}
+
+static INLINE INT16 dsp_decode_ima_adpcm_sample(INT32* predictor, INT32* step, BYTE code)
+{
 	INT32 d;
+	INT32 sign;
 
-	ss = ima_step_size_table[adpcm->ima.last_step[channel]];
-	d = (ss >> 3);
-	if (sample & 1)
-		d += (ss >> 2);
-	if (sample & 2)
-		d += (ss >> 1);
-	if (sample & 4)
-		d += ss;
-	if (sample & 8)
-		d = -d;
-	d += adpcm->ima.last_sample[channel];
+	sign = -((code >> 3) & 1);
+	d = ima_diff_table[(*step << 3) + (code & 7)];
+	d = *predictor + ((d ^ sign) - sign);
 
 	if (d < -32768)
 		d = -32768;
 	else if (d > 32767)
 		d = 32767;
 
-	adpcm->ima.last_sample[channel] = (INT16) d;
+	*predictor = d;
+	*step = ima_next_step_table[(*step << 3) + (code & 7)];
+
+	return (INT16) d;
+}
+
+/**
+ * The code is the number of thresholds of the step the difference to the
+ * predictor reaches, the same code the successive approximation of the
+ * specification finds, but without a chain of dependent compares. The
+ * predictor then follows the difference the decoder will reconstruct.
+ */
+static INLINE BYTE dsp_encode_ima_adpcm_sample(INT32* predictor, INT32* step, INT32 sample)
+{
+	INT32 e;
+	INT32 d;
+	INT32 sign;
+	BYTE code;
+	const INT32* t;
+
+	t = &ima_threshold_table[*step << 3];
+	e = sample - *predictor;
+	sign = e >> 31;
+	e = (e ^ sign) - sign;
 
-	adpcm->ima.last_step[channel] += ima_step_index_table[sample];
-	if (adpcm->ima.last_step[channel] < 0)
-		adpcm->ima.last_step[channel] = 0;
-	else if (adpcm->ima.last_step[channel] > 88)
-		adpcm->ima.last_step[channel] = 88;
+	code = (e >= t[1]) + (e >= t[2]) + (e >= t[3]) + (e >= t[4]) +
+		(e >= t[5]) + (e >= t[6]) + (e >= t[7]);
 
-	return (UINT16) d;
+	d = ima_diff_table[(*step << 3) + code];
+	d = *predictor + ((d ^ sign) - sign);
+
+	if (d < -32768)
+		d = -32768;
+	else if (d > 32767)
+		d = 32767;
+
+	*predictor = d;
+	*step = ima_next_step_table[(*step << 3) + code];
+
+	return code | (sign & 8);
 }
 
-static void freerdp_dsp_decode_ima_adpcm(FREERDP_DSP_CONTEXT* context,
-	const BYTE* src, int size, int channels, int block_size)
+static void dsp_read_ima_adpcm_header(ADPCM* adpcm, const BYTE* src, int channels)
 {
-	BYTE* dst;
-	BYTE sample;
-	UINT16 decoded;
-	UINT32 out_size;
-	int channel;
-	int i;
+	int c;
 
-	out_size = size * 4;
-	if (out_size > context->adpcm_maxlength)
+	for (c = 0; c < channels; c++)
 	{
-		context->adpcm_maxlength = out_size + 1024;
-		context->adpcm_buffer = realloc(context->adpcm_buffer, context->adpcm_maxlength);
+		adpcm->ima.last_sample[c] = (INT16) (((UINT16) src[0]) | (((UINT16) src[1]) << 8));
+		adpcm->ima.last_step[c] = MIN(src[2], IMA_MAX_STEP);
+		src += 4;
 	}
-	dst = context->adpcm_buffer;
-	while (size > 0)
-	{
-		if (size % block_size == 0)
-		{
-			context->adpcm.ima.last_sample[0] = (INT16) (((UINT16)(*src)) | (((UINT16)(*(src + 1))) << 8));
-			context->adpcm.ima.last_step[0] = (INT16) (*(src + 2));
-			src += 4;
-			size -= 4;
-			out_size -= 16;
-			if (channels > 1)
-			{
-				context->adpcm.ima.last_sample[1] = (INT16) (((UINT16)(*src)) | (((UINT16)(*(src + 1))) << 8));
-				context->adpcm.ima.last_step[1] = (INT16) (*(src + 2));
-				src += 4;
-				size -= 4;
-				out_size -= 16;
-			}
-		}
+}
 
-		if (channels > 1)
-		{
-			for (i = 0; i < 8; i++)
-			{
-				channel = (i < 4 ? 0 : 1);
-				sample = ((*src) & 0x0f);
-				decoded = dsp_decode_ima_adpcm_sample(&context->adpcm, channel, sample);
-				dst[((i & 3) << 3) + (channel << 1)] = (decoded & 0xff);
-				dst[((i & 3) << 3) + (channel << 1) + 1] = (decoded >> 8);
-				sample = ((*src) >> 4);
-				decoded = dsp_decode_ima_adpcm_sample(&context->adpcm, channel, sample);
-				dst[((i & 3) << 3) + (channel << 1) + 4] = (decoded & 0xff);
-				dst[((i & 3) << 3) + (channel << 1) + 5] = (decoded >> 8);
-				src++;
-			}
-			dst += 32;
-			size -= 8;
-		}
-		else
-		{
-			sample = ((*src) & 0x0f);
-			decoded = dsp_decode_ima_adpcm_sample(&context->adpcm, 0, sample);
-			*dst++ = (decoded & 0xff);
-			*dst++ = (decoded >> 8);
-			sample = ((*src) >> 4);
-			decoded = dsp_decode_ima_adpcm_sample(&context->adpcm, 0, sample);
-			*dst++ = (decoded & 0xff);
-			*dst++ = (decoded >> 8);
-			src++;
-			size--;
-		}
-	}
+static void dsp_write_ima_adpcm_header(ADPCM* adpcm, BYTE* dst, int channels)
+{
+	int c;
 
-	context->adpcm_size = dst - context->adpcm_buffer;
+	for (c = 0; c < channels; c++)
+	{
+		dst[0] = adpcm->ima.last_sample[c] & 0xff;
+		dst[1] = (adpcm->ima.last_sample[c] >> 8) & 0xff;
+		dst[2] = (BYTE) adpcm->ima.last_step[c];
+		dst[3] = 0;
+		dst += 4;
+	}
 }
 
 /**
+ * Mono data has two samples per byte, low nibble first. Stereo data comes
+ * in groups of 8 bytes: 4 bytes with 8 samples of the left channel, then 4
+ * with 8 samples of the right one.
+ *
  * 0     1     2     3
  * 2 0   6 4   10 8  14 12   <left>
  *
  * 4     5     6     7
  * 3 1   7 5   11 9  15 13   <right>
+ *
+ * The block functions below run over the data of one block with the
+ * channel state kept in locals.
  */
-static const struct
-{
-	BYTE byte_num;
-	BYTE byte_shift;
-} ima_stereo_encode_map[] =
-{
-	{ 0, 0 },
-	{ 4, 0 },
-	{ 0, 4 },
-	{ 4, 4 },
-	{ 1, 0 },
-	{ 5, 0 },
-	{ 1, 4 },
-	{ 5, 4 },
-	{ 2, 0 },
-	{ 6, 0 },
-	{ 2, 4 },
-	{ 6, 4 },
-	{ 3, 0 },
-	{ 7, 0 },
-	{ 3, 4 },
-	{ 7, 4 }
-};
 
-static BYTE dsp_encode_ima_adpcm_sample(ADPCM* adpcm,
-	int channel, INT16 sample)
+static void dsp_decode_ima_adpcm_block(ADPCM* adpcm, const BYTE* src, INT16* dst, int size, int channels)
 {
-	INT32 e;
-	INT32 d;
-	INT32 ss;
-	BYTE enc;
-	INT32 diff;
+	int i, k;
+	INT32 step[2];
+	INT32 predictor[2];
+
+	predictor[0] = adpcm->ima.last_sample[0];
+	step[0] = adpcm->ima.last_step[0];
 
-	ss = ima_step_size_table[adpcm->ima.last_step[channel]];
-	d = e = sample - adpcm->ima.last_sample[channel];
-	diff = ss >> 3;
-	enc = 0;
-	if (e < 0)
+	if (channels > 1)
 	{
-		enc = 8;
-		e = -e;
+		predictor[1] = adpcm->ima.last_sample[1];
+		step[1] = adpcm->ima.last_step[1];
+
+		/* the two channels are independent, decode them side by side */
+		for (i = 0; i < size; i += 8)
+		{
+			for (k = 0; k < 4; k++)
+			{
+				dst[0] = dsp_decode_ima_adpcm_sample(&predictor[0], &step[0], src[k] & 0x0f);
+				dst[1] = dsp_decode_ima_adpcm_sample(&predictor[1], &step[1], src[k + 4] & 0x0f);
+				dst[2] = dsp_decode_ima_adpcm_sample(&predictor[0], &step[0], src[k] >> 4);
+				dst[3] = dsp_decode_ima_adpcm_sample(&predictor[1], &step[1], src[k + 4] >> 4);
+				dst += 4;
+			}
+
+			src += 8;
+		}
+
+		adpcm->ima.last_sample[1] = (INT16) predictor[1];
+		adpcm->ima.last_step[1] = (INT16) step[1];
 	}
-	if (e >= ss)
+	else
 	{
-		enc |= 4;
-		e -= ss;
+		for (i = 0; i < size; i++)
+		{
+			dst[0] = dsp_decode_ima_adpcm_sample(&predictor[0], &step[0], src[i] & 0x0f);
+			dst[1] = dsp_decode_ima_adpcm_sample(&predictor[0], &step[0], src[i] >> 4);
+			dst += 2;
+		}
 	}
-	ss >>= 1;
-	if (e >= ss)
+
+	adpcm->ima.last_sample[0] = (INT16) predictor[0];
+	adpcm->ima.last_step[0] = (INT16) step[0];
+}
+
+static void dsp_encode_ima_adpcm_block(ADPCM* adpcm, const INT16* src, BYTE* dst, int size, int channels)
+{
+	int i, k;
+	INT32 step[2];
+	INT32 predictor[2];
+	BYTE code[2];
+
+	predictor[0] = adpcm->ima.last_sample[0];
+	step[0] = adpcm->ima.last_step[0];
+
+	if (channels > 1)
 	{
-		enc |= 2;
-		e -= ss;
+		predictor[1] = adpcm->ima.last_sample[1];
+		step[1] = adpcm->ima.last_step[1];
+
+		for (i = 0; i < size; i += 8)
+		{
+			for (k = 0; k < 4; k++)
+			{
+				code[0] = dsp_encode_ima_adpcm_sample(&predictor[0], &step[0], src[0]);
+				code[1] = dsp_encode_ima_adpcm_sample(&predictor[1], &step[1], src[1]);
+				dst[k] = code[0] | (dsp_encode_ima_adpcm_sample(&predictor[0], &step[0], src[2]) << 4);
+				dst[k + 4] = code[1] | (dsp_encode_ima_adpcm_sample(&predictor[1], &step[1], src[3]) << 4);
+				src += 4;
+			}
+
+			dst += 8;
+		}
+
+		adpcm->ima.last_sample[1] = (INT16) predictor[1];
+		adpcm->ima.last_step[1] = (INT16) step[1];
 	}
-	ss >>= 1;
-	if (e >= ss)
+	else
 	{
-		enc |= 1;
-		e -= ss;
+		for (i = 0; i < size; i++)
+		{
+			code[0] = dsp_encode_ima_adpcm_sample(&predictor[0], &step[0], src[0]);
+			dst[i] = code[0] | (dsp_encode_ima_adpcm_sample(&predictor[0], &step[0], src[1]) << 4);
+			src += 2;
+		}
 	}
 
-	if (d < 0)
-		diff = d + e - diff;
-	else
-		diff = d - e + diff;
-
-	diff += adpcm->ima.last_sample[channel];
-	if (diff < -32768)
-		diff = -32768;
-	else if (diff > 32767)
-		diff = 32767;
-	adpcm->ima.last_sample[channel] = (INT16) diff;
-
-	adpcm->ima.last_step[channel] += ima_step_index_table[enc];
-	if (adpcm->ima.last_step[channel] < 0)
-		adpcm->ima.last_step[channel] = 0;
-	else if (adpcm->ima.last_step[channel] > 88)
-		adpcm->ima.last_step[channel] = 88;
-
-	return enc;
+	adpcm->ima.last_sample[0] = (INT16) predictor[0];
+	adpcm->ima.last_step[0] = (INT16) step[0];
 }
 
-static void freerdp_dsp_encode_ima_adpcm(FREERDP_DSP_CONTEXT* context,
-	const BYTE* src, int size, int channels, int block_size)
+static void dsp_ensure_adpcm_buffer(FREERDP_DSP_CONTEXT* context, UINT32 out_size)
 {
-	BYTE* dst;
-	INT16 sample;
-	BYTE encoded;
-	UINT32 out_size;
-	int i;
-
-	out_size = size / 2;
 	if (out_size > context->adpcm_maxlength)
 	{
 		context->adpcm_maxlength = out_size + 1024;
 		context->adpcm_buffer = realloc(context->adpcm_buffer, context->adpcm_maxlength);
 	}
-	dst = context->adpcm_buffer;
+}
+
+/**
+ * A block header is expected wherever the data left is a multiple of the
+ * block size, so data in front of the first full block continues the
+ * block of the previous call.
+ */
+
+static void freerdp_dsp_decode_ima_adpcm(FREERDP_DSP_CONTEXT* context,
+	const BYTE* src, int size, int channels, int block_size)
+{
+	int chunk;
+	int header;
+	int group;
+	INT16* dst;
+
+	dsp_ensure_adpcm_buffer(context, size * 4);
+	dst = (INT16*) context->adpcm_buffer;
+
+	header = 4 * channels;
+	group = (channels > 1) ? 8 : 1;
+
 	while (size > 0)
 	{
-		if ((dst - context->adpcm_buffer) % block_size == 0)
+		if (size % block_size == 0)
 		{
-			*dst++ = context->adpcm.ima.last_sample[0] & 0xff;
-			*dst++ = (context->adpcm.ima.last_sample[0] >> 8) & 0xff;
-			*dst++ = (BYTE) context->adpcm.ima.last_step[0];
-			*dst++ = 0;
-			if (channels > 1)
-			{
-				*dst++ = context->adpcm.ima.last_sample[1] & 0xff;
-				*dst++ = (context->adpcm.ima.last_sample[1] >> 8) & 0xff;
-				*dst++ = (BYTE) context->adpcm.ima.last_step[1];
-				*dst++ = 0;
-			}
-		}
+			if (size < header)
+				break;
 
-		if (channels > 1)
-		{
-			memset(dst, 0, 8);
-			for (i = 0; i < 16; i++)
-			{
-				sample = (INT16) (((UINT16)(*src)) | (((UINT16)(*(src + 1))) << 8));
-				src += 2;
-				encoded = dsp_encode_ima_adpcm_sample(&context->adpcm, i % 2, sample);
-				dst[ima_stereo_encode_map[i].byte_num] |= encoded << ima_stereo_encode_map[i].byte_shift;
-			}
-			dst += 8;
-			size -= 32;
+			dsp_read_ima_adpcm_header(&context->adpcm, src, channels);
+			src += header;
+			size -= header;
 		}
-		else
+
+		chunk = (size % block_size) ? (size % block_size) : MIN(size, block_size);
+		chunk -= chunk % group;
+
+		if (chunk <= 0)
+			break;
+
+		dsp_decode_ima_adpcm_block(&context->adpcm, src, dst, chunk, channels);
+		src += chunk;
+		size -= chunk;
+		dst += chunk * 2;
+	}
+
+	context->adpcm_size = (BYTE*) dst - context->adpcm_buffer;
+}
+
+static void freerdp_dsp_encode_ima_adpcm(FREERDP_DSP_CONTEXT* context,
+	const BYTE* src, int size, int channels, int block_size)
+{
+	int chunk;
+	int header;
+	int group;
+	int samples;
+	int block_data;
+	BYTE* dst;
+	INT16 tail[16];
+	const INT16* in;
+
+	header = 4 * channels;
+	group = (channels > 1) ? 8 : 1;
+	block_data = (block_size - header) - ((block_size - header) % group);
+
+	if (block_data <= 0)
+	{
+		context->adpcm_size = 0;
+		return;
+	}
+
+	dsp_ensure_adpcm_buffer(context, size / 2 + block_size);
+	dst = context->adpcm_buffer;
+
+	in = (const INT16*) src;
+	samples = size / 2;
+
+	/* every output byte holds two samples */
+	while (samples > 0)
+	{
+		dsp_write_ima_adpcm_header(&context->adpcm, dst, channels);
+		dst += header;
+
+		chunk = MIN(samples / (group * 2), block_data / group) * group;
+
+		dsp_encode_ima_adpcm_block(&context->adpcm, in, dst, chunk, channels);
+		in += chunk * 2;
+		samples -= chunk * 2;
+		dst += chunk;
+
+		/* the last samples are padded with silence to a whole group */
+		if ((samples > 0) && (samples < group * 2) && (chunk < block_data))
 		{
-			sample = (INT16) (((UINT16)(*src)) | (((UINT16)(*(src + 1))) << 8));
-			src += 2;
-			encoded = dsp_encode_ima_adpcm_sample(&context->adpcm, 0, sample);
-			sample = (INT16) (((UINT16)(*src)) | (((UINT16)(*(src + 1))) << 8));
-			src += 2;
-			encoded |= dsp_encode_ima_adpcm_sample(&context->adpcm, 0, sample) << 4;
-			*dst++ = encoded;
-			size -= 4;
+			ZeroMemory(tail, sizeof(tail));
+			CopyMemory(tail, in, samples * sizeof(INT16));
+
+			dsp_encode_ima_adpcm_block(&context->adpcm, tail, dst, group, channels);
+			dst += group;
+			samples = 0;
 		}
 	}
-	
+
 	context->adpcm_size = dst - context->adpcm_buffer;
 }
 
@@ -369,6 +480,8 @@ static const INT16 ms_adpcm_adaptation_table[] =
 	768, 614, 512, 409, 307, 230, 230, 230
 };
 
+#define MS_ADPCM_NUM_COEFFS	7
+
 static const INT16 ms_adpcm_coeff1_table[] =
 {
 	256, 512, 0, 192, 240, 460, 392
@@ -379,160 +492,308 @@ static const INT16 ms_adpcm_coeff2_table[] =
 	0, -256, 0, 64, 0, -208, -232
 };
 
-static INT16 freerdp_dsp_decode_ms_adpcm_sample(ADPCM* adpcm, BYTE sample, int channel)
+/* sign extension of the 4-bit codes */
+static const INT8 ms_adpcm_nibble_table[] =
+{
+	0, 1, 2, 3, 4, 5, 6, 7,
+	-8, -7, -6, -5, -4, -3, -2, -1
+};
+
+typedef struct
+{
+	INT32 sample1;
+	INT32 sample2;
+	INT32 delta;
+	INT32 coeff1;
+	INT32 coeff2;
+} MS_ADPCM_CHANNEL;
+
+static INLINE INT16 dsp_decode_ms_adpcm_sample(MS_ADPCM_CHANNEL* state, BYTE code)
 {
-	INT8 nibble;
 	INT32 presample;
 
-	nibble = (sample & 0x08 ? (INT8)sample - 16 : sample);
-	presample = ((adpcm->ms.sample1[channel] * ms_adpcm_coeff1_table[adpcm->ms.predictor[channel]]) +
-		(adpcm->ms.sample2[channel] * ms_adpcm_coeff2_table[adpcm->ms.predictor[channel]])) / 256;
-	presample += nibble * adpcm->ms.delta[channel];
+	presample = ((state->sample1 * state->coeff1) + (state->sample2 * state->coeff2)) / 256;
+	presample += ms_adpcm_nibble_table[code] * state->delta;
+
 	if (presample > 32767)
 		presample = 32767;
 	else if (presample < -32768)
 		presample = -32768;
-	adpcm->ms.sample2[channel] = adpcm->ms.sample1[channel];
-	adpcm->ms.sample1[channel] = presample;
-	adpcm->ms.delta[channel] = adpcm->ms.delta[channel] * ms_adpcm_adaptation_table[sample] / 256;
-	if (adpcm->ms.delta[channel] < 16)
-		adpcm->ms.delta[channel] = 16;
+
+	state->sample2 = state->sample1;
+	state->sample1 = presample;
+	state->delta = state->delta * ms_adpcm_adaptation_table[code] / 256;
+
+	if (state->delta < 16)
+		state->delta = 16;
+
 	return (INT16) presample;
 }
 
-static void freerdp_dsp_decode_ms_adpcm(FREERDP_DSP_CONTEXT* context,
-	const BYTE* src, int size, int channels, int block_size)
+/**
+ * The code is the difference to the prediction in units of delta, rounded
+ * to nearest above zero and towards zero below it, then clamped to -8..7.
+ * As it is that small, it is counted with independent compares against
+ * the rounding thresholds rather than found by division: above zero the
+ * thresholds are half a delta below the multiples of delta, below zero
+ * they are the multiples themselves, up to 8 * delta. This shortens the
+ * dependency chain of a mono stream, where each code waits for the last.
+ */
+static INLINE BYTE dsp_encode_ms_adpcm_sample(MS_ADPCM_CHANNEL* state, INT32 sample)
 {
-	BYTE* dst;
-	BYTE sample;
-	UINT32 out_size;
+	INT32 a;
+	INT32 q;
+	INT32 t1, t2, t4;
+	INT32 sign;
+	INT32 delta;
+	INT32 presample;
 
-	out_size = size * 4;
-	if (out_size > context->adpcm_maxlength)
+	delta = state->delta;
+	presample = ((state->sample1 * state->coeff1) + (state->sample2 * state->coeff2)) / 256;
+
+	a = sample - presample;
+	sign = a >> 31;
+	a = (a ^ sign) - sign;
+
+	t1 = delta - (~sign & ((delta + 1) / 2 - 1));
+	t2 = t1 + delta;
+	t4 = t2 + (delta << 1);
+
+	q = (a >= t1) + (a >= t2) + (a >= t2 + delta) + (a >= t4) +
+		(a >= t4 + delta) + (a >= t4 + (delta << 1)) + (a >= t4 + (delta << 1) + delta) +
+		((a >= (delta << 3)) & sign);
+
+	q = (q ^ sign) - sign;
+
+	presample += delta * q;
+
+	if (presample > 32767)
+		presample = 32767;
+	else if (presample < -32768)
+		presample = -32768;
+
+	state->sample2 = state->sample1;
+	state->sample1 = presample;
+	state->delta = delta * ms_adpcm_adaptation_table[q & 0x0F] / 256;
+
+	if (state->delta < 16)
+		state->delta = 16;
+
+	return (BYTE) (q & 0x0F);
+}
+
+/**
+ * The same code found by division, as the previous coder did. With the two
+ * independent channels of a stereo block in flight, the coder is bound by
+ * throughput rather than by the latency of one channel, and the few micro
+ * operations of a division beat the compares above.
+ */
+static INLINE BYTE dsp_encode_ms_adpcm_sample_div(MS_ADPCM_CHANNEL* state, INT32 sample)
+{
+	INT32 a;
+	INT32 q;
+	INT32 delta;
+	INT32 presample;
+
+	delta = state->delta;
+	presample = ((state->sample1 * state->coeff1) + (state->sample2 * state->coeff2)) / 256;
+
+	a = sample - presample;
+	q = a / delta;
+
+	if (a - q * delta > delta / 2)
+		q++;
+
+	if (q > 7)
+		q = 7;
+	else if (q < -8)
+		q = -8;
+
+	presample += delta * q;
+
+	if (presample > 32767)
+		presample = 32767;
+	else if (presample < -32768)
+		presample = -32768;
+
+	state->sample2 = state->sample1;
+	state->sample1 = presample;
+	state->delta = delta * ms_adpcm_adaptation_table[q & 0x0F] / 256;
+
+	if (state->delta < 16)
+		state->delta = 16;
+
+	return (BYTE) (q & 0x0F);
+}
+
+static void dsp_load_ms_adpcm_state(ADPCM* adpcm, MS_ADPCM_CHANNEL* state, int channels)
+{
+	int c;
+
+	for (c = 0; c < channels; c++)
 	{
-		context->adpcm_maxlength = out_size + 1024;
-		context->adpcm_buffer = realloc(context->adpcm_buffer, context->adpcm_maxlength);
+		if (adpcm->ms.predictor[c] >= MS_ADPCM_NUM_COEFFS)
+			adpcm->ms.predictor[c] = 0;
+
+		state[c].sample1 = adpcm->ms.sample1[c];
+		state[c].sample2 = adpcm->ms.sample2[c];
+		state[c].delta = adpcm->ms.delta[c];
+		state[c].coeff1 = ms_adpcm_coeff1_table[adpcm->ms.predictor[c]];
+		state[c].coeff2 = ms_adpcm_coeff2_table[adpcm->ms.predictor[c]];
 	}
-	dst = context->adpcm_buffer;
+}
+
+static void dsp_store_ms_adpcm_state(ADPCM* adpcm, MS_ADPCM_CHANNEL* state, int channels)
+{
+	int c;
+
+	for (c = 0; c < channels; c++)
+	{
+		adpcm->ms.sample1[c] = state[c].sample1;
+		adpcm->ms.sample2[c] = state[c].sample2;
+		adpcm->ms.delta[c] = state[c].delta;
+	}
+}
+
+#define MS_ADPCM_READ_INT16(_p) ((INT16) (((UINT16) (_p)[0]) | (((UINT16) (_p)[1]) << 8)))
+
+/**
+ * Block header, per channel: the predictor index, the initial delta, then
+ * the second and the first sample of the block. The samples of the header
+ * are the first two frames of the block, stored as they are.
+ */
+static void dsp_read_ms_adpcm_header(ADPCM* adpcm, const BYTE* src, int channels)
+{
+	int c;
+
+	for (c = 0; c < channels; c++)
+	{
+		adpcm->ms.predictor[c] = src[c];
+		adpcm->ms.delta[c] = MS_ADPCM_READ_INT16(&src[channels + c * 2]);
+		adpcm->ms.sample1[c] = MS_ADPCM_READ_INT16(&src[channels * 3 + c * 2]);
+		adpcm->ms.sample2[c] = MS_ADPCM_READ_INT16(&src[channels * 5 + c * 2]);
+	}
+}
+
+static void dsp_write_ms_adpcm_header(ADPCM* adpcm, BYTE* dst, const INT16* src, int channels)
+{
+	int c;
+	BYTE* p;
+
+	for (c = 0; c < channels; c++)
+	{
+		adpcm->ms.sample2[c] = src[c];
+		adpcm->ms.sample1[c] = src[channels + c];
+
+		dst[c] = adpcm->ms.predictor[c];
+
+		p = &dst[channels + c * 2];
+		p[0] = (BYTE) (adpcm->ms.delta[c] & 0xff);
+		p[1] = (BYTE) ((adpcm->ms.delta[c] >> 8) & 0xff);
+
+		p = &dst[channels * 3 + c * 2];
+		p[0] = (BYTE) (adpcm->ms.sample1[c] & 0xff);
+		p[1] = (BYTE) ((adpcm->ms.sample1[c] >> 8) & 0xff);
+
+		p = &dst[channels * 5 + c * 2];
+		p[0] = (BYTE) (adpcm->ms.sample2[c] & 0xff);
+		p[1] = (BYTE) ((adpcm->ms.sample2[c] >> 8) & 0xff);
+	}
+}
+
+/**
+ * Every data byte holds two codes, high nibble first: two samples of a
+ * mono stream or one frame of a stereo one.
+ */
+
+static void freerdp_dsp_decode_ms_adpcm(FREERDP_DSP_CONTEXT* context,
+	const BYTE* src, int size, int channels, int block_size)
+{
+	int i;
+	int chunk;
+	int header;
+	INT16* dst;
+	MS_ADPCM_CHANNEL state[2];
+
+	dsp_ensure_adpcm_buffer(context, size * 4);
+	dst = (INT16*) context->adpcm_buffer;
+
+	header = 7 * channels;
+
 	while (size > 0)
 	{
 		if (size % block_size == 0)
 		{
-			if (channels > 1)
-			{
-				context->adpcm.ms.predictor[0] = *src++;
-				context->adpcm.ms.predictor[1] = *src++;
-				context->adpcm.ms.delta[0] = *((INT16*)src);
-				src += 2;
-				context->adpcm.ms.delta[1] = *((INT16*)src);
-				src += 2;
-				context->adpcm.ms.sample1[0] = *((INT16*)src);
-				src += 2;
-				context->adpcm.ms.sample1[1] = *((INT16*)src);
-				src += 2;
-				context->adpcm.ms.sample2[0] = *((INT16*)src);
-				src += 2;
-				context->adpcm.ms.sample2[1] = *((INT16*)src);
-				src += 2;
-				size -= 14;
-
-				*((INT16*)dst) = context->adpcm.ms.sample2[0];
-				dst += 2;
-				*((INT16*)dst) = context->adpcm.ms.sample2[1];
-				dst += 2;
-				*((INT16*)dst) = context->adpcm.ms.sample1[0];
-				dst += 2;
-				*((INT16*)dst) = context->adpcm.ms.sample1[1];
-				dst += 2;
-			}
-			else
-			{
-				context->adpcm.ms.predictor[0] = *src++;
-				context->adpcm.ms.delta[0] = *((INT16*)src);
-				src += 2;
-				context->adpcm.ms.sample1[0] = *((INT16*)src);
-				src += 2;
-				context->adpcm.ms.sample2[0] = *((INT16*)src);
-				src += 2;
-				size -= 7;
-
-				*((INT16*)dst) = context->adpcm.ms.sample2[0];
-				dst += 2;
-				*((INT16*)dst) = context->adpcm.ms.sample1[0];
-				dst += 2;
-			}
+			if (size < header)
+				break;
+
+			dsp_read_ms_adpcm_header(&context->adpcm, src, channels);
+			src += header;
+			size -= header;
+
+			for (i = 0; i < channels; i++)
+				dst[i] = (INT16) context->adpcm.ms.sample2[i];
+			for (i = 0; i < channels; i++)
+				dst[channels + i] = (INT16) context->adpcm.ms.sample1[i];
+			dst += channels * 2;
 		}
 
+		chunk = (size % block_size) ? (size % block_size) : MIN(size, block_size);
+
+		if (chunk <= 0)
+			break;
+
+		dsp_load_ms_adpcm_state(&context->adpcm, state, channels);
+
 		if (channels > 1)
 		{
-			sample = *src++;
-			size--;
-			*((INT16*)dst) = freerdp_dsp_decode_ms_adpcm_sample(&context->adpcm, sample >> 4, 0);
-			dst += 2;
-			*((INT16*)dst) = freerdp_dsp_decode_ms_adpcm_sample(&context->adpcm, sample & 0x0F, 1);
-			dst += 2;
-
-			sample = *src++;
-			size--;
-			*((INT16*)dst) = freerdp_dsp_decode_ms_adpcm_sample(&context->adpcm, sample >> 4, 0);
-			dst += 2;
-			*((INT16*)dst) = freerdp_dsp_decode_ms_adpcm_sample(&context->adpcm, sample & 0x0F, 1);
-			dst += 2;
+			for (i = 0; i < chunk; i++)
+			{
+				*dst++ = dsp_decode_ms_adpcm_sample(&state[0], src[i] >> 4);
+				*dst++ = dsp_decode_ms_adpcm_sample(&state[1], src[i] & 0x0F);
+			}
 		}
 		else
 		{
-			sample = *src++;
-			size--;
-			*((INT16*)dst) = freerdp_dsp_decode_ms_adpcm_sample(&context->adpcm, sample >> 4, 0);
-			dst += 2;
-			*((INT16*)dst) = freerdp_dsp_decode_ms_adpcm_sample(&context->adpcm, sample & 0x0F, 0);
-			dst += 2;
+			for (i = 0; i < chunk; i++)
+			{
+				*dst++ = dsp_decode_ms_adpcm_sample(&state[0], src[i] >> 4);
+				*dst++ = dsp_decode_ms_adpcm_sample(&state[0], src[i] & 0x0F);
+			}
 		}
-	}
 
-	context->adpcm_size = dst - context->adpcm_buffer;
-}
+		dsp_store_ms_adpcm_state(&context->adpcm, state, channels);
 
-static BYTE freerdp_dsp_encode_ms_adpcm_sample(ADPCM* adpcm, INT32 sample, int channel)
-{
-	INT32 presample;
-	INT32 errordelta;
-
-	presample = ((adpcm->ms.sample1[channel] * ms_adpcm_coeff1_table[adpcm->ms.predictor[channel]]) +
-		(adpcm->ms.sample2[channel] * ms_adpcm_coeff2_table[adpcm->ms.predictor[channel]])) / 256;
-	errordelta = (sample - presample) / adpcm->ms.delta[channel];
-	if ((sample - presample) % adpcm->ms.delta[channel] > adpcm->ms.delta[channel] / 2)
-		errordelta++;
-	if (errordelta > 7)
-		errordelta = 7;
-	else if (errordelta < -8)
-		errordelta = -8;
-	presample += adpcm->ms.delta[channel] * errordelta;
-	if (presample > 32767)
-		presample = 32767;
-	else if (presample < -32768)
-		presample = -32768;
-	adpcm->ms.sample2[channel] = adpcm->ms.sample1[channel];
-	adpcm->ms.sample1[channel] = presample;
-	adpcm->ms.delta[channel] = adpcm->ms.delta[channel] * ms_adpcm_adaptation_table[(((BYTE)errordelta) & 0x0F)] / 256;
-	if (adpcm->ms.delta[channel] < 16)
-		adpcm->ms.delta[channel] = 16;
-	return ((BYTE)errordelta) & 0x0F;
+		src += chunk;
+		size -= chunk;
+	}
+
+	context->adpcm_size = (BYTE*) dst - context->adpcm_buffer;
 }
 
 static void freerdp_dsp_encode_ms_adpcm(FREERDP_DSP_CONTEXT* context,
 	const BYTE* src, int size, int channels, int block_size)
 {
+	int i;
+	int chunk;
+	int header;
+	int samples;
+	int block_data;
 	BYTE* dst;
-	INT32 sample;
-	UINT32 out_size;
+	const INT16* in;
+	INT16 tail[4];
+	MS_ADPCM_CHANNEL state[2];
 
-	out_size = size / 2;
-	if (out_size > context->adpcm_maxlength)
+	header = 7 * channels;
+	block_data = block_size - header;
+
+	if (block_data <= 0)
 	{
-		context->adpcm_maxlength = out_size + 1024;
-		context->adpcm_buffer = realloc(context->adpcm_buffer, context->adpcm_maxlength);
+		context->adpcm_size = 0;
+		return;
 	}
+
+	dsp_ensure_adpcm_buffer(context, size / 2 + block_size);
 	dst = context->adpcm_buffer;
 
 	if (context->adpcm.ms.delta[0] < 16)
@@ -540,55 +801,64 @@ static void freerdp_dsp_encode_ms_adpcm(FREERDP_DSP_CONTEXT* context,
 	if (context->adpcm.ms.delta[1] < 16)
 		context->adpcm.ms.delta[1] = 16;
 
-	while (size > 0)
+	in = (const INT16*) src;
+	samples = size / 2;
+
+	while (samples > 0)
 	{
-		if ((dst - context->adpcm_buffer) % block_size == 0)
+		/* the two frames of the header, padded with silence if short */
+		if (samples < channels * 2)
+		{
+			ZeroMemory(tail, sizeof(tail));
+			CopyMemory(tail, in, samples * sizeof(INT16));
+			dsp_write_ms_adpcm_header(&context->adpcm, dst, tail, channels);
+			dst += header;
+			break;
+		}
+
+		dsp_write_ms_adpcm_header(&context->adpcm, dst, in, channels);
+		dst += header;
+		in += channels * 2;
+		samples -= channels * 2;
+
+		chunk = MIN(samples / 2, block_data);
+
+		dsp_load_ms_adpcm_state(&context->adpcm, state, channels);
+
+		if (channels > 1)
 		{
-			if (channels > 1)
+			for (i = 0; i < chunk; i++)
 			{
-				*dst++ = context->adpcm.ms.predictor[0];
-				*dst++ = context->adpcm.ms.predictor[1];
-				*dst++ = (BYTE) (context->adpcm.ms.delta[0] & 0xff);
-				*dst++ = (BYTE) ((context->adpcm.ms.delta[0] >> 8) & 0xff);
-				*dst++ = (BYTE) (context->adpcm.ms.delta[1] & 0xff);
-				*dst++ = (BYTE) ((context->adpcm.ms.delta[1] >> 8) & 0xff);
-				context->adpcm.ms.sample1[0] = *((INT16*) (src + 4));
-				context->adpcm.ms.sample1[1] = *((INT16*) (src + 6));
-				context->adpcm.ms.sample2[0] = *((INT16*) (src + 0));
-				context->adpcm.ms.sample2[1] = *((INT16*) (src + 2));
-				*((INT16*) (dst + 0)) = (INT16) context->adpcm.ms.sample1[0];
-				*((INT16*) (dst + 2)) = (INT16) context->adpcm.ms.sample1[1];
-				*((INT16*) (dst + 4)) = (INT16) context->adpcm.ms.sample2[0];
-				*((INT16*) (dst + 6)) = (INT16) context->adpcm.ms.sample2[1];
-				dst += 8;
-				src += 8;
-				size -= 8;
+				dst[i] = (dsp_encode_ms_adpcm_sample_div(&state[0], in[0]) << 4) |
+					dsp_encode_ms_adpcm_sample_div(&state[1], in[1]);
+				in += 2;
 			}
-			else
+		}
+		else
+		{
+			for (i = 0; i < chunk; i++)
 			{
-				*dst++ = context->adpcm.ms.predictor[0];
-				*dst++ = (BYTE) (context->adpcm.ms.delta[0] & 0xff);
-				*dst++ = (BYTE) ((context->adpcm.ms.delta[0] >> 8) & 0xff);
-				context->adpcm.ms.sample1[0] = *((INT16*) (src + 2));
-				context->adpcm.ms.sample2[0] = *((INT16*) (src + 0));
-				*((INT16*) (dst + 0)) = (INT16) context->adpcm.ms.sample1[0];
-				*((INT16*) (dst + 2)) = (INT16) context->adpcm.ms.sample2[0];
-				dst += 4;
-				src += 4;
-				size -= 4;
+				dst[i] = (dsp_encode_ms_adpcm_sample(&state[0], in[0]) << 4) |
+					dsp_encode_ms_adpcm_sample(&state[0], in[1]);
+				in += 2;
 			}
 		}
 
-		sample = *((INT16*) src);
-		src += 2;
-		*dst = freerdp_dsp_encode_ms_adpcm_sample(&context->adpcm, sample, 0) << 4;
-		sample = *((INT16*) src);
-		src += 2;
-		*dst += freerdp_dsp_encode_ms_adpcm_sample(&context->adpcm, sample, channels > 1 ? 1 : 0);
-		dst++;
-		size -= 4;
+		dst += chunk;
+		samples -= chunk * 2;
+
+		/* an odd last sample is padded with silence */
+		if ((samples == 1) && (chunk < block_data))
+		{
+			dst[0] = (dsp_encode_ms_adpcm_sample(&state[0], in[0]) << 4) |
+				dsp_encode_ms_adpcm_sample(&state[channels - 1], 0);
+			dst++;
+			samples = 0;
+		}
+
+		dsp_store_ms_adpcm_state(&context->adpcm, state, channels);
 	}
-	
+
 	context->adpcm_size = dst - context->adpcm_buffer;
 }
 
@@ -599,12 +869,16 @@ FREERDP_DSP_CONTEXT* freerdp_dsp_context_new(void)
 	context = (FREERDP_DSP_CONTEXT*) malloc(sizeof(FREERDP_DSP_CONTEXT));
 	ZeroMemory(context, sizeof(FREERDP_DSP_CONTEXT));
 
+	InitOnceExecuteOnce(&ima_tables_once, dsp_init_ima_tables, NULL, NULL);
+
 	context->resample = freerdp_dsp_resample;
 	context->decode_ima_adpcm = freerdp_dsp_decode_ima_adpcm;
 	context->encode_ima_adpcm = freerdp_dsp_encode_ima_adpcm;
 	context->decode_ms_adpcm = freerdp_dsp_decode_ms_adpcm;
 	context->encode_ms_adpcm = freerdp_dsp_encode_ms_adpcm;
 
+	context->resample_mode = FREERDP_DSP_RESAMPLE_POLYPHASE;
+
 	return context;
 }
 
@@ -616,6 +890,22 @@ void freerdp_dsp_context_free(FREERDP_DSP_CONTEXT* context)
 			free(context->resampled_buffer);
 		if (context->adpcm_buffer)
 			free(context->adpcm_buffer);
+		freerdp_dsp_resampler_free(context->resampler);
 		free(context);
 	}
 }
+
+void freerdp_dsp_context_set_resample_mode(FREERDP_DSP_CONTEXT* context, int mode)
+{
+	context->resample_mode = mode;
+}
+
+/**
+ * Start a new stream: the input history and position of the previous one
+ * are dropped with the next call to resample.
+ */
+void freerdp_dsp_context_reset_resampler(FREERDP_DSP_CONTEXT* context)
+{
+	if (context->resampler)
+		context->resampler->mode = -1;
+}
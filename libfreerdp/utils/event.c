@@ -155,7 +155,10 @@ static void freerdp_tsmf_event_free(RDP_EVENT* event)
 		case RDP_EVENT_TYPE_TSMF_VIDEO_FRAME:
 			{
 				RDP_VIDEO_FRAME_EVENT* vevent = (RDP_VIDEO_FRAME_EVENT*)event;
-				free(vevent->frame_data);
+				if (vevent->frame_buffer)
+					shared_buffer_unref(vevent->frame_buffer);
+				else
+					free(vevent->frame_data);
 				free(vevent->visible_rects);
 			}
 			break;
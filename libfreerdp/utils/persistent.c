@@ -0,0 +1,555 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Persistent Bitmap Cache Store
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <winpr/crt.h>
+
+#include <freerdp/utils/stream.h>
+#include <freerdp/utils/persistent.h>
+
+/**
+ * Cache file layout, little endian:
+ *
+ * header: signature (4 bytes), version (4 bytes), count (4 bytes)
+ *
+ * count entries of: key (8 bytes), stamp (4 bytes), id (1 byte),
+ * flags (1 byte), bpp (2 bytes), width (2 bytes), height (2 bytes),
+ * length (4 bytes), followed by length bytes of bitmap data
+ *
+ * Entries are written the most recently used first.
+ */
+
+#define PERSISTENT_CACHE_SIGNATURE	0x43425052 /* "RPBC" */
+#define PERSISTENT_CACHE_VERSION	1
+
+#define PERSISTENT_CACHE_HEADER_LENGTH	12
+#define PERSISTENT_CACHE_ENTRY_LENGTH	24
+
+/* a sanity bound, well above the 16 KB of the largest cached bitmap, 64x64 at 32 bpp */
+#define PERSISTENT_CACHE_MAX_LENGTH	0x20000
+
+#define PERSISTENT_CACHE_MIN_BUCKETS	256
+
+static UINT32 persistent_cache_hash(rdpPersistentCache* cache, UINT64 key)
+{
+	UINT32 hash;
+
+	hash = (UINT32) (key ^ (key >> 32));
+	hash *= 0x9E3779B1;
+
+	return (hash >> 8) & (cache->buckets - 1);
+}
+
+static void persistent_cache_rehash(rdpPersistentCache* cache, int buckets)
+{
+	int i;
+	UINT32 hash;
+	PERSISTENT_CACHE_ENTRY* entry;
+
+	free(cache->table);
+
+	cache->buckets = buckets;
+	cache->table = (PERSISTENT_CACHE_ENTRY**) malloc(sizeof(PERSISTENT_CACHE_ENTRY*) * buckets);
+	ZeroMemory(cache->table, sizeof(PERSISTENT_CACHE_ENTRY*) * buckets);
+
+	for (i = 0; i < cache->count; i++)
+	{
+		entry = cache->entries[i];
+		hash = persistent_cache_hash(cache, entry->key);
+		entry->next = cache->table[hash];
+		cache->table[hash] = entry;
+	}
+}
+
+PERSISTENT_CACHE_ENTRY* persistent_cache_find(rdpPersistentCache* cache, UINT64 key)
+{
+	PERSISTENT_CACHE_ENTRY* entry;
+
+	entry = cache->table[persistent_cache_hash(cache, key)];
+
+	while (entry && (entry->key != key))
+		entry = entry->next;
+
+	return entry;
+}
+
+static PERSISTENT_CACHE_ENTRY* persistent_cache_add(rdpPersistentCache* cache, UINT64 key, UINT32 id)
+{
+	UINT32 hash;
+	PERSISTENT_CACHE_ENTRY* entry;
+
+	entry = persistent_cache_find(cache, key);
+
+	if (entry)
+	{
+		if (entry->id < PERSISTENT_CACHE_MAX_CELLS)
+			cache->cells[entry->id]--;
+
+		free(entry->data);
+		entry->data = NULL;
+	}
+	else
+	{
+		if (cache->count >= cache->size)
+		{
+			cache->size *= 2;
+			cache->entries = (PERSISTENT_CACHE_ENTRY**) realloc(cache->entries,
+					sizeof(PERSISTENT_CACHE_ENTRY*) * cache->size);
+		}
+
+		entry = (PERSISTENT_CACHE_ENTRY*) malloc(sizeof(PERSISTENT_CACHE_ENTRY));
+		ZeroMemory(entry, sizeof(PERSISTENT_CACHE_ENTRY));
+		entry->key = key;
+
+		cache->entries[cache->count++] = entry;
+
+		if (cache->count > cache->buckets)
+		{
+			persistent_cache_rehash(cache, cache->buckets * 2);
+		}
+		else
+		{
+			hash = persistent_cache_hash(cache, key);
+			entry->next = cache->table[hash];
+			cache->table[hash] = entry;
+		}
+	}
+
+	entry->id = id;
+	entry->index = PERSISTENT_CACHE_NO_INDEX;
+	entry->offset = -1;
+
+	if (id < PERSISTENT_CACHE_MAX_CELLS)
+		cache->cells[id]++;
+
+	return entry;
+}
+
+/**
+ * Stores a bitmap received in a cache order, replacing any bitmap kept
+ * under the same key.
+ */
+
+PERSISTENT_CACHE_ENTRY* persistent_cache_put(rdpPersistentCache* cache, UINT64 key, UINT32 id,
+		UINT16 width, UINT16 height, UINT16 bpp, UINT16 flags, BYTE* data, UINT32 length)
+{
+	PERSISTENT_CACHE_ENTRY* entry;
+
+	if (length > PERSISTENT_CACHE_MAX_LENGTH)
+		return NULL;
+
+	entry = persistent_cache_add(cache, key, id);
+
+	entry->width = width;
+	entry->height = height;
+	entry->bpp = bpp;
+	entry->flags = flags;
+	entry->length = length;
+	entry->stamp = ++cache->stamp;
+
+	entry->data = (BYTE*) malloc(length + 1);
+	CopyMemory(entry->data, data, length);
+
+	return entry;
+}
+
+/**
+ * Records a key announced by the client, at the index it has the bitmap
+ * at in the cell.
+ */
+
+PERSISTENT_CACHE_ENTRY* persistent_cache_put_key(rdpPersistentCache* cache, UINT64 key, UINT32 id, UINT32 index)
+{
+	PERSISTENT_CACHE_ENTRY* entry;
+
+	entry = persistent_cache_add(cache, key, id);
+	entry->index = index;
+	entry->stamp = ++cache->stamp;
+
+	return entry;
+}
+
+void persistent_cache_touch(rdpPersistentCache* cache, PERSISTENT_CACHE_ENTRY* entry)
+{
+	entry->stamp = ++cache->stamp;
+}
+
+UINT32 persistent_cache_get_count(rdpPersistentCache* cache, UINT32 id)
+{
+	if (id >= PERSISTENT_CACHE_MAX_CELLS)
+		return 0;
+
+	return cache->cells[id];
+}
+
+/**
+ * Limits the number of bitmaps of a cell kept in the file, 0 keeps all.
+ */
+
+void persistent_cache_set_max_entries(rdpPersistentCache* cache, UINT32 id, UINT32 max_entries)
+{
+	if (id < PERSISTENT_CACHE_MAX_CELLS)
+		cache->max_entries[id] = max_entries;
+}
+
+/**
+ * The bitmap data of an entry, read from the cache file the first time it
+ * is needed.
+ */
+
+BYTE* persistent_cache_get_data(rdpPersistentCache* cache, PERSISTENT_CACHE_ENTRY* entry)
+{
+	BYTE* data;
+
+	if (entry->data || (entry->offset < 0) || !cache->fp)
+		return entry->data;
+
+	data = (BYTE*) malloc(entry->length + 1);
+
+	if ((fseek(cache->fp, entry->offset, SEEK_SET) != 0) ||
+		(fread(data, 1, entry->length, cache->fp) != entry->length))
+	{
+		free(data);
+		return NULL;
+	}
+
+	entry->data = data;
+
+	return data;
+}
+
+/* the most recently used first, the key breaks ties so that the order never depends on the sort */
+static int persistent_cache_compare(const void* a, const void* b)
+{
+	PERSISTENT_CACHE_ENTRY* entry1 = *((PERSISTENT_CACHE_ENTRY**) a);
+	PERSISTENT_CACHE_ENTRY* entry2 = *((PERSISTENT_CACHE_ENTRY**) b);
+
+	if (entry1->stamp != entry2->stamp)
+		return (entry1->stamp > entry2->stamp) ? -1 : 1;
+
+	if (entry1->key != entry2->key)
+		return (entry1->key < entry2->key) ? -1 : 1;
+
+	return 0;
+}
+
+/**
+ * The bitmaps of a cell to announce in the persistent key list, up to max
+ * of them, the most recently used first. Each gets the index it goes to
+ * in the cell, in that order; the others get none.
+ *
+ * A client loading the same file gets the same keys at the same indices
+ * every time, so the key list sent during the connection and the bitmap
+ * cache set up after it agree.
+ */
+
+int persistent_cache_get_keys(rdpPersistentCache* cache, UINT32 id, PERSISTENT_CACHE_ENTRY** entries, int max)
+{
+	int i;
+	int count = 0;
+
+	qsort(cache->entries, cache->count, sizeof(PERSISTENT_CACHE_ENTRY*), persistent_cache_compare);
+
+	for (i = 0; i < cache->count; i++)
+	{
+		if (cache->entries[i]->id != id)
+			continue;
+
+		if (count < max)
+		{
+			cache->entries[i]->index = count;
+			entries[count++] = cache->entries[i];
+		}
+		else
+		{
+			cache->entries[i]->index = PERSISTENT_CACHE_NO_INDEX;
+		}
+	}
+
+	return count;
+}
+
+static void persistent_cache_free_entries(rdpPersistentCache* cache)
+{
+	int i;
+
+	for (i = 0; i < cache->count; i++)
+	{
+		free(cache->entries[i]->data);
+		free(cache->entries[i]);
+	}
+
+	cache->count = 0;
+	ZeroMemory(cache->cells, sizeof(cache->cells));
+	ZeroMemory(cache->table, sizeof(PERSISTENT_CACHE_ENTRY*) * cache->buckets);
+}
+
+void persistent_cache_clear(rdpPersistentCache* cache)
+{
+	persistent_cache_free_entries(cache);
+
+	if (cache->fp)
+	{
+		fclose(cache->fp);
+		cache->fp = NULL;
+	}
+}
+
+/**
+ * Loads the keys of a cache file, replacing the bitmaps in the cache. The
+ * bitmap data is left in the file, which stays open until the cache is
+ * saved, cleared or freed. Returns FALSE if there is no usable file; an
+ * entry damaged on disk ends the load, keeping the entries before it.
+ */
+
+BOOL persistent_cache_load(rdpPersistentCache* cache, const char* filename)
+{
+	FILE* fp;
+	long size;
+	UINT32 i;
+	UINT32 count;
+	UINT32 version;
+	UINT32 signature;
+	STREAM stream;
+	STREAM* s = &stream;
+	BYTE header[PERSISTENT_CACHE_ENTRY_LENGTH];
+	PERSISTENT_CACHE_ENTRY* entry;
+	PERSISTENT_CACHE_ENTRY fields;
+	BYTE id;
+	BYTE flags;
+
+	persistent_cache_clear(cache);
+
+	fp = fopen(filename, "rb");
+
+	if (!fp)
+		return FALSE;
+
+	fseek(fp, 0, SEEK_END);
+	size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+
+	if (fread(header, 1, PERSISTENT_CACHE_HEADER_LENGTH, fp) != PERSISTENT_CACHE_HEADER_LENGTH)
+	{
+		fclose(fp);
+		return FALSE;
+	}
+
+	stream_attach(s, header, PERSISTENT_CACHE_HEADER_LENGTH);
+	stream_read_UINT32(s, signature);
+	stream_read_UINT32(s, version);
+	stream_read_UINT32(s, count);
+
+	if ((signature != PERSISTENT_CACHE_SIGNATURE) || (version != PERSISTENT_CACHE_VERSION))
+	{
+		printf("persistent_cache_load: %s is not a bitmap cache file\n", filename);
+		fclose(fp);
+		return FALSE;
+	}
+
+	cache->fp = fp;
+
+	for (i = 0; i < count; i++)
+	{
+		if (fread(header, 1, PERSISTENT_CACHE_ENTRY_LENGTH, fp) != PERSISTENT_CACHE_ENTRY_LENGTH)
+			break;
+
+		stream_attach(s, header, PERSISTENT_CACHE_ENTRY_LENGTH);
+		stream_read_UINT64(s, fields.key);
+		stream_read_UINT32(s, fields.stamp);
+		stream_read_BYTE(s, id);
+		stream_read_BYTE(s, flags);
+		stream_read_UINT16(s, fields.bpp);
+		stream_read_UINT16(s, fields.width);
+		stream_read_UINT16(s, fields.height);
+		stream_read_UINT32(s, fields.length);
+
+		fields.offset = ftell(fp);
+
+		if ((id >= PERSISTENT_CACHE_MAX_CELLS) || (fields.length > PERSISTENT_CACHE_MAX_LENGTH) ||
+			(fields.offset + (long) fields.length > size) || persistent_cache_find(cache, fields.key))
+		{
+			printf("persistent_cache_load: damaged entry %d in %s\n", i, filename);
+			break;
+		}
+
+		entry = persistent_cache_add(cache, fields.key, id);
+		entry->stamp = fields.stamp;
+		entry->flags = flags;
+		entry->bpp = fields.bpp;
+		entry->width = fields.width;
+		entry->height = fields.height;
+		entry->length = fields.length;
+		entry->offset = fields.offset;
+
+		if (fields.stamp > cache->stamp)
+			cache->stamp = fields.stamp;
+
+		fseek(fp, fields.length, SEEK_CUR);
+	}
+
+	return TRUE;
+}
+
+/**
+ * Writes the cache to a file, the most recently used bitmaps first and no
+ * more of each cell than set with persistent_cache_set_max_entries(). The
+ * file is written under a temporary name and then renamed, so that an
+ * interrupted save leaves the previous file intact.
+ */
+
+BOOL persistent_cache_save(rdpPersistentCache* cache, const char* filename)
+{
+	int i;
+	FILE* fp;
+	BYTE* data;
+	UINT32 count = 0;
+	char* tmpname;
+	STREAM stream;
+	STREAM* s = &stream;
+	BYTE header[PERSISTENT_CACHE_ENTRY_LENGTH];
+	UINT32 cells[PERSISTENT_CACHE_MAX_CELLS];
+	PERSISTENT_CACHE_ENTRY* entry;
+
+	tmpname = (char*) malloc(strlen(filename) + 5);
+	sprintf(tmpname, "%s.tmp", filename);
+
+	fp = fopen(tmpname, "wb");
+
+	if (!fp)
+	{
+		printf("persistent_cache_save: failed to create %s\n", tmpname);
+		free(tmpname);
+		return FALSE;
+	}
+
+	/* the count is written again once known */
+	stream_attach(s, header, PERSISTENT_CACHE_HEADER_LENGTH);
+	stream_write_UINT32(s, PERSISTENT_CACHE_SIGNATURE);
+	stream_write_UINT32(s, PERSISTENT_CACHE_VERSION);
+	stream_write_UINT32(s, 0);
+	fwrite(header, 1, PERSISTENT_CACHE_HEADER_LENGTH, fp);
+
+	qsort(cache->entries, cache->count, sizeof(PERSISTENT_CACHE_ENTRY*), persistent_cache_compare);
+	ZeroMemory(cells, sizeof(cells));
+
+	for (i = 0; i < cache->count; i++)
+	{
+		entry = cache->entries[i];
+
+		if (entry->id >= PERSISTENT_CACHE_MAX_CELLS)
+			continue;
+
+		if (cache->max_entries[entry->id] && (cells[entry->id] >= cache->max_entries[entry->id]))
+			continue;
+
+		data = persistent_cache_get_data(cache, entry);
+
+		if (!data)
+			continue;
+
+		stream_attach(s, header, PERSISTENT_CACHE_ENTRY_LENGTH);
+		stream_write_UINT64(s, entry->key);
+		stream_write_UINT32(s, entry->stamp);
+		stream_write_BYTE(s, entry->id);
+		stream_write_BYTE(s, entry->flags);
+		stream_write_UINT16(s, entry->bpp);
+		stream_write_UINT16(s, entry->width);
+		stream_write_UINT16(s, entry->height);
+		stream_write_UINT32(s, entry->length);
+
+		fwrite(header, 1, PERSISTENT_CACHE_ENTRY_LENGTH, fp);
+		fwrite(data, 1, entry->length, fp);
+
+		cells[entry->id]++;
+		count++;
+	}
+
+	stream_attach(s, header, 4);
+	stream_write_UINT32(s, count);
+	fseek(fp, 8, SEEK_SET);
+	fwrite(header, 1, 4, fp);
+
+	if (ferror(fp) | fclose(fp))
+	{
+		printf("persistent_cache_save: failed to write %s\n", tmpname);
+		remove(tmpname);
+		free(tmpname);
+		return FALSE;
+	}
+
+	/* the data of every entry kept is in memory now, the old file is no longer needed */
+	if (cache->fp)
+	{
+		fclose(cache->fp);
+		cache->fp = NULL;
+	}
+
+#ifdef _WIN32
+	remove(filename);
+#endif
+
+	if (rename(tmpname, filename) != 0)
+	{
+		printf("persistent_cache_save: failed to rename %s\n", tmpname);
+		remove(tmpname);
+		free(tmpname);
+		return FALSE;
+	}
+
+	free(tmpname);
+
+	return TRUE;
+}
+
+rdpPersistentCache* persistent_cache_new(void)
+{
+	rdpPersistentCache* cache;
+
+	cache = (rdpPersistentCache*) malloc(sizeof(rdpPersistentCache));
+
+	if (cache != NULL)
+	{
+		ZeroMemory(cache, sizeof(rdpPersistentCache));
+
+		cache->size = 64;
+		cache->entries = (PERSISTENT_CACHE_ENTRY**) malloc(sizeof(PERSISTENT_CACHE_ENTRY*) * cache->size);
+
+		persistent_cache_rehash(cache, PERSISTENT_CACHE_MIN_BUCKETS);
+	}
+
+	return cache;
+}
+
+void persistent_cache_free(rdpPersistentCache* cache)
+{
+	if (cache != NULL)
+	{
+		persistent_cache_clear(cache);
+
+		free(cache->entries);
+		free(cache->table);
+		free(cache);
+	}
+}
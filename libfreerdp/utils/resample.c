@@ -0,0 +1,462 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Audio Resampler
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+
+#include "resample.h"
+
+#ifdef WITH_SSE2
+#include "resample_sse2.h"
+#endif
+
+#ifdef WITH_NEON
+#include "resample_neon.h"
+#endif
+
+#ifndef RESAMPLE_INIT_SIMD
+#define RESAMPLE_INIT_SIMD(_kernels) do { } while (0)
+#endif
+
+#ifndef M_PI
+#define M_PI	3.14159265358979323846
+#endif
+
+static void resample_fir(INT16* dst, int dst_step, const INT16* src, const INT16* bank, int taps,
+	const UINT32* offsets, const UINT16* phases, int count)
+{
+	int i, k;
+	INT32 sum;
+	const INT16* x;
+	const INT16* h;
+
+	for (i = 0; i < count; i++)
+	{
+		x = &src[offsets[i]];
+		h = &bank[phases[i] * taps];
+		sum = 0;
+
+		for (k = 0; k < taps; k++)
+			sum += x[k] * h[k];
+
+		sum = (sum + (1 << 14)) >> 15;
+
+		*dst = (INT16) ((sum > 32767) ? 32767 : ((sum < -32768) ? -32768 : sum));
+		dst += dst_step;
+	}
+}
+
+static void resample_linear(INT16* dst, int dst_step, const INT16* src,
+	const UINT32* offsets, const UINT16* phases, int count)
+{
+	int i;
+	const INT16* x;
+
+	for (i = 0; i < count; i++)
+	{
+		x = &src[offsets[i]];
+		*dst = (INT16) ((x[0] * (RESAMPLE_LINEAR_ONE - phases[i]) + x[1] * phases[i] +
+			(RESAMPLE_LINEAR_ONE / 2)) >> 14);
+		dst += dst_step;
+	}
+}
+
+static const DSP_RESAMPLE_KERNELS resample_kernels_generic =
+{
+	"generic",
+	resample_fir,
+	resample_linear
+};
+
+static DSP_RESAMPLE_KERNELS resample_kernels;
+static INIT_ONCE resample_kernels_once = INIT_ONCE_STATIC_INIT;
+
+const DSP_RESAMPLE_KERNELS* freerdp_dsp_resample_kernels_generic(void)
+{
+	return &resample_kernels_generic;
+}
+
+static BOOL CALLBACK resample_kernels_init(PINIT_ONCE once, PVOID param, PVOID* context)
+{
+	CopyMemory(&resample_kernels, &resample_kernels_generic, sizeof(DSP_RESAMPLE_KERNELS));
+	RESAMPLE_INIT_SIMD(&resample_kernels);
+
+	return TRUE;
+}
+
+const DSP_RESAMPLE_KERNELS* freerdp_dsp_resample_kernels_get(void)
+{
+	InitOnceExecuteOnce(&resample_kernels_once, resample_kernels_init, NULL, NULL);
+
+	return &resample_kernels;
+}
+
+static UINT32 resample_gcd(UINT32 a, UINT32 b)
+{
+	UINT32 t;
+
+	while (b != 0)
+	{
+		t = a % b;
+		a = b;
+		b = t;
+	}
+
+	return a;
+}
+
+/**
+ * Blackman windowed sinc low-pass, one row of taps per phase. Row p
+ * interpolates at p/phases past the input sample at taps/2 - 1 in the
+ * window. Each row is normalized to a Q15 gain of exactly one.
+ */
+static void resample_build_bank(FREERDP_DSP_RESAMPLER* resampler)
+{
+	int p, k;
+	int peak;
+	INT32 sum;
+	double t;
+	double x;
+	double cutoff;
+	double total;
+	double* row;
+	INT16* h;
+	int taps = resampler->taps;
+
+	/* in cycles per input sample, below the lower of the two Nyquist frequencies */
+	cutoff = 0.45;
+
+	if (resampler->srate > resampler->rrate)
+		cutoff = cutoff * resampler->rrate / resampler->srate;
+
+	row = (double*) malloc(sizeof(double) * taps);
+
+	for (p = 0; p < resampler->phases; p++)
+	{
+		total = 0.0;
+
+		for (k = 0; k < taps; k++)
+		{
+			t = (k - (taps / 2 - 1)) - ((double) p / resampler->phases);
+			x = 2.0 * M_PI * cutoff * t;
+
+			row[k] = (t == 0.0) ? 2.0 * cutoff : sin(x) / (M_PI * t);
+			row[k] *= 0.42 + 0.5 * cos(2.0 * M_PI * t / taps) + 0.08 * cos(4.0 * M_PI * t / taps);
+
+			total += row[k];
+		}
+
+		h = &resampler->bank[p * taps];
+		sum = 0;
+		peak = 0;
+
+		for (k = 0; k < taps; k++)
+		{
+			h[k] = (INT16) floor((row[k] / total) * 32768.0 + 0.5);
+			sum += h[k];
+
+			if (h[k] > h[peak])
+				peak = k;
+		}
+
+		/* rounding leftovers go to the largest tap */
+		h[peak] += (INT16) (32768 - sum);
+	}
+
+	free(row);
+}
+
+static void resample_configure(FREERDP_DSP_RESAMPLER* resampler, int mode,
+	UINT32 schan, UINT32 srate, UINT32 rchan, UINT32 rrate)
+{
+	int c;
+	int taps;
+	UINT32 gcd;
+
+	resampler->mode = mode;
+	resampler->schan = schan;
+	resampler->srate = srate;
+	resampler->rchan = rchan;
+	resampler->rrate = rrate;
+
+	gcd = resample_gcd(srate, rrate);
+	resampler->L = rrate / gcd;
+	resampler->M = srate / gcd;
+	resampler->frac = 0;
+	resampler->skip = 0;
+
+	if (resampler->bank)
+	{
+		free(resampler->bank);
+		resampler->bank = NULL;
+	}
+
+	if (mode == FREERDP_DSP_RESAMPLE_LINEAR)
+	{
+		resampler->taps = 2;
+		resampler->phases = 0;
+		resampler->plane_length = 0;
+	}
+	else
+	{
+		/* keep the transition band as narrow at the output rate when decimating */
+		taps = RESAMPLE_TAPS;
+
+		if (srate > rrate)
+			taps = (RESAMPLE_TAPS * srate + rrate - 1) / rrate;
+
+		taps = MIN((taps + 7) & ~7, RESAMPLE_MAX_TAPS);
+
+		resampler->taps = taps;
+		resampler->phases = MIN(resampler->L, RESAMPLE_MAX_PHASES);
+		resampler->bank = (INT16*) malloc(sizeof(INT16) * resampler->phases * taps);
+		resample_build_bank(resampler);
+
+		/* silence before the first sample, so that it is output at time 0 */
+		resampler->plane_length = taps / 2 - 1;
+	}
+
+	if (resampler->plane_capacity < RESAMPLE_MAX_TAPS)
+	{
+		free(resampler->planes);
+		resampler->plane_capacity = RESAMPLE_MAX_TAPS;
+		resampler->planes = (INT16*) malloc(sizeof(INT16) * rchan * resampler->plane_capacity);
+	}
+	else
+	{
+		resampler->planes = (INT16*) realloc(resampler->planes, sizeof(INT16) * rchan * resampler->plane_capacity);
+	}
+
+	for (c = 0; c < (int) rchan; c++)
+		ZeroMemory(&resampler->planes[c * resampler->plane_capacity], sizeof(INT16) * resampler->plane_length);
+}
+
+static void resample_ensure_planes(FREERDP_DSP_RESAMPLER* resampler, int length)
+{
+	int c;
+	int capacity;
+	INT16* planes;
+
+	if (length <= resampler->plane_capacity)
+		return;
+
+	capacity = MAX(length, resampler->plane_capacity * 2);
+	planes = (INT16*) malloc(sizeof(INT16) * resampler->rchan * capacity);
+
+	for (c = 0; c < (int) resampler->rchan; c++)
+	{
+		CopyMemory(&planes[c * capacity], &resampler->planes[c * resampler->plane_capacity],
+			sizeof(INT16) * resampler->plane_length);
+	}
+
+	free(resampler->planes);
+	resampler->planes = planes;
+	resampler->plane_capacity = capacity;
+}
+
+static void resample_ensure_outputs(FREERDP_DSP_CONTEXT* context, int frames)
+{
+	int size;
+	FREERDP_DSP_RESAMPLER* resampler = context->resampler;
+
+	if (frames > resampler->max_outputs)
+	{
+		resampler->max_outputs = frames + 256;
+		resampler->offsets = (UINT32*) realloc(resampler->offsets, sizeof(UINT32) * resampler->max_outputs);
+		resampler->positions = (UINT16*) realloc(resampler->positions, sizeof(UINT16) * resampler->max_outputs);
+	}
+
+	size = frames * resampler->rchan * sizeof(INT16);
+
+	if (size > (int) context->resampled_maxlength)
+	{
+		context->resampled_maxlength = size + 1024;
+		context->resampled_buffer = (BYTE*) realloc(context->resampled_buffer, context->resampled_maxlength);
+	}
+}
+
+/* upmix by repeating channels, downmix stereo to mono by averaging */
+static INT16 resample_map_channel(const INT16* frame, UINT32 schan, UINT32 rchan, UINT32 c)
+{
+	if ((schan == 2) && (rchan == 1))
+		return (INT16) ((frame[0] + frame[1]) >> 1);
+
+	return frame[c % schan];
+}
+
+FREERDP_DSP_RESAMPLER* freerdp_dsp_resampler_new(void)
+{
+	FREERDP_DSP_RESAMPLER* resampler;
+
+	resampler = (FREERDP_DSP_RESAMPLER*) malloc(sizeof(FREERDP_DSP_RESAMPLER));
+	ZeroMemory(resampler, sizeof(FREERDP_DSP_RESAMPLER));
+
+	resampler->mode = -1;
+	resampler->kernels = freerdp_dsp_resample_kernels_get();
+
+	return resampler;
+}
+
+void freerdp_dsp_resampler_free(FREERDP_DSP_RESAMPLER* resampler)
+{
+	if (resampler)
+	{
+		free(resampler->bank);
+		free(resampler->planes);
+		free(resampler->offsets);
+		free(resampler->positions);
+		free(resampler);
+	}
+}
+
+/**
+ * Resample interleaved 16-bit frames, continuing the stream of the
+ * previous call as long as the formats do not change. The output lags
+ * the input by half the filter length, and the number of output frames
+ * varies by one between calls so that the rate conversion is exact over
+ * the stream. Buffers only grow, steady streams do not allocate.
+ */
+void freerdp_dsp_resample_s16(FREERDP_DSP_CONTEXT* context, const INT16* src,
+	UINT32 schan, UINT32 srate, int sframes, UINT32 rchan, UINT32 rrate)
+{
+	int i, c;
+	int count;
+	int length;
+	int remain;
+	UINT32 s;
+	UINT32 frac;
+	INT16* dst;
+	INT16* plane;
+	FREERDP_DSP_RESAMPLER* resampler;
+
+	if (!context->resampler)
+		context->resampler = freerdp_dsp_resampler_new();
+
+	resampler = context->resampler;
+
+	if ((resampler->mode != context->resample_mode) || (resampler->schan != schan) ||
+		(resampler->srate != srate) || (resampler->rchan != rchan) || (resampler->rrate != rrate))
+	{
+		resample_configure(resampler, context->resample_mode, schan, srate, rchan, rrate);
+	}
+
+	if (srate == rrate)
+	{
+		resample_ensure_outputs(context, sframes);
+		dst = (INT16*) context->resampled_buffer;
+
+		for (i = 0; i < sframes; i++)
+		{
+			for (c = 0; c < (int) rchan; c++)
+				*dst++ = resample_map_channel(&src[i * schan], schan, rchan, c);
+		}
+
+		context->resampled_frames = sframes;
+		context->resampled_size = sframes * rchan * sizeof(INT16);
+		return;
+	}
+
+	/* the previous call stepped past its input when decimating */
+	if (resampler->skip > 0)
+	{
+		i = MIN((int) resampler->skip, sframes);
+		resampler->skip -= i;
+		src += i * schan;
+		sframes -= i;
+	}
+
+	length = resampler->plane_length + sframes;
+	resample_ensure_planes(resampler, length);
+
+	for (c = 0; c < (int) rchan; c++)
+	{
+		plane = &resampler->planes[c * resampler->plane_capacity + resampler->plane_length];
+
+		for (i = 0; i < sframes; i++)
+			plane[i] = resample_map_channel(&src[i * schan], schan, rchan, c);
+	}
+
+	resample_ensure_outputs(context, (int) (((UINT64) length * resampler->L) / resampler->M) + 2);
+
+	count = 0;
+	s = 0;
+	frac = resampler->frac;
+
+	while ((int) s + resampler->taps <= length)
+	{
+		resampler->offsets[count] = s;
+
+		if (resampler->mode == FREERDP_DSP_RESAMPLE_LINEAR)
+			resampler->positions[count] = (UINT16) (((UINT64) frac * RESAMPLE_LINEAR_ONE) / resampler->L);
+		else if (resampler->phases == (int) resampler->L)
+			resampler->positions[count] = (UINT16) frac;
+		else
+			resampler->positions[count] = (UINT16) (((UINT64) frac * resampler->phases) / resampler->L);
+
+		count++;
+
+		frac += resampler->M;
+		s += frac / resampler->L;
+		frac %= resampler->L;
+	}
+
+	dst = (INT16*) context->resampled_buffer;
+
+	for (c = 0; c < (int) rchan; c++)
+	{
+		plane = &resampler->planes[c * resampler->plane_capacity];
+
+		if (resampler->mode == FREERDP_DSP_RESAMPLE_LINEAR)
+			resampler->kernels->linear(&dst[c], rchan, plane, resampler->offsets, resampler->positions, count);
+		else
+			resampler->kernels->fir(&dst[c], rchan, plane, resampler->bank, resampler->taps,
+				resampler->offsets, resampler->positions, count);
+	}
+
+	/* carry the part of the window still needed over to the next call */
+	if ((int) s >= length)
+	{
+		resampler->skip = s - length;
+		resampler->plane_length = 0;
+	}
+	else
+	{
+		remain = length - s;
+
+		for (c = 0; c < (int) rchan; c++)
+		{
+			plane = &resampler->planes[c * resampler->plane_capacity];
+			MoveMemory(plane, &plane[s], sizeof(INT16) * remain);
+		}
+
+		resampler->plane_length = remain;
+	}
+
+	resampler->frac = frac;
+
+	context->resampled_frames = count;
+	context->resampled_size = count * rchan * sizeof(INT16);
+}
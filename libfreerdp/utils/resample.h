@@ -0,0 +1,99 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Audio Resampler
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __DSP_RESAMPLE_H
+#define __DSP_RESAMPLE_H
+
+#include <freerdp/api.h>
+#include <freerdp/types.h>
+#include <freerdp/utils/dsp.h>
+
+/* polyphase filter phases above which the phase is quantized */
+#define RESAMPLE_MAX_PHASES		512
+
+/* taps per phase when upsampling, scaled up with the decimation ratio */
+#define RESAMPLE_TAPS			32
+#define RESAMPLE_MAX_TAPS		64
+
+/* linear interpolation fractions are Q14 */
+#define RESAMPLE_LINEAR_ONE		16384
+
+/**
+ * Kernels computing the output samples of one channel. Input samples are
+ * planar, outputs are written every dst_step samples, so straight into
+ * the interleaved output buffer. Output i is computed from the input
+ * window starting at offsets[i]:
+ *
+ * fir: taps samples weighted by row phases[i] of the Q15 filter bank
+ * linear: two samples weighted by the Q14 fraction phases[i]
+ */
+struct _DSP_RESAMPLE_KERNELS
+{
+	const char* name;
+
+	void (*fir)(INT16* dst, int dst_step, const INT16* src, const INT16* bank, int taps,
+		const UINT32* offsets, const UINT16* phases, int count);
+
+	void (*linear)(INT16* dst, int dst_step, const INT16* src,
+		const UINT32* offsets, const UINT16* phases, int count);
+};
+typedef struct _DSP_RESAMPLE_KERNELS DSP_RESAMPLE_KERNELS;
+
+/**
+ * Streaming resampler state: the planar input window, carrying the input
+ * history the filter still needs over to the next call, and the position
+ * of the next output between two input samples, in 1/L input samples.
+ * The rate ratio is kept reduced to L/M, so the position is exact.
+ */
+struct _FREERDP_DSP_RESAMPLER
+{
+	int mode;
+	UINT32 schan;
+	UINT32 srate;
+	UINT32 rchan;
+	UINT32 rrate;
+
+	UINT32 L;
+	UINT32 M;
+	UINT32 frac;
+	UINT32 skip;
+
+	int taps;
+	int phases;
+	INT16* bank;
+
+	INT16* planes;
+	int plane_length;
+	int plane_capacity;
+
+	UINT32* offsets;
+	UINT16* positions;
+	int max_outputs;
+
+	const DSP_RESAMPLE_KERNELS* kernels;
+};
+
+FREERDP_API const DSP_RESAMPLE_KERNELS* freerdp_dsp_resample_kernels_generic(void);
+FREERDP_API const DSP_RESAMPLE_KERNELS* freerdp_dsp_resample_kernels_get(void);
+
+FREERDP_DSP_RESAMPLER* freerdp_dsp_resampler_new(void);
+void freerdp_dsp_resampler_free(FREERDP_DSP_RESAMPLER* resampler);
+
+void freerdp_dsp_resample_s16(FREERDP_DSP_CONTEXT* context, const INT16* src,
+	UINT32 schan, UINT32 srate, int sframes, UINT32 rchan, UINT32 rrate);
+
+#endif /* __DSP_RESAMPLE_H */
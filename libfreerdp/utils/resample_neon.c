@@ -0,0 +1,107 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Audio Resampler - NEON Optimizations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#if defined(__ARM_NEON__)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arm_neon.h>
+
+#include "resample.h"
+#include "resample_neon.h"
+
+#if ANDROID
+#include "cpu-features.h"
+#endif
+
+static void resample_fir_neon(INT16* dst, int dst_step, const INT16* src, const INT16* bank, int taps,
+	const UINT32* offsets, const UINT16* phases, int count)
+{
+	int i, k;
+	INT32 sum;
+	int16x8_t a, b;
+	int32x4_t acc;
+	int32x2_t acc2;
+	const INT16* x;
+	const INT16* h;
+
+	if (taps & 7)
+	{
+		freerdp_dsp_resample_kernels_generic()->fir(dst, dst_step, src, bank, taps, offsets, phases, count);
+		return;
+	}
+
+	for (i = 0; i < count; i++)
+	{
+		x = &src[offsets[i]];
+		h = &bank[phases[i] * taps];
+		acc = vdupq_n_s32(0);
+
+		for (k = 0; k < taps; k += 8)
+		{
+			a = vld1q_s16(&x[k]);
+			b = vld1q_s16(&h[k]);
+			acc = vmlal_s16(acc, vget_low_s16(a), vget_low_s16(b));
+			acc = vmlal_s16(acc, vget_high_s16(a), vget_high_s16(b));
+		}
+
+		acc2 = vadd_s32(vget_low_s32(acc), vget_high_s32(acc));
+		acc2 = vpadd_s32(acc2, acc2);
+
+		sum = (vget_lane_s32(acc2, 0) + (1 << 14)) >> 15;
+
+		*dst = (INT16) ((sum > 32767) ? 32767 : ((sum < -32768) ? -32768 : sum));
+		dst += dst_step;
+	}
+}
+
+static BOOL resample_neon_supported(void)
+{
+#if ANDROID
+	UINT64 features;
+
+	if (android_getCpuFamily() != ANDROID_CPU_FAMILY_ARM)
+		return FALSE;
+
+	features = android_getCpuFeatures();
+
+	if (!(features & ANDROID_CPU_ARM_FEATURE_ARMv7))
+		return FALSE;
+
+	return (features & ANDROID_CPU_ARM_FEATURE_NEON) ? TRUE : FALSE;
+#else
+	return TRUE;
+#endif
+}
+
+/* linear interpolation gathers two samples per output and stays generic */
+void resample_init_neon(DSP_RESAMPLE_KERNELS* kernels)
+{
+	if (!resample_neon_supported())
+		return;
+
+	kernels->name = "neon";
+
+	kernels->fir = resample_fir_neon;
+}
+
+#endif /* __ARM_NEON__ */
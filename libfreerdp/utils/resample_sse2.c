@@ -0,0 +1,114 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Audio Resampler - SSE2 Optimizations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <xmmintrin.h>
+#include <emmintrin.h>
+
+#include "resample.h"
+#include "resample_sse2.h"
+
+static void resample_fir_sse2(INT16* dst, int dst_step, const INT16* src, const INT16* bank, int taps,
+	const UINT32* offsets, const UINT16* phases, int count)
+{
+	int i, k;
+	INT32 sum;
+	__m128i acc;
+	const INT16* x;
+	const INT16* h;
+
+	if (taps & 7)
+	{
+		freerdp_dsp_resample_kernels_generic()->fir(dst, dst_step, src, bank, taps, offsets, phases, count);
+		return;
+	}
+
+	for (i = 0; i < count; i++)
+	{
+		x = &src[offsets[i]];
+		h = &bank[phases[i] * taps];
+		acc = _mm_setzero_si128();
+
+		for (k = 0; k < taps; k += 8)
+		{
+			acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_loadu_si128((__m128i*) &x[k]),
+				_mm_loadu_si128((__m128i*) &h[k])));
+		}
+
+		acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+		acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+
+		sum = (_mm_cvtsi128_si32(acc) + (1 << 14)) >> 15;
+
+		*dst = (INT16) ((sum > 32767) ? 32767 : ((sum < -32768) ? -32768 : sum));
+		dst += dst_step;
+	}
+}
+
+/* four outputs at a time: interleaved sample pairs against (1 - f, f) pairs */
+static void resample_linear_sse2(INT16* dst, int dst_step, const INT16* src,
+	const UINT32* offsets, const UINT16* phases, int count)
+{
+	int i;
+	__m128i x, w, r;
+	const INT16 *x0, *x1, *x2, *x3;
+	const __m128i half = _mm_set1_epi32(RESAMPLE_LINEAR_ONE / 2);
+
+	for (i = 0; i + 4 <= count; i += 4)
+	{
+		x0 = &src[offsets[i]];
+		x1 = &src[offsets[i + 1]];
+		x2 = &src[offsets[i + 2]];
+		x3 = &src[offsets[i + 3]];
+
+		x = _mm_set_epi16(x3[1], x3[0], x2[1], x2[0], x1[1], x1[0], x0[1], x0[0]);
+		w = _mm_set_epi16(phases[i + 3], RESAMPLE_LINEAR_ONE - phases[i + 3],
+			phases[i + 2], RESAMPLE_LINEAR_ONE - phases[i + 2],
+			phases[i + 1], RESAMPLE_LINEAR_ONE - phases[i + 1],
+			phases[i], RESAMPLE_LINEAR_ONE - phases[i]);
+
+		r = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(x, w), half), 14);
+		r = _mm_packs_epi32(r, r);
+
+		dst[0] = (INT16) _mm_extract_epi16(r, 0);
+		dst[dst_step] = (INT16) _mm_extract_epi16(r, 1);
+		dst[dst_step * 2] = (INT16) _mm_extract_epi16(r, 2);
+		dst[dst_step * 3] = (INT16) _mm_extract_epi16(r, 3);
+		dst += dst_step * 4;
+	}
+
+	if (i < count)
+	{
+		freerdp_dsp_resample_kernels_generic()->linear(dst, dst_step, src,
+			&offsets[i], &phases[i], count - i);
+	}
+}
+
+void resample_init_sse2(DSP_RESAMPLE_KERNELS* kernels)
+{
+	kernels->name = "sse2";
+
+	kernels->fir = resample_fir_sse2;
+	kernels->linear = resample_linear_sse2;
+}
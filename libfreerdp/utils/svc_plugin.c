@@ -419,6 +419,10 @@ void svc_plugin_init(rdpSvcPlugin* plugin, CHANNEL_ENTRY_POINTS* pEntryPoints)
 		&plugin->channel_def, 1, VIRTUAL_CHANNEL_VERSION_WIN2000, svc_plugin_init_event);
 }
 
+/**
+ * data_out is sent in place and freed on CHANNEL_EVENT_WRITE_COMPLETE,
+ * once the channel is done with it.
+ */
 int svc_plugin_send(rdpSvcPlugin* plugin, STREAM* data_out)
 {
 	UINT32 error = 0;
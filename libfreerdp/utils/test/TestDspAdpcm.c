@@ -0,0 +1,849 @@
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <winpr/crt.h>
+
+#include <freerdp/utils/dsp.h>
+#include <freerdp/utils/stopwatch.h>
+
+/**
+ * The table driven block coders of the DSP context have to produce the
+ * same bytes and samples as the per-sample coders they replaced, which
+ * are kept below as the reference. Both run over the same packets of a
+ * signal with tones, noise and full scale bursts that drive the step
+ * sizes to their limits, then the throughput of both is printed.
+ */
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define TEST_RATE		22050
+#define TEST_SECONDS		4
+#define TEST_RUNS		15
+
+static const INT16 ref_ima_step_index_table[] =
+{
+	-1, -1, -1, -1, 2, 4, 6, 8,
+	-1, -1, -1, -1, 2, 4, 6, 8
+};
+
+static const INT16 ref_ima_step_size_table[] =
+{
+	7, 8, 9, 10, 11, 12, 13, 14, 16, 17,
+	19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+	50, 55, 60, 66, 73, 80, 88, 97, 107, 118,
+	130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+	337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+	876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+	2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358,
+	5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+	15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+static UINT16 ref_decode_ima_adpcm_sample(ADPCM* adpcm,
+	int channel, BYTE sample)
+{
+	INT32 ss;
+	INT32 d;
+
+	ss = ref_ima_step_size_table[adpcm->ima.last_step[channel]];
+	d = (ss >> 3);
+	if (sample & 1)
+		d += (ss >> 2);
+	if (sample & 2)
+		d += (ss >> 1);
+	if (sample & 4)
+		d += ss;
+	if (sample & 8)
+		d = -d;
+	d += adpcm->ima.last_sample[channel];
+
+	if (d < -32768)
+		d = -32768;
+	else if (d > 32767)
+		d = 32767;
+
+	adpcm->ima.last_sample[channel] = (INT16) d;
+
+	adpcm->ima.last_step[channel] += ref_ima_step_index_table[sample];
+	if (adpcm->ima.last_step[channel] < 0)
+		adpcm->ima.last_step[channel] = 0;
+	else if (adpcm->ima.last_step[channel] > 88)
+		adpcm->ima.last_step[channel] = 88;
+
+	return (UINT16) d;
+}
+
+static void ref_decode_ima_adpcm(FREERDP_DSP_CONTEXT* context,
+	const BYTE* src, int size, int channels, int block_size)
+{
+	BYTE* dst;
+	BYTE sample;
+	UINT16 decoded;
+	UINT32 out_size;
+	int channel;
+	int i;
+
+	out_size = size * 4;
+	if (out_size > context->adpcm_maxlength)
+	{
+		context->adpcm_maxlength = out_size + 1024;
+		context->adpcm_buffer = realloc(context->adpcm_buffer, context->adpcm_maxlength);
+	}
+	dst = context->adpcm_buffer;
+	while (size > 0)
+	{
+		if (size % block_size == 0)
+		{
+			context->adpcm.ima.last_sample[0] = (INT16) (((UINT16)(*src)) | (((UINT16)(*(src + 1))) << 8));
+			context->adpcm.ima.last_step[0] = (INT16) (*(src + 2));
+			src += 4;
+			size -= 4;
+			out_size -= 16;
+			if (channels > 1)
+			{
+				context->adpcm.ima.last_sample[1] = (INT16) (((UINT16)(*src)) | (((UINT16)(*(src + 1))) << 8));
+				context->adpcm.ima.last_step[1] = (INT16) (*(src + 2));
+				src += 4;
+				size -= 4;
+				out_size -= 16;
+			}
+		}
+
+		if (channels > 1)
+		{
+			for (i = 0; i < 8; i++)
+			{
+				channel = (i < 4 ? 0 : 1);
+				sample = ((*src) & 0x0f);
+				decoded = ref_decode_ima_adpcm_sample(&context->adpcm, channel, sample);
+				dst[((i & 3) << 3) + (channel << 1)] = (decoded & 0xff);
+				dst[((i & 3) << 3) + (channel << 1) + 1] = (decoded >> 8);
+				sample = ((*src) >> 4);
+				decoded = ref_decode_ima_adpcm_sample(&context->adpcm, channel, sample);
+				dst[((i & 3) << 3) + (channel << 1) + 4] = (decoded & 0xff);
+				dst[((i & 3) << 3) + (channel << 1) + 5] = (decoded >> 8);
+				src++;
+			}
+			dst += 32;
+			size -= 8;
+		}
+		else
+		{
+			sample = ((*src) & 0x0f);
+			decoded = ref_decode_ima_adpcm_sample(&context->adpcm, 0, sample);
+			*dst++ = (decoded & 0xff);
+			*dst++ = (decoded >> 8);
+			sample = ((*src) >> 4);
+			decoded = ref_decode_ima_adpcm_sample(&context->adpcm, 0, sample);
+			*dst++ = (decoded & 0xff);
+			*dst++ = (decoded >> 8);
+			src++;
+			size--;
+		}
+	}
+
+	context->adpcm_size = dst - context->adpcm_buffer;
+}
+
+/**
+ * 0     1     2     3
+ * 2 0   6 4   10 8  14 12   <left>
+ *
+ * 4     5     6     7
+ * 3 1   7 5   11 9  15 13   <right>
+ */
+static const struct
+{
+	BYTE byte_num;
+	BYTE byte_shift;
+} ref_ima_stereo_encode_map[] =
+{
+	{ 0, 0 },
+	{ 4, 0 },
+	{ 0, 4 },
+	{ 4, 4 },
+	{ 1, 0 },
+	{ 5, 0 },
+	{ 1, 4 },
+	{ 5, 4 },
+	{ 2, 0 },
+	{ 6, 0 },
+	{ 2, 4 },
+	{ 6, 4 },
+	{ 3, 0 },
+	{ 7, 0 },
+	{ 3, 4 },
+	{ 7, 4 }
+};
+
+static BYTE ref_encode_ima_adpcm_sample(ADPCM* adpcm,
+	int channel, INT16 sample)
+{
+	INT32 e;
+	INT32 d;
+	INT32 ss;
+	BYTE enc;
+	INT32 diff;
+
+	ss = ref_ima_step_size_table[adpcm->ima.last_step[channel]];
+	d = e = sample - adpcm->ima.last_sample[channel];
+	diff = ss >> 3;
+	enc = 0;
+	if (e < 0)
+	{
+		enc = 8;
+		e = -e;
+	}
+	if (e >= ss)
+	{
+		enc |= 4;
+		e -= ss;
+	}
+	ss >>= 1;
+	if (e >= ss)
+	{
+		enc |= 2;
+		e -= ss;
+	}
+	ss >>= 1;
+	if (e >= ss)
+	{
+		enc |= 1;
+		e -= ss;
+	}
+
+	if (d < 0)
+		diff = d + e - diff;
+	else
+		diff = d - e + diff;
+
+	diff += adpcm->ima.last_sample[channel];
+	if (diff < -32768)
+		diff = -32768;
+	else if (diff > 32767)
+		diff = 32767;
+	adpcm->ima.last_sample[channel] = (INT16) diff;
+
+	adpcm->ima.last_step[channel] += ref_ima_step_index_table[enc];
+	if (adpcm->ima.last_step[channel] < 0)
+		adpcm->ima.last_step[channel] = 0;
+	else if (adpcm->ima.last_step[channel] > 88)
+		adpcm->ima.last_step[channel] = 88;
+
+	return enc;
+}
+
+static void ref_encode_ima_adpcm(FREERDP_DSP_CONTEXT* context,
+	const BYTE* src, int size, int channels, int block_size)
+{
+	BYTE* dst;
+	INT16 sample;
+	BYTE encoded;
+	UINT32 out_size;
+	int i;
+
+	out_size = size / 2;
+	if (out_size > context->adpcm_maxlength)
+	{
+		context->adpcm_maxlength = out_size + 1024;
+		context->adpcm_buffer = realloc(context->adpcm_buffer, context->adpcm_maxlength);
+	}
+	dst = context->adpcm_buffer;
+	while (size > 0)
+	{
+		if ((dst - context->adpcm_buffer) % block_size == 0)
+		{
+			*dst++ = context->adpcm.ima.last_sample[0] & 0xff;
+			*dst++ = (context->adpcm.ima.last_sample[0] >> 8) & 0xff;
+			*dst++ = (BYTE) context->adpcm.ima.last_step[0];
+			*dst++ = 0;
+			if (channels > 1)
+			{
+				*dst++ = context->adpcm.ima.last_sample[1] & 0xff;
+				*dst++ = (context->adpcm.ima.last_sample[1] >> 8) & 0xff;
+				*dst++ = (BYTE) context->adpcm.ima.last_step[1];
+				*dst++ = 0;
+			}
+		}
+
+		if (channels > 1)
+		{
+			memset(dst, 0, 8);
+			for (i = 0; i < 16; i++)
+			{
+				sample = (INT16) (((UINT16)(*src)) | (((UINT16)(*(src + 1))) << 8));
+				src += 2;
+				encoded = ref_encode_ima_adpcm_sample(&context->adpcm, i % 2, sample);
+				dst[ref_ima_stereo_encode_map[i].byte_num] |= encoded << ref_ima_stereo_encode_map[i].byte_shift;
+			}
+			dst += 8;
+			size -= 32;
+		}
+		else
+		{
+			sample = (INT16) (((UINT16)(*src)) | (((UINT16)(*(src + 1))) << 8));
+			src += 2;
+			encoded = ref_encode_ima_adpcm_sample(&context->adpcm, 0, sample);
+			sample = (INT16) (((UINT16)(*src)) | (((UINT16)(*(src + 1))) << 8));
+			src += 2;
+			encoded |= ref_encode_ima_adpcm_sample(&context->adpcm, 0, sample) << 4;
+			*dst++ = encoded;
+			size -= 4;
+		}
+	}
+
+	context->adpcm_size = dst - context->adpcm_buffer;
+}
+
+static const INT16 ref_ms_adpcm_adaptation_table[] =
+{
+	230, 230, 230, 230, 307, 409, 512, 614,
+	768, 614, 512, 409, 307, 230, 230, 230
+};
+
+static const INT16 ref_ms_adpcm_coeff1_table[] =
+{
+	256, 512, 0, 192, 240, 460, 392
+};
+
+static const INT16 ref_ms_adpcm_coeff2_table[] =
+{
+	0, -256, 0, 64, 0, -208, -232
+};
+
+static INT16 ref_decode_ms_adpcm_sample(ADPCM* adpcm, BYTE sample, int channel)
+{
+	INT8 nibble;
+	INT32 presample;
+
+	nibble = (sample & 0x08 ? (INT8)sample - 16 : sample);
+	presample = ((adpcm->ms.sample1[channel] * ref_ms_adpcm_coeff1_table[adpcm->ms.predictor[channel]]) +
+		(adpcm->ms.sample2[channel] * ref_ms_adpcm_coeff2_table[adpcm->ms.predictor[channel]])) / 256;
+	presample += nibble * adpcm->ms.delta[channel];
+	if (presample > 32767)
+		presample = 32767;
+	else if (presample < -32768)
+		presample = -32768;
+	adpcm->ms.sample2[channel] = adpcm->ms.sample1[channel];
+	adpcm->ms.sample1[channel] = presample;
+	adpcm->ms.delta[channel] = adpcm->ms.delta[channel] * ref_ms_adpcm_adaptation_table[sample] / 256;
+	if (adpcm->ms.delta[channel] < 16)
+		adpcm->ms.delta[channel] = 16;
+	return (INT16) presample;
+}
+
+static void ref_decode_ms_adpcm(FREERDP_DSP_CONTEXT* context,
+	const BYTE* src, int size, int channels, int block_size)
+{
+	BYTE* dst;
+	BYTE sample;
+	UINT32 out_size;
+
+	out_size = size * 4;
+	if (out_size > context->adpcm_maxlength)
+	{
+		context->adpcm_maxlength = out_size + 1024;
+		context->adpcm_buffer = realloc(context->adpcm_buffer, context->adpcm_maxlength);
+	}
+	dst = context->adpcm_buffer;
+	while (size > 0)
+	{
+		if (size % block_size == 0)
+		{
+			if (channels > 1)
+			{
+				context->adpcm.ms.predictor[0] = *src++;
+				context->adpcm.ms.predictor[1] = *src++;
+				context->adpcm.ms.delta[0] = *((INT16*)src);
+				src += 2;
+				context->adpcm.ms.delta[1] = *((INT16*)src);
+				src += 2;
+				context->adpcm.ms.sample1[0] = *((INT16*)src);
+				src += 2;
+				context->adpcm.ms.sample1[1] = *((INT16*)src);
+				src += 2;
+				context->adpcm.ms.sample2[0] = *((INT16*)src);
+				src += 2;
+				context->adpcm.ms.sample2[1] = *((INT16*)src);
+				src += 2;
+				size -= 14;
+
+				*((INT16*)dst) = context->adpcm.ms.sample2[0];
+				dst += 2;
+				*((INT16*)dst) = context->adpcm.ms.sample2[1];
+				dst += 2;
+				*((INT16*)dst) = context->adpcm.ms.sample1[0];
+				dst += 2;
+				*((INT16*)dst) = context->adpcm.ms.sample1[1];
+				dst += 2;
+			}
+			else
+			{
+				context->adpcm.ms.predictor[0] = *src++;
+				context->adpcm.ms.delta[0] = *((INT16*)src);
+				src += 2;
+				context->adpcm.ms.sample1[0] = *((INT16*)src);
+				src += 2;
+				context->adpcm.ms.sample2[0] = *((INT16*)src);
+				src += 2;
+				size -= 7;
+
+				*((INT16*)dst) = context->adpcm.ms.sample2[0];
+				dst += 2;
+				*((INT16*)dst) = context->adpcm.ms.sample1[0];
+				dst += 2;
+			}
+		}
+
+		if (channels > 1)
+		{
+			sample = *src++;
+			size--;
+			*((INT16*)dst) = ref_decode_ms_adpcm_sample(&context->adpcm, sample >> 4, 0);
+			dst += 2;
+			*((INT16*)dst) = ref_decode_ms_adpcm_sample(&context->adpcm, sample & 0x0F, 1);
+			dst += 2;
+
+			sample = *src++;
+			size--;
+			*((INT16*)dst) = ref_decode_ms_adpcm_sample(&context->adpcm, sample >> 4, 0);
+			dst += 2;
+			*((INT16*)dst) = ref_decode_ms_adpcm_sample(&context->adpcm, sample & 0x0F, 1);
+			dst += 2;
+		}
+		else
+		{
+			sample = *src++;
+			size--;
+			*((INT16*)dst) = ref_decode_ms_adpcm_sample(&context->adpcm, sample >> 4, 0);
+			dst += 2;
+			*((INT16*)dst) = ref_decode_ms_adpcm_sample(&context->adpcm, sample & 0x0F, 0);
+			dst += 2;
+		}
+	}
+
+	context->adpcm_size = dst - context->adpcm_buffer;
+}
+
+static BYTE ref_encode_ms_adpcm_sample(ADPCM* adpcm, INT32 sample, int channel)
+{
+	INT32 presample;
+	INT32 errordelta;
+
+	presample = ((adpcm->ms.sample1[channel] * ref_ms_adpcm_coeff1_table[adpcm->ms.predictor[channel]]) +
+		(adpcm->ms.sample2[channel] * ref_ms_adpcm_coeff2_table[adpcm->ms.predictor[channel]])) / 256;
+	errordelta = (sample - presample) / adpcm->ms.delta[channel];
+	if ((sample - presample) % adpcm->ms.delta[channel] > adpcm->ms.delta[channel] / 2)
+		errordelta++;
+	if (errordelta > 7)
+		errordelta = 7;
+	else if (errordelta < -8)
+		errordelta = -8;
+	presample += adpcm->ms.delta[channel] * errordelta;
+	if (presample > 32767)
+		presample = 32767;
+	else if (presample < -32768)
+		presample = -32768;
+	adpcm->ms.sample2[channel] = adpcm->ms.sample1[channel];
+	adpcm->ms.sample1[channel] = presample;
+	adpcm->ms.delta[channel] = adpcm->ms.delta[channel] * ref_ms_adpcm_adaptation_table[(((BYTE)errordelta) & 0x0F)] / 256;
+	if (adpcm->ms.delta[channel] < 16)
+		adpcm->ms.delta[channel] = 16;
+	return ((BYTE)errordelta) & 0x0F;
+}
+
+static void ref_encode_ms_adpcm(FREERDP_DSP_CONTEXT* context,
+	const BYTE* src, int size, int channels, int block_size)
+{
+	BYTE* dst;
+	INT32 sample;
+	UINT32 out_size;
+
+	out_size = size / 2;
+	if (out_size > context->adpcm_maxlength)
+	{
+		context->adpcm_maxlength = out_size + 1024;
+		context->adpcm_buffer = realloc(context->adpcm_buffer, context->adpcm_maxlength);
+	}
+	dst = context->adpcm_buffer;
+
+	if (context->adpcm.ms.delta[0] < 16)
+		context->adpcm.ms.delta[0] = 16;
+	if (context->adpcm.ms.delta[1] < 16)
+		context->adpcm.ms.delta[1] = 16;
+
+	while (size > 0)
+	{
+		if ((dst - context->adpcm_buffer) % block_size == 0)
+		{
+			if (channels > 1)
+			{
+				*dst++ = context->adpcm.ms.predictor[0];
+				*dst++ = context->adpcm.ms.predictor[1];
+				*dst++ = (BYTE) (context->adpcm.ms.delta[0] & 0xff);
+				*dst++ = (BYTE) ((context->adpcm.ms.delta[0] >> 8) & 0xff);
+				*dst++ = (BYTE) (context->adpcm.ms.delta[1] & 0xff);
+				*dst++ = (BYTE) ((context->adpcm.ms.delta[1] >> 8) & 0xff);
+				context->adpcm.ms.sample1[0] = *((INT16*) (src + 4));
+				context->adpcm.ms.sample1[1] = *((INT16*) (src + 6));
+				context->adpcm.ms.sample2[0] = *((INT16*) (src + 0));
+				context->adpcm.ms.sample2[1] = *((INT16*) (src + 2));
+				*((INT16*) (dst + 0)) = (INT16) context->adpcm.ms.sample1[0];
+				*((INT16*) (dst + 2)) = (INT16) context->adpcm.ms.sample1[1];
+				*((INT16*) (dst + 4)) = (INT16) context->adpcm.ms.sample2[0];
+				*((INT16*) (dst + 6)) = (INT16) context->adpcm.ms.sample2[1];
+				dst += 8;
+				src += 8;
+				size -= 8;
+			}
+			else
+			{
+				*dst++ = context->adpcm.ms.predictor[0];
+				*dst++ = (BYTE) (context->adpcm.ms.delta[0] & 0xff);
+				*dst++ = (BYTE) ((context->adpcm.ms.delta[0] >> 8) & 0xff);
+				context->adpcm.ms.sample1[0] = *((INT16*) (src + 2));
+				context->adpcm.ms.sample2[0] = *((INT16*) (src + 0));
+				*((INT16*) (dst + 0)) = (INT16) context->adpcm.ms.sample1[0];
+				*((INT16*) (dst + 2)) = (INT16) context->adpcm.ms.sample2[0];
+				dst += 4;
+				src += 4;
+				size -= 4;
+			}
+		}
+
+		sample = *((INT16*) src);
+		src += 2;
+		*dst = ref_encode_ms_adpcm_sample(&context->adpcm, sample, 0) << 4;
+		sample = *((INT16*) src);
+		src += 2;
+		*dst += ref_encode_ms_adpcm_sample(&context->adpcm, sample, channels > 1 ? 1 : 0);
+		dst++;
+		size -= 4;
+	}
+
+	context->adpcm_size = dst - context->adpcm_buffer;
+}
+
+typedef void (*pAdpcmCoder)(FREERDP_DSP_CONTEXT* context,
+	const BYTE* src, int size, int channels, int block_size);
+
+typedef struct
+{
+	const char* name;
+	int ms;
+	int channels;
+	int block_size;
+} testFormat;
+
+static const testFormat test_formats[] =
+{
+	{ "IMA ADPCM stereo 2048", 0, 2, 2048 },
+	{ "IMA ADPCM mono 1024", 0, 1, 1024 },
+	{ "IMA ADPCM stereo 512", 0, 2, 512 },
+	{ "MS ADPCM stereo 2048", 1, 2, 2048 },
+	{ "MS ADPCM mono 1024", 1, 1, 1024 },
+	{ "MS ADPCM stereo 256", 1, 2, 256 }
+};
+
+/* a fixed generator, so every platform runs the same data */
+static UINT32 test_random(UINT32* seed)
+{
+	*seed = (*seed * 1103515245) + 12345;
+	return (*seed >> 16) & 0x7FFF;
+}
+
+static INT16* test_signal(int frames, int channels)
+{
+	int i, c;
+	double x;
+	INT16* samples;
+	UINT32 seed = 11;
+
+	samples = (INT16*) malloc(frames * channels * sizeof(INT16));
+
+	for (i = 0; i < frames; i++)
+	{
+		for (c = 0; c < channels; c++)
+		{
+			/* 50 ms of full scale square wave every half second */
+			if ((i % (TEST_RATE / 2)) < (TEST_RATE / 20))
+			{
+				samples[i * channels + c] = ((i / (20 + c)) & 1) ? 32767 : -32768;
+				continue;
+			}
+
+			x = 12000 * sin(2 * M_PI * (440 + c * 110) * i / TEST_RATE) +
+				6000 * sin(2 * M_PI * 3000 * i / TEST_RATE) +
+				((double) test_random(&seed) - 16384) / 8;
+
+			samples[i * channels + c] = (INT16) x;
+		}
+	}
+
+	return samples;
+}
+
+static int test_frames_per_block(const testFormat* format)
+{
+	if (format->ms)
+		return (format->block_size - 7 * format->channels) * 2 / format->channels + 2;
+
+	return (format->block_size - 4 * format->channels) * 2 / format->channels;
+}
+
+/**
+ * Packet sizes in frames: whole blocks, and whole blocks with a partial
+ * one, as the server sends them.
+ */
+static int test_packet_frames(const testFormat* format, int packet)
+{
+	static const int blocks[] = { 1, 4, 2, 3 };
+	static const int partial[] = { 0, 0, 16, 40 };
+
+	return blocks[packet % 4] * test_frames_per_block(format) + partial[packet % 4];
+}
+
+static int test_format(const testFormat* format)
+{
+	int status;
+	int frames;
+	int packet;
+	int offset;
+	int encoded;
+	int decoded;
+	int reference_size;
+	int packet_frames;
+	INT16* signal;
+	BYTE* stream;
+	BYTE* reference_stream;
+	INT16* output;
+	INT16* reference_output;
+	int* packet_sizes;
+	double noise, power, x;
+	int i;
+	FREERDP_DSP_CONTEXT* context;
+	FREERDP_DSP_CONTEXT* reference;
+	pAdpcmCoder encode, encode_reference;
+	pAdpcmCoder decode, decode_reference;
+
+	frames = TEST_RATE * TEST_SECONDS;
+	signal = test_signal(frames, format->channels);
+
+	context = freerdp_dsp_context_new();
+	reference = freerdp_dsp_context_new();
+
+	if (format->ms)
+	{
+		encode = context->encode_ms_adpcm;
+		decode = context->decode_ms_adpcm;
+		encode_reference = ref_encode_ms_adpcm;
+		decode_reference = ref_decode_ms_adpcm;
+	}
+	else
+	{
+		encode = context->encode_ima_adpcm;
+		decode = context->decode_ima_adpcm;
+		encode_reference = ref_encode_ima_adpcm;
+		decode_reference = ref_decode_ima_adpcm;
+	}
+
+	stream = (BYTE*) malloc(frames * format->channels * 2);
+	reference_stream = (BYTE*) malloc(frames * format->channels * 2);
+	packet_sizes = (int*) malloc(frames * sizeof(int));
+
+	status = 0;
+	encoded = 0;
+	reference_size = 0;
+	offset = 0;
+
+	for (packet = 0; ; packet++)
+	{
+		packet_frames = test_packet_frames(format, packet);
+
+		if (offset + packet_frames > frames)
+			break;
+
+		encode(context, (BYTE*) &signal[offset * format->channels],
+			packet_frames * format->channels * 2, format->channels, format->block_size);
+		encode_reference(reference, (BYTE*) &signal[offset * format->channels],
+			packet_frames * format->channels * 2, format->channels, format->block_size);
+
+		CopyMemory(&stream[encoded], context->adpcm_buffer, context->adpcm_size);
+		CopyMemory(&reference_stream[reference_size], reference->adpcm_buffer, reference->adpcm_size);
+
+		packet_sizes[packet] = context->adpcm_size;
+		encoded += context->adpcm_size;
+		reference_size += reference->adpcm_size;
+		offset += packet_frames;
+	}
+
+	if ((encoded != reference_size) || (memcmp(stream, reference_stream, encoded) != 0))
+	{
+		printf("%s: encoded stream differs from the reference, %d bytes, %d expected\n",
+			format->name, encoded, reference_size);
+		status = -1;
+	}
+
+	/* decode the packets with whole blocks */
+	output = (INT16*) malloc(frames * format->channels * sizeof(INT16));
+	reference_output = (INT16*) malloc(frames * format->channels * sizeof(INT16));
+
+	freerdp_dsp_context_reset_adpcm(context);
+	freerdp_dsp_context_reset_adpcm(reference);
+
+	decoded = 0;
+	offset = 0;
+	encoded = 0;
+	noise = power = 0;
+
+	for (i = 0; i < packet; i++)
+	{
+		packet_frames = test_packet_frames(format, i);
+
+		if ((packet_sizes[i] % format->block_size) == 0)
+		{
+			decode(context, &stream[encoded], packet_sizes[i], format->channels, format->block_size);
+			decode_reference(reference, &stream[encoded], packet_sizes[i], format->channels, format->block_size);
+
+			if ((context->adpcm_size != reference->adpcm_size) ||
+				(context->adpcm_size != packet_frames * format->channels * 2) ||
+				(memcmp(context->adpcm_buffer, reference->adpcm_buffer, context->adpcm_size) != 0))
+			{
+				printf("%s: decoded packet %d differs from the reference\n", format->name, i);
+				status = -1;
+				break;
+			}
+
+			CopyMemory(&output[decoded * format->channels], context->adpcm_buffer, context->adpcm_size);
+
+			for (offset = 0; offset < packet_frames * format->channels; offset++)
+			{
+				/* the full scale bursts are beyond what ADPCM can follow */
+				if (((decoded + offset / format->channels) % (TEST_RATE / 2)) < (TEST_RATE / 10))
+					continue;
+
+				x = signal[decoded * format->channels + offset];
+				power += x * x;
+				x -= output[decoded * format->channels + offset];
+				noise += x * x;
+			}
+
+			decoded += packet_frames;
+		}
+		else
+		{
+			decoded += packet_frames;
+		}
+
+		encoded += packet_sizes[i];
+	}
+
+	printf("%-24s %7d bytes, round trip SNR %.1f dB\n", format->name, reference_size,
+		10 * log10(power / MAX(noise, 1)));
+
+	if (10 * log10(power / MAX(noise, 1)) < 15)
+	{
+		printf("%s: round trip is too noisy\n", format->name);
+		status = -1;
+	}
+
+	free(reference_output);
+	free(output);
+	free(packet_sizes);
+	free(reference_stream);
+	free(stream);
+	freerdp_dsp_context_free(reference);
+	freerdp_dsp_context_free(context);
+	free(signal);
+
+	return status;
+}
+
+/* the best of TEST_RUNS runs, as a single one is short enough to be noisy */
+static double test_time_coder(pAdpcmCoder coder, FREERDP_DSP_CONTEXT* context,
+	const BYTE* src, int size, int packet_size, int channels, int block_size)
+{
+	int i;
+	int run;
+	double seconds;
+	double best = 0;
+	STOPWATCH* stopwatch;
+
+	stopwatch = stopwatch_create();
+
+	for (run = 0; run < TEST_RUNS; run++)
+	{
+		stopwatch_reset(stopwatch);
+		stopwatch_start(stopwatch);
+
+		for (i = 0; i + packet_size <= size; i += packet_size)
+			coder(context, &src[i], packet_size, channels, block_size);
+
+		stopwatch_stop(stopwatch);
+		seconds = stopwatch_get_elapsed_time_in_seconds(stopwatch);
+
+		if ((run == 0) || (seconds < best))
+			best = seconds;
+	}
+
+	stopwatch_free(stopwatch);
+
+	return best;
+}
+
+static void test_benchmark(const testFormat* format)
+{
+	int size;
+	int packet_size;
+	INT16* signal;
+	double fast, slow;
+	FREERDP_DSP_CONTEXT* context;
+
+	signal = test_signal(TEST_RATE * TEST_SECONDS, format->channels);
+	size = TEST_RATE * TEST_SECONDS * format->channels * 2;
+	packet_size = test_frames_per_block(format) * 4 * format->channels * 2;
+
+	context = freerdp_dsp_context_new();
+
+	if (format->ms)
+	{
+		fast = test_time_coder(context->encode_ms_adpcm, context, (BYTE*) signal, size, packet_size,
+			format->channels, format->block_size);
+		slow = test_time_coder(ref_encode_ms_adpcm, context, (BYTE*) signal, size, packet_size,
+			format->channels, format->block_size);
+	}
+	else
+	{
+		fast = test_time_coder(context->encode_ima_adpcm, context, (BYTE*) signal, size, packet_size,
+			format->channels, format->block_size);
+		slow = test_time_coder(ref_encode_ima_adpcm, context, (BYTE*) signal, size, packet_size,
+			format->channels, format->block_size);
+	}
+
+	printf("%-24s encode %d s: %.2f ms, per sample reference %.2f ms (best of %d)\n", format->name,
+		TEST_SECONDS, fast * 1000, slow * 1000, TEST_RUNS);
+
+	freerdp_dsp_context_free(context);
+	free(signal);
+}
+
+int TestDspAdpcm(int argc, char* argv[])
+{
+	int i;
+	int status = 0;
+
+	for (i = 0; i < (int) (sizeof(test_formats) / sizeof(test_formats[0])); i++)
+	{
+		if (test_format(&test_formats[i]) < 0)
+			status = -1;
+	}
+
+	for (i = 0; i < (int) (sizeof(test_formats) / sizeof(test_formats[0])); i++)
+		test_benchmark(&test_formats[i]);
+
+	return status;
+}
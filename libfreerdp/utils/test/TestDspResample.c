@@ -0,0 +1,394 @@
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <winpr/crt.h>
+
+#include <freerdp/utils/dsp.h>
+#include <freerdp/utils/stopwatch.h>
+
+#include "resample.h"
+
+/**
+ * Feeds sine tones through the 16-bit resampler and measures the output
+ * by projecting it on the expected tone, which is independent of the
+ * filter delay. The polyphase mode has to keep the tones in its passband
+ * at unity gain and low distortion, and reject what would alias when
+ * decimating. The stream state has to make chunked input bit exact with
+ * the same input in one piece, and the SIMD kernels bit exact with the
+ * generic ones.
+ */
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define TEST_AMPLITUDE		16000.0
+#define TEST_SECONDS_BENCH	10
+
+/* a fixed generator, so every platform runs the same data */
+static UINT32 test_random(UINT32* seed)
+{
+	*seed = (*seed * 1103515245) + 12345;
+	return (*seed >> 16) & 0x7FFF;
+}
+
+static INT16* test_tone(double freq, UINT32 rate, int frames, int channels)
+{
+	int i, c;
+	INT16* samples;
+
+	samples = (INT16*) malloc(frames * channels * sizeof(INT16));
+
+	for (i = 0; i < frames; i++)
+	{
+		for (c = 0; c < channels; c++)
+			samples[i * channels + c] = (INT16) floor(TEST_AMPLITUDE * sin(2 * M_PI * freq * i / rate) + 0.5);
+	}
+
+	return samples;
+}
+
+/**
+ * Amplitude of the tone in one channel of the output and the ratio of the
+ * tone power to the power of everything else, in dB. The first and last
+ * 10 ms are left out, they hold the filter start up.
+ */
+static void test_measure(const INT16* samples, int frames, int channels, int channel,
+	double freq, UINT32 rate, double* amplitude, double* snr)
+{
+	int i;
+	int start, end;
+	double x, s, c;
+	double a, b, det;
+	double ss, sc, cc, xs, xc;
+	double fit, noise, signal;
+
+	start = rate / 100;
+	end = frames - rate / 100;
+
+	/* least squares fit of a sin + b cos */
+	ss = sc = cc = xs = xc = 0;
+
+	for (i = start; i < end; i++)
+	{
+		x = samples[i * channels + channel];
+		s = sin(2 * M_PI * freq * i / rate);
+		c = cos(2 * M_PI * freq * i / rate);
+		ss += s * s;
+		sc += s * c;
+		cc += c * c;
+		xs += x * s;
+		xc += x * c;
+	}
+
+	det = ss * cc - sc * sc;
+	a = (xs * cc - xc * sc) / det;
+	b = (xc * ss - xs * sc) / det;
+
+	signal = noise = 0;
+
+	for (i = start; i < end; i++)
+	{
+		fit = a * sin(2 * M_PI * freq * i / rate) + b * cos(2 * M_PI * freq * i / rate);
+		x = samples[i * channels + channel] - fit;
+		signal += fit * fit;
+		noise += x * x;
+	}
+
+	*amplitude = sqrt(a * a + b * b);
+	*snr = 10 * log10(signal / MAX(noise, 1e-9));
+}
+
+static double test_tone_gain(int mode, double freq, UINT32 srate, UINT32 rrate, double* snr)
+{
+	int frames;
+	INT16* tone;
+	double amplitude;
+	FREERDP_DSP_CONTEXT* context;
+
+	frames = srate / 2;
+	tone = test_tone(freq, srate, frames, 2);
+
+	context = freerdp_dsp_context_new();
+	freerdp_dsp_context_set_resample_mode(context, mode);
+	context->resample(context, (BYTE*) tone, 2, 2, srate, frames, 2, rrate);
+
+	test_measure((INT16*) context->resampled_buffer, context->resampled_frames, 2, 1,
+		freq, rrate, &amplitude, snr);
+
+	freerdp_dsp_context_free(context);
+	free(tone);
+
+	return 20 * log10(amplitude / TEST_AMPLITUDE);
+}
+
+/* level of a tone above the output Nyquist frequency, at its alias */
+static double test_alias_level(int mode, double freq, UINT32 srate, UINT32 rrate)
+{
+	int frames;
+	INT16* tone;
+	double snr;
+	double amplitude;
+	FREERDP_DSP_CONTEXT* context;
+
+	frames = srate / 2;
+	tone = test_tone(freq, srate, frames, 1);
+
+	context = freerdp_dsp_context_new();
+	freerdp_dsp_context_set_resample_mode(context, mode);
+	context->resample(context, (BYTE*) tone, 2, 1, srate, frames, 1, rrate);
+
+	test_measure((INT16*) context->resampled_buffer, context->resampled_frames, 1, 0,
+		rrate - freq, rrate, &amplitude, &snr);
+
+	freerdp_dsp_context_free(context);
+	free(tone);
+
+	return 20 * log10(MAX(amplitude, 1e-3) / TEST_AMPLITUDE);
+}
+
+static int test_chunked(int mode, UINT32 srate, UINT32 rrate)
+{
+	int i;
+	int frames;
+	int chunk;
+	int length;
+	int status;
+	INT16* input;
+	INT16* chunked;
+	UINT32 seed = 7;
+	FREERDP_DSP_CONTEXT* whole;
+	FREERDP_DSP_CONTEXT* context;
+
+	frames = srate;
+	input = (INT16*) malloc(frames * 2 * sizeof(INT16));
+
+	for (i = 0; i < frames * 2; i++)
+		input[i] = (INT16) (test_random(&seed) * 2 - 32768);
+
+	whole = freerdp_dsp_context_new();
+	freerdp_dsp_context_set_resample_mode(whole, mode);
+	whole->resample(whole, (BYTE*) input, 2, 2, srate, frames, 2, rrate);
+
+	context = freerdp_dsp_context_new();
+	freerdp_dsp_context_set_resample_mode(context, mode);
+
+	chunked = (INT16*) malloc(whole->resampled_size + 1024);
+	length = 0;
+
+	for (i = 0; i < frames; i += chunk)
+	{
+		chunk = MIN((int) (1 + test_random(&seed) % 1500), frames - i);
+		context->resample(context, (BYTE*) &input[i * 2], 2, 2, srate, chunk, 2, rrate);
+
+		if (length + context->resampled_frames > whole->resampled_frames)
+			break;
+
+		CopyMemory(&chunked[length * 2], context->resampled_buffer, context->resampled_size);
+		length += context->resampled_frames;
+	}
+
+	status = 0;
+
+	if ((length != (int) whole->resampled_frames) ||
+		(memcmp(chunked, whole->resampled_buffer, whole->resampled_size) != 0))
+	{
+		printf("%u -> %u mode %d: chunked output differs, %d frames, %u expected\n",
+			srate, rrate, mode, length, whole->resampled_frames);
+		status = -1;
+	}
+
+	freerdp_dsp_context_free(context);
+	freerdp_dsp_context_free(whole);
+	free(chunked);
+	free(input);
+
+	return status;
+}
+
+static int test_kernels(void)
+{
+	int i;
+	int taps;
+	int count;
+	int status;
+	INT16* src;
+	INT16* bank;
+	UINT32* offsets;
+	UINT16* phases;
+	UINT16* fractions;
+	INT16 generic[1000];
+	INT16 optimized[1000];
+	UINT32 seed = 3;
+	const DSP_RESAMPLE_KERNELS* reference;
+	const DSP_RESAMPLE_KERNELS* kernels;
+
+	reference = freerdp_dsp_resample_kernels_generic();
+	kernels = freerdp_dsp_resample_kernels_get();
+
+	printf("resample kernels: %s\n", kernels->name);
+
+	count = 999;
+	taps = RESAMPLE_MAX_TAPS;
+
+	src = (INT16*) malloc((count + taps) * sizeof(INT16));
+	bank = (INT16*) malloc(16 * taps * sizeof(INT16));
+	offsets = (UINT32*) malloc(count * sizeof(UINT32));
+	phases = (UINT16*) malloc(count * sizeof(UINT16));
+	fractions = (UINT16*) malloc(count * sizeof(UINT16));
+
+	/* full scale against taps up to 1/32, so the sums overflow INT16 and are
+	 * clamped while the INT32 accumulators cannot overflow */
+	for (i = 0; i < count + taps; i++)
+		src[i] = (i & 1) ? 32767 : (INT16) (test_random(&seed) * 2 - 32768);
+
+	for (i = 0; i < 16 * taps; i++)
+		bank[i] = (INT16) ((test_random(&seed) % 2047) - 1023);
+
+	for (i = 0; i < count; i++)
+	{
+		offsets[i] = i;
+		phases[i] = test_random(&seed) % 16;
+		fractions[i] = test_random(&seed) % (RESAMPLE_LINEAR_ONE + 1);
+	}
+
+	status = 0;
+
+	for (taps = 8; taps <= RESAMPLE_MAX_TAPS; taps += 4)
+	{
+		reference->fir(generic, 1, src, bank, taps, offsets, phases, count);
+		kernels->fir(optimized, 1, src, bank, taps, offsets, phases, count);
+
+		if (memcmp(generic, optimized, count * sizeof(INT16)) != 0)
+		{
+			printf("%s fir kernel differs from generic with %d taps\n", kernels->name, taps);
+			status = -1;
+		}
+	}
+
+	/* interleaved outputs, and a count that leaves a tail */
+	ZeroMemory(generic, sizeof(generic));
+	ZeroMemory(optimized, sizeof(optimized));
+
+	reference->linear(generic, 2, src, offsets, fractions, count / 2);
+	kernels->linear(optimized, 2, src, offsets, fractions, count / 2);
+
+	if (memcmp(generic, optimized, sizeof(generic)) != 0)
+	{
+		printf("%s linear kernel differs from generic\n", kernels->name);
+		status = -1;
+	}
+
+	free(fractions);
+	free(phases);
+	free(offsets);
+	free(bank);
+	free(src);
+
+	return status;
+}
+
+static void test_benchmark(int mode, const char* name, UINT32 srate, UINT32 rrate)
+{
+	int i;
+	int frames;
+	int chunk;
+	INT16* tone;
+	double seconds;
+	STOPWATCH* stopwatch;
+	FREERDP_DSP_CONTEXT* context;
+
+	frames = srate * TEST_SECONDS_BENCH;
+	chunk = srate / 50;
+	tone = test_tone(1000, srate, frames, 2);
+
+	context = freerdp_dsp_context_new();
+	freerdp_dsp_context_set_resample_mode(context, mode);
+
+	stopwatch = stopwatch_create();
+	stopwatch_start(stopwatch);
+
+	for (i = 0; i + chunk <= frames; i += chunk)
+		context->resample(context, (BYTE*) &tone[i * 2], 2, 2, srate, chunk, 2, rrate);
+
+	stopwatch_stop(stopwatch);
+	seconds = stopwatch_get_elapsed_time_in_seconds(stopwatch);
+
+	printf("%-10s %u -> %u stereo: %d s of audio in %.3f s (%.0fx real time)\n", name, srate, rrate,
+		TEST_SECONDS_BENCH, seconds, (seconds > 0) ? (TEST_SECONDS_BENCH / seconds) : 0);
+
+	stopwatch_free(stopwatch);
+	freerdp_dsp_context_free(context);
+	free(tone);
+}
+
+int TestDspResample(int argc, char* argv[])
+{
+	int i;
+	double snr;
+	double gain;
+	double alias;
+	double linear_alias;
+	int status = 0;
+	static const double passband[] = { 100, 1000, 4000, 7000 };
+
+	gain = test_tone_gain(FREERDP_DSP_RESAMPLE_POLYPHASE, 1000, 44100, 48000, &snr);
+	printf("polyphase 44100 -> 48000, 1 kHz: gain %.3f dB, SNR %.1f dB\n", gain, snr);
+
+	if ((fabs(gain) > 0.1) || (snr < 80))
+	{
+		printf("polyphase upsampling is not transparent\n");
+		status = -1;
+	}
+
+	gain = test_tone_gain(FREERDP_DSP_RESAMPLE_LINEAR, 1000, 44100, 48000, &snr);
+	printf("linear    44100 -> 48000, 1 kHz: gain %.3f dB, SNR %.1f dB\n", gain, snr);
+
+	if ((fabs(gain) > 0.5) || (snr < 30))
+	{
+		printf("linear upsampling is off\n");
+		status = -1;
+	}
+
+	for (i = 0; i < (int) (sizeof(passband) / sizeof(passband[0])); i++)
+	{
+		gain = test_tone_gain(FREERDP_DSP_RESAMPLE_POLYPHASE, passband[i], 48000, 22050, &snr);
+		printf("polyphase 48000 -> 22050, %.0f Hz: gain %.3f dB, SNR %.1f dB\n", passband[i], gain, snr);
+
+		if ((fabs(gain) > 0.5) || (snr < 60))
+		{
+			printf("polyphase passband is not flat at %.0f Hz\n", passband[i]);
+			status = -1;
+		}
+	}
+
+	alias = test_alias_level(FREERDP_DSP_RESAMPLE_POLYPHASE, 15000, 48000, 22050);
+	linear_alias = test_alias_level(FREERDP_DSP_RESAMPLE_LINEAR, 15000, 48000, 22050);
+	printf("48000 -> 22050, 15 kHz alias: polyphase %.1f dB, linear %.1f dB\n", alias, linear_alias);
+
+	if (alias > -60)
+	{
+		printf("polyphase decimation aliases\n");
+		status = -1;
+	}
+
+	if (test_chunked(FREERDP_DSP_RESAMPLE_POLYPHASE, 44100, 48000) < 0)
+		status = -1;
+	if (test_chunked(FREERDP_DSP_RESAMPLE_POLYPHASE, 48000, 22050) < 0)
+		status = -1;
+	if (test_chunked(FREERDP_DSP_RESAMPLE_LINEAR, 22050, 44100) < 0)
+		status = -1;
+	if (test_chunked(FREERDP_DSP_RESAMPLE_LINEAR, 48000, 8000) < 0)
+		status = -1;
+
+	if (test_kernels() < 0)
+		status = -1;
+
+	test_benchmark(FREERDP_DSP_RESAMPLE_POLYPHASE, "polyphase", 44100, 48000);
+	test_benchmark(FREERDP_DSP_RESAMPLE_POLYPHASE, "polyphase", 48000, 22050);
+	test_benchmark(FREERDP_DSP_RESAMPLE_LINEAR, "linear", 44100, 48000);
+
+	return status;
+}
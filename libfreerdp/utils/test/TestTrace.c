@@ -0,0 +1,313 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/interlocked.h>
+
+#include <freerdp/utils/trace.h>
+#include <freerdp/utils/worker.h>
+#include <freerdp/utils/stopwatch.h>
+
+/**
+ * Checks the precision of the latency histograms, that trace points record
+ * nothing while tracing is off and everything on the threads of a worker
+ * pool once it is on, and that slow events can be found afterwards.
+ *
+ * Threads beyond TRACE_MAX_THREADS at once have to be counted as dropped,
+ * and the buffers of threads gone have to be reused by new ones.
+ *
+ * Also times a trace point with tracing off against the bare loop it sits
+ * in, which is what every build pays for the trace points.
+ */
+
+#define TEST_ITERATIONS		10000000
+#define TEST_THREADS		3
+#define TEST_ITEMS		3000
+
+static volatile UINT32 test_counter;
+
+static int test_histogram(void)
+{
+	UINT64 i;
+	UINT64 value;
+	UINT64 expected;
+	int status = 0;
+	TRACE_HISTOGRAM histogram;
+
+	trace_histogram_reset(&histogram);
+
+	for (i = 1; i <= 100000; i++)
+		trace_histogram_record(&histogram, i);
+
+	if ((histogram.count != 100000) || (histogram.min != 1) || (histogram.max != 100000))
+	{
+		printf("histogram counts %d values from %d to %d\n",
+			(int) histogram.count, (int) histogram.min, (int) histogram.max);
+		status = -1;
+	}
+
+	for (i = 1; i <= 1000; i *= 10)
+	{
+		expected = 100000 - (100000 / (i * 2));
+		value = trace_histogram_get_percentile(&histogram, 100.0 - (100.0 / (i * 2)));
+
+		if ((value < expected) || (value > expected + (expected / 8)))
+		{
+			printf("percentile of %d is %d\n", (int) expected, (int) value);
+			status = -1;
+		}
+	}
+
+	/* every value falls in a bucket at most an eighth wider than itself */
+	for (value = 1; value < ((UINT64) 1 << 40); value = (value * 3) / 2 + 1)
+	{
+		trace_histogram_reset(&histogram);
+		trace_histogram_record(&histogram, value);
+		trace_histogram_record(&histogram, (UINT64) 1 << 62);
+
+		expected = trace_histogram_get_percentile(&histogram, 50);
+
+		if ((expected < value) || (expected > value + (value / 8)))
+		{
+			printf("%llu is read back as %llu\n", (unsigned long long) value, (unsigned long long) expected);
+			status = -1;
+			break;
+		}
+	}
+
+	return status;
+}
+
+static void test_trace_item(void* context, int index)
+{
+	UINT64 trace;
+
+	TRACE_BEGIN(trace);
+	test_counter++;
+	TRACE_END(TRACE_CODEC_DECODE, trace);
+}
+
+static int test_threads(void)
+{
+	int status = 0;
+	WORKER_POOL* pool;
+	TRACE_HISTOGRAM histogram;
+
+	trace_set_enabled(TRUE);
+	trace_reset();
+
+	pool = worker_pool_new(TEST_THREADS);
+	worker_pool_run(pool, TEST_ITEMS, test_trace_item, NULL);
+	worker_pool_free(pool);
+
+	trace_get_histogram(TRACE_CODEC_DECODE, &histogram);
+
+	if (histogram.count != TEST_ITEMS)
+	{
+		printf("%d of %d trace points are recorded\n", (int) histogram.count, TEST_ITEMS);
+		status = -1;
+	}
+
+	trace_set_enabled(FALSE);
+
+	return status;
+}
+
+#ifndef _WIN32
+
+static volatile LONG test_started;
+static LONG test_none = 0;
+
+/* records a trace point, then waits for all threads of the batch to do the same */
+static void* test_trace_thread(void* arg)
+{
+	LONG count = *((LONG*) arg);
+
+	trace_record(TRACE_ENCODE, trace_get_time());
+	InterlockedIncrement(&test_started);
+
+	while (test_started < count)
+		Sleep(1);
+
+	return NULL;
+}
+
+static void test_run_threads(LONG count, BOOL together)
+{
+	int i;
+	pthread_t* threads;
+
+	threads = (pthread_t*) malloc(sizeof(pthread_t) * count);
+	test_started = 0;
+
+	for (i = 0; i < count; i++)
+	{
+		pthread_create(&threads[i], NULL, test_trace_thread, (together) ? &count : &test_none);
+
+		if (!together)
+			pthread_join(threads[i], NULL);
+	}
+
+	if (together)
+	{
+		for (i = 0; i < count; i++)
+			pthread_join(threads[i], NULL);
+	}
+
+	free(threads);
+}
+
+static int test_thread_limit(void)
+{
+	int dropped;
+	int status = 0;
+	TRACE_HISTOGRAM histogram;
+
+	trace_set_enabled(TRUE);
+	trace_reset();
+
+	test_run_threads(TRACE_MAX_THREADS + 4, TRUE);
+
+	trace_get_histogram(TRACE_ENCODE, &histogram);
+	dropped = trace_get_dropped_threads();
+
+	if ((dropped < 4) || (histogram.count + dropped != TRACE_MAX_THREADS + 4))
+	{
+		printf("%d of %d threads are traced at once, %d are dropped\n",
+			(int) histogram.count, TRACE_MAX_THREADS + 4, dropped);
+		status = -1;
+	}
+
+	trace_reset();
+
+	/* one after the other, each finds the buffer of the previous one free */
+	test_run_threads(TRACE_MAX_THREADS * 2, FALSE);
+
+	trace_get_histogram(TRACE_ENCODE, &histogram);
+	dropped = trace_get_dropped_threads();
+
+	if ((histogram.count != TRACE_MAX_THREADS * 2) || (dropped != 0))
+	{
+		printf("%d of %d threads run one after the other are traced, %d are dropped\n",
+			(int) histogram.count, TRACE_MAX_THREADS * 2, dropped);
+		status = -1;
+	}
+
+	trace_set_enabled(FALSE);
+
+	return status;
+}
+
+#endif
+
+static int test_events(void)
+{
+	int count;
+	int status = 0;
+	TRACE_EVENT events[4];
+
+	trace_set_enabled(TRUE);
+	trace_reset();
+
+	trace_record(TRACE_GDI_BLIT, trace_get_time());
+	trace_record(TRACE_SEND, trace_get_time() - 5000000);
+	trace_record(TRACE_GDI_BLIT, trace_get_time());
+
+	count = trace_get_events(events, 4, 1000000);
+
+	if ((count != 1) || (events[0].point != TRACE_SEND) || (events[0].duration < 5000000))
+	{
+		printf("%d slow events are found\n", count);
+		status = -1;
+	}
+
+	trace_set_enabled(FALSE);
+
+	return status;
+}
+
+static double test_loop(BOOL traced)
+{
+	int i;
+	UINT64 trace;
+	double elapsed;
+	STOPWATCH* stopwatch;
+
+	stopwatch = stopwatch_create();
+	stopwatch_start(stopwatch);
+
+	if (traced)
+	{
+		for (i = 0; i < TEST_ITERATIONS; i++)
+		{
+			TRACE_BEGIN(trace);
+			test_counter++;
+			TRACE_END(TRACE_GDI_BLIT, trace);
+		}
+	}
+	else
+	{
+		for (i = 0; i < TEST_ITERATIONS; i++)
+			test_counter++;
+	}
+
+	stopwatch_stop(stopwatch);
+	elapsed = stopwatch_get_elapsed_time_in_seconds(stopwatch);
+	stopwatch_free(stopwatch);
+
+	return elapsed;
+}
+
+static int test_disabled_overhead(void)
+{
+	double bare;
+	double disabled;
+	double enabled;
+	int status = 0;
+	TRACE_HISTOGRAM histogram;
+
+	trace_set_enabled(FALSE);
+	trace_reset();
+
+	bare = test_loop(FALSE);
+	disabled = test_loop(TRUE);
+
+	trace_get_histogram(TRACE_GDI_BLIT, &histogram);
+
+	if (histogram.count != 0)
+	{
+		printf("trace points record while tracing is off\n");
+		status = -1;
+	}
+
+	trace_set_enabled(TRUE);
+	enabled = test_loop(TRUE);
+	trace_set_enabled(FALSE);
+
+	printf("trace point overhead: %.2f ns off, %.2f ns on\n",
+		((disabled - bare) * 1000000000) / TEST_ITERATIONS,
+		((enabled - bare) * 1000000000) / TEST_ITERATIONS);
+
+	return status;
+}
+
+int TestTrace(int argc, char* argv[])
+{
+	int status = 0;
+
+	status |= test_histogram();
+	status |= test_threads();
+	status |= test_events();
+#ifndef _WIN32
+	status |= test_thread_limit();
+#endif
+	status |= test_disabled_overhead();
+
+	return status;
+}
@@ -0,0 +1,464 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Trace Points and Latency Histograms
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/thread.h>
+#include <winpr/windows.h>
+#include <winpr/interlocked.h>
+
+#ifndef _WIN32
+#include <time.h>
+#include <pthread.h>
+#endif
+
+#include <freerdp/utils/trace.h>
+
+/**
+ * The trace points and events of one thread, written by that thread only.
+ * Once the thread exits the buffer is handed to the next new thread, which
+ * adds to what is there.
+ */
+struct _TRACE_BUFFER
+{
+	UINT32 thread;
+	volatile LONG in_use;
+	UINT32 next_event;
+	TRACE_EVENT events[TRACE_BUFFER_EVENTS];
+	TRACE_HISTOGRAM histograms[TRACE_POINT_COUNT];
+};
+typedef struct _TRACE_BUFFER TRACE_BUFFER;
+
+static const char* const TRACE_POINT_NAMES[TRACE_POINT_COUNT] =
+{
+	"transport read",
+	"decompress",
+	"order decode",
+	"codec decode",
+	"gdi blit",
+	"encode",
+	"compress",
+	"send"
+};
+
+volatile BOOL g_trace_enabled = FALSE;
+
+#ifdef _WIN32
+static DWORD g_trace_tls;
+#else
+static pthread_key_t g_trace_tls;
+#endif
+
+static volatile LONG g_trace_initialized = 0;
+
+/* buffers are never freed, so that those of threads gone are still read */
+static LONG g_trace_buffer_count = 0;
+static TRACE_BUFFER* g_trace_buffers[TRACE_MAX_THREADS];
+
+/* the threads that found all buffers taken, marked with the dummy buffer */
+static LONG g_trace_dropped_threads = 0;
+static TRACE_BUFFER g_trace_dropped;
+
+UINT64 trace_get_time(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER counter;
+	static LARGE_INTEGER frequency;
+
+	if (frequency.QuadPart == 0)
+		QueryPerformanceFrequency(&frequency);
+
+	QueryPerformanceCounter(&counter);
+
+	return ((counter.QuadPart / frequency.QuadPart) * 1000000000) +
+		(((counter.QuadPart % frequency.QuadPart) * 1000000000) / frequency.QuadPart);
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ((UINT64) ts.tv_sec * 1000000000) + ts.tv_nsec;
+#endif
+}
+
+static int trace_histogram_get_index(UINT64 value)
+{
+	int msb = 0;
+
+	if (value < 2 * TRACE_HISTOGRAM_SUB_BUCKETS)
+		return (int) value;
+
+	while ((value >> msb) > 1)
+		msb++;
+
+	/* the 3 bits below the highest one pick one of 8 buckets in its power of two */
+	return 2 * TRACE_HISTOGRAM_SUB_BUCKETS + (msb - 4) * TRACE_HISTOGRAM_SUB_BUCKETS +
+		(int) ((value >> (msb - 3)) & (TRACE_HISTOGRAM_SUB_BUCKETS - 1));
+}
+
+/* the highest value counted in a bucket */
+static UINT64 trace_histogram_get_value(int index)
+{
+	int msb;
+	int sub;
+
+	if (index < 2 * TRACE_HISTOGRAM_SUB_BUCKETS)
+		return index;
+
+	index -= 2 * TRACE_HISTOGRAM_SUB_BUCKETS;
+	msb = (index / TRACE_HISTOGRAM_SUB_BUCKETS) + 4;
+	sub = index % TRACE_HISTOGRAM_SUB_BUCKETS;
+
+	return (((UINT64) (TRACE_HISTOGRAM_SUB_BUCKETS + sub + 1)) << (msb - 3)) - 1;
+}
+
+void trace_histogram_reset(TRACE_HISTOGRAM* histogram)
+{
+	ZeroMemory(histogram, sizeof(TRACE_HISTOGRAM));
+}
+
+void trace_histogram_record(TRACE_HISTOGRAM* histogram, UINT64 value)
+{
+	if ((histogram->count == 0) || (value < histogram->min))
+		histogram->min = value;
+
+	if (value > histogram->max)
+		histogram->max = value;
+
+	histogram->count++;
+	histogram->total += value;
+	histogram->buckets[trace_histogram_get_index(value)]++;
+}
+
+void trace_histogram_add(TRACE_HISTOGRAM* histogram, TRACE_HISTOGRAM* other)
+{
+	int i;
+
+	if (other->count == 0)
+		return;
+
+	if ((histogram->count == 0) || (other->min < histogram->min))
+		histogram->min = other->min;
+
+	if (other->max > histogram->max)
+		histogram->max = other->max;
+
+	histogram->count += other->count;
+	histogram->total += other->total;
+
+	for (i = 0; i < TRACE_HISTOGRAM_BUCKETS; i++)
+		histogram->buckets[i] += other->buckets[i];
+}
+
+/**
+ * Returns a value at least as high as the given percentage of the recorded
+ * values, and within a bucket of the lowest such value.
+ */
+
+UINT64 trace_histogram_get_percentile(TRACE_HISTOGRAM* histogram, double percentile)
+{
+	int i;
+	UINT64 seen = 0;
+	UINT64 wanted;
+	UINT64 value;
+
+	if (histogram->count == 0)
+		return 0;
+
+	wanted = (UINT64) ((percentile * histogram->count) / 100.0 + 0.5);
+
+	if (wanted < 1)
+		wanted = 1;
+
+	for (i = 0; i < TRACE_HISTOGRAM_BUCKETS; i++)
+	{
+		seen += histogram->buckets[i];
+
+		if (seen >= wanted)
+			break;
+	}
+
+	value = trace_histogram_get_value(i);
+
+	return (value < histogram->max) ? value : histogram->max;
+}
+
+#ifdef _WIN32
+#define trace_get_thread_buffer()		((TRACE_BUFFER*) TlsGetValue(g_trace_tls))
+#define trace_set_thread_buffer(_buffer)	TlsSetValue(g_trace_tls, _buffer)
+#else
+#define trace_get_thread_buffer()		((TRACE_BUFFER*) pthread_getspecific(g_trace_tls))
+#define trace_set_thread_buffer(_buffer)	pthread_setspecific(g_trace_tls, _buffer)
+#endif
+
+#ifndef _WIN32
+
+/**
+ * Called as a thread exits. Windows has no such destructor for its thread
+ * local storage, so there the buffers of threads gone are not reused.
+ */
+
+static void trace_release_buffer(void* value)
+{
+	TRACE_BUFFER* buffer = (TRACE_BUFFER*) value;
+
+	if (buffer != &g_trace_dropped)
+		InterlockedExchange(&buffer->in_use, 0);
+}
+
+#endif
+
+static TRACE_BUFFER* trace_get_buffer(void)
+{
+	int i;
+	LONG slot;
+	TRACE_BUFFER* buffer;
+
+	buffer = trace_get_thread_buffer();
+
+	if (buffer == &g_trace_dropped)
+		return NULL;
+
+	if (buffer != NULL)
+		return buffer;
+
+	for (i = 0; (i < g_trace_buffer_count) && (i < TRACE_MAX_THREADS); i++)
+	{
+		buffer = g_trace_buffers[i];
+
+		if ((buffer != NULL) && (InterlockedCompareExchange(&buffer->in_use, 1, 0) == 0))
+		{
+			trace_set_thread_buffer(buffer);
+			return buffer;
+		}
+	}
+
+	buffer = NULL;
+
+	if (g_trace_buffer_count < TRACE_MAX_THREADS)
+	{
+		buffer = (TRACE_BUFFER*) malloc(sizeof(TRACE_BUFFER));
+		ZeroMemory(buffer, sizeof(TRACE_BUFFER));
+		buffer->in_use = 1;
+
+		/* a full barrier, so readers only find the buffer zeroed */
+		slot = InterlockedIncrement(&g_trace_buffer_count) - 1;
+
+		if (slot >= TRACE_MAX_THREADS)
+		{
+			free(buffer);
+			buffer = NULL;
+		}
+		else
+		{
+			buffer->thread = slot;
+			g_trace_buffers[slot] = buffer;
+		}
+	}
+
+	if (buffer == NULL)
+	{
+		InterlockedIncrement(&g_trace_dropped_threads);
+		trace_set_thread_buffer(&g_trace_dropped);
+		return NULL;
+	}
+
+	trace_set_thread_buffer(buffer);
+
+	return buffer;
+}
+
+/**
+ * Records the time since start at a trace point, in the buffer of the
+ * calling thread. Threads finding TRACE_MAX_THREADS others with a buffer
+ * are not traced, and are counted by trace_get_dropped_threads().
+ */
+
+void trace_record(int point, UINT64 start)
+{
+	UINT64 duration;
+	TRACE_EVENT* event;
+	TRACE_BUFFER* buffer;
+
+	duration = trace_get_time() - start;
+	buffer = trace_get_buffer();
+
+	if (buffer == NULL)
+		return;
+
+	trace_histogram_record(&buffer->histograms[point], duration);
+
+	event = &buffer->events[buffer->next_event % TRACE_BUFFER_EVENTS];
+	event->point = point;
+	event->thread = buffer->thread;
+	event->start = start;
+	event->duration = duration;
+	buffer->next_event++;
+}
+
+void trace_set_enabled(BOOL enabled)
+{
+	if (enabled && (g_trace_initialized != 2))
+	{
+		if (InterlockedCompareExchange(&g_trace_initialized, 1, 0) == 0)
+		{
+#ifdef _WIN32
+			g_trace_tls = TlsAlloc();
+#else
+			pthread_key_create(&g_trace_tls, trace_release_buffer);
+#endif
+			InterlockedExchange(&g_trace_initialized, 2);
+		}
+
+		while (g_trace_initialized != 2)
+			Sleep(0);
+	}
+
+	g_trace_enabled = enabled;
+}
+
+/**
+ * Clears the buffers of all threads. Events recorded meanwhile may be
+ * lost, so tracing is best turned off first.
+ */
+
+void trace_reset(void)
+{
+	int i;
+	TRACE_BUFFER* buffer;
+
+	for (i = 0; (i < g_trace_buffer_count) && (i < TRACE_MAX_THREADS); i++)
+	{
+		buffer = g_trace_buffers[i];
+
+		if (buffer == NULL)
+			continue;
+
+		ZeroMemory(buffer->events, sizeof(buffer->events));
+		ZeroMemory(buffer->histograms, sizeof(buffer->histograms));
+		buffer->next_event = 0;
+	}
+
+	InterlockedExchange(&g_trace_dropped_threads, 0);
+}
+
+int trace_get_dropped_threads(void)
+{
+	return (int) g_trace_dropped_threads;
+}
+
+const char* trace_get_point_name(int point)
+{
+	if ((point < 0) || (point >= TRACE_POINT_COUNT))
+		return "unknown";
+
+	return TRACE_POINT_NAMES[point];
+}
+
+/**
+ * Merges the histograms of a trace point of all threads. The buffers are
+ * read while their threads may write to them, so the figures of a point
+ * being recorded can be off by the event in progress.
+ */
+
+void trace_get_histogram(int point, TRACE_HISTOGRAM* histogram)
+{
+	int i;
+	TRACE_BUFFER* buffer;
+
+	trace_histogram_reset(histogram);
+
+	for (i = 0; (i < g_trace_buffer_count) && (i < TRACE_MAX_THREADS); i++)
+	{
+		buffer = g_trace_buffers[i];
+
+		if (buffer != NULL)
+			trace_histogram_add(histogram, &buffer->histograms[point]);
+	}
+}
+
+/**
+ * Copies up to count of the last events of every thread lasting at least
+ * threshold nanoseconds, and returns how many were copied.
+ */
+
+int trace_get_events(TRACE_EVENT* events, int count, UINT64 threshold)
+{
+	int i, j;
+	int found = 0;
+	TRACE_EVENT* event;
+	TRACE_BUFFER* buffer;
+
+	for (i = 0; (i < g_trace_buffer_count) && (i < TRACE_MAX_THREADS); i++)
+	{
+		buffer = g_trace_buffers[i];
+
+		if (buffer == NULL)
+			continue;
+
+		for (j = 0; (j < TRACE_BUFFER_EVENTS) && (found < count); j++)
+		{
+			event = &buffer->events[j];
+
+			if ((event->start != 0) && (event->duration >= threshold))
+				events[found++] = *event;
+		}
+	}
+
+	return found;
+}
+
+void trace_print(void)
+{
+	int i;
+	TRACE_HISTOGRAM histogram;
+
+	printf("\n");
+	printf("|----------------|-----------|------------|------------|------------|------------|\n");
+	printf("| trace point    |     count |     p50 us |     p90 us |     p99 us |     max us |\n");
+	printf("|----------------|-----------|------------|------------|------------|------------|\n");
+
+	for (i = 0; i < TRACE_POINT_COUNT; i++)
+	{
+		trace_get_histogram(i, &histogram);
+
+		if (histogram.count == 0)
+			continue;
+
+		printf("| %-15.15s| %9u | %10.1f | %10.1f | %10.1f | %10.1f |\n", TRACE_POINT_NAMES[i],
+			(UINT32) histogram.count,
+			trace_histogram_get_percentile(&histogram, 50) / 1000.0,
+			trace_histogram_get_percentile(&histogram, 90) / 1000.0,
+			trace_histogram_get_percentile(&histogram, 99) / 1000.0,
+			histogram.max / 1000.0);
+	}
+
+	printf("|----------------|-----------|------------|------------|------------|------------|\n");
+
+	if (g_trace_dropped_threads > 0)
+	{
+		printf("%d threads were not traced, %d others were being traced already\n",
+			(int) g_trace_dropped_threads, TRACE_MAX_THREADS);
+	}
+}
@@ -0,0 +1,181 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Worker Thread Pool
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/windows.h>
+#include <winpr/interlocked.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#include <freerdp/utils/worker.h>
+
+static int worker_pool_get_cpu_count(void)
+{
+	long cpus;
+
+#ifdef _WIN32
+	SYSTEM_INFO info;
+
+	GetSystemInfo(&info);
+	cpus = info.dwNumberOfProcessors;
+#else
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+	return (cpus > 0) ? (int) cpus : 1;
+}
+
+static void worker_pool_work(WORKER_POOL* pool)
+{
+	LONG index;
+
+	while ((index = InterlockedIncrement(&pool->next) - 1) < pool->count)
+		pool->callback(pool->context, (int) index);
+}
+
+static void* worker_pool_thread(void* arg)
+{
+	WORKER_POOL* pool = (WORKER_POOL*) arg;
+
+	for (;;)
+	{
+		WaitForSingleObject(pool->start, INFINITE);
+
+		if (pool->stopping)
+			break;
+
+		worker_pool_work(pool);
+		ReleaseSemaphore(pool->done, 1, NULL);
+	}
+
+	/* the last thing touching the pool, which may be gone right after */
+	ReleaseSemaphore(pool->done, 1, NULL);
+
+	return NULL;
+}
+
+/**
+ * Runs callback for every index from 0 to count - 1, on the threads of the
+ * pool and the calling thread, and returns when all of them are done.
+ */
+
+void worker_pool_run(WORKER_POOL* pool, int count, pWorkerPoolCallback callback, void* context)
+{
+	int i;
+	int helpers;
+
+	if ((pool == NULL) || (pool->threads < 1) || (count < 2))
+	{
+		for (i = 0; i < count; i++)
+			callback(context, i);
+
+		return;
+	}
+
+	helpers = (count - 1 < pool->threads) ? count - 1 : pool->threads;
+
+	pool->count = count;
+	pool->next = 0;
+	pool->context = context;
+	pool->callback = callback;
+
+	ReleaseSemaphore(pool->start, helpers, NULL);
+
+	worker_pool_work(pool);
+
+	for (i = 0; i < helpers; i++)
+		WaitForSingleObject(pool->done, INFINITE);
+}
+
+/**
+ * Creates a pool of threads threads, or of one for every processor but
+ * the calling thread's when threads is negative.
+ */
+
+WORKER_POOL* worker_pool_new(int threads)
+{
+	int i;
+	WORKER_POOL* pool;
+
+	if (threads < 0)
+		threads = worker_pool_get_cpu_count() - 1;
+
+	pool = (WORKER_POOL*) malloc(sizeof(WORKER_POOL));
+
+	if (pool != NULL)
+	{
+		ZeroMemory(pool, sizeof(WORKER_POOL));
+
+		pool->start = CreateSemaphore(NULL, 0, threads + 1, NULL);
+		pool->done = CreateSemaphore(NULL, 0, threads + 1, NULL);
+
+		for (i = 0; i < threads; i++)
+		{
+#ifdef _WIN32
+			HANDLE thread;
+
+			thread = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE) worker_pool_thread, pool, 0, NULL);
+
+			if (thread == NULL)
+				break;
+
+			CloseHandle(thread);
+#else
+			pthread_t thread;
+
+			if (pthread_create(&thread, 0, worker_pool_thread, pool) != 0)
+				break;
+
+			pthread_detach(thread);
+#endif
+			pool->threads++;
+		}
+	}
+
+	return pool;
+}
+
+void worker_pool_free(WORKER_POOL* pool)
+{
+	int i;
+
+	if (pool == NULL)
+		return;
+
+	pool->stopping = TRUE;
+
+	if (pool->threads > 0)
+		ReleaseSemaphore(pool->start, pool->threads, NULL);
+
+	for (i = 0; i < pool->threads; i++)
+		WaitForSingleObject(pool->done, INFINITE);
+
+	CloseHandle(pool->start);
+	CloseHandle(pool->done);
+
+	free(pool);
+}
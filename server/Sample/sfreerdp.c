@@ -636,19 +636,8 @@ static void tf_peer_suppress_output(rdpContext* context, BYTE allow, RECTANGLE_1
 	}
 }
 
-static void* test_peer_mainloop(void* arg)
+static void test_peer_setup(freerdp_peer* client)
 {
-	int i;
-	int fds;
-	int max_fds;
-	int rcount;
-	void* rfds[32];
-	fd_set rfds_set;
-	testPeerContext* context;
-	freerdp_peer* client = (freerdp_peer*) arg;
-
-	memset(rfds, 0, sizeof(rfds));
-
 	test_peer_init(client);
 
 	/* Initialize the real server settings here */
@@ -672,9 +661,25 @@ static void* test_peer_mainloop(void* arg)
 	client->update->SuppressOutput = tf_peer_suppress_output;
 
 	client->Initialize(client);
-	context = (testPeerContext*) client->context;
 
 	printf("We've got a client %s\n", client->local ? "(local)" : client->hostname);
+}
+
+static void* test_peer_mainloop(void* arg)
+{
+	int i;
+	int fds;
+	int max_fds;
+	int rcount;
+	void* rfds[32];
+	fd_set rfds_set;
+	testPeerContext* context;
+	freerdp_peer* client = (freerdp_peer*) arg;
+
+	memset(rfds, 0, sizeof(rfds));
+
+	test_peer_setup(client);
+	context = (testPeerContext*) client->context;
 
 	while (1)
 	{
@@ -731,9 +736,52 @@ static void* test_peer_mainloop(void* arg)
 	return NULL;
 }
 
+static BOOL test_runtime_peer_get_fds(freerdp_runtime* runtime, freerdp_peer* client, void** rfds, int* rcount)
+{
+	testPeerContext* context = (testPeerContext*) client->context;
+
+	if (client->GetFileDescriptor(client, rfds, rcount) != TRUE)
+		return FALSE;
+
+	WTSVirtualChannelManagerGetFileDescriptor(context->vcm, rfds, rcount);
+
+	return TRUE;
+}
+
+static BOOL test_runtime_peer_check_fds(freerdp_runtime* runtime, freerdp_peer* client)
+{
+	testPeerContext* context = (testPeerContext*) client->context;
+
+	if (client->CheckFileDescriptor(client) != TRUE)
+		return FALSE;
+
+	return WTSVirtualChannelManagerCheckFileDescriptor(context->vcm);
+}
+
+static void test_runtime_peer_closed(freerdp_runtime* runtime, freerdp_peer* client)
+{
+	printf("Client %s disconnected.\n", client->local ? "(local)" : client->hostname);
+
+	client->Disconnect(client);
+	freerdp_peer_context_free(client);
+	freerdp_peer_free(client);
+}
+
 static void test_peer_accepted(freerdp_listener* instance, freerdp_peer* client)
 {
 	pthread_t th;
+	freerdp_runtime* runtime = (freerdp_runtime*) instance->param1;
+
+	/* pcap playback blocks the peer, keep it on a thread of its own */
+	if (runtime && !test_pcap_file)
+	{
+		test_peer_setup(client);
+
+		if (!runtime->AddPeer(runtime, client))
+			test_runtime_peer_closed(runtime, client);
+
+		return;
+	}
 
 	pthread_create(&th, 0, test_peer_mainloop, client);
 	pthread_detach(th);
@@ -801,14 +849,32 @@ static void test_server_mainloop(freerdp_listener* instance)
 
 int main(int argc, char* argv[])
 {
+	freerdp_runtime* runtime;
 	freerdp_listener* instance;
 
 	/* Ignore SIGPIPE, otherwise an SSL_write failure could crash your server */
 	signal(SIGPIPE, SIG_IGN);
 
+	/* Serve all sessions from one worker thread per CPU where supported */
+	runtime = freerdp_runtime_new(0);
+
+	if (runtime)
+	{
+		runtime->PeerGetFileDescriptor = test_runtime_peer_get_fds;
+		runtime->PeerCheckFileDescriptor = test_runtime_peer_check_fds;
+		runtime->PeerClosed = test_runtime_peer_closed;
+
+		if (!runtime->Start(runtime))
+		{
+			freerdp_runtime_free(runtime);
+			runtime = NULL;
+		}
+	}
+
 	instance = freerdp_listener_new();
 
 	instance->PeerAccepted = test_peer_accepted;
+	instance->param1 = (void*) runtime;
 
 	if (argc > 1)
 		test_pcap_file = argv[1];
@@ -825,6 +891,7 @@ int main(int argc, char* argv[])
 	}
 
 	freerdp_listener_free(instance);
+	freerdp_runtime_free(runtime);
 
 	return 0;
 }
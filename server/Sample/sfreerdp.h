@@ -22,6 +22,7 @@
 
 #include <freerdp/freerdp.h>
 #include <freerdp/listener.h>
+#include <freerdp/runtime.h>
 #include <freerdp/codec/rfx.h>
 #include <freerdp/codec/nsc.h>
 #include <freerdp/utils/thread.h>
@@ -21,23 +21,36 @@
 #include "config.h"
 #endif
 
+#include <time.h>
+#include <poll.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <X11/Xlib.h>
+#include <X11/Xutil.h>
 
-#include <sys/select.h>
 #include <sys/signal.h>
 
-#include <freerdp/utils/sleep.h>
+#ifdef HAVE_SYS_TIMERFD_H
+#include <sys/timerfd.h>
+#endif
+
+#ifdef HAVE_SYS_EVENTFD_H
+#include <sys/eventfd.h>
+#endif
+
+#include <winpr/crt.h>
+#include <winpr/interlocked.h>
 
 #include "xf_encode.h"
 
-XImage* xf_snapshot(xfPeerContext* xfp, int x, int y, int width, int height)
+XImage* xf_snapshot(xfInfo* xfi, int x, int y, int width, int height)
 {
 	XImage* image;
-	xfInfo* xfi = xfp->info;
 
 	if (xfi->use_xshm)
 	{
-		pthread_mutex_lock(&(xfp->mutex));
+		pthread_mutex_lock(&(xfi->mutex));
 
 		XCopyArea(xfi->display, xfi->root_window, xfi->fb_pixmap,
 				xfi->xdamage_gc, x, y, width, height, x, y);
@@ -46,25 +59,24 @@ XImage* xf_snapshot(xfPeerContext* xfp, int x, int y, int width, int height)
 
 		image = xfi->fb_image;
 
-		pthread_mutex_unlock(&(xfp->mutex));
+		pthread_mutex_unlock(&(xfi->mutex));
 	}
 	else
 	{
-		pthread_mutex_lock(&(xfp->mutex));
+		pthread_mutex_lock(&(xfi->mutex));
 
 		image = XGetImage(xfi->display, xfi->root_window,
 				x, y, width, height, AllPlanes, ZPixmap);
 
-		pthread_mutex_unlock(&(xfp->mutex));
+		pthread_mutex_unlock(&(xfi->mutex));
 	}
 
 	return image;
 }
 
-void xf_xdamage_subtract_region(xfPeerContext* xfp, int x, int y, int width, int height)
+void xf_xdamage_subtract_region(xfInfo* xfi, int x, int y, int width, int height)
 {
 	XRectangle region;
-	xfInfo* xfi = xfp->info;
 
 	region.x = x;
 	region.y = y;
@@ -72,112 +84,817 @@ void xf_xdamage_subtract_region(xfPeerContext* xfp, int x, int y, int width, int
 	region.height = height;
 
 #ifdef WITH_XFIXES
-	pthread_mutex_lock(&(xfp->mutex));
+	pthread_mutex_lock(&(xfi->mutex));
 	XFixesSetRegion(xfi->display, xfi->xdamage_region, &region, 1);
 	XDamageSubtract(xfi->display, xfi->xdamage, xfi->xdamage_region, None);
-	pthread_mutex_unlock(&(xfp->mutex));
+	pthread_mutex_unlock(&(xfi->mutex));
 #endif
 }
 
-void* xf_frame_rate_thread(void* param)
+UINT64 xf_encoder_now_us(void)
 {
-	xfInfo* xfi;
-	xfEvent* event;
-	xfPeerContext* xfp;
-	freerdp_peer* client;
-	UINT32 wait_interval;
+	struct timespec ts;
 
-	client = (freerdp_peer*) param;
-	xfp = (xfPeerContext*) client->context;
-	xfi = xfp->info;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
 
-	wait_interval = 1000000 / xfp->fps;
+	return ((UINT64) ts.tv_sec) * 1000000 + (ts.tv_nsec / 1000);
+}
 
-	while (1)
+void xf_stage_stats_add(xfStageStats* stats, UINT64 elapsed_us)
+{
+	stats->count++;
+	stats->total_us += elapsed_us;
+
+	if (elapsed_us > stats->max_us)
+		stats->max_us = elapsed_us;
+}
+
+/**
+ * Print the average and worst time of a stage and start a new interval.
+ */
+
+void xf_stage_stats_print(const char* name, xfStageStats* stats)
+{
+	if (stats->count > 0)
 	{
-		// check if we should terminate
-		pthread_testcancel();
-		
-		event = xf_event_new(XF_EVENT_TYPE_FRAME_TICK);
-		xf_event_push(xfp->event_queue, (xfEvent*) event);
-		freerdp_usleep(wait_interval);
+		printf("%s: %d frames, avg %.2f ms, max %.2f ms\n", name, stats->count,
+			(double) stats->total_us / stats->count / 1000.0, (double) stats->max_us / 1000.0);
 	}
+
+	ZeroMemory(stats, sizeof(xfStageStats));
 }
 
-void* xf_monitor_updates(void* param)
+/**
+ * Encode a capture as a single multi-rectangle RemoteFX message. The
+ * capture rects are tile aligned and so is their bounding box, which
+ * becomes the image origin and keeps the tiles on the RemoteFX grid.
+ */
+
+static xfFrame* xf_frame_new(STREAM* header, RFX_CONTEXT* rfx_context, xfCapture* capture)
 {
-	int fds;
-	xfInfo* xfi;
-	XEvent xevent;
-	fd_set rfds_set;
-	int select_status;
-	int pending_events;
+	BYTE* data;
+	xfFrame* frame;
+
+	frame = (xfFrame*) malloc(sizeof(xfFrame));
+	ZeroMemory(frame, sizeof(xfFrame));
+
+	frame->refcount = 1;
+	frame->header = header;
+	frame->capture_time = capture->time;
+
+	frame->x = capture->x;
+	frame->y = capture->y;
+	frame->width = capture->width;
+	frame->height = capture->height;
+
+	frame->num_rects = capture->num_rects;
+	frame->rects = (RFX_RECT*) malloc(sizeof(RFX_RECT) * (capture->num_rects > 0 ? capture->num_rects : 1));
+	CopyMemory(frame->rects, capture->rects, sizeof(RFX_RECT) * capture->num_rects);
+
+	frame->s = stream_new(65536);
+
+	data = &capture->data[(capture->y * capture->scanline) + (capture->x * 4)];
+
+	rfx_compose_message(rfx_context, frame->s, capture->rects, capture->num_rects,
+		data, capture->width, capture->height, capture->scanline);
+
+	frame->encode_time = xf_encoder_now_us();
+
+	return frame;
+}
+
+void xf_frame_release(xfFrame* frame)
+{
+	if (InterlockedDecrement(&(frame->refcount)) > 0)
+		return;
+
+	stream_free(frame->s);
+	free(frame->rects);
+	free(frame);
+}
+
+static xfCapture* xf_capture_new(xfInfo* xfi)
+{
+	xfCapture* capture;
+
+	capture = (xfCapture*) malloc(sizeof(xfCapture));
+	ZeroMemory(capture, sizeof(xfCapture));
+
+	capture->scanline = xfi->width * 4;
+	capture->data = (BYTE*) malloc(capture->scanline * xfi->height);
+
+	capture->max_rects = XF_ENCODER_MAX_RECTS;
+	capture->rects = (RFX_RECT*) malloc(sizeof(RFX_RECT) * capture->max_rects);
+
+	return capture;
+}
+
+static void xf_capture_free(xfCapture* capture)
+{
+	free(capture->rects);
+	free(capture->data);
+	free(capture);
+}
+
+/**
+ * Copy each rectangle of region from the screen into the capture buffer.
+ * Only those areas are read back from the X server.
+ */
+
+static void xf_capture_region(xfCapture* capture, xfInfo* xfi, HGDI_REGION region)
+{
+	int i, y;
+	int nrects;
+	BYTE* src;
+	BYTE* dst;
+	XImage* image;
+	GDI_RGN* rects;
+	RFX_RECT* rect;
+
+	gdi_RegionSimplify(region, XF_ENCODER_MAX_RECTS);
+	rects = gdi_RegionGetRects(region, &nrects);
+
+	if (nrects > capture->max_rects)
+	{
+		capture->max_rects = nrects;
+		capture->rects = (RFX_RECT*) realloc(capture->rects, sizeof(RFX_RECT) * capture->max_rects);
+	}
+
+	capture->time = xf_encoder_now_us();
+	capture->x = region->extents.x;
+	capture->y = region->extents.y;
+	capture->width = region->extents.w;
+	capture->height = region->extents.h;
+	capture->num_rects = 0;
+
+	for (i = 0; i < nrects; i++)
+	{
+		image = xf_snapshot(xfi, rects[i].x, rects[i].y, rects[i].w, rects[i].h);
+
+		if (image == NULL)
+			continue;
+
+		src = (BYTE*) image->data;
+
+		if (xfi->use_xshm)
+			src = &src[(rects[i].y * image->bytes_per_line) + (rects[i].x * image->bits_per_pixel / 8)];
+
+		dst = &capture->data[(rects[i].y * capture->scanline) + (rects[i].x * 4)];
+
+		for (y = 0; y < rects[i].h; y++)
+		{
+			CopyMemory(dst, src, rects[i].w * 4);
+			src += image->bytes_per_line;
+			dst += capture->scanline;
+		}
+
+		if (!xfi->use_xshm)
+			XDestroyImage(image);
+
+		rect = &capture->rects[capture->num_rects++];
+		rect->x = rects[i].x - capture->x;
+		rect->y = rects[i].y - capture->y;
+		rect->width = rects[i].w;
+		rect->height = rects[i].h;
+	}
+}
+
+/**
+ * A peer is busy while it still has XF_ENCODER_MAX_PENDING frames queued
+ * or while its client has as many frames unacknowledged as it allows.
+ */
+
+static BOOL xf_encoder_peer_busy(xfPeerContext* xfp)
+{
+	if (xfp->pending_frames >= XF_ENCODER_MAX_PENDING)
+		return TRUE;
+
+	if ((xfp->max_unacked_frames > 0) && (xfp->unacked_frames >= (LONG) xfp->max_unacked_frames))
+		return TRUE;
+
+	return FALSE;
+}
+
+static void xf_encoder_fold_missed(xfEncoder* encoder, xfPeerContext* xfp)
+{
+	int i;
+	int nrects;
+	GDI_RGN* rects;
+
+	if (gdi_RegionIsEmpty(xfp->missed))
+		return;
+
+	rects = gdi_RegionGetRects(xfp->missed, &nrects);
+
+	for (i = 0; i < nrects; i++)
+		gdi_RegionCombineRect(encoder->invalid, rects[i].x, rects[i].y, rects[i].w, rects[i].h, GDI_RGN_OR);
+
+	gdi_RegionClear(xfp->missed);
+}
+
+static void xf_encoder_wake(xfEncoder* encoder)
+{
+	UINT64 value = 1;
+
+	if (write(encoder->wake_fd[1], &value, sizeof(value)) < 0)
+	{
+		if (errno != EAGAIN)
+			perror("write");
+	}
+}
+
+/**
+ * Arm the frame timer for the pending damage, called with the encoder
+ * locked. Nothing is armed without damage or peers, so that an idle
+ * server does not wake up at all.
+ */
+
+static void xf_encoder_schedule(xfEncoder* encoder)
+{
+	UINT64 now;
+	UINT64 deadline;
+#ifdef HAVE_SYS_TIMERFD_H
+	struct itimerspec timer;
+#endif
+
+	if (encoder->deadline || encoder->stopped)
+		return;
+
+	if ((encoder->num_peers < 1) || gdi_RegionIsEmpty(encoder->invalid))
+		return;
+
+	now = xf_encoder_now_us();
+	deadline = encoder->last_capture + encoder->frame_interval;
+
+	/* an absolute time in the past expires right away, zero would disarm */
+	if (deadline < now)
+		deadline = now;
+
+	encoder->deadline = deadline;
+
+#ifdef HAVE_SYS_TIMERFD_H
+	ZeroMemory(&timer, sizeof(timer));
+	timer.it_value.tv_sec = deadline / 1000000;
+	timer.it_value.tv_nsec = (deadline % 1000000) * 1000;
+
+	if (timerfd_settime(encoder->timer_fd, TFD_TIMER_ABSTIME, &timer, NULL) != 0)
+		perror("timerfd_settime");
+#else
+	/* the capture thread derives its poll timeout from the deadline */
+	xf_encoder_wake(encoder);
+#endif
+}
+
+/**
+ * Pace the frames to the fastest client, called with the encoder locked.
+ * A client acknowledging frames is taken to sustain one frame per round
+ * trip for each frame it allows in flight. Clients without frame
+ * acknowledgement run at the nominal frame rate.
+ */
+
+static void xf_encoder_update_interval(xfEncoder* encoder)
+{
+	int i;
+	UINT64 interval;
+	UINT64 fastest = 0;
 	xfPeerContext* xfp;
-	freerdp_peer* client;
-	UINT32 wait_interval;
-	struct timeval timeout;
-	int x, y, width, height;
-	XDamageNotifyEvent* notify;
-	xfEventRegion* event_region;
 
-	client = (freerdp_peer*) param;
-	xfp = (xfPeerContext*) client->context;
-	xfi = xfp->info;
+	for (i = 0; i < encoder->num_peers; i++)
+	{
+		xfp = encoder->peers[i];
+
+		if ((xfp->max_unacked_frames > 0) && (xfp->ack_rtt_us > 0))
+			interval = xfp->ack_rtt_us / xfp->max_unacked_frames;
+		else
+			interval = 0;
+
+		if ((i == 0) || (interval < fastest))
+			fastest = interval;
+	}
 
-	fds = xfi->xfds;
-	wait_interval = (1000000 / 2500);
-	memset(&timeout, 0, sizeof(struct timeval));
+	fastest = MIN(fastest, 1000000 / XF_ENCODER_MIN_FPS);
+	encoder->frame_interval = MAX(fastest, 1000000 / encoder->fps);
+}
 
-	pthread_create(&(xfp->frame_rate_thread), 0, xf_frame_rate_thread, (void*) client);
+static void xf_encoder_send(xfPeerContext* xfp, xfFrame* frame)
+{
+	InterlockedIncrement(&(frame->refcount));
+	InterlockedIncrement(&(xfp->pending_frames));
+
+	xf_event_push(xfp->event_queue, (xfEvent*) xf_event_frame_new(frame));
+}
+
+/**
+ * Hand the encoded frames to the peers, called with the encoder locked.
+ * A busy peer skips the frame and remembers its area instead. Once the
+ * peer has caught up, that area is added to the damage of the next capture.
+ */
+
+static void xf_encoder_fan_out(xfEncoder* encoder, xfFrame** frames)
+{
+	int i, j;
+	xfFrame* frame;
+	xfPeerContext* xfp;
+
+	for (i = 0; i < encoder->num_peers; i++)
+	{
+		xfp = encoder->peers[i];
+		frame = frames[xfp->rfx_mode];
+
+		if (xf_encoder_peer_busy(xfp))
+		{
+			if (frame)
+			{
+				for (j = 0; j < frame->num_rects; j++)
+				{
+					gdi_RegionCombineRect(xfp->missed, frame->x + frame->rects[j].x, frame->y + frame->rects[j].y,
+						frame->rects[j].width, frame->rects[j].height, GDI_RGN_OR);
+				}
+
+				xfp->frames_dropped++;
+			}
+
+			continue;
+		}
+
+		if (frame)
+			xf_encoder_send(xfp, frame);
+
+		xf_encoder_fold_missed(encoder, xfp);
+	}
+
+	xf_encoder_schedule(encoder);
+}
+
+static void xf_encoder_print_stats(xfEncoder* encoder)
+{
+	printf("encoder: %d ticks skipped with the encode queue full\n", encoder->skipped_ticks);
+
+	xf_stage_stats_print("encoder capture", &encoder->capture_stats);
+	xf_stage_stats_print("encoder queue", &encoder->queue_stats);
+	xf_stage_stats_print("encoder encode", &encoder->encode_stats);
+
+	encoder->skipped_ticks = 0;
+}
+
+/**
+ * Encode stage: take the oldest capture, encode it once per codec in use
+ * and queue the result to the peers.
+ */
+
+static void* xf_encoder_encode_thread(void* param)
+{
+	int i;
+	UINT64 start;
+	xfCapture* capture;
+	BOOL encode[XF_ENCODER_MAX_CODECS];
+	xfFrame* frames[XF_ENCODER_MAX_CODECS];
+	xfEncoder* encoder = (xfEncoder*) param;
+
+	pthread_mutex_lock(&(encoder->mutex));
 
 	while (1)
 	{
-		// check if we should terminate
-		pthread_testcancel();
+		while ((encoder->num_captures < 1) && !encoder->stopped)
+			pthread_cond_wait(&(encoder->capture_ready), &(encoder->mutex));
+
+		if (encoder->stopped)
+			break;
+
+		capture = encoder->captures[0];
+		encoder->num_captures--;
+		MoveMemory(&encoder->captures[0], &encoder->captures[1], sizeof(xfCapture*) * encoder->num_captures);
+
+		for (i = 0; i < XF_ENCODER_MAX_CODECS; i++)
+			encode[i] = (encoder->codecs[i].subscribers > 0) ? TRUE : FALSE;
+
+		pthread_mutex_unlock(&(encoder->mutex));
 
-		FD_ZERO(&rfds_set);
-		FD_SET(fds, &rfds_set);
+		start = xf_encoder_now_us();
 
-		timeout.tv_sec = 0;
-		timeout.tv_usec = wait_interval;
-		select_status = select(fds + 1, &rfds_set, NULL, NULL, &timeout);
+		ZeroMemory(frames, sizeof(frames));
 
-		if (select_status == -1)
+		for (i = 0; i < XF_ENCODER_MAX_CODECS; i++)
 		{
-			printf("select failed\n");
+			if (encode[i] && (capture->num_rects > 0))
+				frames[i] = xf_frame_new(encoder->codecs[i].header, encoder->codecs[i].rfx_context, capture);
 		}
-		else if (select_status == 0)
+
+		pthread_mutex_lock(&(encoder->mutex));
+
+		xf_stage_stats_add(&encoder->queue_stats, start - capture->time);
+		xf_stage_stats_add(&encoder->encode_stats, xf_encoder_now_us() - start);
+
+		xf_encoder_fan_out(encoder, frames);
+
+		if (start - encoder->stats_time >= XF_ENCODER_STATS_INTERVAL * 1000000)
 		{
-			//printf("select timeout\n");
+			xf_encoder_print_stats(encoder);
+			encoder->stats_time = start;
 		}
 
-		pthread_mutex_lock(&(xfp->mutex));
+		if (encoder->num_free_captures < XF_ENCODER_MAX_CAPTURES + 1)
+			encoder->free_captures[encoder->num_free_captures++] = capture;
+		else
+			xf_capture_free(capture);
+
+		pthread_mutex_unlock(&(encoder->mutex));
+
+		for (i = 0; i < XF_ENCODER_MAX_CODECS; i++)
+		{
+			if (frames[i])
+				xf_frame_release(frames[i]);
+		}
+
+		pthread_mutex_lock(&(encoder->mutex));
+	}
+
+	pthread_mutex_unlock(&(encoder->mutex));
+
+	return NULL;
+}
+
+/**
+ * Capture stage, run once the frame timer has expired. When the encode
+ * stage is behind the tick is skipped and the damage keeps accumulating
+ * for the next one.
+ */
+
+static void xf_encoder_capture(xfEncoder* encoder)
+{
+	UINT64 start;
+	HGDI_REGION region;
+	xfCapture* capture;
+
+	pthread_mutex_lock(&(encoder->mutex));
+
+	start = xf_encoder_now_us();
+
+	if (!encoder->deadline || (start < encoder->deadline))
+	{
+		pthread_mutex_unlock(&(encoder->mutex));
+		return;
+	}
+
+	encoder->deadline = 0;
+	encoder->last_capture = start;
+
+	if (encoder->num_peers < 1)
+	{
+		gdi_RegionClear(encoder->invalid);
+		pthread_mutex_unlock(&(encoder->mutex));
+		return;
+	}
+
+	if (gdi_RegionIsEmpty(encoder->invalid))
+	{
+		pthread_mutex_unlock(&(encoder->mutex));
+		return;
+	}
+
+	if (encoder->num_captures >= XF_ENCODER_MAX_CAPTURES)
+	{
+		encoder->skipped_ticks++;
+		xf_encoder_schedule(encoder);
+		pthread_mutex_unlock(&(encoder->mutex));
+		return;
+	}
+
+	/* take the damage so that new damage can be recorded meanwhile */
+	region = encoder->invalid;
+	encoder->invalid = gdi_RegionNew();
+
+	if (encoder->num_free_captures > 0)
+		capture = encoder->free_captures[--(encoder->num_free_captures)];
+	else
+		capture = NULL;
+
+	pthread_mutex_unlock(&(encoder->mutex));
+
+	if (capture == NULL)
+		capture = xf_capture_new(encoder->info);
+
+	start = xf_encoder_now_us();
+	xf_capture_region(capture, encoder->info, region);
+	gdi_RegionFree(region);
+
+	pthread_mutex_lock(&(encoder->mutex));
+
+	xf_stage_stats_add(&encoder->capture_stats, xf_encoder_now_us() - start);
+
+	encoder->captures[encoder->num_captures++] = capture;
+	pthread_cond_signal(&(encoder->capture_ready));
+
+	/* damage recorded while capturing */
+	xf_encoder_schedule(encoder);
+
+	pthread_mutex_unlock(&(encoder->mutex));
+}
+
+static void xf_encoder_process_events(xfEncoder* encoder)
+{
+	xfInfo* xfi;
+	XEvent xevent;
+	int pending_events;
+	int x, y, width, height;
+	XDamageNotifyEvent* notify;
+
+	xfi = encoder->info;
+
+	while (1)
+	{
+		pthread_mutex_lock(&(xfi->mutex));
+
 		pending_events = XPending(xfi->display);
-		pthread_mutex_unlock(&(xfp->mutex));
 
 		if (pending_events > 0)
 		{
-			pthread_mutex_lock(&(xfp->mutex));
 			memset(&xevent, 0, sizeof(xevent));
 			XNextEvent(xfi->display, &xevent);
-			pthread_mutex_unlock(&(xfp->mutex));
+		}
 
-			if (xevent.type == xfi->xdamage_notify_event)
-			{
-				notify = (XDamageNotifyEvent*) &xevent;
+		pthread_mutex_unlock(&(xfi->mutex));
+
+		if (pending_events < 1)
+			break;
+
+		if (xevent.type == xfi->xdamage_notify_event)
+		{
+			notify = (XDamageNotifyEvent*) &xevent;
+
+			x = notify->area.x;
+			y = notify->area.y;
+			width = notify->area.width;
+			height = notify->area.height;
+
+			xf_xdamage_subtract_region(xfi, x, y, width, height);
+
+			/* widen to whole tiles so that neighbouring damage coalesces, then clip to the screen */
+			width = x + width + XF_ENCODER_TILE_SIZE - 1;
+			height = y + height + XF_ENCODER_TILE_SIZE - 1;
+			x -= x % XF_ENCODER_TILE_SIZE;
+			y -= y % XF_ENCODER_TILE_SIZE;
+			width = MIN(width - width % XF_ENCODER_TILE_SIZE, xfi->width) - x;
+			height = MIN(height - height % XF_ENCODER_TILE_SIZE, xfi->height) - y;
+
+			pthread_mutex_lock(&(encoder->mutex));
+			gdi_RegionCombineRect(encoder->invalid, x, y, width, height, GDI_RGN_OR);
+			xf_encoder_schedule(encoder);
+			pthread_mutex_unlock(&(encoder->mutex));
+		}
+	}
+}
 
-				x = notify->area.x;
-				y = notify->area.y;
-				width = notify->area.width;
-				height = notify->area.height;
+/**
+ * Capture thread: waits on the X connection for damage, on the frame timer
+ * and on the wake event, without any periodic tick.
+ */
+
+static void* xf_encoder_capture_thread(void* param)
+{
+	int count;
+	int timeout;
+	UINT64 now;
+	BYTE buffer[64];
+	struct pollfd pfds[3];
+	xfEncoder* encoder = (xfEncoder*) param;
+
+	pfds[0].fd = encoder->info->xfds;
+	pfds[1].fd = encoder->wake_fd[0];
+	pfds[2].fd = encoder->timer_fd;
+	count = (encoder->timer_fd != -1) ? 3 : 2;
+
+	while (!encoder->stopped)
+	{
+		xf_encoder_process_events(encoder);
 
-				xf_xdamage_subtract_region(xfp, x, y, width, height);
+		timeout = -1;
 
-				event_region = xf_event_region_new(x, y, width, height);
-				xf_event_push(xfp->event_queue, (xfEvent*) event_region);
+		if (encoder->timer_fd == -1)
+		{
+			pthread_mutex_lock(&(encoder->mutex));
+
+			if (encoder->deadline)
+			{
+				now = xf_encoder_now_us();
+				timeout = (encoder->deadline > now) ? (int) ((encoder->deadline - now + 999) / 1000) : 0;
 			}
+
+			pthread_mutex_unlock(&(encoder->mutex));
+		}
+
+		pfds[0].events = pfds[1].events = pfds[2].events = POLLIN;
+		pfds[0].revents = pfds[1].revents = pfds[2].revents = 0;
+
+		if (poll(pfds, count, timeout) == -1)
+		{
+			if (errno != EINTR)
+				printf("poll failed\n");
+
+			continue;
+		}
+
+		if (pfds[1].revents & POLLIN)
+		{
+			if (read(pfds[1].fd, buffer, sizeof(buffer)) < 0)
+				perror("read");
+		}
+
+		if (pfds[2].revents & POLLIN)
+		{
+			if (read(pfds[2].fd, buffer, sizeof(buffer)) < 0)
+				perror("read");
 		}
+
+		xf_encoder_capture(encoder);
 	}
 
 	return NULL;
 }
+
+static void xf_encoder_codec_init(xfEncoder* encoder, RLGR_MODE mode)
+{
+	xfEncoderCodec* codec = &encoder->codecs[mode];
+
+	codec->rfx_context = rfx_context_new();
+	codec->rfx_context->mode = mode;
+	codec->rfx_context->width = encoder->info->width;
+	codec->rfx_context->height = encoder->info->height;
+
+	rfx_context_set_pixel_format(codec->rfx_context, RDP_PIXEL_FORMAT_B8G8R8A8);
+
+	/**
+	 * The header is only sent once per connection, so keep it apart from
+	 * the frames and let each peer send it ahead of its first frame.
+	 */
+	codec->header = stream_new(64);
+	rfx_compose_message_header(codec->rfx_context, codec->header);
+}
+
+void xf_encoder_subscribe(xfEncoder* encoder, xfPeerContext* xfp)
+{
+	pthread_mutex_lock(&(encoder->mutex));
+
+	if (encoder->num_peers >= encoder->max_peers)
+	{
+		encoder->max_peers *= 2;
+		encoder->peers = (xfPeerContext**) realloc(encoder->peers, sizeof(xfPeerContext*) * encoder->max_peers);
+	}
+
+	encoder->peers[encoder->num_peers++] = xfp;
+
+	if (encoder->codecs[xfp->rfx_mode].rfx_context == NULL)
+		xf_encoder_codec_init(encoder, xfp->rfx_mode);
+
+	encoder->codecs[xfp->rfx_mode].subscribers++;
+
+	/* a new viewer starts with the whole screen */
+	gdi_RegionCombineRect(xfp->missed, 0, 0, encoder->info->width, encoder->info->height, GDI_RGN_OR);
+	xf_encoder_fold_missed(encoder, xfp);
+
+	xf_encoder_update_interval(encoder);
+	xf_encoder_schedule(encoder);
+
+	pthread_mutex_unlock(&(encoder->mutex));
+}
+
+/**
+ * Called by a peer thread once it has sent a frame or its client has
+ * acknowledged some. Picks up the new acknowledgement timing and, when the
+ * peer is no longer busy, schedules the area it missed meanwhile.
+ */
+
+void xf_encoder_peer_ready(xfEncoder* encoder, xfPeerContext* xfp)
+{
+	pthread_mutex_lock(&(encoder->mutex));
+
+	xf_encoder_update_interval(encoder);
+
+	if (!xf_encoder_peer_busy(xfp))
+	{
+		xf_encoder_fold_missed(encoder, xfp);
+		xf_encoder_schedule(encoder);
+	}
+
+	pthread_mutex_unlock(&(encoder->mutex));
+}
+
+void xf_encoder_unsubscribe(xfEncoder* encoder, xfPeerContext* xfp)
+{
+	int i;
+
+	pthread_mutex_lock(&(encoder->mutex));
+
+	for (i = 0; i < encoder->num_peers; i++)
+	{
+		if (encoder->peers[i] != xfp)
+			continue;
+
+		encoder->peers[i] = encoder->peers[--(encoder->num_peers)];
+		encoder->codecs[xfp->rfx_mode].subscribers--;
+		break;
+	}
+
+	xf_encoder_update_interval(encoder);
+
+	pthread_mutex_unlock(&(encoder->mutex));
+}
+
+xfEncoder* xf_encoder_new(xfInfo* xfi)
+{
+	xfEncoder* encoder;
+
+	encoder = (xfEncoder*) malloc(sizeof(xfEncoder));
+	ZeroMemory(encoder, sizeof(xfEncoder));
+
+	if (encoder != NULL)
+	{
+		encoder->fps = 24;
+		encoder->info = xfi;
+		encoder->invalid = gdi_RegionNew();
+		encoder->stats_time = xf_encoder_now_us();
+
+		encoder->max_peers = 8;
+		encoder->peers = (xfPeerContext**) malloc(sizeof(xfPeerContext*) * encoder->max_peers);
+
+		encoder->frame_interval = 1000000 / encoder->fps;
+
+#ifdef HAVE_SYS_EVENTFD_H
+		encoder->wake_fd[0] = encoder->wake_fd[1] = eventfd(0, EFD_NONBLOCK);
+#else
+		if (pipe(encoder->wake_fd) == 0)
+		{
+			fcntl(encoder->wake_fd[0], F_SETFL, O_NONBLOCK);
+			fcntl(encoder->wake_fd[1], F_SETFL, O_NONBLOCK);
+		}
+		else
+		{
+			encoder->wake_fd[0] = encoder->wake_fd[1] = -1;
+		}
+#endif
+
+#ifdef HAVE_SYS_TIMERFD_H
+		encoder->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+#else
+		encoder->timer_fd = -1;
+#endif
+
+		if (encoder->wake_fd[0] == -1)
+			perror("xf_encoder_new: wake event");
+
+		pthread_mutex_init(&(encoder->mutex), NULL);
+		pthread_cond_init(&(encoder->capture_ready), NULL);
+
+		pthread_create(&(encoder->encode_thread), 0, xf_encoder_encode_thread, (void*) encoder);
+		pthread_create(&(encoder->capture_thread), 0, xf_encoder_capture_thread, (void*) encoder);
+	}
+
+	return encoder;
+}
+
+void xf_encoder_free(xfEncoder* encoder)
+{
+	int i;
+
+	if (encoder != NULL)
+	{
+		pthread_mutex_lock(&(encoder->mutex));
+		encoder->stopped = TRUE;
+		pthread_cond_broadcast(&(encoder->capture_ready));
+		xf_encoder_wake(encoder);
+		pthread_mutex_unlock(&(encoder->mutex));
+
+		pthread_join(encoder->capture_thread, NULL);
+		pthread_join(encoder->encode_thread, NULL);
+
+		if (encoder->timer_fd != -1)
+			close(encoder->timer_fd);
+
+		if (encoder->wake_fd[1] != encoder->wake_fd[0])
+			close(encoder->wake_fd[1]);
+
+		close(encoder->wake_fd[0]);
+
+		for (i = 0; i < encoder->num_captures; i++)
+			xf_capture_free(encoder->captures[i]);
+
+		for (i = 0; i < encoder->num_free_captures; i++)
+			xf_capture_free(encoder->free_captures[i]);
+
+		for (i = 0; i < XF_ENCODER_MAX_CODECS; i++)
+		{
+			if (encoder->codecs[i].rfx_context)
+			{
+				stream_free(encoder->codecs[i].header);
+				rfx_context_free(encoder->codecs[i].rfx_context);
+			}
+		}
+
+		gdi_RegionFree(encoder->invalid);
+		pthread_cond_destroy(&(encoder->capture_ready));
+		pthread_mutex_destroy(&(encoder->mutex));
+
+		free(encoder->peers);
+		free(encoder);
+	}
+}
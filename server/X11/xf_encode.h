@@ -20,13 +20,173 @@
 #ifndef __XF_ENCODE_H
 #define __XF_ENCODE_H
 
+typedef struct xf_frame xfFrame;
+typedef struct xf_capture xfCapture;
+typedef struct xf_stage_stats xfStageStats;
+typedef struct xf_encoder xfEncoder;
+typedef struct xf_encoder_codec xfEncoderCodec;
+
 #include <pthread.h>
+#include <freerdp/types.h>
+
+/**
+ * Timing of one pipeline stage over the current reporting interval,
+ * complete before xf_peer.h so that peers can embed it.
+ */
+struct xf_stage_stats
+{
+	UINT32 count;
+	UINT64 total_us;
+	UINT64 max_us;
+};
+
 #include "xfreerdp.h"
 
 #include "xf_peer.h"
 
-XImage* xf_snapshot(xfPeerContext* xfp, int x, int y, int width, int height);
-void xf_xdamage_subtract_region(xfPeerContext* xfp, int x, int y, int width, int height);
-void* xf_monitor_updates(void* param);
+/* encoded frames queued to a peer before it starts dropping frames */
+#define XF_ENCODER_MAX_PENDING		2
+
+/* damaged rectangles encoded per frame before they are merged */
+#define XF_ENCODER_MAX_RECTS		32
+
+/* damage is widened to whole RemoteFX tiles */
+#define XF_ENCODER_TILE_SIZE		64
+
+/* captured frames waiting for the encode stage before capture skips ticks */
+#define XF_ENCODER_MAX_CAPTURES		2
+
+/* seconds between two reports of the stage timings */
+#define XF_ENCODER_STATS_INTERVAL	10
+
+/* slowest frame rate the client acknowledgements can throttle the encoder to */
+#define XF_ENCODER_MIN_FPS		4
+
+/**
+ * A captured frame: the damaged rectangles copied into a screen sized
+ * buffer of its own, so that the next capture can proceed while this one
+ * is being encoded. Only the damaged areas of the buffer are written.
+ * The rects are tile aligned and relative to their bounding box x, y.
+ */
+struct xf_capture
+{
+	UINT64 time;
+
+	BYTE* data;
+	int scanline;
+
+	int x;
+	int y;
+	int width;
+	int height;
+
+	int num_rects;
+	int max_rects;
+	RFX_RECT* rects;
+};
+
+/* one codec per entropy mode, indexed by RLGR_MODE */
+#define XF_ENCODER_MAX_CODECS		2
+
+/**
+ * An encoded frame: a single RemoteFX message covering all the damaged
+ * rectangles, with x, y as its destination. Frames are shared by all the
+ * peers they are sent to.
+ */
+struct xf_frame
+{
+	LONG refcount;
+
+	UINT64 capture_time;
+	UINT64 encode_time;
+
+	STREAM* s;
+	STREAM* header;
+
+	int x;
+	int y;
+	int width;
+	int height;
+
+	int num_rects;
+	RFX_RECT* rects;
+};
+
+struct xf_encoder_codec
+{
+	int subscribers;
+	STREAM* header;
+	RFX_CONTEXT* rfx_context;
+};
+
+/**
+ * Captures the display once and encodes each frame once per codec in use,
+ * then hands the encoded frame to every subscribed peer using that codec.
+ *
+ * Captures are scheduled on a one-shot frame timer that is only armed while
+ * there is damage to send, no sooner than frame_interval after the previous
+ * capture, so an idle screen costs no wakeups. frame_interval starts at
+ * 1/fps and is stretched to the pace at which the fastest client
+ * acknowledges its frames.
+ *
+ * Capture and encode run on their own threads and the peer threads send,
+ * so the capture of frame N+1, the encoding of frame N and the sending of
+ * frame N-1 overlap. Each stage hands over through a bounded queue: the
+ * capture queue here, and the per-peer event queue limited to
+ * XF_ENCODER_MAX_PENDING frames.
+ */
+struct xf_encoder
+{
+	int fps;
+	xfInfo* info;
+	BOOL stopped;
+	pthread_mutex_t mutex;
+	HGDI_REGION invalid;
+
+	pthread_t capture_thread;
+	pthread_t encode_thread;
+
+	int timer_fd;
+	int wake_fd[2];
+	UINT64 deadline;
+	UINT64 last_capture;
+	UINT64 frame_interval;
+
+	int num_captures;
+	xfCapture* captures[XF_ENCODER_MAX_CAPTURES];
+	pthread_cond_t capture_ready;
+
+	int num_free_captures;
+	xfCapture* free_captures[XF_ENCODER_MAX_CAPTURES + 1];
+
+	UINT64 stats_time;
+	UINT32 skipped_ticks;
+	xfStageStats capture_stats;
+	xfStageStats queue_stats;
+	xfStageStats encode_stats;
+
+	int num_peers;
+	int max_peers;
+	xfPeerContext** peers;
+
+	xfEncoderCodec codecs[XF_ENCODER_MAX_CODECS];
+};
+
+UINT64 xf_encoder_now_us(void);
+
+void xf_stage_stats_add(xfStageStats* stats, UINT64 elapsed_us);
+void xf_stage_stats_print(const char* name, xfStageStats* stats);
+
+XImage* xf_snapshot(xfInfo* xfi, int x, int y, int width, int height);
+void xf_xdamage_subtract_region(xfInfo* xfi, int x, int y, int width, int height);
+
+void xf_frame_release(xfFrame* frame);
+
+void xf_encoder_peer_ready(xfEncoder* encoder, xfPeerContext* xfp);
+void xf_encoder_subscribe(xfEncoder* encoder, xfPeerContext* xfp);
+void xf_encoder_unsubscribe(xfEncoder* encoder, xfPeerContext* xfp);
+
+xfEncoder* xf_encoder_new(xfInfo* xfi);
+void xf_encoder_free(xfEncoder* encoder);
 
 #endif /* __XF_ENCODE_H */
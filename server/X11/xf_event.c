@@ -129,7 +129,10 @@ xfEvent* xf_event_pop(xfEventQueue* event_queue)
 	pthread_mutex_lock(&(event_queue->mutex));
 
 	if (event_queue->count < 1)
+	{
+		pthread_mutex_unlock(&(event_queue->mutex));
 		return NULL;
+	}
 
 	/* remove event signal */
 	xf_clear_event(event_queue);
@@ -144,27 +147,25 @@ xfEvent* xf_event_pop(xfEventQueue* event_queue)
 	return event;
 }
 
-xfEventRegion* xf_event_region_new(int x, int y, int width, int height)
+xfEventFrame* xf_event_frame_new(xfFrame* frame)
 {
-	xfEventRegion* event_region;
+	xfEventFrame* event_frame;
 
-	event_region = (xfEventRegion*) malloc(sizeof(xfEventRegion));
-	ZeroMemory(event_region, sizeof(xfEventRegion));
+	event_frame = (xfEventFrame*) malloc(sizeof(xfEventFrame));
+	ZeroMemory(event_frame, sizeof(xfEventFrame));
 
-	if (event_region != NULL)
+	if (event_frame != NULL)
 	{
-		event_region->x = x;
-		event_region->y = y;
-		event_region->width = width;
-		event_region->height = height;
+		event_frame->type = XF_EVENT_TYPE_FRAME;
+		event_frame->frame = frame;
 	}
 
-	return event_region;
+	return event_frame;
 }
 
-void xf_event_region_free(xfEventRegion* event_region)
+void xf_event_frame_free(xfEventFrame* event_frame)
 {
-	free(event_region);
+	free(event_frame);
 }
 
 xfEvent* xf_event_new(int type)
@@ -222,4 +223,7 @@ void xf_event_queue_free(xfEventQueue* event_queue)
 	}
 
 	pthread_mutex_destroy(&(event_queue->mutex));
+
+	free(event_queue->events);
+	free(event_queue);
 }
@@ -22,17 +22,17 @@
 
 typedef struct xf_event xfEvent;
 typedef struct xf_event_queue xfEventQueue;
-typedef struct xf_event_region xfEventRegion;
+typedef struct xf_event_frame xfEventFrame;
 
 #include <pthread.h>
 #include "xfreerdp.h"
 
 #include "xf_peer.h"
+#include "xf_encode.h"
 
 enum xf_event_type
 {
-	XF_EVENT_TYPE_REGION,
-	XF_EVENT_TYPE_FRAME_TICK
+	XF_EVENT_TYPE_FRAME
 };
 
 struct xf_event
@@ -49,22 +49,19 @@ struct xf_event_queue
 	pthread_mutex_t mutex;
 };
 
-struct xf_event_region
+struct xf_event_frame
 {
 	int type;
 
-	int x;
-	int y;
-	int width;
-	int height;
+	xfFrame* frame;
 };
 
 void xf_event_push(xfEventQueue* event_queue, xfEvent* event);
 xfEvent* xf_event_peek(xfEventQueue* event_queue);
 xfEvent* xf_event_pop(xfEventQueue* event_queue);
 
-xfEventRegion* xf_event_region_new(int x, int y, int width, int height);
-void xf_event_region_free(xfEventRegion* event_region);
+xfEventFrame* xf_event_frame_new(xfFrame* frame);
+void xf_event_frame_free(xfEventFrame* event_frame);
 
 xfEvent* xf_event_new(int type);
 void xf_event_free(xfEvent* event);
@@ -47,7 +47,7 @@ void xf_input_keyboard_event(rdpInput* input, UINT16 flags, UINT16 code)
 
 	if (keycode != 0)
 	{
-		pthread_mutex_lock(&(xfp->mutex));
+		pthread_mutex_lock(&(xfi->mutex));
 
 		XTestGrabControl(xfi->display, True);
 
@@ -58,7 +58,7 @@ void xf_input_keyboard_event(rdpInput* input, UINT16 flags, UINT16 code)
 
 		XTestGrabControl(xfi->display, False);
 
-		pthread_mutex_unlock(&(xfp->mutex));
+		pthread_mutex_unlock(&(xfi->mutex));
 	}
 #endif
 }
@@ -76,7 +76,7 @@ void xf_input_mouse_event(rdpInput* input, UINT16 flags, UINT16 x, UINT16 y)
 	BOOL down = FALSE;
 	xfInfo* xfi = xfp->info;
 
-	pthread_mutex_lock(&(xfp->mutex));
+	pthread_mutex_lock(&(xfi->mutex));
 	XTestGrabControl(xfi->display, True);
 
 	if (flags & PTR_FLAGS_WHEEL)
@@ -111,7 +111,7 @@ void xf_input_mouse_event(rdpInput* input, UINT16 flags, UINT16 x, UINT16 y)
 	}
 
 	XTestGrabControl(xfi->display, False);
-	pthread_mutex_unlock(&(xfp->mutex));
+	pthread_mutex_unlock(&(xfi->mutex));
 #endif
 }
 
@@ -121,11 +121,11 @@ void xf_input_extended_mouse_event(rdpInput* input, UINT16 flags, UINT16 x, UINT
 	xfPeerContext* xfp = (xfPeerContext*) input->context;
 	xfInfo* xfi = xfp->info;
 
-	pthread_mutex_lock(&(xfp->mutex));
+	pthread_mutex_lock(&(xfi->mutex));
 	XTestGrabControl(xfi->display, True);
 	XTestFakeMotionEvent(xfi->display, 0, x, y, CurrentTime);
 	XTestGrabControl(xfi->display, False);
-	pthread_mutex_unlock(&(xfp->mutex));
+	pthread_mutex_unlock(&(xfi->mutex));
 #endif
 }
 
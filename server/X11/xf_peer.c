@@ -40,6 +40,7 @@
 #include <freerdp/utils/file.h>
 #include <freerdp/utils/sleep.h>
 #include <freerdp/utils/thread.h>
+#include <winpr/interlocked.h>
 
 extern char* xf_pcap_file;
 extern BOOL xf_pcap_dump_realtime;
@@ -247,6 +248,8 @@ xfInfo* xf_info_init()
 
 	xfi->clrconv = freerdp_clrconv_new(CLRCONV_ALPHA | CLRCONV_INVERT);
 
+	pthread_mutex_init(&(xfi->mutex), NULL);
+
 	XSelectInput(xfi->display, xfi->root_window, SubstructureNotifyMask);
 
 #ifdef WITH_XDAMAGE
@@ -264,13 +267,10 @@ xfInfo* xf_info_init()
 
 void xf_peer_context_new(freerdp_peer* client, xfPeerContext* context)
 {
-	context->info = xf_info_init();
-	context->rfx_context = rfx_context_new();
-	context->rfx_context->mode = RLGR3;
-	context->rfx_context->width = context->info->width;
-	context->rfx_context->height = context->info->height;
-
-	rfx_context_set_pixel_format(context->rfx_context, RDP_PIXEL_FORMAT_B8G8R8A8);
+	context->encoder = xf_encoder;
+	context->info = xf_encoder->info;
+	context->rfx_mode = RLGR3;
+	context->missed = gdi_RegionNew();
 
 	context->s = stream_new(65536);
 }
@@ -280,13 +280,12 @@ void xf_peer_context_free(freerdp_peer* client, xfPeerContext* context)
 	if (context)
 	{
 		stream_free(context->s);
-		rfx_context_free(context->rfx_context);
+		gdi_RegionFree(context->missed);
 	}
 }
 
 void xf_peer_init(freerdp_peer* client)
 {
-	xfInfo* xfi;
 	xfPeerContext* xfp;
 
 	client->context_size = sizeof(xfPeerContext);
@@ -296,15 +295,9 @@ void xf_peer_init(freerdp_peer* client)
 
 	xfp = (xfPeerContext*) client->context;
 
-	xfp->fps = 24;
-	xfp->thread = 0;
 	xfp->activations = 0;
 	xfp->event_queue = xf_event_queue_new();
-
-	xfi = xfp->info;
-	xfp->hdc = gdi_CreateDC(xfi->clrconv, xfi->bpp);
-
-	pthread_mutex_init(&(xfp->mutex), NULL);
+	xfp->stats_time = xf_encoder_now_us();
 }
 
 STREAM* xf_peer_stream_init(xfPeerContext* context)
@@ -319,7 +312,7 @@ void xf_peer_live_rfx(freerdp_peer* client)
 	xfPeerContext* xfp = (xfPeerContext*) client->context;
 
 	if (xfp->activations == 1)
-		pthread_create(&(xfp->thread), 0, xf_monitor_updates, (void*) client);
+		xf_encoder_subscribe(xfp->encoder, xfp);
 }
 
 static BOOL xf_peer_sleep_tsdiff(UINT32 *old_sec, UINT32 *old_usec, UINT32 new_sec, UINT32 new_usec)
@@ -397,79 +390,104 @@ void xf_peer_dump_rfx(freerdp_peer* client)
 	}
 }
 
-void xf_peer_rfx_update(freerdp_peer* client, int x, int y, int width, int height)
+/**
+ * Send an encoded frame shared with the other peers. The RemoteFX header
+ * goes in front of the first message sent after each activation.
+ */
+
+void xf_peer_send_frame(freerdp_peer* client, xfFrame* frame)
 {
 	STREAM* s;
 	BYTE* data;
-	xfInfo* xfi;
-	RFX_RECT rect;
-	XImage* image;
+	UINT32 length;
 	rdpUpdate* update;
 	xfPeerContext* xfp;
 	SURFACE_BITS_COMMAND* cmd;
+	SURFACE_FRAME_MARKER marker;
 
 	update = client->update;
 	xfp = (xfPeerContext*) client->context;
 	cmd = &update->surface_bits_command;
-	xfi = xfp->info;
 
-	if (width * height <= 0)
-		return;
+	data = stream_get_head(frame->s);
+	length = stream_get_length(frame->s);
+
+	if (!xfp->header_sent)
+	{
+		s = xf_peer_stream_init(xfp);
+		stream_check_size(s, stream_get_length(frame->header) + length);
+		stream_write(s, stream_get_head(frame->header), stream_get_length(frame->header));
+		stream_write(s, data, length);
 
-	s = xf_peer_stream_init(xfp);
+		data = stream_get_head(s);
+		length = stream_get_length(s);
 
-	if (xfi->use_xshm)
+		xfp->header_sent = TRUE;
+	}
+
+	cmd->destLeft = frame->x;
+	cmd->destTop = frame->y;
+	cmd->destRight = frame->x + frame->width;
+	cmd->destBottom = frame->y + frame->height;
+
+	cmd->bpp = 32;
+	cmd->codecID = client->settings->RemoteFxCodecId;
+	cmd->width = frame->width;
+	cmd->height = frame->height;
+	cmd->bitmapDataLength = length;
+	cmd->bitmapData = data;
+
+	if (xfp->max_unacked_frames > 0)
 	{
-		/**
-		 * Passing an offset source rectangle to rfx_compose_message()
-		 * leads to protocol errors, so offset the data pointer instead.
-		 */
-		rect.x = 0;
-		rect.y = 0;
-		rect.width = width;
-		rect.height = height;
-
-		image = xf_snapshot(xfp, x, y, width, height);
-
-		data = (BYTE*) image->data;
-		data = &data[(y * image->bytes_per_line) + (x * image->bits_per_pixel / 8)];
-
-		rfx_compose_message(xfp->rfx_context, s, &rect, 1, data,
-				width, height, image->bytes_per_line);
-
-		cmd->destLeft = x;
-		cmd->destTop = y;
-		cmd->destRight = x + width;
-		cmd->destBottom = y + height;
+		xfp->frame_id++;
+		xfp->frame_sent_time[xfp->frame_id % XF_PEER_ACK_WINDOW] = xf_encoder_now_us();
+		InterlockedIncrement(&(xfp->unacked_frames));
+
+		marker.frameId = xfp->frame_id;
+		marker.frameAction = SURFACECMD_FRAMEACTION_BEGIN;
+		update->SurfaceFrameMarker(update->context, &marker);
+
+		update->SurfaceBits(update->context, cmd);
+
+		marker.frameAction = SURFACECMD_FRAMEACTION_END;
+		update->SurfaceFrameMarker(update->context, &marker);
 	}
 	else
 	{
-		rect.x = 0;
-		rect.y = 0;
-		rect.width = width;
-		rect.height = height;
+		update->SurfaceBits(update->context, cmd);
+	}
+}
 
-		image = xf_snapshot(xfp, x, y, width, height);
+/**
+ * Account for the frames the client acknowledged since the last call and
+ * keep a running average of how long it takes to acknowledge a frame.
+ */
 
-		rfx_compose_message(xfp->rfx_context, s, &rect, 1,
-				(BYTE*) image->data, width, height, width * xfi->bytesPerPixel);
+static BOOL xf_peer_check_ack(freerdp_peer* client)
+{
+	UINT64 rtt;
+	UINT32 unacked;
+	xfPeerContext* xfp = (xfPeerContext*) client->context;
 
-		cmd->destLeft = x;
-		cmd->destTop = y;
-		cmd->destRight = x + width;
-		cmd->destBottom = y + height;
+	if ((xfp->max_unacked_frames < 1) || (client->ack_frame_id == xfp->ack_frame_id))
+		return FALSE;
+
+	unacked = xfp->frame_id - client->ack_frame_id;
+
+	/* ignore acknowledgements for frames that were never sent */
+	if (unacked > xfp->frame_id - xfp->ack_frame_id)
+		return FALSE;
 
-		XDestroyImage(image);
+	if (unacked < XF_PEER_ACK_WINDOW)
+	{
+		rtt = xf_encoder_now_us() - xfp->frame_sent_time[client->ack_frame_id % XF_PEER_ACK_WINDOW];
+		xfp->ack_rtt_us = (xfp->ack_rtt_us > 0) ? ((xfp->ack_rtt_us * 7) + rtt) / 8 : rtt;
 	}
 
-	cmd->bpp = 32;
-	cmd->codecID = client->settings->RemoteFxCodecId;
-	cmd->width = width;
-	cmd->height = height;
-	cmd->bitmapDataLength = stream_get_length(s);
-	cmd->bitmapData = stream_get_head(s);
+	xfp->ack_frame_id = client->ack_frame_id;
+	InterlockedExchange(&(xfp->unacked_frames), (LONG) unacked);
 
-	update->SurfaceBits(update->context, cmd);
+	return TRUE;
 }
 
 BOOL xf_peer_get_fds(freerdp_peer* client, void** rfds, int* rcount)
@@ -485,44 +503,64 @@ BOOL xf_peer_get_fds(freerdp_peer* client, void** rfds, int* rcount)
 	return TRUE;
 }
 
+static void xf_peer_print_stats(freerdp_peer* client)
+{
+	char name[64];
+	xfPeerContext* xfp = (xfPeerContext*) client->context;
+
+	sprintf_s(name, sizeof(name), "%s wait", client->hostname);
+	xf_stage_stats_print(name, &xfp->wait_stats);
+	sprintf_s(name, sizeof(name), "%s send", client->hostname);
+	xf_stage_stats_print(name, &xfp->send_stats);
+	sprintf_s(name, sizeof(name), "%s capture to sent", client->hostname);
+	xf_stage_stats_print(name, &xfp->latency_stats);
+}
+
 BOOL xf_peer_check_fds(freerdp_peer* client)
 {
-	xfInfo* xfi;
+	UINT64 start;
+	UINT64 end;
+	xfFrame* frame;
 	xfEvent* event;
 	xfPeerContext* xfp;
-	HGDI_RGN invalid_region;
+	xfEventFrame* event_frame;
 
 	xfp = (xfPeerContext*) client->context;
-	xfi = xfp->info;
 
 	if (xfp->activated == FALSE)
 		return TRUE;
 
+	if (xf_peer_check_ack(client))
+		xf_encoder_peer_ready(xfp->encoder, xfp);
+
 	event = xf_event_peek(xfp->event_queue);
 
 	if (event != NULL)
 	{
-		if (event->type == XF_EVENT_TYPE_REGION)
-		{
-			xfEventRegion* region = (xfEventRegion*) xf_event_pop(xfp->event_queue);
-			gdi_InvalidateRegion(xfp->hdc, region->x, region->y, region->width, region->height);
-			xf_event_region_free(region);
-		}
-		else if (event->type == XF_EVENT_TYPE_FRAME_TICK)
+		if (event->type == XF_EVENT_TYPE_FRAME)
 		{
-			event = xf_event_pop(xfp->event_queue);
-			invalid_region = xfp->hdc->hwnd->invalid;
+			event_frame = (xfEventFrame*) xf_event_pop(xfp->event_queue);
+			frame = event_frame->frame;
+
+			start = xf_encoder_now_us();
+			xf_peer_send_frame(client, frame);
+			end = xf_encoder_now_us();
 
-			if (invalid_region->null == FALSE)
+			xf_stage_stats_add(&xfp->wait_stats, start - frame->encode_time);
+			xf_stage_stats_add(&xfp->send_stats, end - start);
+			xf_stage_stats_add(&xfp->latency_stats, end - frame->capture_time);
+
+			if (end - xfp->stats_time >= XF_ENCODER_STATS_INTERVAL * 1000000)
 			{
-				xf_peer_rfx_update(client, invalid_region->x, invalid_region->y,
-					invalid_region->w, invalid_region->h);
+				xf_peer_print_stats(client);
+				xfp->stats_time = end;
 			}
 
-			invalid_region->null = 1;
-			xfp->hdc->hwnd->ninvalid = 0;
+			InterlockedDecrement(&(xfp->pending_frames));
+			xf_frame_release(frame);
+			xf_event_frame_free(event_frame);
 
-			xf_event_free(event);
+			xf_encoder_peer_ready(xfp->encoder, xfp);
 		}
 	}
 
@@ -584,9 +622,16 @@ BOOL xf_peer_activate(freerdp_peer* client)
 {
 	xfPeerContext* xfp = (xfPeerContext*) client->context;
 
-	rfx_context_reset(xfp->rfx_context);
+	xfp->header_sent = FALSE;
 	xfp->activated = TRUE;
 
+	/* how many frames the client lets go unacknowledged, 0 if it does not acknowledge */
+	xfp->max_unacked_frames = client->settings->FrameAcknowledge;
+
+	xfp->frame_id = client->ack_frame_id;
+	xfp->ack_frame_id = client->ack_frame_id;
+	xfp->unacked_frames = 0;
+
 	if (xf_pcap_file != NULL)
 	{
 		client->update->dump_rfx = TRUE;
@@ -613,6 +658,7 @@ void* xf_peer_main_loop(void* arg)
 	char* server_file_path;
 	freerdp_peer* client = (freerdp_peer*) arg;
 	xfPeerContext* xfp;
+	xfEvent* event;
 
 	memset(rfds, 0, sizeof(rfds));
 
@@ -639,6 +685,9 @@ void* xf_peer_main_loop(void* arg)
 
 	settings->RemoteFxCodec = TRUE;
 
+	/* replaced by the value of clients that acknowledge frames */
+	settings->FrameAcknowledge = 0;
+
 	client->Capabilities = xf_peer_capabilities;
 	client->PostConnect = xf_peer_post_connect;
 	client->Activate = xf_peer_activate;
@@ -703,16 +752,27 @@ void* xf_peer_main_loop(void* arg)
 		}
 	}
 
-	printf("Client %s disconnected.\n", client->hostname);
+	printf("Client %s disconnected (%d frames dropped).\n", client->hostname, xfp->frames_dropped);
 
 	client->Disconnect(client);
-	
-	pthread_cancel(xfp->thread);
-	pthread_cancel(xfp->frame_rate_thread);
-	
-	pthread_join(xfp->thread, NULL);
-	pthread_join(xfp->frame_rate_thread, NULL);
-	
+
+	xf_encoder_unsubscribe(xfp->encoder, xfp);
+
+	while ((event = xf_event_pop(xfp->event_queue)) != NULL)
+	{
+		if (event->type == XF_EVENT_TYPE_FRAME)
+		{
+			xf_frame_release(((xfEventFrame*) event)->frame);
+			xf_event_frame_free((xfEventFrame*) event);
+		}
+		else
+		{
+			xf_event_free(event);
+		}
+	}
+
+	xf_event_queue_free(xfp->event_queue);
+
 	freerdp_peer_context_free(client);
 	freerdp_peer_free(client);
 
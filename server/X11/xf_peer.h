@@ -30,25 +30,45 @@
 
 typedef struct xf_peer_context xfPeerContext;
 
+/* send times kept to measure how long clients take to acknowledge frames */
+#define XF_PEER_ACK_WINDOW	16
+
 #include "xfreerdp.h"
+#include "xf_encode.h"
 
 struct xf_peer_context
 {
 	rdpContext _p;
 
-	int fps;
 	STREAM* s;
-	HGDI_DC hdc;
 	xfInfo* info;
 	int activations;
-	pthread_t thread;
 	BOOL activated;
-	pthread_mutex_t mutex;
-	RFX_CONTEXT* rfx_context;
 	xfEventQueue* event_queue;
-	pthread_t frame_rate_thread;
+
+	xfEncoder* encoder;
+	RLGR_MODE rfx_mode;
+	BOOL header_sent;
+	HGDI_REGION missed;
+	LONG pending_frames;
+	UINT32 frames_dropped;
+
+	UINT32 frame_id;
+	UINT32 ack_frame_id;
+	LONG unacked_frames;
+	UINT32 max_unacked_frames;
+	UINT64 ack_rtt_us;
+	UINT64 frame_sent_time[XF_PEER_ACK_WINDOW];
+
+	UINT64 stats_time;
+	xfStageStats wait_stats;
+	xfStageStats send_stats;
+	xfStageStats latency_stats;
 };
 
+extern xfEncoder* xf_encoder;
+
+xfInfo* xf_info_init();
 void xf_peer_accepted(freerdp_listener* instance, freerdp_peer* client);
 
 #endif /* __XF_PEER_H */
@@ -31,10 +31,12 @@
 #include <sys/signal.h>
 
 #include "xf_peer.h"
+#include "xf_encode.h"
 #include "xfreerdp.h"
 
 char* xf_pcap_file = NULL;
 BOOL xf_pcap_dump_realtime = TRUE;
+xfEncoder* xf_encoder = NULL;
 
 void xf_server_main_loop(freerdp_listener* instance)
 {
@@ -112,6 +114,9 @@ int main(int argc, char* argv[])
 	if (argc > 2 && !strcmp(argv[2], "--fast"))
 		xf_pcap_dump_realtime = FALSE;
 
+	/* all peers share one capture of the display and one encoder per codec */
+	xf_encoder = xf_encoder_new(xf_info_init());
+
 	/* Open the server socket and start listening. */
 	if (instance->Open(instance, NULL, 3389))
 	{
@@ -120,6 +125,7 @@ int main(int argc, char* argv[])
 	}
 
 	freerdp_listener_free(instance);
+	xf_encoder_free(xf_encoder);
 
 	return 0;
 }
@@ -20,6 +20,8 @@
 #ifndef __XFREERDP_H
 #define __XFREERDP_H
 
+#include <pthread.h>
+
 #include <freerdp/codec/color.h>
 
 #ifdef WITH_XSHM
@@ -58,6 +60,7 @@ struct xf_info
 	int bytesPerPixel;
 	HCLRCONV clrconv;
 	BOOL use_xshm;
+	pthread_mutex_t mutex;
 
 	XImage* fb_image;
 	Pixmap fb_pixmap;
@@ -32,6 +32,38 @@
 
 #ifndef _WIN32
 
+#include <sched.h>
+
+/**
+ * The states of an INIT_ONCE, kept in its pointer: NULL before the first
+ * call, WINPR_INIT_ONCE_BUSY while a thread runs the function, and the
+ * context it returned with WINPR_INIT_ONCE_DONE set once it has run. The
+ * context has to be aligned to 4 bytes for both bits to be free, as on
+ * Windows.
+ */
+#define WINPR_INIT_ONCE_DONE	0x1
+#define WINPR_INIT_ONCE_BUSY	0x2
+
+#ifdef __ATOMIC_ACQUIRE
+#define winpr_init_once_load(_once)		__atomic_load_n(&(_once)->Ptr, __ATOMIC_ACQUIRE)
+#define winpr_init_once_store(_once, _value)	__atomic_store_n(&(_once)->Ptr, _value, __ATOMIC_RELEASE)
+#else
+static PVOID winpr_init_once_load(PINIT_ONCE InitOnce)
+{
+	PVOID value = *((PVOID volatile*) &InitOnce->Ptr);
+
+	__sync_synchronize();
+
+	return value;
+}
+
+static void winpr_init_once_store(PINIT_ONCE InitOnce, PVOID value)
+{
+	__sync_synchronize();
+	*((PVOID volatile*) &InitOnce->Ptr) = value;
+}
+#endif
+
 BOOL InitOnceBeginInitialize(LPINIT_ONCE lpInitOnce, DWORD dwFlags, PBOOL fPending, LPVOID* lpContext)
 {
 	return TRUE;
@@ -42,14 +74,59 @@ BOOL InitOnceComplete(LPINIT_ONCE lpInitOnce, DWORD dwFlags, LPVOID lpContext)
 	return TRUE;
 }
 
+/**
+ * Runs InitFn exactly once for InitOnce, no matter how many threads get
+ * here at the same time; the others wait until it has returned. Once it
+ * has, a call is a single load without any lock. No lock is held while
+ * InitFn runs, so that it may run other functions once itself. A failing
+ * InitFn leaves InitOnce untouched, so that the next call tries again.
+ */
+
 BOOL InitOnceExecuteOnce(PINIT_ONCE InitOnce, PINIT_ONCE_FN InitFn, PVOID Parameter, LPVOID* Context)
 {
+	BOOL status;
+	PVOID state;
+	PVOID InitContext = NULL;
+
+	while (1)
+	{
+		state = winpr_init_once_load(InitOnce);
+
+		if ((ULONG_PTR) state & WINPR_INIT_ONCE_DONE)
+		{
+			if (Context)
+				*Context = (PVOID) ((ULONG_PTR) state & ~((ULONG_PTR) WINPR_INIT_ONCE_DONE));
+
+			return TRUE;
+		}
+
+		if ((state == NULL) &&
+			__sync_bool_compare_and_swap(&InitOnce->Ptr, NULL, (PVOID) WINPR_INIT_ONCE_BUSY))
+			break;
+
+		/* another thread runs InitFn */
+		sched_yield();
+	}
+
+	status = InitFn(InitOnce, Parameter, &InitContext);
+
+	if (!status)
+	{
+		winpr_init_once_store(InitOnce, NULL);
+		return FALSE;
+	}
+
+	winpr_init_once_store(InitOnce, (PVOID) ((ULONG_PTR) InitContext | WINPR_INIT_ONCE_DONE));
+
+	if (Context)
+		*Context = InitContext;
+
 	return TRUE;
 }
 
 VOID InitOnceInitialize(PINIT_ONCE InitOnce)
 {
-
+	InitOnce->Ptr = NULL;
 }
 
 #endif
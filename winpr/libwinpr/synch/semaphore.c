@@ -45,9 +45,9 @@ HANDLE CreateSemaphoreW(LPSECURITY_ATTRIBUTES lpSemaphoreAttributes, LONG lIniti
 	if (semaphore)
 	{
 #if defined __APPLE__
-		semaphore_create(mach_task_self(), semaphore, SYNC_POLICY_FIFO, lMaximumCount);
+		semaphore_create(mach_task_self(), semaphore, SYNC_POLICY_FIFO, lInitialCount);
 #else
-		sem_init(semaphore, 0, lMaximumCount);
+		sem_init(semaphore, 0, lInitialCount);
 #endif
 	}
 
@@ -81,11 +81,15 @@ BOOL ReleaseSemaphore(HANDLE hSemaphore, LONG lReleaseCount, LPLONG lpPreviousCo
 
 	if (Type == HANDLE_TYPE_SEMAPHORE)
 	{
+		while (lReleaseCount-- > 0)
+		{
 #if defined __APPLE__
-		semaphore_signal(*((winpr_sem_t*) Object));
+			semaphore_signal(*((winpr_sem_t*) Object));
 #else
-		sem_post((winpr_sem_t*) Object);
+			sem_post((winpr_sem_t*) Object);
 #endif
+		}
+
 		return TRUE;
 	}
 